@@ -8,9 +8,12 @@ const EventDispatcher = require('../utils/eventDispatcher');
 const { getAfiAndSafi } = require('../utils/bgpUtils');
 const { shell } = require('electron');
 const { importMrtFile } = require('../utils/routeViewsUtils');
+const { SnapshotView } = require('../utils/columnarSnapshot');
 class BgpApp {
     constructor(ipc, store) {
         this.worker = null;
+        // 地址族 -> { version, view }，worker 发来的路由快照，翻页时直接从快照取数据
+        this.routeSnapshots = new Map();
         this.bgpConfigFileKey = 'bgp-config';
         this.ipv4PeerConfigFileKey = 'ipv4-peer-config';
         this.ipv6PeerConfigFileKey = 'ipv6-peer-config';
@@ -304,6 +307,7 @@ class BgpApp {
 
             const workerFactory = new WorkerWithPromise(workerPath);
             this.worker = workerFactory.createLongRunningWorker();
+            this.routeSnapshots.clear();
 
             // 设置事件发送器的 webContents
             this.eventDispatcher = new EventDispatcher();
@@ -350,6 +354,7 @@ class BgpApp {
             this.worker.removeEventListener(BgpConst.BGP_EVT_TYPES.BGP_PEER_CHANGE, this.peerChangeHandler);
             await this.worker.terminate();
             this.worker = null;
+            this.routeSnapshots.clear();
             this.eventDispatcher.cleanup(); // 清理事件发送器
             this.eventDispatcher = null;
         }
@@ -459,13 +464,20 @@ class BgpApp {
         logger.info(`addressFamily: ${addressFamily}, page: ${page}, pageSize: ${pageSize}`);
 
         try {
+            // 带上已有快照的版本号，路由表没有变化时 worker 不再重新生成快照
+            let entry = this.routeSnapshots.get(addressFamily);
             const result = await this.worker.sendRequest(BgpConst.BGP_REQ_TYPES.GET_ROUTES, {
                 addressFamily,
-                page,
-                pageSize
+                version: entry ? entry.version : null
             });
-            logger.info(`获取路由列表成功 result: ${JSON.stringify(result)}`);
-            return successResponse(result.data, '获取路由信息成功');
+            if (result.data.snapshot) {
+                entry = { version: result.data.version, view: new SnapshotView(result.data.snapshot) };
+                this.routeSnapshots.set(addressFamily, entry);
+            }
+
+            const list = entry.view.rows((page - 1) * pageSize, page * pageSize);
+            logger.info(`获取路由列表成功 version: ${entry.version}, total: ${entry.view.length}`);
+            return successResponse({ list, total: entry.view.length }, '获取路由信息成功');
         } catch (error) {
             logger.error('Error getting routes:', error.message);
             return errorResponse(error.message);
@@ -39,6 +39,7 @@ class BmpApp {
         this.ipcMain.handle('bmp:getBgpRoutes', this.handleGetBgpRoutes.bind(this));
         this.ipcMain.handle('bmp:getBgpInstances', this.handleGetBgpInstances.bind(this));
         this.ipcMain.handle('bmp:getBgpInstanceRoutes', this.handleGetBgpInstanceRoutes.bind(this));
+        this.ipcMain.handle('bmp:exportMrt', this.handleExportMrt.bind(this));
     }
 
     async handleSaveBmpConfig(event, config) {
@@ -251,13 +252,13 @@ class BmpApp {
         }
     }
 
-    async handleGetBgpRoutes(event, client, session, af, ribType, page, pageSize) {
+    async handleGetBgpRoutes(event, client, session, af, ribType, page, pageSize, query) {
         if (null === this.worker) {
             return successResponse([], 'BMP未启动');
         }
 
         logger.info(
-            `获取路由列表 client: ${JSON.stringify(client)} session: ${JSON.stringify(session)} af: ${JSON.stringify(af)} ribType: ${JSON.stringify(ribType)} page: ${JSON.stringify(page)} pageSize: ${JSON.stringify(pageSize)}`
+            `获取路由列表 client: ${JSON.stringify(client)} session: ${JSON.stringify(session)} af: ${JSON.stringify(af)} ribType: ${JSON.stringify(ribType)} page: ${JSON.stringify(page)} pageSize: ${JSON.stringify(pageSize)} query: ${JSON.stringify(query)}`
         );
 
         try {
@@ -267,7 +268,8 @@ class BmpApp {
                 af,
                 ribType,
                 page,
-                pageSize
+                pageSize,
+                query
             });
             logger.info(`获取路由列表成功 result: ${JSON.stringify(result)}`);
             return successResponse(result.data, '获取路由列表成功');
@@ -277,13 +279,13 @@ class BmpApp {
         }
     }
 
-    async handleGetBgpInstanceRoutes(event, client, instance, page, pageSize) {
+    async handleGetBgpInstanceRoutes(event, client, instance, page, pageSize, query) {
         if (null === this.worker) {
             return successResponse([], 'BMP未启动');
         }
 
         logger.info(
-            `获取BGP实例路由列表 client: ${JSON.stringify(client)} instance: ${JSON.stringify(instance)} page: ${JSON.stringify(page)} pageSize: ${JSON.stringify(pageSize)}`
+            `获取BGP实例路由列表 client: ${JSON.stringify(client)} instance: ${JSON.stringify(instance)} page: ${JSON.stringify(page)} pageSize: ${JSON.stringify(pageSize)} query: ${JSON.stringify(query)}`
         );
 
         try {
@@ -291,7 +293,8 @@ class BmpApp {
                 client,
                 instance,
                 page,
-                pageSize
+                pageSize,
+                query
             });
             logger.info(`获取BGP实例路由列表成功 result: ${JSON.stringify(result)}`);
             return successResponse(result.data, '获取BGP实例路由列表成功');
@@ -301,6 +304,42 @@ class BmpApp {
         }
     }
 
+    async handleExportMrt(event, client, session, af, ribType) {
+        if (null === this.worker) {
+            return errorResponse('BMP未启动');
+        }
+
+        const { dialog } = require('electron');
+        const result = await dialog.showSaveDialog({
+            defaultPath: `rib.${session.sessionIp.replace(/:/g, '_')}.${Date.now()}.mrt`,
+            filters: [
+                { name: 'MRT Files', extensions: ['mrt', 'gz'] },
+                { name: 'All Files', extensions: ['*'] }
+            ]
+        });
+        if (result.canceled || !result.filePath) {
+            return successResponse(null, '取消导出');
+        }
+
+        logger.info(
+            `导出MRT client: ${JSON.stringify(client)} session: ${JSON.stringify(session)} af: ${af} ribType: ${ribType} file: ${result.filePath}`
+        );
+
+        try {
+            const exportResult = await this.worker.sendRequest(BmpConst.BMP_REQ_TYPES.EXPORT_MRT, {
+                client,
+                session,
+                af,
+                ribType,
+                filePath: result.filePath
+            });
+            return successResponse(exportResult.data, exportResult.msg);
+        } catch (error) {
+            logger.error('Error exporting MRT:', error.message);
+            return errorResponse(error.message);
+        }
+    }
+
     async handleGetBgpInstances(event, client) {
         if (null === this.worker) {
             return successResponse([], 'BMP未启动');
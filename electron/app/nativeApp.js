@@ -3,10 +3,13 @@ const { successResponse, errorResponse } = require('../utils/responseUtils');
 const logger = require('../log/logger');
 const fs = require('fs');
 const os = require('os');
-const { DEFAULT_TOOLS_SETTINGS } = require('../const/toolsConst');
+const path = require('path');
+const { DEFAULT_TOOLS_SETTINGS, PACKET_CAPTURE_SETTINGS, TOOLS_REQ_TYPES } = require('../const/toolsConst');
 const iconv = require('iconv-lite');
 const EventDispatcher = require('../utils/eventDispatcher');
 const { getIconPath } = require('../utils/iconUtils');
+const PacketCaptureRing = require('../utils/packetCaptureRing');
+const WorkerWithPromise = require('../worker/workerWithPromise');
 class NativeApp {
     constructor(ipc, store) {
         this.isDev = !app.isPackaged;
@@ -15,7 +18,10 @@ class NativeApp {
         // 抓包相关变量初始化 - 移到主进程
         this.capSession = null;
         this.isCapturing = false;
-        this.packetHistory = []; // 存储抓包历史
+        this.packetRing = null; // 抓包历史，第一次抓包时创建
+        this.captureStats = null;
+        this.flushTimer = null;
+        this.pcapWorker = null; // 离线抓包文件解析 worker，打开文件时创建
 
         this.formatterConfigFileKey = 'formatter';
 
@@ -64,6 +70,14 @@ class NativeApp {
             this.handleExportPacketsToPcap(event, packets)
         );
         ipc.handle('native:getPacketHistory', async () => this.handleGetPacketHistory());
+        ipc.handle('native:getCaptureStats', async () => this.handleGetCaptureStats());
+        ipc.handle('native:parseCapturedPackets', async (event, config) =>
+            this.handleParseCapturedPackets(event, config)
+        );
+        ipc.handle('native:openPcapFile', async (event, config) => this.handleOpenPcapFile(event, config));
+        ipc.handle('native:getPcapPackets', async (event, page) => this.handleGetPcapPackets(event, page));
+        ipc.handle('native:getPcapPacketTree', async (event, id) => this.handleGetPcapPacketTree(event, id));
+        ipc.handle('native:closePcapFile', async () => this.handleClosePcapFile());
 
         // 格式化工具
         ipc.handle('native:formatData', async (event, data) => this.handleFormatData(event, data));
@@ -80,7 +94,135 @@ class NativeApp {
     }
 
     async handleGetPacketHistory() {
-        return successResponse(this.packetHistory || [], '获取抓包历史成功');
+        if (!this.packetRing) {
+            return successResponse([], '获取抓包历史成功');
+        }
+        const from = this.packetRing.next - PACKET_CAPTURE_SETTINGS.historyLimit;
+        return successResponse(this.packetRing.records(from), '获取抓包历史成功');
+    }
+
+    async handleGetCaptureStats() {
+        return successResponse(this.getCaptureStats(), '获取抓包统计成功');
+    }
+
+    /**
+     * 解析抓到的报文
+     *
+     * 报文以二进制形式拷贝到一块共享内存中整批交给解析 worker，不经过十六进制字符串转换。
+     * @param {Object} config { ids, startLayer, protocolType, protocolPort }
+     */
+    async handleParseCapturedPackets(event, config) {
+        try {
+            const ids = config.ids || [];
+            if (!this.packetRing || ids.length === 0) {
+                return errorResponse('报文不存在');
+            }
+
+            const { block, packets, missing } = this.packetRing.extract(ids);
+            if (packets.length === 0) {
+                return errorResponse('报文已被新的报文覆盖');
+            }
+
+            const workerPath = this.isDev
+                ? path.join(__dirname, '../worker/packetParserWorker.js')
+                : path.join(process.resourcesPath, 'app', 'electron/worker/packetParserWorker.js');
+
+            const workerFactory = new WorkerWithPromise(workerPath);
+            const result = await workerFactory.runWorkerWithPromise(workerPath, {
+                protocolType: config.protocolType,
+                protocolPort: config.protocolPort,
+                startLayer: config.startLayer,
+                block,
+                packets
+            });
+
+            return successResponse({ results: result.results, missing }, '报文解析成功');
+        } catch (err) {
+            logger.error('报文解析错误:', err.message);
+            return errorResponse(err.message);
+        }
+    }
+
+    /**
+     * 打开离线抓包文件，在 worker 中建立报文索引
+     * @param {Object} config { protocolPort } BGP 端口，用于识别需要重组的 TCP 流
+     */
+    async handleOpenPcapFile(event, config) {
+        try {
+            const result = await dialog.showOpenDialog({
+                title: '打开抓包文件',
+                properties: ['openFile'],
+                filters: [
+                    { name: 'Capture Files', extensions: ['pcap', 'pcapng', 'cap'] },
+                    { name: 'All Files', extensions: ['*'] }
+                ],
+                icon: getIconPath()
+            });
+            if (result.canceled || result.filePaths.length === 0) {
+                return errorResponse('用户取消打开');
+            }
+
+            if (!this.pcapWorker) {
+                const workerPath = this.isDev
+                    ? path.join(__dirname, '../worker/pcapWorker.js')
+                    : path.join(process.resourcesPath, 'app', 'electron/worker/pcapWorker.js');
+                this.pcapWorker = new WorkerWithPromise(workerPath).createLongRunningWorker();
+            }
+
+            const openResult = await this.pcapWorker.sendRequest(TOOLS_REQ_TYPES.OPEN_PCAP, {
+                filePath: result.filePaths[0],
+                bgpPort: config?.protocolPort
+            });
+            return successResponse(openResult.data, openResult.msg);
+        } catch (err) {
+            logger.error('打开抓包文件错误:', err.message);
+            return errorResponse(err.message);
+        }
+    }
+
+    /**
+     * 分页获取抓包文件中的报文摘要
+     * @param {Object} page { start, count }
+     */
+    async handleGetPcapPackets(event, page) {
+        if (!this.pcapWorker) {
+            return errorResponse('没有打开的抓包文件');
+        }
+        try {
+            const result = await this.pcapWorker.sendRequest(TOOLS_REQ_TYPES.GET_PCAP_PACKETS, page);
+            return successResponse(result.data, result.msg);
+        } catch (err) {
+            logger.error('获取抓包文件报文错误:', err.message);
+            return errorResponse(err.message);
+        }
+    }
+
+    // 按需生成抓包文件中某个报文的解析树
+    async handleGetPcapPacketTree(event, id) {
+        if (!this.pcapWorker) {
+            return errorResponse('没有打开的抓包文件');
+        }
+        try {
+            const result = await this.pcapWorker.sendRequest(TOOLS_REQ_TYPES.GET_PCAP_PACKET_TREE, { id });
+            return successResponse(result.data, result.msg);
+        } catch (err) {
+            logger.error('解析抓包文件报文错误:', err.message);
+            return errorResponse(err.message);
+        }
+    }
+
+    async handleClosePcapFile() {
+        if (!this.pcapWorker) {
+            return successResponse(null, '关闭抓包文件成功');
+        }
+        try {
+            await this.pcapWorker.sendRequest(TOOLS_REQ_TYPES.CLOSE_PCAP, null);
+            await this.pcapWorker.terminate();
+        } catch (err) {
+            logger.error('关闭抓包文件错误:', err.message);
+        }
+        this.pcapWorker = null;
+        return successResponse(null, '关闭抓包文件成功');
     }
 
     async handleGetFormatterHistory() {
@@ -298,14 +440,28 @@ class NativeApp {
                 throw new Error('未找到可用的网络接口');
             }
 
-            const bufSize = 10 * 1024 * 1024;
+            const bufSize = PACKET_CAPTURE_SETTINGS.bufferSize;
             const buffer = Buffer.alloc(bufSize);
 
             const linkType = this.capSession.open(device, filter || '', bufSize, buffer);
 
             this.isCapturing = true;
-            let packetCount = 0;
-            this.packetHistory = []; // 清空历史
+            if (!this.packetRing) {
+                this.packetRing = new PacketCaptureRing(
+                    PACKET_CAPTURE_SETTINGS.ringBytes,
+                    PACKET_CAPTURE_SETTINGS.ringSlots
+                );
+            }
+            this.packetRing.reset(); // 清空历史
+            this.captureStats = {
+                device,
+                startTime: Date.now(),
+                bytes: 0,
+                truncated: 0,
+                uiSkipped: 0,
+                flushedId: 1, // 下一个待推送到界面的报文编号
+                rxDropped: this.readInterfaceDropped(device)
+            };
 
             this.eventDispatcher = new EventDispatcher();
             this.eventDispatcher.setWebContents(webContents);
@@ -322,44 +478,19 @@ class NativeApp {
 
             this.capSession.setMinBytes && this.capSession.setMinBytes(0);
 
+            // 回调里只把报文拷贝进环形缓冲区，由定时器批量推送到界面
+            const ring = this.packetRing;
+            const stats = this.captureStats;
             this.capSession.on('packet', (nbytes, trunc) => {
-                try {
-                    const timestamp = new Date();
-                    packetCount++;
-
-                    logger.info(`Captured packet: ${nbytes} bytes`);
-
-                    let packetInfo = {
-                        id: packetCount,
-                        timestamp: timestamp.toISOString(),
-                        length: nbytes,
-                        truncated: trunc,
-                        raw: buffer.toString('hex', 0, nbytes)
-                    };
-
-                    // 保存到历史记录
-                    this.packetHistory.push(packetInfo);
-                    if (this.packetHistory.length > 5000) {
-                        this.packetHistory.shift();
-                    }
-
-                    this.eventDispatcher.emit(
-                        'native:packetEvent',
-                        successResponse({
-                            type: 'PACKET_CAPTURED',
-                            packet: packetInfo
-                        })
-                    );
-                } catch (err) {
-                    this.eventDispatcher.emit(
-                        'native:packetEvent',
-                        errorResponse(err.message, {
-                            type: 'PACKET_ERROR'
-                        })
-                    );
+                ring.push(buffer, nbytes, trunc, Date.now());
+                stats.bytes += nbytes;
+                if (trunc) {
+                    stats.truncated++;
                 }
             });
 
+            this.flushTimer = setInterval(() => this.flushCapturedPackets(), PACKET_CAPTURE_SETTINGS.flushInterval);
+
             logger.info('启动抓包成功:', { device, linkType, originalDeviceName: deviceName });
             return successResponse(null, '抓包启动成功');
         } catch (err) {
@@ -368,8 +499,11 @@ class NativeApp {
                 this.capSession.close();
                 this.capSession = null;
             }
-            this.eventDispatcher.cleanup();
-            this.eventDispatcher = null;
+            this.stopFlushTimer();
+            if (this.eventDispatcher) {
+                this.eventDispatcher.cleanup();
+                this.eventDispatcher = null;
+            }
             logger.error('启动抓包错误:', err.message);
             return errorResponse(`启动抓包失败: ${err.message}`);
         }
@@ -382,17 +516,106 @@ class NativeApp {
                 this.capSession = null;
             }
             this.isCapturing = false;
-            logger.info('抓包已停止');
+            this.stopFlushTimer();
+            // 推送停止前最后一批报文
+            if (this.eventDispatcher) {
+                this.flushCapturedPackets();
+            }
+            logger.info('抓包已停止', this.getCaptureStats());
             return successResponse(null, '抓包已停止');
         } catch (err) {
             logger.error('停止抓包错误:', err.message);
             return errorResponse(err.message);
         } finally {
-            this.eventDispatcher.cleanup();
-            this.eventDispatcher = null;
+            if (this.eventDispatcher) {
+                this.eventDispatcher.cleanup();
+                this.eventDispatcher = null;
+            }
         }
     }
 
+    stopFlushTimer() {
+        if (this.flushTimer) {
+            clearInterval(this.flushTimer);
+            this.flushTimer = null;
+        }
+    }
+
+    /**
+     * 把上次推送之后新抓到的报文批量推送到界面
+     *
+     * 每批最多 batchLimit 个，超出时只推送最新的报文，其余的仍保留在环形缓冲区中，
+     * 只在统计里计数。
+     */
+    flushCapturedPackets() {
+        const ring = this.packetRing;
+        const stats = this.captureStats;
+        if (ring.next === stats.flushedId) {
+            return;
+        }
+
+        let from = Math.max(stats.flushedId, ring.first);
+        if (ring.next - from > PACKET_CAPTURE_SETTINGS.batchLimit) {
+            from = ring.next - PACKET_CAPTURE_SETTINGS.batchLimit;
+        }
+        stats.uiSkipped += from - stats.flushedId;
+        stats.flushedId = ring.next;
+
+        try {
+            this.eventDispatcher.emit(
+                'native:packetEvent',
+                successResponse({
+                    type: 'PACKET_BATCH',
+                    packets: ring.records(from),
+                    stats: this.getCaptureStats()
+                })
+            );
+        } catch (err) {
+            this.eventDispatcher.emit(
+                'native:packetEvent',
+                errorResponse(err.message, {
+                    type: 'PACKET_ERROR'
+                })
+            );
+        }
+    }
+
+    /**
+     * 读取网卡的内核丢包计数，仅 Linux 支持
+     */
+    readInterfaceDropped(device) {
+        if (process.platform !== 'linux') {
+            return null;
+        }
+        try {
+            return parseInt(fs.readFileSync(`/sys/class/net/${device}/statistics/rx_dropped`, 'utf8'), 10);
+        } catch (_) {
+            return null;
+        }
+    }
+
+    getCaptureStats() {
+        const stats = this.captureStats;
+        if (!stats) {
+            return null;
+        }
+
+        const ring = this.packetRing;
+        const rxDropped = stats.rxDropped === null ? null : this.readInterfaceDropped(stats.device);
+        return {
+            device: stats.device,
+            running: this.isCapturing,
+            duration: Date.now() - stats.startTime,
+            packets: ring.next - 1,
+            bytes: stats.bytes,
+            truncated: stats.truncated,
+            retained: ring.count,
+            evicted: ring.evicted,
+            uiSkipped: stats.uiSkipped,
+            kernelDropped: rxDropped === null ? null : rxDropped - stats.rxDropped
+        };
+    }
+
     async handleExportPacketsToPcap(event, packets) {
         try {
             if (!packets || packets.length === 0) {
@@ -6,6 +6,7 @@ const WorkerWithPromise = require('../worker/workerWithPromise');
 const { getNetworkAddress } = require('../utils/ipUtils');
 const RpkiConst = require('../const/rpkiConst');
 const EventDispatcher = require('../utils/eventDispatcher');
+const RpkiRoa = require('../worker/rpkiRoa');
 
 class RpkiApp {
     constructor(ipcMain, store, keychainManager) {
@@ -36,6 +37,7 @@ class RpkiApp {
 
         // roa
         this.ipcMain.handle('rpki:addRoa', this.handleAddRoa.bind(this));
+        this.ipcMain.handle('rpki:importRoaList', this.handleImportRoaList.bind(this));
         this.ipcMain.handle('rpki:deleteRoa', this.handleDeleteRoa.bind(this));
         this.ipcMain.handle('rpki:getRoaList', this.handleGetRoaList.bind(this));
     }
@@ -99,18 +101,11 @@ class RpkiApp {
 
             this.worker.addEventListener(RpkiConst.RPKI_EVT_TYPES.CLIENT_CONNECTION, this.rpkiClientConnectionHandler);
 
-            // 加载roa配置
+            // 加载roa配置，一次性导入，所有 ROA 在同一个序列号中生效
             const roaList = await this.handleGetRoaList();
             if (roaList.status === 'success') {
-                const roaListData = roaList.data;
-                for (const roa of roaListData) {
-                    const result = await this.worker.sendRequest(RpkiConst.RPKI_REQ_TYPES.ADD_ROA, roa);
-                    if (result.status === 'success') {
-                        logger.info(`worker RPKI ROA恢复成功: ${JSON.stringify(roa)}`);
-                    } else {
-                        logger.error(`worker RPKI ROA恢复失败: ${JSON.stringify(roa)} ${result.msg}`);
-                    }
-                }
+                const result = await this.worker.sendRequest(RpkiConst.RPKI_REQ_TYPES.ADD_ROA_LIST, roaList.data);
+                logger.info(`worker RPKI ROA恢复成功: ${JSON.stringify(result.data)}`);
             } else {
                 logger.error(`RPKI ROA配置加载失败: ${roaList.msg}`);
             }
@@ -205,6 +200,56 @@ class RpkiApp {
         return net1 === net2;
     }
 
+    makeRoaSameKey(roa) {
+        return `${roa.asn}|${roa.maxLength}|${roa.ipType}|${getNetworkAddress(roa.ip, roa.mask)}`;
+    }
+
+    async handleImportRoaList(event, roaList) {
+        try {
+            let currentRoaList = [];
+            const config = this.store.get(this.rpkiRoaFileKey);
+            if (config) {
+                currentRoaList = config;
+            }
+
+            logger.info(`handleImportRoaList: ${roaList.length} ROAs`);
+
+            // 与 isRoaSame 相同的判重规则，使用 Set 避免逐条线性查找
+            const existing = new Set(currentRoaList.map(item => this.makeRoaSameKey(item)));
+            const newRoaList = [];
+            let invalid = 0;
+            for (const roa of roaList) {
+                // 无效的 ROA 不保存，否则每次启动都会重新加载
+                const error = RpkiRoa.validate(roa);
+                if (error) {
+                    logger.error(`RPKI ROA配置无效: ${JSON.stringify(roa)} ${error}`);
+                    invalid++;
+                    continue;
+                }
+                const key = this.makeRoaSameKey(roa);
+                if (!existing.has(key)) {
+                    existing.add(key);
+                    newRoaList.push(roa);
+                }
+            }
+
+            if (this.worker && newRoaList.length > 0) {
+                const result = await this.worker.sendRequest(RpkiConst.RPKI_REQ_TYPES.ADD_ROA_LIST, newRoaList);
+                logger.info(`worker RPKI ROA批量添加成功: ${JSON.stringify(result.data)}`);
+            }
+
+            currentRoaList.push(...newRoaList);
+            this.store.set(this.rpkiRoaFileKey, currentRoaList);
+            return successResponse(
+                { added: newRoaList.length, skipped: roaList.length - newRoaList.length - invalid, invalid },
+                'RPKI ROA配置批量导入成功'
+            );
+        } catch (error) {
+            logger.error('Error importing ROA list:', error.message);
+            return errorResponse(error.message);
+        }
+    }
+
     async handleAddRoa(event, roa) {
         try {
             let currentRoaList = [];
@@ -30,6 +30,12 @@ class SnmpApp {
         this.ipcMain.handle('snmp:getSnmpConfig', this.handleGetSnmpConfig.bind(this));
         this.ipcMain.handle('snmp:startSnmp', this.handleStartSnmp.bind(this));
         this.ipcMain.handle('snmp:stopSnmp', this.handleStopSnmp.bind(this));
+        this.ipcMain.handle('snmp:getTrapList', this.handleGetTrapList.bind(this));
+        this.ipcMain.handle('snmp:getTrapStats', this.handleGetTrapStats.bind(this));
+        this.ipcMain.handle('snmp:clearTrapHistory', this.handleClearTrapHistory.bind(this));
+        this.ipcMain.handle('snmp:startPoll', this.handleStartPoll.bind(this));
+        this.ipcMain.handle('snmp:stopPoll', this.handleStopPoll.bind(this));
+        this.ipcMain.handle('snmp:getPollStatus', this.handleGetPollStatus.bind(this));
     }
 
     /**
@@ -95,6 +101,7 @@ class SnmpApp {
             };
 
             this.worker.addEventListener(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, this.snmpTrapEventHandler);
+            this.worker.addEventListener(SnmpConst.SNMP_EVT_TYPES.POLL_EVT, this.snmpTrapEventHandler);
 
             const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.START_SNMP, config);
 
@@ -109,6 +116,7 @@ class SnmpApp {
             }
         } catch (error) {
             this.worker.removeEventListener(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, this.snmpTrapEventHandler);
+            this.worker.removeEventListener(SnmpConst.SNMP_EVT_TYPES.POLL_EVT, this.snmpTrapEventHandler);
             if (this.worker) {
                 await this.worker.terminate();
                 this.worker = null;
@@ -139,6 +147,7 @@ class SnmpApp {
             return errorResponse('停止SNMP服务器失败: ' + error.message);
         } finally {
             this.worker.removeEventListener(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, this.snmpTrapEventHandler);
+            this.worker.removeEventListener(SnmpConst.SNMP_EVT_TYPES.POLL_EVT, this.snmpTrapEventHandler);
             if (this.worker) {
                 await this.worker.terminate();
                 this.worker = null;
@@ -148,6 +157,109 @@ class SnmpApp {
         }
     }
 
+    /**
+     * 获取最近的Trap（界面推送会在Trap风暴时合并，完整的最近记录从这里获取）
+     */
+    async handleGetTrapList(_event, limit) {
+        if (null === this.worker) {
+            return successResponse([], 'SNMP服务器未启动');
+        }
+
+        try {
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.GET_TRAP_LIST, { limit });
+            return successResponse(result.data, result.msg);
+        } catch (error) {
+            logger.error('获取Trap列表失败:', error);
+            return errorResponse('获取Trap列表失败: ' + error.message);
+        }
+    }
+
+    /**
+     * 获取按源地址和snmpTrapOID聚合的Trap统计
+     */
+    async handleGetTrapStats() {
+        if (null === this.worker) {
+            return successResponse(null, 'SNMP服务器未启动');
+        }
+
+        try {
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.GET_TRAP_STATS, null);
+            logger.info(`获取Trap统计成功: total=${result.data.total}, sources=${result.data.sources.length}`);
+            return successResponse(result.data, result.msg);
+        } catch (error) {
+            logger.error('获取Trap统计失败:', error);
+            return errorResponse('获取Trap统计失败: ' + error.message);
+        }
+    }
+
+    /**
+     * 清空Trap历史
+     */
+    async handleClearTrapHistory() {
+        if (null === this.worker) {
+            return successResponse(null, 'SNMP服务器未启动');
+        }
+
+        try {
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.CLEAR_TRAP_HISTORY, null);
+            return successResponse(null, result.msg);
+        } catch (error) {
+            logger.error('清空Trap历史失败:', error);
+            return errorResponse('清空Trap历史失败: ' + error.message);
+        }
+    }
+
+    /**
+     * 启动GETBULK轮询，结果通过 snmp:event 批量推送
+     * @param {Object} config { agents: [{ host, port, version, community }], oids: [], interval, timeout,
+     *                          retries, maxRepetitions, maxOutstanding }
+     */
+    async handleStartPoll(_event, config) {
+        if (null === this.worker) {
+            return errorResponse('SNMP服务器未启动');
+        }
+
+        try {
+            logger.info(`启动SNMP轮询: ${config.agents.length} 个代理, OID: ${config.oids.join(',')}`);
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.START_POLL, config);
+            if (result.status !== 'success') {
+                return errorResponse(result.msg);
+            }
+            return successResponse(null, result.msg);
+        } catch (error) {
+            logger.error('启动SNMP轮询失败:', error);
+            return errorResponse('启动SNMP轮询失败: ' + error.message);
+        }
+    }
+
+    async handleStopPoll() {
+        if (null === this.worker) {
+            return successResponse(null, 'SNMP服务器未启动');
+        }
+
+        try {
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.STOP_POLL, null);
+            return successResponse(null, result.msg);
+        } catch (error) {
+            logger.error('停止SNMP轮询失败:', error);
+            return errorResponse('停止SNMP轮询失败: ' + error.message);
+        }
+    }
+
+    async handleGetPollStatus() {
+        if (null === this.worker) {
+            return successResponse({ running: false }, 'SNMP服务器未启动');
+        }
+
+        try {
+            const result = await this.worker.sendRequest(SnmpConst.SNMP_REQ_TYPES.GET_POLL_STATUS, null);
+            return successResponse(result.data, result.msg);
+        } catch (error) {
+            logger.error('获取SNMP轮询状态失败:', error);
+            return errorResponse('获取SNMP轮询状态失败: ' + error.message);
+        }
+    }
+
     /**
      * 获取SNMP服务运行状态
      */
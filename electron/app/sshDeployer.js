@@ -129,18 +129,23 @@ class SshDeployer {
                 }
 
                 // 根据文件名决定上传到哪个目录
-                let targetDir;
-                if (file.includes('tcp-ao')) {
-                    targetDir = tempAoDir;
+                let targetDirs;
+                if (file.includes('tcp-proxy')) {
+                    // 两个 helper 共用的转发引擎
+                    targetDirs = [tempMd5Dir, tempAoDir];
+                } else if (file.includes('tcp-ao')) {
+                    targetDirs = [tempAoDir];
                 } else if (file.includes('tcp-md5')) {
-                    targetDir = tempMd5Dir;
+                    targetDirs = [tempMd5Dir];
                 } else {
                     // 默认上传到两个目录（如通用工具脚本）
-                    targetDir = tempMd5Dir;
+                    targetDirs = [tempMd5Dir];
                 }
 
-                await this.uploadFile(localPath, `${targetDir}/${file}`);
-                logger.info(`Uploaded ${file} to ${targetDir}`);
+                for (const targetDir of targetDirs) {
+                    await this.uploadFile(localPath, `${targetDir}/${file}`);
+                    logger.info(`Uploaded ${file} to ${targetDir}`);
+                }
             }
 
             // 创建目标目录并移动文件
@@ -165,19 +170,35 @@ class SshDeployer {
                 logger.info('gcc installed successfully');
             }
 
+            // USDT 探针需要 <sys/sdt.h>，没有时 helper 照常编译，只是不带探针
+            try {
+                await this.execCommand(
+                    'test -f /usr/include/sys/sdt.h || sudo yum install -y systemtap-sdt-devel || sudo apt-get install -y systemtap-sdt-dev'
+                );
+            } catch (error) {
+                logger.warn('sys/sdt.h not available, helpers will be built without USDT probes');
+            }
+
             // Compile TCP MD5 helper
+            // 先编译到 .new 再 rename，正在运行的 helper 不受影响，随后通过 upgrade 热替换
             logger.info('Compiling TCP MD5 helper...');
-            await this.execCommand(`sudo gcc -g -o ${md5ProxyDir}/tcp-md5-helper ${md5ProxyDir}/tcp-md5-helper.c`);
+            await this.execCommand(
+                `cd ${md5ProxyDir} && sudo gcc -g -pthread -o tcp-md5-helper.new tcp-md5-helper.c tcp-proxy-engine.c tcp-proxy-mirror.c tcp-proxy-recorder.c tcp-proxy-resume.c tcp-proxy-sched.c tcp-proxy-latency.c tcp-proxy-fastpath.c tcp-proxy-bmp.c tcp-proxy-filter.c && sudo mv -f tcp-md5-helper.new tcp-md5-helper`
+            );
             logger.info('TCP MD5 helper compiled successfully');
+            // 录制文件回放工具，两种 helper 的录制格式相同
+            await this.execCommand(`cd ${md5ProxyDir} && sudo gcc -O2 -o tcp-proxy-replay tcp-proxy-replay.c`);
+            await this.upgradeRunningProxies(`${md5ProxyDir}/tcp-md5-proxy.sh`);
 
             // Try to compile TCP-AO helper
             logger.info('Attempting to compile TCP-AO helper...');
             try {
                 await this.execCommand(
-                    `cd ${aoProxyDir} && sudo gcc -o tcp-ao-helper tcp-ao-helper.c tcp-ao-json-parser.c -std=c99`
+                    `cd ${aoProxyDir} && sudo gcc -pthread -o tcp-ao-helper.new tcp-ao-helper.c tcp-ao-json-parser.c tcp-proxy-engine.c tcp-proxy-mirror.c tcp-proxy-recorder.c tcp-proxy-resume.c tcp-proxy-sched.c tcp-proxy-latency.c tcp-proxy-fastpath.c tcp-proxy-bmp.c tcp-proxy-filter.c -std=c99 && sudo mv -f tcp-ao-helper.new tcp-ao-helper`
                 );
                 logger.info('TCP-AO helper compiled successfully');
                 logger.info('✅ TCP-AO is available on this system');
+                await this.upgradeRunningProxies(`${aoProxyDir}/tcp-ao-proxy.sh`);
             } catch (error) {
                 logger.warn('TCP-AO compilation failed (kernel may not support TCP-AO)');
             }
@@ -201,6 +222,23 @@ class SshDeployer {
         }
     }
 
+    /**
+     * Hot-upgrade helpers that are already running so the new binary takes over
+     * their listen sockets and established router sessions
+     * @param {string} scriptPath - Proxy script path
+     */
+    async upgradeRunningProxies(scriptPath) {
+        for (const protocol of ['daemon', 'bmp', 'bgp', 'rpki']) {
+            try {
+                const output = await this.execCommand(`sudo ${scriptPath} ${protocol} upgrade`);
+                logger.info(`Upgraded ${protocol} proxy: ${output.trim()}`);
+            } catch (error) {
+                // 未运行的代理无需升级
+                logger.info(`Skip upgrading ${protocol} proxy: ${error.message}`);
+            }
+        }
+    }
+
     /**
      * Disable firewall on remote server
      */
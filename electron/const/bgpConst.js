@@ -11,6 +11,13 @@ const BGP_VERSION = 4;
 // BGP marker length (16 bytes of 0xff)
 const BGP_MARKER_LEN = 16;
 
+// 会话定时器的精度(毫秒)
+const BGP_TIMER_TICK = 100;
+// 默认保持时间(秒)
+const BGP_DEFAULT_HOLD_TIME = 180;
+// 发出 OPEN 后等待对端 OPEN 的保持时间(秒)，RFC 4271 建议 4 分钟
+const BGP_OPEN_SENT_HOLD_TIME = 240;
+
 const BGP_RD_LEN = 8;
 
 const IP_HOST_BYTE_LEN = 4;
@@ -85,6 +92,7 @@ const BGP_AFI_TYPE = {
 // 协议规定的safi
 const BGP_SAFI_TYPE = {
     SAFI_UNICAST: 1,
+    SAFI_LABELED_UNICAST: 4,
     SAFI_MVPN: 5,
     SAFI_EVPN: 70,
     SAFI_VPN: 128,
@@ -298,6 +306,9 @@ module.exports = {
     BGP_HEAD_LEN,
     BGP_MAX_PKT_SIZE,
     BGP_VERSION,
+    BGP_TIMER_TICK,
+    BGP_DEFAULT_HOLD_TIME,
+    BGP_OPEN_SENT_HOLD_TIME,
     IP_HOST_BYTE_LEN,
     IPV6_HOST_BYTE_LEN,
     IP_HOST_LEN,
@@ -70,7 +70,8 @@ const BMP_REQ_TYPES = {
     GET_BGP_SESSIONS: 4,
     GET_BGP_ROUTES: 5,
     GET_BGP_INSTANCES: 6,
-    GET_BGP_INSTANCE_ROUTES: 7
+    GET_BGP_INSTANCE_ROUTES: 7,
+    EXPORT_MRT: 8
 };
 
 const BMP_BGP_RIB_TYPE = {
@@ -5,7 +5,7 @@ const DHCP6_EVT_TYPES = {
 
 // DHCPv6 子事件类型
 const DHCP6_SUB_EVT_TYPES = {
-    DHCP6_SUB_EVT_LEASE: 1 // 租约变更（add/remove/update）
+    DHCP6_SUB_EVT_LEASE_BATCH: 1 // 一个推送周期内的租约变更（add/remove/update）
 };
 
 // DHCPv6 请求-响应类型（app -> worker）
@@ -69,6 +69,15 @@ const DEFAULT_DHCP6_CONFIG = {
     dns2: '2001:4860:4860::8844'
 };
 
+// 租约引擎参数
+const DEFAULT_DHCP6_SETTINGS = {
+    offerHoldMs: 30000, // 发出 ADVERTISE 后为客户端预留地址的时间
+    flushInterval: 200, // 批量推送租约变更的间隔(毫秒)
+    timerTickMs: 1000, // 租约到期的定时精度(毫秒)
+    maxPoolSize: 1 << 24, // 地址池最多管理的地址个数，更大的池只使用开头的这一段
+    socketBufferSize: 4 * 1024 * 1024 // UDP 收发缓冲区，大量客户端同时上线时减少丢包
+};
+
 module.exports = {
     DHCP6_EVT_TYPES,
     DHCP6_SUB_EVT_TYPES,
@@ -76,5 +85,6 @@ module.exports = {
     DHCP6_MSG_TYPES,
     DHCP6_OPTS,
     DHCP6_STATUS,
-    DEFAULT_DHCP6_CONFIG
+    DEFAULT_DHCP6_CONFIG,
+    DEFAULT_DHCP6_SETTINGS
 };
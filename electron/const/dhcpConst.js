@@ -5,7 +5,7 @@ const DHCP_EVT_TYPES = {
 
 // DHCP子事件类型
 const DHCP_SUB_EVT_TYPES = {
-    DHCP_SUB_EVT_LEASE: 1, // 租约变更（add/remove/update）
+    DHCP_SUB_EVT_LEASE_BATCH: 1, // 一个推送周期内的租约变更（add/remove/update）
     DHCP_SUB_EVT_LOG: 2 // 日志事件
 };
 
@@ -42,10 +42,20 @@ const DEFAULT_DHCP_CONFIG = {
     leaseTime: 86400 // 24小时（秒）
 };
 
+// 租约引擎参数
+const DEFAULT_DHCP_SETTINGS = {
+    offerHoldMs: 30000, // 发出 OFFER 后为客户端预留地址的时间
+    flushInterval: 200, // 批量推送租约变更的间隔(毫秒)
+    timerTickMs: 1000, // 租约到期的定时精度(毫秒)
+    maxPoolSize: 1 << 24, // 地址池最多包含的地址个数
+    socketBufferSize: 4 * 1024 * 1024 // UDP 收发缓冲区，大量客户端同时上线时减少丢包
+};
+
 module.exports = {
     DHCP_EVT_TYPES,
     DHCP_SUB_EVT_TYPES,
     DHCP_REQ_TYPES,
     DHCP_MSG_TYPES,
-    DEFAULT_DHCP_CONFIG
+    DEFAULT_DHCP_CONFIG,
+    DEFAULT_DHCP_SETTINGS
 };
@@ -16,7 +16,10 @@ const FTP_REQ_TYPES = {
 };
 
 const DEFAULT_FTP_SETTINGS = {
-    maxFtpUser: 10
+    maxFtpUser: 10,
+    transferChunkSize: 1024 * 1024, // 数据连接每次读写文件的块大小
+    fileCacheMaxFileSize: 128 * 1024 * 1024, // 超过此大小的文件下载时不缓存
+    fileCacheMaxTotal: 512 * 1024 * 1024 // 下载文件缓存的总大小
 };
 
 module.exports = {
@@ -3,7 +3,7 @@ const NTP_EVT_TYPES = {
 };
 
 const NTP_SUB_EVT_TYPES = {
-    REQUEST_RECEIVED: 1,
+    REQUEST_BATCH: 1, // 一个推送周期内的新请求
     SERVER_STATUS: 2,
     HISTORY_CLEARED: 3
 };
@@ -37,7 +37,11 @@ const DEFAULT_NTP_CONFIG = {
 
 const DEFAULT_NTP_SETTINGS = {
     maxHistory: 200,
-    precision: -20
+    precision: -20,
+    flushInterval: 200, // 批量推送请求日志的间隔(毫秒)
+    batchLimit: 50, // 每次最多推送的请求条数，其余只计数
+    clockResyncMs: 2, // 高精度时钟与系统时间相差超过该值(毫秒)时重新对齐
+    socketBufferSize: 4 * 1024 * 1024 // UDP 收发缓冲区，突发请求时减少丢包
 };
 
 module.exports = {
@@ -59,6 +59,14 @@ const RPKI_ROA_STATUS = {
 // Default RPKI Port
 const RPKI_DEFAULT_PORT = 8282;
 
+// RPKI 缓存保留的增量序列号个数，超出后 Serial Query 回复 Cache Reset
+const RPKI_CACHE_MAX_DELTAS = 64;
+
+// End of Data (v1) 中携带的定时器（秒）
+const RPKI_REFRESH_INTERVAL = 3600;
+const RPKI_RETRY_INTERVAL = 600;
+const RPKI_EXPIRE_INTERVAL = 7200;
+
 // 事件类型
 const RPKI_EVT_TYPES = {
     CLIENT_CONNECTION: 1
@@ -70,7 +78,8 @@ const RPKI_REQ_TYPES = {
     STOP_RPKI: 2,
     ADD_ROA: 3,
     DELETE_ROA: 4,
-    GET_CLIENT_LIST: 5
+    GET_CLIENT_LIST: 5,
+    ADD_ROA_LIST: 6
 };
 
 module.exports = {
@@ -82,6 +91,10 @@ module.exports = {
     RPKI_FLAGS,
     RPKI_ROA_STATUS,
     RPKI_DEFAULT_PORT,
+    RPKI_CACHE_MAX_DELTAS,
+    RPKI_REFRESH_INTERVAL,
+    RPKI_RETRY_INTERVAL,
+    RPKI_EXPIRE_INTERVAL,
     RPKI_EVT_TYPES,
     RPKI_REQ_TYPES
 };
@@ -1,6 +1,7 @@
 // SNMP事件类型
 const SNMP_EVT_TYPES = {
-    TRAP_EVT: 1
+    TRAP_EVT: 1,
+    POLL_EVT: 2
 };
 
 const SNMP_SUB_EVT_TYPES = {
@@ -9,7 +10,9 @@ const SNMP_SUB_EVT_TYPES = {
     AGENT_DISCONNECTION: 3,
     TRAP_PROCESSED: 4,
     TRAP_ERROR: 5,
-    SERVER_STATUS: 6
+    SERVER_STATUS: 6,
+    TRAP_BATCH: 7,
+    POLL_RESULT: 8
 };
 
 // SNMP请求-响应类型
@@ -19,7 +22,11 @@ const SNMP_REQ_TYPES = {
     GET_TRAP_LIST: 3,
     GET_TRAP_DETAIL: 4,
     CLEAR_TRAP_HISTORY: 5,
-    UPDATE_CONFIG: 6
+    UPDATE_CONFIG: 6,
+    GET_TRAP_STATS: 7,
+    START_POLL: 8,
+    STOP_POLL: 9,
+    GET_POLL_STATUS: 10
 };
 
 // SNMP版本
@@ -56,6 +63,27 @@ const DEFAULT_SNMP_SETTINGS = {
     timeout: 5000
 };
 
+// Trap 风暴处理
+const SNMP_TRAP_RECV_BUFFER_SIZE = 4 * 1024 * 1024; // UDP 接收缓冲，吸收突发
+const SNMP_TRAP_EMIT_INTERVAL = 200; // 向界面推送 Trap 的最小间隔(ms)
+const SNMP_TRAP_EMIT_LIMIT = 200; // 每次最多推送给界面的 Trap 数，其余只计数
+const SNMP_TRAP_MAX_OIDS = 65536; // OID 驻留表上限
+const SNMP_TRAP_MAX_AGGREGATES = 10000; // 源地址 + snmpTrapOID 聚合计数条目上限
+
+// GETBULK 轮询
+const SNMP_POLL_DEFAULTS = {
+    interval: 60, // 轮询周期(s)
+    timeout: 2000, // 单个请求超时(ms)，重试时按次数递增
+    retries: 2,
+    maxRepetitions: 25, // 初始值，之后按代理自适应
+    maxOutstanding: 256 // 全局在途请求上限
+};
+const SNMP_POLL_MAX_REPETITIONS = 100;
+const SNMP_POLL_GROW_BYTES = 1000; // 响应小于该字节数时增大 max-repetitions
+const SNMP_POLL_TICK = 50; // 超时时间轮 tick(ms)
+const SNMP_POLL_EMIT_INTERVAL = 200; // 向界面推送轮询结果的最小间隔(ms)
+const SNMP_POLL_BATCH_ROWS = 5000; // 累计到该行数时立即推送
+
 const SNMP_BER_ASN1_TAG = {
     SEQUENCE: 0x30,
     INTEGER: 0x02,
@@ -77,6 +105,17 @@ module.exports = {
     SNMP_PDU_TYPE,
     SNMP_SECURITY_LEVEL,
     DEFAULT_SNMP_SETTINGS,
+    SNMP_TRAP_RECV_BUFFER_SIZE,
+    SNMP_TRAP_EMIT_INTERVAL,
+    SNMP_TRAP_EMIT_LIMIT,
+    SNMP_TRAP_MAX_OIDS,
+    SNMP_TRAP_MAX_AGGREGATES,
+    SNMP_POLL_DEFAULTS,
+    SNMP_POLL_MAX_REPETITIONS,
+    SNMP_POLL_GROW_BYTES,
+    SNMP_POLL_TICK,
+    SNMP_POLL_EMIT_INTERVAL,
+    SNMP_POLL_BATCH_ROWS,
     SNMP_SUB_EVT_TYPES,
     SNMP_BER_ASN1_TAG
 };
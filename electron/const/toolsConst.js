@@ -26,6 +26,25 @@ const DEFAULT_TOOLS_SETTINGS = {
     }
 };
 
+// 抓包参数
+const PACKET_CAPTURE_SETTINGS = {
+    bufferSize: 10 * 1024 * 1024, // 底层抓包缓冲区大小
+    ringBytes: 32 * 1024 * 1024, // 报文环形缓冲区大小
+    ringSlots: 20000, // 报文环形缓冲区最多保留的报文个数
+    historyLimit: 5000, // 界面最多展示的报文个数
+    flushInterval: 200, // 批量推送报文到界面的间隔(毫秒)
+    batchLimit: 1000 // 每次最多推送到界面的报文个数，超出部分只计数
+};
+
+// 离线抓包文件解析设置
+const PCAP_INGEST_SETTINGS = {
+    chunkSize: 4 * 1024 * 1024, // 顺序读文件时每次读取的字节数
+    maxWorkers: 4, // 并行解析的 worker 个数上限
+    packetsPerWorker: 50000, // 报文数少于此值时不再拆分给更多 worker
+    maxPendingSegments: 64, // TCP 重组时每个方向最多缓存的乱序报文段
+    pageSize: 500 // 每页报文摘要个数上限
+};
+
 // 默认日志设置
 const DEFAULT_LOG_SETTINGS = {
     logLevel: 'warn'
@@ -46,20 +65,27 @@ const PACKET_SUB_EVT_TYPES = {
     PACKET_CAPTURED: 1,
     PACKET_ERROR: 2,
     PACKET_CAPTURE_START: 3,
-    PACKET_CAPTURE_STOP: 4
+    PACKET_CAPTURE_STOP: 4,
+    PACKET_BATCH: 5
 };
 
 // 工具请求-响应类型
 const TOOLS_REQ_TYPES = {
     START_CAPTURE: 1,
     STOP_CAPTURE: 2,
-    GET_NETWORK_INTERFACES: 3
+    GET_NETWORK_INTERFACES: 3,
+    OPEN_PCAP: 4,
+    GET_PCAP_PACKETS: 5,
+    GET_PCAP_PACKET_TREE: 6,
+    CLOSE_PCAP: 7
 };
 
 module.exports = {
     PROTOCOL_TYPE,
     START_LAYER,
     DEFAULT_TOOLS_SETTINGS,
+    PACKET_CAPTURE_SETTINGS,
+    PCAP_INGEST_SETTINGS,
     DEFAULT_LOG_SETTINGS,
     DEFAULT_UPDATE_SETTINGS,
     TOOLS_EVT_TYPES,
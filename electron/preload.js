@@ -129,11 +129,12 @@ contextBridge.exposeInMainWorld('bmpApi', {
     // 数据获取
     getClientList: () => ipcRenderer.invoke('bmp:getClientList'),
     getBgpSessions: client => ipcRenderer.invoke('bmp:getBgpSessions', client),
-    getBgpRoutes: (client, session, af, ribType, page, pageSize) =>
-        ipcRenderer.invoke('bmp:getBgpRoutes', client, session, af, ribType, page, pageSize),
+    getBgpRoutes: (client, session, af, ribType, page, pageSize, query) =>
+        ipcRenderer.invoke('bmp:getBgpRoutes', client, session, af, ribType, page, pageSize, query),
     getBgpInstances: client => ipcRenderer.invoke('bmp:getBgpInstances', client),
-    getBgpInstanceRoutes: (client, instance, page, pageSize) =>
-        ipcRenderer.invoke('bmp:getBgpInstanceRoutes', client, instance, page, pageSize)
+    getBgpInstanceRoutes: (client, instance, page, pageSize, query) =>
+        ipcRenderer.invoke('bmp:getBgpInstanceRoutes', client, instance, page, pageSize, query),
+    exportMrt: (client, session, af, ribType) => ipcRenderer.invoke('bmp:exportMrt', client, session, af, ribType)
 });
 
 // rpki模块
@@ -148,6 +149,7 @@ contextBridge.exposeInMainWorld('rpkiApi', {
 
     // roa操作
     addRoa: roa => ipcRenderer.invoke('rpki:addRoa', roa),
+    importRoaList: roaList => ipcRenderer.invoke('rpki:importRoaList', roaList),
     deleteRoa: roa => ipcRenderer.invoke('rpki:deleteRoa', roa),
     getRoaList: () => ipcRenderer.invoke('rpki:getRoaList'),
     getClientList: () => ipcRenderer.invoke('rpki:getClientList')
@@ -188,7 +190,17 @@ contextBridge.exposeInMainWorld('snmpApi', {
 
     // snmp服务
     startSnmp: config => ipcRenderer.invoke('snmp:startSnmp', config),
-    stopSnmp: () => ipcRenderer.invoke('snmp:stopSnmp')
+    stopSnmp: () => ipcRenderer.invoke('snmp:stopSnmp'),
+
+    // trap
+    getTrapList: limit => ipcRenderer.invoke('snmp:getTrapList', limit),
+    getTrapStats: () => ipcRenderer.invoke('snmp:getTrapStats'),
+    clearTrapHistory: () => ipcRenderer.invoke('snmp:clearTrapHistory'),
+
+    // getbulk 轮询
+    startPoll: config => ipcRenderer.invoke('snmp:startPoll', config),
+    stopPoll: () => ipcRenderer.invoke('snmp:stopPoll'),
+    getPollStatus: () => ipcRenderer.invoke('snmp:getPollStatus')
 });
 
 // ntp模块
@@ -210,7 +222,13 @@ contextBridge.exposeInMainWorld('nativeApi', {
     startPacketCapture: config => ipcRenderer.invoke('native:startPacketCapture', config),
     stopPacketCapture: () => ipcRenderer.invoke('native:stopPacketCapture'),
     getPacketHistory: () => ipcRenderer.invoke('native:getPacketHistory'),
+    getCaptureStats: () => ipcRenderer.invoke('native:getCaptureStats'),
+    parseCapturedPackets: config => ipcRenderer.invoke('native:parseCapturedPackets', config),
     exportPacketsToPcap: packets => ipcRenderer.invoke('native:exportPacketsToPcap', packets),
+    openPcapFile: config => ipcRenderer.invoke('native:openPcapFile', config),
+    getPcapPackets: page => ipcRenderer.invoke('native:getPcapPackets', page),
+    getPcapPacketTree: id => ipcRenderer.invoke('native:getPcapPacketTree', id),
+    closePcapFile: () => ipcRenderer.invoke('native:closePcapFile'),
 
     // 格式化工具模块
     formatData: formatterData => ipcRenderer.invoke('native:formatData', formatterData),
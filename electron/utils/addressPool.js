@@ -0,0 +1,86 @@
+/**
+ * 地址池空闲位图
+ *
+ * 池中的地址按相对池起点的偏移编号，每个地址占一位，置 1 表示已分配或已预留。
+ * 分配时从上次分配的位置往后按 32 位整字查找第一个空闲位(next-fit)，已满的字直接跳过，
+ * 不再逐个地址转换成字符串去查表。最后一个字中超出池大小的位初始化为已占用，查找时无需判断越界。
+ */
+
+class AddressPool {
+    /**
+     * @param {number} size 池中的地址个数
+     */
+    constructor(size) {
+        this.size = size;
+        this.words = new Uint32Array(Math.ceil(size / 32));
+        this.used = 0;
+        this.cursor = 0; // 下次开始查找的字
+        this.clear();
+    }
+
+    get freeCount() {
+        return this.size - this.used;
+    }
+
+    isFree(offset) {
+        return (this.words[offset >>> 5] & (1 << (offset & 31))) === 0;
+    }
+
+    /**
+     * 占用指定地址
+     * @returns {boolean} 地址原本空闲时返回 true
+     */
+    reserve(offset) {
+        if (offset < 0 || offset >= this.size || !this.isFree(offset)) {
+            return false;
+        }
+        this.words[offset >>> 5] |= 1 << (offset & 31);
+        this.used++;
+        return true;
+    }
+
+    release(offset) {
+        if (offset < 0 || offset >= this.size || this.isFree(offset)) {
+            return;
+        }
+        this.words[offset >>> 5] &= ~(1 << (offset & 31));
+        this.used--;
+    }
+
+    /**
+     * 分配一个空闲地址
+     * @returns {number} 地址偏移，池已满时返回 -1
+     */
+    allocate() {
+        if (this.used >= this.size) {
+            return -1;
+        }
+        const words = this.words;
+        const count = words.length;
+        for (let n = 0, i = this.cursor; n < count; n++, i = i + 1 === count ? 0 : i + 1) {
+            const word = words[i];
+            if (word === 0xffffffff) {
+                continue;
+            }
+            // 最低的 0 位
+            const bit = 31 - Math.clz32(~word & (word + 1));
+            words[i] = word | (1 << bit);
+            this.used++;
+            this.cursor = i;
+            return i * 32 + bit;
+        }
+        return -1;
+    }
+
+    clear() {
+        this.words.fill(0);
+        const tail = this.size & 31;
+        if (tail !== 0) {
+            this.words[this.words.length - 1] = ~((1 << tail) - 1);
+        }
+        this.used = 0;
+        this.cursor = 0;
+    }
+}
+
+module.exports = AddressPool;
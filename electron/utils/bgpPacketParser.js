@@ -1122,5 +1122,7 @@ function getBgpPacketSummary(parsedPacket) {
 module.exports = {
     parseBgpPacket,
     getBgpPacketSummary,
-    parsePathAttributes
+    parsePathAttributes,
+    parseMpReachNlri,
+    parseMpUnreachNlri
 };
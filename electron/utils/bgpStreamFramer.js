@@ -0,0 +1,101 @@
+/**
+ * 从重组后的 TCP 字节流中切分 BGP 报文
+ *
+ * 数据由 TcpStream 按序交付，每段带有所在报文的编号。切出一条 BGP 报文时记录它的起始序列号、
+ * 长度，以及组成它的数据来自哪些报文(最小和最大编号)，以便之后按需重新拼出这条报文。
+ * 流不是从报文边界开始(抓包从连接中途开始或有数据丢失)时，按 16 字节全 1 的标记重新同步。
+ */
+
+const BgpConst = require('../const/bgpConst');
+const { seqDiff } = require('./tcpStream');
+
+const MARKER = Buffer.alloc(16, 0xff);
+
+class BgpStreamFramer {
+    /**
+     * @param {Function} onMessage ({ startSeq, length, type, firstPkt, lastPkt })
+     */
+    constructor(onMessage) {
+        this.onMessage = onMessage;
+        this.reset();
+    }
+
+    reset() {
+        this.buffer = null;
+        this.bufferSeq = 0; // buffer[0] 的序列号
+        this.segments = []; // 缓存数据的来源: { seq, end, pkt }，按序列号排列
+    }
+
+    /**
+     * TcpStream 的 onData 回调，data 在返回后可能被调用方复用
+     */
+    push(data, pkt, seq) {
+        if (!this.buffer || this.buffer.length === 0) {
+            this.buffer = data;
+            this.bufferSeq = seq;
+            this.segments.length = 0;
+        } else {
+            this.buffer = Buffer.concat([this.buffer, data]);
+        }
+        this.segments.push({ seq, end: (seq + data.length) >>> 0, pkt });
+
+        let buffer = this.buffer;
+        while (buffer.length >= BgpConst.BGP_HEAD_LEN) {
+            if (buffer.compare(MARKER, 0, 16, 0, 16) !== 0) {
+                const index = buffer.indexOf(MARKER, 1);
+                const skip = index < 0 ? buffer.length - 15 : index;
+                buffer = this.consume(buffer, skip);
+                continue;
+            }
+            const length = buffer.readUInt16BE(16);
+            if (length < BgpConst.BGP_HEAD_LEN) {
+                buffer = this.consume(buffer, 1);
+                continue;
+            }
+            if (buffer.length < length) {
+                break;
+            }
+            this.emit(length, buffer[18]);
+            buffer = this.consume(buffer, length);
+        }
+        // 剩余的不完整报文拷贝出来，不引用调用方的缓冲区
+        this.buffer = buffer.length > 0 ? Buffer.from(buffer) : null;
+    }
+
+    emit(length, type) {
+        const start = this.bufferSeq;
+        const end = (start + length) >>> 0;
+        let firstPkt = -1;
+        let lastPkt = -1;
+        for (const segment of this.segments) {
+            if (seqDiff(segment.seq, end) >= 0) {
+                break;
+            }
+            if (seqDiff(segment.end, start) <= 0) {
+                continue;
+            }
+            if (firstPkt < 0 || segment.pkt < firstPkt) {
+                firstPkt = segment.pkt;
+            }
+            if (segment.pkt > lastPkt) {
+                lastPkt = segment.pkt;
+            }
+        }
+        this.onMessage({ startSeq: start, length, type, firstPkt, lastPkt });
+    }
+
+    // 丢弃 buffer 开头的 n 字节
+    consume(buffer, n) {
+        this.bufferSeq = (this.bufferSeq + n) >>> 0;
+        let drop = 0;
+        while (drop < this.segments.length && seqDiff(this.segments[drop].end, this.bufferSeq) <= 0) {
+            drop++;
+        }
+        if (drop > 0) {
+            this.segments.splice(0, drop);
+        }
+        return buffer.subarray(n);
+    }
+}
+
+module.exports = BgpStreamFramer;
@@ -0,0 +1,480 @@
+/**
+ * BGP UPDATE 快速解码
+ *
+ * 面向 BMP 监控这类高速入库场景，与 bgpPacketParser 相比:
+ * - NLRI 先只按长度字节跳读一遍统计条数，再一次性平铺到定长的类型化数组中，
+ *   每条前缀只记录 pathId、前缀位数、前缀和 RD 在报文中的位置，不创建对象；
+ *   前缀、RD 字符串在访问时才生成。
+ * - 路径属性只扫描一遍属性头记录位置，各属性在第一次访问时才解析并缓存，
+ *   同一个 UPDATE 中的多条路由共用一份解析结果。
+ *
+ * 支持 IPv4/IPv6 单播、带标签单播、VPN 前缀以及 ADD-PATH；EVPN、QP 等其他
+ * 地址族交给 bgpPacketParser 解析，对外提供相同的访问接口。
+ */
+
+const BgpConst = require('../const/bgpConst');
+const { ipv6BufferToString, rdBufferToString } = require('./ipUtils');
+const { getBgpOriginType } = require('./bgpUtils');
+const { parseMpReachNlri, parseMpUnreachNlri } = require('./bgpPacketParser');
+
+// 撤销带标签路由时使用的兼容标签值(RFC 8277)
+const WITHDRAW_LABEL = 0x800000;
+
+/**
+ * 地址族的 NLRI 编码方式，不能按 前缀长度 + 前缀 解码时返回 null
+ */
+function getNlriEncoding(afi, safi) {
+    let maxBits;
+    if (afi === BgpConst.BGP_AFI_TYPE.AFI_IPV4) {
+        maxBits = BgpConst.IP_HOST_LEN;
+    } else if (afi === BgpConst.BGP_AFI_TYPE.AFI_IPV6) {
+        maxBits = BgpConst.IPV6_HOST_LEN;
+    } else {
+        return null;
+    }
+
+    switch (safi) {
+        case BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST:
+            return { maxBits, labeled: false, hasRd: false };
+        case BgpConst.BGP_SAFI_TYPE.SAFI_LABELED_UNICAST:
+            return { maxBits, labeled: true, hasRd: false };
+        case BgpConst.BGP_SAFI_TYPE.SAFI_VPN:
+            return { maxBits, labeled: true, hasRd: true };
+        default:
+            return null;
+    }
+}
+
+function isAddPathEnabled(context, afi, safi) {
+    if (context && typeof context.isAddPathReceiveEnabled === 'function') {
+        return !!context.isAddPathReceiveEnabled(afi, safi);
+    }
+    return false;
+}
+
+/**
+ * 按位数截断后的 IPv4 前缀，直接从报文字节拼出点分格式
+ */
+function formatIpv4Prefix(buffer, offset, bits) {
+    const bytes = (bits + 7) >> 3;
+    let value = 0;
+    for (let i = 0; i < bytes; i++) {
+        value |= buffer[offset + i] << (24 - 8 * i);
+    }
+    if (bits < 32) {
+        value &= ~(0xffffffff >>> bits);
+    }
+    return `${value >>> 24}.${(value >>> 16) & 0xff}.${(value >>> 8) & 0xff}.${value & 0xff}`;
+}
+
+/**
+ * 平铺的 NLRI 列表
+ *
+ * 第 i 条前缀: pathIds[i]、lengths[i](前缀位数，已去掉标签和 RD)、offsets[i](前缀首字节位置)，
+ * 带标签时 labels[i] 为第一个标签(没有标签时为 -1)，VPN 前缀的 rdOffsets[i] 为 RD 位置。
+ */
+class NlriList {
+    /**
+     * @param {Buffer} buffer 报文
+     * @param {number} start NLRI 起始位置
+     * @param {number} end NLRI 结束位置
+     * @param {number} afi
+     * @param {number} safi
+     * @param {boolean} addPath 是否带 pathId
+     */
+    constructor(buffer, start, end, afi, safi, addPath) {
+        const encoding = getNlriEncoding(afi, safi);
+        this.buffer = buffer;
+        this.afi = afi;
+        this.safi = safi;
+
+        // 第一遍: 只读长度字节跳到下一条，统计条数并确认长度正好落在 end 上
+        const lengthAt = addPath ? 4 : 0;
+        let count = 0;
+        let pos = start;
+        while (pos < end) {
+            pos += lengthAt + 1 + ((buffer[pos + lengthAt] + 7) >> 3);
+            count++;
+        }
+        if (pos !== end) {
+            throw new Error(`NLRI 长度与报文不符: ${start}-${end}`);
+        }
+
+        this.count = count;
+        this.pathIds = new Uint32Array(count);
+        this.lengths = new Uint8Array(count);
+        this.offsets = new Uint32Array(count);
+        this.labels = encoding.labeled ? new Int32Array(count) : null;
+        this.rdOffsets = encoding.hasRd ? new Uint32Array(count) : null;
+        this.prefixes = new Array(count); // 已生成的前缀字符串
+
+        // 第二遍: 填充各列
+        pos = start;
+        for (let i = 0; i < count; i++) {
+            if (addPath) {
+                this.pathIds[i] = buffer.readUInt32BE(pos);
+                pos += 4;
+            }
+            let bits = buffer[pos];
+            pos += 1;
+            const next = pos + ((bits + 7) >> 3);
+
+            if (encoding.labeled) {
+                // 标签栈到栈底标记为止，撤销时只有一个兼容标签
+                let first = -1;
+                while (bits >= 24) {
+                    const label = (buffer[pos] << 16) | (buffer[pos + 1] << 8) | buffer[pos + 2];
+                    pos += 3;
+                    bits -= 24;
+                    if (first < 0) {
+                        first = label >>> 4;
+                    }
+                    if (label & 1 || label === WITHDRAW_LABEL) {
+                        break;
+                    }
+                }
+                this.labels[i] = first;
+            }
+            if (encoding.hasRd) {
+                if (bits < BgpConst.BGP_RD_LEN << 3) {
+                    throw new Error(`VPN 前缀长度无效: ${buffer[next - 1]}`);
+                }
+                this.rdOffsets[i] = pos;
+                pos += BgpConst.BGP_RD_LEN;
+                bits -= BgpConst.BGP_RD_LEN << 3;
+            }
+            if (bits > encoding.maxBits) {
+                throw new Error(`前缀长度无效: ${bits}`);
+            }
+
+            this.offsets[i] = pos;
+            this.lengths[i] = bits;
+            pos = next;
+        }
+    }
+
+    pathId(i) {
+        return this.pathIds[i];
+    }
+
+    prefixLength(i) {
+        return this.lengths[i];
+    }
+
+    prefix(i) {
+        let prefix = this.prefixes[i];
+        if (prefix === undefined) {
+            const offset = this.offsets[i];
+            const bits = this.lengths[i];
+            if (this.afi === BgpConst.BGP_AFI_TYPE.AFI_IPV4) {
+                prefix = formatIpv4Prefix(this.buffer, offset, bits);
+            } else {
+                prefix = ipv6BufferToString(this.buffer.subarray(offset, offset + ((bits + 7) >> 3)), bits);
+            }
+            this.prefixes[i] = prefix;
+        }
+        return prefix;
+    }
+
+    rd(i) {
+        if (!this.rdOffsets) {
+            return null;
+        }
+        const offset = this.rdOffsets[i];
+        return rdBufferToString(this.buffer.subarray(offset, offset + BgpConst.BGP_RD_LEN));
+    }
+
+    label(i) {
+        return this.labels ? this.labels[i] : -1;
+    }
+}
+
+/**
+ * bgpPacketParser 解析出的 NLRI 数组，提供与 NlriList 相同的访问接口
+ */
+class NlriEntries {
+    constructor(afi, safi, entries) {
+        this.afi = afi;
+        this.safi = safi;
+        this.entries = entries;
+        this.count = entries.length;
+    }
+
+    pathId(i) {
+        return this.entries[i].pathId;
+    }
+
+    prefixLength(i) {
+        return this.entries[i].length;
+    }
+
+    prefix(i) {
+        return this.entries[i].prefix;
+    }
+
+    rd(i) {
+        return this.entries[i].rd;
+    }
+
+    label(_) {
+        return -1;
+    }
+}
+
+const EMPTY_NLRI = new NlriEntries(BgpConst.BGP_AFI_TYPE.AFI_IPV4, BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST, []);
+
+/**
+ * 延迟解析的路径属性
+ *
+ * 构造时只记录每个属性的类型和位置，各 getter 在第一次访问时解析，属性不存在时返回 undefined。
+ * mpReach/mpUnreach 由 decodeUpdate 预先解析，使用方修改路由表之前已确认报文完整。
+ */
+class PathAttributes {
+    constructor(buffer, start, end, context) {
+        this.buffer = buffer;
+        this.context = context;
+        this.types = [];
+        this.flags = [];
+        this.starts = [];
+        this.ends = [];
+        this.cache = new Map(); // 属性类型 -> 解析结果
+
+        let pos = start;
+        while (pos < end) {
+            if (pos + 3 > end) {
+                throw new Error('路径属性头部不完整');
+            }
+            const flags = buffer[pos];
+            const type = buffer[pos + 1];
+            let length;
+            if (flags & BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH) {
+                if (pos + 4 > end) {
+                    throw new Error('路径属性头部不完整');
+                }
+                length = buffer.readUInt16BE(pos + 2);
+                pos += 4;
+            } else {
+                length = buffer[pos + 2];
+                pos += 3;
+            }
+            if (pos + length > end) {
+                throw new Error(`路径属性 ${type} 长度越界`);
+            }
+            this.types.push(type);
+            this.flags.push(flags);
+            this.starts.push(pos);
+            this.ends.push(pos + length);
+            pos += length;
+        }
+    }
+
+    has(type) {
+        return this.types.indexOf(type) >= 0;
+    }
+
+    /**
+     * 属性值的原始字节，属性不存在时返回 null
+     */
+    value(type) {
+        const index = this.types.indexOf(type);
+        return index < 0 ? null : this.buffer.subarray(this.starts[index], this.ends[index]);
+    }
+
+    lazy(type, parse) {
+        if (this.cache.has(type)) {
+            return this.cache.get(type);
+        }
+        const value = this.value(type);
+        const result = value ? parse(value) : undefined;
+        this.cache.set(type, result);
+        return result;
+    }
+
+    get origin() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.ORIGIN, value =>
+            value.length >= 1 ? getBgpOriginType(value[0]) : undefined
+        );
+    }
+
+    /**
+     * AS_PATH 中 AS 号的字节数，未协商 ASN 长度时按第一个段的长度推断
+     */
+    asnSize(asPathValue) {
+        const asnSize = this.context?.asnSize;
+        if (asnSize) {
+            return asnSize;
+        }
+        return asPathValue.length >= 2 && asPathValue.length === 2 + asPathValue[1] * 2 ? 2 : 4;
+    }
+
+    /**
+     * AS_PATH 文本: 序列中的 AS 以空格分隔，集合用 {} 包起来
+     */
+    get asPath() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.AS_PATH, value => {
+            const asnSize = this.asnSize(value);
+            const segments = [];
+            let pos = 0;
+            while (pos + 2 <= value.length) {
+                const segmentType = value[pos];
+                const segmentLength = value[pos + 1];
+                pos += 2;
+                const asNumbers = [];
+                for (let i = 0; i < segmentLength && pos + asnSize <= value.length; i++) {
+                    asNumbers.push(asnSize === 4 ? value.readUInt32BE(pos) : value.readUInt16BE(pos));
+                    pos += asnSize;
+                }
+                const text = asNumbers.join(' ');
+                segments.push(segmentType === BgpConst.BGP_AS_PATH_TYPE.AS_SEQUENCE ? text : `{${text}}`);
+            }
+            return segments.join(' ');
+        });
+    }
+
+    get nextHop() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.NEXT_HOP, value =>
+            value.length === 4 ? `${value[0]}.${value[1]}.${value[2]}.${value[3]}` : undefined
+        );
+    }
+
+    get med() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.MED, value => (value.length >= 4 ? value.readUInt32BE(0) : undefined));
+    }
+
+    get localPref() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.LOCAL_PREF, value =>
+            value.length >= 4 ? value.readUInt32BE(0) : undefined
+        );
+    }
+
+    get otc() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.PATH_OTC, value =>
+            value.length >= 4 ? value.readUInt32BE(0) : undefined
+        );
+    }
+
+    /**
+     * 团体属性文本，多个团体属性以空格分隔
+     */
+    get communities() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.COMMUNITY, value => {
+            const communities = [];
+            for (let i = 0; i + 4 <= value.length; i += 4) {
+                communities.push(`${value.readUInt16BE(i)}:${value.readUInt16BE(i + 2)}`);
+            }
+            return communities.join(' ');
+        });
+    }
+
+    /**
+     * @returns {{ afi: number, safi: number, nextHop: string, nlri: NlriList|NlriEntries }|undefined}
+     */
+    get mpReach() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI, value => {
+            const afi = value.readUInt16BE(0);
+            const safi = value[2];
+            const nextHopLength = value[3];
+            const nlriStart = 4 + nextHopLength + 1; // 下一跳之后有 1 字节保留字段
+            if (nlriStart > value.length) {
+                throw new Error('MP_REACH_NLRI 长度无效');
+            }
+
+            if (!getNlriEncoding(afi, safi)) {
+                const parsed = parseMpReachNlri(value, this.context);
+                return { afi, safi, nextHop: parsed.nextHop, nlri: new NlriEntries(afi, safi, parsed.nlri) };
+            }
+
+            // VPN 下一跳前有 8 字节全 0 的 RD；IPv6 下一跳可能再带一个链路本地地址，只取全局地址
+            let nextHopStart = 4;
+            let nextHopBytes = nextHopLength;
+            if (safi === BgpConst.BGP_SAFI_TYPE.SAFI_VPN) {
+                nextHopStart += BgpConst.BGP_RD_LEN;
+                nextHopBytes -= BgpConst.BGP_RD_LEN;
+            }
+            let nextHop = '';
+            if (nextHopBytes === BgpConst.IP_HOST_BYTE_LEN) {
+                nextHop = formatIpv4Prefix(value, nextHopStart, BgpConst.IP_HOST_LEN);
+            } else if (nextHopBytes >= BgpConst.IPV6_HOST_BYTE_LEN) {
+                nextHop = ipv6BufferToString(
+                    value.subarray(nextHopStart, nextHopStart + BgpConst.IPV6_HOST_BYTE_LEN),
+                    BgpConst.IPV6_HOST_LEN
+                );
+            }
+
+            const addPath = isAddPathEnabled(this.context, afi, safi);
+            return { afi, safi, nextHop, nlri: new NlriList(value, nlriStart, value.length, afi, safi, addPath) };
+        });
+    }
+
+    /**
+     * @returns {{ afi: number, safi: number, withdrawnRoutes: NlriList|NlriEntries }|undefined}
+     */
+    get mpUnreach() {
+        return this.lazy(BgpConst.BGP_PATH_ATTR.MP_UNREACH_NLRI, value => {
+            const afi = value.readUInt16BE(0);
+            const safi = value[2];
+            if (!getNlriEncoding(afi, safi)) {
+                const parsed = parseMpUnreachNlri(value, this.context);
+                return { afi, safi, withdrawnRoutes: new NlriEntries(afi, safi, parsed.withdrawnRoutes) };
+            }
+            const addPath = isAddPathEnabled(this.context, afi, safi);
+            return { afi, safi, withdrawnRoutes: new NlriList(value, 3, value.length, afi, safi, addPath) };
+        });
+    }
+}
+
+const EMPTY_ATTRIBUTES = new PathAttributes(Buffer.alloc(0), 0, 0, null);
+
+/**
+ * 解码 BGP UPDATE 报文
+ * @param {Buffer} buffer 完整的 UPDATE 报文(含 19 字节头部)
+ * @param {Object} context 提供 isAddPathReceiveEnabled(afi, safi) 和可选 asnSize 的对象，如 bmpBgpSession
+ * @returns {{ valid: boolean, error?: string, withdrawn: NlriList|NlriEntries, attributes: PathAttributes,
+ *     nlri: NlriList|NlriEntries }}
+ */
+function decodeUpdate(buffer, context) {
+    const update = { valid: true, withdrawn: EMPTY_NLRI, attributes: EMPTY_ATTRIBUTES, nlri: EMPTY_NLRI };
+    try {
+        if (buffer.length < BgpConst.BGP_HEAD_LEN + 4) {
+            throw new Error('报文长度不足');
+        }
+        const type = buffer[BgpConst.BGP_MARKER_LEN + 2];
+        if (type !== BgpConst.BGP_PACKET_TYPE.UPDATE) {
+            throw new Error(`不是 UPDATE 报文: ${type}`);
+        }
+        const end = Math.min(buffer.readUInt16BE(BgpConst.BGP_MARKER_LEN), buffer.length);
+
+        const afi = BgpConst.BGP_AFI_TYPE.AFI_IPV4;
+        const safi = BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST;
+        const addPath = isAddPathEnabled(context, afi, safi);
+
+        let pos = BgpConst.BGP_HEAD_LEN;
+        const withdrawnEnd = pos + 2 + buffer.readUInt16BE(pos);
+        if (withdrawnEnd + 2 > end) {
+            throw new Error('撤销路由长度越界');
+        }
+        const withdrawn = new NlriList(buffer, pos + 2, withdrawnEnd, afi, safi, addPath);
+
+        pos = withdrawnEnd;
+        const attributesEnd = pos + 2 + buffer.readUInt16BE(pos);
+        if (attributesEnd > end) {
+            throw new Error('路径属性长度越界');
+        }
+        const attributes = new PathAttributes(buffer, pos + 2, attributesEnd, context);
+        const nlri = new NlriList(buffer, attributesEnd, end, afi, safi, addPath);
+        // MP_REACH/MP_UNREACH 中的路由在这里解码并缓存，格式错误时与其他部分一样整体作废
+        void attributes.mpReach;
+        void attributes.mpUnreach;
+
+        // 整个报文解码成功后才生效，格式错误的报文不会只处理一部分
+        update.withdrawn = withdrawn;
+        update.attributes = attributes;
+        update.nlri = nlri;
+    } catch (error) {
+        update.valid = false;
+        update.error = `Error decoding BGP update: ${error.message}`;
+    }
+    return update;
+}
+
+module.exports = { decodeUpdate, NlriList, PathAttributes };
@@ -70,6 +70,8 @@ function getBgpSafiName(safi) {
     switch (safi) {
         case BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST:
             return 'Unicast';
+        case BgpConst.BGP_SAFI_TYPE.SAFI_LABELED_UNICAST:
+            return 'Labeled Unicast';
         case BgpConst.BGP_SAFI_TYPE.SAFI_MVPN:
             return 'MVPN';
         case BgpConst.BGP_SAFI_TYPE.SAFI_EVPN:
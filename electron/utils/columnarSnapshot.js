@@ -0,0 +1,232 @@
+/**
+ * 列式快照
+ *
+ * 把一批同构对象按列编码到一块 SharedArrayBuffer 中，跨线程传递时只共享内存，
+ * 不做结构化克隆；读取端用 SnapshotView 按需解码，只有真正访问的行才会生成对象。
+ *
+ * 列类型:
+ * - num:  Float64 数值，null/undefined 记为 NaN
+ * - str:  逐行存放的 UTF-8 字符串，适合 IP 这类几乎不重复的值
+ * - dict: 字典编码，适合 AS Path、下一跳这类大量重复的值；值可以是任意 JSON 数据
+ *
+ * 内存布局(每段按 8 字节对齐):
+ * - num:  Float64Array(rowCount)
+ * - str:  Uint8Array(rowCount) 空值标记，Uint32Array(rowCount + 1) 偏移，UTF-8 数据
+ * - dict: Uint32Array(rowCount) 字典下标，字典本身按 str 列的格式存放 JSON 文本
+ */
+
+function align8(n) {
+    return (n + 7) & ~7;
+}
+
+/**
+ * 字符串段(空值标记 + 偏移 + 数据)的布局，values 中 null/undefined 为空值
+ */
+function planStrings(values, offset) {
+    let bytes = 0;
+    for (const value of values) {
+        if (value !== null && value !== undefined) {
+            bytes += Buffer.byteLength(value, 'utf8');
+        }
+    }
+    const nullsOffset = offset;
+    const offsetsOffset = align8(nullsOffset + values.length);
+    const dataOffset = offsetsOffset + (values.length + 1) * 4;
+    return {
+        count: values.length,
+        nullsOffset,
+        offsetsOffset,
+        dataOffset,
+        dataLength: bytes,
+        end: align8(dataOffset + bytes)
+    };
+}
+
+function writeStrings(buffer, plan, values) {
+    const nulls = new Uint8Array(buffer, plan.nullsOffset, plan.count);
+    const offsets = new Uint32Array(buffer, plan.offsetsOffset, plan.count + 1);
+    const data = Buffer.from(buffer, plan.dataOffset, plan.dataLength);
+    let pos = 0;
+    for (let i = 0; i < values.length; i++) {
+        offsets[i] = pos;
+        const value = values[i];
+        if (value === null || value === undefined) {
+            nulls[i] = 1;
+        } else {
+            pos += data.write(value, pos, 'utf8');
+        }
+    }
+    offsets[values.length] = pos;
+}
+
+/**
+ * 编码快照
+ * @param {Iterable} items 数据对象
+ * @param {number} rowCount 对象个数
+ * @param {Array<{name: string, type: 'num'|'str'|'dict', get: Function}>} columns 列定义，get 从对象中取值
+ * @returns {{ buffer: SharedArrayBuffer, rowCount: number, columns: Object[] }}
+ */
+function encodeSnapshot(items, rowCount, columns) {
+    // 第一遍: 收集各列的值，确定每段的大小
+    const states = columns.map(column => ({
+        column,
+        values: column.type === 'num' ? new Float64Array(rowCount) : new Array(rowCount),
+        ids: column.type === 'dict' ? new Uint32Array(rowCount) : null,
+        dict: column.type === 'dict' ? new Map() : null,
+        dictValues: column.type === 'dict' ? [] : null // 字典下标 -> JSON 文本
+    }));
+
+    let row = 0;
+    for (const item of items) {
+        for (const state of states) {
+            const value = state.column.get(item);
+            switch (state.column.type) {
+                case 'num':
+                    state.values[row] = value === null || value === undefined ? NaN : Number(value);
+                    break;
+                case 'str':
+                    state.values[row] = value === null || value === undefined ? null : String(value);
+                    break;
+                case 'dict': {
+                    // 基本类型直接作为 Map 的键，对象按 JSON 文本去重(加前缀以免与同内容的字符串冲突)
+                    const isObject = value !== null && typeof value === 'object';
+                    const key = isObject ? '\0' + JSON.stringify(value) : value;
+                    let id = state.dict.get(key);
+                    if (id === undefined) {
+                        id = state.dict.size;
+                        state.dict.set(key, id);
+                        state.dictValues.push(isObject ? key.slice(1) : JSON.stringify(value ?? null));
+                    }
+                    state.ids[row] = id;
+                    break;
+                }
+            }
+        }
+        row++;
+    }
+
+    let offset = 0;
+    const metas = states.map(state => {
+        const { name, type } = state.column;
+        const meta = { name, type, offset };
+        if (type === 'num') {
+            offset = align8(offset + rowCount * 8);
+        } else if (type === 'str') {
+            meta.strings = planStrings(state.values, offset);
+            offset = meta.strings.end;
+        } else {
+            offset = align8(offset + rowCount * 4);
+            meta.strings = planStrings(state.dictValues, offset);
+            offset = meta.strings.end;
+        }
+        return meta;
+    });
+
+    // 第二遍: 写入共享内存
+    const buffer = new SharedArrayBuffer(Math.max(offset, 8));
+    states.forEach((state, i) => {
+        const meta = metas[i];
+        if (meta.type === 'num') {
+            new Float64Array(buffer, meta.offset, rowCount).set(state.values);
+        } else if (meta.type === 'str') {
+            writeStrings(buffer, meta.strings, state.values);
+        } else {
+            new Uint32Array(buffer, meta.offset, rowCount).set(state.ids);
+            writeStrings(buffer, meta.strings, state.dictValues);
+        }
+    });
+
+    return { buffer, rowCount, columns: metas };
+}
+
+/**
+ * 快照的只读视图，字符串和字典值在第一次访问时解码
+ */
+class SnapshotView {
+    /**
+     * @param {{ buffer: SharedArrayBuffer|ArrayBuffer, rowCount: number, columns: Object[] }} snapshot
+     */
+    constructor(snapshot) {
+        this.buffer = snapshot.buffer;
+        this.rowCount = snapshot.rowCount;
+        this.columns = snapshot.columns.map(meta => this.openColumn(meta));
+    }
+
+    openColumn(meta) {
+        const column = { name: meta.name, type: meta.type };
+        if (meta.type === 'num') {
+            column.values = new Float64Array(this.buffer, meta.offset, this.rowCount);
+            return column;
+        }
+
+        const plan = meta.strings;
+        column.nulls = new Uint8Array(this.buffer, plan.nullsOffset, plan.count);
+        column.offsets = new Uint32Array(this.buffer, plan.offsetsOffset, plan.count + 1);
+        column.data = Buffer.from(this.buffer, plan.dataOffset, plan.dataLength);
+        if (meta.type === 'dict') {
+            column.ids = new Uint32Array(this.buffer, meta.offset, this.rowCount);
+            column.cache = new Array(plan.count); // 字典下标 -> 已解码的基本类型值
+        }
+        return column;
+    }
+
+    get length() {
+        return this.rowCount;
+    }
+
+    static readString(column, index) {
+        if (column.nulls[index]) {
+            return null;
+        }
+        return column.data.toString('utf8', column.offsets[index], column.offsets[index + 1]);
+    }
+
+    /**
+     * 第 row 行第 col 列的值
+     */
+    value(row, col) {
+        const column = this.columns[col];
+        switch (column.type) {
+            case 'num': {
+                const value = column.values[row];
+                return Number.isNaN(value) ? null : value;
+            }
+            case 'str':
+                return SnapshotView.readString(column, row);
+            default: {
+                const id = column.ids[row];
+                const cached = column.cache[id];
+                if (cached !== undefined) {
+                    return cached;
+                }
+                const value = JSON.parse(SnapshotView.readString(column, id));
+                // 对象每次重新解析，避免多行共享同一个对象
+                if (value === null || typeof value !== 'object') {
+                    column.cache[id] = value;
+                }
+                return value;
+            }
+        }
+    }
+
+    row(index) {
+        const result = {};
+        for (let col = 0; col < this.columns.length; col++) {
+            result[this.columns[col].name] = this.value(index, col);
+        }
+        return result;
+    }
+
+    /**
+     * [start, end) 行生成的对象数组
+     */
+    rows(start, end) {
+        const list = [];
+        for (let i = Math.max(0, start); i < Math.min(end, this.rowCount); i++) {
+            list.push(this.row(i));
+        }
+        return list;
+    }
+}
+
+module.exports = { encodeSnapshot, SnapshotView };
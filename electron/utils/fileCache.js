@@ -0,0 +1,86 @@
+/**
+ * 下载文件的内存缓存
+ *
+ * 多个客户端同时下载同一个文件(例如给一批设备推送镜像)时，文件只从磁盘读一次，
+ * 各数据连接直接发送同一块内存的切片，不再各自打开文件、逐块分配缓冲区读入。
+ * 按文件大小和修改时间判断缓存是否有效，超过总大小时淘汰最久未使用的文件。
+ */
+
+const fs = require('fs');
+
+class FileCache {
+    /**
+     * @param {number} maxFileSize 可缓存的单个文件上限(字节)
+     * @param {number} maxTotal 缓存总大小上限(字节)
+     */
+    constructor(maxFileSize, maxTotal) {
+        this.maxFileSize = maxFileSize;
+        this.maxTotal = maxTotal;
+        this.entries = new Map(); // 路径 -> { size, mtimeMs, data }，data 为读文件的 Promise，按最近使用排序
+        this.total = 0;
+    }
+
+    /**
+     * 取文件内容，未缓存或已过期时读入
+     * @param {string} fullPath 文件路径
+     * @param {fs.Stats} stats 调用方刚取得的文件信息
+     * @returns {Promise<Buffer|null>} 文件过大不缓存时返回 null
+     */
+    async get(fullPath, stats) {
+        if (stats.size > this.maxFileSize || stats.size > this.maxTotal) {
+            return null;
+        }
+
+        const cached = this.entries.get(fullPath);
+        if (cached) {
+            this.entries.delete(fullPath);
+            if (cached.size === stats.size && cached.mtimeMs === stats.mtimeMs) {
+                this.entries.set(fullPath, cached);
+                return cached.data;
+            }
+            this.total -= cached.size;
+        }
+
+        // 同时到达的请求共用一次读取
+        const entry = { size: stats.size, mtimeMs: stats.mtimeMs, data: fs.promises.readFile(fullPath) };
+        this.entries.set(fullPath, entry);
+        this.total += entry.size;
+        this.evict();
+
+        try {
+            return await entry.data;
+        } catch (err) {
+            if (this.entries.get(fullPath) === entry) {
+                this.invalidate(fullPath);
+            }
+            throw err;
+        }
+    }
+
+    /**
+     * 文件被上传覆盖或删除时丢弃缓存
+     */
+    invalidate(fullPath) {
+        const cached = this.entries.get(fullPath);
+        if (cached) {
+            this.entries.delete(fullPath);
+            this.total -= cached.size;
+        }
+    }
+
+    evict() {
+        for (const fullPath of this.entries.keys()) {
+            if (this.total <= this.maxTotal) {
+                break;
+            }
+            this.invalidate(fullPath);
+        }
+    }
+
+    clear() {
+        this.entries.clear();
+        this.total = 0;
+    }
+}
+
+module.exports = FileCache;
@@ -307,6 +307,20 @@ function getIpType(ip) {
     return null;
 }
 
+/**
+ * 将地址转换为与 Node socket 上报（inet_ntop）一致的规范形式，
+ * 如 2001:DB8:0:0::1 -> 2001:db8::1，::FFFF:1.2.3.4 -> ::ffff:1.2.3.4
+ * @param {String} ip - IPv4/IPv6 地址
+ * @returns {String} 规范形式的地址
+ */
+function canonicalIp(ip) {
+    const addr = ipaddr.parse(ip);
+    if (addr.kind() === 'ipv6' && addr.isIPv4MappedAddress()) {
+        return `::ffff:${addr.toIPv4Address().toString()}`;
+    }
+    return addr.toString();
+}
+
 /**
  * Get IP type name from code
  * @param {Number} ipType - IP type code
@@ -376,6 +390,7 @@ module.exports = {
     rdBufferToString,
     extCommunitiesBufferToString,
     getIpType,
+    canonicalIp,
     ipv4BufferToString,
     ipv6BufferToString,
     rdStringToBytes,
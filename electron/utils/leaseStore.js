@@ -0,0 +1,162 @@
+/**
+ * DHCP 租约表，DHCPv4 和 DHCPv6 共用
+ *
+ * 客户端标识(MAC 或 DUID)和地址(相对池起点的偏移)各有一个哈希索引，空闲地址由 AddressPool 位图管理。
+ * 发出 OFFER/ADVERTISE 时地址即被预留一段时间，同时握手的客户端不会拿到同一个地址。
+ * 预留超时和租约到期都挂在同一个定时轮上，不再定期遍历全部租约。
+ */
+
+const AddressPool = require('./addressPool');
+const TimerWheel = require('./timerWheel');
+
+class LeaseStore {
+    /**
+     * @param {number} size 池中的地址个数
+     * @param {Function} onExpire (clientId, lease) 租约到期时的回调，预留超时不回调
+     * @param {number} tickMs 到期定时精度(毫秒)
+     */
+    constructor(size, onExpire, tickMs = 1000) {
+        this.pool = new AddressPool(size);
+        this.onExpire = onExpire;
+        this.wheel = new TimerWheel(tickMs);
+        this.byClient = new Map(); // clientId -> { clientId, offset, lease, timer }，lease 为 null 表示仅预留
+        this.byOffset = new Map(); // 地址偏移 -> 同上
+        this.leaseCount = 0;
+    }
+
+    start() {
+        this.wheel.start();
+    }
+
+    stop() {
+        this.wheel.stop();
+    }
+
+    get size() {
+        return this.pool.size;
+    }
+
+    get(clientId) {
+        const entry = this.byClient.get(clientId);
+        return entry ? entry.lease : null;
+    }
+
+    /**
+     * @returns {string|null} 占用该地址(租约或预留)的客户端
+     */
+    ownerOf(offset) {
+        const entry = this.byOffset.get(offset);
+        return entry ? entry.clientId : null;
+    }
+
+    /**
+     * 为客户端选一个地址: 已有租约或预留的沿用原地址，否则从池中分配并预留 holdMs
+     * @returns {number} 地址偏移，池已满时返回 -1
+     */
+    offer(clientId, holdMs) {
+        let entry = this.byClient.get(clientId);
+        if (entry) {
+            if (!entry.lease) {
+                this.wheel.schedule(entry.timer, holdMs);
+            }
+            return entry.offset;
+        }
+        const offset = this.pool.allocate();
+        if (offset < 0) {
+            return -1;
+        }
+        entry = this.createEntry(clientId, offset);
+        this.wheel.schedule(entry.timer, holdMs);
+        return offset;
+    }
+
+    /**
+     * 放弃客户端的预留(客户端选择了其他服务器)，已有租约的不受影响
+     */
+    cancelOffer(clientId) {
+        const entry = this.byClient.get(clientId);
+        if (entry && !entry.lease) {
+            this.remove(entry);
+        }
+    }
+
+    /**
+     * 把地址绑定给客户端，ttlMs 后到期；客户端原来占用的是其他地址时先释放
+     * @returns {boolean} 地址不在池内或已被其他客户端占用时返回 false
+     */
+    bind(clientId, offset, lease, ttlMs) {
+        let entry = this.byClient.get(clientId);
+        const owner = this.byOffset.get(offset);
+        if (owner && owner !== entry) {
+            return false;
+        }
+        if (!owner) {
+            if (!this.pool.reserve(offset)) {
+                return false;
+            }
+            if (entry) {
+                this.byOffset.delete(entry.offset);
+                this.pool.release(entry.offset);
+                entry.offset = offset;
+                this.byOffset.set(offset, entry);
+            } else {
+                entry = this.createEntry(clientId, offset);
+            }
+        }
+        if (!entry.lease) {
+            this.leaseCount++;
+        }
+        entry.lease = lease;
+        this.wheel.schedule(entry.timer, ttlMs);
+        return true;
+    }
+
+    /**
+     * 释放客户端的租约或预留
+     * @returns {object|null} 被释放的租约
+     */
+    release(clientId) {
+        const entry = this.byClient.get(clientId);
+        if (!entry) {
+            return null;
+        }
+        this.remove(entry);
+        return entry.lease;
+    }
+
+    forEachLease(callback) {
+        for (const entry of this.byClient.values()) {
+            if (entry.lease) {
+                callback(entry.lease, entry.clientId);
+            }
+        }
+    }
+
+    // 地址在池中的位由调用方先占用
+    createEntry(clientId, offset) {
+        const entry = { clientId, offset, lease: null, timer: null };
+        entry.timer = this.wheel.createTimer(() => this.expire(entry));
+        this.byClient.set(clientId, entry);
+        this.byOffset.set(offset, entry);
+        return entry;
+    }
+
+    remove(entry) {
+        this.wheel.cancel(entry.timer);
+        this.byClient.delete(entry.clientId);
+        this.byOffset.delete(entry.offset);
+        this.pool.release(entry.offset);
+        if (entry.lease) {
+            this.leaseCount--;
+        }
+    }
+
+    expire(entry) {
+        this.remove(entry);
+        if (entry.lease && this.onExpire) {
+            this.onExpire(entry.clientId, entry.lease);
+        }
+    }
+}
+
+module.exports = LeaseStore;
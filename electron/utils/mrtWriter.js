@@ -0,0 +1,337 @@
+const fs = require('fs');
+const zlib = require('zlib');
+const ipaddr = require('ipaddr.js');
+const BgpConst = require('../const/bgpConst');
+
+/**
+ * MRT TABLE_DUMP_V2 (RFC 6396 / RFC 8050) 路由表导出
+ *
+ * 输入为若干对等体的路由表快照(BmpRouteTable.snapshot())，各快照已按 前缀地址、掩码 排序，
+ * 按前缀多路归并后每个前缀生成一条 RIB 记录，包含所有对等体在该前缀上的路由。
+ * 输出分批写入文件并等待写入完成，批与批之间让出事件循环，导出期间继续处理其他报文。
+ *
+ * 同一 UPDATE 的所有前缀共用一份编码后的路径属性，属性缓存有上限，内存占用与路由表规模无关。
+ */
+
+const MRT_HEADER_LEN = 12;
+const MRT_TYPE_TABLE_DUMP_V2 = 13;
+const MRT_SUBTYPE = {
+    PEER_INDEX_TABLE: 1,
+    RIB_IPV4_UNICAST: 2,
+    RIB_IPV6_UNICAST: 4,
+    RIB_IPV4_UNICAST_ADDPATH: 8,
+    RIB_IPV6_UNICAST_ADDPATH: 10
+};
+
+// PEER_INDEX_TABLE 中的 Peer Type 位
+const PEER_TYPE_IPV6 = 0x01;
+const PEER_TYPE_AS4 = 0x02;
+
+const FLUSH_BYTES = 256 * 1024; // 输出缓冲达到该大小时写入文件
+const BATCH_PREFIXES = 4096; // 每处理这么多前缀让出一次事件循环
+const ATTR_CACHE_MAX = 65536; // 属性编码缓存的最大条目数
+
+function encodeMrtHeader(buffer, timestamp, subtype, length) {
+    buffer.writeUInt32BE(timestamp, 0);
+    buffer.writeUInt16BE(MRT_TYPE_TABLE_DUMP_V2, 4);
+    buffer.writeUInt16BE(subtype, 6);
+    buffer.writeUInt32BE(length, 8);
+}
+
+function ipToBuffer(ip) {
+    return Buffer.from(ipaddr.parse(ip).toByteArray());
+}
+
+/**
+ * PEER_INDEX_TABLE 记录，对等体统一使用 4 字节 AS 号
+ */
+function encodePeerIndexTable(timestamp, collectorId, viewName, peers) {
+    const view = Buffer.from(viewName || '', 'utf8');
+    const entries = peers.map(peer => {
+        const address = ipToBuffer(peer.ip);
+        const entry = Buffer.alloc(1 + 4 + address.length + 4);
+        entry[0] = PEER_TYPE_AS4 | (address.length === 16 ? PEER_TYPE_IPV6 : 0);
+        ipToBuffer(peer.bgpId || '0.0.0.0').copy(entry, 1);
+        address.copy(entry, 5);
+        entry.writeUInt32BE(Number(peer.as) >>> 0, 5 + address.length);
+        return entry;
+    });
+
+    const body = Buffer.alloc(4 + 2 + view.length + 2);
+    ipToBuffer(collectorId || '0.0.0.0').copy(body, 0);
+    body.writeUInt16BE(view.length, 4);
+    view.copy(body, 6);
+    body.writeUInt16BE(peers.length, 6 + view.length);
+
+    const length = body.length + entries.reduce((sum, entry) => sum + entry.length, 0);
+    const header = Buffer.alloc(MRT_HEADER_LEN);
+    encodeMrtHeader(header, timestamp, MRT_SUBTYPE.PEER_INDEX_TABLE, length);
+    return Buffer.concat([header, body, ...entries]);
+}
+
+function encodeAttribute(flags, type, value) {
+    const extended = value.length > 255;
+    const header = Buffer.alloc(extended ? 4 : 3);
+    header[0] = extended
+        ? flags | BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH
+        : flags & ~BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH;
+    header[1] = type;
+    if (extended) {
+        header.writeUInt16BE(value.length, 2);
+    } else {
+        header[2] = value.length;
+    }
+    return Buffer.concat([header, value]);
+}
+
+// 2 字节 AS 号的 AS_PATH 转为 4 字节，MRT 中的 AS_PATH 必须使用 4 字节 AS 号
+function widenAsPath(value) {
+    const parts = [];
+    let pos = 0;
+    while (pos + 2 <= value.length) {
+        const count = value[pos + 1];
+        const segment = Buffer.alloc(2 + count * 4);
+        segment[0] = value[pos];
+        segment[1] = count;
+        pos += 2;
+        for (let i = 0; i < count && pos + 2 <= value.length; i++, pos += 2) {
+            segment.writeUInt32BE(value.readUInt16BE(pos), 2 + i * 4);
+        }
+        parts.push(segment);
+    }
+    return Buffer.concat(parts);
+}
+
+/**
+ * RIB 条目中的路径属性: 原样复制 UPDATE 中的属性，MP_REACH_NLRI 只保留下一跳长度和下一跳，
+ * 去掉 MP_UNREACH_NLRI
+ * @param {PathAttributes} attrs UPDATE 的路径属性
+ */
+function encodeRibAttributes(attrs) {
+    const PATH_ATTR = BgpConst.BGP_PATH_ATTR;
+    const parts = [];
+    for (let i = 0; i < attrs.types.length; i++) {
+        const type = attrs.types[i];
+        const flags = attrs.flags[i];
+        const value = attrs.buffer.subarray(attrs.starts[i], attrs.ends[i]);
+        if (type === PATH_ATTR.MP_UNREACH_NLRI) {
+            continue;
+        }
+        if (type === PATH_ATTR.MP_REACH_NLRI) {
+            // AFI(2) SAFI(1) 之后是下一跳长度和下一跳
+            parts.push(encodeAttribute(flags, type, value.subarray(3, 4 + value[3])));
+        } else if (type === PATH_ATTR.AS_PATH && attrs.asnSize(value) === 2) {
+            parts.push(encodeAttribute(flags, type, widenAsPath(value)));
+        } else {
+            const headerLen = flags & BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH ? 4 : 3;
+            parts.push(attrs.buffer.subarray(attrs.starts[i] - headerLen, attrs.ends[i]));
+        }
+    }
+    return Buffer.concat(parts);
+}
+
+function hexToBytes(hex, start, count) {
+    const bytes = Buffer.alloc(count);
+    for (let i = 0; i < count; i++) {
+        bytes[i] = parseInt(hex.substr(start + i * 2, 2), 16);
+    }
+    return bytes;
+}
+
+function waitEvent(emitter, event) {
+    return new Promise((resolve, reject) => {
+        const onEvent = () => {
+            emitter.off('error', onError);
+            resolve();
+        };
+        const onError = err => {
+            emitter.off(event, onEvent);
+            reject(err);
+        };
+        emitter.once(event, onEvent);
+        emitter.once('error', onError);
+    });
+}
+
+/**
+ * 导出 RIB 快照为 MRT 文件，文件名以 .gz 结尾时用 gzip 压缩
+ * @param {string} filePath 输出文件
+ * @param {Object} options
+ * @param {number} options.afi 地址族，只支持 IPv4/IPv6 单播
+ * @param {Array<{ip, as, bgpId, snapshot: {keys: string[], updates: Object[]}}>} options.peers 对等体及其路由表快照
+ * @param {string} [options.collectorId] 采集器 BGP ID
+ * @param {string} [options.viewName] 视图名称
+ * @param {boolean} [options.addPath] 是否写入 Path Identifier (RFC 8050)
+ * @returns {Promise<{peers: number, prefixes: number, entries: number, attributes: number, bytes: number}>}
+ */
+async function writeRibDump(filePath, options) {
+    const { afi, peers, collectorId, viewName, addPath = false } = options;
+    const isIpv6 = afi === BgpConst.BGP_AFI_TYPE.AFI_IPV6;
+    let subtype;
+    if (isIpv6) {
+        subtype = addPath ? MRT_SUBTYPE.RIB_IPV6_UNICAST_ADDPATH : MRT_SUBTYPE.RIB_IPV6_UNICAST;
+    } else {
+        subtype = addPath ? MRT_SUBTYPE.RIB_IPV4_UNICAST_ADDPATH : MRT_SUBTYPE.RIB_IPV4_UNICAST;
+    }
+    const timestamp = Math.floor(Date.now() / 1000);
+
+    // 相同的对等体在索引表中只出现一次
+    const indexEntries = [];
+    const indexMap = new Map();
+    const peerIndexes = peers.map(peer => {
+        const key = `${peer.bgpId}|${peer.ip}|${peer.as}`;
+        if (!indexMap.has(key)) {
+            indexMap.set(key, indexEntries.length);
+            indexEntries.push(peer);
+        }
+        return indexMap.get(key);
+    });
+
+    const file = fs.createWriteStream(filePath);
+    const output = filePath.endsWith('.gz') ? zlib.createGzip() : file;
+    // 写文件出错时结束压缩流，让等待 drain 的写入方收到错误
+    let streamError = null;
+    file.on('error', err => {
+        streamError = streamError || err;
+        if (output !== file) {
+            output.destroy(err);
+        }
+    });
+    if (output !== file) {
+        output.on('error', err => {
+            streamError = streamError || err;
+        });
+        output.pipe(file);
+    }
+
+    let pending = [];
+    let pendingBytes = 0;
+    let bytes = 0;
+    const flush = async () => {
+        if (streamError) {
+            throw streamError;
+        }
+        if (pendingBytes === 0) {
+            return;
+        }
+        const chunk = pending.length === 1 ? pending[0] : Buffer.concat(pending, pendingBytes);
+        bytes += pendingBytes;
+        pending = [];
+        pendingBytes = 0;
+        if (!output.write(chunk)) {
+            await waitEvent(output, 'drain');
+        }
+    };
+    const emit = record => {
+        pending.push(record);
+        pendingBytes += record.length;
+    };
+
+    let prefixes = 0;
+    let entries = 0;
+    let attributes = 0; // 编码过的属性块个数
+
+    const attrCache = new Map(); // UPDATE 解码结果 -> 编码后的属性
+    const attributesOf = update => {
+        let encoded = attrCache.get(update);
+        if (!encoded) {
+            if (attrCache.size >= ATTR_CACHE_MAX) {
+                attrCache.clear();
+            }
+            encoded = update?.attributes ? encodeRibAttributes(update.attributes) : Buffer.alloc(0);
+            attrCache.set(update, encoded);
+            attributes++;
+        }
+        return encoded;
+    };
+
+    try {
+        emit(encodePeerIndexTable(timestamp, collectorId, viewName, indexEntries));
+
+        const cursors = new Array(peers.length).fill(0);
+        const group = [];
+        for (;;) {
+            // 各对等体当前位置中最小的前缀(排序键 '|' 之前的部分)
+            let prefixKey = null;
+            for (let p = 0; p < peers.length; p++) {
+                const { keys } = peers[p].snapshot;
+                if (cursors[p] < keys.length) {
+                    const key = keys[cursors[p]];
+                    const candidate = key.slice(0, key.indexOf('|'));
+                    if (prefixKey === null || candidate < prefixKey) {
+                        prefixKey = candidate;
+                    }
+                }
+            }
+            if (prefixKey === null) {
+                break;
+            }
+
+            // 收集所有对等体在该前缀上的路由
+            const prefixTag = prefixKey + '|';
+            group.length = 0;
+            let entriesLength = 0;
+            for (let p = 0; p < peers.length; p++) {
+                const { keys, updates } = peers[p].snapshot;
+                while (cursors[p] < keys.length && keys[cursors[p]].startsWith(prefixTag)) {
+                    const key = keys[cursors[p]];
+                    const attrs = attributesOf(updates[cursors[p]]);
+                    // 排序键为 地址十六进制 + 掩码十六进制 + '|' + pathId|rd|ip|mask
+                    const pathId = parseInt(key.slice(prefixTag.length), 10) || 0;
+                    group.push({ peerIndex: peerIndexes[p], pathId, attrs });
+                    entriesLength += 2 + 4 + (addPath ? 4 : 0) + 2 + attrs.length;
+                    cursors[p]++;
+                }
+            }
+
+            const prefixLength = parseInt(prefixKey.slice(-2), 16);
+            const prefixBytes = (prefixLength + 7) >> 3;
+            const length = 4 + 1 + prefixBytes + 2 + entriesLength;
+            const record = Buffer.alloc(MRT_HEADER_LEN + length);
+            encodeMrtHeader(record, timestamp, subtype, length);
+            let pos = MRT_HEADER_LEN;
+            record.writeUInt32BE(prefixes, pos);
+            record[pos + 4] = prefixLength;
+            pos += 5;
+            hexToBytes(prefixKey, 0, prefixBytes).copy(record, pos);
+            pos += prefixBytes;
+            record.writeUInt16BE(group.length, pos);
+            pos += 2;
+            for (const entry of group) {
+                record.writeUInt16BE(entry.peerIndex, pos);
+                record.writeUInt32BE(timestamp, pos + 2);
+                pos += 6;
+                if (addPath) {
+                    record.writeUInt32BE(entry.pathId >>> 0, pos);
+                    pos += 4;
+                }
+                record.writeUInt16BE(entry.attrs.length, pos);
+                entry.attrs.copy(record, pos + 2);
+                pos += 2 + entry.attrs.length;
+            }
+            emit(record);
+            prefixes++;
+            entries += group.length;
+
+            if (pendingBytes >= FLUSH_BYTES) {
+                await flush();
+            }
+            if (prefixes % BATCH_PREFIXES === 0) {
+                await new Promise(resolve => setImmediate(resolve));
+            }
+        }
+
+        await flush();
+        const finished = waitEvent(file, 'close');
+        output.end();
+        await finished;
+    } catch (err) {
+        output.destroy();
+        file.destroy();
+        throw err;
+    }
+
+    return { peers: indexEntries.length, prefixes, entries, attributes, bytes };
+}
+
+module.exports = { writeRibDump, MRT_SUBTYPE };
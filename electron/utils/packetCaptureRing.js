@@ -0,0 +1,149 @@
+/**
+ * 抓包环形缓冲区
+ *
+ * 报文字节按到达顺序连续写入一块 SharedArrayBuffer，写到末尾后回绕到开头，
+ * 被新数据覆盖的最早报文自动淘汰；每个报文的位置、长度和时间戳保存在定长
+ * 索引数组中。抓包回调里每个报文只做一次内存拷贝，不再生成十六进制字符串。
+ *
+ * 报文编号(id)从 1 开始单调递增，编号为 id 的报文位于索引槽 (id - 1) % slots。
+ */
+class PacketCaptureRing {
+    constructor(dataBytes, slots) {
+        this.dataBytes = dataBytes;
+        this.slots = slots;
+        this.data = Buffer.from(new SharedArrayBuffer(dataBytes));
+        this.offsets = new Uint32Array(slots);
+        this.lengths = new Uint32Array(slots);
+        this.truncated = new Uint8Array(slots);
+        this.times = new Float64Array(slots);
+        this.reset();
+    }
+
+    reset() {
+        this.first = 1; // 最早的仍保留的报文编号
+        this.next = 1; // 下一个报文编号
+        this.writePos = 0;
+        this.evicted = 0;
+    }
+
+    get count() {
+        return this.next - this.first;
+    }
+
+    /**
+     * 拷贝一个报文到环中
+     * @param {Buffer} src 抓包缓冲区
+     * @param {number} nbytes 实际捕获的字节数
+     * @param {boolean} truncated 报文是否因抓包缓冲区不足被截断
+     * @param {number} time 时间戳(毫秒)
+     * @returns {number} 报文编号
+     */
+    push(src, nbytes, truncated, time) {
+        const length = Math.min(nbytes, this.dataBytes);
+        // 末尾放不下时回绕，末尾剩余空间里的报文一并淘汰
+        const wrap = this.writePos + length > this.dataBytes;
+        const pos = wrap ? 0 : this.writePos;
+        const end = pos + length;
+
+        // 淘汰数据区与本次写入范围重叠的最早报文，以及索引槽已用完时的最早报文
+        while (this.first < this.next) {
+            const slot = (this.first - 1) % this.slots;
+            const start = this.offsets[slot];
+            const overlap =
+                (start >= pos && start < end) ||
+                (start < pos && start + this.lengths[slot] > pos) ||
+                (wrap && start >= this.writePos);
+            if (!overlap && this.next - this.first < this.slots) {
+                break;
+            }
+            this.first++;
+            this.evicted++;
+        }
+
+        src.copy(this.data, pos, 0, length);
+
+        const id = this.next++;
+        const slot = (id - 1) % this.slots;
+        this.offsets[slot] = pos;
+        this.lengths[slot] = length;
+        this.truncated[slot] = truncated ? 1 : 0;
+        this.times[slot] = time;
+        this.writePos = end;
+        return id;
+    }
+
+    has(id) {
+        return id >= this.first && id < this.next;
+    }
+
+    /**
+     * 报文内容的视图，仅在下一次 push 之前有效
+     */
+    view(id) {
+        const slot = (id - 1) % this.slots;
+        const offset = this.offsets[slot];
+        return this.data.subarray(offset, offset + this.lengths[slot]);
+    }
+
+    /**
+     * 供界面展示的报文记录
+     */
+    record(id) {
+        const slot = (id - 1) % this.slots;
+        const offset = this.offsets[slot];
+        const length = this.lengths[slot];
+        return {
+            id,
+            timestamp: new Date(this.times[slot]).toISOString(),
+            length,
+            truncated: this.truncated[slot] === 1,
+            raw: this.data.toString('hex', offset, offset + length)
+        };
+    }
+
+    /**
+     * 编号在 [from, to) 且仍保留的报文记录
+     */
+    records(from = this.first, to = this.next) {
+        const result = [];
+        for (let id = Math.max(from, this.first); id < to; id++) {
+            result.push(this.record(id));
+        }
+        return result;
+    }
+
+    /**
+     * 把指定报文拷贝到一块新的共享内存中，交给解析 worker 使用
+     *
+     * 环中的数据随时可能被新报文覆盖，因此不直接共享环本身。
+     * @returns {{ block: SharedArrayBuffer, packets: Array<{id, offset, length}>, missing: number[] }}
+     */
+    extract(ids) {
+        const kept = [];
+        const missing = [];
+        let total = 0;
+        for (const id of ids) {
+            if (this.has(id)) {
+                kept.push(id);
+                total += this.lengths[(id - 1) % this.slots];
+            } else {
+                missing.push(id);
+            }
+        }
+
+        const block = new SharedArrayBuffer(Math.max(total, 1));
+        const target = Buffer.from(block);
+        const packets = new Array(kept.length);
+        let offset = 0;
+        for (let i = 0; i < kept.length; i++) {
+            const src = this.view(kept[i]);
+            src.copy(target, offset);
+            packets[i] = { id: kept[i], offset, length: src.length };
+            offset += src.length;
+        }
+
+        return { block, packets, missing };
+    }
+}
+
+module.exports = PacketCaptureRing;
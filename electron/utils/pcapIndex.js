@@ -0,0 +1,694 @@
+/**
+ * 离线抓包文件索引
+ *
+ * 打开 pcap/pcapng 文件时不把报文读进内存，而是按块顺序读取(pread)建立一份列式索引:
+ * 每个报文在文件中的偏移、长度、时间戳，以及解析出的网络层/传输层信息(五元组、TCP 序列号等)。
+ * 各列都放在 SharedArrayBuffer 上，解析 worker 可以按报文区间并行填写，读取端按页生成摘要，
+ * 需要详细解析某个报文时再按偏移从文件中读出。
+ *
+ * 支持的格式:
+ * - pcap: 大小端、微秒/纳秒时间戳
+ * - pcapng: SHB/IDB/EPB/SPB/PB，每个接口各自的链路类型和时间精度
+ */
+
+const fs = require('fs');
+const ipaddr = require('ipaddr.js');
+const { TcpStream, seqDiff } = require('./tcpStream');
+const BgpStreamFramer = require('./bgpStreamFramer');
+
+const PCAP_MAGIC_USEC = 0xa1b2c3d4;
+const PCAP_MAGIC_NSEC = 0xa1b23c4d;
+const PCAPNG_SHB = 0x0a0d0d0a;
+const PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+
+const PCAPNG_BLOCK = {
+    IDB: 0x00000001,
+    PB: 0x00000002,
+    SPB: 0x00000003,
+    EPB: 0x00000006
+};
+
+// 链路类型(LINKTYPE_*)
+const LINK_TYPE = {
+    NULL: 0,
+    ETHERNET: 1,
+    RAW: 101,
+    LOOP: 108,
+    LINUX_SLL: 113,
+    IPV4: 228,
+    IPV6: 229,
+    LINUX_SLL2: 276
+};
+
+const ETHER_TYPE = {
+    IPV4: 0x0800,
+    ARP: 0x0806,
+    VLAN: 0x8100,
+    QINQ: 0x88a8,
+    IPV6: 0x86dd
+};
+
+const IP_PROTO = {
+    ICMP: 1,
+    TCP: 6,
+    UDP: 17,
+    ICMPV6: 58
+};
+
+const TCP_SYN = 0x02;
+
+// 解析网络层和传输层头部时最多读取的字节数
+const HEADER_PEEK = 256;
+
+// 扫描阶段得到的列
+const SCAN_COLUMNS = [
+    ['offsets', Float64Array],
+    ['capLens', Uint32Array],
+    ['origLens', Uint32Array],
+    ['times', Float64Array], // 秒
+    ['linkTypes', Uint16Array]
+];
+
+// 解析阶段填写的列
+const DISSECT_COLUMNS = [
+    ['netTypes', Uint16Array], // 以太网类型，0 表示未知
+    ['ipProtos', Uint8Array],
+    ['addrLens', Uint8Array], // 4 或 16，0 表示没有 IP 地址
+    ['srcPorts', Uint16Array],
+    ['dstPorts', Uint16Array],
+    ['payloadOffsets', Uint16Array], // 传输层载荷在报文中的偏移
+    ['payloadLengths', Uint16Array],
+    ['tcpSeqs', Uint32Array],
+    ['tcpFlags', Uint8Array],
+    ['flowIds', Uint32Array],
+    ['flowNext', Int32Array] // 同一条流的下一个报文，-1 表示没有
+];
+
+const NO_FLOW = 0xffffffff;
+
+// 重组结果中每条 BGP 报文占的 Uint32 个数: lastPkt, firstPkt, startSeq, length, type
+const BGP_MESSAGE_FIELDS = 5;
+
+/**
+ * 带缓存的顺序读取，只在请求的范围超出当前块时才重新读文件
+ */
+class ChunkReader {
+    constructor(fd, fileSize, chunkSize) {
+        this.fd = fd;
+        this.fileSize = fileSize;
+        this.chunkSize = chunkSize;
+        this.buffer = Buffer.allocUnsafe(chunkSize);
+        this.start = 0;
+        this.end = 0;
+    }
+
+    /**
+     * 保证 [pos, pos + n) 在缓存中
+     * @returns {number} 该范围在 this.buffer 中的起始下标，超出文件末尾返回 -1
+     */
+    ensure(pos, n) {
+        if (pos >= this.start && pos + n <= this.end) {
+            return pos - this.start;
+        }
+        if (pos + n > this.fileSize) {
+            return -1;
+        }
+        const length = Math.max(n, Math.min(this.chunkSize, this.fileSize - pos));
+        if (this.buffer.length < length) {
+            this.buffer = Buffer.allocUnsafe(length);
+        }
+        const read = fs.readSync(this.fd, this.buffer, 0, length, pos);
+        this.start = pos;
+        this.end = pos + read;
+        return read >= n ? 0 : -1;
+    }
+}
+
+/**
+ * 容量按需翻倍的数值列，扫描时报文个数未知
+ */
+class GrowableColumn {
+    constructor(Type, capacity = 65536) {
+        this.Type = Type;
+        this.values = new Type(capacity);
+    }
+
+    set(index, value) {
+        if (index >= this.values.length) {
+            const values = new this.Type(this.values.length * 2);
+            values.set(this.values);
+            this.values = values;
+        }
+        this.values[index] = value;
+    }
+}
+
+function allocShared(Type, length) {
+    return new Type(new SharedArrayBuffer(Math.max(length * Type.BYTES_PER_ELEMENT, 8)), 0, length);
+}
+
+class PcapIndex {
+    constructor(count, columns) {
+        this.count = count;
+        Object.assign(this, columns);
+    }
+
+    /**
+     * 顺序扫描文件，只解析文件格式层面的记录头
+     * @param {number} fd 已打开的文件
+     * @param {number} chunkSize 每次读取的字节数
+     * @returns {PcapIndex}
+     */
+    static scan(fd, chunkSize) {
+        const fileSize = fs.fstatSync(fd).size;
+        const reader = new ChunkReader(fd, fileSize, chunkSize);
+        const columns = SCAN_COLUMNS.map(([, Type]) => new GrowableColumn(Type));
+        let count = 0;
+        const add = (offset, capLen, origLen, time, linkType) => {
+            columns[0].set(count, offset);
+            columns[1].set(count, capLen);
+            columns[2].set(count, origLen);
+            columns[3].set(count, time);
+            columns[4].set(count, linkType);
+            count++;
+        };
+
+        const at = reader.ensure(0, 4);
+        if (at < 0) {
+            throw new Error('文件太小，不是有效的抓包文件');
+        }
+        const magic = reader.buffer.readUInt32BE(at);
+        if (magic === PCAPNG_SHB) {
+            PcapIndex.scanPcapng(reader, add);
+        } else if ([PCAP_MAGIC_USEC, PCAP_MAGIC_NSEC].some(m => m === magic || m === reader.buffer.readUInt32LE(at))) {
+            PcapIndex.scanPcap(reader, add);
+        } else {
+            throw new Error('不支持的文件格式，只支持 pcap 和 pcapng');
+        }
+
+        const result = {};
+        SCAN_COLUMNS.forEach(([name, Type], i) => {
+            result[name] = allocShared(Type, count);
+            result[name].set(columns[i].values.subarray(0, count));
+        });
+        for (const [name, Type] of DISSECT_COLUMNS) {
+            result[name] = allocShared(Type, count);
+        }
+        result.flowNext.fill(-1);
+        result.flowIds.fill(NO_FLOW);
+        result.srcAddrs = allocShared(Uint8Array, count * 16);
+        result.dstAddrs = allocShared(Uint8Array, count * 16);
+        return new PcapIndex(count, result);
+    }
+
+    static scanPcap(reader, add) {
+        const buffer = () => reader.buffer;
+        let at = reader.ensure(0, 24);
+        if (at < 0) {
+            throw new Error('pcap 文件头不完整');
+        }
+        const le = buffer().readUInt32LE(at) === PCAP_MAGIC_USEC || buffer().readUInt32LE(at) === PCAP_MAGIC_NSEC;
+        const read32 = offset => (le ? buffer().readUInt32LE(offset) : buffer().readUInt32BE(offset));
+        const fracScale = read32(at) === PCAP_MAGIC_NSEC ? 1e-9 : 1e-6;
+        const linkType = read32(at + 20) & 0xffff;
+
+        let pos = 24;
+        while ((at = reader.ensure(pos, 16)) >= 0) {
+            const capLen = read32(at + 8);
+            if (pos + 16 + capLen > reader.fileSize) {
+                break; // 文件被截断
+            }
+            add(pos + 16, capLen, read32(at + 12), read32(at) + read32(at + 4) * fracScale, linkType);
+            pos += 16 + capLen;
+        }
+    }
+
+    static scanPcapng(reader, add) {
+        let le = true;
+        let interfaces = [];
+        let pos = 0;
+        let at;
+        while ((at = reader.ensure(pos, 12)) >= 0) {
+            let buffer = reader.buffer;
+            const blockType = le ? buffer.readUInt32LE(at) : buffer.readUInt32BE(at);
+            if (blockType === PCAPNG_SHB) {
+                // 每个分段可以有不同的字节序，接口编号也从 0 重新开始
+                le = buffer.readUInt32LE(at + 8) === PCAPNG_BYTE_ORDER_MAGIC;
+                interfaces = [];
+            }
+            const read32 = offset => (le ? buffer.readUInt32LE(offset) : buffer.readUInt32BE(offset));
+            const read16 = offset => (le ? buffer.readUInt16LE(offset) : buffer.readUInt16BE(offset));
+            const blockLen = read32(at + 4);
+            if (blockLen < 12 || blockLen % 4 !== 0 || pos + blockLen > reader.fileSize) {
+                break;
+            }
+
+            switch (blockType) {
+                case PCAPNG_BLOCK.IDB: {
+                    at = reader.ensure(pos, blockLen);
+                    buffer = reader.buffer;
+                    interfaces.push({
+                        linkType: read16(at + 8),
+                        tsScale: PcapIndex.readTsResolution(buffer, at + 16, at + blockLen - 4, read16)
+                    });
+                    break;
+                }
+                case PCAPNG_BLOCK.EPB:
+                case PCAPNG_BLOCK.PB: {
+                    at = reader.ensure(pos, 28);
+                    buffer = reader.buffer;
+                    const ifIndex = blockType === PCAPNG_BLOCK.EPB ? read32(at + 8) : read16(at + 8);
+                    const iface = interfaces[ifIndex] || { linkType: LINK_TYPE.ETHERNET, tsScale: 1e-6 };
+                    const ts = read32(at + 12) * 4294967296 + read32(at + 16);
+                    const capLen = Math.min(read32(at + 20), blockLen - 32);
+                    add(pos + 28, capLen, read32(at + 24), ts * iface.tsScale, iface.linkType);
+                    break;
+                }
+                case PCAPNG_BLOCK.SPB: {
+                    at = reader.ensure(pos, 12);
+                    buffer = reader.buffer;
+                    const iface = interfaces[0] || { linkType: LINK_TYPE.ETHERNET };
+                    const origLen = read32(at + 8);
+                    // SPB 没有时间戳
+                    add(pos + 12, Math.min(origLen, blockLen - 16), origLen, 0, iface.linkType);
+                    break;
+                }
+                default:
+                    break;
+            }
+            pos += blockLen;
+        }
+    }
+
+    // IDB 选项中的 if_tsresol，缺省为微秒
+    static readTsResolution(buffer, start, end, read16) {
+        let offset = start;
+        while (offset + 4 <= end) {
+            const code = read16(offset);
+            const length = read16(offset + 2);
+            if (code === 0) {
+                break;
+            }
+            if (code === 9 && length >= 1) {
+                const value = buffer[offset + 4];
+                return value & 0x80 ? Math.pow(2, -(value & 0x7f)) : Math.pow(10, -value);
+            }
+            offset += 4 + ((length + 3) & ~3);
+        }
+        return 1e-6;
+    }
+
+    /**
+     * 把索引的各列(共享内存)打包，交给其他 worker 用 fromShared 打开
+     */
+    share() {
+        const columns = {};
+        for (const [name] of [...SCAN_COLUMNS, ...DISSECT_COLUMNS]) {
+            columns[name] = this[name].buffer;
+        }
+        columns.srcAddrs = this.srcAddrs.buffer;
+        columns.dstAddrs = this.dstAddrs.buffer;
+        return { count: this.count, columns };
+    }
+
+    static fromShared(shared) {
+        const { count, columns } = shared;
+        const result = {};
+        for (const [name, Type] of [...SCAN_COLUMNS, ...DISSECT_COLUMNS]) {
+            result[name] = new Type(columns[name], 0, count);
+        }
+        result.srcAddrs = new Uint8Array(columns.srcAddrs, 0, count * 16);
+        result.dstAddrs = new Uint8Array(columns.dstAddrs, 0, count * 16);
+        return new PcapIndex(count, result);
+    }
+
+    /**
+     * 解析 [start, end) 区间报文的网络层和传输层头部，填写解析列
+     */
+    dissectRange(fd, start, end, chunkSize) {
+        const reader = new ChunkReader(fd, fs.fstatSync(fd).size, chunkSize);
+        for (let i = start; i < end; i++) {
+            const length = Math.min(this.capLens[i], HEADER_PEEK);
+            const at = reader.ensure(this.offsets[i], length);
+            if (at >= 0) {
+                this.dissectPacket(i, reader.buffer.subarray(at, at + length), this.capLens[i]);
+            }
+        }
+    }
+
+    dissectPacket(i, buffer, capLen) {
+        let offset;
+        let netType;
+        switch (this.linkTypes[i]) {
+            case LINK_TYPE.ETHERNET: {
+                if (buffer.length < 14) {
+                    return;
+                }
+                offset = 14;
+                netType = buffer.readUInt16BE(12);
+                // 最多跳过两层 VLAN 标签
+                for (let tags = 0; tags < 2 && (netType === ETHER_TYPE.VLAN || netType === ETHER_TYPE.QINQ); tags++) {
+                    if (buffer.length < offset + 4) {
+                        return;
+                    }
+                    netType = buffer.readUInt16BE(offset + 2);
+                    offset += 4;
+                }
+                break;
+            }
+            case LINK_TYPE.LINUX_SLL:
+                if (buffer.length < 16) {
+                    return;
+                }
+                offset = 16;
+                netType = buffer.readUInt16BE(14);
+                break;
+            case LINK_TYPE.LINUX_SLL2:
+                if (buffer.length < 20) {
+                    return;
+                }
+                offset = 20;
+                netType = buffer.readUInt16BE(0);
+                break;
+            case LINK_TYPE.NULL:
+            case LINK_TYPE.LOOP:
+                offset = 4;
+                netType = PcapIndex.ipEtherType(buffer, offset);
+                break;
+            case LINK_TYPE.RAW:
+            case LINK_TYPE.IPV4:
+            case LINK_TYPE.IPV6:
+                offset = 0;
+                netType = PcapIndex.ipEtherType(buffer, offset);
+                break;
+            default:
+                return;
+        }
+
+        this.netTypes[i] = netType;
+        if (netType === ETHER_TYPE.IPV4) {
+            this.dissectIpv4(i, buffer, offset, capLen);
+        } else if (netType === ETHER_TYPE.IPV6) {
+            this.dissectIpv6(i, buffer, offset, capLen);
+        }
+    }
+
+    // 没有链路层类型字段时按 IP 版本号判断
+    static ipEtherType(buffer, offset) {
+        if (buffer.length <= offset) {
+            return 0;
+        }
+        const version = buffer[offset] >> 4;
+        return version === 4 ? ETHER_TYPE.IPV4 : version === 6 ? ETHER_TYPE.IPV6 : 0;
+    }
+
+    dissectIpv4(i, buffer, offset, capLen) {
+        if (buffer.length < offset + 20) {
+            return;
+        }
+        const headerLen = (buffer[offset] & 0x0f) * 4;
+        const totalLen = buffer.readUInt16BE(offset + 2);
+        this.ipProtos[i] = buffer[offset + 9];
+        this.addrLens[i] = 4;
+        this.srcAddrs.set(buffer.subarray(offset + 12, offset + 16), i * 16);
+        this.dstAddrs.set(buffer.subarray(offset + 16, offset + 20), i * 16);
+        // 非首个分片没有传输层头部
+        if ((buffer.readUInt16BE(offset + 6) & 0x1fff) !== 0) {
+            return;
+        }
+        // 以太网最小帧长会补零，载荷以 IP 总长度为准
+        const end = Math.min(offset + Math.max(totalLen, headerLen), capLen);
+        this.dissectTransport(i, buffer, offset + headerLen, end);
+    }
+
+    dissectIpv6(i, buffer, offset, capLen) {
+        if (buffer.length < offset + 40) {
+            return;
+        }
+        const end = Math.min(offset + 40 + buffer.readUInt16BE(offset + 4), capLen);
+        this.addrLens[i] = 16;
+        this.srcAddrs.set(buffer.subarray(offset + 8, offset + 24), i * 16);
+        this.dstAddrs.set(buffer.subarray(offset + 24, offset + 40), i * 16);
+
+        // 跳过扩展头
+        let next = buffer[offset + 6];
+        let cur = offset + 40;
+        for (;;) {
+            if (next === 0 || next === 43 || next === 60) {
+                if (buffer.length < cur + 2) {
+                    break;
+                }
+                next = buffer[cur];
+                cur += (buffer[cur + 1] + 1) * 8;
+            } else if (next === 44) {
+                if (buffer.length < cur + 8) {
+                    break;
+                }
+                // 非首个分片没有传输层头部
+                if ((buffer.readUInt16BE(cur + 2) & 0xfff8) !== 0) {
+                    this.ipProtos[i] = buffer[cur];
+                    return;
+                }
+                next = buffer[cur];
+                cur += 8;
+            } else {
+                break;
+            }
+        }
+        this.ipProtos[i] = next;
+        this.dissectTransport(i, buffer, cur, end);
+    }
+
+    dissectTransport(i, buffer, offset, end) {
+        const proto = this.ipProtos[i];
+        if (proto === IP_PROTO.TCP) {
+            if (buffer.length < offset + 20) {
+                return;
+            }
+            const headerLen = (buffer[offset + 12] >> 4) * 4;
+            this.srcPorts[i] = buffer.readUInt16BE(offset);
+            this.dstPorts[i] = buffer.readUInt16BE(offset + 2);
+            this.tcpSeqs[i] = buffer.readUInt32BE(offset + 4);
+            this.tcpFlags[i] = buffer[offset + 13];
+            this.payloadOffsets[i] = offset + headerLen;
+            this.payloadLengths[i] = Math.max(0, end - offset - headerLen);
+        } else if (proto === IP_PROTO.UDP) {
+            if (buffer.length < offset + 8) {
+                return;
+            }
+            this.srcPorts[i] = buffer.readUInt16BE(offset);
+            this.dstPorts[i] = buffer.readUInt16BE(offset + 2);
+            this.payloadOffsets[i] = offset + 8;
+            this.payloadLengths[i] = Math.max(0, end - offset - 8);
+        }
+    }
+
+    isTransport(i) {
+        return this.addrLens[i] !== 0 && (this.ipProtos[i] === IP_PROTO.TCP || this.ipProtos[i] === IP_PROTO.UDP);
+    }
+
+    /**
+     * 按方向区分的五元组给 TCP/UDP 报文分配流编号，并把同一条流的报文串成链表
+     * @returns {Array<{ first: number, last: number, count: number, srcPort: number, dstPort: number }>}
+     */
+    assignFlows() {
+        const flows = [];
+        const flowMap = new Map();
+        for (let i = 0; i < this.count; i++) {
+            if (!this.isTransport(i)) {
+                continue;
+            }
+            const addrLen = this.addrLens[i];
+            const key =
+                this.ipProtos[i] +
+                '|' +
+                Buffer.from(this.srcAddrs.buffer, i * 16, addrLen).toString('latin1') +
+                '|' +
+                Buffer.from(this.dstAddrs.buffer, i * 16, addrLen).toString('latin1') +
+                '|' +
+                this.srcPorts[i] +
+                '|' +
+                this.dstPorts[i];
+            let flowId = flowMap.get(key);
+            if (flowId === undefined) {
+                flowId = flows.length;
+                flowMap.set(key, flowId);
+                flows.push({ first: i, last: i, count: 0, srcPort: this.srcPorts[i], dstPort: this.dstPorts[i] });
+            } else {
+                this.flowNext[flows[flowId].last] = i;
+                flows[flowId].last = i;
+            }
+            flows[flowId].count++;
+            this.flowIds[i] = flowId;
+        }
+        return flows;
+    }
+
+    /**
+     * 重组一组 TCP 流并切分出 BGP 报文
+     *
+     * 按文件顺序遍历报文，只处理属于这些流的报文，读文件仍是顺序的。
+     * @param {Array<{ id: number, first: number, last: number }>} flows 要重组的流
+     * @returns {{ count: number, buffer: SharedArrayBuffer }} 每条报文 BGP_MESSAGE_FIELDS 个 Uint32
+     */
+    reassembleBgp(fd, flows, chunkSize, maxPending) {
+        const owned = new Set();
+        let start = this.count;
+        let end = 0;
+        for (const flow of flows) {
+            owned.add(flow.id);
+            start = Math.min(start, flow.first);
+            end = Math.max(end, flow.last + 1);
+        }
+
+        let messages = new Uint32Array(4096 * BGP_MESSAGE_FIELDS);
+        let count = 0;
+        const onMessage = message => {
+            if ((count + 1) * BGP_MESSAGE_FIELDS > messages.length) {
+                const grown = new Uint32Array(messages.length * 2);
+                grown.set(messages);
+                messages = grown;
+            }
+            const at = count * BGP_MESSAGE_FIELDS;
+            messages[at] = message.lastPkt;
+            messages[at + 1] = message.firstPkt;
+            messages[at + 2] = message.startSeq;
+            messages[at + 3] = message.length;
+            messages[at + 4] = message.type;
+            count++;
+        };
+
+        const streams = new Map(); // flowId -> TcpStream
+        const reader = new ChunkReader(fd, fs.fstatSync(fd).size, chunkSize);
+        for (let i = start; i < end; i++) {
+            const flowId = this.flowIds[i];
+            if (!owned.has(flowId)) {
+                continue;
+            }
+            let stream = streams.get(flowId);
+            if (!stream) {
+                const framer = new BgpStreamFramer(onMessage);
+                stream = new TcpStream(
+                    (data, pkt, seq) => framer.push(data, pkt, seq),
+                    () => framer.reset(),
+                    maxPending
+                );
+                streams.set(flowId, stream);
+            }
+            if (this.tcpFlags[i] & TCP_SYN) {
+                stream.syn(this.tcpSeqs[i]);
+            }
+            const length = this.payloadLengths[i];
+            if (length === 0) {
+                continue;
+            }
+            const at = reader.ensure(this.offsets[i] + this.payloadOffsets[i], length);
+            if (at >= 0) {
+                stream.push(this.tcpSeqs[i], reader.buffer.subarray(at, at + length), i);
+            }
+        }
+
+        const buffer = new SharedArrayBuffer(Math.max(count * BGP_MESSAGE_FIELDS * 4, 8));
+        new Uint32Array(buffer).set(messages.subarray(0, count * BGP_MESSAGE_FIELDS));
+        return { count, buffer };
+    }
+
+    /**
+     * 沿流链表从 firstPkt 到 lastPkt 重新拼出序列号 [startSeq, startSeq + length) 的数据
+     */
+    collectStream(fd, firstPkt, lastPkt, startSeq, length) {
+        const data = Buffer.alloc(length);
+        let filled = 0;
+        const stream = new TcpStream(
+            (chunk, pkt, seq) => {
+                const at = seqDiff(seq, startSeq);
+                const n = Math.min(chunk.length, length - at);
+                if (n > 0) {
+                    chunk.copy(data, at, 0, n);
+                    filled = at + n;
+                }
+            },
+            null,
+            Infinity
+        );
+        stream.nextSeq = startSeq;
+        for (let p = firstPkt; p >= 0 && p <= lastPkt && filled < length; p = this.flowNext[p]) {
+            const packet = this.readPacket(fd, p);
+            const offset = this.payloadOffsets[p];
+            stream.push(this.tcpSeqs[p], packet.subarray(offset, offset + this.payloadLengths[p]), p);
+        }
+        return filled === length ? data : null;
+    }
+
+    /**
+     * 从文件中读出第 i 个报文
+     */
+    readPacket(fd, i) {
+        const buffer = Buffer.allocUnsafe(this.capLens[i]);
+        const read = fs.readSync(fd, buffer, 0, buffer.length, this.offsets[i]);
+        return buffer.subarray(0, read);
+    }
+
+    address(addrs, i) {
+        const addrLen = this.addrLens[i];
+        if (addrLen === 0) {
+            return '';
+        }
+        return ipaddr.fromByteArray(Array.from(addrs.subarray(i * 16, i * 16 + addrLen))).toString();
+    }
+
+    /**
+     * 第 i 个报文的摘要
+     */
+    summary(i) {
+        const netType = this.netTypes[i];
+        const proto = this.ipProtos[i];
+        const item = {
+            id: i + 1,
+            time: this.times[i],
+            source: this.address(this.srcAddrs, i),
+            destination: this.address(this.dstAddrs, i),
+            length: this.origLens[i],
+            protocol: '',
+            info: ''
+        };
+
+        if (this.addrLens[i] === 0) {
+            item.protocol =
+                netType === ETHER_TYPE.ARP ? 'ARP' : netType ? `0x${netType.toString(16).padStart(4, '0')}` : 'Unknown';
+            return item;
+        }
+
+        switch (proto) {
+            case IP_PROTO.TCP: {
+                item.protocol = 'TCP';
+                const flags = PcapIndex.tcpFlagsString(this.tcpFlags[i]);
+                item.info =
+                    `${this.srcPorts[i]} → ${this.dstPorts[i]} [${flags}] ` +
+                    `Seq=${this.tcpSeqs[i]} Len=${this.payloadLengths[i]}`;
+                break;
+            }
+            case IP_PROTO.UDP:
+                item.protocol = 'UDP';
+                item.info = `${this.srcPorts[i]} → ${this.dstPorts[i]} Len=${this.payloadLengths[i]}`;
+                break;
+            case IP_PROTO.ICMP:
+                item.protocol = 'ICMP';
+                break;
+            case IP_PROTO.ICMPV6:
+                item.protocol = 'ICMPv6';
+                break;
+            default:
+                item.protocol = this.addrLens[i] === 4 ? 'IPv4' : 'IPv6';
+                item.info = `Protocol=${proto}`;
+        }
+        return item;
+    }
+
+    static tcpFlagsString(flags) {
+        const names = ['FIN', 'SYN', 'RST', 'PSH', 'ACK', 'URG', 'ECE', 'CWR'];
+        return names.filter((_, bit) => flags & (1 << bit)).join(', ');
+    }
+}
+
+module.exports = { PcapIndex, ChunkReader, LINK_TYPE, ETHER_TYPE, IP_PROTO, NO_FLOW, BGP_MESSAGE_FIELDS };
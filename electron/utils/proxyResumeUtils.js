@@ -0,0 +1,44 @@
+// 远程代理可续传转发的握手和确认帧，格式见 scripts/tcp-proxy-resume.c，整数均为网络字节序
+const RESUME_HELLO_MAGIC = Buffer.from('PXRS');
+const RESUME_HELLO_LENGTH = 32;
+const RESUME_ACCEPT_MAGIC = Buffer.from('PXRA');
+const RESUME_ACK_MAGIC = Buffer.from('PXRK');
+
+// 连接上的前几个字节是否可能是续传握手（BMP 报文以版本号 3 开头，不会冲突）
+function isResumeHello(buffer) {
+    const length = Math.min(buffer.length, RESUME_HELLO_MAGIC.length);
+    return RESUME_HELLO_MAGIC.subarray(0, length).equals(buffer.subarray(0, length));
+}
+
+function parseResumeHello(buffer) {
+    if (buffer.length < RESUME_HELLO_LENGTH || !isResumeHello(buffer)) {
+        return null;
+    }
+    return {
+        version: buffer.readUInt16BE(4),
+        flags: buffer.readUInt16BE(6),
+        streamId: buffer.readBigUInt64BE(8).toString(16).padStart(16, '0'),
+        baseSeq: Number(buffer.readBigUInt64BE(16)),
+        writeSeq: Number(buffer.readBigUInt64BE(24))
+    };
+}
+
+function buildResumeFrame(magic, status, seq) {
+    const frame = Buffer.alloc(16);
+    magic.copy(frame, 0);
+    frame.writeUInt32BE(status, 4);
+    frame.writeBigUInt64BE(BigInt(seq), 8);
+    return frame;
+}
+
+// 回复握手：resumeSeq 为该流已收到的字节数，新的流为 0
+function buildResumeAccept(resumeSeq, status = 0) {
+    return buildResumeFrame(RESUME_ACCEPT_MAGIC, status, resumeSeq);
+}
+
+// 确认已处理的字节数，helper 收到后释放之前的数据
+function buildResumeAck(ackedSeq) {
+    return buildResumeFrame(RESUME_ACK_MAGIC, 0, ackedSeq);
+}
+
+module.exports = { RESUME_HELLO_LENGTH, isResumeHello, parseResumeHello, buildResumeAccept, buildResumeAck };
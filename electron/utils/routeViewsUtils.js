@@ -3,6 +3,13 @@ const zlib = require('zlib');
 const BgpConst = require('../const/bgpConst');
 const { ipv4BufferToString, ipv6BufferToString } = require('./ipUtils');
 const { parsePathAttributes } = require('./bgpPacketParser');
+const { PathAttributes } = require('./bgpUpdateDecoder');
+
+// TABLE_DUMP_V2 子类型，ADDPATH 子类型的 RIB 条目带 Path Identifier (RFC 8050)
+const RIB_SUBTYPES = {
+    [BgpConst.BGP_AFI_TYPE.AFI_IPV4]: { plain: 2, addPath: 8 },
+    [BgpConst.BGP_AFI_TYPE.AFI_IPV6]: { plain: 4, addPath: 10 }
+};
 
 /**
  * Parses a local MRT file (.bz2 or .gz) and returns BGP routes.
@@ -48,11 +55,9 @@ async function importMrtFile(filePath, limit = 10000, targetAfi, onProgress) {
 
                         if (type === 13) {
                             // TABLE_DUMP_V2
-                            if (
-                                (targetAfi === BgpConst.BGP_AFI_TYPE.AFI_IPV4 && subtype === 2) ||
-                                (targetAfi === BgpConst.BGP_AFI_TYPE.AFI_IPV6 && subtype === 4)
-                            ) {
-                                const parsed = parseRibEntry(recordData, targetAfi);
+                            const ribSubtypes = RIB_SUBTYPES[targetAfi];
+                            if (ribSubtypes && (subtype === ribSubtypes.plain || subtype === ribSubtypes.addPath)) {
+                                const parsed = parseRibEntry(recordData, targetAfi, subtype === ribSubtypes.addPath);
                                 for (const r of parsed) {
                                     if (count < limit) {
                                         routes.push(r);
@@ -143,7 +148,7 @@ function parseTableDump(data, afi) {
     return null;
 }
 
-function parseRibEntry(data, afi) {
+function parseRibEntry(data, afi, addPath = false) {
     const entries = [];
     try {
         let pos = 0;
@@ -165,13 +170,14 @@ function parseRibEntry(data, afi) {
         pos += 2;
         for (let i = 0; i < entryCount; i++) {
             if (pos + 8 > data.length) break;
-            pos += 6; // skip peerIdx and origTime
+            pos += addPath ? 10 : 6; // skip peerIdx, origTime and path id
+            if (pos + 2 > data.length) break;
             const attrLen = data.readUInt16BE(pos);
             pos += 2;
             if (pos + attrLen > data.length) break;
             const attrBuf = data.subarray(pos, pos + attrLen);
             pos += attrLen;
-            const attrs = parseBgpAttributes(attrBuf, 4); // Type 13 usually uses 4-byte ASNs
+            const attrs = parseBgpAttributes(expandMrtMpReach(attrBuf), 4); // Type 13 usually uses 4-byte ASNs
             entries.push({
                 ip: prefix,
                 mask: prefixLen,
@@ -185,6 +191,43 @@ function parseRibEntry(data, afi) {
     return entries;
 }
 
+/**
+ * TABLE_DUMP_V2 的 RIB 条目中 MP_REACH_NLRI 只有下一跳长度和下一跳 (RFC 6396 4.3.4)，
+ * 按 UPDATE 中的格式补全 AFI/SAFI 和保留字节，以便用同一套属性解析
+ */
+function expandMrtMpReach(buffer) {
+    const attrs = new PathAttributes(buffer, 0, buffer.length, null);
+    const index = attrs.types.indexOf(BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI);
+    if (index < 0) {
+        return buffer;
+    }
+    const value = buffer.subarray(attrs.starts[index], attrs.ends[index]);
+    if (value.length === 0 || value[0] !== value.length - 1) {
+        // 已经是完整格式
+        return buffer;
+    }
+
+    const afi = value[0] === 4 ? BgpConst.BGP_AFI_TYPE.AFI_IPV4 : BgpConst.BGP_AFI_TYPE.AFI_IPV6;
+    // 下一跳长度为 32 时(全局地址 + 链路本地地址)只取全局地址
+    const nextHopLength = value[0] === 32 ? 16 : value[0];
+    // AFI(2) SAFI(1) 下一跳长度(1) 下一跳 保留字节(1)，没有 NLRI
+    const full = Buffer.alloc(4 + nextHopLength + 1);
+    full.writeUInt16BE(afi, 0);
+    full[2] = BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST;
+    full[3] = nextHopLength;
+    value.copy(full, 4, 1, 1 + nextHopLength);
+
+    const flags = attrs.flags[index] | BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH;
+    const header = Buffer.from([flags, BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI, full.length >> 8, full.length & 0xff]);
+    const headerLen = attrs.flags[index] & BgpConst.BGP_PATH_ATTR_FLAGS.EXTENDED_LENGTH ? 4 : 3;
+    return Buffer.concat([
+        buffer.subarray(0, attrs.starts[index] - headerLen),
+        header,
+        full,
+        buffer.subarray(attrs.ends[index])
+    ]);
+}
+
 function parseBgpAttributes(buffer, asnSize = 4) {
     try {
         const { pathAttributes } = parsePathAttributes(buffer, 0, buffer.length, { asnSize });
@@ -0,0 +1,528 @@
+const SnmpConst = require('../const/snmpConst');
+
+const TAG = SnmpConst.SNMP_BER_ASN1_TAG;
+const PDU = SnmpConst.SNMP_PDU_TYPE;
+
+// SNMPv2-MIB 中 Trap 相关的固定 OID
+const SYS_UPTIME_OID = '1.3.6.1.2.1.1.3.0';
+const SNMP_TRAP_OID = '1.3.6.1.6.3.1.1.4.1.0';
+// RFC 3584: v1 通用 Trap 对应 snmpTraps.(generic + 1)
+const SNMP_TRAPS_PREFIX = '1.3.6.1.6.3.1.1.5';
+
+// 变量绑定值类型名称，与 Asn1Parser 输出保持一致
+const VALUE_TYPE_NAMES = {
+    [TAG.INTEGER]: 'Integer',
+    [TAG.OCTET_STRING]: 'OctetString',
+    [TAG.NULL]: 'Null',
+    [TAG.OBJECT_IDENTIFIER]: 'ObjectIdentifier',
+    [TAG.IP_ADDRESS]: 'IpAddress',
+    [TAG.COUNTER32]: 'Counter32',
+    [TAG.GAUGE32]: 'Gauge32',
+    [TAG.TIME_TICKS]: 'TimeTicks',
+    [TAG.OPAQUE]: 'Opaque',
+    [TAG.COUNTER64]: 'Counter64'
+};
+
+/**
+ * SNMP Trap 解码器
+ *
+ * 直接在收到的 Buffer 上按偏移解析 BER，不为每个节点创建对象。解码结果是紧凑记录：
+ * OID 驻留为整数 id，OCTET STRING 只保留原报文的 subarray，变量绑定平铺为
+ * [oid, tag, value, ...]。只有需要展示的记录才通过 toTrapData 展开成界面使用的格式。
+ * 轮询引擎也用它解码 GetResponse（decodeResponse）。
+ */
+class SnmpTrapDecoder {
+    constructor(maxOids = SnmpConst.SNMP_TRAP_MAX_OIDS) {
+        this.maxOids = maxOids;
+        this.oidIds = new Map(); // OID 编码字节的哈希 -> id
+        this.oidBytes = []; // id -> OID 编码字节，用于确认哈希命中
+        this.dottedIds = new Map(); // 点分 OID -> id，报文中的 OID 与 v1 推导出的 OID 共用
+        this.oids = []; // id -> 点分字符串
+
+        this.buf = null;
+        this.pos = 0;
+        this.end = 0;
+        this.tag = 0;
+        this.version = 0;
+        this.communityStart = 0;
+        this.communityEnd = 0;
+
+        this.sysUpTimeId = this.internDotted(SYS_UPTIME_OID);
+        this.snmpTrapOidId = this.internDotted(SNMP_TRAP_OID);
+    }
+
+    /**
+     * 解析消息头，返回 PDU 类型，this.pos 指向 PDU 内容
+     */
+    begin(buffer) {
+        this.buf = buffer;
+        this.pos = 0;
+        this.end = buffer.length;
+
+        const messageLen = this.tlv(TAG.SEQUENCE);
+        this.end = this.pos + messageLen;
+        this.version = this.integer(this.tlv(TAG.INTEGER));
+        const communityLen = this.tlv(TAG.OCTET_STRING);
+        this.communityStart = this.pos;
+        this.pos += communityLen;
+        this.communityEnd = this.pos;
+
+        const pduLen = this.tlv(-1);
+        this.end = this.pos + pduLen;
+        return this.tag;
+    }
+
+    /**
+     * 解码一个 SNMP 报文
+     * @returns {Object|null} 紧凑记录，非 Trap/Inform 报文返回 null；格式错误时抛出异常
+     */
+    decode(buffer, sourceIp, sourcePort) {
+        const pduType = this.begin(buffer);
+        if (pduType !== PDU.TRAP && pduType !== PDU.SNMPV2_TRAP && pduType !== PDU.INFORM_REQUEST) {
+            return null;
+        }
+        const version = this.version;
+        const community = buffer.toString('utf8', this.communityStart, this.communityEnd);
+
+        const record = {
+            seq: 0,
+            time: Date.now(),
+            sourceIp,
+            sourcePort,
+            version,
+            community,
+            pduType,
+            requestId: 0,
+            enterprise: null,
+            agentAddr: 0,
+            genericTrap: null,
+            specificTrap: null,
+            uptime: 0,
+            trapOid: null,
+            varbinds: null
+        };
+
+        if (pduType === PDU.TRAP) {
+            record.enterprise = this.oid(this.tlv(TAG.OBJECT_IDENTIFIER));
+            record.agentAddr = this.unsigned(this.tlv(TAG.IP_ADDRESS));
+            record.genericTrap = this.integer(this.tlv(TAG.INTEGER));
+            record.specificTrap = this.integer(this.tlv(TAG.INTEGER));
+            // 部分设备把 time-stamp 编码成 INTEGER
+            record.uptime = this.unsigned(this.tlv(-1));
+            record.trapOid = this.v1TrapOid(record);
+        } else {
+            record.requestId = this.integer(this.tlv(TAG.INTEGER));
+            this.skip(TAG.INTEGER); // error-status
+            this.skip(TAG.INTEGER); // error-index
+        }
+
+        record.varbinds = this.varbinds(record);
+        return record;
+    }
+
+    /**
+     * 解码轮询请求的响应（GetResponse/Report）
+     *
+     * 轮询遍历的实例 OID 数量很大，不进入驻留表：变量绑定中的 OID 保留为原报文的
+     * subarray（BER 内容字节），可直接用作下一个请求的起点。
+     * @returns {Object|null} { pduType, requestId, errorStatus, errorIndex, varbinds }，其他 PDU 返回 null
+     */
+    decodeResponse(buffer) {
+        const pduType = this.begin(buffer);
+        if (pduType !== PDU.GET_RESPONSE && pduType !== PDU.REPORT) {
+            return null;
+        }
+
+        const requestId = this.integer(this.tlv(TAG.INTEGER));
+        const errorStatus = this.integer(this.tlv(TAG.INTEGER));
+        const errorIndex = this.integer(this.tlv(TAG.INTEGER));
+        return { pduType, requestId, errorStatus, errorIndex, varbinds: this.varbinds(null) };
+    }
+
+    /**
+     * 解析变量绑定列表，顺带取出 v2 Trap 的 sysUpTime.0 和 snmpTrapOID.0
+     * @param {Object|null} record Trap 记录；为 null 时按轮询响应处理，OID 不驻留
+     */
+    varbinds(record) {
+        const list = [];
+        const listLen = this.tlv(TAG.SEQUENCE);
+        const listEnd = this.pos + listLen;
+
+        while (this.pos < listEnd) {
+            const varbindLen = this.tlv(TAG.SEQUENCE);
+            const next = this.pos + varbindLen;
+            const oidLen = this.tlv(TAG.OBJECT_IDENTIFIER);
+            const oid = record ? this.oid(oidLen) : this.rawOid(oidLen);
+            const len = this.tlv(-1);
+            const tag = this.tag;
+            let value;
+
+            switch (tag) {
+                case TAG.INTEGER:
+                    value = this.integer(len);
+                    break;
+                case TAG.COUNTER32:
+                case TAG.GAUGE32:
+                case TAG.TIME_TICKS:
+                case TAG.IP_ADDRESS:
+                    value = this.unsigned(len);
+                    break;
+                case TAG.COUNTER64:
+                    value = this.unsigned64(len);
+                    break;
+                case TAG.OBJECT_IDENTIFIER:
+                    value = record ? this.oid(len) : this.rawOid(len);
+                    break;
+                case TAG.OCTET_STRING:
+                case TAG.OPAQUE:
+                    // 不拷贝，展开时再转换
+                    value = this.buf.subarray(this.pos, this.pos + len);
+                    break;
+                default:
+                    // NULL 以及 noSuchObject/noSuchInstance/endOfMibView
+                    value = null;
+                    break;
+            }
+            this.pos = next;
+
+            if (!record) {
+                list.push(oid, tag, value);
+                continue;
+            }
+            if (oid === this.sysUpTimeId && tag === TAG.TIME_TICKS) {
+                record.uptime = value;
+            } else if (oid === this.snmpTrapOidId && tag === TAG.OBJECT_IDENTIFIER) {
+                record.trapOid = value;
+            }
+            list.push(oid, tag, value);
+        }
+
+        return list;
+    }
+
+    /**
+     * 读取一个 TLV 头，返回内容长度，this.pos 指向内容起始
+     * @param {number} expect 期望的标记，-1 表示不检查，实际标记保存在 this.tag
+     */
+    tlv(expect) {
+        const buf = this.buf;
+        let p = this.pos;
+        if (p + 2 > this.end) {
+            throw new Error('报文截断');
+        }
+
+        this.tag = buf[p++];
+        if (expect >= 0 && this.tag !== expect) {
+            throw new Error(`期望标记0x${expect.toString(16)}，但得到0x${this.tag.toString(16)}`);
+        }
+
+        let len = buf[p++];
+        if (len & 0x80) {
+            let n = len & 0x7f;
+            if (n === 0 || n > 3) {
+                throw new Error('不支持的长度格式');
+            }
+            if (p + n > this.end) {
+                throw new Error('报文截断');
+            }
+            len = 0;
+            while (n-- > 0) {
+                len = len * 256 + buf[p++];
+            }
+        }
+
+        if (p + len > this.end) {
+            throw new Error('报文截断');
+        }
+        this.pos = p;
+        return len;
+    }
+
+    /**
+     * 跳过一个 TLV
+     */
+    skip(expect) {
+        const len = this.tlv(expect);
+        this.pos += len;
+    }
+
+    /**
+     * 有符号整数（INTEGER）
+     */
+    integer(len) {
+        if (len === 0) {
+            return 0;
+        }
+        if (len > 6) {
+            throw new Error('INTEGER长度超出范围');
+        }
+        const value = this.buf.readIntBE(this.pos, len);
+        this.pos += len;
+        return value;
+    }
+
+    /**
+     * 无符号整数（Counter32/Gauge32/TimeTicks/IpAddress），可能带一个前导 0
+     */
+    unsigned(len) {
+        if (len > 5) {
+            throw new Error('无符号整数长度超出范围');
+        }
+        const buf = this.buf;
+        let value = 0;
+        for (let i = 0; i < len; i++) {
+            value = value * 256 + buf[this.pos + i];
+        }
+        this.pos += len;
+        return value;
+    }
+
+    /**
+     * Counter64，超出安全整数范围时返回十进制字符串
+     */
+    unsigned64(len) {
+        if (len > 9) {
+            throw new Error('Counter64长度超出范围');
+        }
+        const buf = this.buf;
+        let start = this.pos;
+        this.pos += len;
+        while (start < this.pos && buf[start] === 0) {
+            start++;
+        }
+        if (this.pos - start <= 6) {
+            let value = 0;
+            for (let i = start; i < this.pos; i++) {
+                value = value * 256 + buf[i];
+            }
+            return value;
+        }
+
+        let value = 0n;
+        for (let i = start; i < this.pos; i++) {
+            value = (value << 8n) | BigInt(buf[i]);
+        }
+        return value.toString();
+    }
+
+    /**
+     * OBJECT IDENTIFIER，返回驻留 id；驻留表已满时返回点分字符串
+     *
+     * 按编码字节的哈希查表（冲突时线性探测），命中时只比较字节，不生成字符串。
+     */
+    oid(len) {
+        const buf = this.buf;
+        const start = this.pos;
+        const end = start + len;
+        this.pos = end;
+
+        let hash = len;
+        for (let i = start; i < end; i++) {
+            hash = Math.imul(hash ^ buf[i], 0x01000193);
+        }
+
+        let key = hash;
+        for (;;) {
+            const id = this.oidIds.get(key);
+            if (id === undefined) {
+                break;
+            }
+            if (this.sameOid(id, start, end)) {
+                return id;
+            }
+            key = (key + 1) | 0;
+        }
+
+        const interned = this.internDotted(SnmpTrapDecoder.oidToString(buf, start, end));
+        if (typeof interned === 'number' && !this.oidBytes[interned]) {
+            this.oidBytes[interned] = Buffer.from(buf.subarray(start, end));
+            this.oidIds.set(key, interned);
+        }
+        return interned;
+    }
+
+    /**
+     * 不驻留的 OID，返回编码字节的 subarray
+     */
+    rawOid(len) {
+        const start = this.pos;
+        this.pos += len;
+        return this.buf.subarray(start, this.pos);
+    }
+
+    sameOid(id, start, end) {
+        const bytes = this.oidBytes[id];
+        if (bytes.length !== end - start) {
+            return false;
+        }
+        const buf = this.buf;
+        for (let i = 0; i < bytes.length; i++) {
+            if (bytes[i] !== buf[start + i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * 驻留一个点分格式的 OID，驻留表已满时原样返回字符串
+     */
+    internDotted(dotted) {
+        const id = this.dottedIds.get(dotted);
+        if (id !== undefined) {
+            return id;
+        }
+        if (this.oids.length >= this.maxOids) {
+            return dotted;
+        }
+
+        this.oids.push(dotted);
+        this.dottedIds.set(dotted, this.oids.length - 1);
+        return this.oids.length - 1;
+    }
+
+    /**
+     * 按 RFC 3584 把 v1 Trap 映射为 snmpTrapOID
+     */
+    v1TrapOid(record) {
+        if (record.genericTrap >= 0 && record.genericTrap < 6) {
+            return this.internDotted(`${SNMP_TRAPS_PREFIX}.${record.genericTrap + 1}`);
+        }
+        return this.internDotted(`${this.oidString(record.enterprise)}.0.${record.specificTrap}`);
+    }
+
+    /**
+     * 驻留 id、未驻留的字符串或编码字节转点分字符串
+     */
+    oidString(oid) {
+        if (oid === null) {
+            return null;
+        }
+        if (typeof oid === 'number') {
+            return this.oids[oid];
+        }
+        return typeof oid === 'string' ? oid : SnmpTrapDecoder.oidToString(oid, 0, oid.length);
+    }
+
+    /**
+     * 把紧凑记录展开为界面使用的 Trap 数据
+     */
+    toTrapData(record) {
+        const varbinds = [];
+        const list = record.varbinds;
+        for (let i = 0; i < list.length; i += 3) {
+            varbinds.push({
+                oid: this.oidString(list[i]),
+                type: SnmpTrapDecoder.getValueTypeName(list[i + 1]),
+                value: this.valueToDisplay(list[i + 1], list[i + 2])
+            });
+        }
+
+        return {
+            id: `trap_${record.time}_${record.seq}`,
+            timestamp: new Date(record.time).toISOString(),
+            sourceIp: record.sourceIp,
+            sourcePort: record.sourcePort,
+            version: SnmpTrapDecoder.getVersionString(record.version),
+            community: record.community,
+            pduType: record.pduType,
+            requestId: record.requestId,
+            enterpriseOid: this.oidString(record.enterprise),
+            agentAddr: record.pduType === PDU.TRAP ? SnmpTrapDecoder.ipToString(record.agentAddr) : undefined,
+            trapOid: this.oidString(record.trapOid),
+            trapType: SnmpTrapDecoder.getTrapType(record.pduType),
+            specificType: record.specificTrap,
+            genericType: record.genericTrap,
+            uptime: record.uptime,
+            varbinds,
+            status: 'received'
+        };
+    }
+
+    valueToDisplay(tag, value) {
+        switch (tag) {
+            case TAG.OCTET_STRING:
+                return value.toString('utf8');
+            case TAG.OPAQUE:
+                return value.toString('hex');
+            case TAG.OBJECT_IDENTIFIER:
+                return this.oidString(value);
+            case TAG.IP_ADDRESS:
+                return SnmpTrapDecoder.ipToString(value);
+            default:
+                return value;
+        }
+    }
+
+    /**
+     * 清空驻留表（保留内置 OID）
+     */
+    reset() {
+        this.oidIds.clear();
+        this.oidBytes = [];
+        this.dottedIds.clear();
+        this.oids = [];
+        this.sysUpTimeId = this.internDotted(SYS_UPTIME_OID);
+        this.snmpTrapOidId = this.internDotted(SNMP_TRAP_OID);
+    }
+
+    static oidToString(buf, start, end) {
+        let dotted = '';
+        let value = 0;
+        let first = true;
+
+        for (let i = start; i < end; i++) {
+            value = value * 128 + (buf[i] & 0x7f);
+            if (buf[i] & 0x80) {
+                continue;
+            }
+            if (first) {
+                // 首个子标识符编码了前两个节点，第一个节点为 2 时第二个节点不受 40 限制
+                const top = value < 80 ? Math.floor(value / 40) : 2;
+                dotted = `${top}.${value - top * 40}`;
+                first = false;
+            } else {
+                dotted += `.${value}`;
+            }
+            value = 0;
+        }
+
+        return dotted;
+    }
+
+    static getValueTypeName(tag) {
+        return VALUE_TYPE_NAMES[tag] || `Unknown(0x${tag.toString(16)})`;
+    }
+
+    static ipToString(value) {
+        return `${(value >>> 24) & 0xff}.${(value >>> 16) & 0xff}.${(value >>> 8) & 0xff}.${value & 0xff}`;
+    }
+
+    static getVersionString(version) {
+        switch (version) {
+            case 0:
+                return 'v1';
+            case 1:
+                return 'v2c';
+            case 3:
+                return 'v3';
+            default:
+                return `unknown(${version})`;
+        }
+    }
+
+    static getTrapType(pduType) {
+        switch (pduType) {
+            case PDU.TRAP:
+                return 'SNMPv1 Trap';
+            case PDU.SNMPV2_TRAP:
+                return 'SNMPv2 Trap';
+            case PDU.INFORM_REQUEST:
+                return 'Inform Request';
+            default:
+                return 'Unknown';
+        }
+    }
+}
+
+module.exports = SnmpTrapDecoder;
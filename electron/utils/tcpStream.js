@@ -0,0 +1,112 @@
+/**
+ * TCP 单向字节流重组
+ *
+ * 按序列号把报文段拼成连续的字节流，重传和重叠的部分只交付一次，乱序到达的报文段先缓存，
+ * 前面的空洞补上后再按序交付。缓存的乱序报文段超过 maxPending 个时认为空洞的数据已经丢失
+ * (抓包丢包)，通过 onGap 通知上层后从缓存中序列号最小的报文段继续。
+ *
+ * 序列号按 32 位回绕比较。push 返回后调用方可以复用 data 的内存。
+ */
+
+// a - b 的 32 位有符号差值
+function seqDiff(a, b) {
+    return (a - b) | 0;
+}
+
+class TcpStream {
+    /**
+     * @param {Function} onData (data, tag, seq) 按序交付的数据，tag 为数据所在报文段的标记，seq 为首字节的序列号
+     * @param {Function} onGap 数据丢失时的回调
+     * @param {number} maxPending 最多缓存的乱序报文段个数
+     */
+    constructor(onData, onGap = null, maxPending = 64) {
+        this.onData = onData;
+        this.onGap = onGap;
+        this.maxPending = maxPending;
+        this.nextSeq = null; // 下一个期望的序列号，null 表示还没见到数据
+        this.pending = new Map(); // seq -> { data, tag }
+    }
+
+    /**
+     * 见到 SYN 时以 ISN + 1 作为流的起点
+     */
+    syn(seq) {
+        if (this.nextSeq === null) {
+            this.nextSeq = (seq + 1) >>> 0;
+        }
+    }
+
+    push(seq, data, tag) {
+        if (data.length === 0) {
+            return;
+        }
+        if (this.nextSeq === null) {
+            // 抓包从连接中途开始，以第一个报文段作为起点
+            this.nextSeq = seq;
+        }
+
+        const delta = seqDiff(seq, this.nextSeq);
+        if (delta > 0) {
+            const cached = this.pending.get(seq);
+            if (!cached || cached.data.length < data.length) {
+                // 调用方可能复用 data，缓存时拷贝一份
+                this.pending.set(seq, { data: Buffer.from(data), tag });
+            }
+            if (this.pending.size > this.maxPending) {
+                this.skipGap();
+            }
+            return;
+        }
+        if (-delta >= data.length) {
+            // 完全重传
+            return;
+        }
+
+        this.deliver(delta === 0 ? data : data.subarray(-delta), tag);
+        this.drain();
+    }
+
+    deliver(data, tag) {
+        const seq = this.nextSeq;
+        this.nextSeq = (seq + data.length) >>> 0;
+        this.onData(data, tag, seq);
+    }
+
+    // 交付缓存中已经接上的报文段
+    drain() {
+        while (this.pending.size > 0) {
+            let progressed = false;
+            for (const [seq, segment] of this.pending) {
+                const delta = seqDiff(seq, this.nextSeq);
+                if (delta > 0) {
+                    continue;
+                }
+                this.pending.delete(seq);
+                if (-delta < segment.data.length) {
+                    this.deliver(segment.data.subarray(-delta), segment.tag);
+                }
+                progressed = true;
+            }
+            if (!progressed) {
+                return;
+            }
+        }
+    }
+
+    // 放弃空洞，从缓存中最早的报文段继续
+    skipGap() {
+        let first = null;
+        for (const seq of this.pending.keys()) {
+            if (first === null || seqDiff(seq, first) < 0) {
+                first = seq;
+            }
+        }
+        this.nextSeq = first;
+        if (this.onGap) {
+            this.onGap();
+        }
+        this.drain();
+    }
+}
+
+module.exports = { TcpStream, seqDiff };
@@ -0,0 +1,149 @@
+/**
+ * 分层定时轮
+ *
+ * 大量定时器(在途请求的超时、会话的保持/存活定时器等)挂在同一个轮上，由一个 setInterval 推进，
+ * 不再为每个定时器创建 Node 定时器。每层 64 个槽，第 0 层的槽宽为一个 tick，
+ * 上一层的槽宽是下一层整圈的长度；第 0 层转完一圈时，把上一层当前槽里的定时器
+ * 重新分配到下层。插入和取消都是 O(1)。
+ *
+ * 定时器对象由 createTimer 创建后反复使用，schedule 会先取消之前的调度。
+ */
+
+const SLOT_BITS = 6;
+const SLOTS = 1 << SLOT_BITS;
+const SLOT_MASK = SLOTS - 1;
+
+class TimerWheel {
+    /**
+     * @param {number} tickMs tick 长度(毫秒)，即定时精度
+     * @param {number} levels 层数，能直接容纳的最长时间为 tickMs * 64^levels，更长的会在顶层多转几圈
+     */
+    constructor(tickMs = 100, levels = 4) {
+        this.tickMs = tickMs;
+        this.levels = levels;
+        this.wheels = [];
+        for (let level = 0; level < levels; level++) {
+            const slots = new Array(SLOTS);
+            for (let i = 0; i < SLOTS; i++) {
+                slots[i] = new Set();
+            }
+            this.wheels.push(slots);
+        }
+        this.tick = 0; // 已处理到的 tick
+        this.origin = Date.now();
+        this.interval = null;
+        this.size = 0;
+    }
+
+    start() {
+        if (this.interval) {
+            return;
+        }
+        this.origin = Date.now() - this.tick * this.tickMs;
+        this.interval = setInterval(() => this.advance(), this.tickMs);
+    }
+
+    stop() {
+        if (this.interval) {
+            clearInterval(this.interval);
+            this.interval = null;
+        }
+    }
+
+    /**
+     * @param {Function} callback 到期回调
+     * @returns {{ callback: Function, expires: number, bucket: Set|null }}
+     */
+    createTimer(callback) {
+        return { callback, expires: 0, bucket: null };
+    }
+
+    /**
+     * 在 delayMs 后触发 timer，已在轮上的先取消
+     */
+    schedule(timer, delayMs) {
+        this.cancel(timer);
+        timer.expires = this.tick + Math.max(1, Math.ceil(delayMs / this.tickMs));
+        this.insert(timer);
+        this.size++;
+    }
+
+    cancel(timer) {
+        if (timer.bucket) {
+            timer.bucket.delete(timer);
+            timer.bucket = null;
+            this.size--;
+        }
+    }
+
+    isScheduled(timer) {
+        return timer.bucket !== null;
+    }
+
+    insert(timer) {
+        const delta = timer.expires - this.tick;
+        let level = 0;
+        while (level < this.levels - 1 && delta >= 1 << (SLOT_BITS * (level + 1))) {
+            level++;
+        }
+        // 超出顶层范围的放在顶层最远的槽，转到时再重新分配
+        const expires = Math.min(timer.expires, this.tick + (1 << (SLOT_BITS * this.levels)) - 1);
+        const bucket = this.wheels[level][Math.floor(expires / (1 << (SLOT_BITS * level))) & SLOT_MASK];
+        bucket.add(timer);
+        timer.bucket = bucket;
+    }
+
+    /**
+     * 把 level 层当前槽里的定时器重新分配到下层
+     */
+    cascade(level) {
+        const index = Math.floor(this.tick / (1 << (SLOT_BITS * level))) & SLOT_MASK;
+        const bucket = this.wheels[level][index];
+        if (bucket.size === 0) {
+            return index;
+        }
+        const timers = Array.from(bucket);
+        bucket.clear();
+        for (const timer of timers) {
+            this.insert(timer);
+        }
+        return index;
+    }
+
+    /**
+     * 推进到当前时间，依次触发到期的定时器
+     */
+    advance() {
+        const target = Math.floor((Date.now() - this.origin) / this.tickMs);
+        while (this.tick < target) {
+            this.tick++;
+            if ((this.tick & SLOT_MASK) === 0) {
+                for (let level = 1; level < this.levels && this.cascade(level) === 0; level++);
+            }
+
+            const bucket = this.wheels[0][this.tick & SLOT_MASK];
+            if (bucket.size === 0) {
+                continue;
+            }
+            const timers = Array.from(bucket);
+            bucket.clear();
+            for (const timer of timers) {
+                timer.bucket = null;
+                this.size--;
+                if (timer.expires > this.tick) {
+                    // 顶层多转一圈的定时器还没到期
+                    this.insert(timer);
+                    this.size++;
+                    continue;
+                }
+                try {
+                    timer.callback();
+                } catch (_) {
+                    // 单个回调出错不影响其他定时器
+                }
+            }
+        }
+    }
+}
+
+module.exports = TimerWheel;
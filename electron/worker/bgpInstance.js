@@ -8,6 +8,9 @@ class BgpInstance {
 
         this.peerMap = new Map();
         this.routeMap = new Map();
+        // 路由表版本，路由发布或撤销时递增，用于判断路由快照是否需要重建
+        this.routeVersion = 0;
+        this.routeSnapshot = null;
         // 自定义属性,
         this.customAttr = '';
         // 扩展团体属性
@@ -46,12 +49,14 @@ class BgpInstance {
     }
 
     sendRoute() {
+        this.routeVersion++;
         this.peerMap.forEach((peer, _) => {
             peer.sendRoute();
         });
     }
 
     withdrawRoute(withdrawnRoutes) {
+        this.routeVersion++;
         this.peerMap.forEach((peer, _) => {
             peer.withdrawRoute(withdrawnRoutes);
         });
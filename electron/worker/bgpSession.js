@@ -2,10 +2,33 @@ const BgpConst = require('../const/bgpConst');
 const { writeUInt16, writeUInt32, ipToBytes } = require('../utils/ipUtils');
 const { getAddrFamilyType, getAfiAndSafi } = require('../utils/bgpUtils');
 const { parseBgpPacket, getBgpPacketSummary } = require('../utils/bgpPacketParser');
+const { decodeUpdate } = require('../utils/bgpUpdateDecoder');
 const logger = require('../log/logger');
 const CommonUtils = require('../utils/commonUtils');
 const BgpInstance = require('./bgpInstance');
 
+// 所有会话共用的 KEEPALIVE 报文，内容固定
+let KEEPALIVE_MSG = null;
+
+/**
+ * UPDATE 报文的简要信息，只统计路由条数，不逐条展开
+ */
+function getUpdateSummary(buffer) {
+    const update = decodeUpdate(buffer, null);
+    if (!update.valid) {
+        return update.error;
+    }
+    const { mpReach, mpUnreach } = update.attributes;
+    let summary = `(${buffer.length} bytes) withdrawn: ${update.withdrawn.count}, nlri: ${update.nlri.count}`;
+    if (mpReach) {
+        summary += `, mp_reach(${mpReach.afi}/${mpReach.safi}): ${mpReach.nlri.count}`;
+    }
+    if (mpUnreach) {
+        summary += `, mp_unreach(${mpUnreach.afi}/${mpUnreach.safi}): ${mpUnreach.withdrawnRoutes.count}`;
+    }
+    return summary;
+}
+
 class BgpSession {
     constructor(vrfIndex, peerIp, instanceMap, messageHandler) {
         this.socket = null;
@@ -33,6 +56,93 @@ class BgpSession {
         this.peerType = BgpConst.BGP_PEER_TYPE.PEER_TYPE_INVALID;
 
         this.sessState = BgpConst.BGP_PEER_STATE.IDLE;
+
+        // 保持/存活定时器挂在 worker 共用的定时轮上，见 setTimerWheel
+        this.timerWheel = null;
+        this.holdTimer = null;
+        this.keepAliveTimer = null;
+        this.negotiatedHoldTime = 0; // 当前生效的保持时间(秒)，0 表示不启用定时器
+        this.lastRecvTime = 0; // 最近一次收到报文的时间，保持定时器到期时据此判断是否真正超时
+    }
+
+    setTimerWheel(timerWheel) {
+        this.timerWheel = timerWheel;
+        this.holdTimer = timerWheel.createTimer(() => this.onHoldTimer());
+        this.keepAliveTimer = timerWheel.createTimer(() => this.onKeepAliveTimer());
+    }
+
+    /**
+     * 启动定时器，holdTime 为 0 时按 RFC 4271 不发送 KEEPALIVE 也不检测超时
+     */
+    startTimers(holdTime, keepAlive) {
+        this.stopTimers();
+        this.negotiatedHoldTime = holdTime;
+        if (!this.timerWheel || holdTime === 0) {
+            return;
+        }
+        this.timerWheel.schedule(this.holdTimer, holdTime * 1000);
+        if (keepAlive) {
+            this.timerWheel.schedule(this.keepAliveTimer, this.getKeepAliveInterval());
+        }
+    }
+
+    stopTimers() {
+        this.negotiatedHoldTime = 0;
+        if (this.timerWheel) {
+            this.timerWheel.cancel(this.holdTimer);
+            this.timerWheel.cancel(this.keepAliveTimer);
+        }
+    }
+
+    getKeepAliveInterval() {
+        return Math.max(1, Math.floor(this.negotiatedHoldTime / 3)) * 1000;
+    }
+
+    onHoldTimer() {
+        if (this.negotiatedHoldTime === 0) {
+            return;
+        }
+        // 收到报文时只记录时间，到期时再看是否真的超时，避免每个报文都重排定时器
+        const remaining = this.negotiatedHoldTime * 1000 - (Date.now() - this.lastRecvTime);
+        if (remaining > 0) {
+            this.timerWheel.schedule(this.holdTimer, remaining);
+            return;
+        }
+
+        logger.warn(`${this.peerIp} hold timer expired`);
+        if (this.socket) {
+            this.sendNotification(BgpConst.BGP_ERROR_CODE.HOLD_TIMER_EXPIRED, 0);
+        }
+        this.dropSession();
+    }
+
+    onKeepAliveTimer() {
+        if (!this.socket || this.negotiatedHoldTime === 0) {
+            return;
+        }
+        this.sendKeepAliveMsg();
+        this.timerWheel.schedule(this.keepAliveTimer, this.getKeepAliveInterval());
+    }
+
+    // 断开连接，peer 回到 IDLE
+    dropSession() {
+        this.stopTimers();
+        this.resetPeer();
+        this.sessState = BgpConst.BGP_PEER_STATE.IDLE;
+        this.packetBuffer = Buffer.alloc(0);
+        if (this.socket) {
+            this.socket.destroy();
+            this.socket = null;
+        }
+    }
+
+    // 对端关闭了连接
+    tcpClosed(socket) {
+        if (this.socket !== socket) {
+            return;
+        }
+        this.socket = null;
+        this.dropSession();
     }
 
     // 更新session状态
@@ -64,6 +174,10 @@ class BgpSession {
         // 连接建立成功之后就发送open报文
         this.sendOpenMsg();
         this.changeSessionFsmState(BgpConst.BGP_PEER_STATE.OPEN_SENT);
+
+        // 等待对端 OPEN 期间使用较长的保持时间
+        this.lastRecvTime = Date.now();
+        this.startTimers(BgpConst.BGP_OPEN_SENT_HOLD_TIME, false);
     }
 
     clearSession() {
@@ -77,6 +191,7 @@ class BgpSession {
     }
 
     resetSession() {
+        this.stopTimers();
         if (this.socket) {
             this.changeSessionFsmState(BgpConst.BGP_PEER_STATE.IDLE);
             this.sendNotification(
@@ -123,8 +238,9 @@ class BgpSession {
     }
 
     handleBgpPacket(buffer) {
-        // 将新接收的数据追加到缓冲区
-        this.packetBuffer = Buffer.concat([this.packetBuffer, buffer]);
+        this.lastRecvTime = Date.now();
+        // 将新接收的数据追加到缓冲区，没有残留数据时直接使用收到的数据
+        this.packetBuffer = this.packetBuffer.length === 0 ? buffer : Buffer.concat([this.packetBuffer, buffer]);
 
         // 循环处理缓冲区中的完整报文
         while (this.packetBuffer.length >= BgpConst.BGP_HEAD_LEN) {
@@ -137,9 +253,9 @@ class BgpSession {
 
             // 提取完整的报文
             const packet = this.packetBuffer.subarray(0, header.length);
-            const parsedPacket = parseBgpPacket(packet);
 
             if (header.type === BgpConst.BGP_PACKET_TYPE.OPEN) {
+                const parsedPacket = parseBgpPacket(packet);
                 logger.info(`${this.peerIp} recv open message ${JSON.stringify(parsedPacket)}`);
                 logger.info(`${this.peerIp} recv open message ${getBgpPacketSummary(parsedPacket)}`);
 
@@ -285,17 +401,24 @@ class BgpSession {
                 this.sendKeepAliveMsg();
                 this.changeSessionFsmState(BgpConst.BGP_PEER_STATE.OPEN_CONFIRM);
 
+                // 保持时间取双方较小值，KEEPALIVE 间隔为其三分之一
+                const localHoldTime = parseInt(this.holdTime);
+                const holdTime = Math.min(
+                    isNaN(localHoldTime) ? BgpConst.BGP_DEFAULT_HOLD_TIME : localHoldTime,
+                    parsedPacket.holdTime
+                );
+                this.startTimers(holdTime, true);
+
                 if (parseInt(this.localAs) === parseInt(parsedPacket.asn)) {
                     this.peerType = BgpConst.BGP_PEER_TYPE.PEER_TYPE_IBGP;
                 } else if (parseInt(this.localAs) !== parseInt(parsedPacket.asn)) {
                     this.peerType = BgpConst.BGP_PEER_TYPE.PEER_TYPE_EBGP;
                 }
             } else if (header.type === BgpConst.BGP_PACKET_TYPE.KEEPALIVE) {
+                // 已建立的会话收到 KEEPALIVE 只需刷新接收时间，由存活定时器周期发送 KEEPALIVE
                 if (this.sessState !== BgpConst.BGP_PEER_STATE.ESTABLISHED) {
-                    logger.info(`${this.peerIp} recv keepalive message ${getBgpPacketSummary(parsedPacket)}`);
-                }
-                this.sendKeepAliveMsg();
-                if (this.sessState !== BgpConst.BGP_PEER_STATE.ESTABLISHED) {
+                    logger.info(`${this.peerIp} recv keepalive message ${getBgpPacketSummary(parseBgpPacket(packet))}`);
+                    this.sendKeepAliveMsg();
                     this.changeSessionFsmState(BgpConst.BGP_PEER_STATE.ESTABLISHED);
 
                     const sessionKey = BgpSession.makeKey(0, this.peerIp);
@@ -309,20 +432,19 @@ class BgpSession {
                     });
                 }
             } else if (header.type === BgpConst.BGP_PACKET_TYPE.NOTIFICATION) {
+                const parsedPacket = parseBgpPacket(packet);
                 logger.info(`${this.peerIp} recv notification message ${getBgpPacketSummary(parsedPacket)}`);
-                this.resetPeer();
-                if (this.socket) {
-                    this.socket.destroy();
-                    this.socket = null;
-                }
+                this.dropSession();
+                break;
             } else if (header.type === BgpConst.BGP_PACKET_TYPE.ROUTE_REFRESH) {
+                const parsedPacket = parseBgpPacket(packet);
                 logger.info(`${this.peerIp} recv route-refresh message ${getBgpPacketSummary(parsedPacket)}`);
                 const instance = this.instanceMap.get(BgpInstance.makeKey(0, parsedPacket.afi, parsedPacket.safi));
                 if (instance) {
                     instance.sendRoute();
                 }
             } else if (header.type === BgpConst.BGP_PACKET_TYPE.UPDATE) {
-                logger.info(`${this.peerIp} recv update message ${getBgpPacketSummary(parsedPacket)}`);
+                logger.info(`${this.peerIp} recv update message ${getUpdateSummary(packet)}`);
             }
 
             // 从缓冲区中移除已处理的报文
@@ -577,6 +699,10 @@ class BgpSession {
     }
 
     buildKeepAliveMsg() {
+        if (KEEPALIVE_MSG) {
+            return KEEPALIVE_MSG;
+        }
+
         const buffer = Buffer.alloc(BgpConst.BGP_HEAD_LEN);
 
         // 填充 Marker（16 字节 0xff）
@@ -586,6 +712,7 @@ class BgpSession {
         // Type (1 byte)
         buffer.writeUInt8(BgpConst.BGP_PACKET_TYPE.KEEPALIVE, BgpConst.BGP_MARKER_LEN + 2);
 
+        KEEPALIVE_MSG = buffer;
         return buffer;
     }
 
@@ -607,14 +734,12 @@ class BgpSession {
 
     sendRoute(buffer) {
         this.socket.write(buffer);
-        const parsedPacket = parseBgpPacket(buffer);
-        logger.info(`${this.peerIp} send route msg ${getBgpPacketSummary(parsedPacket)}`);
+        logger.info(`${this.peerIp} send route msg ${getUpdateSummary(buffer)}`);
     }
 
     withdrawRoute(buffer) {
         this.socket.write(buffer);
-        const parsedPacket = parseBgpPacket(buffer);
-        logger.info(`${this.peerIp} withdraw route msg ${getBgpPacketSummary(parsedPacket)}`);
+        logger.info(`${this.peerIp} withdraw route msg ${getUpdateSummary(buffer)}`);
     }
 }
 
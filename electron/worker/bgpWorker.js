@@ -9,6 +9,29 @@ const BgpSession = require('./bgpSession');
 const BgpInstance = require('./bgpInstance');
 const CommonUtils = require('../utils/commonUtils');
 const BgpRoute = require('./bgpRoute');
+const { encodeSnapshot } = require('../utils/columnarSnapshot');
+const TimerWheel = require('../utils/timerWheel');
+
+// 路由快照的列，与 BgpRoute.getRouteInfo() 的字段一致
+const BGP_ROUTE_SNAPSHOT_COLUMNS = [
+    { name: 'ip', type: 'str', get: route => route.ip },
+    { name: 'mask', type: 'dict', get: route => route.mask },
+    { name: 'asPath', type: 'dict', get: route => route.asPath },
+    { name: 'med', type: 'dict', get: route => route.med },
+    { name: 'localPref', type: 'dict', get: route => route.localPref },
+    { name: 'communities', type: 'dict', get: route => route.communities },
+    { name: 'nextHop', type: 'dict', get: route => route.nextHop },
+    { name: 'origin', type: 'dict', get: route => route.origin },
+    { name: 'customAttr', type: 'dict', get: route => route.customAttr },
+    { name: 'rt', type: 'dict', get: route => route.rt },
+    { name: 'routeType', type: 'dict', get: route => route.routeType },
+    { name: 'rd', type: 'dict', get: route => route.rd },
+    { name: 'originatingRouterIp', type: 'dict', get: route => route.originatingRouterIp },
+    { name: 'sourceIp', type: 'str', get: route => route.sourceIp },
+    { name: 'groupIp', type: 'str', get: route => route.groupIp },
+    { name: 'sourceAs', type: 'dict', get: route => route.sourceAs },
+    { name: 'dqpn', type: 'dict', get: route => route.dqpn }
+];
 
 class BgpWorker {
     constructor() {
@@ -21,6 +44,8 @@ class BgpWorker {
 
         this.bgpSessionMap = new Map();
         this.bgpInstanceMap = new Map();
+        // 所有会话的保持/存活定时器共用一个定时轮
+        this.timerWheel = new TimerWheel(BgpConst.BGP_TIMER_TICK);
 
         // 创建消息处理器
         this.messageHandler = new WorkerMessageHandler();
@@ -105,6 +130,10 @@ class BgpWorker {
 
                 socket.on('close', () => {
                     logger.info(`ipv4 Client ${clientAddress}:${clientPort} close`);
+                    const bgpSession = this.bgpSessionMap.get(BgpSession.makeKey(0, clientAddress));
+                    if (bgpSession) {
+                        bgpSession.tcpClosed(socket);
+                    }
                 });
 
                 socket.on('error', err => {
@@ -143,6 +172,10 @@ class BgpWorker {
 
                 socket.on('close', () => {
                     logger.info(`ipv6 Client ${clientAddress}:${clientPort} close`);
+                    const bgpSession = this.bgpSessionMap.get(BgpSession.makeKey(0, clientAddress));
+                    if (bgpSession) {
+                        bgpSession.tcpClosed(socket);
+                    }
                 });
 
                 socket.on('error', err => {
@@ -190,6 +223,7 @@ class BgpWorker {
             this.bgpInstanceMap.set(BgpInstance.makeKey(0, afi, safi), new BgpInstance(0, afi, safi));
         });
 
+        this.timerWheel.start();
         // 启动tcp服务器
         this.startTcpServer(messageId);
     }
@@ -229,6 +263,7 @@ class BgpWorker {
             });
         } else {
             bgpSession = new BgpSession(0, ipv4PeerConfigData.peerIp, this.bgpInstanceMap, this.messageHandler);
+            bgpSession.setTimerWheel(this.timerWheel);
         }
         bgpSession.localAs = this.bgpConfigData.localAs;
         bgpSession.peerAs = ipv4PeerConfigData.peerAs;
@@ -349,6 +384,7 @@ class BgpWorker {
             });
         } else {
             bgpSession = new BgpSession(0, ipv6PeerConfigData.peerIpv6, this.bgpInstanceMap, this.messageHandler);
+            bgpSession.setTimerWheel(this.timerWheel);
         }
         bgpSession.localAs = this.bgpConfigData.localAs;
         bgpSession.peerAs = ipv6PeerConfigData.peerIpv6As;
@@ -508,6 +544,8 @@ class BgpWorker {
         // 清空routeMap
         this.bgpInstanceMap.forEach((instance, _) => {
             instance.routeMap.clear();
+            instance.routeVersion++;
+            instance.routeSnapshot = null;
         });
 
         // 关闭session socket
@@ -518,6 +556,7 @@ class BgpWorker {
 
         // 清空sessionMap
         this.bgpSessionMap.clear();
+        this.timerWheel.stop();
 
         // 清空instanceMap
         this.bgpInstanceMap.clear();
@@ -827,8 +866,14 @@ class BgpWorker {
         this.messageHandler.sendSuccessResponse(messageId, null, 'peer删除成功');
     }
 
+    /**
+     * 获取路由快照
+     *
+     * 路由表按列编码到共享内存中交给主进程，主进程按页从快照中取数据。路由表没有变化时
+     * 复用上次的快照；调用方已持有当前版本时只返回版本号。
+     */
     getRoutes(messageId, queryInfo) {
-        const { addressFamily, page, pageSize } = queryInfo;
+        const { addressFamily, version } = queryInfo;
         const { afi, safi } = getAfiAndSafi(addressFamily);
         const instance = this.bgpInstanceMap.get(BgpInstance.makeKey(0, afi, safi));
         if (!instance) {
@@ -837,16 +882,23 @@ class BgpWorker {
             return;
         }
 
-        const routes = [];
-        instance.routeMap.forEach((route, _) => {
-            const routeInfo = route.getRouteInfo();
-            routes.push(routeInfo);
-        });
+        if (version === instance.routeVersion) {
+            this.messageHandler.sendSuccessResponse(messageId, { version, snapshot: null }, '路由查询成功');
+            return;
+        }
 
-        const total = routes.length;
-        const list = routes.slice((page - 1) * pageSize, page * pageSize);
+        if (!instance.routeSnapshot || instance.routeSnapshot.version !== instance.routeVersion) {
+            const addrFamilyType = getAddrFamilyType(afi, safi);
+            instance.routeSnapshot = {
+                version: instance.routeVersion,
+                snapshot: encodeSnapshot(instance.routeMap.values(), instance.routeMap.size, [
+                    ...BGP_ROUTE_SNAPSHOT_COLUMNS,
+                    { name: 'addressFamily', type: 'dict', get: () => addrFamilyType }
+                ])
+            };
+        }
 
-        this.messageHandler.sendSuccessResponse(messageId, { list, total }, '路由查询成功');
+        this.messageHandler.sendSuccessResponse(messageId, instance.routeSnapshot, '路由查询成功');
     }
 
     generateMvpnRoutes(messageId, config) {
@@ -1,4 +1,5 @@
 const { getAddrFamilyType } = require('../utils/bgpUtils');
+const BmpRouteTable = require('./bmpRouteTable');
 
 class BmpBgpInstance {
     constructor(bmpSession) {
@@ -28,7 +29,7 @@ class BmpBgpInstance {
         this.sendAddPathMap = new Map();
         this.isAddPath = false;
 
-        this.bgpRoutes = new Map();
+        this.bgpRoutes = new BmpRouteTable();
     }
 
     isAddPathReceiveEnabled(afi, safi) {
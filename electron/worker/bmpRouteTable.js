@@ -0,0 +1,402 @@
+const ipaddr = require('ipaddr.js');
+
+// 有序索引每块的最大条目数，超过后对半拆分
+const CHUNK_MAX = 1024;
+
+/**
+ * 带有序索引的路由表
+ *
+ * 用法与 Map(routeKey -> BmpBgpRoute) 相同，另外按 前缀地址、掩码、RD、pathId 维护一份
+ * 分块的有序索引，在路由增删时增量更新。分页查询从游标(上一页最后一条的排序键)或
+ * 页号直接定位，只构造当前页的路由信息，前缀过滤只扫描该前缀覆盖的区间。
+ *
+ * 每块由两个等长数组组成: keys 为排序键，nums 为排序键开头最多 12 个十六进制字符的数值。
+ * 比较时先比数值，相等时再比字符串，绝大多数比较不需要访问字符串本身。
+ */
+class BmpRouteTable extends Map {
+    constructor() {
+        super();
+        this.chunks = []; // { nums: number[], keys: string[] }
+        this.version = 0; // 每次增删递增，用于判断过滤计数缓存是否失效
+        this.countCache = null;
+    }
+
+    /**
+     * 排序键: 定长十六进制地址 + 两位十六进制掩码 + '|' + routeKey
+     *
+     * 同一地址族内地址长度一致，直接按字符串比较即可得到 地址、掩码 的顺序，
+     * 同一前缀的不同 RD、pathId 再按 routeKey 排列。
+     */
+    static makeSortKey(routeKey) {
+        // routeKey 为 pathId|rd|ip|mask，RD 中不含 '|'
+        const maskAt = routeKey.lastIndexOf('|');
+        const ipAt = routeKey.lastIndexOf('|', maskAt - 1);
+        const ip = routeKey.slice(ipAt + 1, maskAt);
+        const mask = parseInt(routeKey.slice(maskAt + 1), 10);
+        return ipToHex(ip) + toHex2(mask) + '|' + routeKey;
+    }
+
+    /**
+     * 排序键开头最多 12 个十六进制字符(IPv4 为地址加掩码，IPv6 为地址前 48 位)对应的数值
+     */
+    static sortNum(sortKey) {
+        const end = Math.min(12, sortKey.length);
+        let num = 0;
+        for (let i = 0; i < end; i++) {
+            const c = sortKey.charCodeAt(i);
+            if (c === 0x7c) {
+                break;
+            }
+            num = num * 16 + (c <= 0x39 ? c - 0x30 : c - 0x57);
+        }
+        return num;
+    }
+
+    static routeKeyOf(sortKey) {
+        return sortKey.slice(sortKey.indexOf('|') + 1);
+    }
+
+    set(routeKey, route) {
+        if (!super.has(routeKey)) {
+            this.insertSortKey(BmpRouteTable.makeSortKey(routeKey));
+            this.version++;
+        }
+        return super.set(routeKey, route);
+    }
+
+    delete(routeKey) {
+        if (!super.has(routeKey)) {
+            return false;
+        }
+        this.removeSortKey(BmpRouteTable.makeSortKey(routeKey));
+        this.version++;
+        return super.delete(routeKey);
+    }
+
+    clear() {
+        this.chunks = [];
+        this.version++;
+        this.countCache = null;
+        super.clear();
+    }
+
+    /**
+     * 当前内容的快照: 按排序键顺序排列的排序键数组和对应路由的 UPDATE 解码结果数组
+     *
+     * 路由对象会被之后的 UPDATE 原地修改，而每个 UPDATE 的解码结果生成后不再变化，
+     * 因此只需保存这两类引用，之后路由表的增删改都不会影响快照内容。
+     */
+    snapshot() {
+        const keys = new Array(this.size);
+        const updates = new Array(this.size);
+        let n = 0;
+        for (const chunk of this.chunks) {
+            for (const key of chunk.keys) {
+                keys[n] = key;
+                updates[n] = this.get(BmpRouteTable.routeKeyOf(key)).bgpPacket;
+                n++;
+            }
+        }
+        return { keys, updates };
+    }
+
+    /**
+     * 第一个 >= key 的位置；strict 为 true 时为第一个 > key 的位置
+     * @returns {{ ci: number, i: number }} 块下标和块内下标，ci 等于块数表示末尾
+     */
+    seek(key, strict = false) {
+        const num = BmpRouteTable.sortNum(key);
+        // 位置 j 处的键是否排在目标之前
+        const before = (nums, keys, j) =>
+            nums[j] < num || (nums[j] === num && (keys[j] < key || (strict && keys[j] === key)));
+
+        const chunks = this.chunks;
+        let lo = 0;
+        let hi = chunks.length;
+        while (lo < hi) {
+            const mid = (lo + hi) >> 1;
+            const { nums, keys } = chunks[mid];
+            if (before(nums, keys, nums.length - 1)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo === chunks.length) {
+            return { ci: lo, i: 0 };
+        }
+
+        const { nums, keys } = chunks[lo];
+        let l = 0;
+        let h = nums.length;
+        while (l < h) {
+            const mid = (l + h) >> 1;
+            if (before(nums, keys, mid)) {
+                l = mid + 1;
+            } else {
+                h = mid;
+            }
+        }
+        return { ci: lo, i: l };
+    }
+
+    /**
+     * 第 rank 条(从 0 开始)的位置，只需累加块大小
+     */
+    seekRank(rank) {
+        const chunks = this.chunks;
+        let ci = 0;
+        while (ci < chunks.length && rank >= chunks[ci].keys.length) {
+            rank -= chunks[ci].keys.length;
+            ci++;
+        }
+        return { ci, i: rank };
+    }
+
+    insertSortKey(key) {
+        const num = BmpRouteTable.sortNum(key);
+        if (this.chunks.length === 0) {
+            this.chunks.push({ nums: [num], keys: [key] });
+            return;
+        }
+
+        let { ci, i } = this.seek(key);
+        // 比所有键都大时追加到最后一块
+        if (ci === this.chunks.length) {
+            ci--;
+            i = this.chunks[ci].keys.length;
+        }
+        const chunk = this.chunks[ci];
+        chunk.nums.splice(i, 0, num);
+        chunk.keys.splice(i, 0, key);
+        if (chunk.keys.length > CHUNK_MAX) {
+            const half = CHUNK_MAX >> 1;
+            this.chunks.splice(ci + 1, 0, { nums: chunk.nums.splice(half), keys: chunk.keys.splice(half) });
+        }
+    }
+
+    removeSortKey(key) {
+        const { ci, i } = this.seek(key);
+        const chunk = this.chunks[ci];
+        if (!chunk || chunk.keys[i] !== key) {
+            return;
+        }
+        chunk.nums.splice(i, 1);
+        chunk.keys.splice(i, 1);
+        if (chunk.keys.length === 0) {
+            this.chunks.splice(ci, 1);
+        }
+    }
+
+    /**
+     * 分页查询
+     * @param {Object} options
+     * @param {string} [options.cursor] 上一页返回的游标，优先于 page 使用
+     * @param {number} [options.page] 页号，从 1 开始
+     * @param {number} options.pageSize 每页条数
+     * @param {Object} [options.filter] { prefix, asPath, community, nextHop }
+     * @returns {{ list: Object[], total: number, cursor: string|null, hasMore: boolean }}
+     */
+    query({ cursor = null, page = 1, pageSize = 10, filter = null }) {
+        const match = compileFilter(filter);
+        const list = [];
+
+        let pos;
+        if (cursor) {
+            pos = this.seek(cursor, true);
+        } else if (!match) {
+            pos = this.seekRank((page - 1) * pageSize);
+        } else {
+            pos = this.rangeStart(match);
+        }
+        // 有过滤条件且按页号查询时，需要先跳过前面页的匹配项
+        let skip = !cursor && match ? (page - 1) * pageSize : 0;
+
+        let lastKey = null;
+        let hasMore = false;
+        this.scan(pos, match, key => {
+            if (skip > 0) {
+                skip--;
+                return true;
+            }
+            if (list.length === pageSize) {
+                hasMore = true;
+                return false;
+            }
+            list.push(this.get(BmpRouteTable.routeKeyOf(key)).getRouteInfo());
+            lastKey = key;
+            return true;
+        });
+
+        return {
+            list,
+            total: match ? this.countMatches(match) : this.size,
+            cursor: hasMore ? lastKey : null,
+            hasMore
+        };
+    }
+
+    rangeStart(match) {
+        return match.prefix ? this.seek(match.prefix.lo) : { ci: 0, i: 0 };
+    }
+
+    /**
+     * 从 pos 开始按顺序遍历满足过滤条件的排序键，visit 返回 false 时停止
+     */
+    scan(pos, match, visit) {
+        const chunks = this.chunks;
+        let { ci, i } = pos;
+        for (; ci < chunks.length; ci++, i = 0) {
+            const keys = chunks[ci].keys;
+            for (; i < keys.length; i++) {
+                const key = keys[i];
+                if (match) {
+                    if (match.prefix) {
+                        const { hi, hexLength, length } = match.prefix;
+                        // 地址超出前缀范围后不会再有匹配项
+                        if (key.length < hexLength || key.slice(0, hexLength) > hi) {
+                            return;
+                        }
+                        if (parseInt(key.substr(hexLength, 2), 16) < length) {
+                            continue;
+                        }
+                    }
+                    if (!matchRoute(match, this.get(BmpRouteTable.routeKeyOf(key)))) {
+                        continue;
+                    }
+                }
+                if (!visit(key)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    /**
+     * 满足过滤条件的路由总数，路由表没有变化时复用上次的计数
+     */
+    countMatches(match) {
+        const cache = this.countCache;
+        if (cache && cache.signature === match.signature && cache.version === this.version) {
+            return cache.count;
+        }
+        let count = 0;
+        this.scan(this.rangeStart(match), match, () => {
+            count++;
+            return true;
+        });
+        this.countCache = { signature: match.signature, version: this.version, count };
+        return count;
+    }
+}
+
+function toHex2(value) {
+    return (value < 16 ? '0' : '') + value.toString(16);
+}
+
+function bytesToHex(bytes) {
+    let hex = '';
+    for (const byte of bytes) {
+        hex += toHex2(byte);
+    }
+    return hex;
+}
+
+function ipToHex(ip) {
+    // IPv4 走快速路径，避免为每条路由创建 ipaddr 对象
+    if (ip.indexOf(':') < 0) {
+        let hex = '';
+        let octet = 0;
+        for (let i = 0; i < ip.length; i++) {
+            const c = ip.charCodeAt(i);
+            if (c === 0x2e) {
+                hex += toHex2(octet);
+                octet = 0;
+            } else {
+                octet = octet * 10 + c - 0x30;
+            }
+        }
+        return hex + toHex2(octet);
+    }
+    return bytesToHex(ipaddr.parse(ip).toByteArray());
+}
+
+/**
+ * 把过滤条件编译为便于逐条匹配的形式，没有任何条件时返回 null
+ *
+ * prefix: 'a.b.c.d/len' 匹配该前缀范围内(掩码不短于 len)的路由，不带掩码时按主机路由处理
+ * asPath: AS Path 正则表达式
+ * community: 团体属性，需与路由的某个团体属性完全相同
+ * nextHop: 下一跳地址
+ */
+function compileFilter(filter) {
+    if (!filter) {
+        return null;
+    }
+
+    const match = {};
+    let empty = true;
+
+    const prefix = (filter.prefix || '').trim();
+    if (prefix) {
+        const [ip, lengthStr] = prefix.split('/');
+        const bytes = ipaddr.parse(ip).toByteArray();
+        const length = lengthStr === undefined ? bytes.length * 8 : parseInt(lengthStr, 10);
+        if (isNaN(length) || length < 0 || length > bytes.length * 8) {
+            throw new Error(`前缀掩码无效: ${prefix}`);
+        }
+        const lo = bytes.slice();
+        const hi = bytes.slice();
+        for (let bit = length; bit < bytes.length * 8; bit++) {
+            const mask = 0x80 >> (bit & 7);
+            lo[bit >> 3] &= ~mask;
+            hi[bit >> 3] |= mask;
+        }
+        // lo 补上最小掩码，便于直接作为排序键定位
+        match.prefix = { lo: bytesToHex(lo) + '00', hi: bytesToHex(hi), hexLength: bytes.length * 2, length };
+        empty = false;
+    }
+
+    const asPath = (filter.asPath || '').trim();
+    if (asPath) {
+        try {
+            match.asPath = new RegExp(asPath);
+        } catch (err) {
+            throw new Error(`AS Path 正则表达式无效: ${err.message}`);
+        }
+        empty = false;
+    }
+
+    const community = (filter.community || '').trim();
+    if (community) {
+        match.community = ` ${community} `;
+        empty = false;
+    }
+
+    const nextHop = (filter.nextHop || '').trim();
+    if (nextHop) {
+        match.nextHop = nextHop;
+        empty = false;
+    }
+
+    if (empty) {
+        return null;
+    }
+    match.signature = `${prefix}\n${asPath}\n${community}\n${nextHop}`;
+    return match;
+}
+
+function matchRoute(match, route) {
+    if (match.asPath && !match.asPath.test(route.asPath || '')) {
+        return false;
+    }
+    if (match.community && !` ${route.communities || ''} `.includes(match.community)) {
+        return false;
+    }
+    if (match.nextHop && route.nextHop !== match.nextHop) {
+        return false;
+    }
+    return true;
+}
+
+module.exports = BmpRouteTable;
@@ -4,8 +4,10 @@ const { getInitiationTlvName } = require('../utils/bmpUtils');
 const BgpConst = require('../const/bgpConst');
 const BmpBgpSession = require('./bmpBgpSession');
 const BmpBgpRoute = require('./bmpBgpRoute');
+const BmpRouteTable = require('./bmpRouteTable');
 const { rdBufferToString, ipv4BufferToString, ipv6BufferToString } = require('../utils/ipUtils');
 const { parseBgpPacket } = require('../utils/bgpPacketParser');
+const { decodeUpdate } = require('../utils/bgpUpdateDecoder');
 const { getAddrFamilyType } = require('../utils/bgpUtils');
 const BmpBgpInstance = require('./bmpBgpInstance');
 
@@ -46,44 +48,20 @@ class BmpSession {
         return false;
     }
 
-    // 辅助方法：设置路由属性
+    // 辅助方法：设置路由属性，属性在同一个 UPDATE 的所有路由间只解析一次
     setRouteAttributes(route, bgpUpdate) {
         route.bgpPacket = bgpUpdate;
 
-        for (const attr of bgpUpdate.pathAttributes || []) {
-            switch (attr.typeCode) {
-                case BgpConst.BGP_PATH_ATTR.ORIGIN:
-                    route.origin = attr.origin;
-                    break;
-                case BgpConst.BGP_PATH_ATTR.AS_PATH:
-                    route.asPath = '';
-                    attr.segments.forEach(seg => {
-                        if (seg.typeName === 'AS_SEQUENCE') {
-                            route.asPath += seg.asNumbers.join(' ');
-                        } else {
-                            route.asPath += `{${seg.asNumbers.join(' ')}}`;
-                        }
-                    });
-                    break;
-                case BgpConst.BGP_PATH_ATTR.NEXT_HOP:
-                    route.nextHop = attr.nextHop;
-                    break;
-                case BgpConst.BGP_PATH_ATTR.LOCAL_PREF:
-                    route.localPref = attr.localPref;
-                    break;
-                case BgpConst.BGP_PATH_ATTR.COMMUNITY:
-                    route.communities = attr.communities.map(c => c.formatted).join(' ');
-                    break;
-                case BgpConst.BGP_PATH_ATTR.MED:
-                    route.med = attr.med;
-                    break;
-                case BgpConst.BGP_PATH_ATTR.PATH_OTC:
-                    route.otc = attr.otc;
-                    break;
-                case BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI:
-                    route.nextHop = attr.mpReach.nextHop;
-            }
-        }
+        const attrs = bgpUpdate.attributes;
+        const PATH_ATTR = BgpConst.BGP_PATH_ATTR;
+        if (attrs.has(PATH_ATTR.ORIGIN)) route.origin = attrs.origin;
+        if (attrs.has(PATH_ATTR.AS_PATH)) route.asPath = attrs.asPath;
+        if (attrs.has(PATH_ATTR.NEXT_HOP)) route.nextHop = attrs.nextHop;
+        if (attrs.has(PATH_ATTR.LOCAL_PREF)) route.localPref = attrs.localPref;
+        if (attrs.has(PATH_ATTR.COMMUNITY)) route.communities = attrs.communities;
+        if (attrs.has(PATH_ATTR.MED)) route.med = attrs.med;
+        if (attrs.has(PATH_ATTR.PATH_OTC)) route.otc = attrs.otc;
+        if (attrs.has(PATH_ATTR.MP_REACH_NLRI)) route.nextHop = attrs.mpReach.nextHop;
     }
 
     getRibTypesByFlags(sessionFlags) {
@@ -166,7 +144,7 @@ class BmpSession {
             const bgpUpdate = message.subarray(position, position + updateLength);
 
             // Pass bgpSession for ADD-PATH capability check
-            const parsedBgpUpdate = parseBgpPacket(bgpUpdate, bgpSession); // passing bgpSession as second arg
+            const parsedBgpUpdate = decodeUpdate(bgpUpdate, bgpSession);
 
             if (!parsedBgpUpdate.valid) {
                 logger.error(`Received BGP Update message is invalid: ${parsedBgpUpdate.error}`);
@@ -181,7 +159,7 @@ class BmpSession {
             }
 
             // 处理withdrawn routes (IPv4)
-            if (parsedBgpUpdate.withdrawnRoutes && parsedBgpUpdate.withdrawnRoutes.length > 0) {
+            if (parsedBgpUpdate.withdrawn.count > 0) {
                 const afKey = `${BgpConst.BGP_AFI_TYPE.AFI_IPV4}|${BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST}`;
                 const ribTypeRouteMap = bgpSession.bgpRoutes.get(afKey);
                 if (!ribTypeRouteMap) {
@@ -196,12 +174,13 @@ class BmpSession {
                         logger.error(`Received BGP Update message from unknown rib type: ${ribType}`);
                         continue;
                     }
-                    for (const withdrawn of parsedBgpUpdate.withdrawnRoutes) {
+                    const withdrawn = parsedBgpUpdate.withdrawn;
+                    for (let i = 0; i < withdrawn.count; i++) {
                         const routeKey = BmpBgpRoute.makeKey(
-                            withdrawn.pathId,
-                            withdrawn.rd,
-                            withdrawn.prefix,
-                            withdrawn.length
+                            withdrawn.pathId(i),
+                            withdrawn.rd(i),
+                            withdrawn.prefix(i),
+                            withdrawn.prefixLength(i)
                         );
                         const route = routeMap.get(routeKey);
                         if (route) {
@@ -229,15 +208,9 @@ class BmpSession {
 
             isNotify = false;
             // 处理MP_UNREACH_NLRI (多协议撤销路由)
-            let mpUnreachNlri = null;
-            for (const attr of parsedBgpUpdate.pathAttributes || []) {
-                if (attr.typeCode === BgpConst.BGP_PATH_ATTR.MP_UNREACH_NLRI) {
-                    mpUnreachNlri = attr.mpUnreach;
-                    break;
-                }
-            }
+            const mpUnreachNlri = parsedBgpUpdate.attributes.mpUnreach;
 
-            if (mpUnreachNlri && mpUnreachNlri.withdrawnRoutes && mpUnreachNlri.withdrawnRoutes.length > 0) {
+            if (mpUnreachNlri && mpUnreachNlri.withdrawnRoutes.count > 0) {
                 const afKey = `${mpUnreachNlri.afi}|${mpUnreachNlri.safi}`;
                 const ribTypeRouteMap = bgpSession.bgpRoutes.get(afKey);
                 if (!ribTypeRouteMap) {
@@ -252,12 +225,13 @@ class BmpSession {
                         logger.error(`Received BGP Update message from unknown rib type: ${ribType}`);
                         continue;
                     }
-                    for (const withdrawn of mpUnreachNlri.withdrawnRoutes) {
+                    const withdrawn = mpUnreachNlri.withdrawnRoutes;
+                    for (let i = 0; i < withdrawn.count; i++) {
                         const routeKey = BmpBgpRoute.makeKey(
-                            withdrawn.pathId,
-                            withdrawn.rd,
-                            withdrawn.prefix,
-                            withdrawn.length
+                            withdrawn.pathId(i),
+                            withdrawn.rd(i),
+                            withdrawn.prefix(i),
+                            withdrawn.prefixLength(i)
                         );
                         const route = routeMap.get(routeKey);
                         if (route) {
@@ -282,7 +256,7 @@ class BmpSession {
 
             isNotify = false;
             // 处理IPv4 NLRI
-            if (parsedBgpUpdate.nlri && parsedBgpUpdate.nlri.length > 0) {
+            if (parsedBgpUpdate.nlri.count > 0) {
                 const afKey = `${BgpConst.BGP_AFI_TYPE.AFI_IPV4}|${BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST}`;
                 const ribTypeRouteMap = bgpSession.bgpRoutes.get(afKey);
                 if (!ribTypeRouteMap) {
@@ -296,8 +270,14 @@ class BmpSession {
                         logger.error(`Received BGP Update message from unknown rib type: ${ribType}`);
                         continue;
                     }
-                    for (const nlri of parsedBgpUpdate.nlri) {
-                        const routeKey = BmpBgpRoute.makeKey(nlri.pathId, nlri.rd, nlri.prefix, nlri.length);
+                    const nlri = parsedBgpUpdate.nlri;
+                    for (let i = 0; i < nlri.count; i++) {
+                        const routeKey = BmpBgpRoute.makeKey(
+                            nlri.pathId(i),
+                            nlri.rd(i),
+                            nlri.prefix(i),
+                            nlri.prefixLength(i)
+                        );
 
                         let bmpBgpRoute = routeMap.get(routeKey);
                         if (!bmpBgpRoute) {
@@ -307,10 +287,10 @@ class BmpSession {
                             bmpBgpRoute.clearAttributes();
                         }
 
-                        bmpBgpRoute.pathId = nlri.pathId;
-                        bmpBgpRoute.rd = nlri.rd;
-                        bmpBgpRoute.ip = nlri.prefix;
-                        bmpBgpRoute.mask = nlri.length;
+                        bmpBgpRoute.pathId = nlri.pathId(i);
+                        bmpBgpRoute.rd = nlri.rd(i);
+                        bmpBgpRoute.ip = nlri.prefix(i);
+                        bmpBgpRoute.mask = nlri.prefixLength(i);
 
                         // 设置路由属性
                         this.setRouteAttributes(bmpBgpRoute, parsedBgpUpdate);
@@ -336,15 +316,9 @@ class BmpSession {
 
             isNotify = false;
             // 处理MP_REACH_NLRI (多协议扩展)
-            let mpReachNlri = null;
-            for (const attr of parsedBgpUpdate.pathAttributes || []) {
-                if (attr.typeCode === BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI) {
-                    mpReachNlri = attr.mpReach;
-                    break;
-                }
-            }
+            const mpReachNlri = parsedBgpUpdate.attributes.mpReach;
 
-            if (mpReachNlri && mpReachNlri.nlri && mpReachNlri.nlri.length > 0) {
+            if (mpReachNlri && mpReachNlri.nlri.count > 0) {
                 // 寻找匹配的多协议peer
                 const afKey = `${mpReachNlri.afi}|${mpReachNlri.safi}`;
                 const ribTypeRouteMap = bgpSession.bgpRoutes.get(afKey);
@@ -358,8 +332,14 @@ class BmpSession {
                         logger.error(`Received BGP Update message from unknown rib type: ${ribType}`);
                         continue;
                     }
-                    for (const nlri of mpReachNlri.nlri) {
-                        const routeKey = BmpBgpRoute.makeKey(nlri.pathId, nlri.rd, nlri.prefix, nlri.length);
+                    const nlri = mpReachNlri.nlri;
+                    for (let i = 0; i < nlri.count; i++) {
+                        const routeKey = BmpBgpRoute.makeKey(
+                            nlri.pathId(i),
+                            nlri.rd(i),
+                            nlri.prefix(i),
+                            nlri.prefixLength(i)
+                        );
 
                         let bmpBgpRoute = routeMap.get(routeKey);
                         if (!bmpBgpRoute) {
@@ -369,10 +349,10 @@ class BmpSession {
                             bmpBgpRoute.clearAttributes();
                         }
 
-                        bmpBgpRoute.pathId = nlri.pathId;
-                        bmpBgpRoute.rd = nlri.rd;
-                        bmpBgpRoute.ip = nlri.prefix;
-                        bmpBgpRoute.mask = nlri.length;
+                        bmpBgpRoute.pathId = nlri.pathId(i);
+                        bmpBgpRoute.rd = nlri.rd(i);
+                        bmpBgpRoute.ip = nlri.prefix(i);
+                        bmpBgpRoute.mask = nlri.prefixLength(i);
 
                         // 设置路由属性
                         this.setRouteAttributes(bmpBgpRoute, parsedBgpUpdate);
@@ -436,8 +416,8 @@ class BmpSession {
             const { length: updateLength, type: _updateType } = this.parseBgpHeader(bgpUpdateHeader);
             const bgpUpdate = message.subarray(position, position + updateLength);
 
-            // Pass bgpSession for ADD-PATH capability check
-            const parsedBgpUpdate = parseBgpPacket(bgpUpdate, this); // passing bgpSession as second arg
+            // Pass bmpSession for ADD-PATH capability check
+            const parsedBgpUpdate = decodeUpdate(bgpUpdate, this);
 
             if (!parsedBgpUpdate.valid) {
                 logger.error(`Received BGP Update message is invalid: ${parsedBgpUpdate.error}`);
@@ -446,7 +426,7 @@ class BmpSession {
 
             let isNotify = false;
             // 处理withdrawn routes (IPv4)
-            if (parsedBgpUpdate.withdrawnRoutes && parsedBgpUpdate.withdrawnRoutes.length > 0) {
+            if (parsedBgpUpdate.withdrawn.count > 0) {
                 const instKey = `${instanceType}|${instanceRd}|${BgpConst.BGP_AFI_TYPE.AFI_IPV4}|${BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST}`;
                 const bgpInstance = this.bgpInstanceMap.get(instKey);
                 if (!bgpInstance) {
@@ -455,12 +435,13 @@ class BmpSession {
                 }
 
                 // 删除所有撤销的路由
-                for (const withdrawn of parsedBgpUpdate.withdrawnRoutes) {
+                const withdrawn = parsedBgpUpdate.withdrawn;
+                for (let i = 0; i < withdrawn.count; i++) {
                     const routeKey = BmpBgpRoute.makeKey(
-                        withdrawn.pathId,
-                        withdrawn.rd,
-                        withdrawn.prefix,
-                        withdrawn.length
+                        withdrawn.pathId(i),
+                        withdrawn.rd(i),
+                        withdrawn.prefix(i),
+                        withdrawn.prefixLength(i)
                     );
                     const route = bgpInstance.bgpRoutes.get(routeKey);
                     if (route) {
@@ -483,15 +464,9 @@ class BmpSession {
 
             isNotify = false;
             // 处理MP_UNREACH_NLRI (多协议撤销路由)
-            let mpUnreachNlri = null;
-            for (const attr of parsedBgpUpdate.pathAttributes || []) {
-                if (attr.typeCode === BgpConst.BGP_PATH_ATTR.MP_UNREACH_NLRI) {
-                    mpUnreachNlri = attr.mpUnreach;
-                    break;
-                }
-            }
+            const mpUnreachNlri = parsedBgpUpdate.attributes.mpUnreach;
 
-            if (mpUnreachNlri && mpUnreachNlri.withdrawnRoutes && mpUnreachNlri.withdrawnRoutes.length > 0) {
+            if (mpUnreachNlri && mpUnreachNlri.withdrawnRoutes.count > 0) {
                 const instKey = `${instanceType}|${instanceRd}|${mpUnreachNlri.afi}|${mpUnreachNlri.safi}`;
                 const bgpInstance = this.bgpInstanceMap.get(instKey);
                 if (!bgpInstance) {
@@ -500,12 +475,13 @@ class BmpSession {
                 }
 
                 // 删除所有撤销的路由
-                for (const withdrawn of mpUnreachNlri.withdrawnRoutes) {
+                const withdrawn = mpUnreachNlri.withdrawnRoutes;
+                for (let i = 0; i < withdrawn.count; i++) {
                     const routeKey = BmpBgpRoute.makeKey(
-                        withdrawn.pathId,
-                        withdrawn.rd,
-                        withdrawn.prefix,
-                        withdrawn.length
+                        withdrawn.pathId(i),
+                        withdrawn.rd(i),
+                        withdrawn.prefix(i),
+                        withdrawn.prefixLength(i)
                     );
                     const route = bgpInstance.bgpRoutes.get(routeKey);
                     if (route) {
@@ -528,7 +504,7 @@ class BmpSession {
 
             isNotify = false;
             // 处理IPv4 NLRI
-            if (parsedBgpUpdate.nlri && parsedBgpUpdate.nlri.length > 0) {
+            if (parsedBgpUpdate.nlri.count > 0) {
                 const instKey = `${instanceType}|${instanceRd}|${BgpConst.BGP_AFI_TYPE.AFI_IPV4}|${BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST}`;
                 const bgpInstance = this.bgpInstanceMap.get(instKey);
                 if (!bgpInstance) {
@@ -536,8 +512,14 @@ class BmpSession {
                     return;
                 }
 
-                for (const nlri of parsedBgpUpdate.nlri) {
-                    const routeKey = BmpBgpRoute.makeKey(nlri.pathId, nlri.rd, nlri.prefix, nlri.length);
+                const nlri = parsedBgpUpdate.nlri;
+                for (let i = 0; i < nlri.count; i++) {
+                    const routeKey = BmpBgpRoute.makeKey(
+                        nlri.pathId(i),
+                        nlri.rd(i),
+                        nlri.prefix(i),
+                        nlri.prefixLength(i)
+                    );
 
                     let bmpBgpRoute = bgpInstance.bgpRoutes.get(routeKey);
                     if (!bmpBgpRoute) {
@@ -547,10 +529,10 @@ class BmpSession {
                         bmpBgpRoute.clearAttributes();
                     }
 
-                    bmpBgpRoute.pathId = nlri.pathId;
-                    bmpBgpRoute.rd = nlri.rd;
-                    bmpBgpRoute.ip = nlri.prefix;
-                    bmpBgpRoute.mask = nlri.length;
+                    bmpBgpRoute.pathId = nlri.pathId(i);
+                    bmpBgpRoute.rd = nlri.rd(i);
+                    bmpBgpRoute.ip = nlri.prefix(i);
+                    bmpBgpRoute.mask = nlri.prefixLength(i);
 
                     // 设置路由属性
                     this.setRouteAttributes(bmpBgpRoute, parsedBgpUpdate);
@@ -572,15 +554,9 @@ class BmpSession {
 
             // 处理MP_REACH_NLRI (多协议扩展)
             isNotify = false;
-            let mpReachNlri = null;
-            for (const attr of parsedBgpUpdate.pathAttributes || []) {
-                if (attr.typeCode === BgpConst.BGP_PATH_ATTR.MP_REACH_NLRI) {
-                    mpReachNlri = attr.mpReach;
-                    break;
-                }
-            }
+            const mpReachNlri = parsedBgpUpdate.attributes.mpReach;
 
-            if (mpReachNlri && mpReachNlri.nlri && mpReachNlri.nlri.length > 0) {
+            if (mpReachNlri && mpReachNlri.nlri.count > 0) {
                 // 寻找匹配的多协议peer
                 const instKey = `${instanceType}|${instanceRd}|${mpReachNlri.afi}|${mpReachNlri.safi}`;
                 const bgpInstance = this.bgpInstanceMap.get(instKey);
@@ -589,8 +565,14 @@ class BmpSession {
                     return;
                 }
 
-                for (const nlri of mpReachNlri.nlri) {
-                    const routeKey = BmpBgpRoute.makeKey(nlri.pathId, nlri.rd, nlri.prefix, nlri.length);
+                const nlri = mpReachNlri.nlri;
+                for (let i = 0; i < nlri.count; i++) {
+                    const routeKey = BmpBgpRoute.makeKey(
+                        nlri.pathId(i),
+                        nlri.rd(i),
+                        nlri.prefix(i),
+                        nlri.prefixLength(i)
+                    );
 
                     let bmpBgpRoute = bgpInstance.bgpRoutes.get(routeKey);
                     if (!bmpBgpRoute) {
@@ -600,10 +582,10 @@ class BmpSession {
                         bmpBgpRoute.clearAttributes();
                     }
 
-                    bmpBgpRoute.pathId = nlri.pathId;
-                    bmpBgpRoute.rd = nlri.rd;
-                    bmpBgpRoute.ip = nlri.prefix;
-                    bmpBgpRoute.mask = nlri.length;
+                    bmpBgpRoute.pathId = nlri.pathId(i);
+                    bmpBgpRoute.rd = nlri.rd(i);
+                    bmpBgpRoute.ip = nlri.prefix(i);
+                    bmpBgpRoute.mask = nlri.prefixLength(i);
 
                     // 设置路由属性
                     this.setRouteAttributes(bmpBgpRoute, parsedBgpUpdate);
@@ -1115,7 +1097,7 @@ class BmpSession {
             bgpSession.ribTypes.forEach(ribType => {
                 bgpSession.bgpRoutes.forEach((routeMap, _afKey) => {
                     if (!routeMap.has(ribType)) {
-                        routeMap.set(ribType, new Map());
+                        routeMap.set(ribType, new BmpRouteTable());
                     }
                 });
             });
@@ -5,8 +5,23 @@ const WorkerMessageHandler = require('./workerMessageHandler');
 const BmpSession = require('./bmpSession');
 const SshTunnel = require('./sshTunnel');
 const { getAfiAndSafi } = require('../utils/bgpUtils');
+const { writeRibDump } = require('../utils/mrtWriter');
+const BgpConst = require('../const/bgpConst');
 const BmpBgpSession = require('./bmpBgpSession');
 const BmpConst = require('../const/bmpConst');
+const {
+    RESUME_HELLO_LENGTH,
+    isResumeHello,
+    parseResumeHello,
+    buildResumeAccept,
+    buildResumeAck
+} = require('../utils/proxyResumeUtils');
+
+// 每秒或每收到 256KB 确认一次，helper 据此释放缓存
+const PROXY_RESUME_ACK_INTERVAL = 1000;
+const PROXY_RESUME_ACK_BYTES = 256 * 1024;
+// 大于 helper 默认的最长断线时间 (300 秒)
+const PROXY_RESUME_STREAM_TIMEOUT = 600 * 1000;
 
 class BmpWorker {
     constructor() {
@@ -18,6 +33,7 @@ class BmpWorker {
         this.sshTunnel = null; // SSH隧道（用于MD5认证）
 
         this.bmpSessionMap = new Map(); // bmp会话map
+        this.resumeStreams = new Map(); // 远程代理可续传流 streamId -> { bmpSession, received, ... }
 
         // 创建消息处理器
         this.messageHandler = new WorkerMessageHandler();
@@ -34,111 +50,174 @@ class BmpWorker {
             BmpConst.BMP_REQ_TYPES.GET_BGP_INSTANCE_ROUTES,
             this.getBgpInstanceRoutes.bind(this)
         );
+        this.messageHandler.registerHandler(BmpConst.BMP_REQ_TYPES.EXPORT_MRT, this.exportMrt.bind(this));
     }
 
-    async startTcpServer(messageId) {
-        try {
-            this.server = net.createServer(socket => {
-                const clientAddress = socket.remoteAddress;
-                const clientPort = socket.remotePort;
-
-                logger.info(`ipv4 Client connected from ${clientAddress}:${clientPort}`);
-                logger.info(`ipv4 localAddress: ${socket.localAddress}:${socket.localPort}`);
-
-                // 当接收到数据时处理数据
-                socket.on('data', data => {
-                    const bmpSession = this.bmpSessionMap.get(
-                        BmpSession.makeKey(socket.localAddress, socket.localPort, clientAddress, clientPort)
-                    );
-                    if (!bmpSession) {
-                        logger.error(`ipv4 Client ${clientAddress}:${clientPort} not found in bmpSessionMap`);
+    // 处理一个 BMP 连接，ipv4/ipv6 服务器共用
+    handleConnection(socket, family) {
+        const clientAddress = socket.remoteAddress;
+        const clientPort = socket.remotePort;
+        const sessionKey = BmpSession.makeKey(socket.localAddress, socket.localPort, clientAddress, clientPort);
+
+        logger.info(`${family} Client connected from ${clientAddress}:${clientPort}`);
+        logger.info(`${family} localAddress: ${socket.localAddress}:${socket.localPort}`);
+
+        // 经远程代理的可续传连接先收到握手，握手完成前的数据暂存
+        let pending = Buffer.alloc(0);
+        let handshakeDone = false;
+        let resumeStream = null;
+
+        // 当接收到数据时处理数据
+        socket.on('data', data => {
+            if (!handshakeDone) {
+                pending = Buffer.concat([pending, data]);
+                if (isResumeHello(pending)) {
+                    if (pending.length < RESUME_HELLO_LENGTH) {
+                        return;
+                    }
+                    resumeStream = this.attachResumeStream(socket, sessionKey, parseResumeHello(pending));
+                    if (!resumeStream) {
                         socket.destroy();
                         return;
                     }
-                    bmpSession.recvMsg(data);
-                });
+                    pending = pending.subarray(RESUME_HELLO_LENGTH);
+                }
+                handshakeDone = true;
+                data = pending;
+                pending = null;
+                if (data.length === 0) {
+                    return;
+                }
+            }
 
-                socket.on('end', () => {
-                    logger.info(`ipv4 Client ${clientAddress}:${clientPort} end`);
-                });
+            const bmpSession = resumeStream ? resumeStream.bmpSession : this.bmpSessionMap.get(sessionKey);
+            if (!bmpSession) {
+                logger.error(`${family} Client ${clientAddress}:${clientPort} not found in bmpSessionMap`);
+                socket.destroy();
+                return;
+            }
+            bmpSession.recvMsg(data);
+            if (resumeStream) {
+                resumeStream.received += data.length;
+                if (resumeStream.received - resumeStream.acked >= PROXY_RESUME_ACK_BYTES) {
+                    this.ackResumeStream(resumeStream);
+                }
+            }
+        });
 
-                socket.on('close', () => {
-                    logger.info(`ipv4 Client ${clientAddress}:${clientPort} close`);
-                });
+        socket.on('end', () => {
+            logger.info(`${family} Client ${clientAddress}:${clientPort} end`);
+        });
 
-                socket.on('error', err => {
-                    logger.error(`ipv4 TCP Error from ${clientAddress}:${clientPort}: ${err.message}`);
-                });
+        socket.on('close', () => {
+            logger.info(`${family} Client ${clientAddress}:${clientPort} close`);
+            if (resumeStream) {
+                this.detachResumeStream(resumeStream, socket);
+            }
+        });
 
-                // 创建BMP会话
-                let bmpSession = null;
-                const sessionKey = BmpSession.makeKey(socket.localAddress, socket.localPort, clientAddress, clientPort);
-                bmpSession = this.bmpSessionMap.get(sessionKey);
-                if (bmpSession) {
-                    bmpSession.closeSession();
-                    this.bmpSessionMap.delete(sessionKey);
-                } else {
-                    bmpSession = new BmpSession(this.messageHandler, this);
-                }
-                this.bmpSessionMap.set(sessionKey, bmpSession);
+        socket.on('error', err => {
+            logger.error(`${family} TCP Error from ${clientAddress}:${clientPort}: ${err.message}`);
+        });
 
-                bmpSession.socket = socket;
-                bmpSession.localIp = socket.localAddress;
-                bmpSession.localPort = socket.localPort;
-                bmpSession.remoteIp = clientAddress;
-                bmpSession.remotePort = clientPort;
-            });
+        // 创建BMP会话
+        let bmpSession = this.bmpSessionMap.get(sessionKey);
+        if (bmpSession) {
+            bmpSession.closeSession();
+            this.bmpSessionMap.delete(sessionKey);
+        } else {
+            bmpSession = new BmpSession(this.messageHandler, this);
+        }
+        this.bmpSessionMap.set(sessionKey, bmpSession);
 
-            this.ipv6Server = net.createServer(socket => {
-                const clientAddress = socket.remoteAddress;
-                const clientPort = socket.remotePort;
+        bmpSession.socket = socket;
+        bmpSession.localIp = socket.localAddress;
+        bmpSession.localPort = socket.localPort;
+        bmpSession.remoteIp = clientAddress;
+        bmpSession.remotePort = clientPort;
+    }
 
-                logger.info(`ipv6 Client connected from ${clientAddress}:${clientPort}`);
-                logger.info(`ipv6 localAddress: ${socket.localAddress}:${socket.localPort}`);
+    /**
+     * 可续传连接握手：已知的流把新连接接到原来的 BmpSession 上，从已收到的字节处继续
+     */
+    attachResumeStream(socket, sessionKey, hello) {
+        if (!hello || hello.version !== 1) {
+            logger.error(`Unsupported proxy resume handshake from ${socket.remoteAddress}:${socket.remotePort}`);
+            return null;
+        }
 
-                // 当接收到数据时处理数据
-                socket.on('data', data => {
-                    const bmpSession = this.bmpSessionMap.get(
-                        BmpSession.makeKey(socket.localAddress, socket.localPort, clientAddress, clientPort)
-                    );
-                    if (!bmpSession) {
-                        logger.error(`ipv6 Client ${clientAddress}:${clientPort} not found in bmpSessionMap`);
-                        socket.destroy();
-                        return;
-                    }
-                    bmpSession.recvMsg(data);
-                });
+        let stream = this.resumeStreams.get(hello.streamId);
+        const placeholder = this.bmpSessionMap.get(sessionKey);
+        if (stream) {
+            // 连接级的临时会话不再需要，socket 由原会话接管
+            this.bmpSessionMap.delete(sessionKey);
+            const bmpSession = stream.bmpSession;
+            this.bmpSessionMap.delete(
+                BmpSession.makeKey(bmpSession.localIp, bmpSession.localPort, bmpSession.remoteIp, bmpSession.remotePort)
+            );
+            bmpSession.socket = socket;
+            bmpSession.localIp = socket.localAddress;
+            bmpSession.localPort = socket.localPort;
+            bmpSession.remoteIp = socket.remoteAddress;
+            bmpSession.remotePort = socket.remotePort;
+            this.bmpSessionMap.set(sessionKey, bmpSession);
+            if (placeholder && placeholder !== bmpSession) {
+                placeholder.socket = null;
+            }
+            clearTimeout(stream.expireTimer);
+            stream.expireTimer = null;
+            const queued = hello.writeSeq - stream.received;
+            logger.info(`Proxy stream ${hello.streamId} resumed at ${stream.received} (${queued} bytes queued)`);
+        } else {
+            stream = { streamId: hello.streamId, bmpSession: placeholder, received: 0, acked: 0, expireTimer: null };
+            this.resumeStreams.set(hello.streamId, stream);
+            logger.info(`Proxy stream ${hello.streamId} started`);
+        }
 
-                socket.on('end', () => {
-                    logger.info(`ipv6 Client ${clientAddress}:${clientPort} end`);
-                });
+        // helper 无法提供已收到位置之后的数据时返回 0，helper 会关闭 router 会话重新开始
+        const resumeSeq = stream.received >= hello.baseSeq && stream.received <= hello.writeSeq ? stream.received : 0;
+        stream.socket = socket;
+        stream.acked = resumeSeq;
+        socket.write(buildResumeAccept(resumeSeq));
 
-                socket.on('close', () => {
-                    logger.info(`ipv6 Client ${clientAddress}:${clientPort} close`);
-                });
+        clearInterval(stream.ackTimer);
+        stream.ackTimer = setInterval(() => this.ackResumeStream(stream), PROXY_RESUME_ACK_INTERVAL);
+        return stream;
+    }
 
-                socket.on('error', err => {
-                    logger.error(`ipv6 TCP Error from ${clientAddress}:${clientPort}: ${err.message}`);
-                });
+    ackResumeStream(stream) {
+        if (stream.socket && stream.received > stream.acked) {
+            stream.acked = stream.received;
+            stream.socket.write(buildResumeAck(stream.acked));
+        }
+    }
 
-                // 创建BMP会话
-                let bmpSession = null;
-                const sessionKey = BmpSession.makeKey(socket.localAddress, socket.localPort, clientAddress, clientPort);
-                bmpSession = this.bmpSessionMap.get(sessionKey);
-                if (bmpSession) {
-                    bmpSession.closeSession();
-                    this.bmpSessionMap.delete(sessionKey);
-                } else {
-                    bmpSession = new BmpSession(this.messageHandler, this);
-                }
-                this.bmpSessionMap.set(sessionKey, bmpSession);
+    // 连接断开后保留流的状态，helper 在超时前重连即可续传
+    detachResumeStream(stream, socket) {
+        if (stream.socket !== socket) {
+            return;
+        }
+        clearInterval(stream.ackTimer);
+        stream.ackTimer = null;
+        stream.socket = null;
+        stream.expireTimer = setTimeout(() => {
+            logger.info(`Proxy stream ${stream.streamId} was not resumed, dropping its state`);
+            this.resumeStreams.delete(stream.streamId);
+        }, PROXY_RESUME_STREAM_TIMEOUT);
+    }
 
-                bmpSession.socket = socket;
-                bmpSession.localIp = socket.localAddress;
-                bmpSession.localPort = socket.localPort;
-                bmpSession.remoteIp = clientAddress;
-                bmpSession.remotePort = clientPort;
-            });
+    clearResumeStreams() {
+        this.resumeStreams.forEach(stream => {
+            clearInterval(stream.ackTimer);
+            clearTimeout(stream.expireTimer);
+        });
+        this.resumeStreams.clear();
+    }
+
+    async startTcpServer(messageId) {
+        try {
+            this.server = net.createServer(socket => this.handleConnection(socket, 'ipv4'));
+            this.ipv6Server = net.createServer(socket => this.handleConnection(socket, 'ipv6'));
 
             // 启动ipv4服务器并监听端口
             const listenPormise = util.promisify(this.server.listen).bind(this.server);
@@ -226,6 +305,18 @@ class BmpWorker {
                     `${windowsIp}:${localPort}` // 转发到 Windows 的 localPort
                 );
 
+                // 隧道断开时 helper 保持 router 会话并缓存数据，重连后从断点继续
+                try {
+                    await this.sshTunnel.enableProxyResume(
+                        'bmp',
+                        bmpConfigData.resumeSpillDir || '/var/tmp',
+                        {},
+                        !!bmpConfigData.useTcpAo
+                    );
+                } catch (error) {
+                    logger.warn(`Proxy resume not available, forwarding without it: ${error.message}`);
+                }
+
                 logger.info('SSH tunnel and proxy started successfully');
                 logger.info(`BMP router should connect to: ${sshHost}:${bmpConfigData.port}`);
                 logger.info(`Proxy will forward to localhost:${localPort}`);
@@ -319,6 +410,7 @@ class BmpWorker {
         this.messageHandler.sendEvent(BmpConst.BMP_EVT_TYPES.TERMINATION, { data: null });
 
         // 清空会话
+        this.clearResumeStreams();
         this.bmpSessionMap.forEach((session, _) => {
             session.closeSession();
         });
@@ -351,10 +443,9 @@ class BmpWorker {
     }
 
     getBgpInstanceRoutes(messageId, data) {
-        const { client, instance, page, pageSize } = data;
+        const { client, instance, page, pageSize, query } = data;
         const bmpSessionKey = BmpSession.makeKey(client.localIp, client.localPort, client.remoteIp, client.remotePort);
         const bmpSession = this.bmpSessionMap.get(bmpSessionKey);
-        const routeList = [];
         if (!bmpSession) {
             logger.error(`BMP会话 ${bmpSessionKey} 不存在`);
             this.messageHandler.sendErrorResponse(messageId, 'BMP会话不存在');
@@ -371,21 +462,13 @@ class BmpWorker {
             return;
         }
 
-        bgpInstance.bgpRoutes.forEach((route, _) => {
-            routeList.push(route.getRouteInfo());
-        });
-
-        const total = routeList.length;
-        const list = routeList.slice((page - 1) * pageSize, page * pageSize);
-
-        this.messageHandler.sendSuccessResponse(messageId, { list, total }, 'BGP实例获取路由列表成功');
+        this.queryRoutes(messageId, bgpInstance.bgpRoutes, page, pageSize, query, 'BGP实例获取路由列表成功');
     }
 
     getBgpRoutes(messageId, data) {
-        const { client, session, af, ribType, page, pageSize } = data;
+        const { client, session, af, ribType, page, pageSize, query } = data;
         const bmpSessionKey = BmpSession.makeKey(client.localIp, client.localPort, client.remoteIp, client.remotePort);
         const bmpSession = this.bmpSessionMap.get(bmpSessionKey);
-        const routeList = [];
         if (!bmpSession) {
             logger.error(`BMP会话 ${bmpSessionKey} 不存在`);
             this.messageHandler.sendErrorResponse(messageId, 'BMP会话不存在');
@@ -421,14 +504,91 @@ class BmpWorker {
             return;
         }
 
-        routeMap.forEach((route, _) => {
-            routeList.push(route.getRouteInfo());
-        });
+        this.queryRoutes(messageId, routeMap, page, pageSize, query, '获取路由列表成功');
+    }
+
+    /**
+     * 把 BGP 会话某个地址族、某种 RIB 的路由导出为 MRT TABLE_DUMP_V2 文件
+     *
+     * 请求到达时同步取路由表快照，之后分批写文件，期间继续接收和处理 BMP 报文，
+     * 导出的内容为请求时刻的路由表。
+     */
+    async exportMrt(messageId, data) {
+        const { client, session, af, ribType, filePath } = data;
+        const bmpSessionKey = BmpSession.makeKey(client.localIp, client.localPort, client.remoteIp, client.remotePort);
+        const bmpSession = this.bmpSessionMap.get(bmpSessionKey);
+        if (!bmpSession) {
+            logger.error(`BMP会话 ${bmpSessionKey} 不存在`);
+            this.messageHandler.sendErrorResponse(messageId, 'BMP会话不存在');
+            return;
+        }
+
+        const bgpSessionKey = BmpBgpSession.makeKey(
+            session.sessionType,
+            session.sessionRd,
+            session.sessionIp,
+            session.sessionAs
+        );
+        const bgpSession = bmpSession.bgpSessionMap.get(bgpSessionKey);
+        if (!bgpSession) {
+            logger.error(`BMP会话 ${bmpSessionKey} 不存在BGP会话 ${bgpSessionKey}`);
+            this.messageHandler.sendErrorResponse(messageId, 'BGP会话不存在');
+            return;
+        }
+
+        const { afi, safi } = getAfiAndSafi(af);
+        if (safi !== BgpConst.BGP_SAFI_TYPE.SAFI_UNICAST) {
+            this.messageHandler.sendErrorResponse(messageId, 'MRT导出只支持IPv4/IPv6单播地址族');
+            return;
+        }
+        const routeMap = bgpSession.bgpRoutes.get(`${afi}|${safi}`)?.get(ribType);
+        if (!routeMap) {
+            logger.error(`BGP会话 ${bgpSessionKey} 不存在地址族 ${afi}|${safi} 或 ribType ${ribType}`);
+            this.messageHandler.sendErrorResponse(messageId, '路由表不存在');
+            return;
+        }
 
-        const total = routeList.length;
-        const list = routeList.slice((page - 1) * pageSize, page * pageSize);
+        try {
+            const result = await writeRibDump(filePath, {
+                afi,
+                collectorId: '0.0.0.0',
+                viewName: bmpSession.sysName || bmpSession.remoteIp,
+                addPath: bgpSession.isAddPathReceiveEnabled(afi, safi),
+                peers: [
+                    {
+                        ip: bgpSession.sessionIp,
+                        as: bgpSession.sessionAs,
+                        bgpId: bgpSession.sessionRouterId,
+                        snapshot: routeMap.snapshot()
+                    }
+                ]
+            });
+            logger.info(`MRT导出完成 ${filePath}: ${JSON.stringify(result)}`);
+            this.messageHandler.sendSuccessResponse(messageId, result, `MRT导出成功，共 ${result.prefixes} 个前缀`);
+        } catch (err) {
+            logger.error(`MRT导出失败: ${err.message}`);
+            this.messageHandler.sendErrorResponse(messageId, `MRT导出失败: ${err.message}`);
+        }
+    }
 
-        this.messageHandler.sendSuccessResponse(messageId, { list, total }, '获取路由列表成功');
+    /**
+     * 路由分页查询，只构造当前页的路由信息
+     * @param {BmpRouteTable} routeTable 路由表
+     * @param {Object} [query] { cursor, filter }，cursor 为上一页返回的游标，filter 为过滤条件
+     */
+    queryRoutes(messageId, routeTable, page, pageSize, query, msg) {
+        try {
+            const result = routeTable.query({
+                cursor: query?.cursor || null,
+                page,
+                pageSize,
+                filter: query?.filter || null
+            });
+            this.messageHandler.sendSuccessResponse(messageId, result, msg);
+        } catch (err) {
+            logger.error(`路由查询失败: ${err.message}`);
+            this.messageHandler.sendErrorResponse(messageId, err.message);
+        }
     }
 
     getBgpInstances(messageId, client) {
@@ -1,3 +1,14 @@
+// 输出格式同 toLocaleString('zh-CN', { hour12: false })
+const DATE_FORMAT = new Intl.DateTimeFormat('zh-CN', {
+    hour12: false,
+    year: 'numeric',
+    month: 'numeric',
+    day: 'numeric',
+    hour: 'numeric',
+    minute: 'numeric',
+    second: 'numeric'
+});
+
 class Dhcp6Lease {
     constructor(duid, ip, iaid, preferredLifetime, validLifetime) {
         this.duid = duid; // 客户端 DUID（hex 字符串）
@@ -28,8 +39,8 @@ class Dhcp6Lease {
             iaid: this.iaid,
             preferredLifetime: this.preferredLifetime,
             validLifetime: this.validLifetime,
-            startTime: this.startTime.toLocaleString('zh-CN', { hour12: false }),
-            expiresAt: this.expiresAt.toLocaleString('zh-CN', { hour12: false }),
+            startTime: DATE_FORMAT.format(this.startTime),
+            expiresAt: DATE_FORMAT.format(this.expiresAt),
             status: this.isExpired() ? 'expired' : this.status
         };
     }
@@ -4,8 +4,11 @@ const net = require('net');
 const logger = require('../log/logger');
 const WorkerMessageHandler = require('./workerMessageHandler');
 const Dhcp6Lease = require('./dhcp6Lease');
+const LeaseStore = require('../utils/leaseStore');
 const Dhcp6Const = require('../const/dhcp6Const');
 
+const SETTINGS = Dhcp6Const.DEFAULT_DHCP6_SETTINGS;
+
 // ========== IPv6 工具函数 ==========
 function ipv6ToBuffer(addr) {
     if (!net.isIPv6(addr)) throw new Error(`无效IPv6地址: ${addr}`);
@@ -57,16 +60,15 @@ function bufferToIpv6(buf) {
     return groups.join(':');
 }
 
-function incrementIpv6(buf) {
-    const result = Buffer.from(buf);
-    for (let i = 15; i >= 0; i--) {
-        if (result[i] < 255) {
-            result[i]++;
-            break;
-        }
-        result[i] = 0;
-    }
-    return result;
+function bufferToBigInt(buf) {
+    return (buf.readBigUInt64BE(0) << 64n) | buf.readBigUInt64BE(8);
+}
+
+function bigIntToBuffer(value) {
+    const buf = Buffer.alloc(16);
+    buf.writeBigUInt64BE(value >> 64n, 0);
+    buf.writeBigUInt64BE(value & 0xffffffffffffffffn, 8);
+    return buf;
 }
 
 // 生成服务器 DUID-LL（类型3: link-layer address）
@@ -116,7 +118,7 @@ function parseDhcp6Packet(buf) {
                     const subLen = iaNa.readUInt16BE(j + 2);
                     j += 4;
                     if (subCode === Dhcp6Const.DHCP6_OPTS.IAADDR && subLen >= 24) {
-                        packet.requestedIp = bufferToIpv6(iaNa.slice(j, j + 16));
+                        packet.requestedAddr = iaNa.slice(j, j + 16);
                     }
                     j += subLen;
                 }
@@ -182,11 +184,16 @@ class Dhcp6Worker {
         this.server = null;
         this.config = null;
         this.serverDuid = generateServerDuid();
-        this.leaseMap = new Map(); // clientDuid -> Dhcp6Lease
-        this.ipToClient = new Map(); // ipStr -> clientDuid
-        this.poolStartBuf = null;
-        this.poolEndBuf = null;
-        this.leaseTimer = null;
+        this.serverDuidHex = this.serverDuid.toString('hex');
+        this.leaseStore = null; // clientDuid -> Dhcp6Lease，地址以相对 poolStart 的偏移管理
+        this.poolStart = 0n;
+        this.serverIdOption = buildOption(Dhcp6Const.DHCP6_OPTS.SERVERID, this.serverDuid);
+        this.dnsOption = null;
+
+        // 租约变更攒一个周期后批量推送
+        this.pendingEvents = [];
+        this.flushTimer = null;
+        this.exhaustedCount = 0;
 
         this.messageHandler = new WorkerMessageHandler();
         this.messageHandler.init();
@@ -196,182 +203,181 @@ class Dhcp6Worker {
         this.messageHandler.registerHandler(Dhcp6Const.DHCP6_REQ_TYPES.RELEASE_LEASE, this.releaseLease.bind(this));
     }
 
-    allocateIp(clientDuid) {
-        if (this.leaseMap.has(clientDuid)) return this.leaseMap.get(clientDuid).ip;
-
-        let cur = Buffer.from(this.poolStartBuf);
-        while (Buffer.compare(cur, this.poolEndBuf) <= 0) {
-            const ipStr = bufferToIpv6(cur);
-            if (!this.ipToClient.has(ipStr)) return ipStr;
-            cur = incrementIpv6(cur);
-        }
-        return null; // 池已耗尽
+    offsetToAddr(offset) {
+        return bigIntToBuffer(this.poolStart + BigInt(offset));
     }
 
-    handleSolicit(packet, rinfo) {
-        const { clientDuid, iaid, txId } = packet;
-        if (!clientDuid || !iaid) return;
+    // 地址不在池内时返回 -1
+    addrToOffset(addr) {
+        const offset = bufferToBigInt(addr) - this.poolStart;
+        return offset >= 0n && offset < BigInt(this.leaseStore.size) ? Number(offset) : -1;
+    }
 
-        const assignedIp = this.allocateIp(clientDuid);
-        if (!assignedIp) {
-            logger.warn(`DHCPv6: IP池已耗尽，拒绝 ${clientDuid}`);
-            return;
+    /**
+     * 组装带 IA_NA 的 ADVERTISE/REPLY，iaNaOpt 由 buildIaNa 生成
+     */
+    sendIaResponse(msgType, packet, rinfo, iaNaOpt, withDns = false) {
+        const opts = [
+            this.serverIdOption,
+            buildOption(Dhcp6Const.DHCP6_OPTS.CLIENTID, packet.options[Dhcp6Const.DHCP6_OPTS.CLIENTID]),
+            iaNaOpt
+        ];
+        if (withDns && this.dnsOption) {
+            opts.push(this.dnsOption);
         }
+        const resp = buildDhcp6Response(msgType, packet.txId, opts);
+        // 不带回调，发送失败由 socket 的 error 事件报告
+        this.server.send(resp, 0, resp.length, rinfo.port, rinfo.address);
+    }
 
-        logger.info(`DHCPv6 SOLICIT from ${clientDuid}, 提供 ${assignedIp}`);
-
+    sendAddress(msgType, packet, rinfo, addr) {
+        const iaAddrOpt = buildIaAddr(addr, this.config.preferredLifetime, this.config.validLifetime);
         const t1 = Math.floor(this.config.validLifetime * 0.5);
         const t2 = Math.floor(this.config.validLifetime * 0.875);
-        const iaAddrOpt = buildIaAddr(
-            ipv6ToBuffer(assignedIp),
-            this.config.preferredLifetime,
-            this.config.validLifetime
-        );
-        const iaNaOpt = buildIaNa(Buffer.from(iaid, 'hex'), t1, t2, iaAddrOpt);
+        const iaNaOpt = buildIaNa(Buffer.from(packet.iaid, 'hex'), t1, t2, iaAddrOpt);
+        this.sendIaResponse(msgType, packet, rinfo, iaNaOpt, true);
+    }
 
-        const opts = [
-            buildOption(Dhcp6Const.DHCP6_OPTS.SERVERID, this.serverDuid),
-            buildOption(Dhcp6Const.DHCP6_OPTS.CLIENTID, Buffer.from(clientDuid, 'hex')),
-            iaNaOpt
-        ];
-        if (this.config.dns1 || this.config.dns2) {
-            const dnsList = [this.config.dns1, this.config.dns2].filter(Boolean).map(ipv6ToBuffer);
-            opts.push(buildOption(Dhcp6Const.DHCP6_OPTS.DNS_SERVERS, Buffer.concat(dnsList)));
+    sendStatus(msgType, packet, rinfo, code, msg) {
+        const naOpt = buildIaNa(Buffer.from(packet.iaid, 'hex'), 0, 0, buildStatusCode(code, msg));
+        this.sendIaResponse(msgType, packet, rinfo, naOpt);
+    }
+
+    handleSolicit(packet, rinfo) {
+        const { clientDuid, iaid } = packet;
+        if (!clientDuid || !iaid) return;
+
+        // 已有租约或预留的沿用原地址，否则分配新地址并预留，ADVERTISE 期间不会再分给其他客户端
+        const offset = this.leaseStore.offer(clientDuid, SETTINGS.offerHoldMs);
+        if (offset < 0) {
+            // 池耗尽时每个 SOLICIT 都会走到这里，只计数，在推送时汇总打印
+            this.exhaustedCount++;
+            return;
         }
 
-        const resp = buildDhcp6Response(Dhcp6Const.DHCP6_MSG_TYPES.ADVERTISE, txId, opts);
-        this.server.send(resp, 0, resp.length, rinfo.port, rinfo.address, err => {
-            if (err) logger.error(`DHCPv6: 发送ADVERTISE失败: ${err.message}`);
-        });
+        this.sendAddress(Dhcp6Const.DHCP6_MSG_TYPES.ADVERTISE, packet, rinfo, this.offsetToAddr(offset));
     }
 
     handleRequest(packet, rinfo) {
-        const { clientDuid, iaid, serverDuid, txId, requestedIp } = packet;
+        const { clientDuid, iaid, serverDuid, requestedAddr } = packet;
         if (!clientDuid || !iaid) return;
 
-        // 校验 Server ID 是否匹配
-        if (serverDuid && serverDuid !== this.serverDuid.toString('hex')) {
-            logger.info(`DHCPv6 REQUEST: 目标服务器不是本机，忽略`);
+        // 校验 Server ID 是否匹配，客户端选择了其他服务器时释放为它预留的地址
+        if (serverDuid && serverDuid !== this.serverDuidHex) {
+            this.leaseStore.cancelOffer(clientDuid);
             return;
         }
 
-        const assignedIp = requestedIp || this.allocateIp(clientDuid);
-        if (!assignedIp) {
+        // 优先使用客户端请求的地址(池内且未被其他客户端占用)，否则沿用已有租约/预留或重新分配
+        let offset = requestedAddr ? this.addrToOffset(requestedAddr) : -1;
+        const owner = offset >= 0 ? this.leaseStore.ownerOf(offset) : null;
+        if (offset < 0 || (owner !== null && owner !== clientDuid)) {
+            offset = this.leaseStore.offer(clientDuid, SETTINGS.offerHoldMs);
+        }
+
+        const addr = offset >= 0 ? this.offsetToAddr(offset) : null;
+        const ip = addr ? bufferToIpv6(addr) : null;
+        const existing = this.leaseStore.get(clientDuid);
+        const lease =
+            existing && existing.ip === ip
+                ? existing
+                : new Dhcp6Lease(clientDuid, ip, iaid, this.config.preferredLifetime, this.config.validLifetime);
+
+        if (!addr || !this.leaseStore.bind(clientDuid, offset, lease, this.config.validLifetime * 1000)) {
             // 无地址可用
-            const naOpt = buildIaNa(
-                Buffer.from(iaid, 'hex'),
-                0,
-                0,
-                buildStatusCode(Dhcp6Const.DHCP6_STATUS.NO_ADDRS_AVAIL, 'No addresses available')
+            this.sendStatus(
+                Dhcp6Const.DHCP6_MSG_TYPES.REPLY,
+                packet,
+                rinfo,
+                Dhcp6Const.DHCP6_STATUS.NO_ADDRS_AVAIL,
+                'No addresses available'
             );
-            const opts = [
-                buildOption(Dhcp6Const.DHCP6_OPTS.SERVERID, this.serverDuid),
-                buildOption(Dhcp6Const.DHCP6_OPTS.CLIENTID, Buffer.from(clientDuid, 'hex')),
-                naOpt
-            ];
-            const resp = buildDhcp6Response(Dhcp6Const.DHCP6_MSG_TYPES.REPLY, txId, opts);
-            this.server.send(resp, 0, resp.length, rinfo.port, rinfo.address, err => {
-                if (err) logger.error(`DHCPv6: 发送REPLY(NoAddrs)失败: ${err.message}`);
-            });
             return;
         }
 
-        // 记录租约
-        const t1 = Math.floor(this.config.validLifetime * 0.5);
-        const t2 = Math.floor(this.config.validLifetime * 0.875);
-
-        if (this.leaseMap.has(clientDuid)) {
-            const lease = this.leaseMap.get(clientDuid);
+        if (lease === existing) {
             lease.renew(this.config.preferredLifetime, this.config.validLifetime);
-            this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
-                type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE,
-                opType: 'update',
-                data: lease.getInfo()
-            });
-            logger.info(`DHCPv6 续约: ${clientDuid} -> ${assignedIp}`);
-        } else {
-            const lease = new Dhcp6Lease(
-                clientDuid,
-                assignedIp,
-                iaid,
-                this.config.preferredLifetime,
-                this.config.validLifetime
-            );
-            this.leaseMap.set(clientDuid, lease);
-            this.ipToClient.set(assignedIp, clientDuid);
-            this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
-                type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE,
-                opType: 'add',
-                data: lease.getInfo()
-            });
-            logger.info(`DHCPv6 新租约: ${clientDuid} -> ${assignedIp}`);
         }
+        this.queueLeaseEvent(existing ? 'update' : 'add', lease);
 
-        const iaAddrOpt = buildIaAddr(
-            ipv6ToBuffer(assignedIp),
-            this.config.preferredLifetime,
-            this.config.validLifetime
-        );
-        const iaNaOpt = buildIaNa(Buffer.from(iaid, 'hex'), t1, t2, iaAddrOpt);
-        const opts = [
-            buildOption(Dhcp6Const.DHCP6_OPTS.SERVERID, this.serverDuid),
-            buildOption(Dhcp6Const.DHCP6_OPTS.CLIENTID, Buffer.from(clientDuid, 'hex')),
-            iaNaOpt
-        ];
-        if (this.config.dns1 || this.config.dns2) {
-            const dnsList = [this.config.dns1, this.config.dns2].filter(Boolean).map(ipv6ToBuffer);
-            opts.push(buildOption(Dhcp6Const.DHCP6_OPTS.DNS_SERVERS, Buffer.concat(dnsList)));
-        }
-        const resp = buildDhcp6Response(Dhcp6Const.DHCP6_MSG_TYPES.REPLY, txId, opts);
-        this.server.send(resp, 0, resp.length, rinfo.port, rinfo.address, err => {
-            if (err) logger.error(`DHCPv6: 发送REPLY失败: ${err.message}`);
-        });
+        this.sendAddress(Dhcp6Const.DHCP6_MSG_TYPES.REPLY, packet, rinfo, addr);
     }
 
     handleRelease(packet, rinfo) {
         const { clientDuid, iaid, txId } = packet;
         if (!clientDuid) return;
 
-        if (this.leaseMap.has(clientDuid)) {
-            const lease = this.leaseMap.get(clientDuid);
-            this.ipToClient.delete(lease.ip);
-            this.leaseMap.delete(clientDuid);
-            logger.info(`DHCPv6 RELEASE: ${clientDuid} 释放 ${lease.ip}`);
-            this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
-                type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { duid: clientDuid, ip: lease.ip }
-            });
+        const lease = this.leaseStore.release(clientDuid);
+        if (lease) {
+            this.queueLeaseEvent('remove', lease);
         }
 
         // 回复 REPLY
         if (txId && iaid) {
-            const naOpt = buildIaNa(
-                Buffer.from(iaid, 'hex'),
-                0,
-                0,
-                buildStatusCode(Dhcp6Const.DHCP6_STATUS.SUCCESS, 'Released')
+            this.sendStatus(
+                Dhcp6Const.DHCP6_MSG_TYPES.REPLY,
+                packet,
+                rinfo,
+                Dhcp6Const.DHCP6_STATUS.SUCCESS,
+                'Released'
             );
-            const opts = [
-                buildOption(Dhcp6Const.DHCP6_OPTS.SERVERID, this.serverDuid),
-                buildOption(Dhcp6Const.DHCP6_OPTS.CLIENTID, Buffer.from(clientDuid, 'hex')),
-                naOpt
-            ];
-            const resp = buildDhcp6Response(Dhcp6Const.DHCP6_MSG_TYPES.REPLY, txId, opts);
-            this.server.send(resp, 0, resp.length, rinfo.port, rinfo.address, () => {});
         }
     }
 
+    queueLeaseEvent(opType, lease) {
+        this.pendingEvents.push({ opType, lease });
+    }
+
+    flushLeaseEvents() {
+        if (this.exhaustedCount > 0) {
+            logger.warn(`DHCPv6: IP池已耗尽，拒绝了 ${this.exhaustedCount} 个 SOLICIT`);
+            this.exhaustedCount = 0;
+        }
+        if (this.pendingEvents.length === 0) {
+            return;
+        }
+        const events = this.pendingEvents;
+        this.pendingEvents = [];
+        this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
+            type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE_BATCH,
+            data: events.map(({ opType, lease }) => ({
+                opType,
+                data: opType === 'remove' ? { duid: lease.duid, ip: lease.ip } : lease.getInfo()
+            }))
+        });
+    }
+
     startDhcp6(messageId, config) {
         this.config = config;
         const listenPort = Number.isInteger(Number(this.config.serverPort))
             ? Number(this.config.serverPort)
             : Dhcp6Const.DEFAULT_DHCP6_CONFIG.serverPort;
-        this.poolStartBuf = ipv6ToBuffer(config.poolStart);
-        this.poolEndBuf = ipv6ToBuffer(config.poolEnd);
-
         try {
-            this.server = dgram.createSocket({ type: 'udp6', reuseAddr: true });
+            this.poolStart = bufferToBigInt(ipv6ToBuffer(config.poolStart));
+            const poolSize = bufferToBigInt(ipv6ToBuffer(config.poolEnd)) - this.poolStart + 1n;
+            if (poolSize <= 0n) {
+                throw new Error(`地址池 ${config.poolStart} - ${config.poolEnd} 无效`);
+            }
+            if (poolSize > BigInt(SETTINGS.maxPoolSize)) {
+                logger.warn(`DHCPv6: 地址池过大，只使用开头的 ${SETTINGS.maxPoolSize} 个地址`);
+            }
+            const dnsList = [config.dns1, config.dns2].filter(Boolean).map(ipv6ToBuffer);
+            this.dnsOption =
+                dnsList.length > 0 ? buildOption(Dhcp6Const.DHCP6_OPTS.DNS_SERVERS, Buffer.concat(dnsList)) : null;
+            this.leaseStore = new LeaseStore(
+                Number(poolSize > BigInt(SETTINGS.maxPoolSize) ? BigInt(SETTINGS.maxPoolSize) : poolSize),
+                (duid, lease) => this.queueLeaseEvent('remove', lease),
+                SETTINGS.timerTickMs
+            );
+            this.pendingEvents = [];
+            this.exhaustedCount = 0;
+
+            this.server = dgram.createSocket({
+                type: 'udp6',
+                reuseAddr: true,
+                recvBufferSize: SETTINGS.socketBufferSize,
+                sendBufferSize: SETTINGS.socketBufferSize
+            });
 
             let started = false;
             this.server.on('error', err => {
@@ -392,7 +398,6 @@ class Dhcp6Worker {
                 try {
                     const packet = parseDhcp6Packet(msg);
                     if (!packet) return;
-                    logger.info(`DHCPv6收到消息类型 ${packet.msgType} from [${rinfo.address}]:${rinfo.port}`);
 
                     switch (packet.msgType) {
                         case Dhcp6Const.DHCP6_MSG_TYPES.SOLICIT:
@@ -439,7 +444,8 @@ class Dhcp6Worker {
                     `DHCPv6服务器启动成功，监听 [::]:${listenPort}`
                 );
 
-                this.leaseTimer = setInterval(() => this.checkExpiredLeases(), 60000);
+                this.leaseStore.start();
+                this.flushTimer = setInterval(() => this.flushLeaseEvents(), SETTINGS.flushInterval);
             });
         } catch (err) {
             logger.error(`DHCPv6服务器启动失败: ${err.message}`);
@@ -448,59 +454,40 @@ class Dhcp6Worker {
     }
 
     stopDhcp6(messageId) {
-        if (this.leaseTimer) {
-            clearInterval(this.leaseTimer);
-            this.leaseTimer = null;
+        if (this.flushTimer) {
+            clearInterval(this.flushTimer);
+            this.flushTimer = null;
+        }
+        if (this.leaseStore) {
+            this.leaseStore.stop();
+            this.leaseStore = null;
         }
         if (this.server) {
             this.server.close();
             this.server = null;
         }
-        this.leaseMap.clear();
-        this.ipToClient.clear();
+        this.pendingEvents = [];
         this.config = null;
         this.messageHandler.sendSuccessResponse(messageId, null, 'DHCPv6服务器已停止');
     }
 
     getLeaseList(messageId) {
         const leases = [];
-        this.leaseMap.forEach(lease => leases.push(lease.getInfo()));
+        if (this.leaseStore) {
+            this.leaseStore.forEachLease(lease => leases.push(lease.getInfo()));
+        }
         this.messageHandler.sendSuccessResponse(messageId, leases, '获取租约列表成功');
     }
 
     releaseLease(messageId, duid) {
-        if (this.leaseMap.has(duid)) {
-            const lease = this.leaseMap.get(duid);
-            this.ipToClient.delete(lease.ip);
-            this.leaseMap.delete(duid);
-            this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
-                type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { duid, ip: lease.ip }
-            });
+        const lease = this.leaseStore ? this.leaseStore.release(duid) : null;
+        if (lease) {
+            this.queueLeaseEvent('remove', lease);
             this.messageHandler.sendSuccessResponse(messageId, null, `租约 ${duid} 已释放`);
         } else {
             this.messageHandler.sendErrorResponse(messageId, `未找到 ${duid} 的租约`);
         }
     }
-
-    checkExpiredLeases() {
-        const expired = [];
-        this.leaseMap.forEach((lease, duid) => {
-            if (lease.isExpired()) expired.push(duid);
-        });
-        expired.forEach(duid => {
-            const lease = this.leaseMap.get(duid);
-            this.ipToClient.delete(lease.ip);
-            this.leaseMap.delete(duid);
-            logger.info(`DHCPv6: 租约过期: ${duid} -> ${lease.ip}`);
-            this.messageHandler.sendEvent(Dhcp6Const.DHCP6_EVT_TYPES.DHCP6_EVT, {
-                type: Dhcp6Const.DHCP6_SUB_EVT_TYPES.DHCP6_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { duid, ip: lease.ip }
-            });
-        });
-    }
 }
 
 new Dhcp6Worker();
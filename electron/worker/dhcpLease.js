@@ -1,3 +1,14 @@
+// 与 toLocaleString('zh-CN', { hour12: false }) 输出相同，复用同一个格式化器，避免每次重新创建
+const DATE_FORMAT = new Intl.DateTimeFormat('zh-CN', {
+    hour12: false,
+    year: 'numeric',
+    month: 'numeric',
+    day: 'numeric',
+    hour: 'numeric',
+    minute: 'numeric',
+    second: 'numeric'
+});
+
 class DhcpLease {
     constructor(macAddr, ip, hostname, leaseTime) {
         this.macAddr = macAddr;
@@ -25,8 +36,8 @@ class DhcpLease {
             ip: this.ip,
             hostname: this.hostname,
             leaseTime: this.leaseTime,
-            startTime: this.startTime.toLocaleString('zh-CN', { hour12: false }),
-            expiresAt: this.expiresAt.toLocaleString('zh-CN', { hour12: false }),
+            startTime: DATE_FORMAT.format(this.startTime),
+            expiresAt: DATE_FORMAT.format(this.expiresAt),
             status: this.isExpired() ? 'expired' : this.status
         };
     }
@@ -3,8 +3,11 @@ const os = require('os');
 const logger = require('../log/logger');
 const WorkerMessageHandler = require('./workerMessageHandler');
 const DhcpLease = require('./dhcpLease');
+const LeaseStore = require('../utils/leaseStore');
 const DhcpConst = require('../const/dhcpConst');
 
+const SETTINGS = DhcpConst.DEFAULT_DHCP_SETTINGS;
+
 // 自动探测本机第一个非回环 IPv4 地址，用于 DHCP Option 54（服务器标识符）
 function detectLocalIp() {
     const ifaces = os.networkInterfaces();
@@ -34,16 +37,30 @@ function ipToBuffer(ip) {
     return Buffer.from(ip.split('.').map(Number));
 }
 
+const HEX_BYTES = Array.from({ length: 256 }, (_, i) => i.toString(16).padStart(2, '0'));
+
+function formatMac(buf, len) {
+    let mac = HEX_BYTES[buf[0]];
+    for (let i = 1; i < len; i++) {
+        mac += ':' + HEX_BYTES[buf[i]];
+    }
+    return mac;
+}
+
 class DhcpWorker {
     constructor() {
         this.server = null;
         this.config = null;
-        this.leaseMap = new Map(); // macAddr -> DhcpLease
-        this.ipToMac = new Map(); // ip -> macAddr
-        this.pendingOffers = new Map(); // xid -> { macAddr, ip }
+        this.leaseStore = null; // macAddr -> DhcpLease，地址以相对 poolStart 的偏移管理
         this.poolStart = 0;
-        this.poolEnd = 0;
-        this.leaseTimer = null;
+        this.serverIpNum = 0;
+        this.optionTemplate = null; // OFFER/ACK 中除消息类型外的固定选项
+        this.nakOptionTemplate = null;
+
+        // 租约变更攒一个周期后批量推送
+        this.pendingEvents = [];
+        this.flushTimer = null;
+        this.exhaustedCount = 0;
 
         this.messageHandler = new WorkerMessageHandler();
         this.messageHandler.init();
@@ -73,11 +90,7 @@ class DhcpWorker {
         };
 
         // 解析MAC地址
-        const hlen = packet.hlen || 6;
-        packet.macAddr = Array.from(packet.chaddr.slice(0, hlen))
-            .map(b => b.toString(16).padStart(2, '0'))
-            .join(':')
-            .toLowerCase();
+        packet.macAddr = formatMac(packet.chaddr, Math.min(packet.hlen || 6, 16));
 
         // 解析DHCP Options
         if (buffer.length > 240) {
@@ -101,7 +114,7 @@ class DhcpWorker {
             packet.msgType = packet.options[53].readUInt8(0);
         }
         if (packet.options[50] && packet.options[50].length >= 4) {
-            packet.requestedIp = numToIp(packet.options[50].readUInt32BE(0));
+            packet.requestedNum = packet.options[50].readUInt32BE(0);
         }
         if (packet.options[12]) {
             packet.hostname = packet.options[12].toString('ascii').replace(/\0/g, '');
@@ -113,226 +126,171 @@ class DhcpWorker {
         return packet;
     }
 
-    buildDhcpResponse(packet, msgType, assignedIp, serverIp) {
-        const buf = Buffer.alloc(576, 0);
+    /**
+     * 预先写好 OFFER/ACK 和 NAK 中不随请求变化的选项
+     */
+    buildOptionTemplates() {
+        const serverIpBuf = ipToBuffer(this.config.serverIp);
+        const options = [Buffer.from([54, 4]), serverIpBuf];
+
+        // Option 51: IP Address Lease Time
+        const leaseTime = Buffer.alloc(6);
+        leaseTime.writeUInt8(51, 0);
+        leaseTime.writeUInt8(4, 1);
+        leaseTime.writeUInt32BE(this.config.leaseTime, 2);
+        options.push(leaseTime);
+
+        // Option 1: Subnet Mask
+        options.push(Buffer.from([1, 4]), ipToBuffer(this.config.subnetMask));
+
+        // Option 3: Router (Gateway)
+        if (this.config.gateway) {
+            options.push(Buffer.from([3, 4]), ipToBuffer(this.config.gateway));
+        }
+
+        // Option 6: DNS Servers
+        const dnsServers = [this.config.dns1, this.config.dns2].filter(Boolean);
+        if (dnsServers.length > 0) {
+            options.push(Buffer.from([6, dnsServers.length * 4]), ...dnsServers.map(ipToBuffer));
+        }
+
+        this.optionTemplate = Buffer.concat(options);
+        // NAK仅包含Server Identifier
+        this.nakOptionTemplate = Buffer.concat([Buffer.from([54, 4]), serverIpBuf]);
+    }
+
+    buildDhcpResponse(packet, msgType, assignedIpNum) {
+        const options = msgType === DhcpConst.DHCP_MSG_TYPES.NAK ? this.nakOptionTemplate : this.optionTemplate;
+        const buf = Buffer.alloc(240 + 3 + options.length + 1, 0);
 
         // Fixed header
         buf.writeUInt8(2, 0); // op: BOOTREPLY
         buf.writeUInt8(packet.htype, 1);
         buf.writeUInt8(packet.hlen, 2);
-        buf.writeUInt8(0, 3); // hops
         buf.writeUInt32BE(packet.xid, 4);
-        buf.writeUInt16BE(0, 8); // secs
         buf.writeUInt16BE(packet.flags, 10); // 保留广播标志
 
-        // ciaddr (为0，由OFFER/ACK决定yiaddr)
-        buf.fill(0, 12, 16);
-
-        // yiaddr (分配给客户端的IP)
-        ipToBuffer(assignedIp).copy(buf, 16);
-
-        // siaddr (服务器IP)
-        ipToBuffer(serverIp).copy(buf, 20);
+        // ciaddr为0，yiaddr为分配给客户端的IP，siaddr为服务器IP
+        buf.writeUInt32BE(assignedIpNum, 16);
+        buf.writeUInt32BE(this.serverIpNum, 20);
 
-        // giaddr
+        // giaddr, chaddr
         packet.giaddr.copy(buf, 24);
-
-        // chaddr
         packet.chaddr.copy(buf, 28);
 
         // Magic Cookie
         MAGIC_COOKIE.copy(buf, 236);
 
-        let offset = 240;
-
         // Option 53: DHCP Message Type
-        buf.writeUInt8(53, offset++);
-        buf.writeUInt8(1, offset++);
-        buf.writeUInt8(msgType, offset++);
-
-        if (msgType !== DhcpConst.DHCP_MSG_TYPES.NAK) {
-            // Option 54: Server Identifier
-            buf.writeUInt8(54, offset++);
-            buf.writeUInt8(4, offset++);
-            ipToBuffer(serverIp).copy(buf, offset);
-            offset += 4;
-
-            // Option 51: IP Address Lease Time
-            buf.writeUInt8(51, offset++);
-            buf.writeUInt8(4, offset++);
-            buf.writeUInt32BE(this.config.leaseTime, offset);
-            offset += 4;
-
-            // Option 1: Subnet Mask
-            buf.writeUInt8(1, offset++);
-            buf.writeUInt8(4, offset++);
-            ipToBuffer(this.config.subnetMask).copy(buf, offset);
-            offset += 4;
-
-            // Option 3: Router (Gateway)
-            if (this.config.gateway) {
-                buf.writeUInt8(3, offset++);
-                buf.writeUInt8(4, offset++);
-                ipToBuffer(this.config.gateway).copy(buf, offset);
-                offset += 4;
-            }
-
-            // Option 6: DNS Servers
-            const dnsServers = [this.config.dns1, this.config.dns2].filter(Boolean);
-            if (dnsServers.length > 0) {
-                buf.writeUInt8(6, offset++);
-                buf.writeUInt8(dnsServers.length * 4, offset++);
-                dnsServers.forEach(dns => {
-                    ipToBuffer(dns).copy(buf, offset);
-                    offset += 4;
-                });
-            }
-        } else {
-            // NAK仅包含Server Identifier
-            buf.writeUInt8(54, offset++);
-            buf.writeUInt8(4, offset++);
-            ipToBuffer(serverIp).copy(buf, offset);
-            offset += 4;
-        }
+        buf.writeUInt8(53, 240);
+        buf.writeUInt8(1, 241);
+        buf.writeUInt8(msgType, 242);
+        options.copy(buf, 243);
 
         // Option 255: End
-        buf.writeUInt8(255, offset++);
+        buf.writeUInt8(255, buf.length - 1);
 
-        return buf.slice(0, offset);
+        return buf;
     }
 
-    allocateIp(macAddr) {
-        // 已有租约，返回同一个IP
-        if (this.leaseMap.has(macAddr)) {
-            return this.leaseMap.get(macAddr).ip;
-        }
-        // 从池中分配空闲IP
-        for (let num = this.poolStart; num <= this.poolEnd; num++) {
-            const ip = numToIp(num);
-            if (!this.ipToMac.has(ip)) {
-                return ip;
-            }
-        }
-        return null; // IP池已耗尽
+    sendNak(packet, rinfo, reason) {
+        logger.warn(`DHCP REQUEST: ${reason}，发送NAK`);
+        const nak = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.NAK, 0);
+        this.sendResponse(nak, packet, rinfo);
     }
 
     handleDiscover(packet, rinfo) {
-        const macAddr = packet.macAddr;
-        const offeredIp = this.allocateIp(macAddr);
-
-        if (!offeredIp) {
-            logger.warn(`DHCP: IP池已耗尽，拒绝 ${macAddr}`);
+        // 已有租约或预留的沿用原地址，否则分配新地址并预留，OFFER 期间不会再分给其他客户端
+        const offset = this.leaseStore.offer(packet.macAddr, SETTINGS.offerHoldMs);
+        if (offset < 0) {
+            // 池耗尽时每个 DISCOVER 都会走到这里，只计数，在推送时汇总打印
+            this.exhaustedCount++;
             return;
         }
 
-        this.pendingOffers.set(packet.xid, { macAddr, ip: offeredIp });
-        logger.info(`DHCP DISCOVER from ${macAddr} (${rinfo.address}), offering ${offeredIp}`);
-
-        const response = this.buildDhcpResponse(
-            packet,
-            DhcpConst.DHCP_MSG_TYPES.OFFER,
-            offeredIp,
-            this.config.serverIp
-        );
+        const response = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.OFFER, this.poolStart + offset);
         this.sendResponse(response, packet, rinfo);
     }
 
     handleRequest(packet, rinfo) {
         const macAddr = packet.macAddr;
 
-        // 如果客户端选择了其他服务器，忽略
+        // 如果客户端选择了其他服务器，忽略并释放为它预留的地址
         if (packet.serverId && packet.serverId !== this.config.serverIp) {
-            // 如果该客户端有pending offer，清理掉
-            if (this.pendingOffers.has(packet.xid)) {
-                this.pendingOffers.delete(packet.xid);
-            }
-            logger.info(`DHCP REQUEST: 客户端 ${macAddr} 选择了其他服务器 ${packet.serverId}`);
+            this.leaseStore.cancelOffer(macAddr);
             return;
         }
 
         // 确定请求的IP
-        let requestedIp = packet.requestedIp;
-        if (!requestedIp) {
-            const ciaddrNum = packet.ciaddr.readUInt32BE(0);
-            if (ciaddrNum !== 0) {
-                requestedIp = numToIp(ciaddrNum);
-            }
-        }
-
-        if (!requestedIp) {
-            logger.warn(`DHCP REQUEST: 无法确定请求IP，发送NAK`);
-            const nak = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.NAK, '0.0.0.0', this.config.serverIp);
-            this.sendResponse(nak, packet, rinfo);
+        const requestedNum = packet.requestedNum || packet.ciaddr.readUInt32BE(0);
+        if (requestedNum === 0) {
+            this.sendNak(packet, rinfo, '无法确定请求IP');
             return;
         }
 
         // 验证IP是否在池范围内
-        const requestedNum = ipToNum(requestedIp);
-        if (requestedNum < this.poolStart || requestedNum > this.poolEnd) {
-            logger.warn(`DHCP REQUEST: IP ${requestedIp} 不在池范围内，发送NAK`);
-            const nak = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.NAK, '0.0.0.0', this.config.serverIp);
-            this.sendResponse(nak, packet, rinfo);
+        const offset = requestedNum - this.poolStart;
+        const requestedIp = numToIp(requestedNum);
+        if (offset < 0 || offset >= this.leaseStore.size) {
+            this.sendNak(packet, rinfo, `IP ${requestedIp} 不在池范围内`);
             return;
         }
 
+        const hostname = packet.hostname || '未知';
+        const existing = this.leaseStore.get(macAddr);
+        const lease =
+            existing && existing.ip === requestedIp
+                ? existing
+                : new DhcpLease(macAddr, requestedIp, hostname, this.config.leaseTime);
+
         // 验证IP未被其他MAC占用
-        if (this.ipToMac.has(requestedIp) && this.ipToMac.get(requestedIp) !== macAddr) {
-            logger.warn(`DHCP REQUEST: IP ${requestedIp} 已被 ${this.ipToMac.get(requestedIp)} 占用`);
-            const nak = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.NAK, '0.0.0.0', this.config.serverIp);
-            this.sendResponse(nak, packet, rinfo);
+        if (!this.leaseStore.bind(macAddr, offset, lease, this.config.leaseTime * 1000)) {
+            this.sendNak(packet, rinfo, `IP ${requestedIp} 已被 ${this.leaseStore.ownerOf(offset)} 占用`);
             return;
         }
 
-        const hostname = packet.hostname || '未知';
-
-        if (this.leaseMap.has(macAddr)) {
+        if (lease === existing) {
             // 续约
-            const lease = this.leaseMap.get(macAddr);
             lease.renew(this.config.leaseTime);
             lease.hostname = hostname;
-            logger.info(`DHCP续约: ${macAddr} -> ${requestedIp}`);
-
-            this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
-                type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE,
-                opType: 'update',
-                data: lease.getInfo()
-            });
-        } else {
-            // 新租约
-            const lease = new DhcpLease(macAddr, requestedIp, hostname, this.config.leaseTime);
-            this.leaseMap.set(macAddr, lease);
-            this.ipToMac.set(requestedIp, macAddr);
-            logger.info(`DHCP新租约: ${macAddr} -> ${requestedIp}`);
-
-            this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
-                type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE,
-                opType: 'add',
-                data: lease.getInfo()
-            });
         }
+        this.queueLeaseEvent(existing ? 'update' : 'add', lease);
 
-        this.pendingOffers.delete(packet.xid);
-
-        const ack = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.ACK, requestedIp, this.config.serverIp);
+        const ack = this.buildDhcpResponse(packet, DhcpConst.DHCP_MSG_TYPES.ACK, requestedNum);
         this.sendResponse(ack, packet, rinfo);
     }
 
     handleRelease(packet) {
-        const macAddr = packet.macAddr;
+        const lease = this.leaseStore.release(packet.macAddr);
+        if (lease) {
+            this.queueLeaseEvent('remove', lease);
+        }
+    }
 
-        if (this.leaseMap.has(macAddr)) {
-            const lease = this.leaseMap.get(macAddr);
-            const ip = lease.ip;
-            this.leaseMap.delete(macAddr);
-            this.ipToMac.delete(ip);
-            logger.info(`DHCP RELEASE: ${macAddr} 释放 ${ip}`);
-
-            this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
-                type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { macAddr, ip }
-            });
+    queueLeaseEvent(opType, lease) {
+        this.pendingEvents.push({ opType, lease });
+    }
+
+    /**
+     * 把一个周期内的租约变更合成一个事件推送，租约信息在这里才格式化
+     */
+    flushLeaseEvents() {
+        if (this.exhaustedCount > 0) {
+            logger.warn(`DHCP: IP池已耗尽，拒绝了 ${this.exhaustedCount} 个 DISCOVER`);
+            this.exhaustedCount = 0;
+        }
+        if (this.pendingEvents.length === 0) {
+            return;
         }
+        const events = this.pendingEvents;
+        this.pendingEvents = [];
+        this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
+            type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE_BATCH,
+            data: events.map(({ opType, lease }) => ({
+                opType,
+                data: opType === 'remove' ? { macAddr: lease.macAddr, ip: lease.ip } : lease.getInfo()
+            }))
+        });
     }
 
     sendResponse(response, packet, rinfo) {
@@ -343,11 +301,8 @@ class DhcpWorker {
         // 响应发回请求来源端口（标准客户端用68，测试脚本可使用任意端口）
         const destPort = rinfo.port;
 
-        this.server.send(response, 0, response.length, destPort, destAddress, err => {
-            if (err) {
-                logger.error(`DHCP: 发送响应到 ${destAddress}:${destPort} 失败: ${err.message}`);
-            }
-        });
+        // 不带回调，发送失败由 socket 的 error 事件报告
+        this.server.send(response, 0, response.length, destPort, destAddress);
     }
 
     startDhcp(messageId, config) {
@@ -361,10 +316,31 @@ class DhcpWorker {
             logger.info(`DHCP: 自动探测服务器IP: ${this.config.serverIp}`);
         }
         this.poolStart = ipToNum(config.poolStart);
-        this.poolEnd = ipToNum(config.poolEnd);
+        const poolSize = ipToNum(config.poolEnd) - this.poolStart + 1;
+        if (poolSize <= 0 || poolSize > SETTINGS.maxPoolSize) {
+            this.messageHandler.sendErrorResponse(
+                messageId,
+                `DHCP服务器启动失败: 地址池 ${config.poolStart} - ${config.poolEnd} 无效`
+            );
+            return;
+        }
+        this.serverIpNum = ipToNum(this.config.serverIp);
+        this.buildOptionTemplates();
+        this.leaseStore = new LeaseStore(
+            poolSize,
+            (macAddr, lease) => this.queueLeaseEvent('remove', lease),
+            SETTINGS.timerTickMs
+        );
+        this.pendingEvents = [];
+        this.exhaustedCount = 0;
 
         try {
-            this.server = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+            this.server = dgram.createSocket({
+                type: 'udp4',
+                reuseAddr: true,
+                recvBufferSize: SETTINGS.socketBufferSize,
+                sendBufferSize: SETTINGS.socketBufferSize
+            });
 
             // 统一错误处理：区分启动阶段（messageId有效）和运行阶段
             let started = false;
@@ -388,8 +364,6 @@ class DhcpWorker {
                     const packet = this.parseDhcpPacket(msg);
                     if (!packet || packet.op !== 1) return; // 只处理BOOTREQUEST
 
-                    logger.info(`DHCP收到消息类型 ${packet.msgType} from ${rinfo.address}:${rinfo.port}`);
-
                     switch (packet.msgType) {
                         case DhcpConst.DHCP_MSG_TYPES.DISCOVER:
                             this.handleDiscover(packet, rinfo);
@@ -418,10 +392,8 @@ class DhcpWorker {
                     `DHCP服务器启动成功，监听 0.0.0.0:${listenPort}`
                 );
 
-                // 每60秒检查过期租约
-                this.leaseTimer = setInterval(() => {
-                    this.checkExpiredLeases();
-                }, 60000);
+                this.leaseStore.start();
+                this.flushTimer = setInterval(() => this.flushLeaseEvents(), SETTINGS.flushInterval);
             });
         } catch (err) {
             logger.error(`DHCP服务器启动失败: ${err.message}`);
@@ -430,9 +402,13 @@ class DhcpWorker {
     }
 
     stopDhcp(messageId) {
-        if (this.leaseTimer) {
-            clearInterval(this.leaseTimer);
-            this.leaseTimer = null;
+        if (this.flushTimer) {
+            clearInterval(this.flushTimer);
+            this.flushTimer = null;
+        }
+        if (this.leaseStore) {
+            this.leaseStore.stop();
+            this.leaseStore = null;
         }
 
         if (this.server) {
@@ -440,9 +416,7 @@ class DhcpWorker {
             this.server = null;
         }
 
-        this.leaseMap.clear();
-        this.ipToMac.clear();
-        this.pendingOffers.clear();
+        this.pendingEvents = [];
         this.config = null;
 
         this.messageHandler.sendSuccessResponse(messageId, null, 'DHCP服务器已停止');
@@ -450,53 +424,23 @@ class DhcpWorker {
 
     getLeaseList(messageId) {
         const leases = [];
-        this.leaseMap.forEach(lease => {
-            leases.push(lease.getInfo());
-        });
+        if (this.leaseStore) {
+            this.leaseStore.forEachLease(lease => {
+                leases.push(lease.getInfo());
+            });
+        }
         this.messageHandler.sendSuccessResponse(messageId, leases, '获取租约列表成功');
     }
 
     releaseLease(messageId, macAddr) {
-        if (this.leaseMap.has(macAddr)) {
-            const lease = this.leaseMap.get(macAddr);
-            const ip = lease.ip;
-            this.leaseMap.delete(macAddr);
-            this.ipToMac.delete(ip);
-
-            this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
-                type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { macAddr, ip }
-            });
-
+        const lease = this.leaseStore ? this.leaseStore.release(macAddr) : null;
+        if (lease) {
+            this.queueLeaseEvent('remove', lease);
             this.messageHandler.sendSuccessResponse(messageId, null, `租约 ${macAddr} 已释放`);
         } else {
             this.messageHandler.sendErrorResponse(messageId, `未找到 ${macAddr} 的租约`);
         }
     }
-
-    checkExpiredLeases() {
-        const expired = [];
-        this.leaseMap.forEach((lease, macAddr) => {
-            if (lease.isExpired()) {
-                expired.push(macAddr);
-            }
-        });
-
-        expired.forEach(macAddr => {
-            const lease = this.leaseMap.get(macAddr);
-            const ip = lease.ip;
-            this.leaseMap.delete(macAddr);
-            this.ipToMac.delete(ip);
-            logger.info(`DHCP: 租约过期: ${macAddr} -> ${ip}`);
-
-            this.messageHandler.sendEvent(DhcpConst.DHCP_EVT_TYPES.DHCP_EVT, {
-                type: DhcpConst.DHCP_SUB_EVT_TYPES.DHCP_SUB_EVT_LEASE,
-                opType: 'remove',
-                data: { macAddr, ip }
-            });
-        });
-    }
 }
 
 new DhcpWorker();
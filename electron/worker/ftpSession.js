@@ -2,6 +2,7 @@ const logger = require('../log/logger');
 const path = require('path');
 const fs = require('fs');
 const FtpConst = require('../const/ftpConst');
+const SETTINGS = FtpConst.DEFAULT_FTP_SETTINGS;
 class FtpSession {
     constructor(messageHandler, ftpWorker) {
         this.socket = null;
@@ -26,6 +27,11 @@ class FtpSession {
         this.dataSocket = null;
         this.transferType = 'ascii'; // default to ASCII
         this.connectedTime = new Date();
+
+        // 传输统计
+        this.transferCount = 0;
+        this.transferredBytes = 0;
+        this.lastThroughput = 0; // 最近一次传输的速率(字节/秒)
     }
 
     static makeKey(localIp, localPort, remoteIp, remotePort) {
@@ -413,9 +419,9 @@ class FtpSession {
 
                 this.createDataConnection()
                     .then(socket => {
-                        const stream = fs.createReadStream(fullPath);
+                        const startAt = process.hrtime.bigint();
 
-                        stream.on('error', err => {
+                        const onReadError = err => {
                             logger.error(`File read error: ${err.message}`);
                             socket.end();
                             this.sendMsg(Buffer.from('550 Failed to read file'));
@@ -427,22 +433,37 @@ class FtpSession {
                                 error: err.message,
                                 clientInfo: this.getClientInfo()
                             });
-                        });
-
-                        stream.pipe(socket);
+                        };
 
                         socket.on('close', () => {
                             this.sendMsg(Buffer.from('226 Transfer complete'));
                             this.closeDataConnection();
+                            const stat = this.recordTransfer('download', filePath, socket.bytesWritten, startAt);
 
                             // Send file transfer complete event
                             this.messageHandler.sendEvent(FtpConst.FTP_EVT_TYPES.FILE_TRANSFER_COMPLETE, {
                                 type: 'download',
                                 filename: filePath,
                                 size: stats.size,
+                                ...stat,
                                 clientInfo: this.getClientInfo()
                             });
                         });
+
+                        this.ftpWorker.fileCache
+                            .get(fullPath, stats)
+                            .then(data => {
+                                if (data) {
+                                    this.sendBuffer(socket, data);
+                                    return;
+                                }
+                                const stream = fs.createReadStream(fullPath, {
+                                    highWaterMark: SETTINGS.transferChunkSize
+                                });
+                                stream.on('error', onReadError);
+                                stream.pipe(socket);
+                            })
+                            .catch(onReadError);
                     })
                     .catch(err => {
                         logger.error(`Data connection error: ${err.message}`);
@@ -476,19 +497,47 @@ class FtpSession {
 
             this.createDataConnection()
                 .then(socket => {
-                    const stream = fs.createWriteStream(fullPath);
+                    const startAt = process.hrtime.bigint();
+                    const fileCache = this.ftpWorker.fileCache;
+                    fileCache.invalidate(fullPath);
+                    const stream = fs.createWriteStream(fullPath, { highWaterMark: SETTINGS.transferChunkSize });
 
                     stream.on('error', err => {
                         logger.error(`File write error: ${err.message}`);
                         socket.end();
                         this.sendMsg(Buffer.from('550 Failed to write file'));
+                        this.closeDataConnection();
                     });
 
                     socket.pipe(stream);
 
-                    socket.on('close', () => {
+                    // 客户端发完数据后正常关闭连接才有 end 事件
+                    let completed = false;
+                    socket.on('end', () => {
+                        completed = true;
+                    });
+
+                    // 数据全部写入文件后才回复 226，客户端收到回复后立即读取也能拿到完整文件
+                    stream.on('finish', () => {
+                        fileCache.invalidate(fullPath);
                         this.sendMsg(Buffer.from('226 Transfer complete'));
                         this.closeDataConnection();
+                        this.recordTransfer('upload', filePath, socket.bytesRead, startAt);
+                    });
+
+                    // 连接异常断开时文件不完整，关闭后删除
+                    socket.on('close', () => {
+                        if (completed || stream.destroyed) {
+                            return;
+                        }
+                        logger.error(`Upload of ${filePath} aborted after ${socket.bytesRead} bytes`);
+                        socket.unpipe(stream);
+                        stream.once('close', () => {
+                            fs.unlink(fullPath, () => fileCache.invalidate(fullPath));
+                        });
+                        stream.destroy();
+                        this.sendMsg(Buffer.from('426 Connection closed; transfer aborted'));
+                        this.closeDataConnection();
                     });
                 })
                 .catch(err => {
@@ -498,6 +547,55 @@ class FtpSession {
         });
     }
 
+    /**
+     * 把缓存的文件内容按块写入数据连接，发送缓冲区满时等 drain 再继续
+     */
+    sendBuffer(socket, data) {
+        const chunkSize = SETTINGS.transferChunkSize;
+        let offset = 0;
+
+        const writeMore = () => {
+            while (offset < data.length) {
+                const end = Math.min(offset + chunkSize, data.length);
+                const flushed = socket.write(data.subarray(offset, end));
+                offset = end;
+                if (!flushed) {
+                    socket.once('drain', writeMore);
+                    return;
+                }
+            }
+            socket.end();
+        };
+
+        writeMore();
+    }
+
+    /**
+     * 记录一次传输的字节数和耗时，更新会话统计并通知界面
+     * @returns {object} { bytes, durationMs, throughput }
+     */
+    recordTransfer(type, filename, bytes, startAt) {
+        const durationMs = Number(process.hrtime.bigint() - startAt) / 1e6;
+        const throughput = durationMs > 0 ? Math.round((bytes * 1000) / durationMs) : 0;
+
+        this.transferCount++;
+        this.transferredBytes += bytes;
+        this.lastThroughput = throughput;
+
+        logger.info(
+            `${type} ${filename}: ${bytes} bytes in ${durationMs.toFixed(1)} ms ` +
+                `(${(throughput / 1048576).toFixed(1)} MB/s)`
+        );
+
+        this.messageHandler.sendEvent(FtpConst.FTP_EVT_TYPES.FTP_EVT, {
+            type: FtpConst.FTP_SUB_EVT_TYPES.FTP_SUB_EVT_CONNCET,
+            opType: 'update',
+            data: this.getClientInfo()
+        });
+
+        return { bytes, durationMs, throughput };
+    }
+
     handleDele(filePath) {
         // Delete a file
         const fullPath = path.join(this.ftpWorker.userConfig.rootDir, this.currentDir, filePath);
@@ -514,6 +612,8 @@ class FtpSession {
                     return;
                 }
 
+                this.ftpWorker.fileCache.invalidate(fullPath);
+
                 this.sendMsg(Buffer.from('250 File deleted'));
             });
         });
@@ -635,7 +735,10 @@ class FtpSession {
             username: this.username || '匿名',
             authenticated: this.authenticated,
             status: status,
-            connectedTime: connectedTime
+            connectedTime: connectedTime,
+            transferCount: this.transferCount,
+            transferredBytes: this.transferredBytes,
+            lastThroughput: this.lastThroughput
         };
     }
 }
@@ -4,6 +4,8 @@ const logger = require('../log/logger');
 const WorkerMessageHandler = require('./workerMessageHandler');
 const FtpSession = require('./ftpSession');
 const FtpConst = require('../const/ftpConst');
+const FileCache = require('../utils/fileCache');
+const SETTINGS = FtpConst.DEFAULT_FTP_SETTINGS;
 class FtpWorker {
     constructor() {
         this.server = null;
@@ -14,6 +16,7 @@ class FtpWorker {
         this.userConfig = null; // ftp用户配置数据
 
         this.ftpSessionMap = new Map(); // ftp会话map
+        this.fileCache = new FileCache(SETTINGS.fileCacheMaxFileSize, SETTINGS.fileCacheMaxTotal); // 下载文件缓存
 
         // 创建消息处理器
         this.messageHandler = new WorkerMessageHandler();
@@ -267,6 +270,7 @@ class FtpWorker {
             session.closeSession();
         });
         this.ftpSessionMap.clear();
+        this.fileCache.clear();
         this.messageHandler.sendSuccessResponse(messageId, null, 'ftp协议停止成功');
     }
 
@@ -4,17 +4,68 @@ const WorkerMessageHandler = require('./workerMessageHandler');
 const NtpConst = require('../const/ntpConst');
 
 const NTP_EPOCH_OFFSET_MS = 2208988800000;
+const NTP_EPOCH_OFFSET_SEC = 2208988800;
 const NTP_FRACTION_SCALE = 0x100000000;
 const NTP_SHORT_SCALE = 0x10000;
+const NS_TO_FRACTION = NTP_FRACTION_SCALE / 1e9;
+
+/**
+ * 服务端高精度时钟
+ *
+ * Date.now() 只有毫秒精度。启动时在系统时间跳变的时刻把 process.hrtime() 对齐到系统时间，
+ * 之后按单调时钟推算，写出的 NTP 时间戳带有亚毫秒的小数部分；系统时间被调整时重新对齐。
+ */
+class NtpClock {
+    constructor(offsetMs) {
+        this.offsetMs = offsetMs;
+        this.sync();
+    }
+
+    sync() {
+        // 等到毫秒值刚变化时对齐，误差不超过系统时钟的一次跳变
+        const start = Date.now();
+        let ms = Date.now();
+        while (ms === start) {
+            ms = Date.now();
+        }
+        this.baseHr = process.hrtime();
+        ms += this.offsetMs;
+        this.baseSec = Math.floor(ms / 1000);
+        this.baseNs = Math.round((ms - this.baseSec * 1000) * 1e6);
+    }
+
+    /**
+     * 当前时间(已加上时间偏移)
+     * @returns {number[]} [Unix 秒, 纳秒]
+     */
+    now() {
+        const elapsed = process.hrtime(this.baseHr);
+        let sec = this.baseSec + elapsed[0];
+        let nsec = this.baseNs + elapsed[1];
+        if (nsec >= 1e9) {
+            sec++;
+            nsec -= 1e9;
+        }
+        return [sec, nsec];
+    }
+
+    static toMs(time) {
+        return time[0] * 1000 + time[1] / 1e6;
+    }
 
-function writeTimestamp(buffer, offset, ms) {
-    const ntpMs = ms + NTP_EPOCH_OFFSET_MS;
-    const seconds = Math.floor(ntpMs / 1000);
-    const remainderMs = ntpMs - seconds * 1000;
-    const fraction = Math.floor((remainderMs / 1000) * NTP_FRACTION_SCALE);
+    // 与系统时间相差超过 NTP_CLOCK_RESYNC_MS 时重新对齐
+    checkDrift() {
+        const drift = NtpClock.toMs(this.now()) - (Date.now() + this.offsetMs);
+        if (Math.abs(drift) > NtpConst.DEFAULT_NTP_SETTINGS.clockResyncMs) {
+            logger.warn(`NTP时钟与系统时间相差 ${drift.toFixed(3)} ms，重新对齐`);
+            this.sync();
+        }
+    }
+}
 
-    buffer.writeUInt32BE(seconds >>> 0, offset);
-    buffer.writeUInt32BE(fraction >>> 0, offset + 4);
+function writeTimestamp(buffer, offset, time) {
+    buffer.writeUInt32BE((time[0] + NTP_EPOCH_OFFSET_SEC) >>> 0, offset);
+    buffer.writeUInt32BE(Math.floor(time[1] * NS_TO_FRACTION) >>> 0, offset + 4);
 }
 
 function readTimestamp(buffer, offset) {
@@ -81,9 +132,17 @@ class NtpWorker {
         this.server = null;
         this.ipv6Server = null;
         this.ntpConfig = null;
-        this.requestHistory = [];
-        this.requestCounter = 0;
+        this.clock = null;
+        this.responseTemplate = null; // 响应中每次都相同的字段
+        this.flushTimer = null;
+
+        // 请求日志按环形缓冲区保存原始数据，推送或查询时才格式化
         this.historyLimit = NtpConst.DEFAULT_NTP_SETTINGS.maxHistory;
+        this.history = new Array(this.historyLimit);
+        this.historySize = 0;
+        this.requestCounter = 0;
+        this.flushedCounter = 0; // 已推送到界面的请求
+        this.sendErrors = 0;
 
         this.messageHandler = new WorkerMessageHandler();
         this.messageHandler.init();
@@ -132,18 +191,23 @@ class NtpWorker {
             };
             this.ntpConfig = mergedConfig;
             this.validateConfig(mergedConfig);
-            this.requestHistory = [];
+            this.resetHistory();
             this.requestCounter = 0;
+            this.flushedCounter = 0;
+            this.sendErrors = 0;
+            this.clock = new NtpClock(Number(this.ntpConfig.timeOffsetMs));
+            this.responseTemplate = this.buildResponseTemplate();
 
             await this.startUdp4Server();
             await this.tryStartUdp6Server();
+            this.flushTimer = setInterval(() => this.flushRequests(), NtpConst.DEFAULT_NTP_SETTINGS.flushInterval);
 
             const data = {
                 port: this.ntpConfig.port,
                 stratum: this.ntpConfig.stratum,
                 referenceId: this.ntpConfig.referenceId,
                 timeOffsetMs: this.ntpConfig.timeOffsetMs,
-                requestCount: this.requestHistory.length
+                requestCount: this.historySize
             };
 
             this.messageHandler.sendSuccessResponse(
@@ -165,20 +229,45 @@ class NtpWorker {
         }
     }
 
+    createSocket(type) {
+        return dgram.createSocket({
+            type,
+            reuseAddr: true,
+            recvBufferSize: NtpConst.DEFAULT_NTP_SETTINGS.socketBufferSize,
+            sendBufferSize: NtpConst.DEFAULT_NTP_SETTINGS.socketBufferSize
+        });
+    }
+
+    /**
+     * 响应中 stratum、precision、root delay/dispersion、reference ID 不随请求变化，启动时预先写好
+     */
+    buildResponseTemplate() {
+        const template = Buffer.alloc(48, 0);
+        template.writeUInt8(Number(this.ntpConfig.stratum), 1);
+        template.writeInt8(NtpConst.DEFAULT_NTP_SETTINGS.precision, 3);
+        writeShortFormat(template, 4, this.ntpConfig.rootDelayMs);
+        writeShortFormat(template, 8, this.ntpConfig.rootDispersionMs);
+        sanitizeReferenceId(this.ntpConfig.referenceId).copy(template, 12);
+        return template;
+    }
+
     startUdp4Server() {
         return new Promise((resolve, reject) => {
-            this.server = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+            const socket = this.createSocket('udp4');
+            this.server = socket;
             let listening = false;
 
             this.server.on('message', (msg, rinfo) => {
-                this.handleNtpMessage(msg, rinfo, 'IPv4');
+                this.handleNtpMessage(msg, rinfo, socket, 'IPv4');
             });
 
-            this.server.once('error', err => {
+            this.server.on('error', err => {
                 if (!listening) {
                     reject(err);
                     return;
                 }
+                // 发送不带回调，发送失败也从这里报告
+                this.sendErrors++;
                 logger.error('NTP IPv4 服务器错误:', err);
             });
 
@@ -196,18 +285,20 @@ class NtpWorker {
     async tryStartUdp6Server() {
         try {
             await new Promise((resolve, reject) => {
-                this.ipv6Server = dgram.createSocket({ type: 'udp6', reuseAddr: true });
+                const socket = this.createSocket('udp6');
+                this.ipv6Server = socket;
                 let listening = false;
 
                 this.ipv6Server.on('message', (msg, rinfo) => {
-                    this.handleNtpMessage(msg, rinfo, 'IPv6');
+                    this.handleNtpMessage(msg, rinfo, socket, 'IPv6');
                 });
 
-                this.ipv6Server.once('error', err => {
+                this.ipv6Server.on('error', err => {
                     if (!listening) {
                         reject(err);
                         return;
                     }
+                    this.sendErrors++;
                     logger.error('NTP IPv6 服务器错误:', err);
                 });
 
@@ -229,171 +320,173 @@ class NtpWorker {
         }
     }
 
-    handleNtpMessage(message, rinfo, ipVersion) {
-        const requestReceivedAt = Date.now();
-        const serverClockAtReceive = requestReceivedAt + this.ntpConfig.timeOffsetMs;
+    /**
+     * 处理一个 NTP 请求
+     *
+     * 收到报文后先读时钟作为 T2，发送前再读一次作为 T3。热路径上不打日志、不格式化时间，
+     * 请求记录只保存原始数值，由 flushRequests 定时批量推送到界面。
+     */
+    handleNtpMessage(message, rinfo, socket, ipVersion) {
+        const receiveTime = this.clock.now();
+        const record = {
+            receivedAt: receiveTime,
+            clientAddress: rinfo.address,
+            clientPort: rinfo.port,
+            ipVersion,
+            version: '-',
+            mode: '-',
+            status: 'error',
+            message: '',
+            clientTransmitMs: null,
+            transmitAt: null,
+            packetLength: message.length,
+            leapIndicator: undefined
+        };
 
         try {
             if (message.length < 48) {
-                this.recordRequest({
-                    timestamp: formatTime(requestReceivedAt),
-                    clientAddress: rinfo.address,
-                    clientPort: rinfo.port,
-                    ipVersion,
-                    version: '-',
-                    mode: '-',
-                    modeName: '-',
-                    status: 'error',
-                    message: `报文长度不足 48 字节: ${message.length}`,
-                    originateTime: '-',
-                    receiveTime: '-',
-                    transmitTime: '-',
-                    clientTransmitTime: '-',
-                    packetLength: message.length
-                });
+                record.message = `报文长度不足 48 字节: ${message.length}`;
+                this.recordRequest(record);
                 return;
             }
 
-            const firstByte = message.readUInt8(0);
-            const leapIndicator = firstByte >> 6;
+            const firstByte = message[0];
             const version = (firstByte >> 3) & 0x07;
             const mode = firstByte & 0x07;
-            const clientTransmitMs = readTimestamp(message, 40);
+            record.leapIndicator = firstByte >> 6;
+            record.version = version;
+            record.mode = mode;
+            record.clientTransmitMs = readTimestamp(message, 40);
 
             if (mode !== NtpConst.NTP_MODES.CLIENT) {
-                this.recordRequest({
-                    timestamp: formatTime(requestReceivedAt),
-                    clientAddress: rinfo.address,
-                    clientPort: rinfo.port,
-                    ipVersion,
-                    version,
-                    mode,
-                    modeName: modeName(mode),
-                    status: 'ignored',
-                    message: '仅响应 Client 模式请求',
-                    originateTime: '-',
-                    receiveTime: '-',
-                    transmitTime: '-',
-                    clientTransmitTime: formatTime(clientTransmitMs),
-                    packetLength: message.length,
-                    leapIndicator
-                });
+                record.status = 'ignored';
+                record.message = '仅响应 Client 模式请求';
+                this.recordRequest(record);
                 return;
             }
 
             const responseVersion = version >= 1 && version <= 4 ? version : 4;
-            const response = Buffer.alloc(48, 0);
-            response.writeUInt8((0 << 6) | (responseVersion << 3) | NtpConst.NTP_MODES.SERVER, 0);
-            response.writeUInt8(Number(this.ntpConfig.stratum), 1);
-            response.writeUInt8(message.readUInt8(2), 2);
-            response.writeInt8(NtpConst.DEFAULT_NTP_SETTINGS.precision, 3);
-            writeShortFormat(response, 4, this.ntpConfig.rootDelayMs);
-            writeShortFormat(response, 8, this.ntpConfig.rootDispersionMs);
-            sanitizeReferenceId(this.ntpConfig.referenceId).copy(response, 12);
-            writeTimestamp(response, 16, serverClockAtReceive);
+            const response = Buffer.allocUnsafe(48);
+            this.responseTemplate.copy(response, 0);
+            response[0] = (0 << 6) | (responseVersion << 3) | NtpConst.NTP_MODES.SERVER;
+            response[2] = message[2];
+            writeTimestamp(response, 16, receiveTime);
             message.copy(response, 24, 40, 48);
-            writeTimestamp(response, 32, serverClockAtReceive);
-
-            const responseSocket = ipVersion === 'IPv6' && this.ipv6Server ? this.ipv6Server : this.server;
-            const transmitAt = Date.now() + this.ntpConfig.timeOffsetMs;
-            writeTimestamp(response, 40, transmitAt);
-
-            responseSocket.send(response, 0, response.length, rinfo.port, rinfo.address, err => {
-                if (err) {
-                    logger.error(`NTP响应发送失败 ${rinfo.address}:${rinfo.port}: ${err.message}`);
-                    this.recordRequest({
-                        timestamp: formatTime(requestReceivedAt),
-                        clientAddress: rinfo.address,
-                        clientPort: rinfo.port,
-                        ipVersion,
-                        version: responseVersion,
-                        mode,
-                        modeName: modeName(mode),
-                        status: 'error',
-                        message: '响应发送失败: ' + err.message,
-                        originateTime: formatTime(clientTransmitMs),
-                        receiveTime: formatTime(serverClockAtReceive),
-                        transmitTime: formatTime(transmitAt),
-                        clientTransmitTime: formatTime(clientTransmitMs),
-                        packetLength: message.length,
-                        leapIndicator
-                    });
-                    return;
-                }
+            writeTimestamp(response, 32, receiveTime);
 
-                logger.info(`NTP已响应 ${rinfo.address}:${rinfo.port} version=${responseVersion} mode=${mode}`);
-                this.recordRequest({
-                    timestamp: formatTime(requestReceivedAt),
-                    clientAddress: rinfo.address,
-                    clientPort: rinfo.port,
-                    ipVersion,
-                    version: responseVersion,
-                    mode,
-                    modeName: modeName(mode),
-                    status: 'replied',
-                    message: '已成功响应客户端请求',
-                    originateTime: formatTime(clientTransmitMs),
-                    receiveTime: formatTime(serverClockAtReceive),
-                    transmitTime: formatTime(transmitAt),
-                    clientTransmitTime: formatTime(clientTransmitMs),
-                    packetLength: message.length,
-                    leapIndicator
-                });
-            });
+            const transmitTime = this.clock.now();
+            writeTimestamp(response, 40, transmitTime);
+            socket.send(response, 0, response.length, rinfo.port, rinfo.address);
+
+            record.version = responseVersion;
+            record.status = 'replied';
+            record.message = '已成功响应客户端请求';
+            record.transmitAt = transmitTime;
+            this.recordRequest(record);
         } catch (error) {
             logger.error('处理NTP请求失败:', error);
-            this.recordRequest({
-                timestamp: formatTime(requestReceivedAt),
-                clientAddress: rinfo.address,
-                clientPort: rinfo.port,
-                ipVersion,
-                version: '-',
-                mode: '-',
-                modeName: '-',
-                status: 'error',
-                message: '处理失败: ' + error.message,
-                originateTime: '-',
-                receiveTime: '-',
-                transmitTime: '-',
-                clientTransmitTime: '-',
-                packetLength: message.length
-            });
+            record.version = '-';
+            record.mode = '-';
+            record.message = '处理失败: ' + error.message;
+            this.recordRequest(record);
         }
     }
 
-    recordRequest(entry) {
-        const record = {
-            id: ++this.requestCounter,
-            ...entry
+    recordRequest(record) {
+        record.id = ++this.requestCounter;
+        this.history[(record.id - 1) % this.historyLimit] = record;
+        if (this.historySize < this.historyLimit) {
+            this.historySize++;
+        }
+    }
+
+    resetHistory() {
+        this.history = new Array(this.historyLimit);
+        this.historySize = 0;
+    }
+
+    // 把原始记录格式化为界面展示的字段
+    formatRecord(record) {
+        const offsetMs = Number(this.ntpConfig?.timeOffsetMs) || 0;
+        const replied = record.transmitAt !== null;
+        return {
+            id: record.id,
+            timestamp: formatTime(NtpClock.toMs(record.receivedAt) - offsetMs),
+            clientAddress: record.clientAddress,
+            clientPort: record.clientPort,
+            ipVersion: record.ipVersion,
+            version: record.version,
+            mode: record.mode,
+            modeName: record.mode === '-' ? '-' : modeName(record.mode),
+            status: record.status,
+            message: record.message,
+            originateTime: replied ? formatTime(record.clientTransmitMs) : '-',
+            receiveTime: replied ? formatTime(NtpClock.toMs(record.receivedAt)) : '-',
+            transmitTime: replied ? formatTime(NtpClock.toMs(record.transmitAt)) : '-',
+            clientTransmitTime: record.version === '-' ? '-' : formatTime(record.clientTransmitMs),
+            packetLength: record.packetLength,
+            leapIndicator: record.leapIndicator
         };
-        this.requestHistory.unshift(record);
-        if (this.requestHistory.length > this.historyLimit) {
-            this.requestHistory.length = this.historyLimit;
+    }
+
+    /**
+     * 最近的 count 条请求，新的在前
+     */
+    recentRequests(count) {
+        const list = [];
+        const limit = Math.min(count, this.historySize);
+        for (let i = 0; i < limit; i++) {
+            list.push(this.formatRecord(this.history[(this.requestCounter - 1 - i) % this.historyLimit]));
         }
+        return list;
+    }
+
+    requestStats() {
+        const last = this.historySize > 0 ? this.history[(this.requestCounter - 1) % this.historyLimit] : null;
+        const offsetMs = Number(this.ntpConfig?.timeOffsetMs) || 0;
+        return {
+            requestCount: this.historySize,
+            totalCount: this.requestCounter,
+            sendErrors: this.sendErrors,
+            lastRequestAt: last ? formatTime(NtpClock.toMs(last.receivedAt) - offsetMs) : '-',
+            lastClient: last ? `${last.clientAddress}:${last.clientPort}` : '-'
+        };
+    }
 
+    // 定时把新请求批量推送到界面，顺便检查时钟是否需要重新对齐
+    flushRequests() {
+        this.clock.checkDrift();
+        const pending = this.requestCounter - this.flushedCounter;
+        if (pending === 0) {
+            return;
+        }
+        this.flushedCounter = this.requestCounter;
         this.messageHandler.sendEvent(NtpConst.NTP_EVT_TYPES.NTP_EVT, {
-            type: NtpConst.NTP_SUB_EVT_TYPES.REQUEST_RECEIVED,
-            data: record,
-            stats: {
-                requestCount: this.requestHistory.length,
-                lastRequestAt: record.timestamp,
-                lastClient: `${record.clientAddress}:${record.clientPort}`
-            }
+            type: NtpConst.NTP_SUB_EVT_TYPES.REQUEST_BATCH,
+            data: this.recentRequests(Math.min(pending, NtpConst.DEFAULT_NTP_SETTINGS.batchLimit)),
+            stats: this.requestStats()
         });
     }
 
     getRequestList(messageId) {
-        this.messageHandler.sendSuccessResponse(messageId, this.requestHistory, '获取NTP请求日志成功');
+        this.messageHandler.sendSuccessResponse(
+            messageId,
+            this.recentRequests(this.historySize),
+            '获取NTP请求日志成功'
+        );
     }
 
     clearRequestHistory(messageId) {
-        this.requestHistory = [];
+        this.resetHistory();
+        this.flushedCounter = this.requestCounter;
         this.messageHandler.sendSuccessResponse(messageId, null, 'NTP请求日志已清空');
         this.messageHandler.sendEvent(NtpConst.NTP_EVT_TYPES.NTP_EVT, {
             type: NtpConst.NTP_SUB_EVT_TYPES.HISTORY_CLEARED,
             data: null,
             stats: {
                 requestCount: 0,
+                totalCount: this.requestCounter,
+                sendErrors: this.sendErrors,
                 lastRequestAt: '-',
                 lastClient: '-'
             }
@@ -402,7 +495,7 @@ class NtpWorker {
 
     stopNtp(messageId) {
         this.closeSockets();
-        this.requestHistory = [];
+        this.resetHistory();
         this.messageHandler.sendSuccessResponse(messageId, null, 'NTP服务器已停止');
         this.messageHandler.sendEvent(NtpConst.NTP_EVT_TYPES.NTP_EVT, {
             type: NtpConst.NTP_SUB_EVT_TYPES.SERVER_STATUS,
@@ -419,6 +512,10 @@ class NtpWorker {
     }
 
     async closeSockets() {
+        if (this.flushTimer) {
+            clearInterval(this.flushTimer);
+            this.flushTimer = null;
+        }
         const closeTasks = [];
         if (this.server) {
             closeTasks.push(
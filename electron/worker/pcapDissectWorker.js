@@ -0,0 +1,26 @@
+const { parentPort } = require('worker_threads');
+const fs = require('fs');
+const { PcapIndex } = require('../utils/pcapIndex');
+
+// 处理传入的任务: 解析一段报文的头部，或重组一组 BGP 流，结果直接写在共享内存中
+parentPort.on('message', data => {
+    let fd = null;
+    try {
+        fd = fs.openSync(data.filePath, 'r');
+        const index = PcapIndex.fromShared(data.index);
+        let result;
+        if (data.task === 'dissect') {
+            index.dissectRange(fd, data.start, data.end, data.chunkSize);
+            result = { count: data.end - data.start };
+        } else {
+            result = index.reassembleBgp(fd, data.flows, data.chunkSize, data.maxPending);
+        }
+        parentPort.postMessage({ status: 'success', data: result });
+    } catch (err) {
+        parentPort.postMessage({ status: 'error', msg: `解析抓包文件时出错: ${err.message}` });
+    } finally {
+        if (fd !== null) {
+            fs.closeSync(fd);
+        }
+    }
+});
@@ -0,0 +1,358 @@
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const logger = require('../log/logger');
+const WorkerMessageHandler = require('./workerMessageHandler');
+const WorkerWithPromise = require('./workerWithPromise');
+const { PcapIndex, LINK_TYPE, IP_PROTO, BGP_MESSAGE_FIELDS } = require('../utils/pcapIndex');
+const { seqDiff } = require('../utils/tcpStream');
+const { parseBgpPacket } = require('../pktParser/bgpPacketParser');
+const registry = require('../pktParser/packetParserRegistry');
+const BgpConst = require('../const/bgpConst');
+const { TOOLS_REQ_TYPES, PCAP_INGEST_SETTINGS } = require('../const/toolsConst');
+
+const BGP_TYPE_NAMES = Object.fromEntries(
+    Object.entries(BgpConst.BGP_PACKET_TYPE).map(([name, type]) => [type, name.replace('_', '-')])
+);
+
+/**
+ * 离线抓包文件解析 worker
+ *
+ * 打开文件时分三步建立索引:
+ * 1. 顺序扫描文件格式层面的记录头，得到每个报文的偏移、长度和时间戳
+ * 2. 按报文区间拆给多个子 worker 并行解析网络层和传输层头部，结果直接写进共享内存中的索引列
+ * 3. 按五元组划分流，BGP 端口上的 TCP 流按流拆给子 worker 重组，切分出每条 BGP 报文
+ *
+ * 报文的详细解析树只在界面选中某个报文时才生成。
+ */
+class PcapWorker {
+    constructor() {
+        this.filePath = null;
+        this.fd = null;
+        this.index = null;
+        this.bgpPort = 179;
+
+        // BGP 报文按结束所在的报文排序，第 i 个报文结束的 BGP 报文为 [pktMessageStart[i], pktMessageStart[i + 1])
+        this.messages = null;
+        this.pktMessageStart = null;
+
+        this.messageHandler = new WorkerMessageHandler();
+        this.messageHandler.init();
+        this.messageHandler.registerHandler(TOOLS_REQ_TYPES.OPEN_PCAP, this.openPcap.bind(this));
+        this.messageHandler.registerHandler(TOOLS_REQ_TYPES.GET_PCAP_PACKETS, this.getPackets.bind(this));
+        this.messageHandler.registerHandler(TOOLS_REQ_TYPES.GET_PCAP_PACKET_TREE, this.getPacketTree.bind(this));
+        this.messageHandler.registerHandler(TOOLS_REQ_TYPES.CLOSE_PCAP, this.closePcap.bind(this));
+    }
+
+    async openPcap(messageId, data) {
+        try {
+            this.close();
+            const startTime = Date.now();
+            this.filePath = data.filePath;
+            this.bgpPort = parseInt(data.bgpPort) || 179;
+            this.fd = fs.openSync(this.filePath, 'r');
+
+            const index = PcapIndex.scan(this.fd, PCAP_INGEST_SETTINGS.chunkSize);
+            const workers = Math.max(
+                1,
+                Math.min(
+                    Math.ceil(index.count / PCAP_INGEST_SETTINGS.packetsPerWorker),
+                    PCAP_INGEST_SETTINGS.maxWorkers,
+                    os.cpus().length
+                )
+            );
+            await this.dissect(index, workers);
+
+            const flows = index.assignFlows();
+            const bgpFlows = [];
+            flows.forEach((flow, id) => {
+                const isTcp = index.ipProtos[flow.first] === IP_PROTO.TCP;
+                if (isTcp && (flow.srcPort === this.bgpPort || flow.dstPort === this.bgpPort)) {
+                    bgpFlows.push({ id, first: flow.first, last: flow.last, count: flow.count });
+                }
+            });
+            const messageCount = await this.reassemble(index, bgpFlows, workers);
+            this.index = index;
+
+            const elapsed = Date.now() - startTime;
+            logger.info(
+                `打开抓包文件 ${this.filePath}: ${index.count} 个报文, ${flows.length} 条流, ` +
+                    `${bgpFlows.length} 条 BGP 流, ${messageCount} 条 BGP 报文, ${workers} 个 worker, 耗时 ${elapsed}ms`
+            );
+            this.messageHandler.sendSuccessResponse(
+                messageId,
+                {
+                    filePath: this.filePath,
+                    packetCount: index.count,
+                    flowCount: flows.length,
+                    bgpFlowCount: bgpFlows.length,
+                    bgpMessageCount: messageCount,
+                    elapsed
+                },
+                '打开抓包文件成功'
+            );
+        } catch (err) {
+            logger.error('打开抓包文件失败:', err.message);
+            this.close();
+            this.messageHandler.sendErrorResponse(messageId, `打开抓包文件失败: ${err.message}`);
+        }
+    }
+
+    runTask(task) {
+        const workerPath = path.join(__dirname, 'pcapDissectWorker.js');
+        const workerFactory = new WorkerWithPromise(workerPath);
+        return workerFactory.runWorkerWithPromise(workerPath, {
+            ...task,
+            filePath: this.filePath,
+            chunkSize: PCAP_INGEST_SETTINGS.chunkSize
+        });
+    }
+
+    // 第二步: 把报文平均分成 workers 段并行解析头部
+    async dissect(index, workers) {
+        if (workers === 1) {
+            index.dissectRange(this.fd, 0, index.count, PCAP_INGEST_SETTINGS.chunkSize);
+            return;
+        }
+        const shared = index.share();
+        const step = Math.ceil(index.count / workers);
+        const tasks = [];
+        for (let start = 0; start < index.count; start += step) {
+            tasks.push(
+                this.runTask({ task: 'dissect', index: shared, start, end: Math.min(start + step, index.count) })
+            );
+        }
+        await Promise.all(tasks);
+    }
+
+    // 第三步: 按报文数把 BGP 流分组后并行重组，再把结果按结束报文排序
+    async reassemble(index, bgpFlows, workers) {
+        const groupCount = Math.min(workers, bgpFlows.length);
+        let results;
+        if (groupCount <= 1) {
+            results = [
+                index.reassembleBgp(
+                    this.fd,
+                    bgpFlows,
+                    PCAP_INGEST_SETTINGS.chunkSize,
+                    PCAP_INGEST_SETTINGS.maxPendingSegments
+                )
+            ];
+        } else {
+            // 报文多的流优先分给当前最空闲的组
+            const groups = Array.from({ length: groupCount }, () => ({ flows: [], packets: 0 }));
+            for (const flow of [...bgpFlows].sort((a, b) => b.count - a.count)) {
+                const group = groups.reduce((min, cur) => (cur.packets < min.packets ? cur : min));
+                group.flows.push(flow);
+                group.packets += flow.count;
+            }
+            const shared = index.share();
+            results = await Promise.all(
+                groups.map(group =>
+                    this.runTask({
+                        task: 'reassemble',
+                        index: shared,
+                        flows: group.flows,
+                        maxPending: PCAP_INGEST_SETTINGS.maxPendingSegments
+                    })
+                )
+            );
+        }
+
+        // 按结束报文做计数排序，同一报文内的 BGP 报文来自同一条流，保持原有顺序
+        let total = 0;
+        const starts = new Uint32Array(index.count + 1);
+        const lists = results.map(result => new Uint32Array(result.buffer, 0, result.count * BGP_MESSAGE_FIELDS));
+        for (const list of lists) {
+            for (let at = 0; at < list.length; at += BGP_MESSAGE_FIELDS) {
+                starts[list[at] + 1]++;
+            }
+            total += list.length / BGP_MESSAGE_FIELDS;
+        }
+        for (let i = 0; i < index.count; i++) {
+            starts[i + 1] += starts[i];
+        }
+        const messages = new Uint32Array(total * BGP_MESSAGE_FIELDS);
+        const cursor = starts.slice(0, index.count);
+        for (const list of lists) {
+            for (let at = 0; at < list.length; at += BGP_MESSAGE_FIELDS) {
+                const dst = cursor[list[at]]++ * BGP_MESSAGE_FIELDS;
+                messages.set(list.subarray(at, at + BGP_MESSAGE_FIELDS), dst);
+            }
+        }
+        this.messages = messages;
+        this.pktMessageStart = starts;
+        return total;
+    }
+
+    close() {
+        if (this.fd !== null) {
+            fs.closeSync(this.fd);
+        }
+        this.fd = null;
+        this.index = null;
+        this.messages = null;
+        this.pktMessageStart = null;
+    }
+
+    closePcap(messageId) {
+        this.close();
+        this.messageHandler.sendSuccessResponse(messageId, null, '关闭抓包文件成功');
+    }
+
+    /**
+     * 第 i 个报文中结束的 BGP 报文
+     */
+    bgpMessagesOf(i) {
+        const list = [];
+        for (let m = this.pktMessageStart[i]; m < this.pktMessageStart[i + 1]; m++) {
+            const at = m * BGP_MESSAGE_FIELDS;
+            list.push({
+                lastPkt: this.messages[at],
+                firstPkt: this.messages[at + 1],
+                startSeq: this.messages[at + 2],
+                length: this.messages[at + 3],
+                type: this.messages[at + 4]
+            });
+        }
+        return list;
+    }
+
+    /**
+     * 分页获取报文摘要
+     * @param {Object} data { start, count }
+     */
+    getPackets(messageId, data) {
+        if (!this.index) {
+            this.messageHandler.sendErrorResponse(messageId, '没有打开的抓包文件');
+            return;
+        }
+        const start = Math.max(0, data.start || 0);
+        const end = Math.min(this.index.count, start + Math.min(data.count || 0, PCAP_INGEST_SETTINGS.pageSize));
+        const packets = [];
+        for (let i = start; i < end; i++) {
+            const item = this.index.summary(i);
+            const messages = this.bgpMessagesOf(i);
+            if (messages.length > 0) {
+                item.protocol = 'BGP';
+                item.info = messages.map(message => BGP_TYPE_NAMES[message.type] || `TYPE ${message.type}`).join(', ');
+            }
+            packets.push(item);
+        }
+        this.messageHandler.sendSuccessResponse(messageId, { total: this.index.count, packets }, '获取报文成功');
+    }
+
+    /**
+     * 生成报文的详细解析树
+     *
+     * 链路层到传输层由解析器注册表逐层解析，在该报文中结束的 BGP 报文追加在后面:
+     * 整条都在本报文中的直接按原偏移解析；跨报文的先沿流重新拼出完整报文再解析，
+     * 子节点的偏移换算回本报文，不在本报文中的部分不做高亮。
+     * @param {Object} data { id } 报文编号，从 1 开始
+     */
+    getPacketTree(messageId, data) {
+        const index = this.index;
+        const i = (data.id || 0) - 1;
+        if (!index || i < 0 || i >= index.count) {
+            this.messageHandler.sendErrorResponse(messageId, '报文不存在');
+            return;
+        }
+
+        try {
+            const buffer = index.readPacket(this.fd, i);
+            const tree = {
+                name: `Frame ${i + 1}: ${index.origLens[i]} bytes on wire, ${buffer.length} bytes captured`,
+                offset: 0,
+                length: buffer.length,
+                value: '',
+                children: []
+            };
+            const result = this.parseLinkLayer(index.linkTypes[i], tree, buffer);
+
+            for (const message of this.bgpMessagesOf(i)) {
+                this.appendBgpMessage(tree, buffer, i, message);
+            }
+            this.messageHandler.sendSuccessResponse(
+                messageId,
+                { packetData: buffer.toString('hex'), tree, error: result.valid ? null : result.error },
+                '解析报文成功'
+            );
+        } catch (err) {
+            logger.error('解析报文失败:', err.message);
+            this.messageHandler.sendErrorResponse(messageId, `解析报文失败: ${err.message}`);
+        }
+    }
+
+    parseLinkLayer(linkType, tree, buffer) {
+        const pseudoHeader = (name, length) => {
+            tree.children.push({ name, offset: 0, length, value: '', children: [] });
+        };
+        const ipType = offset => (buffer[offset] >> 4 === 6 ? 0x86dd : 0x0800);
+        const parseNetwork = (etherType, offset) =>
+            registry.parse(etherType === 0x0806 ? 'arp' : 'ip', etherType, tree, buffer, offset);
+
+        switch (linkType) {
+            case LINK_TYPE.ETHERNET:
+                return registry.parse('ethernet', 0, tree, buffer, 0);
+            case LINK_TYPE.RAW:
+            case LINK_TYPE.IPV4:
+            case LINK_TYPE.IPV6:
+                return registry.parse('ip', ipType(0), tree, buffer, 0);
+            case LINK_TYPE.NULL:
+            case LINK_TYPE.LOOP:
+                pseudoHeader('Null/Loopback', 4);
+                return registry.parse('ip', ipType(4), tree, buffer, 4);
+            case LINK_TYPE.LINUX_SLL:
+                pseudoHeader('Linux cooked capture v1', 16);
+                return parseNetwork(buffer.readUInt16BE(14), 16);
+            case LINK_TYPE.LINUX_SLL2:
+                pseudoHeader('Linux cooked capture v2', 20);
+                return parseNetwork(buffer.readUInt16BE(0), 20);
+            default:
+                return { valid: false, error: `不支持的链路类型: ${linkType}` };
+        }
+    }
+
+    appendBgpMessage(tree, buffer, i, message) {
+        const index = this.index;
+        const payloadStart = index.payloadOffsets[i];
+        const payloadEnd = payloadStart + index.payloadLengths[i];
+        // BGP 报文首字节在本报文中的下标，跨报文时可能落在本报文之外
+        const start = payloadStart + seqDiff(message.startSeq, index.tcpSeqs[i]);
+
+        if (message.firstPkt === i && start >= payloadStart && start + message.length <= payloadEnd) {
+            parseBgpPacket(buffer.subarray(0, start + message.length), tree, start);
+            return;
+        }
+
+        const data = index.collectStream(this.fd, message.firstPkt, i, message.startSeq, message.length);
+        if (!data) {
+            tree.children.push({
+                name: `BGP Packet (${message.length} bytes, 重组失败)`,
+                offset: 0,
+                length: 0,
+                value: '',
+                children: []
+            });
+            return;
+        }
+
+        const reassembled = { children: [] };
+        parseBgpPacket(data, reassembled, 0);
+        // 重组报文中的下标 o 对应本报文中的下标 start + o
+        const relocate = node => {
+            const from = Math.max(node.offset + start, payloadStart);
+            const to = Math.min(node.offset + node.length + start, payloadEnd);
+            node.offset = to > from ? from : 0;
+            node.length = to > from ? to - from : 0;
+            (node.children || []).forEach(relocate);
+        };
+        for (const node of reassembled.children) {
+            relocate(node);
+            node.name += ` (${message.length} bytes, 重组自报文 #${message.firstPkt + 1} - #${i + 1})`;
+            tree.children.push(node);
+        }
+    }
+}
+
+new PcapWorker(); // 启动监听
@@ -0,0 +1,283 @@
+const logger = require('../log/logger');
+const RpkiConst = require('../const/rpkiConst');
+const BgpConst = require('../const/bgpConst');
+const { ipToBytes } = require('../utils/ipUtils');
+
+const IPV4_PREFIX_PDU_LENGTH = RpkiConst.RPKI_HEADER_LENGTH + 12;
+const IPV6_PREFIX_PDU_LENGTH = RpkiConst.RPKI_HEADER_LENGTH + 24;
+const PREFIX_PDU_FLAGS_OFFSET = RpkiConst.RPKI_HEADER_LENGTH;
+
+/**
+ * RPKI-RTR 缓存
+ *
+ * 所有 router 会话共享同一个 Session ID 和序列号。每个 ROA 只编码一次 Prefix PDU 模板，
+ * 全量快照（Cache Response + Prefix PDUs + End of Data）以及每个序列号的增量都保存在连续的
+ * Buffer 中，按协议版本惰性构建并缓存，N 个 router 的应答就是 N 次对同一个 Buffer 的 write。
+ */
+class RpkiCache {
+    constructor(maxDeltas = RpkiConst.RPKI_CACHE_MAX_DELTAS) {
+        this.sessionId = Math.floor(Math.random() * 65536);
+        this.serial = 0;
+        this.maxDeltas = maxDeltas;
+
+        this.pduMap = new Map(); // roa key -> 公告 Prefix PDU 模板（version 0）
+        this.pendingChanges = new Map(); // 未提交的变化: roa key -> { announce, pdu }
+        this.deltas = []; // [{ serial, changes: Map(roa key -> { announce, pdu }) }]，按序列号递增
+
+        this.snapshotCache = new Map(); // version -> 全量应答
+        this.deltaCache = new Map(); // `${version}|${fromSerial}` -> 增量应答
+        this.notifyCache = new Map(); // version -> Serial Notify
+    }
+
+    static encodePrefixPdu(rpkiRoa) {
+        const isIpv4 = rpkiRoa.ipType === BgpConst.IP_TYPE.IPV4;
+        const length = isIpv4 ? IPV4_PREFIX_PDU_LENGTH : IPV6_PREFIX_PDU_LENGTH;
+        const addrLength = isIpv4 ? 4 : 16;
+        const buffer = Buffer.alloc(length);
+
+        let position = 0;
+        buffer[position++] = RpkiConst.RPKI_PROTOCOL_VERSION.V0; // Version
+        buffer[position++] = isIpv4 ? RpkiConst.RPKI_MSG_TYPE.IPV4_PREFIX : RpkiConst.RPKI_MSG_TYPE.IPV6_PREFIX;
+        buffer.writeUInt16BE(0, position); // Reserved
+        position += 2;
+        buffer.writeUInt32BE(length, position); // Length
+        position += 4;
+
+        buffer[position++] = RpkiConst.RPKI_FLAGS.UPDATE; // Flags
+        buffer[position++] = rpkiRoa.mask; // Prefix Length
+        buffer[position++] = rpkiRoa.maxLength; // Max Length
+        buffer[position++] = 0; // Padding
+
+        const ipBytesArray = ipToBytes(rpkiRoa.ip);
+        for (let i = 0; i < addrLength; i++) {
+            buffer[position + i] = ipBytesArray[i];
+        }
+        position += addrLength;
+
+        buffer.writeUInt32BE(rpkiRoa.asn, position); // ASN
+
+        return buffer;
+    }
+
+    static encodeCacheResponse(version, sessionId) {
+        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH);
+        buffer[0] = version;
+        buffer[1] = RpkiConst.RPKI_MSG_TYPE.CACHE_RESPONSE;
+        buffer.writeUInt16BE(sessionId, 2);
+        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH, 4);
+        return buffer;
+    }
+
+    static encodeEndOfData(version, sessionId, serial) {
+        const length =
+            version > RpkiConst.RPKI_PROTOCOL_VERSION.V0
+                ? RpkiConst.RPKI_HEADER_LENGTH + 16
+                : RpkiConst.RPKI_HEADER_LENGTH + 4;
+        const buffer = Buffer.alloc(length);
+        buffer[0] = version;
+        buffer[1] = RpkiConst.RPKI_MSG_TYPE.END_OF_DATA;
+        buffer.writeUInt16BE(sessionId, 2);
+        buffer.writeUInt32BE(length, 4);
+        buffer.writeUInt32BE(serial, RpkiConst.RPKI_HEADER_LENGTH);
+        if (version > RpkiConst.RPKI_PROTOCOL_VERSION.V0) {
+            buffer.writeUInt32BE(RpkiConst.RPKI_REFRESH_INTERVAL, RpkiConst.RPKI_HEADER_LENGTH + 4);
+            buffer.writeUInt32BE(RpkiConst.RPKI_RETRY_INTERVAL, RpkiConst.RPKI_HEADER_LENGTH + 8);
+            buffer.writeUInt32BE(RpkiConst.RPKI_EXPIRE_INTERVAL, RpkiConst.RPKI_HEADER_LENGTH + 12);
+        }
+        return buffer;
+    }
+
+    static encodeSerialNotify(version, sessionId, serial) {
+        const length = RpkiConst.RPKI_HEADER_LENGTH + 4;
+        const buffer = Buffer.alloc(length);
+        buffer[0] = version;
+        buffer[1] = RpkiConst.RPKI_MSG_TYPE.SERIAL_NOTIFY;
+        buffer.writeUInt16BE(sessionId, 2);
+        buffer.writeUInt32BE(length, 4);
+        buffer.writeUInt32BE(serial, RpkiConst.RPKI_HEADER_LENGTH);
+        return buffer;
+    }
+
+    // 将 PDU 模板拷贝到目标 Buffer，并修正版本号和公告/撤销标志
+    static copyPdu(pdu, target, offset, version, announce) {
+        pdu.copy(target, offset);
+        target[offset] = version;
+        target[offset + PREFIX_PDU_FLAGS_OFFSET] = announce ? RpkiConst.RPKI_FLAGS.UPDATE : RpkiConst.RPKI_FLAGS.WITHDRAWAL;
+        return offset + pdu.length;
+    }
+
+    static nextSerial(serial) {
+        return (serial + 1) >>> 0;
+    }
+
+    get size() {
+        return this.pduMap.size;
+    }
+
+    addRoa(key, rpkiRoa) {
+        if (this.pduMap.has(key)) {
+            return false;
+        }
+        const pdu = RpkiCache.encodePrefixPdu(rpkiRoa);
+        this.pduMap.set(key, pdu);
+        this.recordChange(key, true, pdu);
+        return true;
+    }
+
+    deleteRoa(key) {
+        const pdu = this.pduMap.get(key);
+        if (!pdu) {
+            return false;
+        }
+        this.pduMap.delete(key);
+        this.recordChange(key, false, pdu);
+        return true;
+    }
+
+    recordChange(key, announce, pdu) {
+        const pending = this.pendingChanges.get(key);
+        // 同一批次内先加后删（或先删后加）相互抵消
+        if (pending && pending.announce !== announce) {
+            this.pendingChanges.delete(key);
+            return;
+        }
+        this.pendingChanges.set(key, { announce, pdu });
+    }
+
+    hasPendingChanges() {
+        return this.pendingChanges.size > 0;
+    }
+
+    /**
+     * 提交未提交的变化，生成新的序列号
+     * @returns {boolean} 序列号是否发生变化
+     */
+    commit() {
+        if (this.pendingChanges.size === 0) {
+            return false;
+        }
+
+        this.serial = RpkiCache.nextSerial(this.serial);
+        this.deltas.push({ serial: this.serial, changes: this.pendingChanges });
+        if (this.deltas.length > this.maxDeltas) {
+            this.deltas.shift();
+        }
+        this.pendingChanges = new Map();
+
+        this.snapshotCache.clear();
+        this.deltaCache.clear();
+        this.notifyCache.clear();
+
+        logger.info(`RPKI cache serial ${this.serial}: ${this.pduMap.size} ROAs, ${this.deltas.length} deltas retained`);
+        return true;
+    }
+
+    getSerialNotify(version) {
+        let notify = this.notifyCache.get(version);
+        if (!notify) {
+            notify = RpkiCache.encodeSerialNotify(version, this.sessionId, this.serial);
+            this.notifyCache.set(version, notify);
+        }
+        return notify;
+    }
+
+    /**
+     * 获取全量应答（Reset Query）
+     */
+    getSnapshot(version) {
+        let snapshot = this.snapshotCache.get(version);
+        if (snapshot) {
+            return snapshot;
+        }
+
+        const cacheResponse = RpkiCache.encodeCacheResponse(version, this.sessionId);
+        const endOfData = RpkiCache.encodeEndOfData(version, this.sessionId, this.serial);
+
+        let length = cacheResponse.length + endOfData.length;
+        for (const pdu of this.pduMap.values()) {
+            length += pdu.length;
+        }
+
+        snapshot = Buffer.allocUnsafe(length);
+        let offset = cacheResponse.copy(snapshot, 0);
+        for (const pdu of this.pduMap.values()) {
+            offset = RpkiCache.copyPdu(pdu, snapshot, offset, version, true);
+        }
+        endOfData.copy(snapshot, offset);
+
+        this.snapshotCache.set(version, snapshot);
+        return snapshot;
+    }
+
+    /**
+     * 获取从 fromSerial 到当前序列号的增量应答（Serial Query）
+     * @returns {Buffer|null} 历史不足以计算增量时返回 null，此时应回复 Cache Reset
+     */
+    getDelta(version, fromSerial) {
+        const cacheKey = `${version}|${fromSerial}`;
+        let delta = this.deltaCache.get(cacheKey);
+        if (delta) {
+            return delta;
+        }
+
+        let start;
+        if (fromSerial === this.serial) {
+            start = this.deltas.length;
+        } else {
+            start = this.deltas.findIndex(item => item.serial === RpkiCache.nextSerial(fromSerial));
+            if (start < 0) {
+                return null;
+            }
+        }
+
+        // 合并多个序列号的变化：只保留相对 fromSerial 有净变化的 ROA
+        const merged = new Map();
+        for (let i = start; i < this.deltas.length; i++) {
+            for (const [key, change] of this.deltas[i].changes) {
+                const prev = merged.get(key);
+                if (prev && prev.announce !== change.announce) {
+                    merged.delete(key);
+                } else {
+                    merged.set(key, change);
+                }
+            }
+        }
+
+        const cacheResponse = RpkiCache.encodeCacheResponse(version, this.sessionId);
+        const endOfData = RpkiCache.encodeEndOfData(version, this.sessionId, this.serial);
+
+        let length = cacheResponse.length + endOfData.length;
+        for (const change of merged.values()) {
+            length += change.pdu.length;
+        }
+
+        delta = Buffer.allocUnsafe(length);
+        let offset = cacheResponse.copy(delta, 0);
+        // 先撤销后公告，避免 router 在中间状态看到重复的覆盖
+        for (const change of merged.values()) {
+            if (!change.announce) {
+                offset = RpkiCache.copyPdu(change.pdu, delta, offset, version, false);
+            }
+        }
+        for (const change of merged.values()) {
+            if (change.announce) {
+                offset = RpkiCache.copyPdu(change.pdu, delta, offset, version, true);
+            }
+        }
+        endOfData.copy(delta, offset);
+
+        this.deltaCache.set(cacheKey, delta);
+        return delta;
+    }
+
+    clear() {
+        this.pduMap.clear();
+        this.pendingChanges.clear();
+        this.deltas = [];
+        this.snapshotCache.clear();
+        this.deltaCache.clear();
+        this.notifyCache.clear();
+    }
+}
+
+module.exports = RpkiCache;
@@ -1,3 +1,6 @@
+const ipaddr = require('ipaddr.js');
+const BgpConst = require('../const/bgpConst');
+
 class RpkiRoa {
     constructor(ip, mask, asn, maxLength, ipType) {
         this.ip = ip;
@@ -11,6 +14,34 @@ class RpkiRoa {
         return `${ip}|${mask}|${asn}|${maxLength}`;
     }
 
+    /**
+     * 检查 ROA 能否编码为 Prefix PDU
+     * @returns {string|null} 错误原因，有效时返回 null
+     */
+    static validate(roa) {
+        const isIpv4 = roa.ipType === BgpConst.IP_TYPE.IPV4;
+        if (!isIpv4 && roa.ipType !== BgpConst.IP_TYPE.IPV6) {
+            return `地址类型无效: ${roa.ipType}`;
+        }
+        if (typeof roa.ip !== 'string' || !(isIpv4 ? ipaddr.IPv4 : ipaddr.IPv6).isValid(roa.ip)) {
+            return `地址无效: ${roa.ip}`;
+        }
+        const hostLen = isIpv4 ? BgpConst.IP_HOST_LEN : BgpConst.IPV6_HOST_LEN;
+        const mask = Number(roa.mask);
+        const maxLength = Number(roa.maxLength);
+        const asn = Number(roa.asn);
+        if (!Number.isInteger(mask) || mask < 0 || mask > hostLen) {
+            return `掩码无效: ${roa.mask}`;
+        }
+        if (!Number.isInteger(maxLength) || maxLength < mask || maxLength > hostLen) {
+            return `最大长度无效: ${roa.maxLength}`;
+        }
+        if (!Number.isInteger(asn) || asn < 0 || asn > 0xffffffff) {
+            return `AS 号无效: ${roa.asn}`;
+        }
+        return null;
+    }
+
     static parseKey(key) {
         const [ip, mask, asn, maxLength] = key.split('|');
         return { ip, mask, asn, maxLength };
@@ -1,7 +1,5 @@
 const logger = require('../log/logger');
 const RpkiConst = require('../const/rpkiConst');
-const BgpConst = require('../const/bgpConst');
-const { ipToBytes } = require('../utils/ipUtils');
 class RpkiSession {
     constructor(messageHandler, rpkiWorker) {
         this.socket = null;
@@ -14,6 +12,7 @@ class RpkiSession {
         this.messageBuffer = Buffer.alloc(0);
         this.sessionId = null;
         this.protocolVersion = RpkiConst.RPKI_PROTOCOL_VERSION.V0;
+        this.synced = false; // 是否已完成一次 Reset Query，完成后才发送 Serial Notify
     }
 
     static makeKey(localIp, localPort, remoteIp, remotePort) {
@@ -35,6 +34,9 @@ class RpkiSession {
             );
 
             switch (header.type) {
+                case RpkiConst.RPKI_MSG_TYPE.SERIAL_QUERY:
+                    this.handleSerialQuery(header, message);
+                    break;
                 case RpkiConst.RPKI_MSG_TYPE.RESET_QUERY:
                     this.handleResetQuery(header, message);
                     break;
@@ -116,15 +118,48 @@ class RpkiSession {
     handleResetQuery(header, _message) {
         this.protocolVersion = header.version;
         if (this.protocolVersion === RpkiConst.RPKI_PROTOCOL_VERSION.V0) {
-            this.sendCacheResponse();
-            this.sendRoaData();
-            this.sendEndOfData();
+            const rpkiCache = this.rpkiWorker.rpkiCache;
+            this.sessionId = rpkiCache.sessionId;
+            this.sendMessage(rpkiCache.getSnapshot(this.protocolVersion));
+            this.synced = true;
         } else {
             logger.error(`Unsupported protocol version: ${this.protocolVersion}`);
             this.sendError(RpkiConst.RPKI_ERROR_CODE.UNSUPPORTED_PROTOCOL_VERSION);
         }
     }
 
+    handleSerialQuery(header, message) {
+        if (header.version !== RpkiConst.RPKI_PROTOCOL_VERSION.V0) {
+            logger.error(`Unsupported protocol version: ${header.version}`);
+            this.sendError(RpkiConst.RPKI_ERROR_CODE.UNSUPPORTED_PROTOCOL_VERSION);
+            return;
+        }
+        this.protocolVersion = header.version;
+
+        // Serial Query 为头部加 4 字节的 Serial Number
+        if (message.length < RpkiConst.RPKI_HEADER_LENGTH + 4) {
+            logger.error(`Serial Query too short: ${message.length} bytes`);
+            this.sendError(RpkiConst.RPKI_ERROR_CODE.CORRUPT_DATA);
+            return;
+        }
+
+        const rpkiCache = this.rpkiWorker.rpkiCache;
+        const sessionId = header.reserved;
+        const serial = message.readUInt32BE(RpkiConst.RPKI_HEADER_LENGTH);
+        logger.info(`Serial Query: session ${sessionId}, serial ${serial}, cache serial ${rpkiCache.serial}`);
+
+        // Session ID 不一致或增量历史已淘汰，要求 router 重新做 Reset Query
+        const delta = sessionId === rpkiCache.sessionId ? rpkiCache.getDelta(this.protocolVersion, serial) : null;
+        if (!delta) {
+            this.sendCacheReset();
+            return;
+        }
+
+        this.sessionId = rpkiCache.sessionId;
+        this.sendMessage(delta);
+        this.synced = true;
+    }
+
     handleCacheResponse(message) {
         logger.info(`Handling Cache Response message`);
         this.sessionId = message.readUInt16BE(RpkiConst.RPKI_HEADER_LENGTH);
@@ -282,205 +317,11 @@ class RpkiSession {
         this.sendMessage(buffer);
     }
 
-    sendCacheResponse() {
-        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH);
-
-        buffer[0] = this.protocolVersion; // Version
-        buffer[1] = RpkiConst.RPKI_MSG_TYPE.CACHE_RESPONSE; // Type
-        if (!this.sessionId) {
-            this.sessionId = Math.floor(Math.random() * 65536);
-        }
-        buffer.writeUInt16BE(this.sessionId, 2);
-        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH, 4); // Length
-
-        this.sendMessage(buffer);
-    }
-
-    sendIPv4Prefix(rpkiRoa) {
-        // Header + Flags(1) + PrefixLength(1) + MaxLength(1) + Padding(1) + ASN(4) + Prefix(4)
-        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 12);
-
-        let position = 0;
-
-        buffer[position] = this.protocolVersion; // Version
-        position++;
-        buffer[position] = RpkiConst.RPKI_MSG_TYPE.IPV4_PREFIX; // Type
-        position++;
-        buffer.writeUInt16BE(0, position); // Reserved
-        position += 2;
-        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 12, position); // Length
-        position += 4;
-
-        buffer[position] = RpkiConst.RPKI_FLAGS.UPDATE; // Flags
-        position++;
-        buffer[position] = rpkiRoa.mask; // Prefix Length
-        position++;
-        buffer[position] = rpkiRoa.maxLength; // Max Length
-        position++;
-        buffer[position] = 0; // Padding
-        position++;
-
-        // Write IPv4 prefix
-        const ipBytesArray = ipToBytes(rpkiRoa.ip);
-        for (let i = 0; i < 4; i++) {
-            buffer[position + i] = ipBytesArray[i];
-        }
-        position += 4;
-
-        buffer.writeUInt32BE(rpkiRoa.asn, position); // ASN
-        position += 4;
-
-        this.sendMessage(buffer);
-    }
-
-    sendIPv6Prefix(rpkiRoa) {
-        // Header + Flags(1) + PrefixLength(1) + MaxLength(1) + Padding(1) + ASN(4) + Prefix(16)
-        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 24);
-
-        let position = 0;
-
-        buffer[position] = this.protocolVersion; // Version
-        position++;
-        buffer[position] = RpkiConst.RPKI_MSG_TYPE.IPV6_PREFIX; // Type
-        position++;
-        buffer.writeUInt16BE(0, position); // Reserved
-        position += 2;
-        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 24, position); // Length
-        position += 4;
-
-        buffer[position] = RpkiConst.RPKI_FLAGS.UPDATE; // Flags
-        position++;
-        buffer[position] = rpkiRoa.mask; // Prefix Length
-        position++;
-        buffer[position] = rpkiRoa.maxLength; // Max Length
-        position++;
-        buffer[position] = 0; // Padding
-        position++;
-
-        // Write IPv6 prefix
-        const ipBytesArray = ipToBytes(rpkiRoa.ip);
-        for (let i = 0; i < 16; i++) {
-            buffer[position + i] = ipBytesArray[i];
-        }
-        position += 16;
-
-        buffer.writeUInt32BE(rpkiRoa.asn, position); // ASN
-        position += 4;
-
-        this.sendMessage(buffer);
-    }
-
-    withdrawIPv4Prefix(rpkiRoa) {
-        // Header + Flags(1) + PrefixLength(1) + MaxLength(1) + Padding(1) + ASN(4) + Prefix(4)
-        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 12);
-
-        let position = 0;
-
-        buffer[position] = this.protocolVersion; // Version
-        position++;
-        buffer[position] = RpkiConst.RPKI_MSG_TYPE.IPV4_PREFIX; // Type
-        position++;
-        buffer.writeUInt16BE(0, position); // Reserved
-        position += 2;
-        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 12, position); // Length
-        position += 4;
-
-        buffer[position] = RpkiConst.RPKI_FLAGS.WITHDRAWAL; // Flags
-        position++;
-        buffer[position] = rpkiRoa.mask; // Prefix Length
-        position++;
-        buffer[position] = rpkiRoa.maxLength; // Max Length
-        position++;
-        buffer[position] = 0; // Padding
-        position++;
-
-        // Write IPv4 prefix
-        const ipBytesArray = ipToBytes(rpkiRoa.ip);
-        for (let i = 0; i < 4; i++) {
-            buffer[position + i] = ipBytesArray[i];
-        }
-        position += 4;
-
-        buffer.writeUInt32BE(rpkiRoa.asn, position); // ASN
-        position += 4;
-
-        this.sendMessage(buffer);
-    }
-
-    withdrawIPv6Prefix(rpkiRoa) {
-        // Header + Flags(1) + PrefixLength(1) + MaxLength(1) + Padding(1) + ASN(4) + Prefix(16)
-        const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 24);
-
-        let position = 0;
-
-        buffer[position] = this.protocolVersion; // Version
-        position++;
-        buffer[position] = RpkiConst.RPKI_MSG_TYPE.IPV6_PREFIX; // Type
-        position++;
-        buffer.writeUInt16BE(0, position); // Reserved
-        position += 2;
-        buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 24, position); // Length
-        position += 4;
-
-        buffer[position] = RpkiConst.RPKI_FLAGS.WITHDRAWAL; // Flags
-        position++;
-        buffer[position] = rpkiRoa.mask; // Prefix Length
-        position++;
-        buffer[position] = rpkiRoa.maxLength; // Max Length
-        position++;
-        buffer[position] = 0; // Padding
-        position++;
-
-        // Write IPv6 prefix
-        const ipBytesArray = ipToBytes(rpkiRoa.ip);
-        for (let i = 0; i < 16; i++) {
-            buffer[position + i] = ipBytesArray[i];
-        }
-        position += 16;
-
-        buffer.writeUInt32BE(rpkiRoa.asn, position); // ASN
-        position += 4;
-
-        this.sendMessage(buffer);
-    }
-
-    sendEndOfData() {
-        if (this.protocolVersion > RpkiConst.RPKI_PROTOCOL_VERSION.V0) {
-            // Header + SessionID(2) + Serial(4) + Refresh(4) + Retry(4) + Expire(4)
-            const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 18);
-
-            buffer[0] = this.protocolVersion; // Version
-            buffer[1] = RpkiConst.RPKI_MSG_TYPE.END_OF_DATA; // Type
-            buffer.writeUInt16BE(0, 2); // Reserved
-            buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 18, 4); // Length
-
-            buffer.writeUInt16BE(this.sessionId, RpkiConst.RPKI_HEADER_LENGTH); // Session ID
-            buffer.writeUInt32BE(1, RpkiConst.RPKI_HEADER_LENGTH + 2); // Serial Number
-
-            // Default intervals (in seconds)
-            buffer.writeUInt32BE(3600, RpkiConst.RPKI_HEADER_LENGTH + 6); // Refresh: 1 hour
-            buffer.writeUInt32BE(600, RpkiConst.RPKI_HEADER_LENGTH + 10); // Retry: 10 minutes
-            buffer.writeUInt32BE(7200, RpkiConst.RPKI_HEADER_LENGTH + 14); // Expire: 2 hours
-
-            this.sendMessage(buffer);
-        } else {
-            const buffer = Buffer.alloc(RpkiConst.RPKI_HEADER_LENGTH + 4);
-            let position = 0;
-
-            buffer[position] = this.protocolVersion; // Version
-            position++;
-            buffer[position] = RpkiConst.RPKI_MSG_TYPE.END_OF_DATA; // Type
-            position++;
-            buffer.writeUInt16BE(this.sessionId, position); // Reserved
-            position += 2;
-            buffer.writeUInt32BE(RpkiConst.RPKI_HEADER_LENGTH + 4, position); // Length
-            position += 4;
-
-            buffer.writeUInt32BE(0, position); // Serial Number
-            position += 4;
-
-            this.sendMessage(buffer);
+    sendSerialNotify(notify) {
+        if (!this.synced) {
+            return;
         }
+        this.sendMessage(notify);
     }
 
     sendCacheReset() {
@@ -510,20 +351,6 @@ class RpkiSession {
         this.sendMessage(buffer);
     }
 
-    sendRoaData() {
-        const roaList = this.rpkiWorker.rpkiRoaMap.values();
-        for (const roa of roaList) {
-            this.sendSingleRoaData(roa);
-        }
-    }
-
-    withdrawRoaData() {
-        const roaList = this.rpkiWorker.rpkiRoaMap.values();
-        for (const roa of roaList) {
-            this.withdrawSingleRoaData(roa);
-        }
-    }
-
     // Notification methods to inform the front-end
     notifyRoaUpdate() {
         // Convert ROA data to array for easier consumption by front-end
@@ -544,22 +371,6 @@ class RpkiSession {
         });
     }
 
-    sendSingleRoaData(rpkiRoa) {
-        if (rpkiRoa.ipType === BgpConst.IP_TYPE.IPV4) {
-            this.sendIPv4Prefix(rpkiRoa);
-        } else {
-            this.sendIPv6Prefix(rpkiRoa);
-        }
-    }
-
-    withdrawSingleRoaData(rpkiRoa) {
-        if (rpkiRoa.ipType === BgpConst.IP_TYPE.IPV4) {
-            this.withdrawIPv4Prefix(rpkiRoa);
-        } else {
-            this.withdrawIPv6Prefix(rpkiRoa);
-        }
-    }
-
     getClientInfo() {
         return {
             localIp: this.localIp,
@@ -4,6 +4,7 @@ const logger = require('../log/logger');
 const WorkerMessageHandler = require('./workerMessageHandler');
 const RpkiSession = require('./rpkiSession');
 const RpkiRoa = require('./rpkiRoa');
+const RpkiCache = require('./rpkiCache');
 const RpkiConst = require('../const/rpkiConst');
 const SshTunnel = require('./sshTunnel');
 
@@ -17,6 +18,8 @@ class RpkiWorker {
 
         this.rpkiSessionMap = new Map(); // rpki会话map
         this.rpkiRoaMap = new Map(); // rpki roa map
+        this.rpkiCache = new RpkiCache(); // 预编码的 PDU 快照和增量
+        this.commitScheduled = false;
 
         // 创建消息处理器
         this.messageHandler = new WorkerMessageHandler();
@@ -26,6 +29,7 @@ class RpkiWorker {
         this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.START_RPKI, this.startRpki.bind(this));
         this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.STOP_RPKI, this.stopRpki.bind(this));
         this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.ADD_ROA, this.addRoa.bind(this));
+        this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.ADD_ROA_LIST, this.addRoaList.bind(this));
         this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.DELETE_ROA, this.deleteRoa.bind(this));
         this.messageHandler.registerHandler(RpkiConst.RPKI_REQ_TYPES.GET_CLIENT_LIST, this.getClientList.bind(this));
     }
@@ -421,39 +425,81 @@ class RpkiWorker {
         });
         this.rpkiSessionMap.clear();
         this.rpkiRoaMap.clear();
+        this.rpkiCache.clear();
         this.messageHandler.sendSuccessResponse(messageId, null, 'rpki协议停止成功');
     }
 
-    sendSingleRoaData(rpkiRoa) {
-        const rpkiSession = this.rpkiSessionMap.values();
-        for (const session of rpkiSession) {
-            session.sendSingleRoaData(rpkiRoa);
+    // 提交缓存变化并通知所有已同步的 router，同一事件循环内的多次变化合并为一个序列号
+    scheduleCommit() {
+        if (this.commitScheduled) {
+            return;
         }
+        this.commitScheduled = true;
+        setImmediate(() => {
+            this.commitScheduled = false;
+            this.commitAndNotify();
+        });
     }
 
-    withdrawSingleRoaData(rpkiRoa) {
-        const rpkiSession = this.rpkiSessionMap.values();
-        for (const session of rpkiSession) {
-            session.withdrawSingleRoaData(rpkiRoa);
+    commitAndNotify() {
+        if (!this.rpkiCache.commit()) {
+            return;
+        }
+        for (const session of this.rpkiSessionMap.values()) {
+            session.sendSerialNotify(this.rpkiCache.getSerialNotify(session.protocolVersion));
         }
     }
 
-    addRoa(messageId, roa) {
+    addRoaToCache(roa) {
+        const error = RpkiRoa.validate(roa);
+        if (error) {
+            throw new Error(error);
+        }
         const key = RpkiRoa.makeKey(roa.ip, roa.mask, roa.asn, roa.maxLength);
         if (this.rpkiRoaMap.has(key)) {
-            logger.error(`RPKI ROA配置已存在: ${key}`);
-            this.messageHandler.sendErrorResponse(messageId, 'RPKI ROA配置已存在');
-            return;
+            return false;
         }
         const rpkiRoa = new RpkiRoa(roa.ip, roa.mask, roa.asn, roa.maxLength, roa.ipType);
         this.rpkiRoaMap.set(key, rpkiRoa);
+        this.rpkiCache.addRoa(key, rpkiRoa);
+        return true;
+    }
+
+    addRoa(messageId, roa) {
+        if (!this.addRoaToCache(roa)) {
+            logger.error(`RPKI ROA配置已存在: ${RpkiRoa.makeKey(roa.ip, roa.mask, roa.asn, roa.maxLength)}`);
+            this.messageHandler.sendErrorResponse(messageId, 'RPKI ROA配置已存在');
+            return;
+        }
 
-        // 发送ROA数据
-        this.sendSingleRoaData(rpkiRoa);
+        this.scheduleCommit();
 
         this.messageHandler.sendSuccessResponse(messageId, null, 'RPKI ROA配置添加成功');
     }
 
+    // 批量导入：所有 ROA 在同一个序列号中生效
+    addRoaList(messageId, roaList) {
+        let added = 0;
+        for (const roa of roaList) {
+            try {
+                if (this.addRoaToCache(roa)) {
+                    added++;
+                }
+            } catch (error) {
+                logger.error(`RPKI ROA配置无效: ${JSON.stringify(roa)} ${error.message}`);
+            }
+        }
+
+        this.commitAndNotify();
+
+        logger.info(`RPKI ROA批量添加: ${added}/${roaList.length}`);
+        this.messageHandler.sendSuccessResponse(
+            messageId,
+            { added, skipped: roaList.length - added },
+            'RPKI ROA配置批量添加成功'
+        );
+    }
+
     deleteRoa(messageId, roa) {
         const key = RpkiRoa.makeKey(roa.ip, roa.mask, roa.asn, roa.maxLength);
         if (!this.rpkiRoaMap.has(key)) {
@@ -462,12 +508,10 @@ class RpkiWorker {
             return;
         }
 
-        const rpkiRoa = this.rpkiRoaMap.get(key);
-
-        // 发送ROA数据
-        this.withdrawSingleRoaData(rpkiRoa);
-
+        this.rpkiCache.deleteRoa(key);
         this.rpkiRoaMap.delete(key);
+        this.scheduleCommit();
+
         this.messageHandler.sendSuccessResponse(messageId, null, 'RPKI ROA配置删除成功');
     }
 
@@ -0,0 +1,459 @@
+const dgram = require('dgram');
+const net = require('net');
+const logger = require('../log/logger');
+const { canonicalIp } = require('../utils/ipUtils');
+const SnmpConst = require('../const/snmpConst');
+const SnmpTrapDecoder = require('../utils/snmpTrapDecoder');
+const TimerWheel = require('../utils/timerWheel');
+
+const TAG = SnmpConst.SNMP_BER_ASN1_TAG;
+const PDU = SnmpConst.SNMP_PDU_TYPE;
+
+// SNMPv2 变量绑定异常值
+const END_OF_MIB_VIEW = 0x82;
+// error-status
+const ERROR_TOO_BIG = 1;
+
+const NULL_VALUE = Buffer.from([TAG.NULL, 0x00]);
+
+function berLength(len) {
+    if (len < 0x80) {
+        return Buffer.from([len]);
+    }
+    if (len < 0x100) {
+        return Buffer.from([0x81, len]);
+    }
+    return Buffer.from([0x82, len >> 8, len & 0xff]);
+}
+
+function berTlv(tag, content) {
+    return Buffer.concat([Buffer.from([tag]), berLength(content.length), content]);
+}
+
+function berInteger(value) {
+    const bytes = [];
+    do {
+        bytes.unshift(value & 0xff);
+        value = Math.floor(value / 256);
+    } while (value > 0);
+    if (bytes[0] & 0x80) {
+        bytes.unshift(0);
+    }
+    return berTlv(TAG.INTEGER, Buffer.from(bytes));
+}
+
+/**
+ * 点分 OID 编码为 BER 内容字节
+ */
+function encodeOid(dotted) {
+    const parts = dotted.split('.').map(Number);
+    const bytes = [];
+    const pushSub = value => {
+        const sub = [value & 0x7f];
+        while (value > 0x7f) {
+            value = Math.floor(value / 128);
+            sub.unshift((value & 0x7f) | 0x80);
+        }
+        bytes.push(...sub);
+    };
+
+    pushSub(parts[0] * 40 + parts[1]);
+    for (let i = 2; i < parts.length; i++) {
+        pushSub(parts[i]);
+    }
+    return Buffer.from(bytes);
+}
+
+/**
+ * SNMP GETBULK 轮询引擎
+ *
+ * 所有代理共用一个 UDP 套接字（IPv6 代理另用一个），响应按 request-id 分发到在途请求。
+ * 每个代理同一时刻只有一个在途请求，代理之间轮转，全局在途请求数不超过 maxOutstanding。
+ * max-repetitions 按代理自适应：tooBig 或超时减半（tooBig 同时作为上限），响应较小时逐步增大。遍历结果通过
+ * onRows 按响应回调，由 worker 合并后批量推送。
+ */
+class SnmpPoller {
+    /**
+     * @param {Function} onRows (agentKey, rootOid, rows) 每个响应解析出的结果行
+     * @param {Function} onAgentDone (summary) 代理完成一轮遍历
+     */
+    constructor(onRows, onAgentDone) {
+        this.onRows = onRows;
+        this.onAgentDone = onAgentDone;
+
+        this.decoder = new SnmpTrapDecoder();
+        this.options = null;
+        this.roots = []; // [{ dotted, bytes }]
+        this.agents = new Map(); // host:port -> agent
+        this.pending = new Map(); // request-id -> request
+        this.readyQueue = []; // 等待发送下一个请求的代理
+        this.nextRequestId = Math.floor(Math.random() * 0x7fffffff) + 1;
+
+        this.socket = null;
+        this.socket6 = null;
+        this.wheel = null;
+        this.cycleTimer = null;
+        this.cycle = 0;
+        this.cycleStart = 0;
+
+        this.stats = {
+            requests: 0,
+            responses: 0,
+            timeouts: 0,
+            stray: 0,
+            malformed: 0
+        };
+    }
+
+    /**
+     * 启动轮询
+     * @param {Object} config { agents: [{ host, port, version, community }], oids: [], interval, timeout,
+     *                          retries, maxRepetitions, maxOutstanding }
+     */
+    async start(config) {
+        const options = { ...SnmpConst.SNMP_POLL_DEFAULTS, ...config };
+        if (!Array.isArray(options.agents) || options.agents.length === 0) {
+            throw new Error('未配置轮询代理');
+        }
+        if (!Array.isArray(options.oids) || options.oids.length === 0) {
+            throw new Error('未配置轮询OID');
+        }
+
+        this.roots = options.oids.map(dotted => {
+            if (!/^[0-2](\.[0-9]+)+$/.test(dotted)) {
+                throw new Error(`无效的OID: ${dotted}`);
+            }
+            return { dotted, bytes: encodeOid(dotted) };
+        });
+
+        for (const item of options.agents) {
+            const family = net.isIP(item.host);
+            if (family === 0) {
+                throw new Error(`代理地址必须是IP地址: ${item.host}`);
+            }
+            // 保存规范形式，响应按 rinfo.address 原样比较
+            const host = canonicalIp(item.host);
+            const port = item.port || 161;
+            const key = `${host}:${port}`;
+            this.agents.set(key, {
+                key,
+                host,
+                port,
+                family,
+                version: item.version === 'v1' ? 0 : 1,
+                community: Buffer.from(item.community || 'public'),
+                maxRepetitions: options.maxRepetitions,
+                maxRepetitionsLimit: SnmpConst.SNMP_POLL_MAX_REPETITIONS,
+                rootIndex: 0,
+                cursor: null,
+                active: false,
+                request: null,
+                cycleStart: 0,
+                cycleRows: 0,
+                error: null,
+                stats: {
+                    cycles: 0,
+                    requests: 0,
+                    retries: 0,
+                    timeouts: 0,
+                    tooBig: 0,
+                    errors: 0,
+                    overruns: 0,
+                    rows: 0,
+                    lastCycleMs: 0,
+                    lastError: null
+                }
+            });
+        }
+
+        this.options = options;
+        this.socket = await this.openSocket('udp4');
+        if ([...this.agents.values()].some(agent => agent.family === 6)) {
+            this.socket6 = await this.openSocket('udp6');
+        }
+
+        this.wheel = new TimerWheel(SnmpConst.SNMP_POLL_TICK);
+        this.wheel.start();
+
+        this.startCycle();
+        this.cycleTimer = setInterval(() => this.startCycle(), options.interval * 1000);
+        logger.info(
+            `SNMP轮询启动: ${this.agents.size} 个代理, ${this.roots.length} 个OID子树, 周期 ${options.interval}s`
+        );
+    }
+
+    openSocket(type) {
+        return new Promise((resolve, reject) => {
+            const socket = dgram.createSocket({ type, recvBufferSize: SnmpConst.SNMP_TRAP_RECV_BUFFER_SIZE });
+            socket.on('message', (msg, rinfo) => this.handleMessage(msg, rinfo));
+            socket.once('error', reject);
+            socket.bind(0, () => {
+                socket.removeListener('error', reject);
+                socket.on('error', err => logger.error(`SNMP轮询套接字错误: ${err.message}`));
+                resolve(socket);
+            });
+        });
+    }
+
+    stop() {
+        if (this.cycleTimer) {
+            clearInterval(this.cycleTimer);
+            this.cycleTimer = null;
+        }
+        if (this.wheel) {
+            this.wheel.stop();
+            this.wheel = null;
+        }
+        for (const socket of [this.socket, this.socket6]) {
+            if (socket) {
+                socket.close();
+            }
+        }
+        this.socket = null;
+        this.socket6 = null;
+        this.pending.clear();
+        this.readyQueue = [];
+        this.agents.clear();
+        logger.info('SNMP轮询停止');
+    }
+
+    /**
+     * 开始新一轮遍历；上一轮还没完成的代理本轮跳过
+     */
+    startCycle() {
+        this.cycle++;
+        this.cycleStart = Date.now();
+
+        for (const agent of this.agents.values()) {
+            if (agent.active) {
+                agent.stats.overruns++;
+                continue;
+            }
+            agent.active = true;
+            agent.rootIndex = 0;
+            agent.cursor = this.roots[0].bytes;
+            agent.cycleStart = this.cycleStart;
+            agent.cycleRows = 0;
+            agent.error = null;
+            this.readyQueue.push(agent);
+        }
+        this.pump();
+    }
+
+    /**
+     * 在全局并发上限内为就绪的代理发送请求
+     */
+    pump() {
+        let head = 0;
+        while (head < this.readyQueue.length && this.pending.size < this.options.maxOutstanding) {
+            this.sendRequest(this.readyQueue[head++], 0);
+        }
+        this.readyQueue.splice(0, head);
+    }
+
+    allocRequestId() {
+        do {
+            this.nextRequestId = (this.nextRequestId % 0x7fffffff) + 1;
+        } while (this.pending.has(this.nextRequestId));
+        return this.nextRequestId;
+    }
+
+    encodeRequest(agent, requestId) {
+        // v1 不支持 GETBULK，用 GETNEXT 逐个遍历
+        const isBulk = agent.version !== 0;
+        const varbind = berTlv(TAG.SEQUENCE, Buffer.concat([berTlv(TAG.OBJECT_IDENTIFIER, agent.cursor), NULL_VALUE]));
+        const pdu = berTlv(
+            isBulk ? PDU.GET_BULK_REQUEST : PDU.GET_NEXT_REQUEST,
+            Buffer.concat([
+                berInteger(requestId),
+                berInteger(0), // non-repeaters / error-status
+                berInteger(isBulk ? agent.maxRepetitions : 0), // max-repetitions / error-index
+                berTlv(TAG.SEQUENCE, varbind)
+            ])
+        );
+        return berTlv(
+            TAG.SEQUENCE,
+            Buffer.concat([berInteger(agent.version), berTlv(TAG.OCTET_STRING, agent.community), pdu])
+        );
+    }
+
+    sendRequest(agent, attempts) {
+        const request = {
+            id: this.allocRequestId(),
+            agent,
+            attempts,
+            timer: null
+        };
+        const message = this.encodeRequest(agent, request.id);
+
+        agent.request = request;
+        agent.stats.requests++;
+        this.stats.requests++;
+        this.pending.set(request.id, request);
+        // 重试时按次数退避
+        request.timer = this.wheel.createTimer(() => this.handleTimeout(request));
+        this.wheel.schedule(request.timer, this.options.timeout * (attempts + 1));
+
+        const socket = agent.family === 6 ? this.socket6 : this.socket;
+        socket.send(message, agent.port, agent.host, err => {
+            if (err) {
+                logger.debug(`SNMP轮询请求发送失败 ${agent.key}: ${err.message}`);
+            }
+        });
+    }
+
+    handleMessage(buffer, rinfo) {
+        let response;
+        try {
+            response = this.decoder.decodeResponse(buffer);
+        } catch (error) {
+            this.stats.malformed++;
+            return;
+        }
+
+        const request = response ? this.pending.get(response.requestId) : undefined;
+        if (!request || request.agent.port !== rinfo.port || request.agent.host !== rinfo.address) {
+            // 已超时重发的旧请求的迟到响应，或者其他来源
+            this.stats.stray++;
+            return;
+        }
+
+        this.stats.responses++;
+        this.pending.delete(request.id);
+        this.wheel.cancel(request.timer);
+        request.agent.request = null;
+        this.handleResponse(request.agent, response, buffer.length);
+        this.pump();
+    }
+
+    handleResponse(agent, response, size) {
+        if (response.errorStatus === ERROR_TOO_BIG) {
+            // 记住上限，之后增长不再超过它
+            agent.stats.tooBig++;
+            agent.maxRepetitions = Math.max(1, agent.maxRepetitions >> 1);
+            agent.maxRepetitionsLimit = agent.maxRepetitions;
+            this.readyQueue.push(agent);
+            return;
+        }
+
+        const root = this.roots[agent.rootIndex].bytes;
+        let subtreeDone = response.errorStatus !== 0;
+        if (subtreeDone) {
+            // v1 的 noSuchName 表示已经遍历到 MIB 末尾
+            if (agent.version !== 0) {
+                agent.stats.errors++;
+                agent.stats.lastError = `error-status ${response.errorStatus}`;
+            }
+        }
+
+        const rows = [];
+        const list = response.varbinds;
+        for (let i = 0; !subtreeDone && i < list.length; i += 3) {
+            const oid = list[i];
+            const tag = list[i + 1];
+            if (
+                tag === END_OF_MIB_VIEW ||
+                oid.length <= root.length ||
+                root.compare(oid, 0, root.length) !== 0 ||
+                oid.equals(agent.cursor)
+            ) {
+                subtreeDone = true;
+                break;
+            }
+
+            rows.push({
+                oid: this.decoder.oidString(oid),
+                type: SnmpTrapDecoder.getValueTypeName(tag),
+                value: this.decoder.valueToDisplay(tag, list[i + 2])
+            });
+            agent.cursor = Buffer.from(oid);
+        }
+        if (list.length === 0) {
+            subtreeDone = true;
+        }
+
+        if (rows.length > 0) {
+            agent.cycleRows += rows.length;
+            agent.stats.rows += rows.length;
+            this.onRows(agent.key, this.roots[agent.rootIndex].dotted, rows);
+        }
+
+        // 响应离 MTU 还远，说明一次可以取更多
+        if (agent.version !== 0 && !subtreeDone && size < SnmpConst.SNMP_POLL_GROW_BYTES) {
+            agent.maxRepetitions = Math.min(
+                agent.maxRepetitionsLimit,
+                agent.maxRepetitions + Math.max(1, agent.maxRepetitions >> 2)
+            );
+        }
+
+        if (subtreeDone) {
+            agent.rootIndex++;
+            if (agent.rootIndex >= this.roots.length) {
+                this.finishAgent(agent);
+                return;
+            }
+            agent.cursor = this.roots[agent.rootIndex].bytes;
+        }
+        this.readyQueue.push(agent);
+    }
+
+    handleTimeout(request) {
+        const agent = request.agent;
+        this.pending.delete(request.id);
+        agent.request = null;
+
+        if (request.attempts < this.options.retries) {
+            // 大响应可能因分片丢失，重试时减小 max-repetitions，并换新的 request-id
+            agent.stats.retries++;
+            agent.maxRepetitions = Math.max(1, agent.maxRepetitions >> 1);
+            this.sendRequest(agent, request.attempts + 1);
+            return;
+        }
+
+        agent.stats.timeouts++;
+        agent.stats.lastError = 'timeout';
+        agent.error = 'timeout';
+        this.stats.timeouts++;
+        this.finishAgent(agent);
+        this.pump();
+    }
+
+    finishAgent(agent) {
+        agent.active = false;
+        agent.stats.cycles++;
+        agent.stats.lastCycleMs = Date.now() - agent.cycleStart;
+        this.onAgentDone({
+            agent: agent.key,
+            cycle: this.cycle,
+            rows: agent.cycleRows,
+            durationMs: agent.stats.lastCycleMs,
+            error: agent.error
+        });
+    }
+
+    getStatus() {
+        const agents = [];
+        for (const agent of this.agents.values()) {
+            agents.push({
+                agent: agent.key,
+                version: agent.version === 0 ? 'v1' : 'v2c',
+                active: agent.active,
+                maxRepetitions: agent.maxRepetitions,
+                maxRepetitionsLimit: agent.maxRepetitionsLimit,
+                ...agent.stats
+            });
+        }
+
+        return {
+            running: this.socket !== null,
+            cycle: this.cycle,
+            cycleStart: this.cycleStart ? new Date(this.cycleStart).toISOString() : null,
+            outstanding: this.pending.size,
+            queued: this.readyQueue.length,
+            ...this.stats,
+            agents
+        };
+    }
+}
+
+module.exports = SnmpPoller;
@@ -0,0 +1,158 @@
+const SnmpConst = require('../const/snmpConst');
+
+const PDU = SnmpConst.SNMP_PDU_TYPE;
+
+/**
+ * Trap 存储
+ *
+ * 最近的 Trap 保存在固定容量的环形数组中，更早的记录被覆盖；另外按源地址以及
+ * 源地址 + snmpTrapOID 维护聚合计数，Trap 风暴期间内存占用有上界。
+ */
+class SnmpTrapStore {
+    constructor(capacity = SnmpConst.DEFAULT_SNMP_SETTINGS.maxTrapHistory) {
+        this.capacity = capacity;
+        this.ring = new Array(capacity);
+        this.head = 0; // 下一个写入位置
+        this.count = 0;
+        this.seq = 0; // 已收到的 Trap 总数，也是记录序号
+
+        this.sources = new Map(); // 源地址 -> 计数
+        this.aggregates = 0; // 所有源下 snmpTrapOID 计数条目数
+        this.aggregateOverflow = 0; // 因条目上限未能单独计数的 Trap 数
+        this.decodeErrors = 0;
+        this.since = Date.now();
+    }
+
+    /**
+     * 保存一条解码后的 Trap 并更新聚合计数
+     * @returns {boolean} 是否是第一次收到该源地址的 Trap
+     */
+    push(record) {
+        record.seq = ++this.seq;
+        this.ring[this.head] = record;
+        this.head = (this.head + 1) % this.capacity;
+        if (this.count < this.capacity) {
+            this.count++;
+        }
+
+        const isNew = !this.sources.has(record.sourceIp);
+        const source = this.getSource(record.sourceIp, record.time);
+        source.traps++;
+        source.lastSeen = record.time;
+        if (record.pduType === PDU.TRAP) {
+            source.v1++;
+        } else if (record.pduType === PDU.INFORM_REQUEST) {
+            source.informs++;
+        } else {
+            source.v2c++;
+        }
+
+        const oidCount = source.oids.get(record.trapOid);
+        if (oidCount !== undefined) {
+            source.oids.set(record.trapOid, oidCount + 1);
+        } else if (this.aggregates < SnmpConst.SNMP_TRAP_MAX_AGGREGATES) {
+            source.oids.set(record.trapOid, 1);
+            this.aggregates++;
+        } else {
+            this.aggregateOverflow++;
+        }
+
+        return isNew;
+    }
+
+    /**
+     * 记录一个无法解码的报文
+     */
+    error(sourceIp) {
+        this.decodeErrors++;
+        this.getSource(sourceIp, Date.now()).errors++;
+    }
+
+    getSource(sourceIp, time) {
+        let source = this.sources.get(sourceIp);
+        if (!source) {
+            source = {
+                ip: sourceIp,
+                firstSeen: time,
+                lastSeen: time,
+                traps: 0,
+                v1: 0,
+                v2c: 0,
+                informs: 0,
+                errors: 0,
+                oids: new Map() // snmpTrapOID(驻留 id) -> 次数
+            };
+            this.sources.set(sourceIp, source);
+        }
+        return source;
+    }
+
+    /**
+     * 最近的 limit 条记录，新的在前
+     */
+    recent(limit = this.count) {
+        const n = Math.min(limit, this.count);
+        const result = new Array(n);
+        for (let i = 0; i < n; i++) {
+            result[i] = this.ring[(this.head - 1 - i + this.capacity) % this.capacity];
+        }
+        return result;
+    }
+
+    /**
+     * 聚合统计
+     * @param {SnmpTrapDecoder} decoder 用于把驻留 id 还原为 OID 字符串
+     * @param {number} topN 返回次数最多的前 topN 个 源地址/snmpTrapOID 组合
+     */
+    getStats(decoder, topN = 20) {
+        const sources = [];
+        const top = [];
+        for (const source of this.sources.values()) {
+            sources.push({
+                ip: source.ip,
+                firstSeen: new Date(source.firstSeen).toISOString(),
+                lastSeen: new Date(source.lastSeen).toISOString(),
+                traps: source.traps,
+                v1: source.v1,
+                v2c: source.v2c,
+                informs: source.informs,
+                errors: source.errors,
+                trapOids: source.oids.size
+            });
+            for (const [oid, count] of source.oids) {
+                top.push({ sourceIp: source.ip, oid, count });
+            }
+        }
+        top.sort((a, b) => b.count - a.count);
+
+        return {
+            since: new Date(this.since).toISOString(),
+            total: this.seq,
+            retained: this.count,
+            capacity: this.capacity,
+            decodeErrors: this.decodeErrors,
+            aggregateOverflow: this.aggregateOverflow,
+            internedOids: decoder.oids.length,
+            sources,
+            topTrapOids: top.slice(0, topN).map(item => ({
+                sourceIp: item.sourceIp,
+                trapOid: decoder.oidString(item.oid),
+                count: item.count
+            }))
+        };
+    }
+
+    clear() {
+        this.ring = new Array(this.capacity);
+        this.head = 0;
+        this.count = 0;
+        this.seq = 0;
+        this.sources.clear();
+        this.aggregates = 0;
+        this.aggregateOverflow = 0;
+        this.decodeErrors = 0;
+        this.since = Date.now();
+    }
+}
+
+module.exports = SnmpTrapStore;
@@ -2,7 +2,9 @@ const dgram = require('dgram');
 const logger = require('../log/logger');
 const WorkerMessageHandler = require('./workerMessageHandler');
 const SnmpConst = require('../const/snmpConst');
-const Asn1Parser = require('../utils/asn1Parser');
+const SnmpTrapDecoder = require('../utils/snmpTrapDecoder');
+const SnmpTrapStore = require('./snmpTrapStore');
+const SnmpPoller = require('./snmpPoller');
 
 class SnmpWorker {
     constructor() {
@@ -10,8 +12,21 @@ class SnmpWorker {
         this.ipv6Server = null;
         this.snmpConfig = null;
         this.sessionMap = new Map(); // SNMP会话映射
-        this.agentMap = new Map(); // 代理映射
-        this.trapCounter = 0;
+
+        // Trap 解码与存储
+        this.decoder = new SnmpTrapDecoder();
+        this.trapStore = new SnmpTrapStore();
+        this.pending = []; // 待解码的 [buffer, rinfo, ...]
+        this.decodeScheduled = false;
+        this.unsentTraps = 0; // 已解码但还未推送给界面的 Trap 数
+        this.emitTimer = null;
+
+        // GETBULK 轮询
+        this.poller = null;
+        this.pollRows = []; // 待推送的 [{ agent, root, rows }]
+        this.pollRowCount = 0;
+        this.pollDone = []; // 待推送的本轮已完成代理
+        this.pollEmitTimer = null;
 
         // 创建消息处理器
         this.messageHandler = new WorkerMessageHandler();
@@ -20,6 +35,15 @@ class SnmpWorker {
         // 注册消息处理器
         this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.START_SNMP, this.startSnmp.bind(this));
         this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.STOP_SNMP, this.stopSnmp.bind(this));
+        this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.GET_TRAP_LIST, this.getTrapList.bind(this));
+        this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.GET_TRAP_STATS, this.getTrapStats.bind(this));
+        this.messageHandler.registerHandler(
+            SnmpConst.SNMP_REQ_TYPES.CLEAR_TRAP_HISTORY,
+            this.clearTrapHistory.bind(this)
+        );
+        this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.START_POLL, this.startPoll.bind(this));
+        this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.STOP_POLL, this.stopPoll.bind(this));
+        this.messageHandler.registerHandler(SnmpConst.SNMP_REQ_TYPES.GET_POLL_STATUS, this.getPollStatus.bind(this));
     }
 
     /**
@@ -28,6 +52,7 @@ class SnmpWorker {
     async startSnmp(messageId, config) {
         try {
             this.snmpConfig = config;
+            this.trapStore = new SnmpTrapStore(config.maxTrapHistory || SnmpConst.DEFAULT_SNMP_SETTINGS.maxTrapHistory);
 
             // 设置日志级别
             if (this.snmpConfig.logLevel) {
@@ -65,10 +90,13 @@ class SnmpWorker {
     async startUdpServer() {
         return new Promise((resolve, reject) => {
             try {
-                this.server = dgram.createSocket('udp4');
+                this.server = dgram.createSocket({
+                    type: 'udp4',
+                    recvBufferSize: SnmpConst.SNMP_TRAP_RECV_BUFFER_SIZE
+                });
 
                 this.server.on('message', (msg, rinfo) => {
-                    this.handleSnmpMessage(msg, rinfo, 'ipv4');
+                    this.handleSnmpMessage(msg, rinfo);
                 });
 
                 this.server.on('error', err => {
@@ -95,10 +123,13 @@ class SnmpWorker {
     async startUdpServerV6() {
         return new Promise((resolve, reject) => {
             try {
-                this.ipv6Server = dgram.createSocket('udp6');
+                this.ipv6Server = dgram.createSocket({
+                    type: 'udp6',
+                    recvBufferSize: SnmpConst.SNMP_TRAP_RECV_BUFFER_SIZE
+                });
 
                 this.ipv6Server.on('message', (msg, rinfo) => {
-                    this.handleSnmpMessage(msg, rinfo, 'ipv6');
+                    this.handleSnmpMessage(msg, rinfo);
                 });
 
                 this.ipv6Server.on('error', err => {
@@ -120,217 +151,209 @@ class SnmpWorker {
     }
 
     /**
-     * 处理SNMP消息
+     * 收到 SNMP 报文，先排队，在同一轮事件循环结束后批量解码
      */
-    handleSnmpMessage(buffer, rinfo, ipVersion) {
-        try {
-            logger.info(`收到来自 ${rinfo.address}:${rinfo.port} (${ipVersion}) 的SNMP消息, 长度: ${buffer.length}`);
+    handleSnmpMessage(buffer, rinfo) {
+        this.pending.push(buffer, rinfo);
+        if (!this.decodeScheduled) {
+            this.decodeScheduled = true;
+            setImmediate(() => this.decodePending());
+        }
+    }
 
-            // 解析SNMP消息
-            const snmpMessage = this.parseSnmpMessage(buffer);
-            if (!snmpMessage) {
-                logger.error('SNMP消息解析失败');
-                return;
+    /**
+     * 批量解码排队的报文，写入 Trap 存储
+     */
+    decodePending() {
+        const pending = this.pending;
+        this.pending = [];
+        this.decodeScheduled = false;
+
+        for (let i = 0; i < pending.length; i += 2) {
+            const rinfo = pending[i + 1];
+            let record;
+            try {
+                record = this.decoder.decode(pending[i], rinfo.address, rinfo.port);
+            } catch (error) {
+                logger.debug(`来自 ${rinfo.address}:${rinfo.port} 的SNMP报文解析失败: ${error.message}`);
+                this.trapStore.error(rinfo.address);
+                continue;
             }
 
-            logger.info(
-                `解析成功: version=${snmpMessage.version}, community=${snmpMessage.community}, pduType=0x${snmpMessage.pduType.toString(16)}`
-            );
+            if (!record) {
+                logger.debug(`收到来自 ${rinfo.address}:${rinfo.port} 的非Trap SNMP消息，忽略`);
+                continue;
+            }
 
-            // 检查是否为Trap消息
-            if (this.isTrapMessage(snmpMessage)) {
-                this.processTrapMessage(snmpMessage, rinfo, buffer);
-            } else {
-                logger.info('收到非Trap SNMP消息，忽略');
+            if (this.trapStore.push(record)) {
+                // 发送代理连接事件
+                this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, {
+                    type: SnmpConst.SNMP_SUB_EVT_TYPES.AGENT_CONNECTION,
+                    data: {
+                        ip: rinfo.address,
+                        firstSeen: new Date(record.time).toISOString(),
+                        status: 'online'
+                    }
+                });
             }
-        } catch (error) {
-            logger.error('处理SNMP消息失败:', error);
+            this.unsentTraps++;
+        }
+
+        // 空闲时立即推送，推送间隔内到达的 Trap 合并到下一次
+        if (this.unsentTraps > 0 && !this.emitTimer) {
+            this.emitTraps();
         }
     }
 
     /**
-     * 解析SNMP消息 - 完整的ASN.1 BER解析
+     * 向界面推送一批 Trap，超出上限的只计入 skipped，可通过 GET_TRAP_LIST 查询
      */
-    parseSnmpMessage(buffer) {
-        try {
-            const parser = new Asn1Parser(buffer);
+    emitTraps() {
+        if (this.unsentTraps === 0) {
+            this.emitTimer = null;
+            return;
+        }
 
-            // 解析SNMP消息序列
-            const messageSequence = parser.parseSequence();
-            if (!messageSequence) {
-                logger.error('SNMP消息不是有效的ASN.1序列');
-                return null;
-            }
+        const count = Math.min(this.unsentTraps, SnmpConst.SNMP_TRAP_EMIT_LIMIT);
+        const traps = this.trapStore.recent(count).map(record => this.decoder.toTrapData(record));
+        const skipped = this.unsentTraps - count;
+        this.unsentTraps = 0;
 
-            // 解析版本
-            const version = parser.parseInteger();
-            if (version === null) {
-                logger.error('无法解析SNMP版本');
-                return null;
-            }
+        if (skipped > 0) {
+            logger.info(`Trap 推送合并: 本批 ${count} 条, 跳过 ${skipped} 条`);
+        }
 
-            // 解析community字符串
-            const community = parser.parseOctetString();
-            if (community === null) {
-                logger.error('无法解析community字符串');
-                return null;
+        this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, {
+            type: SnmpConst.SNMP_SUB_EVT_TYPES.TRAP_BATCH,
+            data: {
+                traps,
+                skipped,
+                total: this.trapStore.seq
             }
+        });
 
-            // 解析PDU
-            const pduResult = parser.parsePdu();
-            if (!pduResult) {
-                logger.error('无法解析PDU');
-                return null;
-            }
+        this.emitTimer = setTimeout(() => this.emitTraps(), SnmpConst.SNMP_TRAP_EMIT_INTERVAL);
+    }
 
-            return {
-                version: this.getVersionString(version),
-                versionNumber: version,
-                community: community,
-                pduType: pduResult.type,
-                requestId: pduResult.requestId || 0,
-                errorStatus: pduResult.errorStatus || 0,
-                errorIndex: pduResult.errorIndex || 0,
-                varbinds: pduResult.varbinds || [],
-                rawData: buffer.toString('hex'),
-                // Trap特有字段
-                enterprise: pduResult.enterprise,
-                agentAddr: pduResult.agentAddr,
-                genericTrap: pduResult.genericTrap,
-                specificTrap: pduResult.specificTrap,
-                timeStamp: pduResult.timeStamp
-            };
-        } catch (error) {
-            logger.error('解析SNMP消息失败:', error);
-            return null;
-        }
+    /**
+     * 查询最近的 Trap
+     */
+    getTrapList(messageId, data) {
+        const limit = data && data.limit ? data.limit : this.trapStore.capacity;
+        const traps = this.trapStore.recent(limit).map(record => this.decoder.toTrapData(record));
+        this.messageHandler.sendSuccessResponse(messageId, traps, '获取Trap列表成功');
     }
 
     /**
-     * 获取版本字符串
+     * 查询 Trap 聚合统计
      */
-    getVersionString(version) {
-        switch (version) {
-            case 0:
-                return 'v1';
-            case 1:
-                return 'v2c';
-            case 3:
-                return 'v3';
-            default:
-                return `unknown(${version})`;
-        }
+    getTrapStats(messageId) {
+        this.messageHandler.sendSuccessResponse(messageId, this.trapStore.getStats(this.decoder), '获取Trap统计成功');
     }
 
     /**
-     * 检查是否为Trap消息
+     * 清空 Trap 历史和聚合计数
      */
-    isTrapMessage(message) {
-        return (
-            message.pduType === SnmpConst.SNMP_PDU_TYPE.TRAP ||
-            message.pduType === SnmpConst.SNMP_PDU_TYPE.SNMPV2_TRAP ||
-            message.pduType === SnmpConst.SNMP_PDU_TYPE.INFORM_REQUEST
-        );
+    clearTrapHistory(messageId) {
+        this.trapStore.clear();
+        this.decoder.reset();
+        this.unsentTraps = 0;
+        logger.info('Trap 历史已清空');
+        this.messageHandler.sendSuccessResponse(messageId, null, 'Trap历史清空成功');
     }
 
     /**
-     * 处理Trap消息
+     * 启动 GETBULK 轮询
      */
-    processTrapMessage(message, rinfo, _rawBuffer) {
+    async startPoll(messageId, config) {
         try {
-            this.trapCounter++;
-
-            const trapData = {
-                id: `trap_${Date.now()}_${this.trapCounter}`,
-                timestamp: new Date().toISOString(),
-                sourceIp: rinfo.address,
-                sourcePort: rinfo.port,
-                version: message.version,
-                community: message.community,
-                pduType: message.pduType,
-                requestId: message.requestId,
-                enterpriseOid: message.enterprise,
-                trapType: this.getTrapType(message),
-                specificType: message.specificTrap,
-                genericType: message.genericTrap,
-                varbinds: message.varbinds,
-                status: 'received',
-                rawData: message.rawData
-            };
-
-            logger.info(`处理Trap: ${trapData.id} 来自 ${rinfo.address}:${rinfo.port}`);
-
-            // 发送Trap接收事件
-            this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, {
-                type: SnmpConst.SNMP_SUB_EVT_TYPES.TRAP_RECEIVED,
-                data: trapData
-            });
+            if (this.poller) {
+                this.stopPolling();
+            }
 
-            // 更新代理信息
-            this.updateAgentInfo(rinfo.address, trapData);
+            this.poller = new SnmpPoller(
+                (agent, root, rows) => this.handlePollRows(agent, root, rows),
+                summary => this.handlePollAgentDone(summary)
+            );
+            await this.poller.start(config);
+            this.messageHandler.sendSuccessResponse(messageId, null, 'SNMP轮询启动成功');
         } catch (error) {
-            logger.error('处理Trap消息失败:', error);
+            logger.error('启动SNMP轮询失败:', error);
+            this.stopPolling();
+            this.messageHandler.sendErrorResponse(messageId, 'SNMP轮询启动失败: ' + error.message);
+        }
+    }
 
-            // 发送Trap错误事件
-            this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, {
-                type: SnmpConst.SNMP_SUB_EVT_TYPES.TRAP_ERROR,
-                data: {
-                    error: error.message,
-                    sourceIp: rinfo.address,
-                    sourcePort: rinfo.port
-                }
-            });
+    stopPoll(messageId) {
+        this.stopPolling();
+        this.messageHandler.sendSuccessResponse(messageId, null, 'SNMP轮询停止成功');
+    }
+
+    getPollStatus(messageId) {
+        const status = this.poller ? this.poller.getStatus() : { running: false };
+        this.messageHandler.sendSuccessResponse(messageId, status, '获取SNMP轮询状态成功');
+    }
+
+    stopPolling() {
+        if (this.poller) {
+            this.poller.stop();
+            this.poller = null;
         }
+        if (this.pollEmitTimer) {
+            clearTimeout(this.pollEmitTimer);
+            this.pollEmitTimer = null;
+        }
+        this.pollRows = [];
+        this.pollRowCount = 0;
+        this.pollDone = [];
     }
 
-    /**
-     * 获取Trap类型
-     */
-    getTrapType(message) {
-        switch (message.pduType) {
-            case SnmpConst.SNMP_PDU_TYPE.TRAP:
-                return 'SNMPv1 Trap';
-            case SnmpConst.SNMP_PDU_TYPE.SNMPV2_TRAP:
-                return 'SNMPv2 Trap';
-            case SnmpConst.SNMP_PDU_TYPE.INFORM_REQUEST:
-                return 'Inform Request';
-            default:
-                return 'Unknown';
+    handlePollRows(agent, root, rows) {
+        this.pollRows.push({ agent, root, rows });
+        this.pollRowCount += rows.length;
+        if (this.pollRowCount >= SnmpConst.SNMP_POLL_BATCH_ROWS) {
+            this.emitPollResults();
+        } else {
+            this.schedulePollEmit();
+        }
+    }
+
+    handlePollAgentDone(summary) {
+        if (summary.error) {
+            logger.warn(`SNMP轮询 ${summary.agent} 第 ${summary.cycle} 轮失败: ${summary.error}`);
+        }
+        this.pollDone.push(summary);
+        this.schedulePollEmit();
+    }
+
+    schedulePollEmit() {
+        if (!this.pollEmitTimer) {
+            this.pollEmitTimer = setTimeout(() => this.emitPollResults(), SnmpConst.SNMP_POLL_EMIT_INTERVAL);
         }
     }
 
     /**
-     * 更新代理信息
+     * 把累计的轮询结果合并成一个事件推送
      */
-    updateAgentInfo(agentIp, trapData) {
-        try {
-            const agentKey = agentIp;
-            let agentInfo = this.agentMap.get(agentKey);
-
-            if (!agentInfo) {
-                agentInfo = {
-                    ip: agentIp,
-                    firstSeen: new Date().toISOString(),
-                    trapCount: 0,
-                    lastTrapTime: null,
-                    status: 'online'
-                };
+    emitPollResults() {
+        if (this.pollEmitTimer) {
+            clearTimeout(this.pollEmitTimer);
+            this.pollEmitTimer = null;
+        }
+        if (this.pollRows.length === 0 && this.pollDone.length === 0) {
+            return;
+        }
 
-                // 发送代理连接事件
-                this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.TRAP_EVT, {
-                    type: SnmpConst.SNMP_SUB_EVT_TYPES.AGENT_CONNECTION,
-                    data: agentInfo
-                });
+        this.messageHandler.sendEvent(SnmpConst.SNMP_EVT_TYPES.POLL_EVT, {
+            type: SnmpConst.SNMP_SUB_EVT_TYPES.POLL_RESULT,
+            data: {
+                results: this.pollRows,
+                completed: this.pollDone
             }
-
-            agentInfo.trapCount++;
-            agentInfo.lastTrapTime = trapData.timestamp;
-            agentInfo.status = 'online';
-
-            this.agentMap.set(agentKey, agentInfo);
-        } catch (error) {
-            logger.error('更新代理信息失败:', error);
-        }
+        });
+        this.pollRows = [];
+        this.pollRowCount = 0;
+        this.pollDone = [];
     }
 
     /**
@@ -348,11 +371,19 @@ class SnmpWorker {
                 this.ipv6Server = null;
             }
 
+            if (this.emitTimer) {
+                clearTimeout(this.emitTimer);
+                this.emitTimer = null;
+            }
+            this.stopPolling();
+
             // 清空配置和会话
             this.snmpConfig = null;
             this.sessionMap.clear();
-            this.agentMap.clear();
-            this.trapCounter = 0;
+            this.pending = [];
+            this.unsentTraps = 0;
+            this.trapStore.clear();
+            this.decoder.reset();
 
             logger.info('SNMP服务器停止成功');
             this.messageHandler.sendSuccessResponse(messageId, null, 'SNMP协议停止成功');
@@ -2,6 +2,13 @@ const { Client } = require('ssh2');
 const logger = require('../log/logger');
 const { EventEmitter } = require('events');
 
+// 远程代理守护进程: 每种认证方式一个常驻 helper，所有协议的监听端口和 peer 通过控制 socket 增删
+const PROXY_DAEMON_SCRIPTS = {
+    md5: '/opt/tcp-md5-proxy/tcp-md5-proxy.sh',
+    ao: '/opt/tcp-ao-proxy/tcp-ao-proxy.sh'
+};
+const PROXY_CONTROL_TIMEOUT = 10000;
+
 /**
  * SSH Tunnel for BMP MD5 Authentication
  * Creates SSH tunnel and manages remote TCP MD5 proxy
@@ -12,6 +19,7 @@ class SshTunnel extends EventEmitter {
         this.conn = null;
         this.tunnelActive = false;
         this.proxyPid = null;
+        this.controlChannels = new Map(); // 'md5' | 'ao' -> Promise<channel>
     }
 
     /**
@@ -116,66 +124,177 @@ class SshTunnel extends EventEmitter {
     }
 
     /**
-     * Start TCP proxy on remote server (MD5 or TCP-AO)
+     * Get (or open) the control channel of the proxy daemon
+     * 整个 SSH 连接上每种认证方式只开一个 exec 通道，命令逐行写入，应答按顺序逐行返回
      */
-    async startProxy(protocol, peerIp, config, listenPort, forwardAddr) {
-        // config 可以是:
-        // - 字符串: MD5 密码（TCP MD5 模式）
-        // - 对象: { useTcpAo: true, tcpAoKeysJson: '[...]' } (TCP-AO 模式)
+    getControlChannel(useTcpAo) {
+        const kind = useTcpAo ? 'ao' : 'md5';
+        let channelPromise = this.controlChannels.get(kind);
+        if (channelPromise) {
+            return channelPromise;
+        }
 
-        const useTcpAo = typeof config === 'object' && config.useTcpAo;
+        channelPromise = new Promise((resolve, reject) => {
+            if (!this.conn) {
+                reject(new Error('SSH not connected'));
+                return;
+            }
 
-        if (useTcpAo) {
-            logger.info(`Starting ${protocol.toUpperCase()} TCP-AO proxy for peer ${peerIp} on port ${listenPort}`);
+            this.conn.exec(`${PROXY_DAEMON_SCRIPTS[kind]} daemon control`, (err, stream) => {
+                if (err) {
+                    reject(err);
+                    return;
+                }
+
+                const channel = { kind, stream, pending: [], buffer: '' };
 
-            // 使用 TCP-AO 代理
-            const tcpAoKeysJson = config.tcpAoKeysJson;
-            const startCmd = `/opt/tcp-ao-proxy/tcp-ao-proxy.sh ${protocol} "${peerIp}" '${tcpAoKeysJson}' ${listenPort} "${forwardAddr}" start`;
+                stream.on('data', data => {
+                    channel.buffer += data.toString();
+                    let index;
+                    while ((index = channel.buffer.indexOf('\n')) >= 0) {
+                        const line = channel.buffer.slice(0, index).trim();
+                        channel.buffer = channel.buffer.slice(index + 1);
+                        this.handleControlReply(channel, line);
+                    }
+                });
 
-            const result = await this.execCommand(startCmd);
-            logger.info(`TCP-AO proxy start result: ${result}`);
+                stream.stderr.on('data', data => {
+                    logger.warn(`Proxy control (${kind}) stderr: ${data.toString().trim()}`);
+                });
 
-            // Wait a bit for proxy to start
-            await new Promise(resolve => setTimeout(resolve, 2000));
+                stream.on('close', () => {
+                    logger.info(`Proxy control channel (${kind}) closed`);
+                    if (this.controlChannels.get(kind) === channelPromise) {
+                        this.controlChannels.delete(kind);
+                    }
+                    for (const request of channel.pending.splice(0)) {
+                        clearTimeout(request.timer);
+                        request.reject(new Error('Proxy control channel closed'));
+                    }
+                });
 
-            // Verify proxy is running
-            const statusCmd = `/opt/tcp-ao-proxy/tcp-ao-proxy.sh ${protocol} "${peerIp}" '${tcpAoKeysJson}' ${listenPort} "${forwardAddr}" status`;
-            const status = await this.execCommand(statusCmd);
+                logger.info(`Proxy control channel (${kind}) opened`);
+                resolve(channel);
+            });
+        });
 
-            if (!status.includes('running')) {
-                throw new Error(`${protocol.toUpperCase()} TCP-AO proxy failed to start`);
+        this.controlChannels.set(kind, channelPromise);
+        channelPromise.catch(() => {
+            if (this.controlChannels.get(kind) === channelPromise) {
+                this.controlChannels.delete(kind);
             }
+        });
+        return channelPromise;
+    }
 
-            logger.info(`${protocol.toUpperCase()} TCP-AO proxy started successfully`);
-        } else {
-            // 使用 TCP MD5 代理
-            const md5Password = typeof config === 'string' ? config : config.md5Password;
-            logger.info(`Starting ${protocol.toUpperCase()} TCP MD5 proxy for peer ${peerIp} on port ${listenPort}`);
+    handleControlReply(channel, line) {
+        // 只有 OK/ERR 开头的行是应答
+        const isOk = line.startsWith('OK');
+        if (!isOk && !line.startsWith('ERR')) {
+            if (line) {
+                logger.info(`Proxy control (${channel.kind}): ${line}`);
+            }
+            return;
+        }
 
-            // Start the proxy script with protocol parameter
-            const startCmd = `/opt/tcp-md5-proxy/tcp-md5-proxy.sh ${protocol} "${peerIp}" "${md5Password}" ${listenPort} "${forwardAddr}" start`;
+        const request = channel.pending.shift();
+        if (!request) {
+            logger.warn(`Unexpected proxy control reply: ${line}`);
+            return;
+        }
+        clearTimeout(request.timer);
 
-            const result = await this.execCommand(startCmd);
-            logger.info(`Proxy start result: ${result}`);
+        const body = line.slice(isOk ? 2 : 3).trim();
+        if (!isOk) {
+            request.reject(new Error(body || 'Proxy control command failed'));
+            return;
+        }
+        try {
+            request.resolve(body ? JSON.parse(body) : {});
+        } catch (error) {
+            request.reject(new Error(`Invalid proxy control reply: ${body}`));
+        }
+    }
 
-            // Wait a bit for proxy to start
-            await new Promise(resolve => setTimeout(resolve, 1000));
+    /**
+     * Reject commands that would not travel as exactly one control line
+     * 密钥等参数中的换行会把一条命令拆成两条，后一条被当作独立命令执行，应答也随之错位
+     */
+    static checkControlCommand(command) {
+        for (let i = 0; i < command.length; i++) {
+            const code = command.charCodeAt(i);
+            if (code < 0x20 || code === 0x7f) {
+                throw new Error('Proxy control arguments must not contain control characters');
+            }
+        }
+    }
 
-            // Verify proxy is running
-            const statusCmd = `/opt/tcp-md5-proxy/tcp-md5-proxy.sh ${protocol} "${peerIp}" "${md5Password}" ${listenPort} "${forwardAddr}" status`;
-            const status = await this.execCommand(statusCmd);
+    /**
+     * Send one command to the proxy daemon and wait for its reply
+     */
+    async sendControlCommand(useTcpAo, command) {
+        SshTunnel.checkControlCommand(command);
+        const channel = await this.getControlChannel(useTcpAo);
+        // 日志中不输出密钥
+        logger.info(`Proxy control (${channel.kind}): ${command.split(' ').slice(0, 2).join(' ')}`);
 
-            if (!status.includes('running')) {
-                throw new Error(`${protocol.toUpperCase()} proxy failed to start`);
-            }
+        return new Promise((resolve, reject) => {
+            const request = { resolve, reject, timer: null };
+            request.timer = setTimeout(() => {
+                // 应答与请求按顺序对应，超时后无法再对齐，关闭通道让后续命令重新打开
+                reject(new Error(`Proxy control command timed out: ${command.split(' ')[0]}`));
+                channel.stream.close();
+            }, PROXY_CONTROL_TIMEOUT);
+            channel.pending.push(request);
+            channel.stream.write(`${command}\n`);
+        });
+    }
 
-            logger.info(`${protocol.toUpperCase()} proxy started successfully`);
+    static getProxySecret(config) {
+        if (typeof config === 'object' && config.useTcpAo) {
+            return config.tcpAoKeysJson;
         }
+        return typeof config === 'string' ? config : config.md5Password;
     }
+
+    /**
+     * Start TCP proxy on remote server (MD5 or TCP-AO)
+     */
+    async startProxy(protocol, peerIp, config, listenPort, forwardAddr) {
+        // config 可以是:
+        // - 字符串: MD5 密码（TCP MD5 模式）
+        // - 对象: { useTcpAo: true, tcpAoKeysJson: '[...]' } (TCP-AO 模式)
+
+        const useTcpAo = typeof config === 'object' && config.useTcpAo;
+        const authType = useTcpAo ? 'TCP-AO' : 'TCP MD5';
+        logger.info(`Starting ${protocol.toUpperCase()} ${authType} proxy for peer ${peerIp} on port ${listenPort}`);
+
+        // 守护进程在监听端口绑定成功后才应答，无需等待和轮询状态
+        const secret = SshTunnel.getProxySecret(config);
+        await this.sendControlCommand(useTcpAo, `ADD ${protocol} ${listenPort} ${forwardAddr} ${peerIp} ${secret}`);
+
+        logger.info(`${protocol.toUpperCase()} ${authType} proxy started successfully`);
+    }
+
+    /**
+     * Keep router sessions of new connections open while the forward leg reconnects
+     * 断线期间的数据先存内存 (memMb) 再溢出到 spillDir 下的临时文件 (diskMb)，collector 需支持续传握手，
+     * 见 utils/proxyResumeUtils.js；spillDir 为 '-' 时只用内存
+     */
+    async enableProxyResume(
+        protocol,
+        spillDir = '/var/tmp',
+        { memMb = 0, diskMb = 0, maxOutageSeconds = 0 } = {},
+        useTcpAo = false
+    ) {
+        await this.sendControlCommand(useTcpAo, `RESUME ${protocol} ${spillDir} ${memMb} ${diskMb} ${maxOutageSeconds}`);
+        logger.info(`${protocol.toUpperCase()} proxy resumable forwarding enabled (spill to ${spillDir})`);
+    }
+
     /**
      * Stop TCP proxy on remote server (MD5 or TCP-AO)
      */
-    async stopProxy(protocol, peerIp, config, listenPort, forwardAddr) {
+    async stopProxy(protocol, peerIp, config, _listenPort, _forwardAddr) {
         if (!this.conn) {
             return;
         }
@@ -190,20 +309,9 @@ class SshTunnel extends EventEmitter {
 
         try {
             const useTcpAo = typeof config === 'object' && config.useTcpAo;
-
-            if (useTcpAo) {
-                // 停止 TCP-AO 代理
-                const tcpAoKeysJson = config.tcpAoKeysJson;
-                const stopCmd = `/opt/tcp-ao-proxy/tcp-ao-proxy.sh ${protocol} "${peerIp}" '${tcpAoKeysJson}' ${listenPort} "${forwardAddr}" stop`;
-                const result = await this.execCommand(stopCmd);
-                logger.info(`TCP-AO proxy stop result: ${result}`);
-            } else {
-                // 停止 TCP MD5 代理
-                const md5Password = typeof config === 'string' ? config : config.md5Password;
-                const stopCmd = `/opt/tcp-md5-proxy/tcp-md5-proxy.sh ${protocol} "${peerIp}" "${md5Password}" ${listenPort} "${forwardAddr}" stop`;
-                const result = await this.execCommand(stopCmd);
-                logger.info(`TCP MD5 proxy stop result: ${result}`);
-            }
+            // 删除 peer，最后一个 peer 删除时守护进程同时关闭该协议的监听端口
+            await this.sendControlCommand(useTcpAo, `REMOVE ${protocol} ${peerIp}`);
+            logger.info(`${protocol.toUpperCase()} proxy stopped`);
         } catch (error) {
             logger.error(`Error stopping proxy: ${error.message}`);
         }
@@ -287,6 +395,17 @@ class SshTunnel extends EventEmitter {
         // Stop proxy first
         await this.stopProxy();
 
+        // 关闭控制通道，守护进程继续运行
+        for (const channelPromise of this.controlChannels.values()) {
+            try {
+                const channel = await channelPromise;
+                channel.stream.end();
+            } catch (error) {
+                // Channel failed to open, nothing to close
+            }
+        }
+        this.controlChannels.clear();
+
         // Close SSH connection
         if (this.conn) {
             this.conn.end();
@@ -0,0 +1,148 @@
+#!/usr/bin/env node
+/**
+ * BGP 会话数压测脚本
+ *
+ * 在一个进程内创建大量已建立的 BgpSession(假 socket)，挂在 worker 使用的同一种定时轮上，
+ * 会话的建立时间均匀分布在一个 KEEPALIVE 间隔内。按虚拟时钟推进: 每个 tick 先把到期的对端 KEEPALIVE
+ * 交给 recvMsg，再推进定时轮发送本端 KEEPALIVE。
+ * 统计不同会话数下的内存、每模拟秒的 CPU 时间和单次推进的最长耗时(事件循环被占用的时间)。
+ * 不经过真实的 TCP 和内核，只衡量会话定时器和 KEEPALIVE 处理随会话数增长的开销。
+ *
+ * 使用方法：
+ *   node --expose-gc scripts/benchBgpSessions.js [选项]
+ *
+ * 选项：
+ *   --sessions <list>  会话数，逗号分隔，默认 1000,10000,50000
+ *   --hold <s>         协商的保持时间(秒)，KEEPALIVE 间隔为其三分之一，默认 90
+ *   --seconds <s>      模拟时长(秒)，默认 300
+ *
+ * 示例：
+ *   node --expose-gc scripts/benchBgpSessions.js --sessions 1000,100000 --hold 9 --seconds 60
+ */
+
+'use strict';
+
+const BgpConst = require('../electron/const/bgpConst');
+const BgpSession = require('../electron/worker/bgpSession');
+const TimerWheel = require('../electron/utils/timerWheel');
+
+function parseArgs(argv) {
+    const options = { sessions: [1000, 10000, 50000], hold: 90, seconds: 300 };
+    for (let i = 0; i < argv.length; i++) {
+        const value = argv[i + 1];
+        switch (argv[i]) {
+            case '--sessions':
+                options.sessions = value.split(',').map(n => parseInt(n, 10));
+                i++;
+                break;
+            case '--hold':
+                options.hold = parseInt(value, 10);
+                i++;
+                break;
+            case '--seconds':
+                options.seconds = parseInt(value, 10);
+                i++;
+                break;
+            default:
+                console.error(`未知选项: ${argv[i]}`);
+                process.exit(1);
+        }
+    }
+    return options;
+}
+
+// 定时轮和会话都通过 Date.now() 取时间，换成虚拟时钟后无需真实等待
+let virtualNow = Date.now();
+Date.now = () => virtualNow;
+
+function heapUsedMb() {
+    if (global.gc) {
+        global.gc();
+    }
+    return process.memoryUsage().heapUsed / 1024 / 1024;
+}
+
+function run(count, hold, seconds) {
+    const tickMs = BgpConst.BGP_TIMER_TICK;
+    const keepAliveTicks = Math.max(1, Math.floor(hold / 3)) * (1000 / tickMs);
+    const keepAlive = Buffer.alloc(BgpConst.BGP_HEAD_LEN, 0xff);
+    keepAlive.writeUInt16BE(BgpConst.BGP_HEAD_LEN, BgpConst.BGP_MARKER_LEN);
+    keepAlive[BgpConst.BGP_MARKER_LEN + 2] = BgpConst.BGP_PACKET_TYPE.KEEPALIVE;
+
+    let sent = 0;
+    let dropped = 0;
+    const socket = {
+        write: () => {
+            sent++;
+        },
+        destroy: () => {
+            dropped++;
+        }
+    };
+
+    const heapBefore = heapUsedMb();
+    const setupStart = process.hrtime.bigint();
+    const wheel = new TimerWheel(tickMs);
+    // 会话逐批建立，对端 KEEPALIVE 也按建立时间错开
+    const peerBuckets = Array.from({ length: keepAliveTicks }, () => []);
+    const perTick = Math.ceil(count / keepAliveTicks);
+    const sessions = [];
+    for (let i = 0; i < count; i++) {
+        if (i % perTick === 0 && i > 0) {
+            virtualNow += tickMs;
+            wheel.advance();
+        }
+        const session = new BgpSession(0, `10.${(i >> 16) & 0xff}.${(i >> 8) & 0xff}.${i & 0xff}`, new Map(), null);
+        session.setTimerWheel(wheel);
+        session.socket = socket;
+        session.sessState = BgpConst.BGP_PEER_STATE.ESTABLISHED;
+        session.lastRecvTime = Date.now();
+        session.startTimers(hold, true);
+        sessions.push(session);
+        peerBuckets[Math.floor(i / perTick)].push(session);
+    }
+    const setupMs = Number(process.hrtime.bigint() - setupStart) / 1e6;
+    const heapMb = heapUsedMb() - heapBefore;
+
+    const ticks = (seconds * 1000) / tickMs;
+    let maxTickMs = 0;
+    const cpuStart = process.cpuUsage();
+    for (let tick = 0; tick < ticks; tick++) {
+        const tickStart = process.hrtime.bigint();
+        virtualNow += tickMs;
+        for (const session of peerBuckets[tick % keepAliveTicks]) {
+            session.recvMsg(keepAlive);
+        }
+        wheel.advance();
+        maxTickMs = Math.max(maxTickMs, Number(process.hrtime.bigint() - tickStart) / 1e6);
+    }
+    const cpu = process.cpuUsage(cpuStart);
+    const cpuMs = (cpu.user + cpu.system) / 1000;
+
+    for (const session of sessions) {
+        session.stopTimers();
+    }
+    return {
+        sessions: count,
+        setupMs: setupMs.toFixed(0),
+        heapMb: heapMb.toFixed(1),
+        bytesPerSession: Math.round((heapMb * 1024 * 1024) / count),
+        cpuMsPerSecond: (cpuMs / seconds).toFixed(2),
+        maxTickMs: maxTickMs.toFixed(2),
+        keepAlivesSent: sent,
+        expectedKeepAlives: count * Math.floor(ticks / keepAliveTicks),
+        dropped
+    };
+}
+
+function main() {
+    const options = parseArgs(process.argv.slice(2));
+    if (!global.gc) {
+        console.warn('未使用 --expose-gc，内存统计包含未回收的对象');
+    }
+    console.log(`hold ${options.hold}s, 模拟 ${options.seconds}s, tick ${BgpConst.BGP_TIMER_TICK}ms`);
+    const results = options.sessions.map(count => run(count, options.hold, options.seconds));
+    console.table(results);
+}
+
+main();
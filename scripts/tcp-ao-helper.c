@@ -8,9 +8,13 @@
  * - 无缝密钥轮换
  * - 支持多种算法 (HMAC-SHA-1, HMAC-SHA-256)
  * - 定时检查并更新密钥配置
+ * - 已建立的会话同步密钥变化, 通过 RNext 协调切换发送密钥, 无需重连
+ * - SESSIONS 中导出每个会话的 current/RNext KeyID 和各密钥的验证计数
  * 
- * 编译: gcc -o tcp-ao-helper tcp-ao-helper.c tcp-ao-json-parser.c
- * 使用: ./tcp-ao-helper <peer_ip> <keys_json> <listen_port> <forward_addr> [key_rotation_interval]
+ * 编译: gcc -pthread -o tcp-ao-helper tcp-ao-helper.c tcp-ao-json-parser.c tcp-proxy-engine.c tcp-proxy-mirror.c tcp-proxy-recorder.c tcp-proxy-resume.c tcp-proxy-sched.c tcp-proxy-latency.c tcp-proxy-fastpath.c tcp-proxy-bmp.c tcp-proxy-filter.c
+ * 使用: ./tcp-ao-helper [--control <socket_path> [--takeover]] <peer_ip> <keys_json> <listen_port> <forward_addr> [key_rotation_interval]
+ *       ./tcp-ao-helper --control <socket_path> [--takeover] [--rotation <seconds>] --daemon
+ *       ./tcp-ao-helper --control <socket_path> --client
  * 
  * keys_json 格式:
  * [
@@ -19,6 +23,13 @@
  * ]
  * 
  * key_rotation_interval: 密钥轮换检查间隔（秒），默认 60
+ *
+ * 守护进程模式 (--daemon): 不带参数启动, 监听端口和 peer 通过控制 socket 的
+ * ADD/KEYS/REMOVE/MIRROR/RECORD/RESUME/SHAPE/FASTPATH/BMPSTATS/FILTER 命令增删, SESSIONS/STATS/LATENCY 查询状态 (见 tcp-proxy-engine.h);
+ * 客户端模式 (--client) 把 stdin 的命令转发到控制 socket, 应答写到 stdout。
+ *
+ * 热升级: 新版本以 --control <socket_path> --takeover 启动后接管所有监听端口、
+ * peer 密钥和会话, 旧进程随即退出; 指定的位置参数会叠加到接管的配置上。
  */
 
 #include <stdio.h>
@@ -30,18 +41,21 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
 #include <signal.h>
 #include <time.h>
 #include <stdarg.h>
+#include <getopt.h>
 #include <linux/types.h>
 #include <linux/tcp.h>
 
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-probes.h"
+
 #define MAX_KEYS 10
 #define MAX_PASSWORD_LEN 80
 #define MAX_ALG_NAME 64
-#define BUFFER_SIZE 65536
 #define DEFAULT_ROTATION_INTERVAL 60
+#define MAX_SOCKET_KEYS (MAX_KEYS * 2)
 
 // 密钥配置
 typedef struct {
@@ -56,22 +70,26 @@ typedef struct {
     time_t acceptEnd;
 } KeyConfig;
 
+// 每个 peer 的 TCP-AO 密钥状态 (proxy_peer_t.auth)
+typedef struct {
+    KeyConfig keys[MAX_KEYS];
+    int key_count;
+    time_t last_rotation_check;
+} AoPeerAuth;
+
 // 外部 JSON 解析函数
 extern int parse_keys_json(const char* json_str, KeyConfig* keys, int max_keys);
 
 // 函数前向声明
 int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int num_keys);
-int add_single_key(int sock, const char *peer_ip, const KeyConfig *key);
+int add_single_key(int sock, const char *peer_ip, const KeyConfig *key, int set_current);
 int delete_single_key(int sock, const char *peer_ip, const KeyConfig *key);
-int delete_all_keys(int sock, const char *peer_ip);
+int delete_all_keys(int sock, const char *peer_ip, const AoPeerAuth *auth);
 
 // 全局变量
 static volatile sig_atomic_t keep_running = 1;
-static KeyConfig keys[MAX_KEYS];
-static int key_count = 0;
-static char keys_json_str[4096];  // 存储 JSON 字符串用于重新解析
 static int rotation_interval = DEFAULT_ROTATION_INTERVAL;
-static time_t last_rotation_check = 0;
+static time_t last_session_sync = 0;
 
 // 信号处理
 void signal_handler(int signum) {
@@ -92,34 +110,10 @@ void log_message(const char *level, const char *format, ...) {
 }
 
 // 删除所有密钥
-int delete_all_keys(int sock, const char *peer_ip) {
-    struct sockaddr_in peer_addr;
-    memset(&peer_addr, 0, sizeof(peer_addr));
-    peer_addr.sin_family = AF_INET;
-    inet_pton(AF_INET, peer_ip, &peer_addr.sin_addr);
-
-    for (int i = 0; i < key_count; i++) {
-        struct tcp_ao_del ao_del;
-        memset(&ao_del, 0, sizeof(ao_del));
-        memcpy(&ao_del.addr, &peer_addr, sizeof(peer_addr));
-        
-        ao_del.sndid = keys[i].keyId;
-        ao_del.rcvid = keys[i].keyId;
-        ao_del.prefix = 0;
-        ao_del.ifindex = 0;
-        ao_del.set_current = 0;
-        ao_del.set_rnext = 0;
-        ao_del.del_async = 0;
-        ao_del.reserved = 0;
-        ao_del.reserved2 = 0;
-
-        if (setsockopt(sock, IPPROTO_TCP, TCP_AO_DEL_KEY, &ao_del, sizeof(ao_del)) < 0) {
-            log_message("WARN", "Failed to delete key %d: %s", keys[i].keyId, strerror(errno));
-        } else {
-            log_message("INFO", "Deleted key %d", keys[i].keyId);
-        }
+int delete_all_keys(int sock, const char *peer_ip, const AoPeerAuth *auth) {
+    for (int i = 0; i < auth->key_count; i++) {
+        delete_single_key(sock, peer_ip, &auth->keys[i]);
     }
-
     return 0;
 }
 
@@ -139,16 +133,18 @@ int is_key_valid_for_recv(const KeyConfig *key, time_t now) {
 }
 
 // 检查并更新密钥配置
-int check_and_rotate_keys(int sock, const char *peer_ip) {
+int check_and_rotate_keys(int sock, const char *peer_ip, AoPeerAuth *auth) {
     time_t now = time(NULL);
+    KeyConfig *keys = auth->keys;
+    int key_count = auth->key_count;
     
     // 检查是否需要轮换
-    if (now - last_rotation_check < rotation_interval) {
+    if (now - auth->last_rotation_check < rotation_interval) {
         return 0;
     }
     
-    last_rotation_check = now;
-    log_message("INFO", "Checking for key rotation at time %ld...", now);
+    auth->last_rotation_check = now;
+    log_message("INFO", "Checking for key rotation for peer %s at time %ld...", peer_ip, now);
     
     // 检查每个密钥的有效性变化
     int needs_update = 0;
@@ -182,11 +178,14 @@ int check_and_rotate_keys(int sock, const char *peer_ip) {
     log_message("INFO", "Key validity changed, performing seamless rotation...");
     
     // 第一步：先添加新生效的密钥（无缝切换的关键）
+    int added = 0, removed = 0;
     for (int i = 0; i < key_count; i++) {
         if (keys_to_add[i]) {
             log_message("INFO", "Adding newly valid key %d", keys[i].keyId);
-            if (add_single_key(sock, peer_ip, &keys[i]) < 0) {
+            if (add_single_key(sock, peer_ip, &keys[i], 1) < 0) {
                 log_message("ERROR", "Failed to add key %d", keys[i].keyId);
+            } else {
+                added++;
             }
         }
     }
@@ -197,16 +196,19 @@ int check_and_rotate_keys(int sock, const char *peer_ip) {
             log_message("INFO", "Removing expired key %d", keys[i].keyId);
             if (delete_single_key(sock, peer_ip, &keys[i]) < 0) {
                 log_message("ERROR", "Failed to remove key %d", keys[i].keyId);
+            } else {
+                removed++;
             }
         }
     }
     
+    PROXY_PROBE4(key_rotate, sock, peer_ip, added, removed);
     log_message("INFO", "Seamless key rotation completed");
     return 0;
 }
 
-// 添加单个密钥
-int add_single_key(int sock, const char *peer_ip, const KeyConfig *key) {
+// 添加单个密钥; 已建立的连接上 set_current 为 0, 发送密钥由 RNext 协调切换
+int add_single_key(int sock, const char *peer_ip, const KeyConfig *key, int set_current) {
     struct sockaddr_in peer_addr;
     memset(&peer_addr, 0, sizeof(peer_addr));
     peer_addr.sin_family = AF_INET;
@@ -240,7 +242,7 @@ int add_single_key(int sock, const char *peer_ip, const KeyConfig *key) {
     
     ao_add.sndid = key->keyId;
     ao_add.rcvid = key->keyId;
-    ao_add.set_current = 1;
+    ao_add.set_current = set_current ? 1 : 0;
     ao_add.set_rnext = 0;
     ao_add.prefix = 32;
     ao_add.maclen = 0;
@@ -256,6 +258,7 @@ int add_single_key(int sock, const char *peer_ip, const KeyConfig *key) {
     }
 
     log_message("INFO", "Successfully added key %d", key->keyId);
+    PROXY_PROBE3(key_add, sock, peer_ip, key->keyId);
     return 0;
 }
 
@@ -286,9 +289,21 @@ int delete_single_key(int sock, const char *peer_ip, const KeyConfig *key) {
     }
     
     log_message("INFO", "Deleted key %d", key->keyId);
+    PROXY_PROBE3(key_del, sock, peer_ip, key->keyId);
     return 0;
 }
 
+// 当前可发送的密钥中 KeyID 最大的一个, 没有时返回 -1
+static int newest_send_key(const KeyConfig *keys, int num_keys, time_t now) {
+    int newest = -1;
+    for (int i = 0; i < num_keys; i++) {
+        if (is_key_valid_for_send(&keys[i], now) && (newest == -1 || keys[i].keyId > keys[newest].keyId)) {
+            newest = i;
+        }
+    }
+    return newest;
+}
+
 // 配置 TCP-AO 密钥
 int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int num_keys) {
     struct sockaddr_in peer_addr;
@@ -300,18 +315,10 @@ int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int
     log_message("INFO", "Configuring TCP-AO keys for peer %s at time %ld", peer_ip, now);
 
     // 找出最新的可发送密钥（KeyID 最大的）
-    int newest_send_key = -1;
-    for (int i = 0; i < num_keys; i++) {
-        if (is_key_valid_for_send(&key_configs[i], now)) {
-            if (newest_send_key == -1 || key_configs[i].keyId > key_configs[newest_send_key].keyId) {
-                newest_send_key = i;
-            }
-        }
-    }
-
-    if (newest_send_key >= 0) {
+    int newest = newest_send_key(key_configs, num_keys, now);
+    if (newest >= 0) {
         log_message("INFO", "Key %d will be used for sending (newest valid send key)", 
-                   key_configs[newest_send_key].keyId);
+                   key_configs[newest].keyId);
     }
 
     int configured_count = 0;
@@ -326,7 +333,7 @@ int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int
         }
         
         // 是否是当前发送密钥
-        int is_current = (i == newest_send_key);
+        int is_current = (i == newest);
         
         log_message("INFO", "Key %d: send=%d, recv=%d, current=%d", 
                    key_configs[i].keyId, can_send, can_recv, is_current);
@@ -397,6 +404,7 @@ int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int
 
         log_message("INFO", "Successfully added TCP-AO key %d%s", 
                    key_configs[i].keyId, is_current ? " (CURRENT for sending)" : "");
+        PROXY_PROBE3(key_add, sock, peer_ip, key_configs[i].keyId);
         configured_count++;
     }
 
@@ -409,201 +417,404 @@ int configure_tcp_ao(int sock, const char *peer_ip, KeyConfig *key_configs, int
     return 0;
 }
 
-// 转发数据
-void forward_data(int from_sock, int to_sock, const char *direction) {
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read, bytes_written, total_written;
+// 解析 peer 的密钥 JSON
+static AoPeerAuth *parse_peer_auth(const char *peer_ip, const char *keys_json) {
+    AoPeerAuth *auth = calloc(1, sizeof(AoPeerAuth));
+    if (!auth) {
+        return NULL;
+    }
 
-    bytes_read = recv(from_sock, buffer, sizeof(buffer), 0);
-    if (bytes_read <= 0) {
-        if (bytes_read < 0) {
-            log_message("ERROR", "Receive error (%s): %s", direction, strerror(errno));
-        }
+    auth->key_count = parse_keys_json(keys_json, auth->keys, MAX_KEYS);
+    if (auth->key_count < 0) {
+        log_message("ERROR", "Failed to parse keys JSON for peer %s", peer_ip);
+        free(auth);
+        return NULL;
+    }
+
+    log_message("INFO", "Parsed %d keys for peer %s", auth->key_count, peer_ip);
+    for (int i = 0; i < auth->key_count; i++) {
+        log_message("INFO", "Key %d: ID=%d, Algorithm=%s",
+                   i, auth->keys[i].keyId, auth->keys[i].algorithm);
+        log_message("INFO", "  Send: %ld - %ld, Accept: %ld - %ld",
+                   auth->keys[i].sendStart, auth->keys[i].sendEnd, 
+                   auth->keys[i].acceptStart, auth->keys[i].acceptEnd);
+    }
+    auth->last_rotation_check = time(NULL);
+    return auth;
+}
+
+static const KeyConfig *find_key(const AoPeerAuth *auth, int key_id) {
+    for (int i = 0; i < auth->key_count; i++) {
+        if (auth->keys[i].keyId == key_id) return &auth->keys[i];
+    }
+    return NULL;
+}
+
+static int key_is_valid(const KeyConfig *key, time_t now) {
+    return key && (is_key_valid_for_send(key, now) || is_key_valid_for_recv(key, now));
+}
+
+// 已建立连接上的 TCP-AO 状态: 连接级计数和 current/RNext, 以及每个密钥的计数
+typedef struct {
+    struct tcp_ao_info_opt info;
+    struct tcp_ao_getsockopt keys[MAX_SOCKET_KEYS];
+    int key_count;
+} AoSocketState;
+
+static int read_socket_state(int sock, AoSocketState *st) {
+    socklen_t len = sizeof(st->info);
+    memset(st, 0, sizeof(*st));
+    if (getsockopt(sock, IPPROTO_TCP, TCP_AO_INFO, &st->info, &len) < 0) {
+        return -1;
+    }
+
+    // optlen 是单个结构的大小 (内核按它计算各密钥的间隔), 缓冲区容量由 nkeys 给出
+    st->keys[0].nkeys = MAX_SOCKET_KEYS;
+    st->keys[0].get_all = 1;
+    len = sizeof(st->keys[0]);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_AO_GET_KEYS, st->keys, &len) < 0) {
+        return -1;
+    }
+    st->key_count = st->keys[0].nkeys < MAX_SOCKET_KEYS ? (int)st->keys[0].nkeys : MAX_SOCKET_KEYS;
+    return 0;
+}
+
+static const struct tcp_ao_getsockopt *socket_key(const AoSocketState *st, int key_id) {
+    for (int i = 0; i < st->key_count; i++) {
+        if (st->keys[i].sndid == key_id) return &st->keys[i];
+    }
+    return NULL;
+}
+
+/*
+ * 把已建立连接上的密钥同步为当前配置:
+ * 1. 补装新生效的密钥, 不设为 current
+ * 2. RNext 指向最新的发送密钥, router 据此改用新密钥发送; router 回应的 RNext 又使本端 current 随之切换
+ * 3. 本端 current 已过发送期或已从配置中删除时, 不再等待 router, 直接切换
+ * 4. 删除已失效的密钥; 仍是 current 或 RNext 的内核不允许删除, 留到下次同步
+ */
+static void sync_session_keys(proxy_session_t *s, const AoPeerAuth *auth, time_t now) {
+    int fd = s->peer_ep.fd;
+    AoSocketState st;
+    int added = 0, removed = 0;
+
+    if (read_socket_state(fd, &st) < 0) {
+        log_message("WARN", "Session %u: failed to read TCP-AO state: %s", s->id, strerror(errno));
         return;
     }
 
-    total_written = 0;
-    while (total_written < bytes_read) {
-        bytes_written = send(to_sock, buffer + total_written, 
-                           bytes_read - total_written, MSG_NOSIGNAL);
-        if (bytes_written < 0) {
-            log_message("ERROR", "Send error (%s): %s", direction, strerror(errno));
-            return;
+    for (int i = 0; i < auth->key_count; i++) {
+        const KeyConfig *key = &auth->keys[i];
+        if (key_is_valid(key, now) && !socket_key(&st, key->keyId) && add_single_key(fd, s->peer_ip, key, 0) == 0) {
+            added++;
         }
-        total_written += bytes_written;
     }
 
-    log_message("DEBUG", "Forwarded %zd bytes (%s)", bytes_read, direction);
+    int newest = newest_send_key(auth->keys, auth->key_count, now);
+    if (newest >= 0) {
+        int want = auth->keys[newest].keyId;
+        const KeyConfig *current = st.info.set_current ? find_key(auth, st.info.current_key) : NULL;
+        struct tcp_ao_info_opt opt;
+        memset(&opt, 0, sizeof(opt));
+
+        if (!st.info.set_rnext || st.info.rnext != want) {
+            opt.set_rnext = 1;
+            opt.rnext = want;
+        }
+        if (!current || !is_key_valid_for_send(current, now)) {
+            opt.set_current = 1;
+            opt.current_key = want;
+        }
+
+        if (opt.set_rnext || opt.set_current) {
+            if (setsockopt(fd, IPPROTO_TCP, TCP_AO_INFO, &opt, sizeof(opt)) < 0) {
+                log_message("WARN", "Session %u: failed to switch to key %d: %s", s->id, want, strerror(errno));
+            } else {
+                if (opt.set_current) {
+                    st.info.set_current = 1;
+                    st.info.current_key = want;
+                }
+                if (opt.set_rnext) {
+                    st.info.set_rnext = 1;
+                    st.info.rnext = want;
+                }
+                log_message("INFO", "Session %u (peer %s): current key %d, RNext %d%s", s->id, s->peer_ip,
+                           st.info.current_key, st.info.rnext, opt.set_current ? " (forced)" : "");
+                PROXY_PROBE4(key_switch, fd, s->peer_ip, st.info.current_key, st.info.rnext);
+            }
+        }
+    }
+
+    for (int i = 0; i < st.key_count; i++) {
+        KeyConfig stale = { .keyId = st.keys[i].sndid };
+        const KeyConfig *key = find_key(auth, stale.keyId);
+        if (key_is_valid(key, now)) {
+            continue;
+        }
+        // 本 helper 安装的密钥 sndid 与 rcvid 都是 KeyID, current/RNext 与 want 一样按 KeyID 比较
+        if ((st.info.set_current && st.info.current_key == stale.keyId) ||
+            (st.info.set_rnext && st.info.rnext == stale.keyId)) {
+            log_message("DEBUG", "Session %u: key %d expired but still in use, retrying later", s->id, stale.keyId);
+            continue;
+        }
+        if (delete_single_key(fd, s->peer_ip, &stale) == 0) {
+            removed++;
+        }
+    }
+
+    if (added || removed) {
+        log_message("INFO", "Session %u (peer %s): %d keys added, %d removed", s->id, s->peer_ip, added, removed);
+        PROXY_PROBE4(key_rotate, fd, s->peer_ip, added, removed);
+    }
 }
 
-// 主代理逻辑
-int run_proxy(const char *peer_ip, const char *listen_port, const char *forward_addr) {
-    int listen_sock, peer_sock, forward_sock;
-    struct sockaddr_in listen_addr, forward_addr_struct;
-    int opt = 1;
-
-    // 解析转发地址
-    char forward_ip[256];
-    int forward_port;
-    if (sscanf(forward_addr, "%[^:]:%d", forward_ip, &forward_port) != 2) {
-        log_message("ERROR", "Invalid forward address format: %s", forward_addr);
+static void sync_peer_sessions(proxy_engine_t *engine, const proxy_peer_t *peer, time_t now) {
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (s->peer == peer && s->peer_ep.fd >= 0) {
+            sync_session_keys(s, peer->auth, now);
+        }
+    }
+}
+
+static int ao_install(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, int adopted) {
+    (void)engine;
+    if (peer->family != AF_INET) {
+        log_message("ERROR", "TCP-AO helper supports IPv4 peers only: %s", peer->ip);
         return -1;
     }
 
-    // 创建监听 socket
-    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_sock < 0) {
-        log_message("ERROR", "Failed to create listen socket: %s", strerror(errno));
+    AoPeerAuth *auth = parse_peer_auth(peer->ip, peer->secret);
+    if (!auth) {
         return -1;
     }
 
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // 接管的监听 socket 上已有相同 KeyID 的密钥, 先删除再按当前配置添加
+    if (adopted) {
+        delete_all_keys(listen_fd, peer->ip, auth);
+    }
 
-    // *** 关键：必须在 bind() 之前配置 TCP-AO 密钥 ***
-    log_message("INFO", "Configuring TCP-AO keys BEFORE bind...");
-    if (configure_tcp_ao(listen_sock, peer_ip, keys, key_count) < 0) {
-        log_message("ERROR", "Failed to configure TCP-AO keys");
-        close(listen_sock);
+    if (configure_tcp_ao(listen_fd, peer->ip, auth->keys, auth->key_count) < 0) {
+        log_message("ERROR", "Failed to configure TCP-AO keys for peer %s", peer->ip);
+        free(auth);
         return -1;
     }
 
-    // 绑定监听地址
-    memset(&listen_addr, 0, sizeof(listen_addr));
-    listen_addr.sin_family = AF_INET;
-    listen_addr.sin_addr.s_addr = INADDR_ANY;
-    listen_addr.sin_port = htons(atoi(listen_port));
+    peer->auth = auth;
+    return 0;
+}
 
-    if (bind(listen_sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0) {
-        log_message("ERROR", "Failed to bind: %s", strerror(errno));
-        close(listen_sock);
-        return -1;
+static void ao_uninstall(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer) {
+    (void)engine;
+    AoPeerAuth *auth = peer->auth;
+    if (!auth) {
+        return;
+    }
+    if (listen_fd >= 0) {
+        delete_all_keys(listen_fd, peer->ip, auth);
     }
+    free(auth);
+    peer->auth = NULL;
+}
 
-    if (listen(listen_sock, 5) < 0) {
-        log_message("ERROR", "Failed to listen: %s", strerror(errno));
-        close(listen_sock);
+// 更新密钥: 与时间轮换相同, 先添加新密钥再删除旧密钥, 新连接不会遇到无密钥的窗口; 已建立的会话随后同步
+// 已有 KeyID 的密码或算法不能原地修改: 会话上正在使用的密钥删不掉, 两端会对同一 KeyID 算出不同的 MAC,
+// 只能用新的 KeyID 轮换
+static int ao_update(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, const char *secret,
+                     char *err, size_t err_len) {
+    AoPeerAuth *old_auth = peer->auth;
+    AoPeerAuth *new_auth = parse_peer_auth(peer->ip, secret);
+    int added = 0, removed = 0;
+    if (!new_auth) {
         return -1;
     }
 
-    log_message("INFO", "TCP-AO proxy listening on port %s", listen_port);
-    log_message("INFO", "Forwarding to %s, expecting connections from %s", forward_addr, peer_ip);
+    for (int i = 0; old_auth && i < new_auth->key_count; i++) {
+        const KeyConfig *key = &new_auth->keys[i];
+        const KeyConfig *old_key = find_key(old_auth, key->keyId);
+        if (old_key && (strcmp(old_key->password, key->password) != 0 ||
+                        strcmp(old_key->algorithm, key->algorithm) != 0)) {
+            snprintf(err, err_len, "key %d already exists with a different password or algorithm, "
+                     "rotate to a new KeyID instead", key->keyId);
+            log_message("ERROR", "Peer %s: %s", peer->ip, err);
+            free(new_auth);
+            return -1;
+        }
+    }
 
-    // 接受连接
-    while (keep_running) {
-        fd_set read_fds;
-        struct timeval tv;
-        
-        FD_ZERO(&read_fds);
-        FD_SET(listen_sock, &read_fds);
-        
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        
-        int activity = select(listen_sock + 1, &read_fds, NULL, NULL, &tv);
-        
-        if (activity < 0 && errno != EINTR) {
-            log_message("ERROR", "Select error: %s", strerror(errno));
-            break;
+    for (int i = 0; i < new_auth->key_count; i++) {
+        const KeyConfig *key = &new_auth->keys[i];
+        if (old_auth && find_key(old_auth, key->keyId)) {
+            continue;
         }
-        
-        if (activity > 0 && FD_ISSET(listen_sock, &read_fds)) {
-            struct sockaddr_in peer_addr;
-            socklen_t peer_len = sizeof(peer_addr);
-            
-            peer_sock = accept(listen_sock, (struct sockaddr *)&peer_addr, &peer_len);
-            if (peer_sock < 0) {
-                log_message("ERROR", "Accept failed: %s", strerror(errno));
-                continue;
-            }
+        if (add_single_key(listen_fd, peer->ip, key, 1) < 0) {
+            log_message("ERROR", "Failed to add key %d for peer %s", key->keyId, peer->ip);
+        } else {
+            added++;
+        }
+    }
 
-            char peer_ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &peer_addr.sin_addr, peer_ip_str, sizeof(peer_ip_str));
-            log_message("INFO", "Accepted connection from %s:%d", 
-                       peer_ip_str, ntohs(peer_addr.sin_port));
-
-            // 连接到转发目标
-            forward_sock = socket(AF_INET, SOCK_STREAM, 0);
-            if (forward_sock < 0) {
-                log_message("ERROR", "Failed to create forward socket: %s", strerror(errno));
-                close(peer_sock);
-                continue;
+    if (old_auth) {
+        for (int i = 0; i < old_auth->key_count; i++) {
+            if (!find_key(new_auth, old_auth->keys[i].keyId) &&
+                delete_single_key(listen_fd, peer->ip, &old_auth->keys[i]) == 0) {
+                removed++;
             }
+        }
+        free(old_auth);
+    }
 
-            memset(&forward_addr_struct, 0, sizeof(forward_addr_struct));
-            forward_addr_struct.sin_family = AF_INET;
-            forward_addr_struct.sin_port = htons(forward_port);
-            inet_pton(AF_INET, forward_ip, &forward_addr_struct.sin_addr);
-
-            if (connect(forward_sock, (struct sockaddr *)&forward_addr_struct, 
-                       sizeof(forward_addr_struct)) < 0) {
-                log_message("ERROR", "Failed to connect to %s: %s", forward_addr, strerror(errno));
-                close(peer_sock);
-                close(forward_sock);
-                continue;
-            }
+    peer->auth = new_auth;
+    PROXY_PROBE4(key_rotate, listen_fd, peer->ip, added, removed);
+    sync_peer_sessions(engine, peer, time(NULL));
+    return 0;
+}
 
-            log_message("INFO", "Connected to forward target %s", forward_addr);
-
-            // 数据转发循环
-            while (keep_running) {
-                // 定期检查密钥轮换
-                check_and_rotate_keys(listen_sock, peer_ip);
-                
-                fd_set fds;
-                FD_ZERO(&fds);
-                FD_SET(peer_sock, &fds);
-                FD_SET(forward_sock, &fds);
-                
-                int max_fd = (peer_sock > forward_sock) ? peer_sock : forward_sock;
-                
-                tv.tv_sec = 1;
-                tv.tv_usec = 0;
-                
-                activity = select(max_fd + 1, &fds, NULL, NULL, &tv);
-                
-                if (activity < 0 && errno != EINTR) {
-                    log_message("ERROR", "Select error in forwarding: %s", strerror(errno));
-                    break;
-                }
-                
-                if (activity > 0) {
-                    if (FD_ISSET(peer_sock, &fds)) {
-                        forward_data(peer_sock, forward_sock, "peer->forward");
-                    }
-                    if (FD_ISSET(forward_sock, &fds)) {
-                        forward_data(forward_sock, peer_sock, "forward->peer");
-                    }
-                }
+// 事件循环每轮回调: 定期检查每个 peer 的密钥轮换, 并把已建立的会话同步到当前密钥
+static void ao_tick(proxy_engine_t *engine) {
+    time_t now = time(NULL);
+
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            if (p->auth) {
+                check_and_rotate_keys(l->ep.fd, p->ip, p->auth);
             }
+        }
+    }
 
-            close(peer_sock);
-            close(forward_sock);
-            log_message("INFO", "Connection closed");
+    // 每次都完整比对, 上次因 current/RNext 未切换而没删掉的密钥也在这里重试
+    if (now - last_session_sync < rotation_interval) {
+        return;
+    }
+    last_session_sync = now;
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (s->peer && s->peer->auth && s->peer_ep.fd >= 0) {
+            sync_session_keys(s, s->peer->auth, now);
         }
     }
+}
 
-    close(listen_sock);
-    return 0;
+// SESSIONS 中的 "auth": current/RNext 是否已切换到期望的发送密钥, 以及连接和各密钥的验证计数
+static int ao_session_json(proxy_engine_t *engine, proxy_session_t *s, char *buf, size_t len) {
+    (void)engine;
+    AoSocketState st;
+    const AoPeerAuth *auth = s->peer ? s->peer->auth : NULL;
+    int newest = auth ? newest_send_key(auth->keys, auth->key_count, time(NULL)) : -1;
+    int want = newest >= 0 ? auth->keys[newest].keyId : -1;
+    size_t off = 0;
+    int n;
+
+    if (read_socket_state(s->peer_ep.fd, &st) < 0) {
+        return -1;
+    }
+
+    n = snprintf(buf, len, "{\"current\":%d,\"rnext\":%d,\"preferred\":%d,\"inSync\":%s,"
+                 "\"good\":%llu,\"bad\":%llu,\"keyNotFound\":%llu,\"aoRequired\":%llu,\"droppedIcmp\":%llu,"
+                 "\"keys\":[",
+                 st.info.set_current ? st.info.current_key : -1, st.info.set_rnext ? st.info.rnext : -1, want,
+                 want >= 0 && st.info.set_current && st.info.set_rnext && st.info.current_key == want &&
+                     st.info.rnext == want ? "true" : "false",
+                 (unsigned long long)st.info.pkt_good, (unsigned long long)st.info.pkt_bad,
+                 (unsigned long long)st.info.pkt_key_not_found, (unsigned long long)st.info.pkt_ao_required,
+                 (unsigned long long)st.info.pkt_dropped_icmp);
+    if (n < 0 || (size_t)n >= len) return -1;
+    off = n;
+
+    for (int i = 0; i < st.key_count; i++) {
+        const struct tcp_ao_getsockopt *k = &st.keys[i];
+        n = snprintf(buf + off, len - off, "%s{\"sndid\":%d,\"rcvid\":%d,\"algorithm\":\"%s\",\"maclen\":%d,"
+                     "\"good\":%llu,\"bad\":%llu}",
+                     i ? "," : "", k->sndid, k->rcvid, k->alg_name, k->maclen,
+                     (unsigned long long)k->pkt_good, (unsigned long long)k->pkt_bad);
+        if (n < 0 || (size_t)n >= len - off) return -1;
+        off += n;
+    }
+
+    n = snprintf(buf + off, len - off, "]}");
+    if (n < 0 || (size_t)n >= len - off) return -1;
+    return (int)(off + n);
+}
+
+static const proxy_auth_ops_t ao_ops = {
+    "TCP-AO",
+    ao_install,
+    ao_uninstall,
+    ao_update,
+    ao_tick,
+    ao_session_json
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--control <socket_path> [--takeover]] <peer_ip> <keys_json> <listen_port> <forward_addr> [rotation_interval]\n", prog);
+    fprintf(stderr, "       %s --control <socket_path> [--takeover] [--rotation <seconds>] --daemon\n", prog);
+    fprintf(stderr, "       %s --control <socket_path> --client\n", prog);
+    fprintf(stderr, "Example: %s 192.168.1.1 '[{\"keyId\":1,\"algorithm\":\"hmac-sha-256\",\"password\":\"key1\",\"send\":true,\"recv\":true}]' 179 localhost:11020 60\n", prog);
+    fprintf(stderr, "Upgrade: %s --control /run/tcp-ao-proxy/bmp.sock --takeover\n", prog);
+}
+
+static void set_rotation_interval(int interval) {
+    rotation_interval = interval;
+    if (rotation_interval < 10) {
+        fprintf(stderr, "Warning: rotation_interval too small, using minimum 10 seconds\n");
+        rotation_interval = 10;
+    }
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 5 || argc > 6) {
-        fprintf(stderr, "Usage: %s <peer_ip> <keys_json> <listen_port> <forward_addr> [rotation_interval]\n", argv[0]);
-        fprintf(stderr, "Example: %s 192.168.1.1 '[{\"keyId\":1,\"algorithm\":\"hmac-sha-256\",\"password\":\"key1\",\"send\":true,\"recv\":true}]' 179 localhost:11020 60\n", argv[0]);
+    static const struct option long_options[] = {
+        {"control", required_argument, NULL, 'c'},
+        {"takeover", no_argument, NULL, 't'},
+        {"daemon", no_argument, NULL, 'd'},
+        {"client", no_argument, NULL, 'C'},
+        {"rotation", required_argument, NULL, 'r'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *control_path = NULL;
+    int takeover = 0;
+    int daemon_mode = 0;
+    int client_mode = 0;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "+", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'c':
+                control_path = optarg;
+                break;
+            case 't':
+                takeover = 1;
+                break;
+            case 'd':
+                daemon_mode = 1;
+                break;
+            case 'C':
+                client_mode = 1;
+                break;
+            case 'r':
+                set_rotation_interval(atoi(optarg));
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if ((takeover || daemon_mode || client_mode) && !control_path) {
+        fprintf(stderr, "--takeover, --daemon and --client require --control <socket_path>\n");
         return 1;
     }
 
-    const char *peer_ip = argv[1];
-    const char *keys_json = argv[2];
-    const char *listen_port = argv[3];
-    const char *forward_addr = argv[4];
-    
-    if (argc == 6) {
-        rotation_interval = atoi(argv[5]);
-        if (rotation_interval < 10) {
-            fprintf(stderr, "Warning: rotation_interval too small, using minimum 10 seconds\n");
-            rotation_interval = 10;
-        }
+    if (client_mode) {
+        signal(SIGPIPE, SIG_IGN);
+        return proxy_control_client(control_path) < 0 ? 1 : 0;
+    }
+
+    char **args = argv + optind;
+    int nargs = argc - optind;
+    if ((nargs != 0 && nargs != 4 && nargs != 5) || (nargs == 0 && !daemon_mode && !takeover)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (nargs == 5) {
+        set_rotation_interval(atoi(args[4]));
     }
 
     // 设置信号处理
@@ -612,37 +823,56 @@ int main(int argc, char *argv[]) {
     signal(SIGPIPE, SIG_IGN);
 
     log_message("INFO", "TCP-AO Proxy Helper starting...");
-    log_message("INFO", "Peer IP: %s", peer_ip);
-    log_message("INFO", "Listen Port: %s", listen_port);
-    log_message("INFO", "Forward Address: %s", forward_addr);
     log_message("INFO", "Key Rotation Interval: %d seconds", rotation_interval);
 
-    // 保存 JSON 字符串用于后续重新解析
-    strncpy(keys_json_str, keys_json, sizeof(keys_json_str) - 1);
-    keys_json_str[sizeof(keys_json_str) - 1] = '\0';
+    proxy_engine_t engine;
+    if (proxy_engine_init(&engine, &ao_ops, &keep_running) < 0) {
+        return 1;
+    }
 
-    // 解析密钥配置
-    key_count = parse_keys_json(keys_json_str, keys, MAX_KEYS);
-    if (key_count < 0) {
-        log_message("ERROR", "Failed to parse keys JSON");
+    // 从正在运行的 helper 接管监听端口、peer 和所有会话
+    if (takeover && proxy_engine_takeover(&engine, control_path) < 0) {
+        log_message("ERROR", "Takeover from %s failed", control_path);
+        proxy_engine_cleanup(&engine);
         return 1;
     }
-    
-    log_message("INFO", "Parsed %d keys", key_count);
-    for (int i = 0; i < key_count; i++) {
-        log_message("INFO", "Key %d: ID=%d, Algorithm=%s",
-                   i, keys[i].keyId, keys[i].algorithm);
-        log_message("INFO", "  Send: %ld - %ld, Accept: %ld - %ld",
-                   keys[i].sendStart, keys[i].sendEnd, 
-                   keys[i].acceptStart, keys[i].acceptEnd);
+
+    if (nargs >= 4) {
+        const char *peer_ip = args[0];
+        const char *keys_json = args[1];
+        const char *listen_port = args[2];
+        const char *forward_addr = args[3];
+        char err[PROXY_ERROR_MAX];
+
+        log_message("INFO", "Peer IP: %s", peer_ip);
+        log_message("INFO", "Listen Port: %s", listen_port);
+        log_message("INFO", "Forward Address: %s", forward_addr);
+
+        if (proxy_engine_add_peer(&engine, PROXY_DEFAULT_LISTENER, atoi(listen_port), forward_addr,
+                                  peer_ip, keys_json, err, sizeof(err)) < 0) {
+            log_message("ERROR", "%s", err);
+            proxy_engine_cleanup(&engine);
+            return 1;
+        }
+        log_message("INFO", "TCP-AO proxy listening on port %s", listen_port);
+        log_message("INFO", "Forwarding to %s, expecting connections from %s", forward_addr, peer_ip);
     }
 
-    // 初始化轮换检查时间
-    last_rotation_check = time(NULL);
+    if ((control_path && proxy_engine_open_control(&engine, control_path) < 0) ||
+        proxy_engine_finish_takeover(&engine) < 0) {
+        proxy_engine_cleanup(&engine);
+        return 1;
+    }
+
+    if (daemon_mode) {
+        log_message("INFO", "TCP-AO proxy daemon ready, %d listeners", engine.listener_count);
+    }
 
     // 运行代理
-    int result = run_proxy(peer_ip, listen_port, forward_addr);
+    int result = proxy_engine_run(&engine);
 
-    log_message("INFO", "TCP-AO Proxy Helper stopped");
+    int handed_off = engine.handed_off;
+    proxy_engine_cleanup(&engine);
+    log_message("INFO", handed_off ? "TCP-AO Proxy Helper handed off to new process" : "TCP-AO Proxy Helper stopped");
     return result;
 }
@@ -7,10 +7,26 @@ PEER_IP=$2
 KEYS_JSON=$3     # JSON array of keys
 LISTEN_PORT=$4
 FORWARD_ADDR=$5
+ACTION=$6
+
+# "<protocol> upgrade" 简写: 沿用运行中 helper 的参数
+if [ "$2" = "upgrade" ]; then
+    ACTION="upgrade"
+    PEER_IP=""
+fi
+
+# 守护进程模式: "daemon {start|stop|status|upgrade|control}" 运行一个服务所有协议的常驻 helper,
+# 监听端口和 peer 通过其控制 socket 增删
+if [ "$PROTOCOL" = "daemon" ]; then
+    ACTION=${2:-start}
+    PEER_IP=""
+fi
 
 PROXY_DIR="/opt/tcp-ao-proxy"
 PID_FILE="/tmp/tcp-ao-proxy-${PROTOCOL}.pid"
 LOG_FILE="/tmp/tcp-ao-proxy-${PROTOCOL}.log"
+# helper 将该目录创建为 0700, 其他用户可访问时拒绝使用
+CTL_SOCK="/run/tcp-ao-proxy/${PROTOCOL}.sock"
 HELPER_BIN="$PROXY_DIR/tcp-ao-helper"
 
 # 日志函数
@@ -36,8 +52,13 @@ start_proxy() {
     fi
     
     # 启动 helper
-    log "Starting helper: $HELPER_BIN $PEER_IP '$KEYS_JSON' $LISTEN_PORT $FORWARD_ADDR"
-    nohup "$HELPER_BIN" "$PEER_IP" "$KEYS_JSON" "$LISTEN_PORT" "$FORWARD_ADDR" >> "$LOG_FILE" 2>&1 &
+    if [ "$PROTOCOL" = "daemon" ]; then
+        log "Starting helper: $HELPER_BIN --control $CTL_SOCK --daemon"
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --daemon >> "$LOG_FILE" 2>&1 &
+    else
+        log "Starting helper: $HELPER_BIN --control $CTL_SOCK $PEER_IP '$KEYS_JSON' $LISTEN_PORT $FORWARD_ADDR"
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" "$PEER_IP" "$KEYS_JSON" "$LISTEN_PORT" "$FORWARD_ADDR" >> "$LOG_FILE" 2>&1 &
+    fi
     
     HELPER_PID=$!
     echo $HELPER_PID > "$PID_FILE"
@@ -93,6 +114,53 @@ stop_proxy() {
     return 0
 }
 
+# 热升级: 新版本 helper 通过控制 socket 接管监听 socket 和所有已建立的会话
+upgrade_proxy() {
+    log "Upgrading TCP-AO proxy for $PROTOCOL..."
+
+    OLD_PID=""
+    if [ -f "$PID_FILE" ]; then
+        OLD_PID=$(cat "$PID_FILE")
+    fi
+
+    if [ -z "$OLD_PID" ] || ! ps -p "$OLD_PID" > /dev/null 2>&1 || [ ! -S "$CTL_SOCK" ]; then
+        if [ -z "$PEER_IP" ]; then
+            log "Proxy not running, nothing to upgrade"
+            return 1
+        fi
+        log "Proxy not running, starting instead"
+        rm -f "$PID_FILE"
+        start_proxy
+        return $?
+    fi
+
+    # 未指定参数时新进程沿用旧进程的参数
+    if [ -n "$PEER_IP" ]; then
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --takeover "$PEER_IP" "$KEYS_JSON" "$LISTEN_PORT" "$FORWARD_ADDR" >> "$LOG_FILE" 2>&1 &
+    else
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --takeover >> "$LOG_FILE" 2>&1 &
+    fi
+    HELPER_PID=$!
+
+    # 新进程确认接管后旧进程自行退出
+    for i in {1..50}; do
+        if ! ps -p "$OLD_PID" > /dev/null 2>&1 || ! ps -p "$HELPER_PID" > /dev/null 2>&1; then
+            break
+        fi
+        sleep 0.2
+    done
+
+    if ps -p "$HELPER_PID" > /dev/null 2>&1 && ! ps -p "$OLD_PID" > /dev/null 2>&1; then
+        echo $HELPER_PID > "$PID_FILE"
+        log "TCP-AO proxy upgraded, new PID $HELPER_PID"
+        return 0
+    fi
+
+    log "ERROR: Upgrade failed, PID $OLD_PID keeps running"
+    kill "$HELPER_PID" > /dev/null 2>&1
+    return 1
+}
+
 # 检查状态
 check_status() {
     if [ -f "$PID_FILE" ]; then
@@ -110,8 +178,16 @@ check_status() {
     fi
 }
 
+# 将 stdin/stdout 接到控制 socket, 首次使用时启动 helper; 此时 stdout 只能输出 OK/ERR 应答
+control_proxy() {
+    if ! check_status > /dev/null 2>&1; then
+        start_proxy > /dev/null 2>&1
+    fi
+    exec "$HELPER_BIN" --control "$CTL_SOCK" --client
+}
+
 # 主逻辑
-case "$6" in
+case "$ACTION" in
     start)
         start_proxy
         ;;
@@ -126,8 +202,16 @@ case "$6" in
     status)
         check_status
         ;;
+    upgrade)
+        upgrade_proxy
+        ;;
+    control)
+        control_proxy
+        ;;
     *)
-        echo "Usage: $0 <protocol> <peer_ip> <keys_json> <listen_port> <forward_addr> {start|stop|restart|status}"
+        echo "Usage: $0 <protocol> <peer_ip> <keys_json> <listen_port> <forward_addr> {start|stop|restart|status|upgrade}"
+        echo "       $0 <protocol> upgrade"
+        echo "       $0 daemon {start|stop|restart|status|upgrade|control}"
         echo "Example: $0 bmp 192.168.1.1 '[{\"keyId\":1,\"algorithm\":\"hmac-sha-256\",\"password\":\"key1\",\"send\":true,\"recv\":true}]' 179 localhost:11020 start"
         exit 1
         ;;
@@ -2,8 +2,26 @@
  * TCP MD5 Proxy Helper - Server Mode (IPv4/IPv6 Support)
  * Accepts incoming connections with TCP MD5 authentication
  * Forwards data through SSH tunnel to Windows
+ *
+ * Build: gcc -pthread -o tcp-md5-helper tcp-md5-helper.c tcp-proxy-engine.c tcp-proxy-mirror.c tcp-proxy-recorder.c tcp-proxy-resume.c tcp-proxy-sched.c tcp-proxy-latency.c tcp-proxy-fastpath.c tcp-proxy-bmp.c tcp-proxy-filter.c
+ *
+ * Modes:
+ *   tcp-md5-helper [--control <path>] <peer_ip> <md5_password> <listen_port> <forward_host:port>
+ *       single peer on listener "default" (legacy per-protocol scripts)
+ *   tcp-md5-helper --control <path> --daemon
+ *       long-running daemon; listeners and peers are added/removed through the
+ *       control socket (ADD/KEYS/REMOVE/MIRROR/RECORD/RESUME/SHAPE/FASTPATH/BMPSTATS/FILTER/SESSIONS/STATS/LATENCY, see
+ *       tcp-proxy-engine.h)
+ *   tcp-md5-helper --control <path> --client
+ *       relay control commands from stdin and replies to stdout
+ *
+ * Hot upgrade: a new binary started with --control <path> --takeover receives
+ * all listeners, peers and live sessions from the running process, which then
+ * exits. Positional arguments, if given, are applied on top of the adopted state.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,16 +30,17 @@
 #include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <signal.h>
 #include <time.h>
+#include <getopt.h>
 #include <linux/tcp.h>
 
-#define BUFFER_SIZE 8192
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-probes.h"
 
 volatile sig_atomic_t running = 1;
 
@@ -113,6 +132,7 @@ int set_tcp_md5_peer(int sockfd, const char *peer_ip, const char *password) {
     }
 
     log_msg("TCP MD5 signature set successfully for peer %s", peer_ip);
+    PROXY_PROBE3(key_add, sockfd, peer_ip, -1);
 
     // Verify the setting (read it back)
     struct tcp_md5sig verify_md5sig;
@@ -130,274 +150,188 @@ int set_tcp_md5_peer(int sockfd, const char *peer_ip, const char *password) {
     return 0;
 }
 
-// Forward data between two sockets
-void forward_data(int client_sock, int forward_sock) {
-    fd_set read_fds;
-    char buffer[BUFFER_SIZE];
-    int max_fd = (client_sock > forward_sock) ? client_sock : forward_sock;
+// Remove the TCP MD5 signature for a peer (a zero-length key deletes it)
+int clear_tcp_md5_peer(int sockfd, const char *peer_ip) {
+    struct tcp_md5sig md5sig;
+    int family = detect_ip_family(peer_ip);
+
+    memset(&md5sig, 0, sizeof(md5sig));
+    if (family == AF_INET) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in *)&md5sig.tcpm_addr;
+        addr4->sin_family = AF_INET;
+        inet_pton(AF_INET, peer_ip, &addr4->sin_addr);
+    } else if (family == AF_INET6) {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&md5sig.tcpm_addr;
+        addr6->sin6_family = AF_INET6;
+        inet_pton(AF_INET6, peer_ip, &addr6->sin6_addr);
+    } else {
+        return -1;
+    }
+
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_MD5SIG, &md5sig, sizeof(md5sig)) < 0) {
+        log_msg("WARNING: Could not remove MD5 signature for peer %s: %s", peer_ip, strerror(errno));
+        return -1;
+    }
+    log_msg("TCP MD5 signature removed for peer %s", peer_ip);
+    PROXY_PROBE3(key_del, sockfd, peer_ip, -1);
+    return 0;
+}
 
-    while (running) {
-        FD_ZERO(&read_fds);
-        FD_SET(client_sock, &read_fds);
-        FD_SET(forward_sock, &read_fds);
+static int md5_install(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, int adopted) {
+    (void)engine;
+    (void)adopted;
+    // Setting the key again on an adopted listener simply replaces it
+    return set_tcp_md5_peer(listen_fd, peer->ip, peer->secret);
+}
 
-        struct timeval timeout = {1, 0};  // 1 second timeout
-        int activity = select(max_fd + 1, &read_fds, NULL, NULL, &timeout);
+static void md5_uninstall(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer) {
+    (void)engine;
+    if (listen_fd >= 0) {
+        clear_tcp_md5_peer(listen_fd, peer->ip);
+    }
+}
 
-        if (activity < 0) {
-            if (errno == EINTR) continue;
-            log_msg("ERROR: select failed: %s", strerror(errno));
-            break;
-        }
+static int md5_update(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, const char *secret,
+                      char *err, size_t err_len) {
+    (void)engine;
+    (void)err;
+    (void)err_len;
+    // New connections use the new password; established sessions keep their key
+    if (set_tcp_md5_peer(listen_fd, peer->ip, secret) < 0) {
+        return -1;
+    }
+    PROXY_PROBE4(key_rotate, listen_fd, peer->ip, 1, 1);
+    return 0;
+}
 
-        if (activity == 0) continue;  // Timeout
+static const proxy_auth_ops_t md5_ops = {
+    "MD5",
+    md5_install,
+    md5_uninstall,
+    md5_update,
+    NULL,
+    NULL
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--control <socket_path> [--takeover]] <peer_ip> <md5_password> <listen_port> <forward_host:port>\n", prog);
+    fprintf(stderr, "       %s --control <socket_path> [--takeover] --daemon\n", prog);
+    fprintf(stderr, "       %s --control <socket_path> --client\n", prog);
+    fprintf(stderr, "Example (IPv4): %s 192.168.1.1 mypassword 11019 localhost:11020\n", prog);
+    fprintf(stderr, "Example (IPv6): %s 2001:db8::1 mypassword 11019 localhost:11020\n", prog);
+    fprintf(stderr, "Upgrade:        %s --control /run/tcp-md5-proxy/bmp.sock --takeover\n", prog);
+}
 
-        // Client -> Forward
-        if (FD_ISSET(client_sock, &read_fds)) {
-            int n = recv(client_sock, buffer, BUFFER_SIZE, 0);
-            if (n <= 0) {
-                log_msg("Client connection closed");
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"control", required_argument, NULL, 'c'},
+        {"takeover", no_argument, NULL, 't'},
+        {"daemon", no_argument, NULL, 'd'},
+        {"client", no_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *control_path = NULL;
+    int takeover = 0;
+    int daemon_mode = 0;
+    int client_mode = 0;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "+", long_options, NULL)) != -1) {
+        switch (c) {
+            case 'c':
+                control_path = optarg;
                 break;
-            }
-            if (send(forward_sock, buffer, n, 0) < 0) {
-                log_msg("ERROR: Failed to send to forward socket");
+            case 't':
+                takeover = 1;
                 break;
-            }
-        }
-
-        // Forward -> Client
-        if (FD_ISSET(forward_sock, &read_fds)) {
-            int n = recv(forward_sock, buffer, BUFFER_SIZE, 0);
-            if (n <= 0) {
-                log_msg("Forward connection closed");
+            case 'd':
+                daemon_mode = 1;
                 break;
-            }
-            if (send(client_sock, buffer, n, 0) < 0) {
-                log_msg("ERROR: Failed to send to client");
+            case 'C':
+                client_mode = 1;
                 break;
-            }
+            default:
+                usage(argv[0]);
+                return 1;
         }
     }
-}
 
-int main(int argc, char *argv[]) {
-    if (argc != 5) {
-        fprintf(stderr, "Usage: %s <peer_ip> <md5_password> <listen_port> <forward_host:port>\n", argv[0]);
-        fprintf(stderr, "Example (IPv4): %s 192.168.1.1 mypassword 11019 localhost:11020\n", argv[0]);
-        fprintf(stderr, "Example (IPv6): %s 2001:db8::1 mypassword 11019 localhost:11020\n", argv[0]);
+    if ((takeover || daemon_mode || client_mode) && !control_path) {
+        fprintf(stderr, "--takeover, --daemon and --client require --control <socket_path>\n");
         return 1;
     }
 
-    const char *peer_ip = argv[1];
-    const char *md5_password = argv[2];
-    int listen_port = atoi(argv[3]);
+    if (client_mode) {
+        signal(SIGPIPE, SIG_IGN);
+        return proxy_control_client(control_path) < 0 ? 1 : 0;
+    }
 
-    // Detect IP family
-    int family = detect_ip_family(peer_ip);
-    if (family < 0) {
-        fprintf(stderr, "ERROR: Invalid peer IP address: %s\n", peer_ip);
+    char **args = argv + optind;
+    int nargs = argc - optind;
+    if (nargs != 0 && nargs != 4) {
+        usage(argv[0]);
         return 1;
     }
-
-    // Parse forward address
-    char forward_host[256];
-    int forward_port;
-    if (sscanf(argv[4], "%255[^:]:%d", forward_host, &forward_port) != 2) {
-        fprintf(stderr, "Invalid forward address format. Use host:port\n");
+    if (nargs == 0 && !daemon_mode && !takeover) {
+        usage(argv[0]);
         return 1;
     }
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
 
-    // Create listening socket with appropriate family
-    int listen_sock = socket(family, SOCK_STREAM, 0);
-    if (listen_sock < 0) {
-        log_msg("ERROR: socket creation failed: %s", strerror(errno));
+    proxy_engine_t engine;
+    if (proxy_engine_init(&engine, &md5_ops, &running) < 0) {
         return 1;
     }
 
-    int opt = 1;
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    // For IPv6, allow IPv4-mapped addresses
-    if (family == AF_INET6) {
-        int ipv6only = 0;
-        setsockopt(listen_sock, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6only, sizeof(ipv6only));
-    }
-
-    // Set TCP MD5 signature for expected peer
-    if (set_tcp_md5_peer(listen_sock, peer_ip, md5_password) < 0) {
-        close(listen_sock);
+    // Take over listeners, peers and live sessions from the running helper
+    if (takeover && proxy_engine_takeover(&engine, control_path) < 0) {
+        log_msg("ERROR: takeover from %s failed", control_path);
+        proxy_engine_cleanup(&engine);
         return 1;
     }
 
-    // Bind to appropriate address family
-    struct sockaddr_storage listen_addr;
-    socklen_t addr_len;
-    memset(&listen_addr, 0, sizeof(listen_addr));
+    if (nargs == 4) {
+        const char *peer_ip = args[0];
+        const char *md5_password = args[1];
+        char err[PROXY_ERROR_MAX];
 
-    if (family == AF_INET) {
-        struct sockaddr_in *addr4 = (struct sockaddr_in *)&listen_addr;
-        addr4->sin_family = AF_INET;
-        addr4->sin_addr.s_addr = INADDR_ANY;
-        addr4->sin_port = htons(listen_port);
-        addr_len = sizeof(struct sockaddr_in);
-    } else {
-        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&listen_addr;
-        addr6->sin6_family = AF_INET6;
-        addr6->sin6_addr = in6addr_any;
-        addr6->sin6_port = htons(listen_port);
-        addr_len = sizeof(struct sockaddr_in6);
-    }
+        if (proxy_engine_add_peer(&engine, PROXY_DEFAULT_LISTENER, atoi(args[2]), args[3],
+                                  peer_ip, md5_password, err, sizeof(err)) < 0) {
+            log_msg("ERROR: %s", err);
+            proxy_engine_cleanup(&engine);
+            return 1;
+        }
 
-    if (bind(listen_sock, (struct sockaddr*)&listen_addr, addr_len) < 0) {
-        log_msg("ERROR: bind failed: %s", strerror(errno));
-        close(listen_sock);
-        return 1;
+        log_msg("TCP MD5 Proxy listening on port %s", args[2]);
+        log_msg("Expecting connections from %s with MD5 authentication", peer_ip);
+        log_msg("MD5 password length: %d bytes", (int)strlen(md5_password));
+        log_msg("Forwarding to %s", args[3]);
+        log_msg("========================================");
+        log_msg("Waiting for router connection...");
+        log_msg("If connection fails, check:");
+        log_msg("  1. Router is configured with correct MD5 password");
+        log_msg("  2. Router IP matches: %s", peer_ip);
+        log_msg("  3. Firewall allows port %s", args[2]);
+        log_msg("========================================");
     }
 
-    if (listen(listen_sock, 5) < 0) {
-        log_msg("ERROR: listen failed: %s", strerror(errno));
-        close(listen_sock);
+    if ((control_path && proxy_engine_open_control(&engine, control_path) < 0) ||
+        proxy_engine_finish_takeover(&engine) < 0) {
+        proxy_engine_cleanup(&engine);
         return 1;
     }
 
-    log_msg("TCP MD5 Proxy listening on %s port %d", family == AF_INET ? "IPv4" : "IPv6", listen_port);
-    log_msg("Expecting connections from %s with MD5 authentication", peer_ip);
-    log_msg("MD5 password length: %d bytes", (int)strlen(md5_password));
-    log_msg("Forwarding to %s:%d", forward_host, forward_port);
-    log_msg("========================================");
-    log_msg("Waiting for router connection...");
-    log_msg("If connection fails, check:");
-    log_msg("  1. Router is configured with correct MD5 password");
-    log_msg("  2. Router IP matches: %s", peer_ip);
-    log_msg("  3. Firewall allows port %d", listen_port);
-    log_msg("========================================");
-
-    while (running) {
-        struct sockaddr_storage client_addr;
-        socklen_t client_len = sizeof(client_addr);
-
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(listen_sock, &read_fds);
-
-        struct timeval timeout = {1, 0};
-        int activity = select(listen_sock + 1, &read_fds, NULL, NULL, &timeout);
-
-        if (activity <= 0) continue;
-
-        int client_sock = accept(listen_sock, (struct sockaddr*)&client_addr, &client_len);
-        if (client_sock < 0) {
-            if (errno == EINTR) continue;
-
-            char client_ip[INET6_ADDRSTRLEN];
-            int client_port;
-
-            if (client_addr.ss_family == AF_INET) {
-                struct sockaddr_in *addr4 = (struct sockaddr_in *)&client_addr;
-                inet_ntop(AF_INET, &addr4->sin_addr, client_ip, INET6_ADDRSTRLEN);
-                client_port = ntohs(addr4->sin_port);
-            } else {
-                struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&client_addr;
-                inet_ntop(AF_INET6, &addr6->sin6_addr, client_ip, INET6_ADDRSTRLEN);
-                client_port = ntohs(addr6->sin6_port);
-            }
-
-            // MD5 authentication failure will cause accept to fail
-            if (errno == ECONNABORTED || errno == ECONNRESET) {
-                log_msg("ERROR: Connection from %s:%d failed - Possible MD5 authentication mismatch",
-                        client_ip, client_port);
-                log_msg("       Check that router is using correct MD5 password");
-            } else if (errno == ETIMEDOUT) {
-                log_msg("ERROR: Connection from %s:%d timed out", client_ip, client_port);
-            } else {
-                log_msg("ERROR: accept failed from %s:%d: %s (errno=%d)",
-                        client_ip, client_port, strerror(errno), errno);
-            }
-            continue;
-        }
-
-        char client_ip[INET6_ADDRSTRLEN];
-        int client_port;
-
-        if (client_addr.ss_family == AF_INET) {
-            struct sockaddr_in *addr4 = (struct sockaddr_in *)&client_addr;
-            inet_ntop(AF_INET, &addr4->sin_addr, client_ip, INET6_ADDRSTRLEN);
-            client_port = ntohs(addr4->sin_port);
-        } else {
-            struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&client_addr;
-            inet_ntop(AF_INET6, &addr6->sin6_addr, client_ip, INET6_ADDRSTRLEN);
-            client_port = ntohs(addr6->sin6_port);
-        }
-
-        log_msg("New connection from %s:%d", client_ip, client_port);
-
-        // Verify it's from expected peer
-        if (strcmp(client_ip, peer_ip) != 0) {
-            log_msg("WARNING: Connection from unexpected peer %s (expected %s), rejecting", client_ip, peer_ip);
-            close(client_sock);
-            continue;
-        }
-
-        log_msg("Connection accepted from expected peer %s (MD5 authentication successful)", peer_ip);
-
-        // Fork to handle connection
-        pid_t pid = fork();
-        if (pid == 0) {
-            // Child process
-            close(listen_sock);
-
-            // Connect to forward destination
-            int forward_sock = socket(AF_INET, SOCK_STREAM, 0);
-            if (forward_sock < 0) {
-                log_msg("ERROR: forward socket creation failed: %s", strerror(errno));
-                close(client_sock);
-                exit(1);
-            }
-
-            struct sockaddr_in forward_addr;
-            memset(&forward_addr, 0, sizeof(forward_addr));
-            forward_addr.sin_family = AF_INET;
-            forward_addr.sin_port = htons(forward_port);
-
-            struct hostent *he = gethostbyname(forward_host);
-            if (!he) {
-                log_msg("ERROR: Failed to resolve forward host: %s", forward_host);
-                close(forward_sock);
-                close(client_sock);
-                exit(1);
-            }
-            memcpy(&forward_addr.sin_addr, he->h_addr_list[0], he->h_length);
-
-            if (connect(forward_sock, (struct sockaddr*)&forward_addr, sizeof(forward_addr)) < 0) {
-                log_msg("ERROR: connect to forward destination failed: %s", strerror(errno));
-                close(forward_sock);
-                close(client_sock);
-                exit(1);
-            }
-
-            log_msg("Connected to forward destination %s:%d", forward_host, forward_port);
-            log_msg("Forwarding data between %s and %s:%d", peer_ip, forward_host, forward_port);
-
-            // Forward data
-            forward_data(client_sock, forward_sock);
-
-            close(forward_sock);
-            close(client_sock);
-            log_msg("Connection closed");
-            exit(0);
-        } else if (pid > 0) {
-            // Parent process
-            close(client_sock);
-        } else {
-            log_msg("ERROR: fork failed: %s", strerror(errno));
-            close(client_sock);
-        }
+    if (daemon_mode) {
+        log_msg("TCP MD5 proxy daemon ready, %d listeners", engine.listener_count);
     }
 
-    close(listen_sock);
-    log_msg("Proxy stopped");
+    proxy_engine_run(&engine);
+
+    int handed_off = engine.handed_off;
+    proxy_engine_cleanup(&engine);
+    log_msg(handed_off ? "Proxy handed off to new process" : "Proxy stopped");
     return 0;
 }
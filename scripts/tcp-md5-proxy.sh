@@ -7,10 +7,26 @@ PEER_IP=$2
 MD5_PASSWORD=$3
 LISTEN_PORT=$4
 FORWARD_ADDR=$5
+ACTION=${6:-start}
+
+# Short form "<protocol> upgrade" keeps the running helper's arguments
+if [ "$2" = "upgrade" ]; then
+    ACTION="upgrade"
+    PEER_IP=""
+fi
+
+# Daemon mode: "daemon {start|stop|status|upgrade|control}" runs one long-lived
+# helper for all protocols; listeners and peers are managed over its control socket
+if [ "$PROTOCOL" = "daemon" ]; then
+    ACTION=${2:-start}
+    PEER_IP=""
+fi
 
 PROXY_DIR="/opt/tcp-md5-proxy"
 PID_FILE="/tmp/tcp-md5-proxy-${PROTOCOL}.pid"
 LOG_FILE="/tmp/tcp-md5-proxy-${PROTOCOL}.log"
+# The helper creates this directory 0700 and refuses to use it if other users can reach it
+CTL_SOCK="/run/tcp-md5-proxy/${PROTOCOL}.sock"
 HELPER_BIN="$PROXY_DIR/tcp-md5-helper"
 
 # Function to log with timestamp
@@ -30,16 +46,24 @@ start_proxy() {
     fi
 
     log_msg "========================================="
-    log_msg "Starting $PROTOCOL MD5 proxy"
-    log_msg "Peer IP: $PEER_IP"
-    log_msg "Listen port: $LISTEN_PORT"
-    log_msg "Forward to: $FORWARD_ADDR"
-    log_msg "MD5 password: ***"
+    if [ "$PROTOCOL" = "daemon" ]; then
+        log_msg "Starting MD5 proxy daemon"
+        log_msg "Control socket: $CTL_SOCK"
 
-    # Start the TCP MD5 proxy helper
-    log_msg "Launching helper process..."
-    nohup "$HELPER_BIN" "$PEER_IP" "$MD5_PASSWORD" "$LISTEN_PORT" "$FORWARD_ADDR" \
-        >> "$LOG_FILE" 2>&1 &
+        log_msg "Launching helper process..."
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --daemon >> "$LOG_FILE" 2>&1 &
+    else
+        log_msg "Starting $PROTOCOL MD5 proxy"
+        log_msg "Peer IP: $PEER_IP"
+        log_msg "Listen port: $LISTEN_PORT"
+        log_msg "Forward to: $FORWARD_ADDR"
+        log_msg "MD5 password: ***"
+
+        # Start the TCP MD5 proxy helper
+        log_msg "Launching helper process..."
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" "$PEER_IP" "$MD5_PASSWORD" "$LISTEN_PORT" "$FORWARD_ADDR" \
+            >> "$LOG_FILE" 2>&1 &
+    fi
 
     PID=$!
     echo $PID > "$PID_FILE"
@@ -72,6 +96,61 @@ stop_proxy() {
     fi
 }
 
+# Function to hot-upgrade proxy: the new helper binary takes over the listen
+# socket and all established sessions from the running one over $CTL_SOCK
+upgrade_proxy() {
+    OLD_PID=""
+    if [ -f "$PID_FILE" ]; then
+        OLD_PID=$(cat "$PID_FILE")
+    fi
+
+    if [ -z "$OLD_PID" ] || ! ps -p "$OLD_PID" > /dev/null 2>&1 || [ ! -S "$CTL_SOCK" ]; then
+        if [ -z "$PEER_IP" ]; then
+            echo "[$PROTOCOL] Proxy not running, nothing to upgrade"
+            log_msg "Upgrade attempt: Proxy not running"
+            return 1
+        fi
+        log_msg "Upgrade requested but proxy not running, starting instead"
+        rm -f "$PID_FILE"
+        start_proxy
+        return $?
+    fi
+
+    log_msg "========================================="
+    log_msg "Upgrading $PROTOCOL MD5 proxy (old PID: $OLD_PID)"
+
+    if [ -n "$PEER_IP" ]; then
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --takeover "$PEER_IP" "$MD5_PASSWORD" "$LISTEN_PORT" "$FORWARD_ADDR" \
+            >> "$LOG_FILE" 2>&1 &
+    else
+        nohup "$HELPER_BIN" --control "$CTL_SOCK" --takeover >> "$LOG_FILE" 2>&1 &
+    fi
+    PID=$!
+
+    # The old helper exits once the new one has confirmed the takeover
+    for i in {1..50}; do
+        if ! ps -p "$OLD_PID" > /dev/null 2>&1; then
+            break
+        fi
+        if ! ps -p "$PID" > /dev/null 2>&1; then
+            break
+        fi
+        sleep 0.2
+    done
+
+    if ps -p "$PID" > /dev/null 2>&1 && ! ps -p "$OLD_PID" > /dev/null 2>&1; then
+        echo $PID > "$PID_FILE"
+        echo "[$PROTOCOL] Proxy upgraded, new PID $PID"
+        log_msg "Proxy upgraded, new PID $PID"
+        return 0
+    fi
+
+    echo "[$PROTOCOL] Proxy upgrade failed, PID $OLD_PID keeps running"
+    log_msg "Proxy upgrade failed, PID $OLD_PID keeps running"
+    kill "$PID" > /dev/null 2>&1
+    return 1
+}
+
 # Function to check status
 status_proxy() {
     if [ ! -f "$PID_FILE" ]; then
@@ -82,8 +161,10 @@ status_proxy() {
     PID=$(cat "$PID_FILE")
     if ps -p "$PID" > /dev/null 2>&1; then
         echo "[$PROTOCOL] Proxy is running (PID: $PID)"
-        echo "Listening on port: $LISTEN_PORT"
-        echo "Forwarding to: $FORWARD_ADDR"
+        if [ "$PROTOCOL" != "daemon" ]; then
+            echo "Listening on port: $LISTEN_PORT"
+            echo "Forwarding to: $FORWARD_ADDR"
+        fi
         echo "Log file: $LOG_FILE"
         return 0
     else
@@ -93,8 +174,17 @@ status_proxy() {
     fi
 }
 
+# Function to attach stdin/stdout to the control socket, starting the helper
+# on first use. Only OK/ERR reply lines may reach stdout here.
+control_proxy() {
+    if ! status_proxy > /dev/null 2>&1; then
+        start_proxy > /dev/null 2>&1
+    fi
+    exec "$HELPER_BIN" --control "$CTL_SOCK" --client
+}
+
 # Main
-case "${6:-start}" in
+case "$ACTION" in
     start)
         start_proxy
         ;;
@@ -109,8 +199,16 @@ case "${6:-start}" in
     status)
         status_proxy
         ;;
+    upgrade)
+        upgrade_proxy
+        ;;
+    control)
+        control_proxy
+        ;;
     *)
-        echo "Usage: $0 <protocol> <peer_ip> <md5_password> <listen_port> <forward_addr> {start|stop|restart|status}"
+        echo "Usage: $0 <protocol> <peer_ip> <md5_password> <listen_port> <forward_addr> {start|stop|restart|status|upgrade}"
+        echo "       $0 <protocol> upgrade"
+        echo "       $0 daemon {start|stop|restart|status|upgrade|control}"
         echo "Protocols: bmp, bgp, rpki"
         exit 1
         ;;
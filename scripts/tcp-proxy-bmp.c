@@ -0,0 +1,953 @@
+/*
+ * TCP Proxy Engine - BMP 边缘统计
+ *
+ * BMPSTATS <listener> on 后, 在 helper 中按消息解析 router -> collector 方向的 BMP 流, 增量维护:
+ *   - 每个 router: 各类 BMP 消息数、sysName/sysDescr (Initiation)、解析错误
+ *   - 每个被监控的 peer (按 peer 类型 + RD + 地址 + AS 区分): up/down 事件和最近的 down 原因,
+ *     Route Monitoring 消息数和最近 60 秒的速率, 按 AFI/SAFI 和 RIB (pre/post-policy, Adj-RIB-In/Out,
+ *     Loc-RIB) 统计的通告/撤销前缀数和 End-of-RIB, 以及 Stats Report 中各计数器的最新值
+ * BMPSTATS <listener> 查询 JSON, 只需要这些计数的看板不必消费和解析完整的数据流。转发的数据不受影响。
+ *
+ * 前缀计数按 NLRI 编码逐条跳过, 不解码前缀本身: 普通/带标签/VPN 前缀按长度位数, EVPN/MVPN 按
+ * 路由类型 + 长度, BGP-LS 按 NLRI 类型 + 长度, Flowspec 按其长度字段; ADD-PATH 由 Peer Up 中的
+ * 两个 OPEN 协商结果决定是否带 Path ID。无法识别的 NLRI 只计消息数。
+ *
+ * 中途开启时, 已建立的会话利用调度模块跟踪的消息边界 (或过滤模块记录的位置, 见 tcp-proxy-filter.c),
+ * 跳过当前不完整的消息后开始解析; 可续传会话和内核快速路径中的会话无法确定接收位置, 不解析。统计数据和各会话的解析状态随 HANDOFF 交给新进程。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define BMP_HEADER_LEN 6
+#define BMP_VERSION 3
+#define BMP_PEER_HEADER_LEN 42
+#define BMP_MAX_MESSAGE (1024 * 1024)   // 更大的消息只计数, 不解析
+#define BMP_MAX_PEERS 4096              // 每个 router 最多跟踪的 peer 数
+#define BMP_MAX_FAMILIES 24
+#define BMP_MAX_STATS 48
+#define BMP_MAX_ADDPATH 16
+#define BMP_RATE_WINDOW 60
+
+#define BMP_MSG_ROUTE_MONITORING 0
+#define BMP_MSG_STATISTICS_REPORT 1
+#define BMP_MSG_PEER_DOWN 2
+#define BMP_MSG_PEER_UP 3
+#define BMP_MSG_INITIATION 4
+#define BMP_MSG_TERMINATION 5
+#define BMP_MSG_ROUTE_MIRRORING 6
+#define BMP_MSG_TYPES 7
+
+#define BMP_PEER_TYPE_LOC_RIB 3
+#define BMP_FLAG_V 0x80
+#define BMP_FLAG_P 0x40
+#define BMP_FLAG_O 0x10
+
+#define BMP_INFO_SYS_DESCR 1
+#define BMP_INFO_SYS_NAME 2
+
+#define BGP_HEADER_LEN 19
+#define BGP_MSG_OPEN 1
+#define BGP_MSG_UPDATE 2
+#define BGP_ATTR_MP_REACH 14
+#define BGP_ATTR_MP_UNREACH 15
+#define BGP_CAP_ADD_PATH 69
+
+#define BMP_RIB_LOC 4
+
+static const char *msg_names[BMP_MSG_TYPES] = {
+    "routeMonitoring", "statisticsReport", "peerDown", "peerUp", "initiation", "termination", "routeMirroring"
+};
+static const char *rib_names[] = { "pre-in", "post-in", "pre-out", "post-out", "loc-rib" };
+
+typedef struct {
+    uint16_t afi;
+    uint8_t safi;
+    uint8_t rib;
+    uint64_t announced;
+    uint64_t withdrawn;
+    uint64_t end_of_rib;
+    uint64_t unparsed;           // 无法识别编码的 NLRI 段数
+} bmp_family_t;
+
+typedef struct {
+    uint16_t type;
+    uint16_t afi;                // 只有 per-AFI/SAFI 计数器 (长度 11) 使用
+    uint8_t safi;
+    uint64_t value;
+} bmp_stat_t;
+
+typedef struct {
+    uint16_t afi;
+    uint8_t safi;
+    uint8_t router_mode;         // 被监控 router 在 OPEN 中声明的 ADD-PATH 模式: 1 接收, 2 发送, 3 两者
+    uint8_t peer_mode;
+} bmp_addpath_t;
+
+// 定长结构, HANDOFF 时按原样发送 (next 在接收方重建)
+typedef struct bmp_peer {
+    struct bmp_peer *next;
+    uint8_t type;
+    uint8_t v6;
+    unsigned char rd[8];
+    unsigned char addr[16];
+    uint32_t as;
+    uint32_t bgp_id;
+    int up;
+    uint8_t last_down_reason;
+    int64_t last_up;
+    int64_t last_down;
+    int64_t stats_time;
+    uint64_t up_events;
+    uint64_t down_events;
+    uint64_t route_monitoring;
+    uint32_t rate_ring[BMP_RATE_WINDOW];
+    int64_t rate_sec;
+    int family_count;
+    int stat_count;
+    int addpath_count;
+    bmp_family_t families[BMP_MAX_FAMILIES];
+    bmp_stat_t stats[BMP_MAX_STATS];
+    bmp_addpath_t addpath[BMP_MAX_ADDPATH];
+} bmp_peer_t;
+
+typedef struct bmp_router {
+    struct bmp_router *next;
+    bmp_peer_t *peers;
+    bmp_peer_t *last;            // 最近一次命中的 peer, 同一 peer 的消息通常连续到达
+    char ip[INET6_ADDRSTRLEN];
+    char sys_name[64];
+    char sys_descr[256];
+    int connected;               // 当前解析中的会话数
+    int peer_count;
+    uint64_t sessions;
+    uint64_t messages[BMP_MSG_TYPES + 1]; // 最后一项为未知类型
+    uint64_t bytes;
+    uint64_t errors;             // 格式错误的消息
+    uint64_t oversize;           // 超过 BMP_MAX_MESSAGE 未解析的消息
+    uint64_t unsynced_bytes;     // 失去消息边界后未解析的字节数
+    uint64_t peer_overflow;      // 超过 BMP_MAX_PEERS 未跟踪的消息
+    int64_t last_message;
+} bmp_router_t;
+
+struct proxy_bmp_stats {
+    bmp_router_t *routers;
+    int router_count;
+    int64_t since;
+};
+
+struct proxy_bmp_stream {
+    bmp_router_t *router;
+    int lost;                    // 消息边界未知, 不再解析
+    unsigned char hdr[BMP_HEADER_LEN];
+    size_t hdr_len;
+    uint32_t msg_len;
+    uint32_t skip;               // 跳过当前消息剩余的字节 (中途开始或消息过大)
+    unsigned char *msg;          // 跨 recv 的消息体
+    size_t have;
+    size_t cap;
+};
+
+static uint16_t get16(const unsigned char *p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get64(const unsigned char *p) {
+    return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+proxy_bmp_stats_t *proxy_bmp_stats_create(void) {
+    proxy_bmp_stats_t *stats = calloc(1, sizeof(proxy_bmp_stats_t));
+    if (stats) stats->since = time(NULL);
+    return stats;
+}
+
+void proxy_bmp_stats_free(proxy_bmp_stats_t *stats) {
+    if (!stats) return;
+    while (stats->routers) {
+        bmp_router_t *r = stats->routers;
+        stats->routers = r->next;
+        while (r->peers) {
+            bmp_peer_t *p = r->peers;
+            r->peers = p->next;
+            free(p);
+        }
+        free(r);
+    }
+    free(stats);
+}
+
+// 只清零计数, 保留 router/peer 的身份、up 状态和 ADD-PATH 协商结果
+void proxy_bmp_stats_reset(proxy_bmp_stats_t *stats) {
+    for (bmp_router_t *r = stats->routers; r; r = r->next) {
+        memset(r->messages, 0, sizeof(r->messages));
+        r->bytes = r->errors = r->oversize = r->unsynced_bytes = r->peer_overflow = 0;
+        for (bmp_peer_t *p = r->peers; p; p = p->next) {
+            p->up_events = p->down_events = p->route_monitoring = 0;
+            memset(p->rate_ring, 0, sizeof(p->rate_ring));
+            p->family_count = 0;
+            p->stat_count = 0;
+        }
+    }
+    stats->since = time(NULL);
+}
+
+static bmp_router_t *router_get(proxy_bmp_stats_t *stats, const char *ip) {
+    for (bmp_router_t *r = stats->routers; r; r = r->next) {
+        if (strcmp(r->ip, ip) == 0) return r;
+    }
+    bmp_router_t *r = calloc(1, sizeof(bmp_router_t));
+    if (!r) return NULL;
+    snprintf(r->ip, sizeof(r->ip), "%s", ip);
+    r->next = stats->routers;
+    stats->routers = r;
+    stats->router_count++;
+    return r;
+}
+
+// 查找或创建 per-peer header 对应的 peer, 超过上限时返回 NULL
+static bmp_peer_t *peer_get(bmp_router_t *r, const unsigned char *hdr) {
+    const unsigned char *rd = hdr + 2;
+    const unsigned char *addr = hdr + 10;
+    uint32_t as = get32(hdr + 26);
+
+    bmp_peer_t *p = r->last;
+    if (p && p->type == hdr[0] && p->as == as && memcmp(p->rd, rd, 8) == 0 && memcmp(p->addr, addr, 16) == 0) {
+        return p;
+    }
+    for (p = r->peers; p; p = p->next) {
+        if (p->type == hdr[0] && p->as == as && memcmp(p->rd, rd, 8) == 0 && memcmp(p->addr, addr, 16) == 0) break;
+    }
+    if (!p) {
+        if (r->peer_count >= BMP_MAX_PEERS) {
+            r->peer_overflow++;
+            return NULL;
+        }
+        p = calloc(1, sizeof(bmp_peer_t));
+        if (!p) return NULL;
+        p->type = hdr[0];
+        memcpy(p->rd, rd, 8);
+        memcpy(p->addr, addr, 16);
+        p->as = as;
+        p->next = r->peers;
+        r->peers = p;
+        r->peer_count++;
+    }
+    p->v6 = (hdr[1] & BMP_FLAG_V) != 0;
+    p->bgp_id = get32(hdr + 30);
+    r->last = p;
+    return p;
+}
+
+static bmp_family_t *family_get(bmp_peer_t *p, uint16_t afi, uint8_t safi, uint8_t rib) {
+    for (int i = 0; i < p->family_count; i++) {
+        bmp_family_t *f = &p->families[i];
+        if (f->afi == afi && f->safi == safi && f->rib == rib) return f;
+    }
+    if (p->family_count == BMP_MAX_FAMILIES) return NULL;
+    bmp_family_t *f = &p->families[p->family_count++];
+    memset(f, 0, sizeof(*f));
+    f->afi = afi;
+    f->safi = safi;
+    f->rib = rib;
+    return f;
+}
+
+static void stat_set(bmp_peer_t *p, uint16_t type, uint16_t afi, uint8_t safi, uint64_t value) {
+    for (int i = 0; i < p->stat_count; i++) {
+        bmp_stat_t *st = &p->stats[i];
+        if (st->type == type && st->afi == afi && st->safi == safi) {
+            st->value = value;
+            return;
+        }
+    }
+    if (p->stat_count == BMP_MAX_STATS) return;
+    bmp_stat_t *st = &p->stats[p->stat_count++];
+    st->type = type;
+    st->afi = afi;
+    st->safi = safi;
+    st->value = value;
+}
+
+static void rate_add(bmp_peer_t *p, int64_t now) {
+    if (now - p->rate_sec >= BMP_RATE_WINDOW) {
+        memset(p->rate_ring, 0, sizeof(p->rate_ring));
+    } else {
+        for (int64_t t = p->rate_sec + 1; t <= now; t++) p->rate_ring[t % BMP_RATE_WINDOW] = 0;
+    }
+    if (now > p->rate_sec) p->rate_sec = now;
+    p->rate_ring[now % BMP_RATE_WINDOW]++;
+}
+
+static double rate_get(const bmp_peer_t *p, int64_t now) {
+    uint64_t sum = 0;
+    for (int64_t t = now - BMP_RATE_WINDOW + 1; t <= now; t++) {
+        if (t <= p->rate_sec && t > p->rate_sec - BMP_RATE_WINDOW) sum += p->rate_ring[t % BMP_RATE_WINDOW];
+    }
+    return (double)sum / BMP_RATE_WINDOW;
+}
+
+// Route Monitoring 中的 UPDATE 是否带 Path ID: Adj-RIB-In 看 router 能否接收, Adj-RIB-Out 看 router 能否发送
+static int addpath_enabled(const bmp_peer_t *p, uint16_t afi, uint8_t safi, int out) {
+    for (int i = 0; i < p->addpath_count; i++) {
+        const bmp_addpath_t *a = &p->addpath[i];
+        if (a->afi != afi || a->safi != safi) continue;
+        return out ? (a->router_mode & 2) && (a->peer_mode & 1) : (a->router_mode & 1) && (a->peer_mode & 2);
+    }
+    return 0;
+}
+
+// 统计一段 NLRI 中的条目数, 编码无法识别或越界时返回 -1
+static long count_nlri(const unsigned char *p, size_t len, uint16_t afi, uint8_t safi, int addpath) {
+    long count = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (addpath) {
+            if (pos + 4 > len) return -1;
+            pos += 4;
+        }
+        if (pos >= len) return -1;
+        size_t item;
+        if (safi == 70 || safi == 5) {
+            // EVPN / MCAST-VPN: 路由类型 + 长度
+            if (pos + 2 > len) return -1;
+            item = 2 + p[pos + 1];
+        } else if (afi == 16388 && (safi == 71 || safi == 72)) {
+            // BGP-LS: NLRI 类型 + 长度
+            if (pos + 4 > len) return -1;
+            item = 4 + get16(p + pos + 2);
+        } else if (safi == 133 || safi == 134) {
+            // Flowspec: 长度 >= 240 时为两字节
+            if (p[pos] >= 0xf0) {
+                if (pos + 2 > len) return -1;
+                item = 2 + (((size_t)(p[pos] & 0x0f) << 8) | p[pos + 1]);
+            } else {
+                item = 1 + p[pos];
+            }
+        } else if (safi == 1 || safi == 2 || safi == 4 || safi == 128 || safi == 129) {
+            // 前缀长度为位数, 带标签和 RD 的前缀也包含在内
+            item = 1 + (p[pos] + 7) / 8;
+        } else {
+            return -1;
+        }
+        if (pos + item > len) return -1;
+        pos += item;
+        count++;
+    }
+    return count;
+}
+
+static void add_nlri(bmp_peer_t *p, uint8_t rib, uint16_t afi, uint8_t safi, const unsigned char *nlri, size_t len,
+                     int withdraw) {
+    bmp_family_t *f = family_get(p, afi, safi, rib);
+    if (!f) return;
+    long n = count_nlri(nlri, len, afi, safi, addpath_enabled(p, afi, safi, rib == 2 || rib == 3));
+    if (n < 0) {
+        f->unparsed++;
+    } else if (withdraw) {
+        f->withdrawn += n;
+    } else {
+        f->announced += n;
+    }
+}
+
+// UPDATE 的三个部分
+typedef struct {
+    const unsigned char *withdrawn;
+    size_t withdrawn_len;
+    const unsigned char *attrs;
+    size_t attr_len;
+    const unsigned char *nlri;
+    size_t nlri_len;
+} bgp_update_t;
+
+static int update_split(const unsigned char *msg, size_t len, bgp_update_t *u) {
+    if (len < BGP_HEADER_LEN + 4 || msg[18] != BGP_MSG_UPDATE || get16(msg + 16) != len) return -1;
+
+    size_t pos = BGP_HEADER_LEN;
+    u->withdrawn_len = get16(msg + pos);
+    pos += 2;
+    if (pos + u->withdrawn_len + 2 > len) return -1;
+    u->withdrawn = msg + pos;
+    pos += u->withdrawn_len;
+    u->attr_len = get16(msg + pos);
+    pos += 2;
+    if (pos + u->attr_len > len) return -1;
+    u->attrs = msg + pos;
+    u->nlri = u->attrs + u->attr_len;
+    u->nlri_len = len - pos - u->attr_len;
+    return 0;
+}
+
+// 取 *pos 处的路径属性并前进, 返回 1 取到, 0 已结束, -1 格式错误
+static int attr_next(const bgp_update_t *u, size_t *pos, uint8_t *type, const unsigned char **value, size_t *len) {
+    size_t a = *pos;
+    if (a >= u->attr_len) return 0;
+    if (a + 3 > u->attr_len) return -1;
+    uint8_t flags = u->attrs[a];
+    size_t hlen = (flags & 0x10) ? 4 : 3;
+    if (a + hlen > u->attr_len) return -1;
+    size_t vlen = (flags & 0x10) ? get16(u->attrs + a + 2) : u->attrs[a + 2];
+    if (a + hlen + vlen > u->attr_len) return -1;
+    *type = u->attrs[a + 1];
+    *value = u->attrs + a + hlen;
+    *len = vlen;
+    *pos = a + hlen + vlen;
+    return 1;
+}
+
+static int parse_update(bmp_peer_t *p, uint8_t rib, const unsigned char *msg, size_t len) {
+    bgp_update_t u;
+    if (update_split(msg, len, &u) < 0) return -1;
+
+    // IPv4 单播 End-of-RIB 为空 UPDATE
+    if (u.withdrawn_len == 0 && u.attr_len == 0 && u.nlri_len == 0) {
+        bmp_family_t *f = family_get(p, 1, 1, rib);
+        if (f) f->end_of_rib++;
+        return 0;
+    }
+    if (u.withdrawn_len) add_nlri(p, rib, 1, 1, u.withdrawn, u.withdrawn_len, 1);
+    if (u.nlri_len) add_nlri(p, rib, 1, 1, u.nlri, u.nlri_len, 0);
+
+    size_t pos = 0;
+    uint8_t type;
+    const unsigned char *v;
+    size_t vlen;
+    int rc;
+    while ((rc = attr_next(&u, &pos, &type, &v, &vlen)) > 0) {
+        if (type == BGP_ATTR_MP_REACH && vlen >= 5) {
+            size_t nh_len = v[3];
+            if (5 + nh_len <= vlen) add_nlri(p, rib, get16(v), v[2], v + 5 + nh_len, vlen - 5 - nh_len, 0);
+        } else if (type == BGP_ATTR_MP_UNREACH && vlen >= 3) {
+            if (vlen == 3) {
+                // 只有 MP_UNREACH 且不带 NLRI 为该 AFI/SAFI 的 End-of-RIB
+                bmp_family_t *f = family_get(p, get16(v), v[2], rib);
+                if (f) f->end_of_rib++;
+            } else {
+                add_nlri(p, rib, get16(v), v[2], v + 3, vlen - 3, 1);
+            }
+        }
+    }
+    return rc;
+}
+
+int proxy_bmp_update_family(const unsigned char *msg, size_t len, uint16_t *afi, uint8_t *safi) {
+    bgp_update_t u;
+    if (update_split(msg, len, &u) < 0) return -1;
+
+    size_t pos = 0;
+    uint8_t type;
+    const unsigned char *v;
+    size_t vlen;
+    int rc;
+    while ((rc = attr_next(&u, &pos, &type, &v, &vlen)) > 0) {
+        if ((type == BGP_ATTR_MP_REACH || type == BGP_ATTR_MP_UNREACH) && vlen >= 3) {
+            *afi = get16(v);
+            *safi = v[2];
+            return 0;
+        }
+    }
+    if (rc < 0) return -1;
+    *afi = 1;
+    *safi = 1;
+    return 0;
+}
+
+// 读取 OPEN 中的 ADD-PATH 能力, 返回 OPEN 的长度, 格式错误返回 0
+static size_t parse_open(const unsigned char *msg, size_t len, bmp_peer_t *p, int router_side) {
+    if (len < BGP_HEADER_LEN + 10 || msg[18] != BGP_MSG_OPEN) return 0;
+    size_t open_len = get16(msg + 16);
+    if (open_len > len || open_len < BGP_HEADER_LEN + 10) return 0;
+
+    size_t pos = BGP_HEADER_LEN + 9;
+    size_t opt_len = msg[pos++];
+    int extended = 0;
+    // RFC 9072 扩展可选参数长度
+    if (opt_len == 255 && pos + 3 <= open_len && msg[pos] == 255) {
+        opt_len = get16(msg + pos + 1);
+        pos += 3;
+        extended = 1;
+    }
+    size_t end = pos + opt_len;
+    if (end > open_len) return 0;
+
+    while (pos + (extended ? 3 : 2) <= end) {
+        uint8_t param = msg[pos];
+        size_t plen = extended ? get16(msg + pos + 1) : msg[pos + 1];
+        pos += extended ? 3 : 2;
+        if (pos + plen > end) return 0;
+        if (param == 2) {
+            size_t c = pos;
+            while (c + 2 <= pos + plen) {
+                uint8_t code = msg[c];
+                size_t clen = msg[c + 1];
+                c += 2;
+                if (c + clen > pos + plen) break;
+                for (size_t i = 0; code == BGP_CAP_ADD_PATH && i + 4 <= clen; i += 4) {
+                    uint16_t afi = get16(msg + c + i);
+                    uint8_t safi = msg[c + i + 2];
+                    uint8_t mode = msg[c + i + 3];
+                    bmp_addpath_t *a = NULL;
+                    for (int k = 0; k < p->addpath_count; k++) {
+                        if (p->addpath[k].afi == afi && p->addpath[k].safi == safi) a = &p->addpath[k];
+                    }
+                    if (!a && p->addpath_count < BMP_MAX_ADDPATH) {
+                        a = &p->addpath[p->addpath_count++];
+                        memset(a, 0, sizeof(*a));
+                        a->afi = afi;
+                        a->safi = safi;
+                    }
+                    if (a && router_side) a->router_mode = mode;
+                    if (a && !router_side) a->peer_mode = mode;
+                }
+                c += clen;
+            }
+        }
+        pos += plen;
+    }
+    return open_len;
+}
+
+static void parse_info_tlvs(bmp_router_t *r, const unsigned char *p, size_t len) {
+    size_t pos = 0;
+    while (pos + 4 <= len) {
+        uint16_t type = get16(p + pos);
+        size_t tlen = get16(p + pos + 2);
+        pos += 4;
+        if (pos + tlen > len) return;
+        char *dst = type == BMP_INFO_SYS_NAME ? r->sys_name : type == BMP_INFO_SYS_DESCR ? r->sys_descr : NULL;
+        size_t cap = type == BMP_INFO_SYS_NAME ? sizeof(r->sys_name) : sizeof(r->sys_descr);
+        if (dst) {
+            size_t n = tlen < cap - 1 ? tlen : cap - 1;
+            memcpy(dst, p + pos, n);
+            dst[n] = '\0';
+        }
+        pos += tlen;
+    }
+}
+
+static int parse_stats(bmp_peer_t *p, const unsigned char *body, size_t len, int64_t now) {
+    if (len < BMP_PEER_HEADER_LEN + 4) return -1;
+    uint32_t count = get32(body + BMP_PEER_HEADER_LEN);
+    size_t pos = BMP_PEER_HEADER_LEN + 4;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (pos + 4 > len) return -1;
+        uint16_t type = get16(body + pos);
+        size_t slen = get16(body + pos + 2);
+        pos += 4;
+        if (pos + slen > len) return -1;
+        const unsigned char *v = body + pos;
+        if (slen == 4) {
+            stat_set(p, type, 0, 0, get32(v));
+        } else if (slen == 8) {
+            stat_set(p, type, 0, 0, get64(v));
+        } else if (slen == 11) {
+            // per-AFI/SAFI 计数器
+            stat_set(p, type, get16(v), v[2], get64(v + 3));
+        }
+        pos += slen;
+    }
+    p->stats_time = now;
+    return 0;
+}
+
+// 处理一条完整的消息, body 不含 BMP 公共头
+static void process_message(bmp_router_t *r, uint8_t type, const unsigned char *body, size_t len) {
+    int64_t now = time(NULL);
+    int rc = 0;
+
+    r->messages[type < BMP_MSG_TYPES ? type : BMP_MSG_TYPES]++;
+    r->last_message = now;
+
+    if (type == BMP_MSG_INITIATION) {
+        parse_info_tlvs(r, body, len);
+        return;
+    }
+    if (type > BMP_MSG_PEER_UP) return;
+    if (len < BMP_PEER_HEADER_LEN) {
+        r->errors++;
+        return;
+    }
+
+    bmp_peer_t *p = peer_get(r, body);
+    if (!p) return;
+    const unsigned char *rest = body + BMP_PEER_HEADER_LEN;
+    size_t rest_len = len - BMP_PEER_HEADER_LEN;
+    uint8_t flags = body[1];
+    uint8_t rib = p->type == BMP_PEER_TYPE_LOC_RIB ? BMP_RIB_LOC
+                                                   : ((flags & BMP_FLAG_P) ? 1 : 0) | ((flags & BMP_FLAG_O) ? 2 : 0);
+
+    switch (type) {
+        case BMP_MSG_ROUTE_MONITORING:
+            p->route_monitoring++;
+            rate_add(p, now);
+            rc = parse_update(p, rib, rest, rest_len);
+            break;
+        case BMP_MSG_STATISTICS_REPORT:
+            rc = parse_stats(p, body, len, now);
+            break;
+        case BMP_MSG_PEER_DOWN:
+            p->up = 0;
+            p->down_events++;
+            p->last_down = now;
+            p->last_down_reason = rest_len > 0 ? rest[0] : 0;
+            break;
+        case BMP_MSG_PEER_UP: {
+            p->up = 1;
+            p->up_events++;
+            p->last_up = now;
+            p->addpath_count = 0;
+            // 本端地址 16 + 两个端口 4, 之后为 router 发出的 OPEN 和收到的 OPEN
+            if (rest_len < 20) {
+                rc = -1;
+                break;
+            }
+            size_t pos = 20;
+            size_t n = parse_open(rest + pos, rest_len - pos, p, 1);
+            if (n == 0 || parse_open(rest + pos + n, rest_len - pos - n, p, 0) == 0) rc = -1;
+            break;
+        }
+    }
+    if (rc < 0) r->errors++;
+}
+
+static proxy_bmp_stream_t *stream_create(proxy_bmp_stats_t *stats, proxy_session_t *s) {
+    proxy_bmp_stream_t *st = calloc(1, sizeof(proxy_bmp_stream_t));
+    if (!st) return NULL;
+    st->router = router_get(stats, s->peer_ip);
+    if (!st->router) {
+        free(st);
+        return NULL;
+    }
+    st->router->connected++;
+    st->router->sessions++;
+    return st;
+}
+
+int proxy_bmp_receive_position(proxy_session_t *s, uint32_t *skip, unsigned char *hdr, size_t *hdr_len) {
+    // 可续传会话的缓冲已移入续传队列, 内核快速路径中的数据不经过用户态
+    if (s->resume || proxy_fastpath_active(s)) return -1;
+    // 过滤中的会话由过滤模块记录收到的位置 (缓冲中的数据已去掉被丢弃的消息)
+    if (s->filter) return proxy_filter_receive_position(s, skip, hdr, hdr_len);
+    return proxy_sched_bmp_position(&s->framing[PROXY_DIR_FORWARD], s->to_forward.data + s->to_forward.off,
+                                    s->to_forward.len - s->to_forward.off, skip, hdr, hdr_len);
+}
+
+void proxy_bmp_attach(proxy_bmp_stats_t *stats, proxy_session_t *s, int midstream) {
+    if (s->bmp) return;
+    s->bmp = stream_create(stats, s);
+    if (!s->bmp || !midstream) return;
+
+    proxy_bmp_stream_t *st = s->bmp;
+    if (proxy_bmp_receive_position(s, &st->skip, st->hdr, &st->hdr_len) < 0) {
+        st->lost = 1;
+        proxy_log("WARN", "Session %u: BMP message boundary unknown, statistics not collected", s->id);
+    }
+}
+
+void proxy_bmp_detach(proxy_session_t *s) {
+    if (!s->bmp) return;
+    s->bmp->router->connected--;
+    free(s->bmp->msg);
+    free(s->bmp);
+    s->bmp = NULL;
+}
+
+void proxy_bmp_feed(proxy_session_t *s, const char *data, size_t len) {
+    proxy_bmp_stream_t *st = s->bmp;
+    const unsigned char *p = (const unsigned char *)data;
+    bmp_router_t *r = st->router;
+
+    r->bytes += len;
+    while (len > 0) {
+        if (st->lost) {
+            r->unsynced_bytes += len;
+            return;
+        }
+        if (st->skip > 0) {
+            size_t n = len < st->skip ? len : st->skip;
+            st->skip -= n;
+            p += n;
+            len -= n;
+            continue;
+        }
+
+        if (st->hdr_len < BMP_HEADER_LEN) {
+            // 完整的消息在本段数据中时直接解析, 不拷贝
+            if (st->hdr_len == 0 && len >= BMP_HEADER_LEN && p[0] == BMP_VERSION) {
+                uint32_t msg_len = get32(p + 1);
+                if (msg_len >= BMP_HEADER_LEN && msg_len <= len) {
+                    process_message(r, p[5], p + BMP_HEADER_LEN, msg_len - BMP_HEADER_LEN);
+                    p += msg_len;
+                    len -= msg_len;
+                    continue;
+                }
+            }
+            size_t n = BMP_HEADER_LEN - st->hdr_len;
+            if (n > len) n = len;
+            memcpy(st->hdr + st->hdr_len, p, n);
+            st->hdr_len += n;
+            p += n;
+            len -= n;
+            if (st->hdr_len < BMP_HEADER_LEN) return;
+
+            st->msg_len = get32(st->hdr + 1);
+            if (st->hdr[0] != BMP_VERSION || st->msg_len < BMP_HEADER_LEN) {
+                r->errors++;
+                st->lost = 1;
+                continue;
+            }
+            st->have = 0;
+            if (st->msg_len > BMP_MAX_MESSAGE) {
+                r->oversize++;
+                r->messages[st->hdr[5] < BMP_MSG_TYPES ? st->hdr[5] : BMP_MSG_TYPES]++;
+                st->skip = st->msg_len - BMP_HEADER_LEN;
+                st->hdr_len = 0;
+                continue;
+            }
+            size_t body = st->msg_len - BMP_HEADER_LEN;
+            if (body > st->cap) {
+                unsigned char *msg = realloc(st->msg, body);
+                if (!msg) {
+                    st->skip = body;
+                    st->hdr_len = 0;
+                    continue;
+                }
+                st->msg = msg;
+                st->cap = body;
+            }
+        }
+
+        size_t body = st->msg_len - BMP_HEADER_LEN;
+        size_t n = body - st->have;
+        if (n > len) n = len;
+        memcpy(st->msg + st->have, p, n);
+        st->have += n;
+        p += n;
+        len -= n;
+        if (st->have == body) {
+            process_message(r, st->hdr[5], st->msg, body);
+            st->hdr_len = 0;
+            st->have = 0;
+        }
+    }
+}
+
+// 会话的解析位置随会话交接, 不完整的消息体一并发送
+typedef struct {
+    uint32_t lost;
+    uint32_t hdr_len;
+    uint32_t msg_len;
+    uint32_t skip;
+    uint32_t have;
+    uint32_t reserved;
+    unsigned char hdr[8];
+} bmp_stream_record_t;
+
+int proxy_bmp_stream_handoff(int fd, proxy_session_t *s) {
+    proxy_bmp_stream_t *st = s->bmp;
+    bmp_stream_record_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.lost = st->lost;
+    rec.hdr_len = st->hdr_len;
+    rec.msg_len = st->msg_len;
+    rec.skip = st->skip;
+    rec.have = st->hdr_len == BMP_HEADER_LEN ? st->have : 0;
+    memcpy(rec.hdr, st->hdr, sizeof(st->hdr));
+    if (proxy_write_all(fd, &rec, sizeof(rec)) < 0 || proxy_write_all(fd, st->msg, rec.have) < 0) return -1;
+    return 0;
+}
+
+int proxy_bmp_stream_takeover(int fd, proxy_bmp_stats_t *stats, proxy_session_t *s) {
+    bmp_stream_record_t rec;
+
+    if (proxy_read_all(fd, &rec, sizeof(rec)) < 0 || rec.hdr_len > BMP_HEADER_LEN) return -1;
+    if (rec.hdr_len == BMP_HEADER_LEN &&
+        (rec.msg_len < BMP_HEADER_LEN || rec.msg_len > BMP_MAX_MESSAGE || rec.have >= rec.msg_len - BMP_HEADER_LEN)) {
+        return -1;
+    }
+    // 旧进程中已计入 sessions, 这里只恢复当前连接数
+    bmp_router_t *r = router_get(stats, s->peer_ip);
+    proxy_bmp_stream_t *st = r ? calloc(1, sizeof(proxy_bmp_stream_t)) : NULL;
+    if (!st) return -1;
+    st->router = r;
+    r->connected++;
+    s->bmp = st;
+    st->lost = rec.lost;
+    st->hdr_len = rec.hdr_len;
+    st->msg_len = rec.msg_len;
+    st->skip = rec.skip;
+    memcpy(st->hdr, rec.hdr, sizeof(st->hdr));
+    // 消息头已到齐时为消息体分配缓冲, 同 proxy_bmp_feed
+    if (st->hdr_len == BMP_HEADER_LEN && st->msg_len > BMP_HEADER_LEN) {
+        st->msg = malloc(st->msg_len - BMP_HEADER_LEN);
+        if (!st->msg || proxy_read_all(fd, st->msg, rec.have) < 0) return -1;
+        st->cap = st->msg_len - BMP_HEADER_LEN;
+        st->have = rec.have;
+    }
+    return 0;
+}
+
+static void rd_string(const unsigned char *rd, char *out, size_t len) {
+    uint16_t type = get16(rd);
+    if (type == 0) {
+        snprintf(out, len, "%u:%u", get16(rd + 2), get32(rd + 4));
+    } else if (type == 1) {
+        snprintf(out, len, "%u.%u.%u.%u:%u", rd[2], rd[3], rd[4], rd[5], get16(rd + 6));
+    } else if (type == 2) {
+        snprintf(out, len, "%u:%u", get32(rd + 2), get16(rd + 6));
+    } else {
+        snprintf(out, len, "%02x%02x%02x%02x%02x%02x%02x%02x", rd[0], rd[1], rd[2], rd[3], rd[4], rd[5], rd[6], rd[7]);
+    }
+}
+
+static void peer_json(const bmp_peer_t *p, int64_t now, proxy_strbuf_t *sb) {
+    char addr[INET6_ADDRSTRLEN];
+    char rd[32];
+    struct in_addr id = { htonl(p->bgp_id) };
+
+    if (p->v6) {
+        inet_ntop(AF_INET6, p->addr, addr, sizeof(addr));
+    } else {
+        inet_ntop(AF_INET, p->addr + 12, addr, sizeof(addr));
+    }
+    rd_string(p->rd, rd, sizeof(rd));
+    proxy_strbuf_printf(sb, "{\"type\":%u,\"rd\":\"%s\",\"address\":\"%s\",\"as\":%u,\"bgpId\":\"%s\","
+                        "\"up\":%s,\"upEvents\":%llu,\"downEvents\":%llu,\"lastUp\":%lld,\"lastDown\":%lld,"
+                        "\"lastDownReason\":%u,\"routeMonitoring\":%llu,\"routeMonitoringRate\":%.2f,\"prefixes\":[",
+                        p->type, rd, addr, p->as, inet_ntoa(id), p->up ? "true" : "false",
+                        (unsigned long long)p->up_events, (unsigned long long)p->down_events,
+                        (long long)p->last_up, (long long)p->last_down, p->last_down_reason,
+                        (unsigned long long)p->route_monitoring, rate_get(p, now));
+    for (int i = 0; i < p->family_count; i++) {
+        const bmp_family_t *f = &p->families[i];
+        proxy_strbuf_printf(sb, "%s{\"afi\":%u,\"safi\":%u,\"rib\":\"%s\",\"announced\":%llu,\"withdrawn\":%llu,"
+                            "\"endOfRib\":%llu,\"unparsed\":%llu}", i ? "," : "", f->afi, f->safi, rib_names[f->rib],
+                            (unsigned long long)f->announced, (unsigned long long)f->withdrawn,
+                            (unsigned long long)f->end_of_rib, (unsigned long long)f->unparsed);
+    }
+    proxy_strbuf_printf(sb, "],\"stats\":[");
+    for (int i = 0; i < p->stat_count; i++) {
+        const bmp_stat_t *st = &p->stats[i];
+        proxy_strbuf_printf(sb, "%s{\"type\":%u", i ? "," : "", st->type);
+        if (st->afi) proxy_strbuf_printf(sb, ",\"afi\":%u,\"safi\":%u", st->afi, st->safi);
+        proxy_strbuf_printf(sb, ",\"value\":%llu}", (unsigned long long)st->value);
+    }
+    proxy_strbuf_printf(sb, "],\"statsUpdated\":%lld}", (long long)p->stats_time);
+}
+
+// BMPSTATS <listener> 的应答
+void proxy_bmp_stats_json(proxy_bmp_stats_t *stats, proxy_strbuf_t *sb) {
+    int64_t now = time(NULL);
+
+    proxy_strbuf_printf(sb, "{\"since\":%lld,\"routers\":[", (long long)stats->since);
+    for (bmp_router_t *r = stats->routers; r; r = r->next) {
+        proxy_strbuf_printf(sb, "%s{\"ip\":", r == stats->routers ? "" : ",");
+        proxy_strbuf_json_string(sb, r->ip);
+        proxy_strbuf_printf(sb, ",\"sysName\":");
+        proxy_strbuf_json_string(sb, r->sys_name);
+        proxy_strbuf_printf(sb, ",\"sysDescr\":");
+        proxy_strbuf_json_string(sb, r->sys_descr);
+        proxy_strbuf_printf(sb, ",\"connected\":%d,\"sessions\":%llu,\"bytes\":%llu,\"lastMessage\":%lld,"
+                            "\"messages\":{",
+                            r->connected, (unsigned long long)r->sessions, (unsigned long long)r->bytes,
+                            (long long)r->last_message);
+        for (int i = 0; i < BMP_MSG_TYPES; i++) {
+            proxy_strbuf_printf(sb, "%s\"%s\":%llu", i ? "," : "", msg_names[i], (unsigned long long)r->messages[i]);
+        }
+        proxy_strbuf_printf(sb, ",\"unknown\":%llu},\"errors\":%llu,\"oversize\":%llu,\"unsyncedBytes\":%llu,"
+                            "\"peerOverflow\":%llu,\"peers\":[", (unsigned long long)r->messages[BMP_MSG_TYPES],
+                            (unsigned long long)r->errors, (unsigned long long)r->oversize,
+                            (unsigned long long)r->unsynced_bytes, (unsigned long long)r->peer_overflow);
+        for (bmp_peer_t *p = r->peers; p; p = p->next) {
+            if (p != r->peers) proxy_strbuf_printf(sb, ",");
+            peer_json(p, now, sb);
+        }
+        proxy_strbuf_printf(sb, "]}");
+    }
+    proxy_strbuf_printf(sb, "]}");
+}
+
+// 统计数据按定长结构原样发送, 两端为同一份代码编译 (HANDOFF 版本号一致)
+int proxy_bmp_stats_handoff(int fd, proxy_bmp_stats_t *stats) {
+    uint32_t count = stats->router_count;
+    int64_t since = stats->since;
+    if (proxy_write_all(fd, &count, sizeof(count)) < 0 || proxy_write_all(fd, &since, sizeof(since)) < 0) return -1;
+
+    for (bmp_router_t *r = stats->routers; r; r = r->next) {
+        uint32_t peers = r->peer_count;
+        if (proxy_write_all(fd, r, sizeof(*r)) < 0 || proxy_write_all(fd, &peers, sizeof(peers)) < 0) return -1;
+        for (bmp_peer_t *p = r->peers; p; p = p->next) {
+            if (proxy_write_all(fd, p, sizeof(*p)) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+int proxy_bmp_stats_takeover(int fd, proxy_bmp_stats_t **out) {
+    uint32_t count = 0;
+    proxy_bmp_stats_t *stats = proxy_bmp_stats_create();
+    if (!stats) return -1;
+    *out = stats;
+    if (proxy_read_all(fd, &count, sizeof(count)) < 0 || proxy_read_all(fd, &stats->since, sizeof(stats->since)) < 0) {
+        return -1;
+    }
+
+    bmp_router_t **tail = &stats->routers;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t peers = 0;
+        bmp_router_t *r = calloc(1, sizeof(bmp_router_t));
+        if (!r) return -1;
+        *tail = r;
+        if (proxy_read_all(fd, r, sizeof(*r)) < 0 || proxy_read_all(fd, &peers, sizeof(peers)) < 0) {
+            memset(r, 0, sizeof(*r));
+            return -1;
+        }
+        r->next = NULL;
+        r->peers = NULL;
+        r->last = NULL;
+        r->peer_count = 0;
+        r->connected = 0;
+        r->ip[sizeof(r->ip) - 1] = '\0';
+        r->sys_name[sizeof(r->sys_name) - 1] = '\0';
+        r->sys_descr[sizeof(r->sys_descr) - 1] = '\0';
+        tail = &r->next;
+        stats->router_count++;
+
+        bmp_peer_t **peer_tail = &r->peers;
+        for (uint32_t j = 0; j < peers; j++) {
+            bmp_peer_t *p = calloc(1, sizeof(bmp_peer_t));
+            if (!p) return -1;
+            if (proxy_read_all(fd, p, sizeof(*p)) < 0) {
+                free(p);
+                return -1;
+            }
+            p->next = NULL;
+            if (p->family_count > BMP_MAX_FAMILIES || p->stat_count > BMP_MAX_STATS ||
+                p->addpath_count > BMP_MAX_ADDPATH) {
+                free(p);
+                return -1;
+            }
+            *peer_tail = p;
+            peer_tail = &p->next;
+            r->peer_count++;
+        }
+    }
+    return 0;
+}
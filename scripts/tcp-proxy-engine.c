@@ -0,0 +1,2356 @@
+/*
+ * TCP Proxy Engine
+ *
+ * 事件循环、会话转发、控制命令以及 HANDOFF 交接实现, 接口见 tcp-proxy-engine.h
+ *
+ * HANDOFF 流程 (旧进程 A, 新进程 B):
+ *   1. B 连接 A 的控制 socket, 发送 "HANDOFF\n"; A 只接受同一用户的连接中的第一条命令, --client 中继连接不能交接
+ *   2. A 把内核快速路径中的会话退回普通转发 (有积压时拒绝, 见 tcp-proxy-fastpath.c), 停止转发,
+ *      发送头部, 然后逐个发送监听端口 (SCM_RIGHTS 携带监听 socket) 及其 peer 和密钥
+ *   3. A 逐个发送会话 (SCM_RIGHTS 携带 peer/forward socket) 及两个方向缓冲中的数据, 以及会话的镜像连接;
+ *      可续传会话再发送续传队列, 转发连接未处于 streaming 状态时不随会话交接, 由 B 重连
+ *   4. B 注册所有监听端口和会话, 绑定新的控制 socket 后回复 "OK\n"
+ *   5. A 收到确认后直接退出 (只 close, 不 shutdown, socket 仍由 B 持有)
+ * 任何一步失败时 A 关闭该连接并继续正常转发, B 退出。A 在交接期间不转发, 整个过程 (含等待 B 确认)
+ * 限制在 PROXY_HANDOFF_DEADLINE_MS 内。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+#include "tcp-proxy-probes.h"
+
+#define PROXY_MAX_EVENTS 64
+#define PROXY_CONTROL_TIMEOUT 5
+#define PROXY_HANDOFF_ACK_TIMEOUT 10
+// 旧进程交接的总时限: 期间所有会话停止转发, 需远低于 BGP 允许的最小保持时间 3 秒
+#define PROXY_HANDOFF_DEADLINE_MS 1500
+#define PROXY_CLIENT_CONNECT_RETRIES 20
+#define PROXY_MIRROR_ORPHAN_TIMEOUT 30
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t listener_count;
+    uint32_t session_count;
+    uint32_t next_session_id;
+    uint32_t reserved;
+    int64_t start_time;
+    uint64_t sessions_accepted;
+    uint64_t bytes_to_forward;
+    uint64_t bytes_to_peer;
+    uint64_t link_rate;
+    uint64_t link_burst;
+} proxy_handoff_header_t;
+
+typedef struct {
+    char name[PROXY_NAME_MAX];
+    char forward_host[256];
+    int32_t port;
+    int32_t family;
+    int32_t forward_port;
+    uint32_t peer_count;
+    uint32_t mirror_count;
+    uint32_t recording;
+    uint32_t resuming;
+    uint32_t fastpath;
+    uint32_t bmp_stats;
+    uint32_t filtering;
+    uint64_t accepted;
+    uint64_t rejected;
+    uint64_t auth_failures;
+} proxy_handoff_listener_t;
+
+typedef struct {
+    char ip[INET6_ADDRSTRLEN];
+    int32_t family;
+    uint32_t secret_len;
+    uint64_t sessions_accepted;
+    uint64_t rate;
+    uint64_t burst;
+    proxy_histogram_t latency[2];
+} proxy_handoff_peer_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t listener_index;
+    int32_t peer_port;
+    uint32_t connecting;
+    uint32_t peer_eof;
+    uint32_t forward_eof;
+    uint32_t to_forward_len;
+    uint32_t to_peer_len;
+    uint32_t mirror_count;
+    uint32_t resuming;
+    uint32_t forward_fd;         // 是否携带 forward socket
+    uint32_t bmp;                // 之后跟着 BMP 解析状态
+    uint32_t filtering;          // 之后跟着过滤状态
+    uint32_t reserved;
+    int64_t start_time;
+    uint64_t bytes_to_forward;
+    uint64_t bytes_to_peer;
+    proxy_framing_t framing[2];
+    char peer_ip[INET6_ADDRSTRLEN];
+} proxy_handoff_session_t;
+
+// 日志函数
+void proxy_log(const char *level, const char *format, ...) {
+    va_list args;
+    time_t now = time(NULL);
+    fprintf(stderr, "[%ld] [%s] ", now, level);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    fflush(stderr);
+}
+
+void proxy_set_error(char *err, size_t err_len, const char *format, ...) {
+    va_list args;
+    if (!err || err_len == 0) return;
+    va_start(args, format);
+    vsnprintf(err, err_len, format, args);
+    va_end(args);
+}
+
+void proxy_strbuf_printf(proxy_strbuf_t *sb, const char *format, ...) {
+    va_list args;
+    if (sb->failed) return;
+
+    while (1) {
+        size_t space = sb->cap - sb->len;
+        va_start(args, format);
+        int n = vsnprintf(sb->data ? sb->data + sb->len : NULL, space, format, args);
+        va_end(args);
+        if (n < 0) {
+            sb->failed = 1;
+            return;
+        }
+        if ((size_t)n < space) {
+            sb->len += n;
+            return;
+        }
+
+        size_t cap = sb->cap ? sb->cap * 2 : 1024;
+        while (cap < sb->len + n + 1) cap *= 2;
+        char *data = realloc(sb->data, cap);
+        if (!data) {
+            sb->failed = 1;
+            return;
+        }
+        sb->data = data;
+        sb->cap = cap;
+    }
+}
+
+void proxy_strbuf_json_string(proxy_strbuf_t *sb, const char *s) {
+    proxy_strbuf_printf(sb, "\"");
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            proxy_strbuf_printf(sb, "\\%c", c);
+        } else if (c < 0x20) {
+            proxy_strbuf_printf(sb, "\\u%04x", c);
+        } else {
+            proxy_strbuf_printf(sb, "%c", c);
+        }
+    }
+    proxy_strbuf_printf(sb, "\"");
+}
+
+int proxy_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int proxy_read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int proxy_send_with_fds(int sock, const void *buf, size_t len, const int *fds, int nfds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * PROXY_HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void *)buf, len };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (nfds > 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+    }
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    // 描述符随第一个字节送达, 剩余部分普通发送即可
+    if ((size_t)n < len) {
+        return proxy_write_all(sock, (const char *)buf + n, len - n);
+    }
+    return 0;
+}
+
+int proxy_recv_with_fds(int sock, void *buf, size_t len, int *fds, int max_fds, int *nfds) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * PROXY_HANDOFF_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { buf, len };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    *nfds = 0;
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        int *received = (int *)CMSG_DATA(cmsg);
+        for (int i = 0; i < count; i++) {
+            if (*nfds < max_fds) {
+                fds[(*nfds)++] = received[i];
+            } else {
+                close(received[i]);
+            }
+        }
+    }
+
+    if ((size_t)n != len || (msg.msg_flags & MSG_CTRUNC)) {
+        for (int i = 0; i < *nfds; i++) close(fds[i]);
+        *nfds = 0;
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void proxy_set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+}
+
+void proxy_set_timeouts(int fd, int seconds) {
+    struct timeval tv = { seconds, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int ip_family(const char *ip) {
+    struct in6_addr addr;
+    if (inet_pton(AF_INET, ip, &addr) == 1) return AF_INET;
+    if (inet_pton(AF_INET6, ip, &addr) == 1) return AF_INET6;
+    return -1;
+}
+
+static void sockaddr_to_string(const struct sockaddr_storage *addr, char *ip, size_t ip_len, int *port) {
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+        inet_ntop(AF_INET, &addr4->sin_addr, ip, ip_len);
+        *port = ntohs(addr4->sin_port);
+    } else {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+        // 双栈监听 socket 上的 IPv4 连接按 IPv4 地址显示, 便于与 peer 列表比较
+        if (IN6_IS_ADDR_V4MAPPED(&addr6->sin6_addr)) {
+            inet_ntop(AF_INET, &addr6->sin6_addr.s6_addr[12], ip, ip_len);
+        } else {
+            inet_ntop(AF_INET6, &addr6->sin6_addr, ip, ip_len);
+        }
+        *port = ntohs(addr6->sin6_port);
+    }
+}
+
+int proxy_parse_host_port(const char *addr, char *host, size_t host_len, int *port) {
+    char buf[256];
+    if (host_len < sizeof(buf) || sscanf(addr, "%255[^:]:%d", buf, port) != 2 ||
+        *port <= 0 || *port > 65535) {
+        return -1;
+    }
+    snprintf(host, host_len, "%s", buf);
+    return 0;
+}
+
+// 更新端点在 epoll 中的事件, 端点尚未注册时添加
+int proxy_endpoint_set_events(proxy_engine_t *engine, proxy_endpoint_t *ep, uint32_t events, int add) {
+    if (!add && ep->events == events) return 0;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = ep;
+    if (epoll_ctl(engine->epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, ep->fd, &ev) < 0) {
+        proxy_log("ERROR", "epoll_ctl failed for fd %d: %s", ep->fd, strerror(errno));
+        return -1;
+    }
+    ep->events = events;
+    return 0;
+}
+
+// close 而非 shutdown: HANDOFF 后 socket 仍由新进程持有
+void proxy_endpoint_close(proxy_engine_t *engine, proxy_endpoint_t *ep) {
+    if (ep->fd < 0) return;
+    epoll_ctl(engine->epfd, EPOLL_CTL_DEL, ep->fd, NULL);
+    close(ep->fd);
+    ep->fd = -1;
+}
+
+static size_t buffer_pending(const proxy_buffer_t *buf) {
+    return buf->len - buf->off;
+}
+
+// reserve 为不在缓冲中但之后要放回的字节数 (过滤模块暂存的不完整消息)
+static size_t buffer_space(proxy_buffer_t *buf, size_t reserve) {
+    if (buf->off > 0 && buf->len + reserve >= PROXY_BUFFER_SIZE) {
+        memmove(buf->data, buf->data + buf->off, buf->len - buf->off);
+        buf->len -= buf->off;
+        buf->off = 0;
+    }
+    return buf->len + reserve < PROXY_BUFFER_SIZE ? PROXY_BUFFER_SIZE - buf->len - reserve : 0;
+}
+
+// 从 socket 读入缓冲, 返回读到的字节数 (EAGAIN 时为 0), -1 出错, *eof 置位表示对端关闭
+static ssize_t buffer_recv(proxy_session_t *s, int dir, int fd, proxy_buffer_t *buf, int *eof) {
+    size_t space = buffer_space(buf, dir == PROXY_DIR_FORWARD ? proxy_filter_held(s) : 0);
+    if (space == 0) {
+        PROXY_PROBE3(buffer_full, s->id, dir, buffer_pending(buf));
+        return 0;
+    }
+
+    ssize_t n = proxy_latency_recv(s, dir, fd, buf->data + buf->len, space);
+    if (n > 0) {
+        buf->len += n;
+        PROXY_PROBE4(recv, s->id, dir, n, buffer_pending(buf));
+        if (buffer_pending(buf) == PROXY_BUFFER_SIZE) PROXY_PROBE3(buffer_full, s->id, dir, buffer_pending(buf));
+        return n;
+    }
+    if (n == 0) {
+        *eof = 1;
+        return 0;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+    return -1;
+}
+
+// 将缓冲写入 socket, 返回 0 成功 (含 EAGAIN 和配额用尽), -1 出错
+static int buffer_send(proxy_engine_t *engine, proxy_session_t *s, int dir, int fd, proxy_buffer_t *buf) {
+    while (buffer_pending(buf) > 0) {
+        size_t quota = proxy_sched_quota(engine, s, dir, buf->data + buf->off, buffer_pending(buf));
+        if (quota == 0) {
+            PROXY_PROBE3(throttled, s->id, dir, buffer_pending(buf));
+            return 0;
+        }
+        ssize_t n = send(fd, buf->data + buf->off, quota, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                PROXY_PROBE3(send_blocked, s->id, dir, buffer_pending(buf));
+                return 0;
+            }
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        proxy_sched_sent(engine, s, dir, buf->data + buf->off, n);
+        proxy_latency_sent(s, dir, n);
+        buf->off += n;
+        PROXY_PROBE4(send, s->id, dir, n, buffer_pending(buf));
+    }
+    buf->off = 0;
+    buf->len = 0;
+    return 0;
+}
+
+static int session_update_events(proxy_engine_t *engine, proxy_session_t *s) {
+    uint32_t peer_events = 0;
+    uint32_t forward_events = 0;
+
+    // 内核转发中的会话只等待连接关闭, 事件由 tcp-proxy-fastpath.c 设置
+    if (proxy_fastpath_active(s)) return 0;
+
+    if (!s->peer_eof && buffer_pending(&s->to_forward) + proxy_filter_held(s) < PROXY_BUFFER_SIZE) {
+        peer_events |= EPOLLIN;
+    }
+    if (buffer_pending(&s->to_peer) > 0 && !s->throttled[PROXY_DIR_PEER]) peer_events |= EPOLLOUT;
+
+    if (s->resume) {
+        if (proxy_endpoint_set_events(engine, &s->peer_ep, peer_events, 0) < 0) return -1;
+        return proxy_resume_update_events(engine, s);
+    }
+    if (s->connecting) {
+        forward_events = EPOLLOUT;
+    } else {
+        if (!s->forward_eof && buffer_pending(&s->to_peer) < PROXY_BUFFER_SIZE) forward_events |= EPOLLIN;
+        if (buffer_pending(&s->to_forward) > 0 && !s->throttled[PROXY_DIR_FORWARD]) forward_events |= EPOLLOUT;
+    }
+
+    if (proxy_endpoint_set_events(engine, &s->peer_ep, peer_events, 0) < 0) return -1;
+    return proxy_endpoint_set_events(engine, &s->forward_ep, forward_events, 0);
+}
+
+static proxy_session_t *session_create(proxy_engine_t *engine, unsigned int id, proxy_listener_t *listener,
+                                       proxy_peer_t *peer, int peer_fd, int forward_fd,
+                                       const char *peer_ip, int peer_port) {
+    proxy_session_t *s = calloc(1, sizeof(proxy_session_t));
+    if (!s) {
+        proxy_log("ERROR", "Failed to allocate session: %s", strerror(errno));
+        return NULL;
+    }
+
+    s->id = id;
+    s->listener = listener;
+    s->peer = peer;
+    s->peer_ep.type = PROXY_EP_PEER;
+    s->peer_ep.fd = peer_fd;
+    s->peer_ep.owner = s;
+    s->forward_ep.type = PROXY_EP_FORWARD;
+    s->forward_ep.fd = forward_fd;
+    s->forward_ep.owner = s;
+    snprintf(s->peer_ip, sizeof(s->peer_ip), "%s", peer_ip);
+    s->peer_port = peer_port;
+    s->start_time = time(NULL);
+
+    // 可续传会话首次连接失败时 forward_fd 为 -1, 由续传模块稍后重连
+    if (proxy_endpoint_set_events(engine, &s->peer_ep, 0, 1) < 0 ||
+        (forward_fd >= 0 && proxy_endpoint_set_events(engine, &s->forward_ep, 0, 1) < 0)) {
+        epoll_ctl(engine->epfd, EPOLL_CTL_DEL, peer_fd, NULL);
+        free(s);
+        return NULL;
+    }
+
+    s->next = engine->sessions;
+    engine->sessions = s;
+    engine->session_count++;
+    if (peer) peer->session_count++;
+    return s;
+}
+
+// 关闭会话 socket 并移入待释放列表, 本轮事件中指向它的端点因 fd 为 -1 被跳过
+static void session_destroy(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_session_t **pp = &engine->sessions;
+    while (*pp && *pp != s) pp = &(*pp)->next;
+    if (!*pp) return;
+
+    *pp = s->next;
+    engine->session_count--;
+    if (s->peer) s->peer->session_count--;
+
+    proxy_fastpath_free(engine, s);
+    proxy_endpoint_close(engine, &s->peer_ep);
+    proxy_endpoint_close(engine, &s->forward_ep);
+    proxy_resume_free(s);
+    proxy_latency_free(s);
+    proxy_bmp_detach(s);
+    proxy_filter_free(s);
+    proxy_mirror_detach_session(engine, s);
+    // 交接或接管失败时会话并未真正结束, 不写入 CLOSE 记录
+    if (s->listener->recorder && *engine->running && !engine->handed_off && engine->takeover_fd < 0) {
+        proxy_recorder_close(s->listener->recorder, s);
+    }
+    s->next = engine->closed_sessions;
+    engine->closed_sessions = s;
+}
+
+static void session_close(proxy_engine_t *engine, proxy_session_t *s, const char *reason) {
+    proxy_fastpath_sync(engine, s);
+    proxy_log("INFO", "Session %u (%s:%d) closed: %s", s->id, s->peer_ip, s->peer_port, reason);
+    PROXY_PROBE5(session_close, s->id, reason, s->bytes_to_forward, s->bytes_to_peer,
+                 (long)(time(NULL) - s->start_time));
+    session_destroy(engine, s);
+}
+
+static void release_closed(proxy_engine_t *engine) {
+    while (engine->closed_sessions) {
+        proxy_session_t *s = engine->closed_sessions;
+        engine->closed_sessions = s->next;
+        free(s);
+    }
+    while (engine->closed_listeners) {
+        proxy_listener_t *l = engine->closed_listeners;
+        engine->closed_listeners = l->next;
+        free(l);
+    }
+    while (engine->closed_conns) {
+        proxy_control_conn_t *c = engine->closed_conns;
+        engine->closed_conns = c->next;
+        free(c);
+    }
+    proxy_mirror_release(engine);
+}
+
+proxy_listener_t *proxy_engine_find_listener(proxy_engine_t *engine, const char *name) {
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        if (strcmp(l->name, name) == 0) return l;
+    }
+    return NULL;
+}
+
+static proxy_peer_t *listener_find_peer(proxy_listener_t *listener, const char *ip) {
+    for (proxy_peer_t *p = listener->peers; p; p = p->next) {
+        if (strcmp(p->ip, ip) == 0) return p;
+    }
+    return NULL;
+}
+
+static proxy_peer_t *peer_create(const char *ip, int family, const char *secret) {
+    if (strlen(secret) >= PROXY_MAX_SECRET_LEN) {
+        return NULL;
+    }
+    proxy_peer_t *peer = calloc(1, sizeof(proxy_peer_t));
+    if (!peer) return NULL;
+    snprintf(peer->ip, sizeof(peer->ip), "%s", ip);
+    peer->family = family;
+    snprintf(peer->secret, sizeof(peer->secret), "%s", secret);
+    return peer;
+}
+
+// 关闭 peer (或 peer 为 NULL 时整个监听端口) 的所有会话
+static void close_sessions(proxy_engine_t *engine, proxy_listener_t *listener, proxy_peer_t *peer,
+                           const char *reason) {
+    proxy_session_t *s = engine->sessions;
+    while (s) {
+        proxy_session_t *next = s->next;
+        if (s->listener == listener && (!peer || s->peer == peer)) {
+            session_close(engine, s, reason);
+        }
+        s = next;
+    }
+}
+
+// 创建监听 socket: 在 bind 之前为所有 peer 安装密钥
+static int listener_open_socket(proxy_engine_t *engine, proxy_listener_t *listener, int port,
+                                char *err, size_t err_len) {
+    int fd = socket(listener->family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        proxy_set_error(err, err_len, "socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (listener->family == AF_INET6) {
+        int ipv6only = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6only, sizeof(ipv6only));
+    }
+
+    for (proxy_peer_t *p = listener->peers; p; p = p->next) {
+        if (engine->ops->install(engine, fd, p, 0) < 0) {
+            proxy_set_error(err, err_len, "failed to install %s key for peer %s", engine->ops->name, p->ip);
+            close(fd);
+            return -1;
+        }
+    }
+
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+    if (listener->family == AF_INET) {
+        struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+        addr4->sin_family = AF_INET;
+        addr4->sin_addr.s_addr = INADDR_ANY;
+        addr4->sin_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in);
+    } else {
+        struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_addr = in6addr_any;
+        addr6->sin6_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, addr_len) < 0 || listen(fd, 16) < 0) {
+        proxy_set_error(err, err_len, "bind/listen on port %d failed: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    proxy_set_nonblocking(fd);
+    return fd;
+}
+
+static int listener_register(proxy_engine_t *engine, proxy_listener_t *listener, int fd) {
+    listener->ep.type = PROXY_EP_LISTENER;
+    listener->ep.fd = fd;
+    listener->ep.owner = listener;
+    listener->ep.events = 0;
+    return proxy_endpoint_set_events(engine, &listener->ep, EPOLLIN, 1);
+}
+
+static void listener_free_peers(proxy_engine_t *engine, proxy_listener_t *listener, int listen_fd) {
+    while (listener->peers) {
+        proxy_peer_t *p = listener->peers;
+        listener->peers = p->next;
+        engine->ops->uninstall(engine, listen_fd, p);
+        free(p);
+    }
+    listener->peer_count = 0;
+}
+
+static void listener_destroy(proxy_engine_t *engine, proxy_listener_t *listener, int uninstall_keys) {
+    proxy_listener_t **pp = &engine->listeners;
+    while (*pp && *pp != listener) pp = &(*pp)->next;
+    if (*pp) {
+        *pp = listener->next;
+        engine->listener_count--;
+    }
+
+    close_sessions(engine, listener, NULL, "listener removed");
+    proxy_mirror_free_targets(engine, listener);
+    proxy_recorder_stop(listener->recorder);
+    listener->recorder = NULL;
+    proxy_resume_config_free(listener->resume);
+    listener->resume = NULL;
+    proxy_bmp_stats_free(listener->bmp_stats);
+    listener->bmp_stats = NULL;
+    proxy_filter_config_free(listener->filter);
+    listener->filter = NULL;
+    listener_free_peers(engine, listener, uninstall_keys ? listener->ep.fd : -1);
+    proxy_endpoint_close(engine, &listener->ep);
+    listener->next = engine->closed_listeners;
+    engine->closed_listeners = listener;
+}
+
+int proxy_engine_add_peer(proxy_engine_t *engine, const char *name, int listen_port, const char *forward_addr,
+                          const char *peer_ip, const char *secret, char *err, size_t err_len) {
+    char forward_host[256];
+    int forward_port;
+    int family = ip_family(peer_ip);
+
+    if (strlen(name) == 0 || strlen(name) >= PROXY_NAME_MAX) {
+        proxy_set_error(err, err_len, "invalid listener name");
+        return -1;
+    }
+    if (listen_port <= 0 || listen_port > 65535) {
+        proxy_set_error(err, err_len, "invalid listen port");
+        return -1;
+    }
+    if (proxy_parse_host_port(forward_addr, forward_host, sizeof(forward_host), &forward_port) < 0) {
+        proxy_set_error(err, err_len, "invalid forward address %s, use host:port", forward_addr);
+        return -1;
+    }
+    if (family < 0) {
+        proxy_set_error(err, err_len, "invalid peer address %s", peer_ip);
+        return -1;
+    }
+
+    proxy_listener_t *listener = proxy_engine_find_listener(engine, name);
+    if (!listener) {
+        listener = calloc(1, sizeof(proxy_listener_t));
+        proxy_peer_t *peer = peer_create(peer_ip, family, secret);
+        if (!listener || !peer) {
+            free(listener);
+            free(peer);
+            proxy_set_error(err, err_len, "out of memory or secret too long");
+            return -1;
+        }
+        snprintf(listener->name, sizeof(listener->name), "%s", name);
+        listener->family = family;
+        listener->port = listen_port;
+        snprintf(listener->forward_host, sizeof(listener->forward_host), "%s", forward_host);
+        listener->forward_port = forward_port;
+        listener->peers = peer;
+        listener->peer_count = 1;
+
+        int fd = listener_open_socket(engine, listener, listen_port, err, err_len);
+        if (fd < 0 || listener_register(engine, listener, fd) < 0) {
+            if (fd >= 0) close(fd);
+            engine->ops->uninstall(engine, -1, peer);
+            free(peer);
+            free(listener);
+            if (fd >= 0) proxy_set_error(err, err_len, "epoll registration failed");
+            return -1;
+        }
+
+        listener->next = engine->listeners;
+        engine->listeners = listener;
+        engine->listener_count++;
+        proxy_log("INFO", "Listener %s: %s port %d -> %s:%d, peer %s (%s)", name,
+                  family == AF_INET ? "IPv4" : "IPv6", listen_port, forward_host, forward_port,
+                  peer_ip, engine->ops->name);
+        return 0;
+    }
+
+    if (family != listener->family) {
+        proxy_set_error(err, err_len, "peer %s address family does not match listener %s", peer_ip, name);
+        return -1;
+    }
+
+    proxy_peer_t *peer = listener_find_peer(listener, peer_ip);
+    if (!peer) {
+        peer = peer_create(peer_ip, family, secret);
+        if (!peer) {
+            proxy_set_error(err, err_len, "out of memory or secret too long");
+            return -1;
+        }
+        if (engine->ops->install(engine, listener->ep.fd, peer, 0) < 0) {
+            engine->ops->uninstall(engine, -1, peer);
+            free(peer);
+            proxy_set_error(err, err_len, "failed to install %s key for peer %s", engine->ops->name, peer_ip);
+            return -1;
+        }
+        peer->next = listener->peers;
+        listener->peers = peer;
+        listener->peer_count++;
+        proxy_log("INFO", "Listener %s: added peer %s", name, peer_ip);
+    } else if (strcmp(peer->secret, secret) != 0) {
+        if (proxy_engine_update_keys(engine, name, peer_ip, secret, err, err_len) < 0) {
+            return -1;
+        }
+    }
+
+    // 端口变化时新建监听 socket 后再替换, 已建立的会话不受影响
+    if (listen_port != listener->port) {
+        int fd = listener_open_socket(engine, listener, listen_port, err, err_len);
+        if (fd < 0) return -1;
+        proxy_endpoint_close(engine, &listener->ep);
+        if (listener_register(engine, listener, fd) < 0) {
+            close(fd);
+            listener->ep.fd = -1;
+            proxy_set_error(err, err_len, "epoll registration failed");
+            return -1;
+        }
+        proxy_log("INFO", "Listener %s: moved from port %d to %d", name, listener->port, listen_port);
+        listener->port = listen_port;
+    }
+
+    if (strcmp(listener->forward_host, forward_host) != 0 || listener->forward_port != forward_port) {
+        proxy_log("INFO", "Listener %s: new sessions forward to %s:%d", name, forward_host, forward_port);
+        snprintf(listener->forward_host, sizeof(listener->forward_host), "%s", forward_host);
+        listener->forward_port = forward_port;
+    }
+    return 0;
+}
+
+int proxy_engine_update_keys(proxy_engine_t *engine, const char *name, const char *peer_ip, const char *secret,
+                             char *err, size_t err_len) {
+    proxy_listener_t *listener = proxy_engine_find_listener(engine, name);
+    proxy_peer_t *peer = listener ? listener_find_peer(listener, peer_ip) : NULL;
+    if (!peer) {
+        proxy_set_error(err, err_len, "peer %s not found on listener %s", peer_ip, name);
+        return -1;
+    }
+    if (strlen(secret) >= PROXY_MAX_SECRET_LEN) {
+        proxy_set_error(err, err_len, "secret too long");
+        return -1;
+    }
+    if (err && err_len) err[0] = '\0';
+    if (engine->ops->update(engine, listener->ep.fd, peer, secret, err, err_len) < 0) {
+        if (!err || !err[0]) {
+            proxy_set_error(err, err_len, "failed to update %s keys for peer %s", engine->ops->name, peer_ip);
+        }
+        return -1;
+    }
+    snprintf(peer->secret, sizeof(peer->secret), "%s", secret);
+    proxy_log("INFO", "Listener %s: updated %s keys for peer %s", name, engine->ops->name, peer_ip);
+    return 0;
+}
+
+int proxy_engine_remove_peer(proxy_engine_t *engine, const char *name, const char *peer_ip,
+                             char *err, size_t err_len) {
+    proxy_listener_t *listener = proxy_engine_find_listener(engine, name);
+    if (!listener) {
+        proxy_set_error(err, err_len, "listener %s not found", name);
+        return -1;
+    }
+
+    if (peer_ip) {
+        proxy_peer_t **pp = &listener->peers;
+        while (*pp && strcmp((*pp)->ip, peer_ip) != 0) pp = &(*pp)->next;
+        if (!*pp) {
+            proxy_set_error(err, err_len, "peer %s not found on listener %s", peer_ip, name);
+            return -1;
+        }
+
+        // 最后一个 peer 删除时连同监听端口一起关闭
+        if (listener->peer_count > 1) {
+            proxy_peer_t *peer = *pp;
+            close_sessions(engine, listener, peer, "peer removed");
+            *pp = peer->next;
+            listener->peer_count--;
+            engine->ops->uninstall(engine, listener->ep.fd, peer);
+            free(peer);
+            proxy_sched_peers_changed(engine);
+            proxy_log("INFO", "Listener %s: removed peer %s", name, peer_ip);
+            return 0;
+        }
+    }
+
+    proxy_log("INFO", "Listener %s on port %d removed", name, listener->port);
+    listener_destroy(engine, listener, 0);
+    proxy_sched_peers_changed(engine);
+    return 0;
+}
+
+int proxy_connect_target(const char *host, int port, int *connecting) {
+    struct addrinfo hints, *res = NULL;
+    char port_str[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    int rc = getaddrinfo(host, port_str, &hints, &res);
+    if (rc != 0 || !res) {
+        proxy_log("ERROR", "Failed to resolve host %s: %s", host, gai_strerror(rc));
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        proxy_log("ERROR", "Failed to create socket: %s", strerror(errno));
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    *connecting = 0;
+    if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        if (errno != EINPROGRESS) {
+            proxy_log("ERROR", "Failed to connect to %s:%d: %s", host, port, strerror(errno));
+            close(fd);
+            freeaddrinfo(res);
+            return -1;
+        }
+        *connecting = 1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+static void handle_accept(proxy_engine_t *engine, proxy_listener_t *listener) {
+    while (listener->ep.fd >= 0) {
+        struct sockaddr_storage client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+
+        int peer_fd = accept4(listener->ep.fd, (struct sockaddr *)&client_addr, &client_len,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC);
+        char client_ip[INET6_ADDRSTRLEN] = "unknown";
+        int client_port = 0;
+
+        if (peer_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (errno == EINTR) continue;
+
+            if (client_addr.ss_family == AF_INET || client_addr.ss_family == AF_INET6) {
+                sockaddr_to_string(&client_addr, client_ip, sizeof(client_ip), &client_port);
+            }
+
+            // 认证失败会导致 accept 失败
+            if (errno == ECONNABORTED || errno == ECONNRESET) {
+                listener->auth_failures++;
+                PROXY_PROBE4(auth_failure, listener->name, client_ip, client_port, errno);
+                proxy_log("ERROR", "Connection from %s:%d failed - Possible %s authentication mismatch",
+                          client_ip, client_port, engine->ops->name);
+            } else if (errno == ETIMEDOUT) {
+                proxy_log("ERROR", "Connection from %s:%d timed out", client_ip, client_port);
+            } else {
+                proxy_log("ERROR", "Accept failed: %s (errno=%d)", strerror(errno), errno);
+                return;
+            }
+            continue;
+        }
+
+        sockaddr_to_string(&client_addr, client_ip, sizeof(client_ip), &client_port);
+        proxy_log("INFO", "New connection from %s:%d on listener %s", client_ip, client_port, listener->name);
+
+        proxy_peer_t *peer = listener_find_peer(listener, client_ip);
+        if (!peer) {
+            listener->rejected++;
+            PROXY_PROBE2(reject, listener->name, client_ip);
+            proxy_log("WARN", "Connection from unexpected peer %s on listener %s, rejecting",
+                      client_ip, listener->name);
+            close(peer_fd);
+            continue;
+        }
+
+        int connecting = 0;
+        int forward_fd = proxy_connect_target(listener->forward_host, listener->forward_port, &connecting);
+        if (forward_fd < 0 && !listener->resume) {
+            close(peer_fd);
+            continue;
+        }
+
+        proxy_session_t *s = session_create(engine, engine->next_session_id++, listener, peer,
+                                            peer_fd, forward_fd, client_ip, client_port);
+        if (!s) {
+            close(peer_fd);
+            if (forward_fd >= 0) close(forward_fd);
+            continue;
+        }
+        listener->accepted++;
+        peer->sessions_accepted++;
+        engine->sessions_accepted++;
+        PROXY_PROBE4(accept, s->id, listener->name, s->peer_ip, s->peer_port);
+
+        if (listener->resume) {
+            if (proxy_resume_attach(engine, s, listener->resume, connecting) < 0) {
+                session_close(engine, s, "failed to set up resumable forwarding");
+                continue;
+            }
+        } else {
+            s->connecting = connecting;
+            if (!connecting) {
+                proxy_log("INFO", "Session %u connected to forward target %s:%d",
+                          s->id, listener->forward_host, listener->forward_port);
+                PROXY_PROBE4(forward_connect, s->id, listener->forward_host, listener->forward_port, 0);
+                proxy_latency_enable(s, &s->forward_ep);
+            }
+        }
+        proxy_latency_enable(s, &s->peer_ep);
+        proxy_mirror_open_legs(engine, s);
+        if (listener->recorder) proxy_recorder_open(listener->recorder, s, 0);
+        if (listener->bmp_stats) proxy_bmp_attach(listener->bmp_stats, s, 0);
+        proxy_filter_attach(listener, s);
+        session_update_events(engine, s);
+    }
+}
+
+// 一侧关闭且发往另一侧的数据已送出后关闭整个会话, 否则更新 epoll 事件;
+// 两侧缓冲都已清空时尝试进入内核快速路径
+static int session_check_done(proxy_engine_t *engine, proxy_session_t *s) {
+    if (s->peer_eof && buffer_pending(&s->to_forward) == 0 && (!s->resume || proxy_resume_drained(s))) {
+        session_close(engine, s, "peer connection closed");
+        return -1;
+    }
+    if (s->forward_eof && buffer_pending(&s->to_peer) == 0) {
+        session_close(engine, s, "forward connection closed");
+        return -1;
+    }
+    if (s->listener->fastpath) proxy_fastpath_attach(engine, s);
+
+    if (session_update_events(engine, s) < 0) {
+        session_close(engine, s, "epoll error");
+        return -1;
+    }
+    return 0;
+}
+
+// 处理会话事件, 返回 0 会话继续, -1 会话已关闭
+static int handle_session_event(proxy_engine_t *engine, proxy_endpoint_t *ep, uint32_t events) {
+    proxy_session_t *s = ep->owner;
+    int is_peer = (ep->type == PROXY_EP_PEER);
+
+    // 可续传会话的转发连接断开只触发重连, router 会话保持
+    if (!is_peer && s->resume) {
+        if (proxy_resume_handle_event(engine, s, events) < 0) {
+            session_close(engine, s, "forward stream cannot be resumed");
+            return -1;
+        }
+        return session_check_done(engine, s);
+    }
+
+    if (events & EPOLLERR) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(ep->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        // 错误队列中只有发送时间戳, 不是连接错误
+        if (err == 0 && s->latency) {
+            proxy_latency_errqueue(s, ep);
+            events &= ~EPOLLERR;
+            if (!(events & (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLRDHUP))) return 0;
+        } else {
+            session_close(engine, s, err ? strerror(err) : "socket error");
+            return -1;
+        }
+    }
+
+    if (proxy_fastpath_active(s)) return proxy_fastpath_handle_event(engine, s, events);
+
+    if (!is_peer && s->connecting) {
+        if (!(events & (EPOLLOUT | EPOLLHUP))) return 0;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(ep->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            proxy_log("ERROR", "Failed to connect to %s:%d: %s",
+                      s->listener->forward_host, s->listener->forward_port, strerror(err ? err : errno));
+            PROXY_PROBE4(forward_connect, s->id, s->listener->forward_host, s->listener->forward_port,
+                         err ? err : errno);
+            session_close(engine, s, "forward connect failed");
+            return -1;
+        }
+        s->connecting = 0;
+        proxy_log("INFO", "Session %u connected to forward target %s:%d",
+                  s->id, s->listener->forward_host, s->listener->forward_port);
+        PROXY_PROBE4(forward_connect, s->id, s->listener->forward_host, s->listener->forward_port, 0);
+        proxy_latency_enable(s, &s->forward_ep);
+    }
+
+    proxy_buffer_t *in_buf = is_peer ? &s->to_forward : &s->to_peer;
+    proxy_buffer_t *out_buf = is_peer ? &s->to_peer : &s->to_forward;
+    proxy_endpoint_t *other = is_peer ? &s->forward_ep : &s->peer_ep;
+    int *eof = is_peer ? &s->peer_eof : &s->forward_eof;
+
+    if ((events & (EPOLLIN | EPOLLHUP)) && (ep->events & EPOLLIN)) {
+        ssize_t n = buffer_recv(s, is_peer ? PROXY_DIR_FORWARD : PROXY_DIR_PEER, ep->fd, in_buf, eof);
+        if (n < 0) {
+            session_close(engine, s, strerror(errno));
+            return -1;
+        }
+        if (is_peer) {
+            s->bytes_to_forward += n;
+            engine->bytes_to_forward += n;
+            if (n > 0 && s->mirrors) proxy_mirror_feed(engine, s, in_buf->data + in_buf->len - n, n);
+            if (n > 0 && s->bmp) proxy_bmp_feed(s, in_buf->data + in_buf->len - n, n);
+        } else {
+            s->bytes_to_peer += n;
+            engine->bytes_to_peer += n;
+        }
+        if (n > 0 && s->listener->recorder) {
+            proxy_recorder_data(s->listener->recorder, s, is_peer, in_buf->data + in_buf->len - n, n);
+        }
+        // 镜像、统计和录制之后再过滤, 只影响发往转发目标的数据
+        if (is_peer && n > 0 && s->filter) proxy_filter_apply(s, in_buf, n);
+
+        // 立即尝试转发, 省去一次 epoll 往返
+        if (is_peer && s->resume) {
+            if (proxy_resume_push(engine, s) < 0) {
+                session_close(engine, s, "resume queue failed");
+                return -1;
+            }
+        } else if (buffer_pending(in_buf) > 0 && !(other == &s->forward_ep && s->connecting)) {
+            if (buffer_send(engine, s, is_peer ? PROXY_DIR_FORWARD : PROXY_DIR_PEER, other->fd, in_buf) < 0) {
+                session_close(engine, s, strerror(errno));
+                return -1;
+            }
+        }
+    } else if ((events & EPOLLHUP) && !(ep->events & EPOLLIN)) {
+        session_close(engine, s, is_peer ? "peer hang up" : "forward hang up");
+        return -1;
+    }
+
+    if ((events & EPOLLOUT) && buffer_pending(out_buf) > 0) {
+        if (buffer_send(engine, s, is_peer ? PROXY_DIR_PEER : PROXY_DIR_FORWARD, ep->fd, out_buf) < 0) {
+            session_close(engine, s, strerror(errno));
+            return -1;
+        }
+    }
+
+    return session_check_done(engine, s);
+}
+
+// 可续传会话的重连和超时检查
+static void resume_tick(proxy_engine_t *engine) {
+    time_t now = time(NULL);
+    proxy_session_t *s = engine->sessions;
+    while (s) {
+        proxy_session_t *next = s->next;
+        if (s->resume) {
+            if (proxy_resume_tick(engine, s, now) < 0) {
+                session_close(engine, s, "forward target unavailable");
+            } else {
+                session_check_done(engine, s);
+            }
+        }
+        s = next;
+    }
+}
+
+// 内核转发会话: 同步字节计数, 连接关闭或不再满足条件时退回普通转发
+static void fastpath_tick(proxy_engine_t *engine) {
+    if (!engine->fastpath) return;
+    proxy_session_t *s = engine->sessions;
+    while (s) {
+        proxy_session_t *next = s->next;
+        if (proxy_fastpath_active(s) && proxy_fastpath_tick(engine, s) > 0) session_check_done(engine, s);
+        s = next;
+    }
+}
+
+// 重试因配额不足暂停的会话
+static int session_flush(proxy_engine_t *engine, proxy_session_t *s) {
+    int progress = 0;
+
+    for (int dir = 0; dir < 2; dir++) {
+        if (!s->throttled[dir]) continue;
+        s->throttled[dir] = 0;
+
+        proxy_buffer_t *buf = dir == PROXY_DIR_FORWARD ? &s->to_forward : &s->to_peer;
+        proxy_endpoint_t *ep = dir == PROXY_DIR_FORWARD ? &s->forward_ep : &s->peer_ep;
+        size_t before = buffer_pending(buf);
+        int rc;
+
+        if (dir == PROXY_DIR_FORWARD && s->resume) {
+            rc = proxy_resume_push(engine, s);
+            progress |= !s->throttled[dir];
+        } else {
+            if (ep->fd < 0 || (dir == PROXY_DIR_FORWARD && s->connecting)) continue;
+            rc = buffer_send(engine, s, dir, ep->fd, buf);
+            progress |= buffer_pending(buf) < before;
+        }
+        if (rc < 0) {
+            session_close(engine, s, dir == PROXY_DIR_FORWARD && s->resume ? "resume queue failed" : strerror(errno));
+            return -1;
+        }
+    }
+    if (session_check_done(engine, s) < 0) return -1;
+    return progress;
+}
+
+// 补充令牌后按 DRR 轮流重试暂停的会话: 每一轮各 peer 最多发送一个 quantum, 直到没有进展为止;
+// 每次从不同的会话开始, 同一 peer 的多个会话之间也不会总是排在前面的先发
+static void sched_round(proxy_engine_t *engine) {
+    if (!proxy_sched_refill(engine)) return;
+
+    int progress = 1;
+    engine->sched_in_round = 1;
+    while (progress && engine->session_count > 0) {
+        progress = 0;
+        proxy_sched_add_quantum(engine);
+
+        int start = engine->sched_round++ % engine->session_count;
+        proxy_session_t *first = engine->sessions;
+        for (int i = 0; i < start && first->next; i++) first = first->next;
+
+        proxy_session_t *s = first;
+        do {
+            proxy_session_t *next = s->next ? s->next : engine->sessions;
+            if (s->throttled[PROXY_DIR_FORWARD] || s->throttled[PROXY_DIR_PEER]) {
+                int rc = session_flush(engine, s);
+                if (rc < 0) {
+                    // 会话已关闭, 链表可能变化, 下一轮从头开始
+                    progress = engine->session_count > 0;
+                    break;
+                }
+                progress |= rc;
+            }
+            s = next;
+        } while (s != first);
+    }
+    engine->sched_in_round = 0;
+}
+
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 把收发超时设为距 deadline 的剩余时间, 已超时返回 -1
+static int handoff_time_left(int fd, int64_t deadline) {
+    int64_t left = deadline - monotonic_ms();
+    if (left <= 0) {
+        proxy_log("ERROR", "HANDOFF: not finished within %d ms", PROXY_HANDOFF_DEADLINE_MS);
+        return -1;
+    }
+    struct timeval tv = { (time_t)(left / 1000), (suseconds_t)(left % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return 0;
+}
+
+// 把所有监听端口和会话交给新进程, 成功返回 0
+static int handoff_sessions(proxy_engine_t *engine, int fd) {
+    proxy_handoff_header_t header;
+    int64_t deadline = monotonic_ms() + PROXY_HANDOFF_DEADLINE_MS;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = PROXY_HANDOFF_MAGIC;
+    header.version = PROXY_HANDOFF_VERSION;
+    header.listener_count = engine->listener_count;
+    header.session_count = engine->session_count;
+    header.next_session_id = engine->next_session_id;
+    header.start_time = engine->start_time;
+    header.sessions_accepted = engine->sessions_accepted;
+    header.bytes_to_forward = engine->bytes_to_forward;
+    header.bytes_to_peer = engine->bytes_to_peer;
+    header.link_rate = engine->link_rate;
+    header.link_burst = engine->link_burst;
+
+    if (handoff_time_left(fd, deadline) < 0) return -1;
+    if (proxy_write_all(fd, &header, sizeof(header)) < 0) {
+        proxy_log("ERROR", "HANDOFF: failed to send header: %s", strerror(errno));
+        return -1;
+    }
+
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        proxy_handoff_listener_t rec;
+        if (handoff_time_left(fd, deadline) < 0) return -1;
+        memset(&rec, 0, sizeof(rec));
+        snprintf(rec.name, sizeof(rec.name), "%s", l->name);
+        snprintf(rec.forward_host, sizeof(rec.forward_host), "%s", l->forward_host);
+        rec.port = l->port;
+        rec.family = l->family;
+        rec.forward_port = l->forward_port;
+        rec.peer_count = l->peer_count;
+        rec.mirror_count = l->mirror_count;
+        rec.recording = l->recorder != NULL;
+        rec.resuming = l->resume != NULL;
+        rec.fastpath = l->fastpath;
+        rec.bmp_stats = l->bmp_stats != NULL;
+        rec.filtering = l->filter != NULL;
+        rec.accepted = l->accepted;
+        rec.rejected = l->rejected;
+        rec.auth_failures = l->auth_failures;
+
+        if (proxy_send_with_fds(fd, &rec, sizeof(rec), &l->ep.fd, 1) < 0) {
+            proxy_log("ERROR", "HANDOFF: failed to send listener %s: %s", l->name, strerror(errno));
+            return -1;
+        }
+
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            proxy_handoff_peer_t peer_rec;
+            memset(&peer_rec, 0, sizeof(peer_rec));
+            snprintf(peer_rec.ip, sizeof(peer_rec.ip), "%s", p->ip);
+            peer_rec.family = p->family;
+            peer_rec.secret_len = strlen(p->secret);
+            peer_rec.sessions_accepted = p->sessions_accepted;
+            peer_rec.rate = p->rate;
+            peer_rec.burst = p->burst;
+            memcpy(peer_rec.latency, p->latency, sizeof(peer_rec.latency));
+            if (proxy_write_all(fd, &peer_rec, sizeof(peer_rec)) < 0 ||
+                proxy_write_all(fd, p->secret, peer_rec.secret_len) < 0) {
+                proxy_log("ERROR", "HANDOFF: failed to send peer %s: %s", p->ip, strerror(errno));
+                return -1;
+            }
+        }
+        if (proxy_mirror_handoff_targets(fd, l) < 0) return -1;
+        if (l->recorder && proxy_recorder_handoff(fd, l->recorder) < 0) return -1;
+        if (l->resume && proxy_resume_config_handoff(fd, l->resume) < 0) return -1;
+        if (l->bmp_stats && proxy_bmp_stats_handoff(fd, l->bmp_stats) < 0) return -1;
+        if (l->filter && proxy_filter_handoff(fd, l->filter) < 0) return -1;
+    }
+
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        proxy_handoff_session_t rec;
+        uint32_t index = 0;
+        if (handoff_time_left(fd, deadline) < 0) return -1;
+        for (proxy_listener_t *l = engine->listeners; l && l != s->listener; l = l->next) index++;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.id = s->id;
+        rec.listener_index = index;
+        rec.peer_port = s->peer_port;
+        rec.connecting = s->connecting;
+        rec.peer_eof = s->peer_eof;
+        rec.forward_eof = s->forward_eof;
+        rec.to_forward_len = buffer_pending(&s->to_forward);
+        rec.to_peer_len = buffer_pending(&s->to_peer);
+        rec.mirror_count = s->mirror_count;
+        rec.resuming = s->resume != NULL;
+        rec.forward_fd = s->forward_ep.fd >= 0 && (!s->resume || proxy_resume_streaming(s));
+        rec.bmp = s->bmp != NULL;
+        rec.filtering = s->filter != NULL;
+        rec.start_time = s->start_time;
+        rec.bytes_to_forward = s->bytes_to_forward;
+        rec.bytes_to_peer = s->bytes_to_peer;
+        memcpy(rec.framing, s->framing, sizeof(rec.framing));
+        snprintf(rec.peer_ip, sizeof(rec.peer_ip), "%s", s->peer_ip);
+
+        int fds[2] = { s->peer_ep.fd, s->forward_ep.fd };
+        if (proxy_send_with_fds(fd, &rec, sizeof(rec), fds, rec.forward_fd ? 2 : 1) < 0 ||
+            proxy_write_all(fd, s->to_forward.data + s->to_forward.off, rec.to_forward_len) < 0 ||
+            proxy_write_all(fd, s->to_peer.data + s->to_peer.off, rec.to_peer_len) < 0) {
+            proxy_log("ERROR", "HANDOFF: failed to send session %u: %s", s->id, strerror(errno));
+            return -1;
+        }
+        if (proxy_mirror_handoff_legs(fd, s) < 0) return -1;
+        if (s->resume && proxy_resume_handoff(fd, s) < 0) return -1;
+        if (s->bmp && proxy_bmp_stream_handoff(fd, s) < 0) return -1;
+        if (s->filter && proxy_filter_stream_handoff(fd, s) < 0) return -1;
+    }
+
+    // 等待新进程确认
+    char ack[3];
+    if (handoff_time_left(fd, deadline) < 0) return -1;
+    if (proxy_read_all(fd, ack, sizeof(ack)) < 0 || memcmp(ack, "OK\n", 3) != 0) {
+        proxy_log("ERROR", "HANDOFF: new process did not confirm, resuming");
+        return -1;
+    }
+
+    proxy_log("INFO", "HANDOFF: %d listeners, %d sessions handed to new process",
+              engine->listener_count, engine->session_count);
+    return 0;
+}
+
+static void session_auth_json(proxy_engine_t *engine, proxy_session_t *s, proxy_strbuf_t *sb) {
+    char buf[PROXY_AUTH_JSON_MAX];
+    if (engine->ops->session_json && s->peer_ep.fd >= 0 &&
+        engine->ops->session_json(engine, s, buf, sizeof(buf)) >= 0) {
+        proxy_strbuf_printf(sb, "%s", buf);
+    } else {
+        proxy_strbuf_printf(sb, "null");
+    }
+}
+
+static void build_sessions_json(proxy_engine_t *engine, proxy_strbuf_t *sb) {
+    time_t now = time(NULL);
+    int first = 1;
+
+    proxy_strbuf_printf(sb, "[");
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        proxy_fastpath_sync(engine, s);
+        proxy_strbuf_printf(sb, "%s{\"id\":%u,\"listener\":", first ? "" : ",", s->id);
+        proxy_strbuf_json_string(sb, s->listener->name);
+        proxy_strbuf_printf(sb, ",\"peer\":");
+        proxy_strbuf_json_string(sb, s->peer_ip);
+        proxy_strbuf_printf(sb, ",\"peerPort\":%d,\"uptime\":%ld,\"connecting\":%s,"
+                      "\"bytesToForward\":%llu,\"bytesToPeer\":%llu,"
+                      "\"bufferedToForward\":%zu,\"bufferedToPeer\":%zu,\"mirrors\":",
+                      s->peer_port, (long)(now - s->start_time), s->connecting ? "true" : "false",
+                      (unsigned long long)s->bytes_to_forward, (unsigned long long)s->bytes_to_peer,
+                      buffer_pending(&s->to_forward), buffer_pending(&s->to_peer));
+        proxy_mirror_legs_json(s, sb);
+        proxy_strbuf_printf(sb, ",\"resume\":");
+        proxy_resume_json(s, sb);
+        proxy_strbuf_printf(sb, ",\"throttled\":[%s,%s],\"fastPath\":", s->throttled[PROXY_DIR_FORWARD] ? "true" : "false",
+                            s->throttled[PROXY_DIR_PEER] ? "true" : "false");
+        proxy_fastpath_session_json(s, sb);
+        proxy_strbuf_printf(sb, ",\"auth\":");
+        session_auth_json(engine, s, sb);
+        proxy_strbuf_printf(sb, "}");
+        first = 0;
+    }
+    proxy_strbuf_printf(sb, "]");
+}
+
+static void build_stats_json(proxy_engine_t *engine, proxy_strbuf_t *sb) {
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) proxy_fastpath_sync(engine, s);
+    proxy_strbuf_printf(sb, "{\"pid\":%d,\"auth\":", (int)getpid());
+    proxy_strbuf_json_string(sb, engine->ops->name);
+    proxy_strbuf_printf(sb, ",\"uptime\":%ld,\"sessions\":%d,\"sessionsAccepted\":%llu,"
+                  "\"bytesToForward\":%llu,\"bytesToPeer\":%llu,\"listeners\":[",
+                  (long)(time(NULL) - engine->start_time), engine->session_count,
+                  (unsigned long long)engine->sessions_accepted,
+                  (unsigned long long)engine->bytes_to_forward, (unsigned long long)engine->bytes_to_peer);
+
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        proxy_strbuf_printf(sb, "%s{\"name\":", l == engine->listeners ? "" : ",");
+        proxy_strbuf_json_string(sb, l->name);
+        proxy_strbuf_printf(sb, ",\"port\":%d,\"forward\":\"%s:%d\",\"accepted\":%llu,\"rejected\":%llu,"
+                      "\"authFailures\":%llu,\"peers\":[",
+                      l->port, l->forward_host, l->forward_port, (unsigned long long)l->accepted,
+                      (unsigned long long)l->rejected, (unsigned long long)l->auth_failures);
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            proxy_strbuf_printf(sb, "%s{\"ip\":", p == l->peers ? "" : ",");
+            proxy_strbuf_json_string(sb, p->ip);
+            proxy_strbuf_printf(sb, ",\"sessions\":%d,\"sessionsAccepted\":%llu,\"shape\":",
+                          p->session_count, (unsigned long long)p->sessions_accepted);
+            proxy_sched_peer_json(p, sb);
+            proxy_strbuf_printf(sb, ",\"latency\":");
+            proxy_latency_peer_json(p, sb);
+            proxy_strbuf_printf(sb, "}");
+        }
+        proxy_strbuf_printf(sb, "],\"mirrors\":");
+        proxy_mirror_targets_json(engine, l, sb);
+        proxy_strbuf_printf(sb, ",\"recorder\":");
+        proxy_recorder_json(l->recorder, sb);
+        proxy_strbuf_printf(sb, ",\"resume\":");
+        proxy_resume_config_json(l->resume, sb);
+        proxy_strbuf_printf(sb, ",\"fastPath\":%s,\"bmpStats\":%s,\"filter\":", l->fastpath ? "true" : "false",
+                            l->bmp_stats ? "true" : "false");
+        proxy_filter_json(l->filter, sb);
+        proxy_strbuf_printf(sb, "}");
+    }
+    proxy_strbuf_printf(sb, "],\"link\":");
+    proxy_sched_link_json(engine, sb);
+    proxy_strbuf_printf(sb, ",\"fastPath\":");
+    proxy_fastpath_json(engine, sb);
+    proxy_strbuf_printf(sb, "}");
+}
+
+static void control_reply(proxy_control_conn_t *conn, const char *status, const char *body) {
+    if (conn->ep.fd < 0) return;
+    if (proxy_write_all(conn->ep.fd, status, strlen(status)) < 0 ||
+        proxy_write_all(conn->ep.fd, " ", 1) < 0 ||
+        proxy_write_all(conn->ep.fd, body, strlen(body)) < 0 ||
+        proxy_write_all(conn->ep.fd, "\n", 1) < 0) {
+        proxy_log("WARN", "Failed to write control reply: %s", strerror(errno));
+    }
+}
+
+// 取下一个以空格分隔的参数
+static char *next_token(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ') p++;
+    if (*p == '\0') return NULL;
+    char *start = p;
+    while (*p && *p != ' ') p++;
+    if (*p) *p++ = '\0';
+    *cursor = p;
+    return start;
+}
+
+// 行剩余部分 (密钥可包含空格)
+static char *rest_of_line(char **cursor) {
+    char *p = *cursor;
+    while (*p == ' ') p++;
+    return *p ? p : NULL;
+}
+
+// 命令行中不允许控制字符: 密钥里夹带的 \r 或 NUL 会截断参数, 后面的内容可能被当作另一条命令
+static int control_line_valid(const char *line, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)line[i];
+        if (c < 0x20 || c == 0x7f) return 0;
+    }
+    return 1;
+}
+
+static void control_execute(proxy_engine_t *engine, proxy_control_conn_t *conn, char *line) {
+    char err[PROXY_ERROR_MAX] = "";
+    char *cursor = line;
+    char *cmd = next_token(&cursor);
+
+    if (!cmd) return;
+    conn->commands++;
+
+    if (strcmp(cmd, "CLIENT") == 0) {
+        // --client 中继的第一行, 不回复, 以免打乱中继另一端的应答顺序
+        conn->relay = 1;
+    } else if (strcmp(cmd, "PING") == 0) {
+        char body[64];
+        snprintf(body, sizeof(body), "{\"pid\":%d}", (int)getpid());
+        control_reply(conn, "OK", body);
+    } else if (strcmp(cmd, "ADD") == 0) {
+        char *name = next_token(&cursor);
+        char *port = next_token(&cursor);
+        char *forward = next_token(&cursor);
+        char *peer_ip = next_token(&cursor);
+        char *secret = rest_of_line(&cursor);
+        if (!secret) {
+            control_reply(conn, "ERR", "usage: ADD <listener> <listen_port> <forward_host:port> <peer_ip> <secret>");
+        } else if (proxy_engine_add_peer(engine, name, atoi(port), forward, peer_ip, secret, err, sizeof(err)) < 0) {
+            control_reply(conn, "ERR", err);
+        } else {
+            control_reply(conn, "OK", "{}");
+        }
+    } else if (strcmp(cmd, "KEYS") == 0) {
+        char *name = next_token(&cursor);
+        char *peer_ip = next_token(&cursor);
+        char *secret = rest_of_line(&cursor);
+        if (!secret) {
+            control_reply(conn, "ERR", "usage: KEYS <listener> <peer_ip> <secret>");
+        } else if (proxy_engine_update_keys(engine, name, peer_ip, secret, err, sizeof(err)) < 0) {
+            control_reply(conn, "ERR", err);
+        } else {
+            control_reply(conn, "OK", "{}");
+        }
+    } else if (strcmp(cmd, "REMOVE") == 0) {
+        char *name = next_token(&cursor);
+        char *peer_ip = next_token(&cursor);
+        if (!name) {
+            control_reply(conn, "ERR", "usage: REMOVE <listener> [<peer_ip>]");
+        } else if (proxy_engine_remove_peer(engine, name, peer_ip, err, sizeof(err)) < 0) {
+            control_reply(conn, "ERR", err);
+        } else {
+            control_reply(conn, "OK", "{}");
+        }
+    } else if (strcmp(cmd, "MIRROR") == 0 || strcmp(cmd, "UNMIRROR") == 0) {
+        int add = strcmp(cmd, "MIRROR") == 0;
+        char *name = next_token(&cursor);
+        char *target = next_token(&cursor);
+        char *policy = next_token(&cursor);
+        char *max_lag = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+        int rc = 0;
+
+        if (!target || (add && policy && strcmp(policy, "drop") != 0 && strcmp(policy, "lag") != 0)) {
+            control_reply(conn, "ERR", add ? "usage: MIRROR <listener> <host:port> [drop|lag [max_lag_bytes]]"
+                                           : "usage: UNMIRROR <listener> <host:port>");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            rc = -1;
+        } else if (add) {
+            rc = proxy_mirror_add_target(listener, target,
+                                         policy && strcmp(policy, "drop") == 0 ? PROXY_MIRROR_DROP : PROXY_MIRROR_LAG,
+                                         max_lag ? strtoull(max_lag, NULL, 10) : 0, err, sizeof(err));
+        } else {
+            rc = proxy_mirror_remove_target(engine, listener, target, err, sizeof(err));
+        }
+        control_reply(conn, rc < 0 ? "ERR" : "OK", rc < 0 ? err : "{}");
+    } else if (strcmp(cmd, "RECORD") == 0) {
+        char *name = next_token(&cursor);
+        char *dir = next_token(&cursor);
+        char *max_file_mb = next_token(&cursor);
+        char *max_file_seconds = next_token(&cursor);
+        char *max_files = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+
+        if (!dir) {
+            control_reply(conn, "ERR", "usage: RECORD <listener> <dir> [max_file_mb] [max_file_seconds] [max_files]");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        proxy_recorder_t *rec = proxy_recorder_start(listener->name, dir,
+                                                     max_file_mb ? strtoull(max_file_mb, NULL, 10) : 0,
+                                                     max_file_seconds ? atoi(max_file_seconds) : 0,
+                                                     max_files ? atoi(max_files) : 0, err, sizeof(err));
+        if (!rec) {
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        // 重新配置时旧录制器写完剩余数据后退出; 已建立的会话从当前位置开始录制
+        proxy_recorder_stop(listener->recorder);
+        listener->recorder = rec;
+        for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+            if (s->listener == listener) proxy_recorder_open(rec, s, 1);
+        }
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "UNRECORD") == 0) {
+        char *name = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+        if (!listener || !listener->recorder) {
+            control_reply(conn, "ERR", "listener not found or not recording");
+            return;
+        }
+        proxy_recorder_stop(listener->recorder);
+        listener->recorder = NULL;
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "RESUME") == 0) {
+        char *name = next_token(&cursor);
+        char *spill_dir = next_token(&cursor);
+        char *mem_mb = next_token(&cursor);
+        char *disk_mb = next_token(&cursor);
+        char *max_outage = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+        proxy_resume_config_t *cfg = NULL;
+
+        if (!spill_dir) {
+            control_reply(conn, "ERR",
+                          "usage: RESUME <listener> <spill_dir|-|off> [mem_mb] [disk_mb] [max_outage_seconds]");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        if (strcmp(spill_dir, "off") != 0) {
+            cfg = proxy_resume_config_create(spill_dir, mem_mb ? strtoull(mem_mb, NULL, 10) : 0,
+                                             disk_mb ? strtoull(disk_mb, NULL, 10) : 0,
+                                             max_outage ? atoi(max_outage) : 0, err, sizeof(err));
+            if (!cfg) {
+                control_reply(conn, "ERR", err);
+                return;
+            }
+        }
+        // 已建立的会话没有握手过, 保持原来的转发方式
+        proxy_resume_config_free(listener->resume);
+        listener->resume = cfg;
+        proxy_log("INFO", "Listener %s: resumable forwarding %s", listener->name, cfg ? "enabled" : "disabled");
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "SHAPE") == 0) {
+        char *name = next_token(&cursor);
+        char *peer_ip = name && strcmp(name, "*") == 0 ? NULL : next_token(&cursor);
+        char *rate = next_token(&cursor);
+        char *burst = next_token(&cursor);
+        proxy_listener_t *listener = NULL;
+        proxy_peer_t *peer = NULL;
+
+        if (!rate) {
+            control_reply(conn, "ERR", "usage: SHAPE <listener> <peer_ip> <rate_kbps> [burst_kb] | "
+                                       "SHAPE * <rate_kbps> [burst_kb]");
+            return;
+        }
+        // 速率按 kbit/s, 突发量按 KB 给出
+        uint64_t rate_bytes = strtoull(rate, NULL, 10) * 1000 / 8;
+        uint64_t burst_bytes = burst ? strtoull(burst, NULL, 10) * 1024 : 0;
+        if (!peer_ip) {
+            proxy_sched_set_link(engine, rate_bytes, burst_bytes);
+            proxy_log("INFO", "Tunnel rate limit set to %s kbit/s", rate);
+            control_reply(conn, "OK", "{}");
+            return;
+        }
+        listener = proxy_engine_find_listener(engine, name);
+        peer = listener ? listener_find_peer(listener, peer_ip) : NULL;
+        if (!peer) {
+            proxy_set_error(err, sizeof(err), "peer %s not found on listener %s", peer_ip, name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        proxy_sched_set_peer(engine, peer, rate_bytes, burst_bytes);
+        proxy_log("INFO", "Listener %s: peer %s rate limit set to %s kbit/s", listener->name, peer->ip, rate);
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "FASTPATH") == 0) {
+        char *name = next_token(&cursor);
+        char *mode = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+
+        if (!mode || (strcmp(mode, "on") != 0 && strcmp(mode, "off") != 0)) {
+            control_reply(conn, "ERR", "usage: FASTPATH <listener> on|off");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        if (proxy_fastpath_enable(engine, listener, strcmp(mode, "on") == 0, err, sizeof(err)) < 0) {
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        // 已建立的会话在下一次事件时进入快速路径
+        proxy_log("INFO", "Listener %s: kernel fast path %s", listener->name, listener->fastpath ? "enabled" : "disabled");
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "BMPSTATS") == 0) {
+        char *name = next_token(&cursor);
+        char *mode = next_token(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+
+        if (!name || (mode && strcmp(mode, "on") != 0 && strcmp(mode, "off") != 0 && strcmp(mode, "reset") != 0)) {
+            control_reply(conn, "ERR", "usage: BMPSTATS <listener> [on|off|reset]");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        if (!mode || strcmp(mode, "reset") == 0) {
+            proxy_strbuf_t sb = { NULL, 0, 0, 0 };
+            if (!listener->bmp_stats) {
+                control_reply(conn, "ERR", "BMP statistics not enabled");
+                return;
+            }
+            // 同 LATENCY reset, 先返回当前计数再清零
+            proxy_bmp_stats_json(listener->bmp_stats, &sb);
+            if (mode) proxy_bmp_stats_reset(listener->bmp_stats);
+            if (sb.failed) {
+                control_reply(conn, "ERR", "out of memory");
+            } else {
+                control_reply(conn, "OK", sb.data);
+            }
+            free(sb.data);
+            return;
+        }
+        if (strcmp(mode, "on") == 0 && !listener->bmp_stats) {
+            listener->bmp_stats = proxy_bmp_stats_create();
+            if (!listener->bmp_stats) {
+                control_reply(conn, "ERR", "out of memory");
+                return;
+            }
+            // 已建立的会话从下一条完整的消息开始统计
+            for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+                if (s->listener == listener) proxy_bmp_attach(listener->bmp_stats, s, 1);
+            }
+        } else if (strcmp(mode, "off") == 0 && listener->bmp_stats) {
+            for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+                if (s->listener == listener) proxy_bmp_detach(s);
+            }
+            proxy_bmp_stats_free(listener->bmp_stats);
+            listener->bmp_stats = NULL;
+        }
+        proxy_log("INFO", "Listener %s: BMP statistics %s", listener->name,
+                  listener->bmp_stats ? "enabled" : "disabled");
+        control_reply(conn, "OK", "{}");
+    } else if (strcmp(cmd, "FILTER") == 0 || strcmp(cmd, "UNFILTER") == 0) {
+        int add = strcmp(cmd, "FILTER") == 0;
+        char *name = next_token(&cursor);
+        char *args = rest_of_line(&cursor);
+        proxy_listener_t *listener = name ? proxy_engine_find_listener(engine, name) : NULL;
+
+        if (!name) {
+            control_reply(conn, "ERR", add ? "usage: FILTER <listener> [pass|drop|sample:N [<key>=<value>...]]"
+                                           : "usage: UNFILTER <listener> [<id>]");
+            return;
+        }
+        if (!listener) {
+            proxy_set_error(err, sizeof(err), "listener %s not found", name);
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        if (add && !args) {
+            proxy_strbuf_t sb = { NULL, 0, 0, 0 };
+            proxy_filter_json(listener->filter, &sb);
+            if (sb.failed) {
+                control_reply(conn, "ERR", "out of memory");
+            } else {
+                control_reply(conn, "OK", sb.data);
+            }
+            free(sb.data);
+            return;
+        }
+        char body[64];
+        int rc = add ? proxy_filter_add(engine, listener, args, err, sizeof(err))
+                     : proxy_filter_remove(engine, listener, args ? strtoul(args, NULL, 10) : 0, err, sizeof(err));
+        if (rc < 0) {
+            control_reply(conn, "ERR", err);
+            return;
+        }
+        if (add) {
+            proxy_log("INFO", "Listener %s: filter rule %d added", listener->name, rc);
+            snprintf(body, sizeof(body), "{\"id\":%d}", rc);
+        } else {
+            proxy_log("INFO", "Listener %s: %d filter rules removed", listener->name, rc);
+            snprintf(body, sizeof(body), "{\"removed\":%d}", rc);
+        }
+        control_reply(conn, "OK", body);
+    } else if (strcmp(cmd, "SESSIONS") == 0 || strcmp(cmd, "STATS") == 0 || strcmp(cmd, "LATENCY") == 0) {
+        proxy_strbuf_t sb = { NULL, 0, 0, 0 };
+        char *arg = next_token(&cursor);
+        if (strcmp(cmd, "SESSIONS") == 0) {
+            build_sessions_json(engine, &sb);
+        } else if (strcmp(cmd, "STATS") == 0) {
+            build_stats_json(engine, &sb);
+        } else {
+            // 先返回当前的直方图再清零, 便于按时间段采集
+            proxy_latency_json(engine, &sb);
+            if (arg && strcmp(arg, "reset") == 0) proxy_latency_reset(engine);
+        }
+        if (sb.failed) {
+            control_reply(conn, "ERR", "out of memory");
+        } else {
+            control_reply(conn, "OK", sb.data);
+        }
+        free(sb.data);
+    } else if (strcmp(cmd, "HANDOFF") == 0) {
+        // 只有 --takeover 新进程会在连接后直接发送 HANDOFF
+        if (conn->relay || conn->commands != 1 || conn->uid != geteuid()) {
+            proxy_log("WARN", "HANDOFF refused: not the first command of a takeover connection");
+            control_reply(conn, "ERR", "HANDOFF is only accepted from --takeover");
+            return;
+        }
+        proxy_log("INFO", "HANDOFF requested, transferring %d listeners and %d sessions",
+                  engine->listener_count, engine->session_count);
+        // sockmap 属于本进程, 会话先退回普通转发, 新进程再重新加入自己的 sockmap
+        int rc = proxy_fastpath_detach_all(engine, err, sizeof(err));
+        for (proxy_session_t *s = engine->sessions; s; s = s->next) session_update_events(engine, s);
+        if (rc < 0) {
+            proxy_log("WARN", "HANDOFF refused: %s", err);
+            control_reply(conn, "ERR", err);
+        } else if (handoff_sessions(engine, conn->ep.fd) == 0) {
+            engine->handed_off = 1;
+            *engine->running = 0;
+        } else {
+            // 关闭连接 (由读循环回收), 新进程读到 EOF 后放弃接管, 不会在本进程恢复转发后再确认
+            shutdown(conn->ep.fd, SHUT_RDWR);
+        }
+    } else {
+        control_reply(conn, "ERR", "unknown command");
+    }
+}
+
+// 控制 socket 可以安装密钥、交出 socket、以本进程身份写文件, 两端必须是同一用户
+static int control_peer_trusted(int fd, const char *what, uid_t *uid) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0) {
+        proxy_log("ERROR", "%s: SO_PEERCRED failed: %s", what, strerror(errno));
+        return 0;
+    }
+    if (cred.uid != geteuid()) {
+        proxy_log("WARN", "%s: rejecting pid %d with uid %d", what, (int)cred.pid, (int)cred.uid);
+        return 0;
+    }
+    if (uid) *uid = cred.uid;
+    return 1;
+}
+
+static void control_conn_close(proxy_engine_t *engine, proxy_control_conn_t *conn) {
+    proxy_control_conn_t **pp = &engine->conns;
+    while (*pp && *pp != conn) pp = &(*pp)->next;
+    if (!*pp) return;
+    *pp = conn->next;
+    proxy_endpoint_close(engine, &conn->ep);
+    conn->next = engine->closed_conns;
+    engine->closed_conns = conn;
+}
+
+static void handle_control_accept(proxy_engine_t *engine) {
+    while (1) {
+        int fd = accept4(engine->control.fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                proxy_log("ERROR", "Control accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        uid_t uid;
+        if (!control_peer_trusted(fd, "Control", &uid)) {
+            close(fd);
+            continue;
+        }
+
+        // 控制连接保持阻塞写 (带超时), 读取使用 MSG_DONTWAIT, 以便 HANDOFF 直接复用该连接
+        proxy_set_timeouts(fd, PROXY_CONTROL_TIMEOUT);
+        proxy_control_conn_t *conn = calloc(1, sizeof(proxy_control_conn_t));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->ep.type = PROXY_EP_CONTROL_CONN;
+        conn->ep.fd = fd;
+        conn->ep.owner = conn;
+        conn->uid = uid;
+        if (proxy_endpoint_set_events(engine, &conn->ep, EPOLLIN, 1) < 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = engine->conns;
+        engine->conns = conn;
+    }
+}
+
+static void handle_control_conn(proxy_engine_t *engine, proxy_control_conn_t *conn) {
+    while (conn->ep.fd >= 0 && !engine->handed_off) {
+        if (conn->len >= sizeof(conn->line) - 1) {
+            control_reply(conn, "ERR", "line too long");
+            control_conn_close(engine, conn);
+            return;
+        }
+
+        ssize_t n = recv(conn->ep.fd, conn->line + conn->len, sizeof(conn->line) - 1 - conn->len, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) control_conn_close(engine, conn);
+            return;
+        }
+        if (n == 0) {
+            control_conn_close(engine, conn);
+            return;
+        }
+        conn->len += n;
+
+        // 逐行执行命令
+        size_t start = 0;
+        for (size_t i = 0; i < conn->len; i++) {
+            if (conn->line[i] != '\n') continue;
+            size_t end = i > start && conn->line[i - 1] == '\r' ? i - 1 : i;
+            conn->line[end] = '\0';
+            if (control_line_valid(conn->line + start, end - start)) {
+                control_execute(engine, conn, conn->line + start);
+            } else {
+                // 每行仍回复一次, 保持应答与请求一一对应
+                control_reply(conn, "ERR", "control characters are not allowed");
+            }
+            start = i + 1;
+            if (conn->ep.fd < 0 || engine->handed_off) return;
+        }
+        memmove(conn->line, conn->line + start, conn->len - start);
+        conn->len -= start;
+    }
+}
+
+int proxy_engine_init(proxy_engine_t *engine, const proxy_auth_ops_t *ops, volatile sig_atomic_t *running) {
+    memset(engine, 0, sizeof(*engine));
+    engine->ops = ops;
+    engine->running = running;
+    engine->control.type = PROXY_EP_CONTROL;
+    engine->control.fd = -1;
+    engine->takeover_fd = -1;
+    engine->next_session_id = 1;
+    engine->start_time = time(NULL);
+
+    engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epfd < 0) {
+        proxy_log("ERROR", "epoll_create1 failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 控制 socket 所在目录只能由本用户访问: 不存在时创建为 0700, 已存在时检查属主和权限
+static int control_dir_check(const char *control_path) {
+    char dir[PROXY_CONTROL_PATH_MAX];
+    struct stat st;
+
+    snprintf(dir, sizeof(dir), "%s", control_path);
+    char *slash = strrchr(dir, '/');
+    if (!slash || slash == dir) {
+        proxy_log("ERROR", "Control socket %s must be inside a private directory", control_path);
+        return -1;
+    }
+    *slash = '\0';
+
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        proxy_log("ERROR", "Failed to create %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    if (lstat(dir, &st) < 0) {
+        proxy_log("ERROR", "Failed to stat %s: %s", dir, strerror(errno));
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077)) {
+        proxy_log("ERROR", "%s must be a directory owned by uid %d with mode 0700", dir, (int)geteuid());
+        return -1;
+    }
+    return 0;
+}
+
+int proxy_engine_open_control(proxy_engine_t *engine, const char *control_path) {
+    struct sockaddr_un addr;
+
+    if (strlen(control_path) >= sizeof(addr.sun_path)) {
+        proxy_log("ERROR", "Control socket path too long: %s", control_path);
+        return -1;
+    }
+    if (control_dir_check(control_path) < 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        proxy_log("ERROR", "Failed to create control socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", control_path);
+
+    // 旧进程 (或残留文件) 占用的路径直接替换, 旧进程已接受的连接不受影响
+    unlink(control_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(control_path, 0600) < 0 ||
+        listen(fd, 16) < 0) {
+        proxy_log("ERROR", "Failed to bind control socket %s: %s", control_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    engine->control.fd = fd;
+    snprintf(engine->control_path, sizeof(engine->control_path), "%s", control_path);
+    proxy_log("INFO", "Control socket listening on %s", control_path);
+    return proxy_endpoint_set_events(engine, &engine->control, EPOLLIN, 1);
+}
+
+static int takeover_listener(proxy_engine_t *engine, int fd, proxy_listener_t **out) {
+    proxy_handoff_listener_t rec;
+    int fds[PROXY_HANDOFF_MAX_FDS];
+    int nfds = 0;
+
+    if (proxy_recv_with_fds(fd, &rec, sizeof(rec), fds, 1, &nfds) < 0 || nfds != 1) {
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        proxy_log("ERROR", "TAKEOVER: invalid listener record");
+        return -1;
+    }
+    rec.name[sizeof(rec.name) - 1] = '\0';
+    rec.forward_host[sizeof(rec.forward_host) - 1] = '\0';
+
+    proxy_listener_t *listener = calloc(1, sizeof(proxy_listener_t));
+    if (!listener) {
+        close(fds[0]);
+        return -1;
+    }
+    snprintf(listener->name, sizeof(listener->name), "%s", rec.name);
+    snprintf(listener->forward_host, sizeof(listener->forward_host), "%s", rec.forward_host);
+    listener->port = rec.port;
+    listener->family = rec.family;
+    listener->forward_port = rec.forward_port;
+    listener->accepted = rec.accepted;
+    listener->rejected = rec.rejected;
+    listener->auth_failures = rec.auth_failures;
+    listener->ep.fd = -1;
+
+    // 按原顺序挂到引擎上, 失败时统一由 proxy_engine_takeover 清理
+    proxy_listener_t **tail = &engine->listeners;
+    while (*tail) tail = &(*tail)->next;
+    *tail = listener;
+    engine->listener_count++;
+    *out = listener;
+
+    if (listener_register(engine, listener, fds[0]) < 0) {
+        close(fds[0]);
+        listener->ep.fd = -1;
+        return -1;
+    }
+    proxy_set_nonblocking(listener->ep.fd);
+
+    for (uint32_t i = 0; i < rec.peer_count; i++) {
+        proxy_handoff_peer_t peer_rec;
+        char secret[PROXY_MAX_SECRET_LEN];
+
+        if (proxy_read_all(fd, &peer_rec, sizeof(peer_rec)) < 0 || peer_rec.secret_len >= sizeof(secret) ||
+            proxy_read_all(fd, secret, peer_rec.secret_len) < 0) {
+            proxy_log("ERROR", "TAKEOVER: invalid peer record");
+            return -1;
+        }
+        secret[peer_rec.secret_len] = '\0';
+        peer_rec.ip[sizeof(peer_rec.ip) - 1] = '\0';
+
+        proxy_peer_t *peer = peer_create(peer_rec.ip, peer_rec.family, secret);
+        if (!peer) return -1;
+        peer->sessions_accepted = peer_rec.sessions_accepted;
+        if (peer_rec.rate) proxy_sched_set_peer(engine, peer, peer_rec.rate, peer_rec.burst);
+        memcpy(peer->latency, peer_rec.latency, sizeof(peer->latency));
+        proxy_peer_t **peer_tail = &listener->peers;
+        while (*peer_tail) peer_tail = &(*peer_tail)->next;
+        *peer_tail = peer;
+        listener->peer_count++;
+
+        // 重新建立本进程的认证状态, 监听 socket 上已有的密钥保持不变
+        if (engine->ops->install(engine, listener->ep.fd, peer, 1) < 0) {
+            proxy_log("ERROR", "TAKEOVER: failed to restore %s keys for peer %s", engine->ops->name, peer->ip);
+            return -1;
+        }
+    }
+
+    if (proxy_mirror_takeover_targets(fd, listener, rec.mirror_count) < 0) return -1;
+    if (rec.recording && proxy_recorder_takeover(fd, listener->name, &listener->recorder) < 0) return -1;
+    if (rec.resuming && proxy_resume_config_takeover(fd, &listener->resume) < 0) return -1;
+    if (rec.bmp_stats && proxy_bmp_stats_takeover(fd, &listener->bmp_stats) < 0) return -1;
+    if (rec.filtering && proxy_filter_takeover(fd, &listener->filter) < 0) return -1;
+    if (rec.fastpath) {
+        char err[PROXY_ERROR_MAX];
+        if (proxy_fastpath_enable(engine, listener, 1, err, sizeof(err)) < 0) {
+            proxy_log("WARN", "TAKEOVER: listener %s: %s, using user-space forwarding", listener->name, err);
+        }
+    }
+
+    proxy_log("INFO", "TAKEOVER: listener %s on port %d with %d peers",
+              listener->name, listener->port, listener->peer_count);
+    return 0;
+}
+
+int proxy_engine_takeover(proxy_engine_t *engine, const char *control_path) {
+    struct sockaddr_un addr;
+    proxy_handoff_header_t header;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        proxy_log("ERROR", "TAKEOVER: socket failed: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", control_path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        proxy_log("ERROR", "TAKEOVER: cannot connect to %s: %s", control_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (!control_peer_trusted(fd, "TAKEOVER", NULL)) {
+        close(fd);
+        return -1;
+    }
+    proxy_set_timeouts(fd, PROXY_HANDOFF_ACK_TIMEOUT);
+    engine->takeover_fd = fd;
+
+    if (proxy_write_all(fd, "HANDOFF\n", 8) < 0 || proxy_read_all(fd, &header, sizeof(header)) < 0) {
+        proxy_log("ERROR", "TAKEOVER: failed to receive header: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (header.magic != PROXY_HANDOFF_MAGIC || header.version != PROXY_HANDOFF_VERSION) {
+        proxy_log("ERROR", "TAKEOVER: incompatible handoff header");
+        close(fd);
+        return -1;
+    }
+
+    // 记录接管的监听端口, 会话按序号引用
+    proxy_listener_t **listeners = calloc(header.listener_count ? header.listener_count : 1,
+                                          sizeof(proxy_listener_t *));
+    if (!listeners) {
+        close(fd);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header.listener_count; i++) {
+        if (takeover_listener(engine, fd, &listeners[i]) < 0) goto fail;
+    }
+
+    for (uint32_t i = 0; i < header.session_count; i++) {
+        proxy_handoff_session_t rec;
+        int session_fds[PROXY_HANDOFF_MAX_FDS];
+        int session_nfds = 0;
+
+        if (proxy_recv_with_fds(fd, &rec, sizeof(rec), session_fds, 2, &session_nfds) < 0 ||
+            session_nfds != (rec.forward_fd ? 2 : 1) || (!rec.forward_fd && !rec.resuming) ||
+            rec.listener_index >= header.listener_count ||
+            rec.to_forward_len > PROXY_BUFFER_SIZE || rec.to_peer_len > PROXY_BUFFER_SIZE) {
+            for (int j = 0; j < session_nfds; j++) close(session_fds[j]);
+            proxy_log("ERROR", "TAKEOVER: invalid session record");
+            goto fail;
+        }
+
+        rec.peer_ip[sizeof(rec.peer_ip) - 1] = '\0';
+        proxy_listener_t *listener = listeners[rec.listener_index];
+        int forward_fd = rec.forward_fd ? session_fds[1] : -1;
+        proxy_session_t *s = session_create(engine, rec.id, listener, listener_find_peer(listener, rec.peer_ip),
+                                            session_fds[0], forward_fd, rec.peer_ip, rec.peer_port);
+        if (!s) {
+            close(session_fds[0]);
+            if (forward_fd >= 0) close(forward_fd);
+            goto fail;
+        }
+        s->connecting = rec.connecting;
+        s->peer_eof = rec.peer_eof;
+        s->forward_eof = rec.forward_eof;
+        s->start_time = rec.start_time;
+        s->bytes_to_forward = rec.bytes_to_forward;
+        s->bytes_to_peer = rec.bytes_to_peer;
+        memcpy(s->framing, rec.framing, sizeof(s->framing));
+
+        if (proxy_read_all(fd, s->to_forward.data, rec.to_forward_len) < 0 ||
+            proxy_read_all(fd, s->to_peer.data, rec.to_peer_len) < 0) {
+            proxy_log("ERROR", "TAKEOVER: failed to receive buffered data: %s", strerror(errno));
+            goto fail;
+        }
+        s->to_forward.len = rec.to_forward_len;
+        s->to_peer.len = rec.to_peer_len;
+        if (proxy_mirror_takeover_legs(engine, fd, s, rec.mirror_count) < 0) goto fail;
+        if (rec.resuming && proxy_resume_takeover(engine, fd, s) < 0) goto fail;
+        if (rec.bmp && (!listener->bmp_stats || proxy_bmp_stream_takeover(fd, listener->bmp_stats, s) < 0)) goto fail;
+        if (rec.filtering && (!listener->filter || proxy_filter_stream_takeover(fd, s) < 0)) goto fail;
+        proxy_latency_enable(s, &s->peer_ep);
+        if (!rec.resuming && !s->connecting) proxy_latency_enable(s, &s->forward_ep);
+        session_update_events(engine, s);
+        proxy_log("INFO", "TAKEOVER: session %u (%s:%d) on %s, %u/%u bytes buffered",
+                  s->id, s->peer_ip, s->peer_port, listener->name, rec.to_forward_len, rec.to_peer_len);
+    }
+
+    free(listeners);
+    engine->next_session_id = header.next_session_id;
+    engine->start_time = header.start_time;
+    engine->sessions_accepted = header.sessions_accepted;
+    engine->bytes_to_forward = header.bytes_to_forward;
+    engine->bytes_to_peer = header.bytes_to_peer;
+    if (header.link_rate) proxy_sched_set_link(engine, header.link_rate, header.link_burst);
+    proxy_log("INFO", "TAKEOVER: received %u listeners and %u sessions from %s",
+              header.listener_count, header.session_count, control_path);
+    return 0;
+
+fail:
+    // 接管失败: 只关闭本进程的副本, 不动监听 socket 上的密钥, 旧进程继续转发
+    free(listeners);
+    while (engine->listeners) listener_destroy(engine, engine->listeners, 0);
+    while (engine->sessions) session_destroy(engine, engine->sessions);
+    proxy_mirror_expire_orphans(engine, 0);
+    release_closed(engine);
+    engine->takeover_fd = -1;
+    close(fd);
+    return -1;
+}
+
+int proxy_engine_finish_takeover(proxy_engine_t *engine) {
+    if (engine->takeover_fd < 0) return 0;
+
+    int rc = proxy_write_all(engine->takeover_fd, "OK\n", 3);
+    close(engine->takeover_fd);
+    engine->takeover_fd = -1;
+    // 接管的会话在新的录制文件中从当前位置开始
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (s->listener->recorder) proxy_recorder_open(s->listener->recorder, s, 1);
+    }
+    if (rc < 0) {
+        proxy_log("ERROR", "TAKEOVER: failed to confirm: %s", strerror(errno));
+        return -1;
+    }
+    proxy_log("INFO", "TAKEOVER: completed, %d listeners, %d sessions active",
+              engine->listener_count, engine->session_count);
+    return 0;
+}
+
+int proxy_engine_run(proxy_engine_t *engine) {
+    struct epoll_event events[PROXY_MAX_EVENTS];
+
+    while (*engine->running) {
+        int n = epoll_wait(engine->epfd, events, PROXY_MAX_EVENTS,
+                           proxy_fastpath_timeout(engine, proxy_sched_timeout(engine, 1000)));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            proxy_log("ERROR", "epoll_wait failed: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n && !engine->handed_off; i++) {
+            proxy_endpoint_t *ep = events[i].data.ptr;
+            // 本轮中已关闭的端点
+            if (ep->fd < 0) continue;
+
+            switch (ep->type) {
+                case PROXY_EP_LISTENER:
+                    handle_accept(engine, ep->owner);
+                    break;
+                case PROXY_EP_CONTROL:
+                    handle_control_accept(engine);
+                    break;
+                case PROXY_EP_CONTROL_CONN:
+                    handle_control_conn(engine, ep->owner);
+                    break;
+                case PROXY_EP_PEER:
+                case PROXY_EP_FORWARD:
+                    handle_session_event(engine, ep, events[i].events);
+                    break;
+                case PROXY_EP_MIRROR:
+                    proxy_mirror_handle_event(engine, ep->owner, events[i].events);
+                    break;
+            }
+        }
+
+        proxy_mirror_expire_orphans(engine, PROXY_MIRROR_ORPHAN_TIMEOUT);
+        resume_tick(engine);
+        if (!engine->handed_off) fastpath_tick(engine);
+        if (!engine->handed_off) sched_round(engine);
+        release_closed(engine);
+        if (engine->handed_off) break;
+        if (engine->ops->tick) engine->ops->tick(engine);
+    }
+    return 0;
+}
+
+void proxy_engine_cleanup(proxy_engine_t *engine) {
+    while (engine->sessions) session_destroy(engine, engine->sessions);
+    proxy_mirror_expire_orphans(engine, 0);
+    // 只关闭 socket, 不删除监听 socket 上的密钥: 交接后它仍由新进程使用
+    while (engine->listeners) listener_destroy(engine, engine->listeners, 0);
+    while (engine->conns) control_conn_close(engine, engine->conns);
+    release_closed(engine);
+    proxy_fastpath_release(engine);
+
+    if (engine->control.fd >= 0) {
+        close(engine->control.fd);
+        engine->control.fd = -1;
+        // 交接后该路径已属于新进程
+        if (!engine->handed_off && engine->control_path[0]) {
+            unlink(engine->control_path);
+        }
+    }
+    if (engine->takeover_fd >= 0) {
+        close(engine->takeover_fd);
+        engine->takeover_fd = -1;
+    }
+    if (engine->epfd >= 0) {
+        close(engine->epfd);
+        engine->epfd = -1;
+    }
+}
+
+static int write_fd_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int proxy_control_client(const char *control_path) {
+    struct sockaddr_un addr;
+    char buf[PROXY_CONTROL_LINE_MAX];
+    int fd = -1;
+
+    if (strlen(control_path) >= sizeof(addr.sun_path)) {
+        proxy_log("ERROR", "Control socket path too long: %s", control_path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", control_path);
+
+    // 守护进程可能刚启动, 稍作重试
+    for (int i = 0; i < PROXY_CLIENT_CONNECT_RETRIES; i++) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            proxy_log("ERROR", "socket failed: %s", strerror(errno));
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) break;
+        close(fd);
+        fd = -1;
+        usleep(100000);
+    }
+    if (fd < 0) {
+        proxy_log("ERROR", "Cannot connect to control socket %s: %s", control_path, strerror(errno));
+        return -1;
+    }
+    if (!control_peer_trusted(fd, "Control client", NULL) || proxy_write_all(fd, "CLIENT\n", 7) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    struct pollfd fds[2];
+    int stdin_open = 1;
+    while (1) {
+        fds[0].fd = stdin_open ? STDIN_FILENO : -1;
+        fds[0].events = POLLIN;
+        fds[1].fd = fd;
+        fds[1].events = POLLIN;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0) {
+                // 命令发完后等待剩余应答
+                stdin_open = 0;
+                shutdown(fd, SHUT_WR);
+            } else if (proxy_write_all(fd, buf, n) < 0) {
+                break;
+            }
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0 || write_fd_all(STDOUT_FILENO, buf, n) < 0) break;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
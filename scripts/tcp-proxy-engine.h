@@ -0,0 +1,321 @@
+/*
+ * TCP Proxy Engine
+ *
+ * tcp-md5-helper 和 tcp-ao-helper 共用的转发引擎:
+ * - 单进程 epoll 事件循环, 一个进程可同时服务多个监听端口 (bmp/bgp/rpki), 每个监听端口可有多个 peer
+ * - 非阻塞连接转发目标, 每个方向一个发送缓冲区
+ * - Unix 控制 socket, 按行接收命令, 应答为一行 "OK <json>" 或 "ERR <message>":
+ *     PING
+ *     ADD <listener> <listen_port> <forward_host:port> <peer_ip> <secret>   添加/更新 peer (secret 为行剩余部分)
+ *     KEYS <listener> <peer_ip> <secret>                                    更新 peer 的密钥
+ *     REMOVE <listener> [<peer_ip>]                                         删除 peer 或整个监听端口
+ *     SESSIONS                                                              列出会话 (含认证方式的会话状态)
+ *     STATS                                                                 统计信息
+ *     MIRROR <listener> <host:port> [drop|lag [max_lag_bytes]]              添加/更新镜像目标 (见 tcp-proxy-mirror.c)
+ *     UNMIRROR <listener> <host:port>                                       删除镜像目标
+ *     RECORD <listener> <dir> [max_file_mb] [max_file_seconds] [max_files]  录制会话数据流 (见 tcp-proxy-recorder.c)
+ *     UNRECORD <listener>                                                   停止录制
+ *     RESUME <listener> <spill_dir|-|off> [mem_mb] [disk_mb] [outage_s]     新会话的转发连接断开后续传 (见 tcp-proxy-resume.c)
+ *     SHAPE <listener> <peer_ip> <rate_kbps> [burst_kb]                     peer 限速, 0 表示不限 (见 tcp-proxy-sched.c)
+ *     SHAPE * <rate_kbps> [burst_kb]                                        整条隧道的带宽, 超出时各 peer 公平分配
+ *     LATENCY [reset]                                                       各 peer 的转发延迟直方图 (见 tcp-proxy-latency.c)
+ *     FASTPATH <listener> on|off                                            会话数据在内核中转发 (见 tcp-proxy-fastpath.c)
+ *     BMPSTATS <listener> [on|off|reset]                                    BMP 按 router/peer 的统计 (见 tcp-proxy-bmp.c)
+ *     FILTER <listener> [pass|drop|sample:N [<key>=<value>...]]             添加 BMP 消息过滤规则或查询 (见 tcp-proxy-filter.c)
+ *     UNFILTER <listener> [<id>]                                            删除一条或全部过滤规则
+ *     HANDOFF                                                               热升级交接, 只接受 --takeover 连接的第一条命令 (见 tcp-proxy-engine.c)
+ * - 只接受与守护进程同一用户的连接, --client 中继连接后先发送不需要应答的 CLIENT
+ * - 认证方式 (MD5 / TCP-AO) 通过 proxy_auth_ops_t 回调在监听 socket 上安装密钥, 并可维护已建立会话上的密钥
+ */
+
+#ifndef TCP_PROXY_ENGINE_H
+#define TCP_PROXY_ENGINE_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PROXY_BUFFER_SIZE 65536
+#define PROXY_NAME_MAX 32
+#define PROXY_MAX_SECRET_LEN 4096
+#define PROXY_CONTROL_LINE_MAX 8192
+#define PROXY_CONTROL_PATH_MAX 108
+#define PROXY_ERROR_MAX 256
+#define PROXY_AUTH_JSON_MAX 4096
+#define PROXY_DEFAULT_LISTENER "default"
+
+#define PROXY_HANDOFF_MAGIC 0x4f485850  /* "PXHO" */
+#define PROXY_HANDOFF_VERSION 10
+
+typedef struct proxy_session proxy_session_t;
+typedef struct proxy_listener proxy_listener_t;
+typedef struct proxy_peer proxy_peer_t;
+typedef struct proxy_control_conn proxy_control_conn_t;
+typedef struct proxy_mirror_target proxy_mirror_target_t;
+typedef struct proxy_mirror_leg proxy_mirror_leg_t;
+typedef struct proxy_recorder proxy_recorder_t;
+typedef struct proxy_resume_config proxy_resume_config_t;
+typedef struct proxy_resume proxy_resume_t;
+typedef struct proxy_latency proxy_latency_t;
+typedef struct proxy_fastpath proxy_fastpath_t;
+typedef struct proxy_fastpath_pair proxy_fastpath_pair_t;
+typedef struct proxy_bmp_stats proxy_bmp_stats_t;
+typedef struct proxy_bmp_stream proxy_bmp_stream_t;
+typedef struct proxy_filter proxy_filter_t;
+typedef struct proxy_filter_stream proxy_filter_stream_t;
+typedef struct proxy_engine proxy_engine_t;
+
+typedef enum {
+    PROXY_EP_LISTENER,
+    PROXY_EP_CONTROL,
+    PROXY_EP_CONTROL_CONN,
+    PROXY_EP_PEER,
+    PROXY_EP_FORWARD,
+    PROXY_EP_MIRROR
+} proxy_ep_type_t;
+
+// 注册到 epoll 的端点, epoll_event.data.ptr 指向它; 关闭后 fd 置为 -1, 内存在本轮事件处理完后释放
+typedef struct {
+    proxy_ep_type_t type;
+    int fd;
+    uint32_t events;            // 当前已注册的事件
+    void *owner;                // 所属的 session / listener / control conn / mirror leg
+} proxy_endpoint_t;
+
+// 单方向发送缓冲: [off, len) 为待发送数据
+typedef struct {
+    char data[PROXY_BUFFER_SIZE];
+    size_t off;
+    size_t len;
+} proxy_buffer_t;
+
+// 数据方向, 用作 proxy_bucket_t / proxy_framing_t 数组下标
+#define PROXY_DIR_FORWARD 0      // peer -> forward
+#define PROXY_DIR_PEER 1         // forward -> peer
+
+// 单方向的令牌桶和 DRR 状态, 优先通道的控制消息可使 tokens 透支为负
+typedef struct {
+    int64_t tokens;
+    int64_t deficit;             // 只在整条隧道限速且有竞争时使用
+    uint64_t bytes;
+    uint64_t throttled;          // 因配额不足暂停发送的次数
+    uint64_t priority;           // 经优先通道发送的控制消息数
+} proxy_bucket_t;
+
+// 单方向已发送数据的 BGP/BMP 消息边界, 用于识别下一条消息是否为可优先发送的控制消息
+typedef struct {
+    uint8_t mode;
+    uint8_t hdr_len;             // 已发送的当前消息头字节数
+    uint16_t reserved;
+    uint32_t msg_left;           // 当前消息剩余的字节数
+    unsigned char hdr[24];
+} proxy_framing_t;
+
+// 延迟直方图 (纳秒), 对数线性分桶: 每个 2 的幂区间分为 PROXY_HIST_SUB_BUCKETS 个等宽的桶, 相对误差不超过 1/16
+#define PROXY_HIST_SUB_BITS 4
+#define PROXY_HIST_SUB_BUCKETS (1 << PROXY_HIST_SUB_BITS)
+#define PROXY_HIST_MAX_BITS 41   // 约 36 分钟, 更大的值计入最后一个桶
+#define PROXY_HIST_BUCKETS ((PROXY_HIST_MAX_BITS - PROXY_HIST_SUB_BITS + 1) * PROXY_HIST_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[PROXY_HIST_BUCKETS];
+} proxy_histogram_t;
+
+struct proxy_peer {
+    proxy_peer_t *next;
+    char ip[INET6_ADDRSTRLEN];
+    int family;
+    char secret[PROXY_MAX_SECRET_LEN];   // MD5 密码或 TCP-AO 密钥 JSON
+    void *auth;                          // 认证方式私有数据 (如解析后的 TCP-AO 密钥)
+    int session_count;
+    uint64_t sessions_accepted;
+    uint64_t rate;               // 限速 (字节/秒), 0 表示不限
+    uint64_t burst;
+    proxy_bucket_t buckets[2];
+    proxy_histogram_t latency[2]; // 数据在 helper 中的停留时间: 内核收到 -> 内核发出
+};
+
+typedef enum {
+    PROXY_MIRROR_LAG,            // 允许落后到 max_lag 字节, 超出后断开
+    PROXY_MIRROR_DROP            // 发送缓冲写不下时立即断开
+} proxy_mirror_policy_t;
+
+// 监听端口上的镜像目标: 新会话的 peer -> forward 数据流同时复制一份发往该目标
+struct proxy_mirror_target {
+    proxy_mirror_target_t *next;
+    char host[256];
+    int port;
+    proxy_mirror_policy_t policy;
+    size_t max_lag;
+    uint64_t sessions;           // 建立过的镜像连接数
+    uint64_t bytes_sent;
+    uint64_t drops;              // 因落后过多被断开的次数
+    uint64_t connect_failures;
+};
+
+// 单个会话到一个镜像目标的连接, 有独立的积压缓冲, 慢的目标不影响 router 和其他目标
+struct proxy_mirror_leg {
+    proxy_mirror_leg_t *next;
+    proxy_endpoint_t ep;
+    proxy_session_t *session;    // 会话结束后为 NULL, 积压数据发完后关闭
+    proxy_mirror_target_t *target;
+    int connecting;
+    char *backlog;               // [off, len) 为未发出的数据
+    size_t off;
+    size_t len;
+    size_t cap;
+    uint64_t bytes_sent;
+    time_t detached_at;
+};
+
+struct proxy_listener {
+    proxy_listener_t *next;
+    proxy_endpoint_t ep;
+    char name[PROXY_NAME_MAX];
+    int port;
+    int family;
+    char forward_host[256];
+    int forward_port;
+    proxy_peer_t *peers;
+    int peer_count;
+    proxy_mirror_target_t *mirrors;
+    int mirror_count;
+    proxy_recorder_t *recorder;  // 未录制时为 NULL
+    proxy_resume_config_t *resume; // 未开启续传时为 NULL, 只影响之后建立的会话
+    int fastpath;                // 满足条件的会话走内核 sockmap 转发
+    proxy_bmp_stats_t *bmp_stats; // 未开启 BMP 统计时为 NULL
+    proxy_filter_t *filter;      // BMP 消息过滤规则, 从未添加过规则时为 NULL
+    uint64_t accepted;
+    uint64_t rejected;           // 来源地址不在 peer 列表中
+    uint64_t auth_failures;      // accept 失败 (通常是认证不匹配)
+};
+
+struct proxy_session {
+    proxy_session_t *next;
+    unsigned int id;
+    proxy_listener_t *listener;
+    proxy_peer_t *peer;
+    proxy_endpoint_t peer_ep;    // router 侧
+    proxy_endpoint_t forward_ep; // 转发目标侧
+    proxy_buffer_t to_forward;   // peer -> forward
+    proxy_buffer_t to_peer;      // forward -> peer
+    proxy_mirror_leg_t *mirrors;
+    int mirror_count;
+    proxy_resume_t *resume;      // 可续传会话的转发侧状态, 转发连接由 tcp-proxy-resume.c 管理
+    proxy_framing_t framing[2];
+    int throttled[2];            // 配额不足, 等待调度器下一轮再发送
+    proxy_latency_t *latency;    // socket 时间戳状态, 未开启时为 NULL
+    proxy_fastpath_pair_t *fastpath; // 从未进入过内核快速路径时为 NULL
+    proxy_bmp_stream_t *bmp;     // router -> collector 方向的 BMP 解析状态, 未开启统计时为 NULL
+    proxy_filter_stream_t *filter; // to_forward 的过滤状态, 没有过滤规则时为 NULL
+    int connecting;              // 转发目标非阻塞连接进行中
+    int peer_eof;
+    int forward_eof;
+    char peer_ip[INET6_ADDRSTRLEN];
+    int peer_port;
+    time_t start_time;
+    uint64_t bytes_to_forward;
+    uint64_t bytes_to_peer;
+};
+
+struct proxy_control_conn {
+    proxy_control_conn_t *next;
+    proxy_endpoint_t ep;
+    char line[PROXY_CONTROL_LINE_MAX];
+    size_t len;
+    uid_t uid;                   // 对端用户 (SO_PEERCRED)
+    unsigned commands;           // 已收到的命令数
+    int relay;                   // --client 中继连接, 不能发起 HANDOFF
+};
+
+typedef struct {
+    const char *name;            // 日志中使用的认证方式名称, 如 "MD5"
+    // 在监听 socket 上安装 peer 的密钥; 新建监听 socket 时在 bind 之前调用,
+    // adopted 表示监听 socket 从旧进程接管, 其上可能已有相同的密钥
+    int (*install)(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, int adopted);
+    // 从监听 socket 移除 peer 的密钥并释放 peer->auth; listen_fd 为 -1 时只释放
+    void (*uninstall)(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer);
+    // 更新密钥, 成功后引擎保存新的 secret; 失败时可把原因写入 err, 作为 ERR 应答返回
+    int (*update)(proxy_engine_t *engine, int listen_fd, proxy_peer_t *peer, const char *secret,
+                  char *err, size_t err_len);
+    // 事件循环每轮回调, 可为 NULL
+    void (*tick)(proxy_engine_t *engine);
+    // SESSIONS 应答中会话的 "auth" 字段: 把 JSON 写入 buf 并返回长度, 无可报告的状态时返回 -1; 可为 NULL
+    int (*session_json)(proxy_engine_t *engine, proxy_session_t *session, char *buf, size_t len);
+} proxy_auth_ops_t;
+
+struct proxy_engine {
+    int epfd;
+    const proxy_auth_ops_t *ops;
+    proxy_listener_t *listeners;
+    int listener_count;
+    proxy_session_t *sessions;
+    int session_count;
+    unsigned int next_session_id;
+    proxy_control_conn_t *conns;
+    proxy_endpoint_t control;
+    char control_path[PROXY_CONTROL_PATH_MAX];
+    int takeover_fd;             // 接管过程中与旧进程的连接
+    volatile sig_atomic_t *running;
+    int handed_off;              // 已交接给新进程, 退出时不再清理控制 socket
+    time_t start_time;
+    uint64_t sessions_accepted;
+    uint64_t bytes_to_forward;
+    uint64_t bytes_to_peer;
+
+    proxy_mirror_leg_t *orphan_legs; // 会话已结束、仍在发送积压数据的镜像连接
+
+    // 调度与限速 (tcp-proxy-sched.c)
+    int shaping;                 // 有任何 peer 或整条隧道限速
+    int sched_in_round;
+    unsigned int sched_round;
+    uint64_t link_rate;          // 整条隧道的带宽 (字节/秒), 0 表示不限
+    uint64_t link_burst;
+    proxy_bucket_t link[2];
+    struct timespec sched_last;
+
+    proxy_fastpath_t *fastpath;  // BPF map 和程序, 首次 FASTPATH on 时加载
+
+    // 已关闭、待本轮事件处理完后释放的对象
+    proxy_session_t *closed_sessions;
+    proxy_mirror_leg_t *closed_legs;
+    proxy_listener_t *closed_listeners;
+    proxy_control_conn_t *closed_conns;
+};
+
+void proxy_log(const char *level, const char *format, ...);
+
+int proxy_engine_init(proxy_engine_t *engine, const proxy_auth_ops_t *ops, volatile sig_atomic_t *running);
+
+// 添加 peer, 监听端口不存在时创建; 已存在时更新端口/转发目标/密钥。失败时 err 中为原因
+int proxy_engine_add_peer(proxy_engine_t *engine, const char *name, int listen_port, const char *forward_addr,
+                          const char *peer_ip, const char *secret, char *err, size_t err_len);
+int proxy_engine_update_keys(proxy_engine_t *engine, const char *name, const char *peer_ip, const char *secret,
+                             char *err, size_t err_len);
+// peer_ip 为 NULL 时删除整个监听端口, 相关会话一并关闭
+int proxy_engine_remove_peer(proxy_engine_t *engine, const char *name, const char *peer_ip,
+                             char *err, size_t err_len);
+proxy_listener_t *proxy_engine_find_listener(proxy_engine_t *engine, const char *name);
+
+int proxy_engine_open_control(proxy_engine_t *engine, const char *control_path);
+
+// 从旧进程接管所有监听端口、peer 和会话, 失败返回 -1
+int proxy_engine_takeover(proxy_engine_t *engine, const char *control_path);
+// 新进程就绪后确认接管, 旧进程收到确认后退出
+int proxy_engine_finish_takeover(proxy_engine_t *engine);
+
+int proxy_engine_run(proxy_engine_t *engine);
+void proxy_engine_cleanup(proxy_engine_t *engine);
+
+// 客户端模式: 连接控制 socket, 把 stdin 的命令转发过去并把应答写到 stdout (供单个 SSH exec 通道使用)
+int proxy_control_client(const char *control_path);
+
+#endif
@@ -0,0 +1,504 @@
+/*
+ * TCP Proxy Engine - 内核快速路径 (BPF sockmap)
+ *
+ * FASTPATH <listener> on 后, 满足条件的会话把 peer/forward 两个 socket 放入 BPF_MAP_TYPE_SOCKMAP,
+ * 由挂在 map 上的 sk_skb 程序把一侧收到的数据直接重定向到另一侧的发送队列, 不再经过用户态:
+ *   - sockmap 的第 2i / 2i+1 项为第 i 个会话的 peer / forward socket
+ *   - 另有一个以 socket cookie 为键的哈希表, 值为对侧在 sockmap 中的下标和该 socket 收到的字节数;
+ *     找不到 cookie 的数据 (理论上不会出现) 交回用户态
+ *   - 不依赖 libbpf, 程序为手写的 eBPF 指令, 直接通过 bpf() 系统调用加载
+ * 用户态只负责建立/拆除、每秒同步字节计数到 bytes_to_*, 以及通过 EPOLLRDHUP 发现连接关闭。
+ *
+ * 只有两侧缓冲均为空、已连接且不需要用户态看到数据的会话才会进入快速路径: 没有镜像、录制、续传、BMP 统计或过滤、
+ * 限速 (peer 或整条隧道); 延迟测量在快速路径中暂停。条件不再满足 (如开始录制、设置限速、FASTPATH off)
+ * 或 HANDOFF 时退回普通转发。
+ *
+ * 退出快速路径时, 已被重定向但因对侧发送缓冲满而仍排在内核 psock 队列中的数据会随 sockmap 项一起丢弃,
+ * 因此只在两侧 socket 的发送队列低于 SO_SNDBUF 的 1/4 时退出 (此时内核队列必然已清空), 否则下一轮再试;
+ * HANDOFF 时有会话无法退出则返回错误, 由调用方稍后重试。
+ * 一侧关闭 (EPOLLRDHUP) 后先等待发往对侧的数据送出, 再退回普通转发, 由原有逻辑读出 EOF 并关闭会话。
+ *
+ * 内核不支持 (无 CAP_BPF/CAP_NET_ADMIN、内核过旧) 时 FASTPATH 返回错误, 会话照常走用户态转发;
+ * 单个会话加入 sockmap 失败时该会话不再尝试。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/sockios.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define FASTPATH_MAX_PAIRS 4096
+#define FASTPATH_SYNC_MS 1000
+#define FASTPATH_DRAIN_MIN_MS 100    // 关闭后至少等待一轮, 让内核工作队列发完重定向的数据
+#define FASTPATH_DRAIN_TIMEOUT_MS 10000
+#define FASTPATH_POLL_MS 100
+
+#ifndef SO_COOKIE
+#define SO_COOKIE 57
+#endif
+
+#define FP_INSN(c, d, s, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define FP_MOV_REG(d, s) FP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define FP_MOV_IMM(d, i) FP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define FP_ADD_IMM(d, i) FP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define FP_LDX(size, d, s, o) FP_INSN(BPF_LDX | BPF_MEM | (size), d, s, o, 0)
+#define FP_STX(size, d, s, o) FP_INSN(BPF_STX | BPF_MEM | (size), d, s, o, 0)
+#define FP_XADD_DW(d, s, o) FP_INSN(BPF_STX | BPF_XADD | BPF_DW, d, s, o, 0)
+#define FP_LD_MAP(d, fd) FP_INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), FP_INSN(0, 0, 0, 0, 0)
+#define FP_JEQ_IMM(d, i, o) FP_INSN(BPF_JMP | BPF_JEQ | BPF_K, d, 0, o, i)
+#define FP_CALL(f) FP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define FP_EXIT() FP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+typedef enum {
+    FASTPATH_OFF,                // 已退回普通转发, 条件满足时可再次进入
+    FASTPATH_ACTIVE,
+    FASTPATH_DRAINING,           // 一侧已关闭, 等待发往对侧的数据送出
+    FASTPATH_DONE                // 关闭或加入失败, 不再尝试
+} fastpath_state_t;
+
+// cookie 哈希表的值, 与 BPF 程序中的偏移对应
+typedef struct {
+    uint32_t target;             // 对侧 socket 在 sockmap 中的下标
+    uint32_t reserved;
+    uint64_t bytes;              // 该 socket 收到并重定向的字节数
+    uint64_t packets;
+} fastpath_value_t;
+
+struct proxy_fastpath {
+    int sockmap_fd;
+    int cookie_fd;
+    int parser_fd;
+    int verdict_fd;
+    int error;                   // 加载失败的 errno, 不再重试
+    unsigned char slots[FASTPATH_MAX_PAIRS];
+    int active;
+    int draining;
+    uint64_t attached;
+    uint64_t detached;
+    uint64_t failures;
+};
+
+struct proxy_fastpath_pair {
+    fastpath_state_t state;
+    uint32_t slot;
+    uint64_t cookies[2];         // 下标为 PROXY_DIR_*: 收到该方向数据的 socket, 即 peer / forward
+    uint64_t synced[2];          // 已计入 bytes_to_* 的字节数
+    int64_t since_ms;            // 进入当前状态的时间
+    int64_t sync_ms;
+};
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int sys_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int map_create(uint32_t type, uint32_t key_size, uint32_t value_size, uint32_t max_entries) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = key_size;
+    attr.value_size = value_size;
+    attr.max_entries = max_entries;
+    return sys_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int map_update(int fd, const void *key, const void *value) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(unsigned long)key;
+    attr.value = (uint64_t)(unsigned long)value;
+    attr.flags = BPF_ANY;
+    return sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+static int map_lookup(int fd, const void *key, void *value) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(unsigned long)key;
+    attr.value = (uint64_t)(unsigned long)value;
+    return sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+static void map_delete(int fd, const void *key) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(unsigned long)key;
+    sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+static int prog_load(const struct bpf_insn *insns, size_t count) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SK_SKB;
+    attr.insns = (uint64_t)(unsigned long)insns;
+    attr.insn_cnt = count;
+    attr.license = (uint64_t)(unsigned long)"Dual MIT/GPL";
+    return sys_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static int prog_attach(int prog_fd, int map_fd, uint32_t type) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.target_fd = map_fd;
+    attr.attach_bpf_fd = prog_fd;
+    attr.attach_type = type;
+    return sys_bpf(BPF_PROG_ATTACH, &attr);
+}
+
+static void fastpath_close(proxy_fastpath_t *fp) {
+    if (fp->verdict_fd >= 0) close(fp->verdict_fd);
+    if (fp->parser_fd >= 0) close(fp->parser_fd);
+    if (fp->sockmap_fd >= 0) close(fp->sockmap_fd);
+    if (fp->cookie_fd >= 0) close(fp->cookie_fd);
+    fp->verdict_fd = fp->parser_fd = fp->sockmap_fd = fp->cookie_fd = -1;
+}
+
+// 创建 map 并加载、挂载程序; 失败时记录 errno, 之后的 FASTPATH 命令直接返回该错误
+static int fastpath_load(proxy_fastpath_t *fp) {
+    fp->sockmap_fd = map_create(BPF_MAP_TYPE_SOCKMAP, sizeof(uint32_t), sizeof(uint32_t), FASTPATH_MAX_PAIRS * 2);
+    fp->cookie_fd = map_create(BPF_MAP_TYPE_HASH, sizeof(uint64_t), sizeof(fastpath_value_t), FASTPATH_MAX_PAIRS * 2);
+    if (fp->sockmap_fd < 0 || fp->cookie_fd < 0) goto fail;
+
+    // strparser: 每个 skb 作为一条完整消息交给 verdict, 不做任何分帧
+    const struct bpf_insn parser[] = {
+        FP_LDX(BPF_W, BPF_REG_0, BPF_REG_1, offsetof(struct __sk_buff, len)),
+        FP_EXIT(),
+    };
+    // verdict: 按 socket cookie 查出对侧下标, 累加字节数后重定向到对侧的发送队列
+    const struct bpf_insn verdict[] = {
+        FP_MOV_REG(BPF_REG_6, BPF_REG_1),
+        FP_CALL(BPF_FUNC_get_socket_cookie),
+        FP_STX(BPF_DW, BPF_REG_10, BPF_REG_0, -8),
+        FP_MOV_REG(BPF_REG_2, BPF_REG_10),
+        FP_ADD_IMM(BPF_REG_2, -8),
+        FP_LD_MAP(BPF_REG_1, fp->cookie_fd),
+        FP_CALL(BPF_FUNC_map_lookup_elem),
+        FP_JEQ_IMM(BPF_REG_0, 0, 12),
+        FP_MOV_REG(BPF_REG_7, BPF_REG_0),
+        FP_LDX(BPF_W, BPF_REG_1, BPF_REG_6, offsetof(struct __sk_buff, len)),
+        FP_XADD_DW(BPF_REG_7, BPF_REG_1, offsetof(fastpath_value_t, bytes)),
+        FP_MOV_IMM(BPF_REG_1, 1),
+        FP_XADD_DW(BPF_REG_7, BPF_REG_1, offsetof(fastpath_value_t, packets)),
+        FP_LDX(BPF_W, BPF_REG_3, BPF_REG_7, offsetof(fastpath_value_t, target)),
+        FP_MOV_REG(BPF_REG_1, BPF_REG_6),
+        FP_LD_MAP(BPF_REG_2, fp->sockmap_fd),
+        FP_MOV_IMM(BPF_REG_4, 0),
+        FP_CALL(BPF_FUNC_sk_redirect_map),
+        FP_EXIT(),
+        FP_MOV_IMM(BPF_REG_0, SK_PASS),
+        FP_EXIT(),
+    };
+
+    fp->parser_fd = prog_load(parser, sizeof(parser) / sizeof(parser[0]));
+    if (fp->parser_fd < 0) goto fail;
+    fp->verdict_fd = prog_load(verdict, sizeof(verdict) / sizeof(verdict[0]));
+    if (fp->verdict_fd < 0) goto fail;
+    if (prog_attach(fp->parser_fd, fp->sockmap_fd, BPF_SK_SKB_STREAM_PARSER) < 0 ||
+        prog_attach(fp->verdict_fd, fp->sockmap_fd, BPF_SK_SKB_STREAM_VERDICT) < 0) {
+        goto fail;
+    }
+    return 0;
+
+fail:
+    fp->error = errno ? errno : EINVAL;
+    fastpath_close(fp);
+    return -1;
+}
+
+int proxy_fastpath_enable(proxy_engine_t *engine, proxy_listener_t *listener, int on, char *err, size_t err_len) {
+    if (!on) {
+        // 已在快速路径中的会话由 proxy_fastpath_tick 退回普通转发
+        listener->fastpath = 0;
+        return 0;
+    }
+
+    if (!engine->fastpath) {
+        proxy_fastpath_t *fp = calloc(1, sizeof(proxy_fastpath_t));
+        if (!fp) {
+            proxy_set_error(err, err_len, "out of memory");
+            return -1;
+        }
+        fp->verdict_fd = fp->parser_fd = fp->sockmap_fd = fp->cookie_fd = -1;
+        engine->fastpath = fp;
+        if (fastpath_load(fp) < 0) {
+            proxy_log("WARN", "BPF sockmap fast path unavailable: %s", strerror(fp->error));
+        } else {
+            proxy_log("INFO", "BPF sockmap fast path loaded");
+        }
+    }
+    if (engine->fastpath->error) {
+        proxy_set_error(err, err_len, "fast path unavailable: %s", strerror(engine->fastpath->error));
+        return -1;
+    }
+    listener->fastpath = 1;
+    return 0;
+}
+
+int proxy_fastpath_active(proxy_session_t *s) {
+    return s->fastpath && (s->fastpath->state == FASTPATH_ACTIVE || s->fastpath->state == FASTPATH_DRAINING);
+}
+
+// 会话不再需要用户态看到数据
+static int eligible(proxy_engine_t *engine, proxy_session_t *s) {
+    return s->listener->fastpath && !s->mirrors && !s->listener->recorder && !s->resume && !s->bmp && !s->filter &&
+           !engine->link_rate && (!s->peer || !s->peer->rate);
+}
+
+// 两侧发送队列都远低于 SO_SNDBUF, 内核 psock 队列中没有积压的重定向数据
+static int pair_idle(proxy_session_t *s) {
+    int fds[2] = { s->peer_ep.fd, s->forward_ep.fd };
+    for (int i = 0; i < 2; i++) {
+        int queued = 0;
+        int sndbuf = 0;
+        socklen_t len = sizeof(sndbuf);
+        if (ioctl(fds[i], SIOCOUTQ, &queued) < 0 ||
+            getsockopt(fds[i], SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) < 0) {
+            return 0;
+        }
+        if (queued >= sndbuf / 4) return 0;
+    }
+    return 1;
+}
+
+void proxy_fastpath_sync(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_fastpath_pair_t *pair = s->fastpath;
+    if (!pair || !engine->fastpath || pair->state == FASTPATH_OFF || pair->state == FASTPATH_DONE) return;
+
+    for (int dir = 0; dir < 2; dir++) {
+        fastpath_value_t value;
+        if (map_lookup(engine->fastpath->cookie_fd, &pair->cookies[dir], &value) < 0) continue;
+        uint64_t delta = value.bytes - pair->synced[dir];
+        pair->synced[dir] = value.bytes;
+        if (dir == PROXY_DIR_FORWARD) {
+            s->bytes_to_forward += delta;
+            engine->bytes_to_forward += delta;
+        } else {
+            s->bytes_to_peer += delta;
+            engine->bytes_to_peer += delta;
+        }
+    }
+    pair->sync_ms = now_ms();
+}
+
+static void pair_remove(proxy_engine_t *engine, proxy_session_t *s, fastpath_state_t state) {
+    proxy_fastpath_t *fp = engine->fastpath;
+    proxy_fastpath_pair_t *pair = s->fastpath;
+
+    proxy_fastpath_sync(engine, s);
+    for (int i = 0; i < 2; i++) {
+        uint32_t key = pair->slot * 2 + i;
+        map_delete(fp->sockmap_fd, &key);
+        map_delete(fp->cookie_fd, &pair->cookies[i]);
+    }
+    fp->slots[pair->slot] = 0;
+    if (pair->state == FASTPATH_DRAINING) fp->draining--;
+    fp->active--;
+    fp->detached++;
+    pair->state = state;
+}
+
+void proxy_fastpath_attach(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_fastpath_t *fp = engine->fastpath;
+    proxy_fastpath_pair_t *pair = s->fastpath;
+
+    if (!fp || fp->error || (pair && pair->state != FASTPATH_OFF)) return;
+    if (!eligible(engine, s) || s->connecting || s->peer_eof || s->forward_eof ||
+        s->peer_ep.fd < 0 || s->forward_ep.fd < 0 || s->throttled[PROXY_DIR_FORWARD] || s->throttled[PROXY_DIR_PEER] ||
+        s->to_forward.len > s->to_forward.off || s->to_peer.len > s->to_peer.off) {
+        return;
+    }
+
+    uint32_t slot = 0;
+    while (slot < FASTPATH_MAX_PAIRS && fp->slots[slot]) slot++;
+    if (slot == FASTPATH_MAX_PAIRS) return;
+
+    if (!pair) {
+        pair = calloc(1, sizeof(proxy_fastpath_pair_t));
+        if (!pair) return;
+        s->fastpath = pair;
+    }
+
+    int fds[2] = { s->peer_ep.fd, s->forward_ep.fd };
+    for (int i = 0; i < 2; i++) {
+        socklen_t len = sizeof(pair->cookies[i]);
+        if (getsockopt(fds[i], SOL_SOCKET, SO_COOKIE, &pair->cookies[i], &len) < 0) goto fail;
+    }
+
+    // 先写 cookie 表再放入 sockmap: socket 一进入 sockmap, 收到的数据 (含之前已排队的) 就交给 verdict 程序
+    for (int i = 0; i < 2; i++) {
+        fastpath_value_t value;
+        memset(&value, 0, sizeof(value));
+        value.target = slot * 2 + (1 - i);
+        if (map_update(fp->cookie_fd, &pair->cookies[i], &value) < 0) goto fail_cookies;
+    }
+    for (int i = 0; i < 2; i++) {
+        uint32_t key = slot * 2 + i;
+        uint32_t value = fds[i];
+        if (map_update(fp->sockmap_fd, &key, &value) < 0) {
+            int saved = errno;
+            if (i == 1) {
+                key = slot * 2;
+                map_delete(fp->sockmap_fd, &key);
+            }
+            errno = saved;
+            goto fail_cookies;
+        }
+    }
+
+    // 数据不再经过用户态, 暂停时间戳; 只等待连接关闭
+    proxy_latency_suspend(s);
+    if (proxy_endpoint_set_events(engine, &s->peer_ep, EPOLLRDHUP, 0) < 0 ||
+        proxy_endpoint_set_events(engine, &s->forward_ep, EPOLLRDHUP, 0) < 0) {
+        proxy_log("WARN", "Session %u: failed to update epoll for fast path", s->id);
+    }
+    fp->slots[slot] = 1;
+    fp->active++;
+    fp->attached++;
+    pair->slot = slot;
+    pair->synced[0] = pair->synced[1] = 0;
+    pair->state = FASTPATH_ACTIVE;
+    pair->since_ms = pair->sync_ms = now_ms();
+    proxy_log("INFO", "Session %u (%s:%d) moved to kernel fast path", s->id, s->peer_ip, s->peer_port);
+    return;
+
+fail_cookies:
+    {
+        int saved = errno;
+        for (int i = 0; i < 2; i++) map_delete(fp->cookie_fd, &pair->cookies[i]);
+        errno = saved;
+    }
+fail:
+    fp->failures++;
+    pair->state = FASTPATH_DONE;
+    proxy_log("WARN", "Session %u: cannot use kernel fast path: %s", s->id, strerror(errno));
+}
+
+// 退出快速路径, 之后由引擎按普通会话重新注册事件
+static void detach(proxy_engine_t *engine, proxy_session_t *s, fastpath_state_t state, const char *reason) {
+    pair_remove(engine, s, state);
+    // 内核转发的数据没有经过调度模块, 不再知道消息边界
+    proxy_sched_reset_framing(s, PROXY_DIR_FORWARD);
+    proxy_sched_reset_framing(s, PROXY_DIR_PEER);
+    proxy_latency_enable(s, &s->peer_ep);
+    proxy_latency_enable(s, &s->forward_ep);
+    proxy_log("INFO", "Session %u left kernel fast path: %s", s->id, reason);
+}
+
+int proxy_fastpath_handle_event(proxy_engine_t *engine, proxy_session_t *s, uint32_t events) {
+    proxy_fastpath_pair_t *pair = s->fastpath;
+
+    if ((events & (EPOLLRDHUP | EPOLLHUP)) && pair->state == FASTPATH_ACTIVE) {
+        pair->state = FASTPATH_DRAINING;
+        pair->since_ms = now_ms();
+        engine->fastpath->draining++;
+        // 关闭前收到的数据已由 verdict 程序处理, 不再需要这些事件
+        proxy_endpoint_set_events(engine, &s->peer_ep, 0, 0);
+        proxy_endpoint_set_events(engine, &s->forward_ep, 0, 0);
+    }
+    return 0;
+}
+
+int proxy_fastpath_tick(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_fastpath_pair_t *pair = s->fastpath;
+    int64_t now = now_ms();
+
+    if (pair->state == FASTPATH_DRAINING) {
+        if (now - pair->since_ms < FASTPATH_DRAIN_MIN_MS) return 0;
+        if (!pair_idle(s) && now - pair->since_ms < FASTPATH_DRAIN_TIMEOUT_MS) return 0;
+        detach(engine, s, FASTPATH_DONE, "connection closed");
+        return 1;
+    }
+    if (pair->state != FASTPATH_ACTIVE) return 0;
+
+    if (!eligible(engine, s) && pair_idle(s)) {
+        detach(engine, s, FASTPATH_OFF, "user-space forwarding required");
+        return 1;
+    }
+    if (now - pair->sync_ms >= FASTPATH_SYNC_MS) proxy_fastpath_sync(engine, s);
+    return 0;
+}
+
+int proxy_fastpath_timeout(proxy_engine_t *engine, int default_ms) {
+    if (engine->fastpath && engine->fastpath->draining > 0 && default_ms > FASTPATH_POLL_MS) {
+        return FASTPATH_POLL_MS;
+    }
+    return default_ms;
+}
+
+int proxy_fastpath_detach_all(proxy_engine_t *engine, char *err, size_t err_len) {
+    int busy = 0;
+
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (!proxy_fastpath_active(s)) continue;
+        if (!pair_idle(s)) {
+            busy++;
+            continue;
+        }
+        detach(engine, s, s->fastpath->state == FASTPATH_DRAINING ? FASTPATH_DONE : FASTPATH_OFF, "handoff");
+    }
+    if (busy) {
+        proxy_set_error(err, err_len, "%d fast path sessions have queued data, retry later", busy);
+        return -1;
+    }
+    return 0;
+}
+
+void proxy_fastpath_free(proxy_engine_t *engine, proxy_session_t *s) {
+    if (!s->fastpath) return;
+    if (proxy_fastpath_active(s)) pair_remove(engine, s, FASTPATH_DONE);
+    free(s->fastpath);
+    s->fastpath = NULL;
+}
+
+void proxy_fastpath_release(proxy_engine_t *engine) {
+    if (!engine->fastpath) return;
+    fastpath_close(engine->fastpath);
+    free(engine->fastpath);
+    engine->fastpath = NULL;
+}
+
+void proxy_fastpath_session_json(proxy_session_t *s, proxy_strbuf_t *sb) {
+    static const char *names[] = { "off", "active", "draining", "done" };
+    if (!s->fastpath) {
+        proxy_strbuf_printf(sb, "null");
+        return;
+    }
+    proxy_strbuf_printf(sb, "\"%s\"", names[s->fastpath->state]);
+}
+
+void proxy_fastpath_json(proxy_engine_t *engine, proxy_strbuf_t *sb) {
+    proxy_fastpath_t *fp = engine->fastpath;
+    if (!fp) {
+        proxy_strbuf_printf(sb, "null");
+        return;
+    }
+    proxy_strbuf_printf(sb, "{\"available\":%s", fp->error ? "false" : "true");
+    if (fp->error) {
+        proxy_strbuf_printf(sb, ",\"error\":");
+        proxy_strbuf_json_string(sb, strerror(fp->error));
+    }
+    proxy_strbuf_printf(sb, ",\"sessions\":%d,\"draining\":%d,\"attached\":%llu,\"detached\":%llu,\"failures\":%llu}",
+                        fp->active, fp->draining, (unsigned long long)fp->attached,
+                        (unsigned long long)fp->detached, (unsigned long long)fp->failures);
+}
@@ -0,0 +1,638 @@
+/*
+ * TCP Proxy Engine - BMP 消息过滤
+ *
+ * FILTER <listener> <action> [match...] 在 router -> collector 方向按消息过滤 BMP 流, 被丢弃的消息不进入隧道:
+ *   action: pass | drop | sample:N (匹配的消息每 N 条转发 1 条)
+ *   match (均可省略, 同一规则内为 "与"):
+ *     type=<t>[,<t>...]   BMP 消息类型, 数字或 rm/stats/down/up/init/term/mirror
+ *     peer=<ip>           被监控 peer 的地址 (per-peer header)
+ *     as=<asn>            被监控 peer 的 AS
+ *     afi=<n> safi=<n>    Route Monitoring 中 UPDATE 的地址族 (MP_REACH/MP_UNREACH, 否则为 IPv4 单播)
+ *     policy=pre|post     Adj-RIB-In 的 pre-policy / post-policy (L 标志)
+ * 规则按添加顺序匹配, 第一条匹配的规则决定动作, 都不匹配时转发。例如只保留一个 peer:
+ *     FILTER bmp pass peer=10.0.0.5
+ *     FILTER bmp drop type=rm,stats,down,up
+ * UNFILTER <listener> [<id>] 删除一条或全部规则, FILTER <listener> 查询规则和丢弃计数。规则立即对所有会话生效。
+ *
+ * 每个会话跟踪收到的数据中的消息边界: recv 之后 (镜像、录制和 BMP 统计看到的仍是原始数据), 在发送缓冲中
+ * 原地去掉被丢弃的消息。尚不能判断的消息 (消息头或 per-peer header 未收全, 或按地址族匹配时 UPDATE 未收全)
+ * 暂存在会话的 hold 缓冲中, 不发送; 暂存的字节从缓冲的可读空间中预留, 下次 recv 后放回缓冲前部重新判断。
+ * 超过 FILTER_MAX_HOLD 仍无法判断的消息直接转发, 计入 unfiltered。
+ * 不是 BMP 的流 (如 bgp/rpki 监听端口) 和失去边界的流不过滤。中途添加规则时, 已建立的会话从下一条完整的
+ * 消息开始过滤; 删除全部规则后, 会话在下一个消息边界退出过滤。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define BMP_HEADER_LEN 6
+#define BMP_VERSION 3
+#define BMP_PEER_HEADER_LEN 42
+#define BMP_MSG_ROUTE_MONITORING 0
+#define BMP_MSG_ROUTE_MIRRORING 6
+#define BMP_PEER_TYPE_LOC_RIB 3
+#define BMP_FLAG_V 0x80
+#define BMP_FLAG_L 0x40
+#define BMP_FLAG_O 0x10
+
+#define FILTER_MAX_RULES 256
+#define FILTER_MAX_HOLD (PROXY_BUFFER_SIZE / 2)
+
+typedef enum {
+    FILTER_PASS = 0,
+    FILTER_DROP,
+    FILTER_SAMPLE,
+    FILTER_UNDECIDED
+} filter_action_t;
+
+static const char *action_names[] = { "pass", "drop", "sample" };
+static const char *type_names[] = { "rm", "stats", "down", "up", "init", "term", "mirror" };
+
+// 定长结构, HANDOFF 时按原样发送 (next 在接收方重建)
+typedef struct filter_rule {
+    struct filter_rule *next;
+    uint32_t id;
+    uint32_t action;
+    uint32_t sample;             // sample:N 的 N
+    uint32_t types;              // 消息类型位图, 0 表示任意类型
+    int32_t afi;                 // -1 表示不限
+    int32_t safi;
+    int32_t policy;              // -1 不限, 0 pre-policy, 1 post-policy
+    uint32_t has_peer;
+    uint32_t has_as;
+    uint32_t as;
+    uint32_t peer_v6;
+    unsigned char peer[16];      // 按 per-peer header 的格式, IPv4 在最后 4 字节
+    uint64_t matched;
+    uint64_t dropped;
+    uint64_t dropped_bytes;
+} filter_rule_t;
+
+struct proxy_filter {
+    filter_rule_t *rules;
+    int rule_count;
+    uint32_t next_id;
+    uint64_t messages;           // 已判断的消息数
+    uint64_t dropped;
+    uint64_t dropped_bytes;
+    uint64_t unfiltered;         // 超过 FILTER_MAX_HOLD 未能判断, 直接转发的消息
+    int64_t since;
+};
+
+struct proxy_filter_stream {
+    int lost;                    // 不是 BMP 流或失去消息边界, 不再过滤
+    uint32_t pass_left;          // 当前消息剩余的待转发字节
+    uint32_t drop_left;          // 当前消息剩余的待丢弃字节
+    unsigned char hdr[BMP_HEADER_LEN]; // 中途开始时已部分转发的消息头, 这条消息只能转发
+    size_t hdr_len;
+    unsigned char *hold;         // 未能判断的消息开头, 不在发送缓冲中
+    size_t held;
+};
+
+static uint32_t get32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int parse_types(const char *value, uint32_t *types) {
+    char copy[128];
+    char *save = NULL;
+    snprintf(copy, sizeof(copy), "%s", value);
+    for (char *t = strtok_r(copy, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        int type = -1;
+        for (int i = 0; i < (int)(sizeof(type_names) / sizeof(type_names[0])); i++) {
+            if (strcmp(t, type_names[i]) == 0) type = i;
+        }
+        if (type < 0) {
+            char *end = NULL;
+            long n = strtol(t, &end, 10);
+            if (*t == '\0' || *end != '\0' || n < 0 || n > 31) return -1;
+            type = n;
+        }
+        *types |= 1u << type;
+    }
+    return *types ? 0 : -1;
+}
+
+static int parse_rule(char *args, filter_rule_t *rule, char *err, size_t err_len) {
+    char *save = NULL;
+    char *action = strtok_r(args, " \t", &save);
+
+    rule->afi = rule->safi = rule->policy = -1;
+    if (!action) {
+        proxy_set_error(err, err_len, "missing action");
+        return -1;
+    }
+    if (strcmp(action, "pass") == 0) {
+        rule->action = FILTER_PASS;
+    } else if (strcmp(action, "drop") == 0) {
+        rule->action = FILTER_DROP;
+    } else if (strncmp(action, "sample:", 7) == 0 && atoi(action + 7) > 0) {
+        rule->action = FILTER_SAMPLE;
+        rule->sample = atoi(action + 7);
+    } else {
+        proxy_set_error(err, err_len, "invalid action %s (pass, drop or sample:N)", action);
+        return -1;
+    }
+
+    for (char *tok = strtok_r(NULL, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        char *value = strchr(tok, '=');
+        if (!value) {
+            proxy_set_error(err, err_len, "invalid match %s", tok);
+            return -1;
+        }
+        *value++ = '\0';
+        int ok = 1;
+        if (strcmp(tok, "type") == 0) {
+            ok = parse_types(value, &rule->types) == 0;
+        } else if (strcmp(tok, "peer") == 0) {
+            struct in_addr v4;
+            rule->has_peer = 1;
+            if (inet_pton(AF_INET6, value, rule->peer) == 1) {
+                rule->peer_v6 = 1;
+            } else if (inet_pton(AF_INET, value, &v4) == 1) {
+                memcpy(rule->peer + 12, &v4, 4);
+            } else {
+                ok = 0;
+            }
+        } else if (strcmp(tok, "as") == 0) {
+            rule->has_as = 1;
+            rule->as = strtoul(value, NULL, 10);
+        } else if (strcmp(tok, "afi") == 0) {
+            rule->afi = atoi(value);
+            ok = rule->afi >= 0 && rule->afi <= 65535;
+        } else if (strcmp(tok, "safi") == 0) {
+            rule->safi = atoi(value);
+            ok = rule->safi >= 0 && rule->safi <= 255;
+        } else if (strcmp(tok, "policy") == 0) {
+            rule->policy = strcmp(value, "post") == 0 ? 1 : strcmp(value, "pre") == 0 ? 0 : -1;
+            ok = rule->policy >= 0;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            proxy_set_error(err, err_len, "invalid match %s=%s", tok, value);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static proxy_filter_stream_t *stream_create(void) {
+    return calloc(1, sizeof(proxy_filter_stream_t));
+}
+
+// midstream 表示会话在添加规则前已建立
+static void stream_attach(proxy_session_t *s, int midstream) {
+    if (s->filter) return;
+    proxy_filter_stream_t *st = stream_create();
+    if (!st) return;
+
+    // 收到的位置在消息中间时先转发完这条消息
+    if (midstream && proxy_bmp_receive_position(s, &st->pass_left, st->hdr, &st->hdr_len) < 0) {
+        st->lost = 1;
+        proxy_log("WARN", "Session %u: BMP message boundary unknown, messages not filtered", s->id);
+    }
+    s->filter = st;
+}
+
+void proxy_filter_attach(proxy_listener_t *listener, proxy_session_t *s) {
+    if (listener->filter && listener->filter->rule_count > 0) stream_attach(s, 0);
+}
+
+static void stream_free(proxy_session_t *s) {
+    if (!s->filter) return;
+    free(s->filter->hold);
+    free(s->filter);
+    s->filter = NULL;
+}
+
+// 会话结束时 hold 中不完整的消息随之丢弃
+void proxy_filter_free(proxy_session_t *s) {
+    stream_free(s);
+}
+
+size_t proxy_filter_held(proxy_session_t *s) {
+    return s->filter ? s->filter->held : 0;
+}
+
+int proxy_filter_add(proxy_engine_t *engine, proxy_listener_t *listener, char *args, char *err, size_t err_len) {
+    filter_rule_t rule;
+
+    memset(&rule, 0, sizeof(rule));
+    if (parse_rule(args, &rule, err, err_len) < 0) return -1;
+    if (!listener->filter) {
+        listener->filter = calloc(1, sizeof(proxy_filter_t));
+        if (!listener->filter) {
+            proxy_set_error(err, err_len, "out of memory");
+            return -1;
+        }
+        listener->filter->since = time(NULL);
+    }
+    proxy_filter_t *f = listener->filter;
+    if (f->rule_count >= FILTER_MAX_RULES) {
+        proxy_set_error(err, err_len, "too many filter rules");
+        return -1;
+    }
+
+    filter_rule_t *r = malloc(sizeof(filter_rule_t));
+    if (!r) {
+        proxy_set_error(err, err_len, "out of memory");
+        return -1;
+    }
+    *r = rule;
+    r->id = ++f->next_id;
+    filter_rule_t **tail = &f->rules;
+    while (*tail) tail = &(*tail)->next;
+    *tail = r;
+    f->rule_count++;
+
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (s->listener == listener) stream_attach(s, 1);
+    }
+    return r->id;
+}
+
+// id 为 0 时删除全部规则
+int proxy_filter_remove(proxy_engine_t *engine, proxy_listener_t *listener, uint32_t id, char *err, size_t err_len) {
+    proxy_filter_t *f = listener->filter;
+    int removed = 0;
+
+    if (f) {
+        filter_rule_t **pp = &f->rules;
+        while (*pp) {
+            filter_rule_t *r = *pp;
+            if (id && r->id != id) {
+                pp = &r->next;
+                continue;
+            }
+            *pp = r->next;
+            free(r);
+            f->rule_count--;
+            removed++;
+        }
+    }
+    if (!removed && id) {
+        proxy_set_error(err, err_len, "filter rule %u not found", id);
+        return -1;
+    }
+    if (!removed) {
+        proxy_set_error(err, err_len, "no filter rules");
+        return -1;
+    }
+    // 停在消息边界的会话立即退出过滤, 其余在 proxy_filter_apply 中到达边界时退出
+    if (f->rule_count == 0) {
+        for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+            proxy_filter_stream_t *st = s->filter;
+            if (s->listener == listener && st && !st->held && !st->hdr_len && !st->pass_left && !st->drop_left) {
+                stream_free(s);
+            }
+        }
+    }
+    return removed;
+}
+
+void proxy_filter_config_free(proxy_filter_t *f) {
+    if (!f) return;
+    while (f->rules) {
+        filter_rule_t *r = f->rules;
+        f->rules = r->next;
+        free(r);
+    }
+    free(f);
+}
+
+// 按规则判断 m 开始的消息, have 为已收到的字节数 (不超过 msg_len)
+static filter_action_t decide(proxy_filter_t *f, const unsigned char *m, size_t have, uint32_t msg_len,
+                              filter_rule_t **match) {
+    uint8_t type = m[5];
+    int per_peer = type <= 3 || type == BMP_MSG_ROUTE_MIRRORING;
+    const unsigned char *ph = m + BMP_HEADER_LEN;
+    int family = -1;             // -1 未解析, 0 不是可解析的 UPDATE, 1 已解析
+    uint16_t afi = 0;
+    uint8_t safi = 0;
+
+    for (filter_rule_t *r = f->rules; r; r = r->next) {
+        if (r->types && (type > 31 || !(r->types & (1u << type)))) continue;
+        if (r->has_peer || r->has_as || r->policy >= 0) {
+            if (!per_peer) continue;
+            if (have < BMP_HEADER_LEN + BMP_PEER_HEADER_LEN) return FILTER_UNDECIDED;
+            if (msg_len < BMP_HEADER_LEN + BMP_PEER_HEADER_LEN) continue;
+            if (r->has_peer && (((ph[1] & BMP_FLAG_V) != 0) != (int)r->peer_v6 || memcmp(ph + 10, r->peer, 16) != 0)) {
+                continue;
+            }
+            if (r->has_as && get32(ph + 26) != r->as) continue;
+            if (r->policy >= 0 && (ph[0] == BMP_PEER_TYPE_LOC_RIB || (ph[1] & BMP_FLAG_O) ||
+                                   ((ph[1] & BMP_FLAG_L) != 0) != r->policy)) {
+                continue;
+            }
+        }
+        if (r->afi >= 0 || r->safi >= 0) {
+            if (type != BMP_MSG_ROUTE_MONITORING || msg_len < BMP_HEADER_LEN + BMP_PEER_HEADER_LEN) continue;
+            if (family < 0) {
+                if (have < msg_len) return FILTER_UNDECIDED;
+                family = proxy_bmp_update_family(m + BMP_HEADER_LEN + BMP_PEER_HEADER_LEN,
+                                                 msg_len - BMP_HEADER_LEN - BMP_PEER_HEADER_LEN, &afi, &safi) == 0;
+            }
+            if (!family || (r->afi >= 0 && afi != r->afi) || (r->safi >= 0 && safi != r->safi)) continue;
+        }
+
+        *match = r;
+        r->matched++;
+        if (r->action == FILTER_SAMPLE) return (r->matched - 1) % r->sample == 0 ? FILTER_PASS : FILTER_DROP;
+        return r->action;
+    }
+    return FILTER_PASS;
+}
+
+// 处理 buf 末尾刚收到的 n 字节: 去掉被丢弃的消息, 无法判断的消息开头移入 hold
+void proxy_filter_apply(proxy_session_t *s, proxy_buffer_t *buf, size_t n) {
+    proxy_filter_stream_t *st = s->filter;
+    proxy_filter_t *f = s->listener->filter;
+    size_t start = buf->len - n;
+
+    // hold 中的字节在新数据之前, 放回缓冲 (recv 时已预留空间)
+    if (st->held) {
+        memmove(buf->data + start + st->held, buf->data + start, n);
+        memcpy(buf->data + start, st->hold, st->held);
+        buf->len += st->held;
+        st->held = 0;
+    }
+
+    unsigned char *d = (unsigned char *)buf->data;
+    size_t r = start;
+    size_t w = start;
+    size_t end = buf->len;
+    int detach = 0;
+
+    while (r < end) {
+        size_t avail = end - r;
+        size_t keep = 0;
+
+        if (st->lost) {
+            keep = avail;
+        } else if (st->pass_left) {
+            keep = avail < st->pass_left ? avail : st->pass_left;
+            st->pass_left -= keep;
+        } else if (st->hdr_len) {
+            keep = BMP_HEADER_LEN - st->hdr_len;
+            if (keep > avail) keep = avail;
+            memcpy(st->hdr + st->hdr_len, d + r, keep);
+            st->hdr_len += keep;
+            if (st->hdr_len == BMP_HEADER_LEN) {
+                st->hdr_len = 0;
+                st->pass_left = get32(st->hdr + 1) - BMP_HEADER_LEN;
+                if (get32(st->hdr + 1) < BMP_HEADER_LEN) st->lost = 1;
+            }
+        } else if (st->drop_left) {
+            size_t k = avail < st->drop_left ? avail : st->drop_left;
+            st->drop_left -= k;
+            r += k;
+            continue;
+        } else if (!f || f->rule_count == 0) {
+            // 规则已全部删除, 从这个边界起不再过滤
+            keep = avail;
+            detach = 1;
+        } else if (d[r] != BMP_VERSION) {
+            st->lost = 1;
+            proxy_log("WARN", "Session %u: not a BMP stream, messages not filtered", s->id);
+            continue;
+        } else if (avail < BMP_HEADER_LEN) {
+            break;
+        } else {
+            uint32_t msg_len = get32(d + r + 1);
+            if (msg_len < BMP_HEADER_LEN) {
+                st->lost = 1;
+                proxy_log("WARN", "Session %u: invalid BMP message length, messages not filtered", s->id);
+                continue;
+            }
+            filter_rule_t *match = NULL;
+            filter_action_t action = decide(f, d + r, avail < msg_len ? avail : msg_len, msg_len, &match);
+            if (action == FILTER_UNDECIDED) {
+                if (msg_len <= FILTER_MAX_HOLD) break;
+                f->unfiltered++;
+                action = FILTER_PASS;
+            }
+            f->messages++;
+            if (action == FILTER_DROP) {
+                f->dropped++;
+                f->dropped_bytes += msg_len;
+                match->dropped++;
+                match->dropped_bytes += msg_len;
+                st->drop_left = msg_len;
+            } else {
+                st->pass_left = msg_len;
+            }
+            continue;
+        }
+
+        if (w != r) memmove(d + w, d + r, keep);
+        w += keep;
+        r += keep;
+    }
+
+    // 剩余的是尚不能判断的消息开头
+    if (r < end) {
+        if (!st->hold) st->hold = malloc(FILTER_MAX_HOLD);
+        if (st->hold) {
+            st->held = end - r;
+            memcpy(st->hold, d + r, st->held);
+        } else {
+            st->lost = 1;
+            if (w != r) memmove(d + w, d + r, end - r);
+            w += end - r;
+        }
+    }
+    buf->len = w;
+    if (detach) stream_free(s);
+}
+
+int proxy_filter_receive_position(proxy_session_t *s, uint32_t *skip, unsigned char *hdr, size_t *hdr_len) {
+    proxy_filter_stream_t *st = s->filter;
+
+    *skip = 0;
+    *hdr_len = 0;
+    if (st->lost) return -1;
+    if (st->hdr_len) {
+        memcpy(hdr, st->hdr, st->hdr_len);
+        *hdr_len = st->hdr_len;
+    } else if (st->pass_left || st->drop_left) {
+        *skip = st->pass_left + st->drop_left;
+    } else if (st->held >= BMP_HEADER_LEN) {
+        // 跳过 hold 中这条消息的剩余部分
+        *skip = get32(st->hold + 1) - st->held;
+    } else {
+        memcpy(hdr, st->hold, st->held);
+        *hdr_len = st->held;
+    }
+    return 0;
+}
+
+void proxy_filter_json(proxy_filter_t *f, proxy_strbuf_t *sb) {
+    char addr[INET6_ADDRSTRLEN];
+
+    if (!f) {
+        proxy_strbuf_printf(sb, "{\"rules\":[],\"messages\":0,\"dropped\":0,\"droppedBytes\":0,\"unfiltered\":0}");
+        return;
+    }
+    proxy_strbuf_printf(sb, "{\"since\":%lld,\"rules\":[", (long long)f->since);
+    for (filter_rule_t *r = f->rules; r; r = r->next) {
+        proxy_strbuf_printf(sb, "%s{\"id\":%u,\"action\":\"%s\"", r == f->rules ? "" : ",", r->id,
+                            action_names[r->action]);
+        if (r->action == FILTER_SAMPLE) proxy_strbuf_printf(sb, ",\"sample\":%u", r->sample);
+        proxy_strbuf_printf(sb, ",\"match\":{");
+        const char *sep = "";
+        if (r->types) {
+            proxy_strbuf_printf(sb, "\"type\":[");
+            for (int t = 0, first = 1; t < 32; t++) {
+                if (!(r->types & (1u << t))) continue;
+                proxy_strbuf_printf(sb, "%s%d", first ? "" : ",", t);
+                first = 0;
+            }
+            proxy_strbuf_printf(sb, "]");
+            sep = ",";
+        }
+        if (r->has_peer) {
+            if (r->peer_v6) {
+                inet_ntop(AF_INET6, r->peer, addr, sizeof(addr));
+            } else {
+                inet_ntop(AF_INET, r->peer + 12, addr, sizeof(addr));
+            }
+            proxy_strbuf_printf(sb, "%s\"peer\":\"%s\"", sep, addr);
+            sep = ",";
+        }
+        if (r->has_as) {
+            proxy_strbuf_printf(sb, "%s\"as\":%u", sep, r->as);
+            sep = ",";
+        }
+        if (r->afi >= 0) {
+            proxy_strbuf_printf(sb, "%s\"afi\":%d", sep, r->afi);
+            sep = ",";
+        }
+        if (r->safi >= 0) {
+            proxy_strbuf_printf(sb, "%s\"safi\":%d", sep, r->safi);
+            sep = ",";
+        }
+        if (r->policy >= 0) proxy_strbuf_printf(sb, "%s\"policy\":\"%s\"", sep, r->policy ? "post" : "pre");
+        proxy_strbuf_printf(sb, "},\"matched\":%llu,\"dropped\":%llu,\"droppedBytes\":%llu}",
+                            (unsigned long long)r->matched, (unsigned long long)r->dropped,
+                            (unsigned long long)r->dropped_bytes);
+    }
+    proxy_strbuf_printf(sb, "],\"messages\":%llu,\"dropped\":%llu,\"droppedBytes\":%llu,\"unfiltered\":%llu}",
+                        (unsigned long long)f->messages, (unsigned long long)f->dropped,
+                        (unsigned long long)f->dropped_bytes, (unsigned long long)f->unfiltered);
+}
+
+typedef struct {
+    uint32_t rule_count;
+    uint32_t next_id;
+    uint64_t messages;
+    uint64_t dropped;
+    uint64_t dropped_bytes;
+    uint64_t unfiltered;
+    int64_t since;
+} filter_config_record_t;
+
+int proxy_filter_handoff(int fd, proxy_filter_t *f) {
+    filter_config_record_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.rule_count = f->rule_count;
+    rec.next_id = f->next_id;
+    rec.messages = f->messages;
+    rec.dropped = f->dropped;
+    rec.dropped_bytes = f->dropped_bytes;
+    rec.unfiltered = f->unfiltered;
+    rec.since = f->since;
+    if (proxy_write_all(fd, &rec, sizeof(rec)) < 0) return -1;
+    for (filter_rule_t *r = f->rules; r; r = r->next) {
+        if (proxy_write_all(fd, r, sizeof(*r)) < 0) return -1;
+    }
+    return 0;
+}
+
+int proxy_filter_takeover(int fd, proxy_filter_t **out) {
+    filter_config_record_t rec;
+
+    if (proxy_read_all(fd, &rec, sizeof(rec)) < 0 || rec.rule_count > FILTER_MAX_RULES) return -1;
+    proxy_filter_t *f = calloc(1, sizeof(proxy_filter_t));
+    if (!f) return -1;
+    *out = f;
+    f->next_id = rec.next_id;
+    f->messages = rec.messages;
+    f->dropped = rec.dropped;
+    f->dropped_bytes = rec.dropped_bytes;
+    f->unfiltered = rec.unfiltered;
+    f->since = rec.since;
+
+    filter_rule_t **tail = &f->rules;
+    for (uint32_t i = 0; i < rec.rule_count; i++) {
+        filter_rule_t *r = malloc(sizeof(filter_rule_t));
+        if (!r) return -1;
+        if (proxy_read_all(fd, r, sizeof(*r)) < 0 || r->action > FILTER_SAMPLE ||
+            (r->action == FILTER_SAMPLE && r->sample == 0)) {
+            free(r);
+            return -1;
+        }
+        r->next = NULL;
+        *tail = r;
+        tail = &r->next;
+        f->rule_count++;
+    }
+    return 0;
+}
+
+typedef struct {
+    uint32_t lost;
+    uint32_t pass_left;
+    uint32_t drop_left;
+    uint32_t held;
+    uint32_t hdr_len;
+    unsigned char hdr[BMP_HEADER_LEN];
+    uint16_t reserved;
+} filter_stream_record_t;
+
+int proxy_filter_stream_handoff(int fd, proxy_session_t *s) {
+    proxy_filter_stream_t *st = s->filter;
+    filter_stream_record_t rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.lost = st->lost;
+    rec.pass_left = st->pass_left;
+    rec.drop_left = st->drop_left;
+    rec.held = st->held;
+    rec.hdr_len = st->hdr_len;
+    memcpy(rec.hdr, st->hdr, sizeof(rec.hdr));
+
+    if (proxy_write_all(fd, &rec, sizeof(rec)) < 0 || proxy_write_all(fd, st->hold, st->held) < 0) return -1;
+    return 0;
+}
+
+int proxy_filter_stream_takeover(int fd, proxy_session_t *s) {
+    filter_stream_record_t rec;
+
+    if (proxy_read_all(fd, &rec, sizeof(rec)) < 0 || rec.held > FILTER_MAX_HOLD || rec.hdr_len >= BMP_HEADER_LEN) {
+        return -1;
+    }
+    proxy_filter_stream_t *st = stream_create();
+    if (!st) return -1;
+    s->filter = st;
+    st->lost = rec.lost;
+    st->pass_left = rec.pass_left;
+    st->drop_left = rec.drop_left;
+    st->hdr_len = rec.hdr_len;
+    memcpy(st->hdr, rec.hdr, sizeof(st->hdr));
+    if (rec.held) {
+        st->hold = malloc(FILTER_MAX_HOLD);
+        if (!st->hold || proxy_read_all(fd, st->hold, rec.held) < 0) return -1;
+        st->held = rec.held;
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * TCP Proxy Engine - 内部接口
+ *
+ * 引擎各模块 (tcp-proxy-engine.c, tcp-proxy-mirror.c, tcp-proxy-recorder.c, tcp-proxy-resume.c,
+ * tcp-proxy-sched.c, tcp-proxy-latency.c, tcp-proxy-fastpath.c, tcp-proxy-bmp.c, tcp-proxy-filter.c)
+ * 之间共用的工具函数, helper 不应直接使用
+ */
+
+#ifndef TCP_PROXY_INTERNAL_H
+#define TCP_PROXY_INTERNAL_H
+
+#include "tcp-proxy-engine.h"
+
+#define PROXY_HANDOFF_MAX_FDS 2
+
+// 控制命令应答使用的可增长字符串
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} proxy_strbuf_t;
+
+void proxy_set_error(char *err, size_t err_len, const char *format, ...);
+void proxy_strbuf_printf(proxy_strbuf_t *sb, const char *format, ...);
+void proxy_strbuf_json_string(proxy_strbuf_t *sb, const char *s);
+
+int proxy_write_all(int fd, const void *buf, size_t len);
+int proxy_read_all(int fd, void *buf, size_t len);
+int proxy_send_with_fds(int sock, const void *buf, size_t len, const int *fds, int nfds);
+int proxy_recv_with_fds(int sock, void *buf, size_t len, int *fds, int max_fds, int *nfds);
+void proxy_set_nonblocking(int fd);
+void proxy_set_timeouts(int fd, int seconds);
+int proxy_parse_host_port(const char *addr, char *host, size_t host_len, int *port);
+// 非阻塞连接 host:port, *connecting 置位表示连接进行中
+int proxy_connect_target(const char *host, int port, int *connecting);
+
+int proxy_endpoint_set_events(proxy_engine_t *engine, proxy_endpoint_t *ep, uint32_t events, int add);
+void proxy_endpoint_close(proxy_engine_t *engine, proxy_endpoint_t *ep);
+
+// 镜像 (tcp-proxy-mirror.c)
+int proxy_mirror_add_target(proxy_listener_t *listener, const char *addr, proxy_mirror_policy_t policy, size_t max_lag,
+                            char *err, size_t err_len);
+int proxy_mirror_remove_target(proxy_engine_t *engine, proxy_listener_t *listener, const char *addr,
+                               char *err, size_t err_len);
+void proxy_mirror_free_targets(proxy_engine_t *engine, proxy_listener_t *listener);
+void proxy_mirror_open_legs(proxy_engine_t *engine, proxy_session_t *s);
+// peer -> forward 方向新读到的数据
+void proxy_mirror_feed(proxy_engine_t *engine, proxy_session_t *s, const char *data, size_t len);
+void proxy_mirror_handle_event(proxy_engine_t *engine, proxy_mirror_leg_t *leg, uint32_t events);
+// 会话结束: 没有积压的镜像连接直接关闭, 有积压的转为孤儿连接继续发送
+void proxy_mirror_detach_session(proxy_engine_t *engine, proxy_session_t *s);
+// 关闭结束超过 timeout 秒仍未发完的孤儿连接, timeout 为 0 时全部关闭
+void proxy_mirror_expire_orphans(proxy_engine_t *engine, int timeout);
+void proxy_mirror_release(proxy_engine_t *engine);
+void proxy_mirror_targets_json(proxy_engine_t *engine, proxy_listener_t *listener, proxy_strbuf_t *sb);
+void proxy_mirror_legs_json(proxy_session_t *s, proxy_strbuf_t *sb);
+int proxy_mirror_handoff_targets(int fd, proxy_listener_t *listener);
+int proxy_mirror_takeover_targets(int fd, proxy_listener_t *listener, uint32_t count);
+int proxy_mirror_handoff_legs(int fd, proxy_session_t *s);
+int proxy_mirror_takeover_legs(proxy_engine_t *engine, int fd, proxy_session_t *s, uint32_t count);
+
+// 录制 (tcp-proxy-recorder.c)
+proxy_recorder_t *proxy_recorder_start(const char *listener, const char *dir, uint64_t max_file_mb,
+                                       int max_file_seconds, int max_files, char *err, size_t err_len);
+void proxy_recorder_stop(proxy_recorder_t *rec);
+// midstream 表示会话在录制开始前已建立
+void proxy_recorder_open(proxy_recorder_t *rec, proxy_session_t *s, int midstream);
+void proxy_recorder_close(proxy_recorder_t *rec, proxy_session_t *s);
+void proxy_recorder_data(proxy_recorder_t *rec, proxy_session_t *s, int from_peer, const char *data, size_t len);
+void proxy_recorder_json(proxy_recorder_t *rec, proxy_strbuf_t *sb);
+int proxy_recorder_handoff(int fd, proxy_recorder_t *rec);
+// 读取配置失败返回 -1; 录制器启动失败不影响接管, *out 为 NULL
+int proxy_recorder_takeover(int fd, const char *listener, proxy_recorder_t **out);
+
+// 可续传转发 (tcp-proxy-resume.c)
+proxy_resume_config_t *proxy_resume_config_create(const char *spill_dir, uint64_t mem_mb, uint64_t disk_mb,
+                                                  int max_outage, char *err, size_t err_len);
+void proxy_resume_config_free(proxy_resume_config_t *cfg);
+void proxy_resume_config_json(proxy_resume_config_t *cfg, proxy_strbuf_t *sb);
+int proxy_resume_config_handoff(int fd, proxy_resume_config_t *cfg);
+int proxy_resume_config_takeover(int fd, proxy_resume_config_t **out);
+// 新会话开始续传, forward_ep.fd 为 -1 (首次连接失败) 时从断开状态开始重连
+int proxy_resume_attach(proxy_engine_t *engine, proxy_session_t *s, proxy_resume_config_t *cfg, int connecting);
+void proxy_resume_free(proxy_session_t *s);
+// 把 s->to_forward 中的数据移入续传队列并尽量发送, 溢出文件出错返回 -1
+int proxy_resume_push(proxy_engine_t *engine, proxy_session_t *s);
+// 转发侧事件, 连接断开只触发重连; 返回 -1 表示无法续传, 会话需要关闭
+int proxy_resume_handle_event(proxy_engine_t *engine, proxy_session_t *s, uint32_t events);
+int proxy_resume_update_events(proxy_engine_t *engine, proxy_session_t *s);
+// 重连和超时检查, 返回 -1 表示转发目标不可用超过 max_outage, 会话需要关闭
+int proxy_resume_tick(proxy_engine_t *engine, proxy_session_t *s, time_t now);
+// 队列中的数据已全部被 collector 确认
+int proxy_resume_drained(proxy_session_t *s);
+int proxy_resume_streaming(proxy_session_t *s);
+void proxy_resume_json(proxy_session_t *s, proxy_strbuf_t *sb);
+int proxy_resume_handoff(int fd, proxy_session_t *s);
+int proxy_resume_takeover(proxy_engine_t *engine, int fd, proxy_session_t *s);
+
+// 调度与限速 (tcp-proxy-sched.c), dir 为 PROXY_DIR_FORWARD / PROXY_DIR_PEER
+void proxy_sched_set_peer(proxy_engine_t *engine, proxy_peer_t *peer, uint64_t rate, uint64_t burst);
+void proxy_sched_set_link(proxy_engine_t *engine, uint64_t rate, uint64_t burst);
+void proxy_sched_peers_changed(proxy_engine_t *engine);
+// 本次最多可发送的字节数, 返回 0 时会话标记为 throttled, 等待补充令牌
+size_t proxy_sched_quota(proxy_engine_t *engine, proxy_session_t *s, int dir, const char *data, size_t len);
+void proxy_sched_sent(proxy_engine_t *engine, proxy_session_t *s, int dir, const char *data, size_t len);
+void proxy_sched_reset_framing(proxy_session_t *s, int dir);
+// 已发送位置之后接上 data 时下一个字节在 BMP 流中的位置, 不是 BMP 流或位置未知时返回 -1
+int proxy_sched_bmp_position(const proxy_framing_t *fr, const char *data, size_t len,
+                             uint32_t *skip, unsigned char *hdr, size_t *hdr_len);
+int proxy_sched_refill(proxy_engine_t *engine);
+void proxy_sched_add_quantum(proxy_engine_t *engine);
+int proxy_sched_timeout(proxy_engine_t *engine, int default_ms);
+void proxy_sched_peer_json(proxy_peer_t *peer, proxy_strbuf_t *sb);
+void proxy_sched_link_json(proxy_engine_t *engine, proxy_strbuf_t *sb);
+
+// 转发延迟测量 (tcp-proxy-latency.c), dir 为数据方向
+int proxy_latency_enable(proxy_session_t *s, proxy_endpoint_t *ep);
+void proxy_latency_free(proxy_session_t *s);
+void proxy_latency_suspend(proxy_session_t *s);
+// 代替 recv, 开启时间戳时记录接收时间
+ssize_t proxy_latency_recv(proxy_session_t *s, int dir, int fd, void *buf, size_t len);
+void proxy_latency_sent(proxy_session_t *s, int dir, size_t len);
+// socket 上的 EPOLLERR 可能只是发送时间戳, 先读取错误队列
+void proxy_latency_errqueue(proxy_session_t *s, proxy_endpoint_t *ep);
+void proxy_latency_peer_json(proxy_peer_t *peer, proxy_strbuf_t *sb);
+void proxy_latency_json(proxy_engine_t *engine, proxy_strbuf_t *sb);
+void proxy_latency_reset(proxy_engine_t *engine);
+
+// 内核快速路径 (tcp-proxy-fastpath.c)
+// 首次开启时加载 BPF 程序, 内核不支持时返回 -1; 关闭只影响标志, 会话在 tick 中退出
+int proxy_fastpath_enable(proxy_engine_t *engine, proxy_listener_t *listener, int on, char *err, size_t err_len);
+int proxy_fastpath_active(proxy_session_t *s);
+// 会话满足条件时放入 sockmap, 失败时该会话不再尝试
+void proxy_fastpath_attach(proxy_engine_t *engine, proxy_session_t *s);
+int proxy_fastpath_handle_event(proxy_engine_t *engine, proxy_session_t *s, uint32_t events);
+// 返回 1 表示会话已退回普通转发, 需要重新注册事件
+int proxy_fastpath_tick(proxy_engine_t *engine, proxy_session_t *s);
+int proxy_fastpath_timeout(proxy_engine_t *engine, int default_ms);
+// 内核转发的字节数计入 bytes_to_*
+void proxy_fastpath_sync(proxy_engine_t *engine, proxy_session_t *s);
+// HANDOFF 前全部退回普通转发, 有会话仍有积压时返回 -1
+int proxy_fastpath_detach_all(proxy_engine_t *engine, char *err, size_t err_len);
+void proxy_fastpath_free(proxy_engine_t *engine, proxy_session_t *s);
+void proxy_fastpath_release(proxy_engine_t *engine);
+void proxy_fastpath_session_json(proxy_session_t *s, proxy_strbuf_t *sb);
+void proxy_fastpath_json(proxy_engine_t *engine, proxy_strbuf_t *sb);
+
+// BMP 统计 (tcp-proxy-bmp.c)
+proxy_bmp_stats_t *proxy_bmp_stats_create(void);
+void proxy_bmp_stats_free(proxy_bmp_stats_t *stats);
+void proxy_bmp_stats_reset(proxy_bmp_stats_t *stats);
+// midstream 表示会话在开启统计前已建立, 从下一条完整的消息开始解析
+void proxy_bmp_attach(proxy_bmp_stats_t *stats, proxy_session_t *s, int midstream);
+void proxy_bmp_detach(proxy_session_t *s);
+// peer -> forward 方向新读到的数据
+void proxy_bmp_feed(proxy_session_t *s, const char *data, size_t len);
+void proxy_bmp_stats_json(proxy_bmp_stats_t *stats, proxy_strbuf_t *sb);
+int proxy_bmp_stats_handoff(int fd, proxy_bmp_stats_t *stats);
+int proxy_bmp_stats_takeover(int fd, proxy_bmp_stats_t **out);
+int proxy_bmp_stream_handoff(int fd, proxy_session_t *s);
+int proxy_bmp_stream_takeover(int fd, proxy_bmp_stats_t *stats, proxy_session_t *s);
+// Route Monitoring 中 UPDATE 的地址族, 带 MP_REACH/MP_UNREACH 时取其 AFI/SAFI, 否则为 IPv4 单播
+int proxy_bmp_update_family(const unsigned char *msg, size_t len, uint16_t *afi, uint8_t *safi);
+// router -> forward 方向下一个收到的字节在 BMP 流中的位置, 同 proxy_sched_bmp_position
+int proxy_bmp_receive_position(proxy_session_t *s, uint32_t *skip, unsigned char *hdr, size_t *hdr_len);
+
+// BMP 消息过滤 (tcp-proxy-filter.c)
+// args 为动作和匹配条件, 返回新规则的 id; 已建立的会话从下一条完整的消息开始过滤
+int proxy_filter_add(proxy_engine_t *engine, proxy_listener_t *listener, char *args, char *err, size_t err_len);
+// id 为 0 时删除全部规则, 返回删除的条数
+int proxy_filter_remove(proxy_engine_t *engine, proxy_listener_t *listener, uint32_t id, char *err, size_t err_len);
+void proxy_filter_config_free(proxy_filter_t *f);
+void proxy_filter_attach(proxy_listener_t *listener, proxy_session_t *s);
+void proxy_filter_free(proxy_session_t *s);
+// 暂存在过滤模块中、尚未放入 to_forward 的字节数, recv 时需要预留
+size_t proxy_filter_held(proxy_session_t *s);
+// to_forward 末尾刚读到 n 字节后调用, 原地去掉被丢弃的消息
+void proxy_filter_apply(proxy_session_t *s, proxy_buffer_t *buf, size_t n);
+int proxy_filter_receive_position(proxy_session_t *s, uint32_t *skip, unsigned char *hdr, size_t *hdr_len);
+void proxy_filter_json(proxy_filter_t *f, proxy_strbuf_t *sb);
+int proxy_filter_handoff(int fd, proxy_filter_t *f);
+int proxy_filter_takeover(int fd, proxy_filter_t **out);
+int proxy_filter_stream_handoff(int fd, proxy_session_t *s);
+int proxy_filter_stream_takeover(int fd, proxy_session_t *s);
+
+#endif
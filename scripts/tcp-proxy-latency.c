@@ -0,0 +1,337 @@
+/*
+ * TCP Proxy Engine - 转发延迟测量
+ *
+ * 会话的 peer/forward socket 开启 SO_TIMESTAMPING (软件时间戳):
+ *   - 接收: 每次 recvmsg 附带内核收到该段数据的时间, 按流偏移记入该方向的环形表
+ *   - 发送: SOF_TIMESTAMPING_OPT_ID 使每次 send 的最后一个字节在进入网卡队列时产生一个时间戳,
+ *     通过错误队列 (MSG_ERRQUEUE, 触发 EPOLLERR) 返回, ee_data 为该字节相对开启时的序号
+ * 两者按流偏移对应, 差值即这段数据在 helper 中的停留时间 (含用户态缓冲、调度限速和 socket 发送缓冲中的排队),
+ * 按 peer 和方向计入对数线性直方图 (精度为 recv 调用粒度: 接收时间取该次读到的最后一段数据)。
+ * STATS 中给出每个 peer 的分位数, LATENCY 命令给出完整的分桶。
+ *
+ * 可续传会话的转发连接会重连并重发, 流偏移不再一一对应, 不测量 peer -> forward 方向。
+ * HANDOFF 后新进程重新开启时间戳, 用 SIOCOUTQ 换算已发出未确认的数据; 交接前收到的数据没有接收时间, 不计入。
+ * 内核快速路径 (tcp-proxy-fastpath.c) 中的会话不经过用户态, 不测量, 退出后同样重新开启。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define LATENCY_RING_SIZE 256
+#define LATENCY_CMSG_SPACE 256
+#define LATENCY_TIMESTAMPING (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | \
+                              SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)
+
+static const char *dir_names[] = { "forward", "peer" };
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+static const char *percentile_names[] = { "p50", "p90", "p99", "p999" };
+
+// 一次 recv 读到的数据 [start, end) 及其接收时间
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int64_t rx_ns;
+} latency_chunk_t;
+
+// 单个方向: 接收侧 socket 记录接收时间, 发送侧 socket 产生发送时间戳
+typedef struct {
+    int rx_enabled;
+    int tx_enabled;
+    uint64_t rx_off;             // 已读入的字节数 (流偏移)
+    uint64_t tx_off;             // 已 send 的字节数
+    uint64_t tx_base;            // 发送时间戳序号 0 对应的流偏移
+    latency_chunk_t ring[LATENCY_RING_SIZE];
+    unsigned int head;
+    unsigned int count;
+} latency_dir_t;
+
+struct proxy_latency {
+    latency_dir_t dirs[2];
+};
+
+// peer socket 接收 peer -> forward 方向的数据, 发送 forward -> peer 方向的数据; forward socket 相反
+static int rx_dir(proxy_ep_type_t type) {
+    return type == PROXY_EP_PEER ? PROXY_DIR_FORWARD : PROXY_DIR_PEER;
+}
+
+static int tx_dir(proxy_ep_type_t type) {
+    return type == PROXY_EP_PEER ? PROXY_DIR_PEER : PROXY_DIR_FORWARD;
+}
+
+static int64_t timespec_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static unsigned int hist_index(uint64_t v) {
+    if (v < PROXY_HIST_SUB_BUCKETS) return v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= PROXY_HIST_MAX_BITS) return PROXY_HIST_BUCKETS - 1;
+    int shift = msb - PROXY_HIST_SUB_BITS;
+    return PROXY_HIST_SUB_BUCKETS + shift * PROXY_HIST_SUB_BUCKETS +
+           (unsigned int)((v >> shift) - PROXY_HIST_SUB_BUCKETS);
+}
+
+// 桶内的最大值
+static uint64_t hist_upper(unsigned int index) {
+    if (index < PROXY_HIST_SUB_BUCKETS) return index;
+    unsigned int shift = (index - PROXY_HIST_SUB_BUCKETS) / PROXY_HIST_SUB_BUCKETS;
+    uint64_t sub = (index - PROXY_HIST_SUB_BUCKETS) % PROXY_HIST_SUB_BUCKETS + PROXY_HIST_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void hist_record(proxy_histogram_t *h, uint64_t v) {
+    if (h->count == 0 || v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+    h->count++;
+    h->sum += v;
+    h->buckets[hist_index(v)]++;
+}
+
+static uint64_t hist_percentile(const proxy_histogram_t *h, double p) {
+    uint64_t rank = (uint64_t)(h->count * p / 100.0 + 0.5);
+    uint64_t seen = 0;
+    if (rank == 0) rank = 1;
+    for (unsigned int i = 0; i < PROXY_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) return hist_upper(i) < h->max ? hist_upper(i) : h->max;
+    }
+    return h->max;
+}
+
+// 在会话的一个 socket 上开启时间戳, 失败时该 socket 不测量
+int proxy_latency_enable(proxy_session_t *s, proxy_endpoint_t *ep) {
+    if (ep->fd < 0) return -1;
+    if (!s->latency) {
+        s->latency = calloc(1, sizeof(proxy_latency_t));
+        if (!s->latency) return -1;
+    }
+
+    // 先关闭再开启, 使接管的 socket 上的发送序号从当前位置重新开始
+    int flags = 0;
+    setsockopt(ep->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    flags = LATENCY_TIMESTAMPING;
+    if (setsockopt(ep->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        proxy_log("WARN", "Session %u: SO_TIMESTAMPING unavailable: %s", s->id, strerror(errno));
+        return -1;
+    }
+
+    latency_dir_t *in = &s->latency->dirs[rx_dir(ep->type)];
+    latency_dir_t *out = &s->latency->dirs[tx_dir(ep->type)];
+    const proxy_buffer_t *out_buf = tx_dir(ep->type) == PROXY_DIR_FORWARD ? &s->to_forward : &s->to_peer;
+    uint64_t out_total = tx_dir(ep->type) == PROXY_DIR_FORWARD ? s->bytes_to_forward : s->bytes_to_peer;
+
+    in->rx_enabled = 1;
+    in->rx_off = rx_dir(ep->type) == PROXY_DIR_FORWARD ? s->bytes_to_forward : s->bytes_to_peer;
+
+    // 序号 0 对应 socket 中第一个未确认的字节
+    int unacked = 0;
+    if (ioctl(ep->fd, SIOCOUTQ, &unacked) < 0) unacked = 0;
+    out->tx_enabled = 1;
+    out->tx_off = out_total - (out_buf->len - out_buf->off);
+    out->tx_base = out->tx_off - unacked;
+    return 0;
+}
+
+// 会话进入内核快速路径: 关闭时间戳并清空状态 (保留分配, 错误队列中剩余的时间戳照常读出丢弃)
+void proxy_latency_suspend(proxy_session_t *s) {
+    if (!s->latency) return;
+    int flags = 0;
+    if (s->peer_ep.fd >= 0) setsockopt(s->peer_ep.fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    if (s->forward_ep.fd >= 0) setsockopt(s->forward_ep.fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    memset(s->latency, 0, sizeof(*s->latency));
+}
+
+void proxy_latency_free(proxy_session_t *s) {
+    free(s->latency);
+    s->latency = NULL;
+}
+
+static void ring_push(latency_dir_t *d, uint64_t start, uint64_t end, int64_t rx_ns) {
+    if (d->count > 0) {
+        latency_chunk_t *last = &d->ring[(d->head + d->count - 1) % LATENCY_RING_SIZE];
+        // 同一个接收时间戳的相邻数据合并
+        if (last->end == start && last->rx_ns == rx_ns) {
+            last->end = end;
+            return;
+        }
+    }
+    if (d->count == LATENCY_RING_SIZE) {
+        d->head = (d->head + 1) % LATENCY_RING_SIZE;
+        d->count--;
+    }
+    latency_chunk_t *c = &d->ring[(d->head + d->count) % LATENCY_RING_SIZE];
+    c->start = start;
+    c->end = end;
+    c->rx_ns = rx_ns;
+    d->count++;
+}
+
+ssize_t proxy_latency_recv(proxy_session_t *s, int dir, int fd, void *buf, size_t len) {
+    latency_dir_t *d = s->latency ? &s->latency->dirs[dir] : NULL;
+    if (!d || !d->rx_enabled) return recv(fd, buf, len, 0);
+
+    char control[LATENCY_CMSG_SPACE];
+    struct iovec iov = { buf, len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n <= 0) return n;
+
+    int64_t rx_ns = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPING) {
+            struct scm_timestamping ts;
+            memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            rx_ns = timespec_ns(&ts.ts[0]);
+        }
+    }
+    // 对应的发送侧没有时间戳时不需要记录
+    if (rx_ns && d->tx_enabled) ring_push(d, d->rx_off, d->rx_off + n, rx_ns);
+    d->rx_off += n;
+    return n;
+}
+
+void proxy_latency_sent(proxy_session_t *s, int dir, size_t len) {
+    if (s->latency) s->latency->dirs[dir].tx_off += len;
+}
+
+// 流偏移为 offset 的字节的接收时间, 并丢弃之前的记录; 找不到返回 0
+static int64_t ring_lookup(latency_dir_t *d, uint64_t offset) {
+    while (d->count > 0) {
+        latency_chunk_t *c = &d->ring[d->head];
+        if (offset < c->start) return 0;
+        if (offset < c->end) return c->rx_ns;
+        d->head = (d->head + 1) % LATENCY_RING_SIZE;
+        d->count--;
+    }
+    return 0;
+}
+
+static void handle_tx_timestamp(proxy_session_t *s, int dir, uint32_t key, int64_t tx_ns) {
+    latency_dir_t *d = &s->latency->dirs[dir];
+    if (!d->tx_enabled || d->tx_off <= d->tx_base) return;
+
+    // 序号只有 32 位, 按已发送的字节数还原
+    uint64_t sent = d->tx_off - d->tx_base;
+    uint64_t rel = (sent & ~0xffffffffULL) | key;
+    if (rel >= sent) {
+        if (rel < 0x100000000ULL) return;
+        rel -= 0x100000000ULL;
+    }
+
+    int64_t rx_ns = ring_lookup(d, d->tx_base + rel);
+    if (rx_ns && tx_ns >= rx_ns && s->peer) hist_record(&s->peer->latency[dir], tx_ns - rx_ns);
+}
+
+// 读取错误队列中的发送时间戳
+void proxy_latency_errqueue(proxy_session_t *s, proxy_endpoint_t *ep) {
+    if (!s->latency || ep->fd < 0) return;
+
+    for (;;) {
+        char control[LATENCY_CMSG_SPACE];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(ep->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+
+        int64_t tx_ns = 0;
+        struct sock_extended_err *serr = NULL;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_TIMESTAMPING) {
+                struct scm_timestamping ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                tx_ns = timespec_ns(&ts.ts[0]);
+            } else if ((c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) ||
+                       (c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR)) {
+                serr = (struct sock_extended_err *)CMSG_DATA(c);
+            }
+        }
+        if (tx_ns && serr && serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && serr->ee_info == SCM_TSTAMP_SND) {
+            handle_tx_timestamp(s, tx_dir(ep->type), serr->ee_data, tx_ns);
+        }
+    }
+}
+
+// 不含外层花括号, LATENCY 命令在其后追加分桶
+static void hist_summary_fields(const proxy_histogram_t *h, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "\"count\":%llu", (unsigned long long)h->count);
+    if (h->count > 0) {
+        proxy_strbuf_printf(sb, ",\"minNs\":%llu,\"meanNs\":%llu,\"maxNs\":%llu", (unsigned long long)h->min,
+                            (unsigned long long)(h->sum / h->count), (unsigned long long)h->max);
+        for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+            proxy_strbuf_printf(sb, ",\"%sNs\":%llu", percentile_names[i],
+                                (unsigned long long)hist_percentile(h, percentiles[i]));
+        }
+    }
+}
+
+// STATS 中每个 peer 的摘要
+void proxy_latency_peer_json(proxy_peer_t *peer, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "{");
+    for (int dir = 0; dir < 2; dir++) {
+        proxy_strbuf_printf(sb, "%s\"%s\":{", dir ? "," : "", dir_names[dir]);
+        hist_summary_fields(&peer->latency[dir], sb);
+        proxy_strbuf_printf(sb, "}");
+    }
+    proxy_strbuf_printf(sb, "}");
+}
+
+// LATENCY 命令: 所有 peer 的完整直方图, buckets 为 [桶内最大值, 计数] 且只列出非空的桶
+void proxy_latency_json(proxy_engine_t *engine, proxy_strbuf_t *sb) {
+    int first = 1;
+
+    proxy_strbuf_printf(sb, "[");
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            proxy_strbuf_printf(sb, "%s{\"listener\":", first ? "" : ",");
+            proxy_strbuf_json_string(sb, l->name);
+            proxy_strbuf_printf(sb, ",\"ip\":");
+            proxy_strbuf_json_string(sb, p->ip);
+            for (int dir = 0; dir < 2; dir++) {
+                const proxy_histogram_t *h = &p->latency[dir];
+                int first_bucket = 1;
+                proxy_strbuf_printf(sb, ",\"%s\":{", dir_names[dir]);
+                hist_summary_fields(h, sb);
+                proxy_strbuf_printf(sb, ",\"buckets\":[");
+                for (unsigned int i = 0; i < PROXY_HIST_BUCKETS; i++) {
+                    if (!h->buckets[i]) continue;
+                    proxy_strbuf_printf(sb, "%s[%llu,%llu]", first_bucket ? "" : ",",
+                                        (unsigned long long)hist_upper(i), (unsigned long long)h->buckets[i]);
+                    first_bucket = 0;
+                }
+                proxy_strbuf_printf(sb, "]}");
+            }
+            proxy_strbuf_printf(sb, "}");
+            first = 0;
+        }
+    }
+    proxy_strbuf_printf(sb, "]");
+}
+
+void proxy_latency_reset(proxy_engine_t *engine) {
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            memset(p->latency, 0, sizeof(p->latency));
+        }
+    }
+}
@@ -0,0 +1,554 @@
+/*
+ * TCP Proxy Engine - 镜像 (fan-out)
+ *
+ * 监听端口可配置多个镜像目标, 每个新会话为每个目标建立一条连接, router -> 转发目标方向的数据
+ * 同时复制给所有镜像目标; 镜像目标发回的数据直接丢弃。
+ *
+ * 数据由会话读入缓冲后, 直接从同一块内存 send 给各个镜像目标, 目标跟得上时不产生额外拷贝;
+ * 只有 socket 发送缓冲写不下的部分才拷贝到该连接自己的积压缓冲。积压按目标策略限制:
+ *   lag   允许落后到 max_lag 字节 (默认 4MB), 超出后断开该镜像连接
+ *   drop  积压超过一个转发缓冲 (64KB) 即断开
+ * 镜像连接的断开、连接失败和积压都不会阻塞 router 或主转发目标, 也不影响其他镜像目标。
+ * 断开的镜像只影响当前会话, 后续新会话仍会尝试连接该目标。
+ *
+ * 新增的镜像目标只作用于之后建立的会话 (中途加入的连接会从消息中间开始, 采集端无法解析)。
+ * 会话结束时仍有积压的镜像连接转为孤儿连接继续发送, 发完或超时后关闭。
+ *
+ * 注: 会话数据需要留在用户态缓冲中 (HANDOFF 交接、统计), 因此没有使用 tee()/splice() 管道。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define PROXY_MIRROR_DEFAULT_LAG (4 * 1024 * 1024)
+#define PROXY_MIRROR_MAX_LAG (256 * 1024 * 1024)
+#define PROXY_MIRROR_INITIAL_BACKLOG 16384
+#define PROXY_MIRROR_MAX_TARGETS 8
+
+typedef struct {
+    char host[256];
+    int32_t port;
+    int32_t policy;
+    uint64_t max_lag;
+    uint64_t sessions;
+    uint64_t bytes_sent;
+    uint64_t drops;
+    uint64_t connect_failures;
+} proxy_handoff_mirror_t;
+
+typedef struct {
+    uint32_t target_index;
+    uint32_t connecting;
+    uint64_t backlog_len;
+    uint64_t bytes_sent;
+} proxy_handoff_leg_t;
+
+static const char *policy_name(proxy_mirror_policy_t policy) {
+    return policy == PROXY_MIRROR_DROP ? "drop" : "lag";
+}
+
+static size_t leg_pending(const proxy_mirror_leg_t *leg) {
+    return leg->len - leg->off;
+}
+
+static size_t leg_limit(const proxy_mirror_leg_t *leg) {
+    return leg->target->policy == PROXY_MIRROR_DROP ? PROXY_BUFFER_SIZE : leg->target->max_lag;
+}
+
+static proxy_mirror_target_t *find_target(proxy_listener_t *listener, const char *host, int port) {
+    for (proxy_mirror_target_t *t = listener->mirrors; t; t = t->next) {
+        if (t->port == port && strcmp(t->host, host) == 0) return t;
+    }
+    return NULL;
+}
+
+// 从会话或孤儿列表中摘下并关闭, 内存在本轮事件处理完后释放
+static void leg_close(proxy_engine_t *engine, proxy_mirror_leg_t *leg, const char *reason) {
+    proxy_mirror_leg_t **pp = leg->session ? &leg->session->mirrors : &engine->orphan_legs;
+    while (*pp && *pp != leg) pp = &(*pp)->next;
+    if (!*pp) return;
+    *pp = leg->next;
+    if (leg->session) leg->session->mirror_count--;
+
+    if (reason) {
+        proxy_log(leg->session ? "WARN" : "INFO", "Mirror %s:%d (session %s): %s, %zu bytes unsent",
+                  leg->target->host, leg->target->port, leg->session ? "active" : "ended", reason, leg_pending(leg));
+    }
+    proxy_endpoint_close(engine, &leg->ep);
+    leg->session = NULL;
+    leg->next = engine->closed_legs;
+    engine->closed_legs = leg;
+}
+
+static void close_target_legs(proxy_engine_t *engine, proxy_mirror_target_t *target, const char *reason) {
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        proxy_mirror_leg_t *leg = s->mirrors;
+        while (leg) {
+            proxy_mirror_leg_t *next = leg->next;
+            if (leg->target == target) leg_close(engine, leg, reason);
+            leg = next;
+        }
+    }
+    proxy_mirror_leg_t *leg = engine->orphan_legs;
+    while (leg) {
+        proxy_mirror_leg_t *next = leg->next;
+        if (leg->target == target) leg_close(engine, leg, reason);
+        leg = next;
+    }
+}
+
+static int leg_update_events(proxy_engine_t *engine, proxy_mirror_leg_t *leg) {
+    uint32_t events = EPOLLIN;
+    if (leg->connecting || leg_pending(leg) > 0) events |= EPOLLOUT;
+    return proxy_endpoint_set_events(engine, &leg->ep, events, 0);
+}
+
+// 追加到积压缓冲, 超出策略限制返回 -1
+static int backlog_append(proxy_mirror_leg_t *leg, const char *data, size_t len) {
+    size_t pending = leg_pending(leg);
+    size_t limit = leg_limit(leg);
+    if (pending + len > limit) return -1;
+
+    if (leg->cap - leg->len < len && leg->off > 0) {
+        memmove(leg->backlog, leg->backlog + leg->off, pending);
+        leg->off = 0;
+        leg->len = pending;
+    }
+    if (leg->cap - leg->len < len) {
+        size_t cap = leg->cap ? leg->cap : PROXY_MIRROR_INITIAL_BACKLOG;
+        while (cap < leg->len + len) cap *= 2;
+        if (cap > limit) cap = limit;
+        char *backlog = realloc(leg->backlog, cap);
+        if (!backlog) return -1;
+        leg->backlog = backlog;
+        leg->cap = cap;
+    }
+    memcpy(leg->backlog + leg->len, data, len);
+    leg->len += len;
+    return 0;
+}
+
+// 发送积压数据, 返回 0 成功 (含 EAGAIN), -1 出错
+static int backlog_flush(proxy_mirror_leg_t *leg) {
+    while (leg_pending(leg) > 0) {
+        ssize_t n = send(leg->ep.fd, leg->backlog + leg->off, leg_pending(leg), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        leg->off += n;
+        leg->bytes_sent += n;
+        leg->target->bytes_sent += n;
+    }
+    leg->off = 0;
+    leg->len = 0;
+    return 0;
+}
+
+static void leg_write(proxy_engine_t *engine, proxy_mirror_leg_t *leg, const char *data, size_t len) {
+    size_t sent = 0;
+
+    // 没有积压时直接从会话缓冲发送
+    if (!leg->connecting && leg_pending(leg) == 0) {
+        while (sent < len) {
+            ssize_t n = send(leg->ep.fd, data + sent, len - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                leg_close(engine, leg, strerror(errno));
+                return;
+            }
+            sent += n;
+        }
+        leg->bytes_sent += sent;
+        leg->target->bytes_sent += sent;
+    }
+
+    if (sent < len) {
+        if (backlog_append(leg, data + sent, len - sent) < 0) {
+            leg->target->drops++;
+            leg_close(engine, leg, "collector too slow, dropped");
+            return;
+        }
+        if (leg_update_events(engine, leg) < 0) {
+            leg_close(engine, leg, "epoll error");
+        }
+    }
+}
+
+int proxy_mirror_add_target(proxy_listener_t *listener, const char *addr, proxy_mirror_policy_t policy, size_t max_lag,
+                            char *err, size_t err_len) {
+    char host[256];
+    int port;
+
+    if (proxy_parse_host_port(addr, host, sizeof(host), &port) < 0) {
+        proxy_set_error(err, err_len, "invalid mirror address %s, use host:port", addr);
+        return -1;
+    }
+    if (max_lag == 0) max_lag = PROXY_MIRROR_DEFAULT_LAG;
+    if (max_lag < PROXY_BUFFER_SIZE || max_lag > PROXY_MIRROR_MAX_LAG) {
+        proxy_set_error(err, err_len, "max lag must be between %d and %d bytes",
+                        PROXY_BUFFER_SIZE, PROXY_MIRROR_MAX_LAG);
+        return -1;
+    }
+
+    proxy_mirror_target_t *target = find_target(listener, host, port);
+    if (!target) {
+        if (listener->mirror_count >= PROXY_MIRROR_MAX_TARGETS) {
+            proxy_set_error(err, err_len, "listener %s already has %d mirror targets",
+                            listener->name, PROXY_MIRROR_MAX_TARGETS);
+            return -1;
+        }
+        target = calloc(1, sizeof(proxy_mirror_target_t));
+        if (!target) {
+            proxy_set_error(err, err_len, "out of memory");
+            return -1;
+        }
+        snprintf(target->host, sizeof(target->host), "%s", host);
+        target->port = port;
+
+        proxy_mirror_target_t **tail = &listener->mirrors;
+        while (*tail) tail = &(*tail)->next;
+        *tail = target;
+        listener->mirror_count++;
+    }
+
+    // 策略变化对已有的镜像连接立即生效, 之后的写入按新限制检查
+    target->policy = policy;
+    target->max_lag = max_lag;
+    proxy_log("INFO", "Listener %s: mirror to %s:%d (policy %s, max lag %zu bytes)",
+              listener->name, host, port, policy_name(policy), max_lag);
+    return 0;
+}
+
+int proxy_mirror_remove_target(proxy_engine_t *engine, proxy_listener_t *listener, const char *addr,
+                               char *err, size_t err_len) {
+    char host[256];
+    int port;
+
+    if (proxy_parse_host_port(addr, host, sizeof(host), &port) < 0) {
+        proxy_set_error(err, err_len, "invalid mirror address %s, use host:port", addr);
+        return -1;
+    }
+
+    proxy_mirror_target_t **pp = &listener->mirrors;
+    while (*pp && !((*pp)->port == port && strcmp((*pp)->host, host) == 0)) pp = &(*pp)->next;
+    if (!*pp) {
+        proxy_set_error(err, err_len, "mirror %s not found on listener %s", addr, listener->name);
+        return -1;
+    }
+
+    proxy_mirror_target_t *target = *pp;
+    close_target_legs(engine, target, "mirror removed");
+    *pp = target->next;
+    listener->mirror_count--;
+    free(target);
+    proxy_log("INFO", "Listener %s: removed mirror %s:%d", listener->name, host, port);
+    return 0;
+}
+
+void proxy_mirror_free_targets(proxy_engine_t *engine, proxy_listener_t *listener) {
+    while (listener->mirrors) {
+        proxy_mirror_target_t *target = listener->mirrors;
+        close_target_legs(engine, target, NULL);
+        listener->mirrors = target->next;
+        free(target);
+    }
+    listener->mirror_count = 0;
+}
+
+static proxy_mirror_leg_t *leg_create(proxy_engine_t *engine, proxy_session_t *s, proxy_mirror_target_t *target,
+                                      int fd, int connecting) {
+    proxy_mirror_leg_t *leg = calloc(1, sizeof(proxy_mirror_leg_t));
+    if (!leg) return NULL;
+
+    leg->ep.type = PROXY_EP_MIRROR;
+    leg->ep.fd = fd;
+    leg->ep.owner = leg;
+    leg->session = s;
+    leg->target = target;
+    leg->connecting = connecting;
+    if (proxy_endpoint_set_events(engine, &leg->ep, EPOLLIN | (connecting ? EPOLLOUT : 0), 1) < 0) {
+        free(leg);
+        return NULL;
+    }
+
+    proxy_mirror_leg_t **tail = &s->mirrors;
+    while (*tail) tail = &(*tail)->next;
+    *tail = leg;
+    s->mirror_count++;
+    return leg;
+}
+
+void proxy_mirror_open_legs(proxy_engine_t *engine, proxy_session_t *s) {
+    for (proxy_mirror_target_t *t = s->listener->mirrors; t; t = t->next) {
+        int connecting = 0;
+        int fd = proxy_connect_target(t->host, t->port, &connecting);
+        if (fd < 0) {
+            t->connect_failures++;
+            continue;
+        }
+        if (!leg_create(engine, s, t, fd, connecting)) {
+            close(fd);
+            continue;
+        }
+        t->sessions++;
+    }
+}
+
+void proxy_mirror_feed(proxy_engine_t *engine, proxy_session_t *s, const char *data, size_t len) {
+    proxy_mirror_leg_t *leg = s->mirrors;
+    while (leg) {
+        proxy_mirror_leg_t *next = leg->next;
+        leg_write(engine, leg, data, len);
+        leg = next;
+    }
+}
+
+void proxy_mirror_handle_event(proxy_engine_t *engine, proxy_mirror_leg_t *leg, uint32_t events) {
+    if (events & EPOLLERR) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(leg->ep.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (leg->connecting) leg->target->connect_failures++;
+        leg_close(engine, leg, err ? strerror(err) : "socket error");
+        return;
+    }
+
+    if (leg->connecting) {
+        if (!(events & (EPOLLOUT | EPOLLHUP))) return;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(leg->ep.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            leg->target->connect_failures++;
+            leg_close(engine, leg, strerror(err ? err : errno));
+            return;
+        }
+        leg->connecting = 0;
+    }
+
+    // 采集端发回的数据丢弃
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        char discard[4096];
+        while (1) {
+            ssize_t n = recv(leg->ep.fd, discard, sizeof(discard), 0);
+            if (n > 0) continue;
+            if (n == 0) {
+                leg_close(engine, leg, "collector closed connection");
+                return;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            leg_close(engine, leg, strerror(errno));
+            return;
+        }
+    }
+
+    if (backlog_flush(leg) < 0) {
+        leg_close(engine, leg, strerror(errno));
+        return;
+    }
+
+    if (!leg->session && leg_pending(leg) == 0) {
+        leg_close(engine, leg, "backlog flushed");
+        return;
+    }
+    if (leg_update_events(engine, leg) < 0) {
+        leg_close(engine, leg, "epoll error");
+    }
+}
+
+void proxy_mirror_detach_session(proxy_engine_t *engine, proxy_session_t *s) {
+    while (s->mirrors) {
+        proxy_mirror_leg_t *leg = s->mirrors;
+        if (leg_pending(leg) == 0) {
+            leg_close(engine, leg, NULL);
+            continue;
+        }
+        s->mirrors = leg->next;
+        s->mirror_count--;
+        leg->session = NULL;
+        leg->detached_at = time(NULL);
+        leg->next = engine->orphan_legs;
+        engine->orphan_legs = leg;
+    }
+}
+
+void proxy_mirror_expire_orphans(proxy_engine_t *engine, int timeout) {
+    time_t now = time(NULL);
+    proxy_mirror_leg_t *leg = engine->orphan_legs;
+    while (leg) {
+        proxy_mirror_leg_t *next = leg->next;
+        if (timeout == 0 || now - leg->detached_at >= timeout) {
+            leg_close(engine, leg, timeout ? "backlog flush timed out" : NULL);
+        }
+        leg = next;
+    }
+}
+
+void proxy_mirror_release(proxy_engine_t *engine) {
+    while (engine->closed_legs) {
+        proxy_mirror_leg_t *leg = engine->closed_legs;
+        engine->closed_legs = leg->next;
+        free(leg->backlog);
+        free(leg);
+    }
+}
+
+void proxy_mirror_targets_json(proxy_engine_t *engine, proxy_listener_t *listener, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "[");
+    for (proxy_mirror_target_t *t = listener->mirrors; t; t = t->next) {
+        int active = 0;
+        size_t lag = 0;
+        for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+            for (proxy_mirror_leg_t *leg = s->mirrors; leg; leg = leg->next) {
+                if (leg->target != t) continue;
+                active++;
+                lag += leg_pending(leg);
+            }
+        }
+        for (proxy_mirror_leg_t *leg = engine->orphan_legs; leg; leg = leg->next) {
+            if (leg->target == t) lag += leg_pending(leg);
+        }
+
+        proxy_strbuf_printf(sb, "%s{\"target\":", t == listener->mirrors ? "" : ",");
+        proxy_strbuf_json_string(sb, t->host);
+        proxy_strbuf_printf(sb, ",\"port\":%d,\"policy\":\"%s\",\"maxLag\":%zu,\"active\":%d,\"lag\":%zu,"
+                            "\"sessions\":%llu,\"bytesSent\":%llu,\"drops\":%llu,\"connectFailures\":%llu}",
+                            t->port, policy_name(t->policy),
+                            t->policy == PROXY_MIRROR_DROP ? (size_t)PROXY_BUFFER_SIZE : t->max_lag, active, lag,
+                            (unsigned long long)t->sessions, (unsigned long long)t->bytes_sent,
+                            (unsigned long long)t->drops, (unsigned long long)t->connect_failures);
+    }
+    proxy_strbuf_printf(sb, "]");
+}
+
+void proxy_mirror_legs_json(proxy_session_t *s, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "[");
+    for (proxy_mirror_leg_t *leg = s->mirrors; leg; leg = leg->next) {
+        proxy_strbuf_printf(sb, "%s{\"target\":", leg == s->mirrors ? "" : ",");
+        proxy_strbuf_json_string(sb, leg->target->host);
+        proxy_strbuf_printf(sb, ",\"port\":%d,\"connecting\":%s,\"lag\":%zu,\"bytesSent\":%llu}",
+                            leg->target->port, leg->connecting ? "true" : "false", leg_pending(leg),
+                            (unsigned long long)leg->bytes_sent);
+    }
+    proxy_strbuf_printf(sb, "]");
+}
+
+int proxy_mirror_handoff_targets(int fd, proxy_listener_t *listener) {
+    for (proxy_mirror_target_t *t = listener->mirrors; t; t = t->next) {
+        proxy_handoff_mirror_t rec;
+        memset(&rec, 0, sizeof(rec));
+        snprintf(rec.host, sizeof(rec.host), "%s", t->host);
+        rec.port = t->port;
+        rec.policy = t->policy;
+        rec.max_lag = t->max_lag;
+        rec.sessions = t->sessions;
+        rec.bytes_sent = t->bytes_sent;
+        rec.drops = t->drops;
+        rec.connect_failures = t->connect_failures;
+        if (proxy_write_all(fd, &rec, sizeof(rec)) < 0) {
+            proxy_log("ERROR", "HANDOFF: failed to send mirror %s:%d: %s", t->host, t->port, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int proxy_mirror_takeover_targets(int fd, proxy_listener_t *listener, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        proxy_handoff_mirror_t rec;
+        if (proxy_read_all(fd, &rec, sizeof(rec)) < 0) {
+            proxy_log("ERROR", "TAKEOVER: invalid mirror record");
+            return -1;
+        }
+        rec.host[sizeof(rec.host) - 1] = '\0';
+
+        proxy_mirror_target_t *target = calloc(1, sizeof(proxy_mirror_target_t));
+        if (!target) return -1;
+        snprintf(target->host, sizeof(target->host), "%s", rec.host);
+        target->port = rec.port;
+        target->policy = rec.policy == PROXY_MIRROR_DROP ? PROXY_MIRROR_DROP : PROXY_MIRROR_LAG;
+        target->max_lag = rec.max_lag;
+        target->sessions = rec.sessions;
+        target->bytes_sent = rec.bytes_sent;
+        target->drops = rec.drops;
+        target->connect_failures = rec.connect_failures;
+
+        proxy_mirror_target_t **tail = &listener->mirrors;
+        while (*tail) tail = &(*tail)->next;
+        *tail = target;
+        listener->mirror_count++;
+    }
+    return 0;
+}
+
+// 会话的镜像连接随会话一起交接 (SCM_RIGHTS 携带 socket), 孤儿连接不交接
+int proxy_mirror_handoff_legs(int fd, proxy_session_t *s) {
+    for (proxy_mirror_leg_t *leg = s->mirrors; leg; leg = leg->next) {
+        proxy_handoff_leg_t rec;
+        uint32_t index = 0;
+        for (proxy_mirror_target_t *t = s->listener->mirrors; t && t != leg->target; t = t->next) index++;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.target_index = index;
+        rec.connecting = leg->connecting;
+        rec.backlog_len = leg_pending(leg);
+        rec.bytes_sent = leg->bytes_sent;
+        if (proxy_send_with_fds(fd, &rec, sizeof(rec), &leg->ep.fd, 1) < 0 ||
+            proxy_write_all(fd, leg->backlog + leg->off, rec.backlog_len) < 0) {
+            proxy_log("ERROR", "HANDOFF: failed to send mirror of session %u: %s", s->id, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int proxy_mirror_takeover_legs(proxy_engine_t *engine, int fd, proxy_session_t *s, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        proxy_handoff_leg_t rec;
+        int fds[PROXY_HANDOFF_MAX_FDS];
+        int nfds = 0;
+
+        if (proxy_recv_with_fds(fd, &rec, sizeof(rec), fds, 1, &nfds) < 0 || nfds != 1 ||
+            rec.target_index >= (uint32_t)s->listener->mirror_count || rec.backlog_len > PROXY_MIRROR_MAX_LAG) {
+            for (int j = 0; j < nfds; j++) close(fds[j]);
+            proxy_log("ERROR", "TAKEOVER: invalid mirror leg record");
+            return -1;
+        }
+
+        proxy_mirror_target_t *target = s->listener->mirrors;
+        for (uint32_t j = 0; j < rec.target_index; j++) target = target->next;
+
+        proxy_mirror_leg_t *leg = leg_create(engine, s, target, fds[0], rec.connecting);
+        if (!leg) {
+            close(fds[0]);
+            return -1;
+        }
+        leg->bytes_sent = rec.bytes_sent;
+        if (rec.backlog_len > 0) {
+            leg->backlog = malloc(rec.backlog_len);
+            if (!leg->backlog || proxy_read_all(fd, leg->backlog, rec.backlog_len) < 0) {
+                proxy_log("ERROR", "TAKEOVER: failed to receive mirror backlog");
+                return -1;
+            }
+            leg->cap = rec.backlog_len;
+            leg->len = rec.backlog_len;
+        }
+        proxy_set_nonblocking(leg->ep.fd);
+        leg_update_events(engine, leg);
+    }
+    return 0;
+}
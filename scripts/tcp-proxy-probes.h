@@ -0,0 +1,48 @@
+/*
+ * TCP Proxy Engine - USDT 静态探针
+ *
+ * 编译环境有 <sys/sdt.h> (systemtap-sdt-devel / systemtap-sdt-dev) 时, 探针编译为一条 nop 指令加上
+ * .note.stapsdt 段中的描述, 不挂载时几乎没有开销; 没有该头文件或定义了 PROXY_NO_PROBES 时为空宏。
+ * 可用 bpftrace / perf 直接挂载, 无需重新编译, 见 tcp-proxy-trace-*.bt:
+ *     bpftrace -l 'usdt:/opt/tcp-md5-proxy/tcp-md5-helper:tcp_proxy:*'
+ *
+ * provider 为 tcp_proxy, 字符串参数为 char *, dir 为 PROXY_DIR_FORWARD (0) / PROXY_DIR_PEER (1):
+ *   accept(session_id, listener, peer_ip, peer_port)                 新会话
+ *   reject(listener, peer_ip)                                        来源地址不在 peer 列表中
+ *   auth_failure(listener, peer_ip, peer_port, errno)                accept 失败, 通常是认证不匹配
+ *   forward_connect(session_id, host, port, error)                   转发连接建立 (error 为 0) 或失败
+ *   recv(session_id, dir, bytes, buffered)                           读入一段数据, buffered 为缓冲中待发送的字节数
+ *   send(session_id, dir, bytes, remaining)                          发出一段数据, remaining 为缓冲中剩余的字节数
+ *   buffer_full(session_id, dir, buffered)                           缓冲已满, 暂停读取 (反压到发送方)
+ *   send_blocked(session_id, dir, remaining)                         socket 发送缓冲已满 (EAGAIN)
+ *   throttled(session_id, dir, remaining)                            限速配额用尽 (见 tcp-proxy-sched.c)
+ *   session_close(session_id, reason, bytes_to_forward, bytes_to_peer, duration_s)
+ *   key_add(listen_fd, peer_ip, key_id)                              安装密钥, MD5 的 key_id 为 -1
+ *   key_del(listen_fd, peer_ip, key_id)
+ *   key_rotate(fd, peer_ip, added, removed)                          按时间轮换或更新密钥 (监听 socket 或已建立的会话)
+ *   key_switch(fd, peer_ip, current_key, rnext_key)                  TCP-AO 会话切换 current/RNext
+ */
+
+#ifndef TCP_PROXY_PROBES_H
+#define TCP_PROXY_PROBES_H
+
+#if !defined(PROXY_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROXY_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef PROXY_HAVE_PROBES
+#define PROXY_PROBE2(name, a1, a2) DTRACE_PROBE2(tcp_proxy, name, a1, a2)
+#define PROXY_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(tcp_proxy, name, a1, a2, a3)
+#define PROXY_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(tcp_proxy, name, a1, a2, a3, a4)
+#define PROXY_PROBE5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(tcp_proxy, name, a1, a2, a3, a4, a5)
+#else
+#define PROXY_PROBE2(name, a1, a2) do { } while (0)
+#define PROXY_PROBE3(name, a1, a2, a3) do { } while (0)
+#define PROXY_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+#define PROXY_PROBE5(name, a1, a2, a3, a4, a5) do { } while (0)
+#endif
+
+#endif
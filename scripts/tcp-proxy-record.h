@@ -0,0 +1,53 @@
+/*
+ * TCP Proxy 录制文件格式
+ *
+ * tcp-proxy-recorder.c 写入, tcp-proxy-replay.c 读取。每个文件以文件头开始, 之后是连续的记录:
+ *   记录头 (proxy_record_chunk_t) + len 字节负载
+ * 记录按写入顺序 (即时间顺序) 排列, 同一监听端口的多个会话交错出现, 以 session_id 区分。
+ * 文件按大小或时间轮转, 文件名为 <listener>-<YYYYmmdd-HHMMSS>-<pid>-<seq>.pxr, 按文件名排序即时间顺序。
+ * 所有整数为本机字节序 (录制和回放在同一台主机上)。
+ */
+
+#ifndef TCP_PROXY_RECORD_H
+#define TCP_PROXY_RECORD_H
+
+#include <stdint.h>
+
+#define PROXY_RECORD_MAGIC 0x43525850   /* "PXRC" */
+#define PROXY_RECORD_VERSION 1
+#define PROXY_RECORD_SUFFIX ".pxr"
+
+typedef enum {
+    PROXY_RECORD_OPEN = 1,       // 会话开始, 负载为 proxy_record_open_t
+    PROXY_RECORD_CLOSE = 2,      // 会话结束, 无负载
+    PROXY_RECORD_PEER = 3,       // router -> 转发目标 的数据
+    PROXY_RECORD_FORWARD = 4,    // 转发目标 -> router 的数据
+    PROXY_RECORD_GAP = 5         // 录制队列溢出丢弃的数据, len 为丢弃的字节数, 无负载
+} proxy_record_type_t;
+
+// OPEN 记录的 flags: 会话在录制开始前 (或热升级前) 已建立, 之前的数据不在录制中
+#define PROXY_RECORD_FLAG_MIDSTREAM 0x0001
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t created_ns;          // CLOCK_REALTIME
+    char listener[32];
+} proxy_record_file_header_t;
+
+typedef struct {
+    int64_t ts_ns;               // CLOCK_REALTIME, 数据从 socket 读出的时间
+    uint32_t session_id;
+    uint16_t type;
+    uint16_t flags;
+    uint32_t len;
+    uint32_t reserved;
+} proxy_record_chunk_t;
+
+typedef struct {
+    char peer_ip[46];
+    uint16_t reserved;
+    int32_t peer_port;
+} proxy_record_open_t;
+
+#endif
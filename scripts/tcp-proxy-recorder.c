@@ -0,0 +1,426 @@
+/*
+ * TCP Proxy Engine - 流录制
+ *
+ * 把监听端口上所有会话两个方向的原始字节流连同时间戳写入按大小/时间轮转的文件
+ * (格式见 tcp-proxy-record.h, 用 tcp-proxy-replay 查看或回放)。
+ *
+ * 转发线程只把记录拷贝到内存块队列中 (加锁 memcpy), 由每个录制器自己的写线程批量写盘,
+ * 磁盘慢或卡住时不会阻塞转发。队列超过上限时丢弃数据并在文件中写入 GAP 记录, 回放时可知数据不完整。
+ * 文件在第一次有数据时才创建; 超过 max_file_bytes 或打开超过 max_file_seconds 后关闭,
+ * 之后的数据写入新文件。max_files 大于 0 时只保留最新的若干个文件。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+#include "tcp-proxy-record.h"
+
+#define PROXY_RECORD_BLOCK_SIZE (256 * 1024)
+#define PROXY_RECORD_MAX_BLOCKS 64
+#define PROXY_RECORD_DEFAULT_FILE_MB 64
+#define PROXY_RECORD_DEFAULT_FILE_SECONDS 3600
+
+typedef struct proxy_record_block proxy_record_block_t;
+struct proxy_record_block {
+    proxy_record_block_t *next;
+    size_t len;
+    char data[PROXY_RECORD_BLOCK_SIZE];
+};
+
+typedef struct {
+    char dir[256];
+    uint64_t max_file_bytes;
+    int32_t max_file_seconds;
+    int32_t max_files;
+} proxy_handoff_recorder_t;
+
+struct proxy_recorder {
+    char listener[PROXY_NAME_MAX];
+    char dir[256];
+    uint64_t max_file_bytes;
+    int max_file_seconds;
+    int max_files;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // 以下字段受 lock 保护
+    proxy_record_block_t *head;
+    proxy_record_block_t *tail;
+    int block_count;
+    int stop;
+    uint64_t pending_gap;        // 已丢弃但尚未写入 GAP 记录的字节数
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t dropped_bytes;
+    uint64_t files;
+    uint64_t write_errors;
+    char current_file[PATH_MAX];
+
+    // 以下字段只由写线程访问
+    int fd;
+    uint64_t file_bytes;
+    time_t file_opened;
+    unsigned int seq;
+};
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int name_compare(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// 删除最旧的录制文件, 只保留 max_files 个
+static void recorder_prune(proxy_recorder_t *rec) {
+    DIR *dir = opendir(rec->dir);
+    if (!dir) return;
+
+    char prefix[PROXY_NAME_MAX + 1];
+    snprintf(prefix, sizeof(prefix), "%s-", rec->listener);
+    size_t suffix_len = strlen(PROXY_RECORD_SUFFIX);
+    char **names = NULL;
+    size_t count = 0, cap = 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0 || len <= suffix_len ||
+            strcmp(entry->d_name + len - suffix_len, PROXY_RECORD_SUFFIX) != 0) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(names, cap * sizeof(char *));
+            if (!grown) break;
+            names = grown;
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count]) count++;
+    }
+    closedir(dir);
+
+    qsort(names, count, sizeof(char *), name_compare);
+    for (size_t i = 0; i + rec->max_files < count; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", rec->dir, names[i]);
+        if (unlink(path) == 0) {
+            proxy_log("INFO", "Recorder %s: removed old recording %s", rec->listener, path);
+        }
+    }
+    for (size_t i = 0; i < count; i++) free(names[i]);
+    free(names);
+}
+
+static void recorder_close_file(proxy_recorder_t *rec) {
+    if (rec->fd < 0) return;
+    close(rec->fd);
+    rec->fd = -1;
+    if (rec->max_files > 0) recorder_prune(rec);
+}
+
+static int recorder_open_file(proxy_recorder_t *rec) {
+    char path[PATH_MAX];
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm_info;
+
+    localtime_r(&now, &tm_info);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm_info);
+    snprintf(path, sizeof(path), "%s/%s-%s-%d-%u%s", rec->dir, rec->listener, stamp, (int)getpid(),
+             rec->seq++, PROXY_RECORD_SUFFIX);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        proxy_log("ERROR", "Recorder %s: cannot create %s: %s", rec->listener, path, strerror(errno));
+        return -1;
+    }
+
+    proxy_record_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PROXY_RECORD_MAGIC;
+    header.version = PROXY_RECORD_VERSION;
+    header.created_ns = now_ns();
+    snprintf(header.listener, sizeof(header.listener), "%s", rec->listener);
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        proxy_log("ERROR", "Recorder %s: cannot write %s: %s", rec->listener, path, strerror(errno));
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    rec->fd = fd;
+    rec->file_bytes = sizeof(header);
+    rec->file_opened = now;
+    pthread_mutex_lock(&rec->lock);
+    rec->files++;
+    snprintf(rec->current_file, sizeof(rec->current_file), "%s", path);
+    pthread_mutex_unlock(&rec->lock);
+    return 0;
+}
+
+static void recorder_write_block(proxy_recorder_t *rec, const proxy_record_block_t *block) {
+    if (rec->fd < 0 && recorder_open_file(rec) < 0) {
+        pthread_mutex_lock(&rec->lock);
+        rec->write_errors++;
+        pthread_mutex_unlock(&rec->lock);
+        return;
+    }
+
+    const char *p = block->data;
+    size_t len = block->len;
+    while (len > 0) {
+        ssize_t n = write(rec->fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            proxy_log("ERROR", "Recorder %s: write failed: %s", rec->listener, strerror(errno));
+            pthread_mutex_lock(&rec->lock);
+            rec->write_errors++;
+            pthread_mutex_unlock(&rec->lock);
+            // 当前文件到此结束 (末尾可能有不完整的记录, 回放时忽略), 下一块写入新文件
+            recorder_close_file(rec);
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+
+    rec->file_bytes += block->len;
+    if (rec->file_bytes >= rec->max_file_bytes) recorder_close_file(rec);
+}
+
+static void *recorder_thread(void *arg) {
+    proxy_recorder_t *rec = arg;
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+
+        // 有写满的块时立即写, 否则最多等待 1 秒
+        pthread_mutex_lock(&rec->lock);
+        while (!rec->stop && !(rec->head && rec->head != rec->tail)) {
+            if (pthread_cond_timedwait(&rec->cond, &rec->lock, &deadline) == ETIMEDOUT) break;
+        }
+        // 整个队列 (包括正在填充的块) 一次取走批量写入
+        proxy_record_block_t *blocks = rec->head;
+        int stop = rec->stop;
+        rec->head = NULL;
+        rec->tail = NULL;
+        rec->block_count = 0;
+        pthread_mutex_unlock(&rec->lock);
+
+        while (blocks) {
+            proxy_record_block_t *next = blocks->next;
+            recorder_write_block(rec, blocks);
+            free(blocks);
+            blocks = next;
+        }
+
+        if (rec->fd >= 0 && time(NULL) - rec->file_opened >= rec->max_file_seconds) {
+            recorder_close_file(rec);
+        }
+        if (stop) break;
+    }
+
+    recorder_close_file(rec);
+    return NULL;
+}
+
+// 把一条记录追加到队列, 调用者持有 lock; 队列已满返回 -1
+static int recorder_enqueue_locked(proxy_recorder_t *rec, uint16_t type, uint32_t session_id, uint16_t flags,
+                                   const void *payload, uint32_t payload_len, uint32_t len, int64_t ts) {
+    size_t need = sizeof(proxy_record_chunk_t) + payload_len;
+
+    if (!rec->tail || rec->tail->len + need > PROXY_RECORD_BLOCK_SIZE) {
+        if (rec->block_count >= PROXY_RECORD_MAX_BLOCKS) return -1;
+        proxy_record_block_t *block = malloc(sizeof(proxy_record_block_t));
+        if (!block) return -1;
+        block->next = NULL;
+        block->len = 0;
+        if (rec->tail) {
+            rec->tail->next = block;
+            // 前一块已写满, 唤醒写线程
+            pthread_cond_signal(&rec->cond);
+        } else {
+            rec->head = block;
+        }
+        rec->tail = block;
+        rec->block_count++;
+    }
+
+    proxy_record_chunk_t chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.ts_ns = ts;
+    chunk.session_id = session_id;
+    chunk.type = type;
+    chunk.flags = flags;
+    chunk.len = len;
+    memcpy(rec->tail->data + rec->tail->len, &chunk, sizeof(chunk));
+    if (payload_len > 0) memcpy(rec->tail->data + rec->tail->len + sizeof(chunk), payload, payload_len);
+    rec->tail->len += need;
+    return 0;
+}
+
+static void recorder_append(proxy_recorder_t *rec, uint16_t type, uint32_t session_id, uint16_t flags,
+                            const void *payload, uint32_t len) {
+    int64_t ts = now_ns();
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->pending_gap > 0 &&
+        recorder_enqueue_locked(rec, PROXY_RECORD_GAP, 0, 0, NULL, 0,
+                                rec->pending_gap > UINT32_MAX ? UINT32_MAX : (uint32_t)rec->pending_gap, ts) == 0) {
+        rec->pending_gap -= rec->pending_gap > UINT32_MAX ? UINT32_MAX : rec->pending_gap;
+    }
+    if (rec->pending_gap > 0 || recorder_enqueue_locked(rec, type, session_id, flags, payload, len, len, ts) < 0) {
+        rec->dropped_bytes += len;
+        rec->pending_gap += len;
+    } else {
+        rec->chunks++;
+        rec->bytes += len;
+    }
+    pthread_mutex_unlock(&rec->lock);
+}
+
+proxy_recorder_t *proxy_recorder_start(const char *listener, const char *dir, uint64_t max_file_mb,
+                                       int max_file_seconds, int max_files, char *err, size_t err_len) {
+    if (dir[0] != '/' || strlen(dir) >= sizeof(((proxy_recorder_t *)0)->dir)) {
+        proxy_set_error(err, err_len, "recording directory must be an absolute path");
+        return NULL;
+    }
+    if (mkdir(dir, 0750) < 0 && errno != EEXIST) {
+        proxy_set_error(err, err_len, "cannot create %s: %s", dir, strerror(errno));
+        return NULL;
+    }
+    if (access(dir, W_OK) < 0) {
+        proxy_set_error(err, err_len, "%s is not writable: %s", dir, strerror(errno));
+        return NULL;
+    }
+
+    proxy_recorder_t *rec = calloc(1, sizeof(proxy_recorder_t));
+    if (!rec) {
+        proxy_set_error(err, err_len, "out of memory");
+        return NULL;
+    }
+    snprintf(rec->listener, sizeof(rec->listener), "%s", listener);
+    snprintf(rec->dir, sizeof(rec->dir), "%s", dir);
+    rec->max_file_bytes = (max_file_mb ? max_file_mb : PROXY_RECORD_DEFAULT_FILE_MB) * 1024 * 1024;
+    rec->max_file_seconds = max_file_seconds > 0 ? max_file_seconds : PROXY_RECORD_DEFAULT_FILE_SECONDS;
+    rec->max_files = max_files > 0 ? max_files : 0;
+    rec->fd = -1;
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->cond, NULL);
+
+    if (pthread_create(&rec->thread, NULL, recorder_thread, rec) != 0) {
+        proxy_set_error(err, err_len, "failed to start writer thread");
+        pthread_mutex_destroy(&rec->lock);
+        pthread_cond_destroy(&rec->cond);
+        free(rec);
+        return NULL;
+    }
+
+    proxy_log("INFO", "Recorder %s: recording to %s (rotate at %llu MB / %d s, keep %d files)", listener, dir,
+              (unsigned long long)(rec->max_file_bytes / 1024 / 1024), rec->max_file_seconds, rec->max_files);
+    return rec;
+}
+
+// 写出队列中剩余的数据后结束写线程
+void proxy_recorder_stop(proxy_recorder_t *rec) {
+    if (!rec) return;
+    pthread_mutex_lock(&rec->lock);
+    rec->stop = 1;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    proxy_log("INFO", "Recorder %s: stopped, %llu chunks, %llu bytes, %llu bytes dropped", rec->listener,
+              (unsigned long long)rec->chunks, (unsigned long long)rec->bytes,
+              (unsigned long long)rec->dropped_bytes);
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->cond);
+    free(rec);
+}
+
+void proxy_recorder_open(proxy_recorder_t *rec, proxy_session_t *s, int midstream) {
+    proxy_record_open_t open_rec;
+    memset(&open_rec, 0, sizeof(open_rec));
+    snprintf(open_rec.peer_ip, sizeof(open_rec.peer_ip), "%s", s->peer_ip);
+    open_rec.peer_port = s->peer_port;
+    recorder_append(rec, PROXY_RECORD_OPEN, s->id, midstream ? PROXY_RECORD_FLAG_MIDSTREAM : 0,
+                    &open_rec, sizeof(open_rec));
+}
+
+void proxy_recorder_close(proxy_recorder_t *rec, proxy_session_t *s) {
+    recorder_append(rec, PROXY_RECORD_CLOSE, s->id, 0, NULL, 0);
+}
+
+void proxy_recorder_data(proxy_recorder_t *rec, proxy_session_t *s, int from_peer, const char *data, size_t len) {
+    recorder_append(rec, from_peer ? PROXY_RECORD_PEER : PROXY_RECORD_FORWARD, s->id, 0, data, len);
+}
+
+void proxy_recorder_json(proxy_recorder_t *rec, proxy_strbuf_t *sb) {
+    if (!rec) {
+        proxy_strbuf_printf(sb, "null");
+        return;
+    }
+    pthread_mutex_lock(&rec->lock);
+    proxy_strbuf_printf(sb, "{\"dir\":");
+    proxy_strbuf_json_string(sb, rec->dir);
+    proxy_strbuf_printf(sb, ",\"file\":");
+    proxy_strbuf_json_string(sb, rec->current_file);
+    proxy_strbuf_printf(sb, ",\"maxFileBytes\":%llu,\"maxFileSeconds\":%d,\"maxFiles\":%d,\"chunks\":%llu,"
+                        "\"bytes\":%llu,\"droppedBytes\":%llu,\"queuedBlocks\":%d,\"files\":%llu,\"writeErrors\":%llu}",
+                        (unsigned long long)rec->max_file_bytes, rec->max_file_seconds, rec->max_files,
+                        (unsigned long long)rec->chunks, (unsigned long long)rec->bytes,
+                        (unsigned long long)rec->dropped_bytes, rec->block_count, (unsigned long long)rec->files,
+                        (unsigned long long)rec->write_errors);
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// 只交接配置, 新进程写入新的文件
+int proxy_recorder_handoff(int fd, proxy_recorder_t *rec) {
+    proxy_handoff_recorder_t rec_cfg;
+    memset(&rec_cfg, 0, sizeof(rec_cfg));
+    snprintf(rec_cfg.dir, sizeof(rec_cfg.dir), "%s", rec->dir);
+    rec_cfg.max_file_bytes = rec->max_file_bytes;
+    rec_cfg.max_file_seconds = rec->max_file_seconds;
+    rec_cfg.max_files = rec->max_files;
+    if (proxy_write_all(fd, &rec_cfg, sizeof(rec_cfg)) < 0) {
+        proxy_log("ERROR", "HANDOFF: failed to send recorder of %s: %s", rec->listener, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int proxy_recorder_takeover(int fd, const char *listener, proxy_recorder_t **out) {
+    proxy_handoff_recorder_t rec_cfg;
+    char err[PROXY_ERROR_MAX];
+
+    *out = NULL;
+    if (proxy_read_all(fd, &rec_cfg, sizeof(rec_cfg)) < 0) {
+        proxy_log("ERROR", "TAKEOVER: invalid recorder record");
+        return -1;
+    }
+    rec_cfg.dir[sizeof(rec_cfg.dir) - 1] = '\0';
+
+    *out = proxy_recorder_start(listener, rec_cfg.dir, rec_cfg.max_file_bytes / 1024 / 1024,
+                                rec_cfg.max_file_seconds, rec_cfg.max_files, err, sizeof(err));
+    if (!*out) proxy_log("ERROR", "TAKEOVER: cannot resume recording of %s: %s", listener, err);
+    return 0;
+}
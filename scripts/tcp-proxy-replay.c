@@ -0,0 +1,387 @@
+/*
+ * TCP Proxy Replay - 读取 tcp-proxy-recorder 生成的录制文件 (格式见 tcp-proxy-record.h)
+ *
+ * 编译: gcc -O2 -o tcp-proxy-replay tcp-proxy-replay.c
+ *
+ * 用法:
+ *   tcp-proxy-replay --list <file.pxr>...
+ *       列出会话: id、peer、开始/结束时间、两个方向的字节数和丢失的数据
+ *   tcp-proxy-replay --dump --session <id> [--direction peer|forward] <file.pxr>...
+ *       把一个会话某个方向的原始字节流写到 stdout (默认 peer, 即 router 发出的数据)
+ *   tcp-proxy-replay --target <host:port> [--session <id>] [--speed <x>] <file.pxr>...
+ *       按录制时的时间间隔把 router 发出的数据重新发给 host:port, 每个会话一条连接;
+ *       --speed 2 为两倍速, --speed 0 为不等待。目标发回的数据丢弃
+ *
+ * 多个文件按命令行顺序读取 (按文件名排序即时间顺序, 可直接使用 shell 通配符)。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "tcp-proxy-record.h"
+
+#define REPLAY_MAX_CHUNK (16 * 1024 * 1024)
+
+typedef enum {
+    MODE_NONE,
+    MODE_LIST,
+    MODE_DUMP,
+    MODE_REPLAY
+} replay_mode_t;
+
+typedef struct replay_session replay_session_t;
+struct replay_session {
+    replay_session_t *next;
+    uint32_t id;
+    char peer_ip[46];
+    int peer_port;
+    int midstream;
+    int closed;
+    int64_t first_ns;
+    int64_t last_ns;
+    uint64_t bytes_peer;
+    uint64_t bytes_forward;
+    int fd;                      // 回放连接
+};
+
+typedef struct {
+    replay_mode_t mode;
+    int session_filter;          // -1 表示全部
+    uint32_t session_id;
+    uint16_t direction;
+    char target_host[256];
+    char target_port[16];
+    double speed;
+
+    replay_session_t *sessions;
+    uint64_t gap_bytes;
+    int truncated;
+    int64_t replay_start_ns;     // 第一条记录的时间
+    struct timespec wall_start;
+} replay_t;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s --list <file.pxr>...\n"
+            "  %s --dump --session <id> [--direction peer|forward] <file.pxr>...\n"
+            "  %s --target <host:port> [--session <id>] [--speed <x>] <file.pxr>...\n",
+            prog, prog, prog);
+}
+
+static replay_session_t *find_session(replay_t *r, uint32_t id, int create) {
+    replay_session_t **pp = &r->sessions;
+    for (; *pp; pp = &(*pp)->next) {
+        if ((*pp)->id == id) return *pp;
+    }
+    if (!create) return NULL;
+
+    replay_session_t *s = calloc(1, sizeof(replay_session_t));
+    if (!s) {
+        perror("calloc");
+        exit(1);
+    }
+    s->id = id;
+    s->fd = -1;
+    // 文件从会话中间开始时没有 OPEN 记录
+    s->midstream = 1;
+    snprintf(s->peer_ip, sizeof(s->peer_ip), "?");
+    *pp = s;
+    return s;
+}
+
+static void format_time(int64_t ns, char *buf, size_t len) {
+    time_t sec = ns / 1000000000LL;
+    struct tm tm_info;
+    localtime_r(&sec, &tm_info);
+    size_t n = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm_info);
+    snprintf(buf + n, len - n, ".%03d", (int)((ns / 1000000) % 1000));
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int connect_target(replay_t *r) {
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int rc = getaddrinfo(r->target_host, r->target_port, &hints, &res);
+    if (rc != 0 || !res) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", r->target_host, gai_strerror(rc));
+        return -1;
+    }
+    int fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) fprintf(stderr, "Cannot connect to %s:%s: %s\n", r->target_host, r->target_port, strerror(errno));
+    freeaddrinfo(res);
+    return fd;
+}
+
+// 丢弃目标发回的数据, 避免对端因接收窗口满而停住
+static void drain_target(int fd) {
+    char buf[4096];
+    while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
+
+// 按录制时的间隔等待 (除以速度)
+static void pace(replay_t *r, int64_t ts_ns) {
+    if (r->speed <= 0) return;
+    if (r->replay_start_ns == 0) {
+        r->replay_start_ns = ts_ns;
+        clock_gettime(CLOCK_MONOTONIC, &r->wall_start);
+        return;
+    }
+
+    double offset = (double)(ts_ns - r->replay_start_ns) / r->speed;
+    if (offset <= 0) return;
+    struct timespec due = r->wall_start;
+    due.tv_sec += (time_t)(offset / 1e9);
+    due.tv_nsec += (long)((int64_t)offset % 1000000000LL);
+    if (due.tv_nsec >= 1000000000L) {
+        due.tv_sec++;
+        due.tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+    }
+}
+
+static int handle_record(replay_t *r, const proxy_record_chunk_t *chunk, const char *payload) {
+    if (chunk->type == PROXY_RECORD_GAP) {
+        r->gap_bytes += chunk->len;
+        if (r->mode != MODE_LIST) {
+            fprintf(stderr, "Warning: %u bytes were not recorded (recorder queue overflow)\n", chunk->len);
+        }
+        return 0;
+    }
+
+    if (r->session_filter >= 0 && chunk->session_id != r->session_id) return 0;
+    replay_session_t *s = find_session(r, chunk->session_id, 1);
+    if (!s->first_ns) s->first_ns = chunk->ts_ns;
+    s->last_ns = chunk->ts_ns;
+
+    switch (chunk->type) {
+        case PROXY_RECORD_OPEN: {
+            proxy_record_open_t open_rec;
+            if (chunk->len >= sizeof(open_rec)) {
+                memcpy(&open_rec, payload, sizeof(open_rec));
+                open_rec.peer_ip[sizeof(open_rec.peer_ip) - 1] = '\0';
+                snprintf(s->peer_ip, sizeof(s->peer_ip), "%s", open_rec.peer_ip);
+                s->peer_port = open_rec.peer_port;
+            }
+            // 同一会话在后续文件 (如热升级后) 中再次出现 OPEN 时保留最初的状态
+            if (s->first_ns == chunk->ts_ns) s->midstream = (chunk->flags & PROXY_RECORD_FLAG_MIDSTREAM) != 0;
+            break;
+        }
+        case PROXY_RECORD_CLOSE:
+            s->closed = 1;
+            if (r->mode == MODE_REPLAY && s->fd >= 0) {
+                pace(r, chunk->ts_ns);
+                close(s->fd);
+                s->fd = -1;
+            }
+            break;
+        case PROXY_RECORD_PEER:
+        case PROXY_RECORD_FORWARD:
+            if (chunk->type == PROXY_RECORD_PEER) {
+                s->bytes_peer += chunk->len;
+            } else {
+                s->bytes_forward += chunk->len;
+            }
+            if (r->mode == MODE_DUMP && chunk->type == r->direction) {
+                if (write_all(STDOUT_FILENO, payload, chunk->len) < 0) return -1;
+            } else if (r->mode == MODE_REPLAY && chunk->type == PROXY_RECORD_PEER && !s->closed) {
+                pace(r, chunk->ts_ns);
+                if (s->fd < 0) {
+                    s->fd = connect_target(r);
+                    if (s->fd < 0) return -1;
+                    fprintf(stderr, "Session %u (%s:%d): replaying to %s:%s%s\n", s->id, s->peer_ip, s->peer_port,
+                            r->target_host, r->target_port, s->midstream ? " (recording starts mid-stream)" : "");
+                }
+                drain_target(s->fd);
+                if (write_all(s->fd, payload, chunk->len) < 0) {
+                    fprintf(stderr, "Session %u: send failed: %s\n", s->id, strerror(errno));
+                    return -1;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static int read_file(replay_t *r, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    proxy_record_file_header_t header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != PROXY_RECORD_MAGIC ||
+        header.version != PROXY_RECORD_VERSION) {
+        fprintf(stderr, "%s is not a proxy recording\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    char *payload = NULL;
+    size_t cap = 0;
+    int rc = 0;
+    proxy_record_chunk_t chunk;
+    while (fread(&chunk, sizeof(chunk), 1, fp) == 1) {
+        if (chunk.type != PROXY_RECORD_GAP && chunk.len > 0) {
+            if (chunk.len > REPLAY_MAX_CHUNK) {
+                fprintf(stderr, "%s: corrupt record, stopping\n", path);
+                r->truncated = 1;
+                break;
+            }
+            if (chunk.len > cap) {
+                char *grown = realloc(payload, chunk.len);
+                if (!grown) {
+                    rc = -1;
+                    break;
+                }
+                payload = grown;
+                cap = chunk.len;
+            }
+            // 写入中断的文件末尾可能只有半条记录
+            if (fread(payload, chunk.len, 1, fp) != 1) {
+                r->truncated = 1;
+                break;
+            }
+        }
+        if (handle_record(r, &chunk, payload) < 0) {
+            rc = -1;
+            break;
+        }
+    }
+
+    free(payload);
+    fclose(fp);
+    return rc;
+}
+
+static void print_sessions(replay_t *r) {
+    printf("%-8s %-40s %-23s %-23s %12s %12s %s\n", "SESSION", "PEER", "FIRST", "LAST", "PEER_BYTES",
+           "FWD_BYTES", "STATE");
+    for (replay_session_t *s = r->sessions; s; s = s->next) {
+        char peer[64], first[32], last[32];
+        snprintf(peer, sizeof(peer), "%s:%d", s->peer_ip, s->peer_port);
+        format_time(s->first_ns, first, sizeof(first));
+        format_time(s->last_ns, last, sizeof(last));
+        printf("%-8u %-40s %-23s %-23s %12llu %12llu %s%s\n", s->id, peer, first, last,
+               (unsigned long long)s->bytes_peer, (unsigned long long)s->bytes_forward,
+               s->closed ? "closed" : "open", s->midstream ? ",midstream" : "");
+    }
+    if (r->gap_bytes > 0) {
+        printf("Warning: %llu bytes were not recorded (recorder queue overflow)\n",
+               (unsigned long long)r->gap_bytes);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    replay_t r;
+    memset(&r, 0, sizeof(r));
+    r.session_filter = -1;
+    r.direction = PROXY_RECORD_PEER;
+    r.speed = 1.0;
+
+    static struct option options[] = {
+        { "list", no_argument, NULL, 'l' },
+        { "dump", no_argument, NULL, 'd' },
+        { "target", required_argument, NULL, 't' },
+        { "session", required_argument, NULL, 's' },
+        { "direction", required_argument, NULL, 'r' },
+        { "speed", required_argument, NULL, 'x' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ldt:s:r:x:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'l':
+                r.mode = MODE_LIST;
+                break;
+            case 'd':
+                r.mode = MODE_DUMP;
+                break;
+            case 't':
+                if (sscanf(optarg, "%255[^:]:%15s", r.target_host, r.target_port) != 2) {
+                    fprintf(stderr, "Invalid target %s, use host:port\n", optarg);
+                    return 1;
+                }
+                r.mode = MODE_REPLAY;
+                break;
+            case 's':
+                r.session_filter = 1;
+                r.session_id = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                if (strcmp(optarg, "peer") == 0) {
+                    r.direction = PROXY_RECORD_PEER;
+                } else if (strcmp(optarg, "forward") == 0) {
+                    r.direction = PROXY_RECORD_FORWARD;
+                } else {
+                    fprintf(stderr, "Invalid direction %s, use peer or forward\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'x':
+                r.speed = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (r.mode == MODE_NONE || optind >= argc || (r.mode == MODE_DUMP && r.session_filter < 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int rc = 0;
+    for (int i = optind; i < argc && rc == 0; i++) {
+        rc = read_file(&r, argv[i]);
+    }
+
+    if (r.mode == MODE_LIST) print_sessions(&r);
+    if (r.truncated) fprintf(stderr, "Warning: recording ends with an incomplete record\n");
+
+    for (replay_session_t *s = r.sessions; s;) {
+        replay_session_t *next = s->next;
+        if (s->fd >= 0) close(s->fd);
+        free(s);
+        s = next;
+    }
+    return rc == 0 ? 0 : 1;
+}
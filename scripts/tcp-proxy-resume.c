@@ -0,0 +1,748 @@
+/*
+ * TCP Proxy Engine - 可续传转发
+ *
+ * RESUME <listener> <spill_dir|-> [mem_mb] [disk_mb] [max_outage_seconds] 开启后, 该监听端口的新会话在
+ * 转发连接 (通常经过 SSH 隧道) 断开时保持 router 侧的认证会话, 后台重连转发目标并从断点继续发送。
+ *
+ * peer -> forward 数据先写入续传队列: 内存块链不超过 mem_mb, 超出部分顺序追加到 spill_dir 下的匿名
+ * 临时文件 (不超过 disk_mb, '-' 表示只用内存), 内存有空间后再读回。队列满时停止读取 router,
+ * 由 TCP 流控反压。数据按字节序号编号, 序号从会话开始时的 0 起算。
+ *
+ * 每次连上转发目标后先握手 (整数均为网络字节序):
+ *   helper -> collector  32 字节: "PXRS" version(2) flags(2) stream_id(8) base_seq(8) write_seq(8)
+ *   collector -> helper  16 字节: "PXRA" status(4) resume_seq(8)
+ * stream_id 在会话内不变, collector 据此找回之前的流, resume_seq 为它已收到的字节数 (新的流为 0)。
+ * helper 从 resume_seq 继续发送; resume_seq 早于 base_seq (collector 丢失了状态) 或 status 非 0 时
+ * 无法无缝续传, 直接关闭 router 会话由 router 重建。
+ * 之后 collector 定期回复 "PXRK" reserved(4) acked_seq(8) 确认已处理的数据, 确认前的数据保留在队列中
+ * 用于断线重发。collector -> router 方向被确认帧占用, 因此续传只适用于单向数据流 (BMP)。
+ *
+ * 转发连接断开后按 1, 2, 4 ... 10 秒退避重连, 连续 max_outage_seconds 未恢复时关闭会话。
+ * router 关闭连接后, 队列中的数据全部确认才关闭会话。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+#include "tcp-proxy-probes.h"
+
+#define RESUME_VERSION 1
+#define RESUME_BLOCK_SIZE 65536
+#define RESUME_HELLO_LEN 32
+#define RESUME_FRAME_LEN 16
+#define RESUME_HELLO_TIMEOUT 10
+#define RESUME_MAX_BACKOFF 10
+#define RESUME_DEFAULT_MEM_MB 16
+#define RESUME_DEFAULT_DISK_MB 256
+#define RESUME_DEFAULT_MAX_OUTAGE 300
+
+typedef enum {
+    RESUME_DISCONNECTED,
+    RESUME_CONNECTING,
+    RESUME_HELLO,                // 已发送握手, 等待 collector 回复续传位置
+    RESUME_STREAMING
+} resume_state_t;
+
+static const char *state_names[] = { "disconnected", "connecting", "hello", "streaming" };
+
+struct proxy_resume_config {
+    char spill_dir[256];         // 空串表示只用内存
+    uint64_t mem_limit;
+    uint64_t disk_limit;
+    int max_outage;
+};
+
+typedef struct resume_block {
+    struct resume_block *next;
+    uint64_t seq;                // 首字节序号
+    size_t len;
+    char data[RESUME_BLOCK_SIZE];
+} resume_block_t;
+
+struct proxy_resume {
+    proxy_resume_config_t cfg;
+    resume_state_t state;
+    uint64_t stream_id;
+    uint64_t acked_seq;          // collector 已确认, 之前的数据已释放
+    uint64_t send_seq;           // 下一个发送的字节
+    uint64_t sent_high;          // 发送过的最大序号, collector 的续传位置不可能超过它
+    uint64_t write_seq;          // 下一个写入队列的字节
+
+    // 内存中为 [acked_seq 所在块, mem_end), 溢出文件中为 [mem_end, write_seq)
+    resume_block_t *head;
+    resume_block_t *tail;
+    uint64_t mem_end;
+    uint64_t mem_bytes;
+    int spill_fd;
+    uint64_t spill_read_off;     // mem_end 在溢出文件中的偏移
+    uint64_t spill_write_off;
+
+    char frame[RESUME_FRAME_LEN];
+    size_t frame_len;
+    time_t hello_at;
+    time_t outage_start;         // 0 表示转发连接正常
+    time_t retry_at;
+    int backoff;
+    int resumed_once;
+    uint64_t reconnects;
+    uint64_t resent_bytes;
+    uint64_t spilled_bytes;
+};
+
+typedef struct {
+    char spill_dir[256];
+    uint64_t mem_limit;
+    uint64_t disk_limit;
+    int32_t max_outage;
+    uint32_t streaming;
+    uint64_t stream_id;
+    uint64_t acked_seq;
+    uint64_t send_seq;
+    uint64_t sent_high;
+    uint64_t write_seq;
+    uint64_t reconnects;
+    uint64_t resent_bytes;
+    uint64_t spilled_bytes;
+    int64_t outage_start;
+    uint32_t frame_len;
+    uint32_t resumed_once;
+    char frame[RESUME_FRAME_LEN];
+} resume_handoff_t;
+
+proxy_resume_config_t *proxy_resume_config_create(const char *spill_dir, uint64_t mem_mb, uint64_t disk_mb,
+                                                  int max_outage, char *err, size_t err_len) {
+    struct stat st;
+    int use_disk = spill_dir && strcmp(spill_dir, "-") != 0;
+
+    if (use_disk && (strlen(spill_dir) >= sizeof(((proxy_resume_config_t *)0)->spill_dir) ||
+                     stat(spill_dir, &st) < 0 || !S_ISDIR(st.st_mode) || access(spill_dir, W_OK) < 0)) {
+        proxy_set_error(err, err_len, "spill directory %s is not writable", spill_dir);
+        return NULL;
+    }
+
+    proxy_resume_config_t *cfg = calloc(1, sizeof(proxy_resume_config_t));
+    if (!cfg) {
+        proxy_set_error(err, err_len, "out of memory");
+        return NULL;
+    }
+    if (use_disk) snprintf(cfg->spill_dir, sizeof(cfg->spill_dir), "%s", spill_dir);
+    cfg->mem_limit = (mem_mb ? mem_mb : RESUME_DEFAULT_MEM_MB) * 1024 * 1024;
+    cfg->disk_limit = use_disk ? (disk_mb ? disk_mb : RESUME_DEFAULT_DISK_MB) * 1024 * 1024 : 0;
+    cfg->max_outage = max_outage > 0 ? max_outage : RESUME_DEFAULT_MAX_OUTAGE;
+    return cfg;
+}
+
+void proxy_resume_config_free(proxy_resume_config_t *cfg) {
+    free(cfg);
+}
+
+void proxy_resume_config_json(proxy_resume_config_t *cfg, proxy_strbuf_t *sb) {
+    if (!cfg) {
+        proxy_strbuf_printf(sb, "null");
+        return;
+    }
+    proxy_strbuf_printf(sb, "{\"spillDir\":");
+    if (cfg->spill_dir[0]) {
+        proxy_strbuf_json_string(sb, cfg->spill_dir);
+    } else {
+        proxy_strbuf_printf(sb, "null");
+    }
+    proxy_strbuf_printf(sb, ",\"memoryLimit\":%llu,\"spillLimit\":%llu,\"maxOutage\":%d}",
+                        (unsigned long long)cfg->mem_limit, (unsigned long long)cfg->disk_limit, cfg->max_outage);
+}
+
+int proxy_resume_config_handoff(int fd, proxy_resume_config_t *cfg) {
+    if (proxy_write_all(fd, cfg, sizeof(*cfg)) < 0) {
+        proxy_log("ERROR", "HANDOFF: failed to send resume config: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int proxy_resume_config_takeover(int fd, proxy_resume_config_t **out) {
+    proxy_resume_config_t *cfg = calloc(1, sizeof(proxy_resume_config_t));
+    if (!cfg || proxy_read_all(fd, cfg, sizeof(*cfg)) < 0) {
+        proxy_log("ERROR", "TAKEOVER: invalid resume config");
+        free(cfg);
+        return -1;
+    }
+    cfg->spill_dir[sizeof(cfg->spill_dir) - 1] = '\0';
+    *out = cfg;
+    return 0;
+}
+
+static uint64_t random_stream_id(void) {
+    uint64_t id = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        if (read(fd, &id, sizeof(id)) != (ssize_t)sizeof(id)) id = 0;
+        close(fd);
+    }
+    if (id == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        id = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ ((uint64_t)getpid() << 16);
+    }
+    return id;
+}
+
+static uint64_t spill_len(const proxy_resume_t *r) {
+    return r->spill_write_off - r->spill_read_off;
+}
+
+// 溢出文件在第一次需要时创建, 创建后立即 unlink (或使用 O_TMPFILE), 进程退出后自动回收
+static int spill_open(proxy_resume_t *r) {
+    if (r->spill_fd >= 0) return 0;
+    if (!r->cfg.spill_dir[0]) return -1;
+
+#ifdef O_TMPFILE
+    r->spill_fd = open(r->cfg.spill_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (r->spill_fd >= 0) return 0;
+#endif
+    char path[320];
+    snprintf(path, sizeof(path), "%s/tcp-proxy-resume-XXXXXX", r->cfg.spill_dir);
+    r->spill_fd = mkostemp(path, O_CLOEXEC);
+    if (r->spill_fd < 0) {
+        proxy_log("ERROR", "Failed to create spill file in %s: %s", r->cfg.spill_dir, strerror(errno));
+        return -1;
+    }
+    unlink(path);
+    return 0;
+}
+
+static resume_block_t *block_for_append(proxy_resume_t *r) {
+    if (r->tail && r->tail->len < RESUME_BLOCK_SIZE) return r->tail;
+
+    resume_block_t *b = malloc(sizeof(resume_block_t));
+    if (!b) return NULL;
+    b->next = NULL;
+    b->seq = r->mem_end;
+    b->len = 0;
+    if (r->tail) {
+        r->tail->next = b;
+    } else {
+        r->head = b;
+    }
+    r->tail = b;
+    return b;
+}
+
+// 写入队列, 返回接受的字节数, -1 表示溢出文件出错
+static ssize_t resume_append(proxy_resume_t *r, const char *data, size_t len) {
+    size_t accepted = 0;
+
+    while (len > 0) {
+        size_t n;
+        // 溢出文件中有数据时新数据必须排在其后
+        if (spill_len(r) == 0 && r->mem_bytes < r->cfg.mem_limit) {
+            resume_block_t *b = block_for_append(r);
+            if (!b) break;
+            n = len;
+            if (n > RESUME_BLOCK_SIZE - b->len) n = RESUME_BLOCK_SIZE - b->len;
+            if (n > r->cfg.mem_limit - r->mem_bytes) n = r->cfg.mem_limit - r->mem_bytes;
+            memcpy(b->data + b->len, data, n);
+            b->len += n;
+            r->mem_bytes += n;
+            r->mem_end += n;
+        } else if (r->cfg.disk_limit > spill_len(r)) {
+            n = len;
+            if (n > r->cfg.disk_limit - spill_len(r)) n = r->cfg.disk_limit - spill_len(r);
+            if (spill_open(r) < 0) return -1;
+            ssize_t written = pwrite(r->spill_fd, data, n, r->spill_write_off);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                proxy_log("ERROR", "Failed to write spill file: %s", strerror(errno));
+                return -1;
+            }
+            n = written;
+            r->spill_write_off += n;
+            r->spilled_bytes += n;
+        } else {
+            break;
+        }
+        data += n;
+        len -= n;
+        accepted += n;
+        r->write_seq += n;
+    }
+    return accepted;
+}
+
+// 内存有空间时把溢出文件中的数据读回内存, -1 表示读取失败
+static int resume_refill(proxy_resume_t *r) {
+    while (spill_len(r) > 0 && r->mem_bytes < r->cfg.mem_limit) {
+        resume_block_t *b = block_for_append(r);
+        if (!b) return 0;
+        size_t n = RESUME_BLOCK_SIZE - b->len;
+        if (n > spill_len(r)) n = spill_len(r);
+        if (n > r->cfg.mem_limit - r->mem_bytes) n = r->cfg.mem_limit - r->mem_bytes;
+
+        ssize_t got = pread(r->spill_fd, b->data + b->len, n, r->spill_read_off);
+        if (got <= 0) {
+            if (got < 0 && errno == EINTR) continue;
+            proxy_log("ERROR", "Failed to read spill file: %s", got < 0 ? strerror(errno) : "unexpected EOF");
+            return -1;
+        }
+        b->len += got;
+        r->mem_bytes += got;
+        r->mem_end += got;
+        r->spill_read_off += got;
+    }
+
+    // 溢出文件读空后截断, 从头复用
+    if (r->spill_fd >= 0 && spill_len(r) == 0 && r->spill_write_off > 0) {
+        if (ftruncate(r->spill_fd, 0) < 0) {
+            proxy_log("WARN", "Failed to truncate spill file: %s", strerror(errno));
+        }
+        r->spill_read_off = 0;
+        r->spill_write_off = 0;
+    }
+    return 0;
+}
+
+// 释放 collector 已确认的数据
+static int resume_ack(proxy_resume_t *r, uint64_t seq) {
+    if (seq <= r->acked_seq) return 0;
+    r->acked_seq = seq;
+    while (r->head && r->head->seq + r->head->len <= seq) {
+        resume_block_t *b = r->head;
+        r->head = b->next;
+        if (!r->head) r->tail = NULL;
+        r->mem_bytes -= b->len;
+        free(b);
+    }
+    return resume_refill(r);
+}
+
+static void resume_disconnect(proxy_engine_t *engine, proxy_session_t *s, const char *reason) {
+    proxy_resume_t *r = s->resume;
+    time_t now = time(NULL);
+
+    proxy_endpoint_close(engine, &s->forward_ep);
+    r->state = RESUME_DISCONNECTED;
+    r->frame_len = 0;
+    if (!r->outage_start) r->outage_start = now;
+    r->retry_at = now + r->backoff;
+    proxy_log("WARN", "Session %u forward leg lost (%s), %llu bytes queued, retry in %ds",
+              s->id, reason, (unsigned long long)(r->write_seq - r->acked_seq), r->backoff);
+    r->backoff = r->backoff * 2 > RESUME_MAX_BACKOFF ? RESUME_MAX_BACKOFF : r->backoff * 2;
+}
+
+static void put_be16(char *p, uint16_t v) {
+    v = htobe16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_be64(char *p, uint64_t v) {
+    v = htobe64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint32_t get_be32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+static uint64_t get_be64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return be64toh(v);
+}
+
+// 转发连接建立后发送握手, 新连接的发送缓冲为空, 32 字节一次即可写完
+static void resume_send_hello(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    char hello[RESUME_HELLO_LEN];
+
+    memcpy(hello, "PXRS", 4);
+    put_be16(hello + 4, RESUME_VERSION);
+    put_be16(hello + 6, 0);
+    put_be64(hello + 8, r->stream_id);
+    put_be64(hello + 16, r->acked_seq);
+    put_be64(hello + 24, r->write_seq);
+
+    if (send(s->forward_ep.fd, hello, sizeof(hello), MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+        resume_disconnect(engine, s, "failed to send resume hello");
+        return;
+    }
+    r->state = RESUME_HELLO;
+    r->hello_at = time(NULL);
+    r->frame_len = 0;
+}
+
+static void resume_flush(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+
+    while (r->state == RESUME_STREAMING && r->send_seq < r->mem_end) {
+        resume_block_t *b = r->head;
+        while (b && b->seq + b->len <= r->send_seq) b = b->next;
+        if (!b) break;
+
+        size_t off = r->send_seq - b->seq;
+        size_t quota = proxy_sched_quota(engine, s, PROXY_DIR_FORWARD, b->data + off, b->len - off);
+        if (quota == 0) {
+            PROXY_PROBE3(throttled, s->id, PROXY_DIR_FORWARD, r->mem_end - r->send_seq);
+            return;
+        }
+        ssize_t n = send(s->forward_ep.fd, b->data + off, quota, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                resume_disconnect(engine, s, strerror(errno));
+            } else {
+                PROXY_PROBE3(send_blocked, s->id, PROXY_DIR_FORWARD, r->mem_end - r->send_seq);
+            }
+            return;
+        }
+        proxy_sched_sent(engine, s, PROXY_DIR_FORWARD, b->data + off, n);
+        r->send_seq += n;
+        PROXY_PROBE4(send, s->id, PROXY_DIR_FORWARD, n, r->mem_end - r->send_seq);
+        if (r->send_seq > r->sent_high) r->sent_high = r->send_seq;
+    }
+}
+
+int proxy_resume_push(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    proxy_buffer_t *buf = &s->to_forward;
+
+    if (buf->len > buf->off) {
+        ssize_t n = resume_append(r, buf->data + buf->off, buf->len - buf->off);
+        if (n < 0) return -1;
+        buf->off += n;
+        if (buf->off == buf->len) {
+            buf->off = 0;
+            buf->len = 0;
+        }
+    }
+    resume_flush(engine, s);
+    return 0;
+}
+
+// 处理 collector 发来的一帧, -1 表示无法续传, 会话需要关闭
+static int resume_frame(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    uint64_t seq = get_be64(r->frame + 8);
+
+    r->frame_len = 0;
+    if (r->state == RESUME_HELLO) {
+        if (memcmp(r->frame, "PXRA", 4) != 0) {
+            resume_disconnect(engine, s, "collector does not support resume");
+            return 0;
+        }
+        if (get_be32(r->frame + 4) != 0) {
+            proxy_log("ERROR", "Session %u: collector rejected stream %016llx (status %u)",
+                      s->id, (unsigned long long)r->stream_id, get_be32(r->frame + 4));
+            return -1;
+        }
+        if (seq < r->acked_seq || seq > r->sent_high) {
+            proxy_log("ERROR", "Session %u: collector resumes at %llu, queue holds %llu-%llu, cannot resume",
+                      s->id, (unsigned long long)seq, (unsigned long long)r->acked_seq,
+                      (unsigned long long)r->write_seq);
+            return -1;
+        }
+        if (resume_ack(r, seq) < 0) return -1;
+
+        r->resent_bytes += r->sent_high - seq;
+        // 从断点之前重发时已发送数据中的消息边界不再可用
+        if (seq != r->send_seq) proxy_sched_reset_framing(s, PROXY_DIR_FORWARD);
+        r->send_seq = seq;
+        r->state = RESUME_STREAMING;
+        r->backoff = 1;
+        if (r->resumed_once) {
+            r->reconnects++;
+            proxy_log("INFO", "Session %u forward leg resumed at %llu after %lds, %llu bytes queued",
+                      s->id, (unsigned long long)seq, (long)(time(NULL) - r->outage_start),
+                      (unsigned long long)(r->write_seq - seq));
+        }
+        r->outage_start = 0;
+        r->resumed_once = 1;
+        PROXY_PROBE4(forward_connect, s->id, s->listener->forward_host, s->listener->forward_port, 0);
+        return 0;
+    }
+
+    if (memcmp(r->frame, "PXRK", 4) != 0 || seq > r->sent_high) {
+        resume_disconnect(engine, s, "invalid ack from collector");
+        return 0;
+    }
+    return resume_ack(r, seq);
+}
+
+int proxy_resume_handle_event(proxy_engine_t *engine, proxy_session_t *s, uint32_t events) {
+    proxy_resume_t *r = s->resume;
+    int fd = s->forward_ep.fd;
+
+    if (events & EPOLLERR) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        resume_disconnect(engine, s, err ? strerror(err) : "socket error");
+        return 0;
+    }
+
+    if (r->state == RESUME_CONNECTING) {
+        if (!(events & (EPOLLOUT | EPOLLHUP))) return 0;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            resume_disconnect(engine, s, strerror(err ? err : errno));
+            return 0;
+        }
+        resume_send_hello(engine, s);
+        return 0;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        while (s->forward_ep.fd >= 0) {
+            ssize_t n = recv(fd, r->frame + r->frame_len, RESUME_FRAME_LEN - r->frame_len, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) resume_disconnect(engine, s, strerror(errno));
+                break;
+            }
+            if (n == 0) {
+                resume_disconnect(engine, s, "collector closed connection");
+                break;
+            }
+            r->frame_len += n;
+            if (r->frame_len == RESUME_FRAME_LEN && resume_frame(engine, s) < 0) return -1;
+        }
+    }
+
+    // 确认释放了队列空间, 接着搬运 router 侧积压的数据
+    if (r->state == RESUME_STREAMING) return proxy_resume_push(engine, s);
+    return 0;
+}
+
+int proxy_resume_update_events(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    uint32_t events = 0;
+
+    if (s->forward_ep.fd < 0) return 0;
+    switch (r->state) {
+        case RESUME_CONNECTING:
+            events = EPOLLOUT;
+            break;
+        case RESUME_HELLO:
+            events = EPOLLIN;
+            break;
+        case RESUME_STREAMING:
+            events = EPOLLIN;
+            if (r->send_seq < r->mem_end && !s->throttled[PROXY_DIR_FORWARD]) events |= EPOLLOUT;
+            break;
+        case RESUME_DISCONNECTED:
+            return 0;
+    }
+    return proxy_endpoint_set_events(engine, &s->forward_ep, events, 0);
+}
+
+static void resume_connect(proxy_engine_t *engine, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    int connecting = 0;
+    int fd = proxy_connect_target(s->listener->forward_host, s->listener->forward_port, &connecting);
+
+    if (fd < 0) {
+        resume_disconnect(engine, s, "connect failed");
+        return;
+    }
+    s->forward_ep.fd = fd;
+    s->forward_ep.events = 0;
+    if (proxy_endpoint_set_events(engine, &s->forward_ep, 0, 1) < 0) {
+        close(fd);
+        s->forward_ep.fd = -1;
+        resume_disconnect(engine, s, "epoll registration failed");
+        return;
+    }
+    r->state = RESUME_CONNECTING;
+    if (!connecting) resume_send_hello(engine, s);
+    proxy_resume_update_events(engine, s);
+}
+
+int proxy_resume_attach(proxy_engine_t *engine, proxy_session_t *s, proxy_resume_config_t *cfg, int connecting) {
+    proxy_resume_t *r = calloc(1, sizeof(proxy_resume_t));
+    if (!r) return -1;
+
+    r->cfg = *cfg;
+    r->stream_id = random_stream_id();
+    r->spill_fd = -1;
+    r->backoff = 1;
+    r->outage_start = time(NULL);
+    s->resume = r;
+
+    if (s->forward_ep.fd < 0) {
+        r->state = RESUME_DISCONNECTED;
+        r->retry_at = r->outage_start + r->backoff;
+    } else {
+        r->state = RESUME_CONNECTING;
+        if (!connecting) resume_send_hello(engine, s);
+    }
+    proxy_log("INFO", "Session %u: resumable forward stream %016llx", s->id, (unsigned long long)r->stream_id);
+    return proxy_resume_update_events(engine, s);
+}
+
+void proxy_resume_free(proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    if (!r) return;
+    while (r->head) {
+        resume_block_t *b = r->head;
+        r->head = b->next;
+        free(b);
+    }
+    if (r->spill_fd >= 0) close(r->spill_fd);
+    free(r);
+    s->resume = NULL;
+}
+
+int proxy_resume_tick(proxy_engine_t *engine, proxy_session_t *s, time_t now) {
+    proxy_resume_t *r = s->resume;
+
+    if (r->state == RESUME_STREAMING) return 0;
+    if (r->outage_start && now - r->outage_start > r->cfg.max_outage) {
+        proxy_log("ERROR", "Session %u: forward target unavailable for %lds, giving up",
+                  s->id, (long)(now - r->outage_start));
+        return -1;
+    }
+    if (r->state == RESUME_HELLO && now - r->hello_at > RESUME_HELLO_TIMEOUT) {
+        resume_disconnect(engine, s, "resume hello timed out");
+    } else if (r->state == RESUME_DISCONNECTED && now >= r->retry_at) {
+        resume_connect(engine, s);
+    }
+    return 0;
+}
+
+int proxy_resume_drained(proxy_session_t *s) {
+    return s->resume->acked_seq == s->resume->write_seq;
+}
+
+int proxy_resume_streaming(proxy_session_t *s) {
+    return s->resume->state == RESUME_STREAMING;
+}
+
+void proxy_resume_json(proxy_session_t *s, proxy_strbuf_t *sb) {
+    proxy_resume_t *r = s->resume;
+    if (!r) {
+        proxy_strbuf_printf(sb, "null");
+        return;
+    }
+    proxy_strbuf_printf(sb, "{\"state\":\"%s\",\"streamId\":\"%016llx\",\"ackedSeq\":%llu,\"sendSeq\":%llu,"
+                        "\"writeSeq\":%llu,\"memoryBytes\":%llu,\"spillBytes\":%llu,\"spilledBytes\":%llu,"
+                        "\"reconnects\":%llu,\"resentBytes\":%llu,\"outage\":%ld}",
+                        state_names[r->state], (unsigned long long)r->stream_id,
+                        (unsigned long long)r->acked_seq, (unsigned long long)r->send_seq,
+                        (unsigned long long)r->write_seq, (unsigned long long)r->mem_bytes,
+                        (unsigned long long)spill_len(r), (unsigned long long)r->spilled_bytes,
+                        (unsigned long long)r->reconnects, (unsigned long long)r->resent_bytes,
+                        (long)(r->outage_start ? time(NULL) - r->outage_start : 0));
+}
+
+// 发送续传状态和 [acked_seq, write_seq) 的全部数据; 只有 streaming 状态的转发连接随会话交给新进程
+int proxy_resume_handoff(int fd, proxy_session_t *s) {
+    proxy_resume_t *r = s->resume;
+    resume_handoff_t rec;
+    char buf[RESUME_BLOCK_SIZE];
+
+    memset(&rec, 0, sizeof(rec));
+    memcpy(rec.spill_dir, r->cfg.spill_dir, sizeof(rec.spill_dir));
+    rec.mem_limit = r->cfg.mem_limit;
+    rec.disk_limit = r->cfg.disk_limit;
+    rec.max_outage = r->cfg.max_outage;
+    rec.streaming = r->state == RESUME_STREAMING;
+    rec.stream_id = r->stream_id;
+    rec.acked_seq = r->acked_seq;
+    rec.send_seq = r->send_seq;
+    rec.sent_high = r->sent_high;
+    rec.write_seq = r->write_seq;
+    rec.reconnects = r->reconnects;
+    rec.resent_bytes = r->resent_bytes;
+    rec.spilled_bytes = r->spilled_bytes;
+    rec.outage_start = r->outage_start;
+    rec.resumed_once = r->resumed_once;
+    rec.frame_len = rec.streaming ? r->frame_len : 0;
+    memcpy(rec.frame, r->frame, sizeof(rec.frame));
+
+    if (proxy_write_all(fd, &rec, sizeof(rec)) < 0) goto fail;
+    for (resume_block_t *b = r->head; b; b = b->next) {
+        size_t off = b->seq < r->acked_seq ? r->acked_seq - b->seq : 0;
+        if (off < b->len && proxy_write_all(fd, b->data + off, b->len - off) < 0) goto fail;
+    }
+    for (uint64_t off = r->spill_read_off; off < r->spill_write_off;) {
+        size_t n = sizeof(buf);
+        if (n > r->spill_write_off - off) n = r->spill_write_off - off;
+        ssize_t got = pread(r->spill_fd, buf, n, off);
+        if (got <= 0 || proxy_write_all(fd, buf, got) < 0) goto fail;
+        off += got;
+    }
+    return 0;
+
+fail:
+    proxy_log("ERROR", "HANDOFF: failed to send resume queue of session %u: %s", s->id, strerror(errno));
+    return -1;
+}
+
+int proxy_resume_takeover(proxy_engine_t *engine, int fd, proxy_session_t *s) {
+    resume_handoff_t rec;
+    char buf[RESUME_BLOCK_SIZE];
+
+    if (proxy_read_all(fd, &rec, sizeof(rec)) < 0 || rec.write_seq < rec.acked_seq ||
+        rec.send_seq < rec.acked_seq || rec.sent_high > rec.write_seq || rec.frame_len > RESUME_FRAME_LEN ||
+        rec.streaming != (s->forward_ep.fd >= 0)) {
+        proxy_log("ERROR", "TAKEOVER: invalid resume record");
+        return -1;
+    }
+
+    proxy_resume_t *r = calloc(1, sizeof(proxy_resume_t));
+    if (!r) return -1;
+    rec.spill_dir[sizeof(rec.spill_dir) - 1] = '\0';
+    memcpy(r->cfg.spill_dir, rec.spill_dir, sizeof(r->cfg.spill_dir));
+    r->cfg.mem_limit = rec.mem_limit;
+    r->cfg.disk_limit = rec.disk_limit;
+    r->cfg.max_outage = rec.max_outage;
+    r->stream_id = rec.stream_id;
+    r->spill_fd = -1;
+    r->backoff = 1;
+    r->acked_seq = rec.acked_seq;
+    r->write_seq = rec.acked_seq;
+    r->mem_end = rec.acked_seq;
+    s->resume = r;
+
+    // 限额与旧进程相同, 队列中的数据一定放得下
+    for (uint64_t remaining = rec.write_seq - rec.acked_seq; remaining > 0;) {
+        size_t n = remaining > sizeof(buf) ? sizeof(buf) : remaining;
+        if (proxy_read_all(fd, buf, n) < 0 || resume_append(r, buf, n) != (ssize_t)n) {
+            proxy_log("ERROR", "TAKEOVER: failed to restore resume queue of session %u", s->id);
+            return -1;
+        }
+        remaining -= n;
+    }
+
+    r->send_seq = rec.send_seq;
+    r->sent_high = rec.sent_high;
+    r->reconnects = rec.reconnects;
+    r->resent_bytes = rec.resent_bytes;
+    r->spilled_bytes = rec.spilled_bytes;
+    r->outage_start = rec.outage_start;
+    r->resumed_once = rec.resumed_once;
+    r->frame_len = rec.frame_len;
+    memcpy(r->frame, rec.frame, sizeof(r->frame));
+
+    // 握手未完成的连接留在旧进程中关闭, 这里立即重连
+    if (rec.streaming) {
+        r->state = RESUME_STREAMING;
+    } else {
+        r->state = RESUME_DISCONNECTED;
+        if (!r->outage_start) r->outage_start = time(NULL);
+        r->retry_at = 0;
+    }
+    return proxy_resume_update_events(engine, s);
+}
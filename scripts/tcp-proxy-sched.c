@@ -0,0 +1,328 @@
+/*
+ * TCP Proxy Engine - 调度与限速
+ *
+ * 多个 router 共用一个 helper 和一条隧道时, 一个 router 推送全表会挤占其他 router 的带宽,
+ * 甚至让它们的 KEEPALIVE 晚于 hold time 到达。发送路径上的三层控制:
+ *   1. peer 限速: SHAPE <listener> <peer_ip> <rate_kbps> [burst_kb], 每个 peer 每个方向一个令牌桶,
+ *      同一 peer 的所有会话共用
+ *   2. 隧道带宽: SHAPE * <rate_kbps> [burst_kb], 所有会话共用的令牌桶; 令牌够用时直接发送,
+ *      不够时各 peer 按 deficit round robin 分配 (每轮每个积压的 peer 加一个 quantum)
+ *   3. 优先通道: 按 BGP (16 字节 marker) 或 BMP (版本 3) 消息头跟踪每个方向的消息边界,
+ *      下一条完整的消息是控制消息 (BGP 非 UPDATE, BMP 非 Route Monitoring/Mirroring) 且不超过 4KB 时
+ *      不受令牌和 DRR 限制立即发送, 令牌可透支。同一连接内的消息不会被重排, 排在大消息后面的
+ *      KEEPALIVE 仍需等待本 peer 的配额, 但不会被其他 peer 的数据阻塞。
+ * 配额不足的会话不注册 EPOLLOUT, 由事件循环每 10ms 补充令牌后重试; router 侧因缓冲写满
+ * 停止读取, 由 TCP 流控反压。隧道带宽应设置得略低于实际带宽, 让排队发生在 helper 而不是隧道中。
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tcp-proxy-engine.h"
+#include "tcp-proxy-internal.h"
+
+#define SCHED_INTERVAL_MS 10
+#define SCHED_QUANTUM 16384
+#define SCHED_MIN_BURST 16384
+#define SCHED_PRIORITY_MAX 4096
+
+#define BGP_HEADER_LEN 19
+#define BGP_MSG_UPDATE 2
+#define BMP_HEADER_LEN 6
+#define BMP_VERSION 3
+#define BMP_MSG_ROUTE_MONITORING 0
+#define BMP_MSG_ROUTE_MIRRORING 6
+
+enum {
+    FRAMING_UNKNOWN = 0,         // 还没有发送过数据
+    FRAMING_NONE,                // 不是 BGP/BMP 或消息头无效, 不再跟踪
+    FRAMING_BGP,
+    FRAMING_BMP
+};
+
+static const char *dir_names[] = { "forward", "peer" };
+
+static uint64_t default_burst(uint64_t rate) {
+    return rate / 10 > SCHED_MIN_BURST ? rate / 10 : SCHED_MIN_BURST;
+}
+
+static void bucket_reset(proxy_bucket_t *b, uint64_t burst) {
+    b->tokens = burst;
+    b->deficit = 0;
+}
+
+static void update_shaping(proxy_engine_t *engine) {
+    int shaping = engine->link_rate > 0;
+    for (proxy_listener_t *l = engine->listeners; l && !shaping; l = l->next) {
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            if (p->rate) {
+                shaping = 1;
+                break;
+            }
+        }
+    }
+    if (shaping && !engine->shaping) clock_gettime(CLOCK_MONOTONIC, &engine->sched_last);
+    engine->shaping = shaping;
+}
+
+// rate/burst 为字节数, 0 表示不限速 / 使用默认突发量
+void proxy_sched_set_peer(proxy_engine_t *engine, proxy_peer_t *peer, uint64_t rate, uint64_t burst) {
+    peer->rate = rate;
+    peer->burst = rate ? (burst ? burst : default_burst(rate)) : 0;
+    bucket_reset(&peer->buckets[PROXY_DIR_FORWARD], peer->burst);
+    bucket_reset(&peer->buckets[PROXY_DIR_PEER], peer->burst);
+    update_shaping(engine);
+}
+
+void proxy_sched_set_link(proxy_engine_t *engine, uint64_t rate, uint64_t burst) {
+    engine->link_rate = rate;
+    engine->link_burst = rate ? (burst ? burst : default_burst(rate)) : 0;
+    bucket_reset(&engine->link[PROXY_DIR_FORWARD], engine->link_burst);
+    bucket_reset(&engine->link[PROXY_DIR_PEER], engine->link_burst);
+    update_shaping(engine);
+}
+
+// peer 删除后重新计算是否还需要调度
+void proxy_sched_peers_changed(proxy_engine_t *engine) {
+    update_shaping(engine);
+}
+
+static int framing_mode(const proxy_framing_t *fr, unsigned char first) {
+    if (fr->mode != FRAMING_UNKNOWN) return fr->mode;
+    if (first == 0xff) return FRAMING_BGP;
+    if (first == BMP_VERSION) return FRAMING_BMP;
+    return FRAMING_NONE;
+}
+
+static size_t header_len(int mode) {
+    return mode == FRAMING_BGP ? BGP_HEADER_LEN : BMP_HEADER_LEN;
+}
+
+// 解析消息头, 返回消息总长度, 0 表示消息头无效; *control 置位表示控制消息
+static uint32_t parse_header(int mode, const unsigned char *hdr, int *control) {
+    if (mode == FRAMING_BGP) {
+        for (int i = 0; i < 16; i++) {
+            if (hdr[i] != 0xff) return 0;
+        }
+        uint32_t len = ((uint32_t)hdr[16] << 8) | hdr[17];
+        if (len < BGP_HEADER_LEN) return 0;
+        *control = hdr[18] != BGP_MSG_UPDATE;
+        return len;
+    }
+
+    if (hdr[0] != BMP_VERSION) return 0;
+    uint32_t len = ((uint32_t)hdr[1] << 24) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 8) | hdr[4];
+    if (len < BMP_HEADER_LEN) return 0;
+    *control = hdr[5] != BMP_MSG_ROUTE_MONITORING && hdr[5] != BMP_MSG_ROUTE_MIRRORING;
+    return len;
+}
+
+// 待发送数据的开头是否为一条完整的小控制消息, 返回其长度, 否则返回 0
+static size_t priority_message(const proxy_framing_t *fr, const char *data, size_t len) {
+    if (len == 0 || fr->msg_left > 0 || fr->hdr_len > 0) return 0;
+    int mode = framing_mode(fr, (unsigned char)data[0]);
+    if (mode == FRAMING_NONE || len < header_len(mode)) return 0;
+
+    int control = 0;
+    uint32_t msg_len = parse_header(mode, (const unsigned char *)data, &control);
+    if (!control || msg_len == 0 || msg_len > SCHED_PRIORITY_MAX || msg_len > len) return 0;
+    return msg_len;
+}
+
+// 跟踪已发送数据中的消息边界
+static void framing_advance(proxy_framing_t *fr, const char *data, size_t len) {
+    while (len > 0) {
+        if (fr->mode == FRAMING_UNKNOWN) fr->mode = framing_mode(fr, (unsigned char)data[0]);
+        if (fr->mode == FRAMING_NONE) return;
+
+        if (fr->msg_left > 0) {
+            size_t n = len < fr->msg_left ? len : fr->msg_left;
+            fr->msg_left -= n;
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        size_t need = header_len(fr->mode) - fr->hdr_len;
+        size_t n = len < need ? len : need;
+        memcpy(fr->hdr + fr->hdr_len, data, n);
+        fr->hdr_len += n;
+        data += n;
+        len -= n;
+        if (fr->hdr_len < header_len(fr->mode)) return;
+
+        int control = 0;
+        uint32_t msg_len = parse_header(fr->mode, fr->hdr, &control);
+        fr->hdr_len = 0;
+        if (msg_len == 0) {
+            fr->mode = FRAMING_NONE;
+            return;
+        }
+        fr->msg_left = msg_len - header_len(fr->mode);
+    }
+}
+
+// 已发送的数据之后再接上 data (缓冲中待发送的部分) 时, 下一个字节在 BMP 流中的位置, 供中途开始解析:
+// *skip 为当前消息还剩的字节数, hdr[0, *hdr_len) 为已收到的部分消息头; 不是 BMP 流或位置未知时返回 -1
+int proxy_sched_bmp_position(const proxy_framing_t *fr, const char *data, size_t len,
+                             uint32_t *skip, unsigned char *hdr, size_t *hdr_len) {
+    proxy_framing_t pos = *fr;
+    framing_advance(&pos, data, len);
+    if (pos.mode == FRAMING_UNKNOWN) {
+        *skip = 0;
+        *hdr_len = 0;
+        return 0;
+    }
+    if (pos.mode != FRAMING_BMP) return -1;
+    *skip = pos.msg_left;
+    *hdr_len = pos.hdr_len;
+    memcpy(hdr, pos.hdr, pos.hdr_len);
+    return 0;
+}
+
+// 发送位置不再连续 (如续传从更早的位置重发) 时无法继续跟踪消息边界
+void proxy_sched_reset_framing(proxy_session_t *s, int dir) {
+    memset(&s->framing[dir], 0, sizeof(s->framing[dir]));
+    s->framing[dir].mode = FRAMING_NONE;
+}
+
+size_t proxy_sched_quota(proxy_engine_t *engine, proxy_session_t *s, int dir, const char *data, size_t len) {
+    if (!engine->shaping || len == 0) return len;
+
+    proxy_peer_t *peer = s->peer;
+    size_t prio = priority_message(&s->framing[dir], data, len);
+    if (prio > 0) {
+        if (peer) peer->buckets[dir].priority++;
+        return prio;
+    }
+
+    size_t quota = len;
+    if (peer && peer->rate) {
+        int64_t tokens = peer->buckets[dir].tokens;
+        if (tokens <= 0) {
+            quota = 0;
+        } else if ((uint64_t)tokens < quota) {
+            quota = tokens;
+        }
+    }
+
+    if (quota > 0 && engine->link_rate) {
+        int64_t tokens = engine->link[dir].tokens;
+        // 隧道令牌够用时没有竞争, 直接发送; 不够时只在调度轮次中按 DRR 分配
+        if ((int64_t)quota > tokens) {
+            int64_t deficit = peer ? peer->buckets[dir].deficit : SCHED_QUANTUM;
+            if (!engine->sched_in_round || tokens <= 0 || deficit <= 0) {
+                quota = 0;
+            } else {
+                if ((int64_t)quota > tokens) quota = tokens;
+                if ((int64_t)quota > deficit) quota = deficit;
+            }
+        }
+    }
+
+    if (quota == 0) {
+        if (!s->throttled[dir] && peer) peer->buckets[dir].throttled++;
+        if (!s->throttled[dir]) engine->link[dir].throttled += engine->link_rate > 0;
+        s->throttled[dir] = 1;
+    }
+    return quota;
+}
+
+void proxy_sched_sent(proxy_engine_t *engine, proxy_session_t *s, int dir, const char *data, size_t len) {
+    framing_advance(&s->framing[dir], data, len);
+    if (s->peer) {
+        s->peer->buckets[dir].bytes += len;
+        if (engine->shaping) {
+            s->peer->buckets[dir].tokens -= len;
+            if (engine->sched_in_round) s->peer->buckets[dir].deficit -= len;
+        }
+    }
+    engine->link[dir].bytes += len;
+    if (engine->shaping) engine->link[dir].tokens -= len;
+}
+
+static void bucket_refill(proxy_bucket_t *b, uint64_t rate, uint64_t burst, int64_t elapsed_us) {
+    if (!rate) return;
+    int64_t tokens = b->tokens + (int64_t)(rate * (uint64_t)elapsed_us / 1000000);
+    b->tokens = tokens > (int64_t)burst ? (int64_t)burst : tokens;
+}
+
+static int any_throttled(proxy_engine_t *engine) {
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (s->throttled[PROXY_DIR_FORWARD] || s->throttled[PROXY_DIR_PEER]) return 1;
+    }
+    return 0;
+}
+
+// 按经过的时间补充令牌, 返回 1 表示有等待配额的会话需要重试 (限速取消后也需要重试一次)
+int proxy_sched_refill(proxy_engine_t *engine) {
+    if (!engine->shaping) return any_throttled(engine);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed_us = (now.tv_sec - engine->sched_last.tv_sec) * 1000000 +
+                         (now.tv_nsec - engine->sched_last.tv_nsec) / 1000;
+    // 不足 1ms 时累计到下一次, 避免整数截断丢失令牌
+    if (elapsed_us >= 1000) {
+        engine->sched_last = now;
+        for (int dir = 0; dir < 2; dir++) {
+            bucket_refill(&engine->link[dir], engine->link_rate, engine->link_burst, elapsed_us);
+            for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+                for (proxy_peer_t *p = l->peers; p; p = p->next) {
+                    bucket_refill(&p->buckets[dir], p->rate, p->burst, elapsed_us);
+                }
+            }
+        }
+    }
+    return any_throttled(engine);
+}
+
+// DRR: 每一轮有积压的 peer 的配额重置为一个 quantum, 没有积压的清零。按字节而不是按消息分配,
+// 不存在配额不够发一条消息的情况, 因此不需要跨轮累计
+void proxy_sched_add_quantum(proxy_engine_t *engine) {
+    for (proxy_listener_t *l = engine->listeners; l; l = l->next) {
+        for (proxy_peer_t *p = l->peers; p; p = p->next) {
+            p->buckets[PROXY_DIR_FORWARD].deficit = 0;
+            p->buckets[PROXY_DIR_PEER].deficit = 0;
+        }
+    }
+    for (proxy_session_t *s = engine->sessions; s; s = s->next) {
+        if (!s->peer) continue;
+        for (int dir = 0; dir < 2; dir++) {
+            proxy_bucket_t *b = &s->peer->buckets[dir];
+            if (s->throttled[dir] && b->deficit < SCHED_QUANTUM) b->deficit = SCHED_QUANTUM;
+        }
+    }
+}
+
+int proxy_sched_timeout(proxy_engine_t *engine, int default_ms) {
+    return any_throttled(engine) ? SCHED_INTERVAL_MS : default_ms;
+}
+
+static void bucket_json(proxy_strbuf_t *sb, const proxy_bucket_t *b) {
+    proxy_strbuf_printf(sb, "{");
+    for (int dir = 0; dir < 2; dir++) {
+        proxy_strbuf_printf(sb, "%s\"%s\":{\"bytes\":%llu,\"throttled\":%llu,\"priority\":%llu}",
+                            dir ? "," : "", dir_names[dir], (unsigned long long)b[dir].bytes,
+                            (unsigned long long)b[dir].throttled, (unsigned long long)b[dir].priority);
+    }
+    proxy_strbuf_printf(sb, "}");
+}
+
+void proxy_sched_peer_json(proxy_peer_t *peer, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "{\"rate\":%llu,\"burst\":%llu,\"traffic\":",
+                        (unsigned long long)peer->rate, (unsigned long long)peer->burst);
+    bucket_json(sb, peer->buckets);
+    proxy_strbuf_printf(sb, "}");
+}
+
+void proxy_sched_link_json(proxy_engine_t *engine, proxy_strbuf_t *sb) {
+    proxy_strbuf_printf(sb, "{\"rate\":%llu,\"burst\":%llu,\"traffic\":",
+                        (unsigned long long)engine->link_rate, (unsigned long long)engine->link_burst);
+    bucket_json(sb, engine->link);
+    proxy_strbuf_printf(sb, "}");
+}
@@ -16,6 +16,8 @@
  *   --count <n>      模拟多个客户端同时请求，默认 1
  *   --release        租约成功后立即发送 RELEASE
  *   --timeout <ms>   等待响应超时（毫秒），默认 5000
+ *   --load <n>       压测模式：n 个客户端依次完成四步握手，统计租约速率和时延分布
+ *   --window <n>     压测模式下同时进行握手的客户端数，默认 64
  *
  * DHCPv4 选项：
  *   --server <ip>    服务器地址，默认 255.255.255.255（广播）
@@ -36,6 +38,8 @@
  *   node scripts/testDhcpClient.js --v6 --server6 ::1
  *   node scripts/testDhcpClient.js --v6 --server6 ::1 --port6 1547
  *   node scripts/testDhcpClient.js --v6 --server6 ::1 --count 3 --release
+ *   node scripts/testDhcpClient.js --server 127.0.0.1 --port 1067 --load 5000 --window 128 --release
+ *   node scripts/testDhcpClient.js --v6 --server6 ::1 --port6 1547 --load 5000 --window 128
  */
 
 'use strict';
@@ -57,6 +61,8 @@ const DO_RELEASE = args.includes('--release');
 const CUSTOM_MAC = getArg('--mac', null);
 const DHCP_SERVER_PORT = parsePortArg('--port', 67);
 const DHCP6_SERVER_PORT = parsePortArg('--port6', DHCP_SERVER_PORT === 67 ? 547 : DHCP_SERVER_PORT);
+const LOAD_CLIENTS = args.includes('--load') ? parsePositiveInt('--load', 1000) : 0;
+const LOAD_WINDOW = parsePositiveInt('--window', 64);
 
 // ========== 公共工具 ==========
 function parseMac(str) {
@@ -87,6 +93,15 @@ function parsePortArg(name, defaultValue) {
     return port;
 }
 
+function parsePositiveInt(name, defaultValue) {
+    const raw = getArg(name, String(defaultValue));
+    const value = Number(raw);
+    if (!Number.isInteger(value) || value <= 0) {
+        throw new Error(`${name} 参数非法: ${raw}`);
+    }
+    return value;
+}
+
 // ============================================================
 // DHCPv4
 // ============================================================
@@ -492,10 +507,238 @@ function runDhcp6Session(socket, macBuf, sessionId) {
     });
 }
 
+// ============================================================
+// 压测
+// ============================================================
+function percentile(sorted, p) {
+    if (sorted.length === 0) {
+        return NaN;
+    }
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+// 第 index 个压测客户端的 MAC，后 4 字节为序号，各客户端互不相同
+function loadMac(index) {
+    const mac = Buffer.alloc(6);
+    mac[0] = 0x02;
+    mac[1] = 0x4c;
+    mac.writeUInt32BE(index >>> 0, 2);
+    return mac;
+}
+
+// DHCPv4 压测: DISCOVER -> OFFER -> REQUEST -> ACK，以 xid 区分客户端
+function dhcp4LoadDriver(socket) {
+    const send = pkt => socket.send(pkt, 0, pkt.length, DHCP_SERVER_PORT, SERVER_ADDR);
+    return {
+        key: msg => (msg.length >= 240 ? msg.readUInt32BE(4) : null),
+        begin: session => send(buildPacket(MSG_TYPE.DISCOVER, session.xid, session.mac)),
+        // 返回 'ack'/'nak' 表示握手结束，null 表示继续等待
+        handle: (session, msg) => {
+            const pkt = parseResponse(msg);
+            if (!pkt) {
+                return null;
+            }
+            if (session.step === 0 && pkt.msgType === MSG_TYPE.OFFER) {
+                session.step = 1;
+                send(
+                    buildPacket(MSG_TYPE.REQUEST, session.xid, session.mac, [
+                        { code: 50, data: ipToBuffer(pkt.yiaddr) },
+                        { code: 54, data: ipToBuffer(pkt.serverId) }
+                    ])
+                );
+                return null;
+            }
+            if (session.step === 1 && pkt.msgType === MSG_TYPE.ACK) {
+                if (DO_RELEASE) {
+                    send(buildRelease(session.xid, session.mac, pkt.yiaddr, pkt.serverId));
+                }
+                return 'ack';
+            }
+            return session.step === 1 && pkt.msgType === MSG_TYPE.NAK ? 'nak' : null;
+        }
+    };
+}
+
+// DHCPv6 压测: SOLICIT -> ADVERTISE -> REQUEST -> REPLY，以 24 位 txId 区分客户端
+function dhcp6LoadDriver(socket) {
+    const send = pkt => socket.send(pkt, 0, pkt.length, DHCP6_SERVER_PORT, SERVER6_ADDR);
+    const txIdOf = xid => [(xid >>> 16) & 0xff, (xid >>> 8) & 0xff, xid & 0xff];
+    const elapsed = buildOpt6(DHCP6_OPT.ELAPSED_TIME, Buffer.from([0, 0]));
+    return {
+        key: msg => (msg.length >= 4 ? msg.readUIntBE(1, 3) : null),
+        begin: session => {
+            session.duid = buildDuidLL(session.mac);
+            send(
+                buildDhcp6Msg(DHCP6_MSG.SOLICIT, txIdOf(session.xid), [
+                    buildOpt6(DHCP6_OPT.CLIENTID, session.duid),
+                    buildIaNA(session.index, null),
+                    elapsed
+                ])
+            );
+        },
+        handle: (session, msg) => {
+            const pkt = parseDhcp6Pkt(msg);
+            const addr = extractIaAddr(pkt.opts[DHCP6_OPT.IA_NA]);
+            if (session.step === 0 && pkt.msgType === DHCP6_MSG.ADVERTISE) {
+                if (!addr || !pkt.opts[DHCP6_OPT.SERVERID]) {
+                    return 'nak';
+                }
+                session.step = 1;
+                session.serverDuid = pkt.opts[DHCP6_OPT.SERVERID];
+                send(
+                    buildDhcp6Msg(DHCP6_MSG.REQUEST, txIdOf(session.xid), [
+                        buildOpt6(DHCP6_OPT.CLIENTID, session.duid),
+                        buildOpt6(DHCP6_OPT.SERVERID, session.serverDuid),
+                        buildIaNA(session.index, buildIaAddr(addr.addrBuf)),
+                        elapsed
+                    ])
+                );
+                return null;
+            }
+            if (session.step === 1 && pkt.msgType === DHCP6_MSG.REPLY) {
+                if (!addr) {
+                    return 'nak';
+                }
+                if (DO_RELEASE) {
+                    send(
+                        buildDhcp6Msg(DHCP6_MSG.RELEASE, txIdOf(session.xid), [
+                            buildOpt6(DHCP6_OPT.CLIENTID, session.duid),
+                            buildOpt6(DHCP6_OPT.SERVERID, session.serverDuid),
+                            buildIaNA(session.index, buildIaAddr(addr.addrBuf)),
+                            elapsed
+                        ])
+                    );
+                }
+                return 'ack';
+            }
+            return null;
+        }
+    };
+}
+
+/**
+ * 压测: 一个 socket 保持 LOAD_WINDOW 个正在握手的客户端，一个结束(成功、被拒绝或超时)就开始下一个，
+ * 直到 LOAD_CLIENTS 个客户端都跑完。时延从发出 DISCOVER/SOLICIT 算到收到 ACK/REPLY。
+ */
+function runLoad() {
+    return new Promise((resolve, reject) => {
+        const socket = dgram.createSocket({
+            type: USE_V6 ? 'udp6' : 'udp4',
+            reuseAddr: true,
+            recvBufferSize: 4 * 1024 * 1024
+        });
+        const driver = USE_V6 ? dhcp6LoadDriver(socket) : dhcp4LoadDriver(socket);
+        const xidMask = USE_V6 ? 0xffffff : 0xffffffff;
+        const xidBase = randomXid();
+        const sessions = new Map(); // xid -> { index, xid, mac, step, startAt }
+        const latencies = [];
+        let acked = 0;
+        let rejected = 0;
+        let timedOut = 0;
+        let started = 0;
+        const startAt = performance.now();
+
+        const finish = () => {
+            clearInterval(timer);
+            const elapsedMs = performance.now() - startAt;
+            latencies.sort((a, b) => a - b);
+            // 稍等一下再关闭，让最后的 RELEASE 发出去
+            setTimeout(() => {
+                socket.close();
+                resolve({ acked, rejected, timedOut, elapsedMs, latencies });
+            }, 100);
+        };
+        const fill = () => {
+            while (started < LOAD_CLIENTS && sessions.size < LOAD_WINDOW) {
+                const index = started++;
+                const xid = ((xidBase + index) & xidMask) >>> 0;
+                const session = { index, xid, mac: loadMac(index), step: 0, startAt: performance.now() };
+                sessions.set(xid, session);
+                driver.begin(session);
+            }
+            if (started >= LOAD_CLIENTS && sessions.size === 0) {
+                finish();
+            }
+        };
+
+        socket.on('error', reject);
+        socket.on('message', msg => {
+            const session = sessions.get(driver.key(msg));
+            if (!session) {
+                return;
+            }
+            const result = driver.handle(session, msg);
+            if (result === null) {
+                return;
+            }
+            sessions.delete(session.xid);
+            if (result === 'ack') {
+                acked++;
+                latencies.push(performance.now() - session.startAt);
+            } else {
+                rejected++;
+            }
+            fill();
+        });
+
+        // 定时清理超时的客户端
+        const timer = setInterval(() => {
+            const now = performance.now();
+            for (const [xid, session] of sessions) {
+                if (now - session.startAt > TIMEOUT_MS) {
+                    sessions.delete(xid);
+                    timedOut++;
+                }
+            }
+            fill();
+        }, 100);
+
+        socket.bind(0, USE_V6 ? '::' : '0.0.0.0', () => {
+            if (!USE_V6) {
+                socket.setBroadcast(true);
+            }
+            fill();
+        });
+    });
+}
+
+async function mainLoad() {
+    console.log('============================================================');
+    console.log(`  DHCP${USE_V6 ? 'v6' : 'v4'} 压测`);
+    console.log('============================================================');
+    if (USE_V6) {
+        console.log(`  服务器地址: ${SERVER6_ADDR}:${DHCP6_SERVER_PORT}`);
+    } else {
+        console.log(`  服务器地址: ${SERVER_ADDR}:${DHCP_SERVER_PORT}`);
+    }
+    console.log(`  客户端数量: ${LOAD_CLIENTS}`);
+    console.log(`  并发握手:   ${LOAD_WINDOW}`);
+    console.log(`  租约后释放: ${DO_RELEASE ? '是' : '否'}`);
+    console.log('============================================================');
+
+    const result = await runLoad();
+    const fmt = value => value.toFixed(2);
+    const lat = result.latencies;
+    console.log(`  成功/拒绝/超时: ${result.acked} / ${result.rejected} / ${result.timedOut}`);
+    console.log(`  耗时:           ${fmt(result.elapsedMs / 1000)} s`);
+    console.log(`  租约速率:       ${Math.round((result.acked * 1000) / result.elapsedMs)} 租约/秒`);
+    console.log(
+        `  握手时延(ms):   p50 ${fmt(percentile(lat, 0.5))}, p90 ${fmt(percentile(lat, 0.9))}, ` +
+            `p99 ${fmt(percentile(lat, 0.99))}, max ${fmt(lat.length ? lat[lat.length - 1] : NaN)}`
+    );
+    console.log('============================================================');
+    process.exit(result.acked === LOAD_CLIENTS ? 0 : 1);
+}
+
 // ============================================================
 // 主流程
 // ============================================================
 async function main() {
+    if (LOAD_CLIENTS > 0) {
+        await mainLoad();
+        return;
+    }
+
     console.log('============================================================');
     console.log(`  DHCP${USE_V6 ? 'v6' : 'v4'} 客户端测试`);
     console.log('============================================================');
@@ -12,10 +12,13 @@
  *   --timeout <ms>   单次请求超时，默认 3000
  *   --version <n>    NTP版本，默认 4
  *   --v6             强制使用 IPv6 socket
+ *   --load <s>       压测模式：持续发送 s 秒，统计吞吐量和时间偏移分布
+ *   --window <n>     压测模式下同时在途的请求数，默认 64
  *
  * 示例：
  *   node scripts/testNtpClient.js --server 127.0.0.1 --port 1123
  *   node scripts/testNtpClient.js --server ::1 --port 1123 --v6
+ *   node scripts/testNtpClient.js --server 127.0.0.1 --port 1123 --load 10 --window 256
  */
 
 'use strict';
@@ -59,6 +62,8 @@ const REQUEST_COUNT = parsePositiveInt('--count', 1);
 const TIMEOUT_MS = parsePositiveInt('--timeout', 3000);
 const NTP_VERSION = parsePositiveInt('--version', 4);
 const USE_IPV6 = HAS_V6_FLAG || net.isIPv6(SERVER_ADDR);
+const LOAD_SECONDS = args.includes('--load') ? parsePositiveInt('--load', 10) : 0;
+const LOAD_WINDOW = parsePositiveInt('--window', 64);
 
 if (NTP_VERSION < 1 || NTP_VERSION > 4) {
     throw new Error(`--version 仅支持 1-4，当前值: ${NTP_VERSION}`);
@@ -99,6 +104,25 @@ function readTimestamp(buffer, offset) {
     return seconds * 1000 - NTP_EPOCH_OFFSET_MS + Math.round((fraction / NTP_FRACTION_SCALE) * 1000);
 }
 
+// 保留亚毫秒精度，压测统计时间偏移用
+function readTimestampPrecise(buffer, offset) {
+    const seconds = buffer.readUInt32BE(offset);
+    const fraction = buffer.readUInt32BE(offset + 4);
+    return seconds * 1000 - NTP_EPOCH_OFFSET_MS + (fraction / NTP_FRACTION_SCALE) * 1000;
+}
+
+function writeTimestampPrecise(buffer, offset, ms) {
+    const ntpMs = ms + NTP_EPOCH_OFFSET_MS;
+    const seconds = Math.floor(ntpMs / 1000);
+    buffer.writeUInt32BE(seconds >>> 0, offset);
+    buffer.writeUInt32BE(Math.floor(((ntpMs - seconds * 1000) / 1000) * NTP_FRACTION_SCALE) >>> 0, offset + 4);
+}
+
+// 亚毫秒精度的本机时间
+function preciseNow() {
+    return performance.timeOrigin + performance.now();
+}
+
 function readShortFormatMs(buffer, offset) {
     return Math.round((buffer.readUInt32BE(offset) / NTP_SHORT_SCALE) * 1000);
 }
@@ -221,7 +245,131 @@ function requestOnce() {
     });
 }
 
+function percentile(sorted, p) {
+    if (sorted.length === 0) {
+        return NaN;
+    }
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+/**
+ * 压测: 一个 socket 保持 LOAD_WINDOW 个在途请求，收到响应立即补发；
+ * 超过 TIMEOUT_MS 未响应的请求算作丢失。请求以发送时间戳(即响应的 originate)区分。
+ */
+function runLoad() {
+    return new Promise((resolve, reject) => {
+        const socket = dgram.createSocket({ type: USE_IPV6 ? 'udp6' : 'udp4', recvBufferSize: 4 * 1024 * 1024 });
+        const inflight = new Map(); // originate 时间戳(hex) -> 发送时间
+        const offsets = [];
+        const delays = [];
+        let sent = 0;
+        let received = 0;
+        let lost = 0;
+        let stopping = false;
+        const startAt = Date.now();
+
+        const sendOne = () => {
+            let t1 = preciseNow();
+            const packet = buildRequestPacket(0);
+            writeTimestampPrecise(packet, 40, t1);
+            let key = packet.toString('hex', 40, 48);
+            // 同一时刻发出的请求时间戳可能相同，错开一点以便区分
+            while (inflight.has(key)) {
+                t1 += 0.000001;
+                writeTimestampPrecise(packet, 40, t1);
+                key = packet.toString('hex', 40, 48);
+            }
+            inflight.set(key, t1);
+            sent++;
+            socket.send(packet, SERVER_PORT, SERVER_ADDR);
+        };
+
+        socket.on('error', reject);
+        socket.on('message', message => {
+            const t4 = preciseNow();
+            if (message.length < 48) {
+                return;
+            }
+            const key = message.toString('hex', 24, 32);
+            const t1 = inflight.get(key);
+            if (t1 === undefined) {
+                return;
+            }
+            inflight.delete(key);
+            received++;
+            const t2 = readTimestampPrecise(message, 32);
+            const t3 = readTimestampPrecise(message, 40);
+            offsets.push((t2 - t1 + (t3 - t4)) / 2);
+            delays.push(t4 - t1 - (t3 - t2));
+            if (!stopping) {
+                sendOne();
+            }
+        });
+
+        // 定时清理超时的请求并补足窗口
+        const timer = setInterval(() => {
+            const now = preciseNow();
+            for (const [key, t1] of inflight) {
+                if (now - t1 > TIMEOUT_MS) {
+                    inflight.delete(key);
+                    lost++;
+                }
+            }
+            if (Date.now() - startAt >= LOAD_SECONDS * 1000) {
+                stopping = true;
+            }
+            if (stopping && (inflight.size === 0 || Date.now() - startAt >= LOAD_SECONDS * 1000 + TIMEOUT_MS)) {
+                clearInterval(timer);
+                socket.close();
+                lost += inflight.size;
+                offsets.sort((a, b) => a - b);
+                delays.sort((a, b) => a - b);
+                resolve({ sent, received, lost, elapsedMs: Date.now() - startAt, offsets, delays });
+                return;
+            }
+            while (!stopping && inflight.size < LOAD_WINDOW) {
+                sendOne();
+            }
+        }, 100);
+
+        socket.bind(0, USE_IPV6 ? '::' : '0.0.0.0', () => {
+            for (let i = 0; i < LOAD_WINDOW; i++) {
+                sendOne();
+            }
+        });
+    });
+}
+
+async function mainLoad() {
+    console.log('============================================================');
+    console.log('  NTP 压测');
+    console.log('============================================================');
+    console.log(`  服务器地址: ${SERVER_ADDR}:${SERVER_PORT}`);
+    console.log(`  持续时间:   ${LOAD_SECONDS} s`);
+    console.log(`  在途请求:   ${LOAD_WINDOW}`);
+    console.log('============================================================');
+
+    const result = await runLoad();
+    const fmt = value => value.toFixed(3);
+    console.log(`  发送/响应/丢失: ${result.sent} / ${result.received} / ${result.lost}`);
+    console.log(`  吞吐量:         ${Math.round((result.received * 1000) / (LOAD_SECONDS * 1000))} 请求/秒`);
+    console.log(
+        `  时间偏移(ms):   p50 ${fmt(percentile(result.offsets, 0.5))}, ` +
+            `p1 ${fmt(percentile(result.offsets, 0.01))}, p99 ${fmt(percentile(result.offsets, 0.99))}`
+    );
+    console.log(
+        `  往返时延(ms):   p50 ${fmt(percentile(result.delays, 0.5))}, p99 ${fmt(percentile(result.delays, 0.99))}`
+    );
+    console.log('============================================================');
+    process.exit(result.received > 0 ? 0 : 1);
+}
+
 async function main() {
+    if (LOAD_SECONDS > 0) {
+        await mainLoad();
+        return;
+    }
+
     console.log('============================================================');
     console.log('  NTP 客户端测试');
     console.log('============================================================');
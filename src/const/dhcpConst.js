@@ -5,7 +5,7 @@ export const DHCP_EVT_TYPES = {
 
 // DHCP子事件类型
 export const DHCP_SUB_EVT_TYPES = {
-    DHCP_SUB_EVT_LEASE: 1, // 租约变更（add/remove/update）
+    DHCP_SUB_EVT_LEASE_BATCH: 1, // 一个推送周期内的租约变更（add/remove/update）
     DHCP_SUB_EVT_LOG: 2 // 日志事件
 };
 
@@ -8,7 +8,7 @@ export const DEFAULT_VALUES = {
 };
 
 export const NTP_SUB_EVT_TYPES = {
-    REQUEST_RECEIVED: 1,
+    REQUEST_BATCH: 1,
     SERVER_STATUS: 2,
     HISTORY_CLEARED: 3
 };
@@ -18,6 +18,9 @@ export const NTP_EVENT_PAGE_ID = {
     PAGE_ID_NTP_REQUEST_LOG: 2
 };
 
+// 请求日志最多保留的条数，与后台一致
+export const NTP_MAX_REQUEST_LOG = 200;
+
 export const NTP_REQUEST_STATUS = {
     REPLIED: 'replied',
     IGNORED: 'ignored',
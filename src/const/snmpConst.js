@@ -1,6 +1,7 @@
 // SNMP事件类型
 export const SNMP_EVT_TYPES = {
-    TRAP_EVT: 1
+    TRAP_EVT: 1,
+    POLL_EVT: 2
 };
 
 export const SNMP_SUB_EVT_TYPES = {
@@ -9,7 +10,9 @@ export const SNMP_SUB_EVT_TYPES = {
     AGENT_DISCONNECTION: 3,
     TRAP_PROCESSED: 4,
     TRAP_ERROR: 5,
-    SERVER_STATUS: 6
+    SERVER_STATUS: 6,
+    TRAP_BATCH: 7,
+    POLL_RESULT: 8
 };
 
 // SNMP版本
@@ -0,0 +1,237 @@
+/**
+ * BGP UPDATE 快速解码测试
+ * 使用方法: node test/bgp_update_decoder_test.js
+ *
+ * 手工拼出 UPDATE 报文，检查 IPv4 NLRI/撤销路由、ADD-PATH、MP_REACH/MP_UNREACH 中的 IPv6 和 VPN 前缀、
+ * 延迟解析的路径属性，以及长度错误的报文整体作废
+ */
+
+const assert = require('assert');
+const { decodeUpdate } = require('../electron/utils/bgpUpdateDecoder');
+const BgpConst = require('../electron/const/bgpConst');
+
+const ATTR = BgpConst.BGP_PATH_ATTR;
+const FLAGS = BgpConst.BGP_PATH_ATTR_FLAGS;
+const AFI = BgpConst.BGP_AFI_TYPE;
+const SAFI = BgpConst.BGP_SAFI_TYPE;
+
+function attribute(flags, type, value) {
+    if (value.length > 0xff) {
+        const header = Buffer.from([flags | FLAGS.EXTENDED_LENGTH, type, 0, 0]);
+        header.writeUInt16BE(value.length, 2);
+        return Buffer.concat([header, value]);
+    }
+    return Buffer.concat([Buffer.from([flags, type, value.length]), value]);
+}
+
+// IPv4/IPv6 前缀: 长度字节 + 有效字节，pathId 不为 undefined 时在前面加 4 字节 Path ID
+function prefix(bytes, bits, pathId) {
+    const body = Buffer.from([bits, ...bytes.slice(0, (bits + 7) >> 3)]);
+    if (pathId === undefined) {
+        return body;
+    }
+    const id = Buffer.alloc(4);
+    id.writeUInt32BE(pathId);
+    return Buffer.concat([id, body]);
+}
+
+function update({ withdrawn = [], attributes = [], nlri = [] } = {}) {
+    const withdrawnBuffer = Buffer.concat(withdrawn);
+    const attributesBuffer = Buffer.concat(attributes);
+    const nlriBuffer = Buffer.concat(nlri);
+    const length = BgpConst.BGP_HEAD_LEN + 2 + withdrawnBuffer.length + 2 + attributesBuffer.length + nlriBuffer.length;
+    const header = Buffer.alloc(BgpConst.BGP_HEAD_LEN, 0xff);
+    header.writeUInt16BE(length, BgpConst.BGP_MARKER_LEN);
+    header[BgpConst.BGP_MARKER_LEN + 2] = BgpConst.BGP_PACKET_TYPE.UPDATE;
+    const withdrawnLength = Buffer.alloc(2);
+    withdrawnLength.writeUInt16BE(withdrawnBuffer.length);
+    const attributesLength = Buffer.alloc(2);
+    attributesLength.writeUInt16BE(attributesBuffer.length);
+    return Buffer.concat([header, withdrawnLength, withdrawnBuffer, attributesLength, attributesBuffer, nlriBuffer]);
+}
+
+function toArray(list) {
+    const routes = [];
+    for (let i = 0; i < list.count; i++) {
+        const route = `${list.prefix(i)}/${list.prefixLength(i)}`;
+        routes.push(list.rd(i) ? `${list.rd(i)} ${route}` : route);
+    }
+    return routes;
+}
+
+const origin = attribute(FLAGS.TRANSITIVE, ATTR.ORIGIN, Buffer.from([0]));
+const nextHop = attribute(FLAGS.TRANSITIVE, ATTR.NEXT_HOP, Buffer.from([192, 0, 2, 1]));
+const ipv6Address = [0x20, 0x01, 0x0d, 0xb8, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1];
+
+const tests = {
+    'IPv4 NLRI, withdrawn routes and lazy attributes': () => {
+        const asPath = Buffer.from([BgpConst.BGP_AS_PATH_TYPE.AS_SEQUENCE, 2, 0, 0, 0xfd, 0xe9, 0, 0, 0xfd, 0xea]);
+        const communities = Buffer.from([0xfd, 0xe9, 0, 100, 0xfd, 0xe9, 0, 200]);
+        const med = Buffer.alloc(4);
+        med.writeUInt32BE(50);
+        const decoded = decodeUpdate(
+            update({
+                withdrawn: [prefix([10, 9, 0, 0], 16)],
+                attributes: [
+                    origin,
+                    attribute(FLAGS.TRANSITIVE, ATTR.AS_PATH, asPath),
+                    nextHop,
+                    attribute(FLAGS.OPTIONAL, ATTR.MED, med),
+                    attribute(FLAGS.OPTIONAL | FLAGS.TRANSITIVE, ATTR.COMMUNITY, communities)
+                ],
+                // 前缀中超出掩码的位被清零
+                nlri: [prefix([10, 1, 0, 0], 16), prefix([172, 16, 255, 255], 20), prefix([], 0)]
+            }),
+            { asnSize: 4 }
+        );
+        assert.ok(decoded.valid, decoded.error);
+        assert.deepStrictEqual(toArray(decoded.withdrawn), ['10.9.0.0/16']);
+        assert.deepStrictEqual(toArray(decoded.nlri), ['10.1.0.0/16', '172.16.240.0/20', '0.0.0.0/0']);
+        assert.strictEqual(decoded.attributes.origin, 'IGP');
+        assert.strictEqual(decoded.attributes.asPath, '65001 65002');
+        assert.strictEqual(decoded.attributes.nextHop, '192.0.2.1');
+        assert.strictEqual(decoded.attributes.med, 50);
+        assert.strictEqual(decoded.attributes.localPref, undefined);
+        assert.strictEqual(decoded.attributes.communities, '65001:100 65001:200');
+        assert.strictEqual(decoded.attributes.mpReach, undefined);
+    },
+
+    'two-byte AS_PATH is inferred without a negotiated ASN size': () => {
+        const asPath = Buffer.from([BgpConst.BGP_AS_PATH_TYPE.AS_SET, 2, 0xfd, 0xe9, 0xfd, 0xea]);
+        const decoded = decodeUpdate(update({ attributes: [attribute(FLAGS.TRANSITIVE, ATTR.AS_PATH, asPath)] }));
+        assert.ok(decoded.valid, decoded.error);
+        assert.strictEqual(decoded.attributes.asPath, '{65001 65002}');
+    },
+
+    'ADD-PATH prefixes carry their path IDs': () => {
+        const context = {
+            isAddPathReceiveEnabled: (afi, safi) => afi === AFI.AFI_IPV4 && safi === SAFI.SAFI_UNICAST
+        };
+        const decoded = decodeUpdate(
+            update({
+                attributes: [origin, nextHop],
+                nlri: [prefix([10, 1, 0, 0], 16, 1), prefix([10, 1, 0, 0], 16, 7)]
+            }),
+            context
+        );
+        assert.ok(decoded.valid, decoded.error);
+        assert.deepStrictEqual(toArray(decoded.nlri), ['10.1.0.0/16', '10.1.0.0/16']);
+        assert.deepStrictEqual([decoded.nlri.pathId(0), decoded.nlri.pathId(1)], [1, 7]);
+    },
+
+    'MP_REACH and MP_UNREACH for IPv6 unicast': () => {
+        const reach = Buffer.concat([
+            Buffer.from([0, AFI.AFI_IPV6, SAFI.SAFI_UNICAST, 16]),
+            Buffer.from(ipv6Address),
+            Buffer.from([0]),
+            prefix([0x20, 0x01, 0x0d, 0xb8, 0, 2], 48),
+            prefix([0x20, 0x01, 0x0d, 0xb8, 0, 3, 0, 0x80], 57)
+        ]);
+        const unreach = Buffer.concat([Buffer.from([0, AFI.AFI_IPV6, SAFI.SAFI_UNICAST]), prefix([0x20, 0x01], 16)]);
+        const decoded = decodeUpdate(
+            update({
+                attributes: [
+                    origin,
+                    attribute(FLAGS.OPTIONAL, ATTR.MP_REACH_NLRI, reach),
+                    attribute(FLAGS.OPTIONAL, ATTR.MP_UNREACH_NLRI, unreach)
+                ]
+            })
+        );
+        assert.ok(decoded.valid, decoded.error);
+        const mpReach = decoded.attributes.mpReach;
+        assert.strictEqual(mpReach.afi, AFI.AFI_IPV6);
+        assert.strictEqual(mpReach.nextHop, '2001:db8:1::1');
+        assert.deepStrictEqual(toArray(mpReach.nlri), ['2001:db8:2::/48', '2001:db8:3:80::/57']);
+        assert.deepStrictEqual(toArray(decoded.attributes.mpUnreach.withdrawnRoutes), ['2001::/16']);
+    },
+
+    'VPNv4 prefixes expose label and RD': () => {
+        // 标签 100，栈底标记置位；RD 类型 0: 65001:7
+        const label = [0x00, 0x06, 0x41];
+        const rd = [0, 0, 0xfd, 0xe9, 0, 0, 0, 7];
+        const vpnPrefix = Buffer.from([24 + 64 + 24, ...label, ...rd, 10, 1, 2]);
+        const reach = Buffer.concat([
+            Buffer.from([0, AFI.AFI_IPV4, SAFI.SAFI_VPN, 12]),
+            Buffer.alloc(8),
+            Buffer.from([192, 0, 2, 9]),
+            Buffer.from([0]),
+            vpnPrefix
+        ]);
+        const decoded = decodeUpdate(
+            update({ attributes: [origin, attribute(FLAGS.OPTIONAL, ATTR.MP_REACH_NLRI, reach)] })
+        );
+        assert.ok(decoded.valid, decoded.error);
+        const nlri = decoded.attributes.mpReach.nlri;
+        assert.strictEqual(decoded.attributes.mpReach.nextHop, '192.0.2.9');
+        assert.deepStrictEqual(toArray(nlri), ['65001:7 10.1.2.0/24']);
+        assert.strictEqual(nlri.label(0), 100);
+    },
+
+    'extended-length attributes are accepted': () => {
+        const communities = Buffer.alloc(4 * 100);
+        for (let i = 0; i < 100; i++) {
+            communities.writeUInt16BE(65001, i * 4);
+            communities.writeUInt16BE(i, i * 4 + 2);
+        }
+        const decoded = decodeUpdate(
+            update({ attributes: [attribute(FLAGS.OPTIONAL | FLAGS.TRANSITIVE, ATTR.COMMUNITY, communities)] })
+        );
+        assert.ok(decoded.valid, decoded.error);
+        assert.strictEqual(decoded.attributes.communities.split(' ').length, 100);
+    },
+
+    'malformed updates are rejected as a whole': () => {
+        const good = update({ attributes: [origin, nextHop], nlri: [prefix([10, 1, 0, 0], 16)] });
+
+        // 最后一个前缀的长度超出报文
+        const truncated = Buffer.concat([good, Buffer.from([24, 10])]);
+        truncated.writeUInt16BE(truncated.length, BgpConst.BGP_MARKER_LEN);
+        let decoded = decodeUpdate(truncated);
+        assert.ok(!decoded.valid);
+        assert.strictEqual(decoded.nlri.count, 0, '作废的报文不应返回部分 NLRI');
+
+        // 前缀长度超过 32 位
+        decoded = decodeUpdate(update({ nlri: [Buffer.from([33, 10, 0, 0, 0, 0])] }));
+        assert.ok(!decoded.valid);
+
+        // MP_REACH 中的 NLRI 错误同样使整个报文作废
+        const reach = Buffer.concat([
+            Buffer.from([0, AFI.AFI_IPV6, SAFI.SAFI_UNICAST, 16]),
+            Buffer.from(ipv6Address),
+            Buffer.from([0, 129])
+        ]);
+        decoded = decodeUpdate(
+            update({
+                attributes: [attribute(FLAGS.OPTIONAL, ATTR.MP_REACH_NLRI, reach)],
+                nlri: [prefix([10, 1, 0, 0], 16)]
+            })
+        );
+        assert.ok(!decoded.valid);
+        assert.strictEqual(decoded.nlri.count, 0);
+
+        // 不是 UPDATE
+        const keepalive = Buffer.from(good);
+        keepalive[BgpConst.BGP_MARKER_LEN + 2] = BgpConst.BGP_PACKET_TYPE.KEEPALIVE;
+        assert.ok(!decodeUpdate(keepalive).valid);
+    }
+};
+
+function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };
@@ -0,0 +1,153 @@
+/**
+ * DHCP 地址池位图和租约表测试
+ * 使用方法: node test/lease_store_test.js
+ *
+ * 检查位图的 next-fit 分配、尾部越界位、占用/释放计数，以及租约表的预留、绑定、换地址、
+ * 预留超时和租约到期(通过拨动定时轮的起点模拟时间流逝，不实际等待)
+ */
+
+const assert = require('assert');
+const AddressPool = require('../electron/utils/addressPool');
+const LeaseStore = require('../electron/utils/leaseStore');
+
+// 让租约表的定时轮前进 ms 毫秒
+function elapse(store, ms) {
+    store.wheel.origin -= ms;
+    store.wheel.advance();
+}
+
+const tests = {
+    'pool allocates every address once and never past the end': () => {
+        const pool = new AddressPool(70);
+        const seen = new Set();
+        for (let i = 0; i < 70; i++) {
+            const offset = pool.allocate();
+            assert.ok(offset >= 0 && offset < 70, `偏移越界: ${offset}`);
+            assert.ok(!seen.has(offset), `重复分配: ${offset}`);
+            seen.add(offset);
+        }
+        assert.strictEqual(pool.allocate(), -1);
+        assert.strictEqual(pool.freeCount, 0);
+    },
+
+    'pool continues after the last allocation and wraps around': () => {
+        const pool = new AddressPool(100);
+        for (let i = 0; i < 40; i++) {
+            pool.allocate();
+        }
+        pool.release(3);
+        // next-fit: 先用完当前字之后的地址，不立即回头使用刚释放的 3
+        assert.strictEqual(pool.allocate(), 40);
+        for (let i = 41; i < 100; i++) {
+            assert.strictEqual(pool.allocate(), i);
+        }
+        assert.strictEqual(pool.allocate(), 3, '池尾之后应回到开头查找');
+        assert.strictEqual(pool.allocate(), -1);
+    },
+
+    'reserve and release keep the counters consistent': () => {
+        const pool = new AddressPool(33);
+        assert.ok(pool.reserve(32));
+        assert.ok(!pool.reserve(32), '重复占用应返回 false');
+        assert.ok(!pool.reserve(33), '池外地址不能占用');
+        assert.ok(!pool.reserve(-1));
+        assert.strictEqual(pool.freeCount, 32);
+        pool.release(32);
+        pool.release(32);
+        pool.release(5);
+        assert.strictEqual(pool.freeCount, 33, '释放空闲地址不应改变计数');
+        pool.clear();
+        assert.strictEqual(pool.freeCount, 33);
+        assert.ok(!pool.isFree(40), '尾部超出池大小的位始终占用');
+    },
+
+    'offer reserves an address until the hold time expires': () => {
+        const store = new LeaseStore(2, null, 100);
+        const a = store.offer('aa', 1000);
+        const b = store.offer('bb', 1000);
+        assert.notStrictEqual(a, b);
+        assert.strictEqual(store.offer('cc', 1000), -1, '预留中的地址不能再分给其他客户端');
+        assert.strictEqual(store.offer('aa', 1000), a, '同一客户端沿用原来的预留');
+        assert.strictEqual(store.ownerOf(a), 'aa');
+        assert.strictEqual(store.get('aa'), null, '仅预留时没有租约');
+
+        elapse(store, 1100);
+        assert.strictEqual(store.ownerOf(a), null);
+        assert.strictEqual(store.pool.freeCount, 2);
+        assert.notStrictEqual(store.offer('cc', 1000), -1);
+    },
+
+    'bind turns an offer into a lease that expires': () => {
+        const expired = [];
+        const store = new LeaseStore(4, (clientId, lease) => expired.push([clientId, lease.ip]), 100);
+        const offset = store.offer('aa', 500);
+        assert.ok(store.bind('aa', offset, { ip: 'x' }, 3000));
+        assert.strictEqual(store.leaseCount, 1);
+
+        // 预留时长已过，但租约未到期
+        elapse(store, 1000);
+        assert.strictEqual(store.get('aa').ip, 'x');
+
+        // 续约推迟到期时间
+        assert.ok(store.bind('aa', offset, { ip: 'y' }, 3000));
+        assert.strictEqual(store.leaseCount, 1);
+        elapse(store, 2500);
+        assert.deepStrictEqual(expired, []);
+        elapse(store, 600);
+        assert.deepStrictEqual(expired, [['aa', 'y']]);
+        assert.strictEqual(store.leaseCount, 0);
+        assert.strictEqual(store.pool.freeCount, 4);
+    },
+
+    'bind to another address moves the client and rejects taken addresses': () => {
+        const store = new LeaseStore(4, null, 100);
+        assert.ok(store.bind('aa', 1, { ip: 'a' }, 10000));
+        assert.ok(!store.bind('bb', 1, { ip: 'b' }, 10000), '其他客户端的地址不能绑定');
+        assert.ok(!store.bind('bb', 9, { ip: 'b' }, 10000), '池外地址不能绑定');
+
+        assert.ok(store.bind('aa', 2, { ip: 'a2' }, 10000));
+        assert.strictEqual(store.ownerOf(1), null, '原地址应释放');
+        assert.strictEqual(store.ownerOf(2), 'aa');
+        assert.strictEqual(store.pool.freeCount, 3);
+        assert.strictEqual(store.leaseCount, 1);
+    },
+
+    'cancelOffer and release free the address without the expire callback': () => {
+        const expired = [];
+        const store = new LeaseStore(2, clientId => expired.push(clientId), 100);
+        store.offer('aa', 1000);
+        store.cancelOffer('aa');
+        assert.strictEqual(store.pool.freeCount, 2);
+
+        const offset = store.offer('bb', 1000);
+        store.bind('bb', offset, { ip: 'b' }, 1000);
+        store.cancelOffer('bb');
+        assert.strictEqual(store.get('bb').ip, 'b', '已有租约时 cancelOffer 不生效');
+        assert.strictEqual(store.release('bb').ip, 'b');
+        assert.strictEqual(store.release('bb'), null);
+
+        elapse(store, 2000);
+        assert.deepStrictEqual(expired, []);
+        assert.strictEqual(store.wheel.size, 0, '释放后定时器应取消');
+    }
+};
+
+function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };
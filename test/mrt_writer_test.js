@@ -0,0 +1,259 @@
+/**
+ * MRT TABLE_DUMP_V2 导出测试
+ * 使用方法: node test/mrt_writer_test.js
+ *
+ * 用 BmpRouteTable 快照导出到临时文件再读回，检查对等体索引表、按前缀归并的 RIB 记录、
+ * ADD-PATH 的 Path Identifier、路径属性的改写(2 字节 AS_PATH 扩展、MP_REACH_NLRI 只留下一跳)以及 gzip 输出
+ */
+
+const assert = require('assert');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const zlib = require('zlib');
+const { writeRibDump, MRT_SUBTYPE } = require('../electron/utils/mrtWriter');
+const { decodeUpdate } = require('../electron/utils/bgpUpdateDecoder');
+const BmpRouteTable = require('../electron/worker/bmpRouteTable');
+const BgpConst = require('../electron/const/bgpConst');
+
+const ATTR = BgpConst.BGP_PATH_ATTR;
+const FLAGS = BgpConst.BGP_PATH_ATTR_FLAGS;
+const AFI = BgpConst.BGP_AFI_TYPE;
+
+function attribute(flags, type, value) {
+    return Buffer.concat([Buffer.from([flags, type, value.length]), value]);
+}
+
+// 只含路径属性的 UPDATE 解码结果，asPath 为 2 字节 AS 号
+function decodedUpdate(asPath, extra = []) {
+    const segment = Buffer.alloc(2 + asPath.length * 2);
+    segment[0] = BgpConst.BGP_AS_PATH_TYPE.AS_SEQUENCE;
+    segment[1] = asPath.length;
+    asPath.forEach((as, i) => segment.writeUInt16BE(as, 2 + i * 2));
+    const attributes = Buffer.concat([
+        attribute(FLAGS.TRANSITIVE, ATTR.ORIGIN, Buffer.from([0])),
+        attribute(FLAGS.TRANSITIVE, ATTR.AS_PATH, segment),
+        ...extra
+    ]);
+    const header = Buffer.alloc(BgpConst.BGP_HEAD_LEN, 0xff);
+    header.writeUInt16BE(BgpConst.BGP_HEAD_LEN + 4 + attributes.length, BgpConst.BGP_MARKER_LEN);
+    header[BgpConst.BGP_MARKER_LEN + 2] = BgpConst.BGP_PACKET_TYPE.UPDATE;
+    const lengths = Buffer.from([0, 0, attributes.length >> 8, attributes.length & 0xff]);
+    const update = decodeUpdate(Buffer.concat([header, lengths, attributes]), { asnSize: 2 });
+    assert.ok(update.valid, update.error);
+    return update;
+}
+
+function table(routes) {
+    const routeTable = new BmpRouteTable();
+    for (const [ip, mask, pathId, update] of routes) {
+        routeTable.set(`${pathId}||${ip}|${mask}`, { bgpPacket: update });
+    }
+    return routeTable.snapshot();
+}
+
+// 把 MRT 文件拆成记录，解析 PEER_INDEX_TABLE 和 RIB 记录
+function parseMrt(buffer, addPath) {
+    const records = [];
+    let offset = 0;
+    while (offset < buffer.length) {
+        const type = buffer.readUInt16BE(offset + 4);
+        const subtype = buffer.readUInt16BE(offset + 6);
+        const length = buffer.readUInt32BE(offset + 8);
+        const body = buffer.subarray(offset + 12, offset + 12 + length);
+        assert.strictEqual(type, 13, 'MRT 类型应为 TABLE_DUMP_V2');
+        assert.strictEqual(body.length, length, 'MRT 记录长度越界');
+        offset += 12 + length;
+
+        if (subtype === MRT_SUBTYPE.PEER_INDEX_TABLE) {
+            const viewLength = body.readUInt16BE(4);
+            const peers = [];
+            let pos = 6 + viewLength + 2;
+            for (let i = 0; i < body.readUInt16BE(6 + viewLength); i++) {
+                const addressLength = body[pos] & 0x01 ? 16 : 4;
+                peers.push({
+                    type: body[pos],
+                    address: [...body.subarray(pos + 5, pos + 5 + addressLength)].join('.'),
+                    as: body.readUInt32BE(pos + 5 + addressLength)
+                });
+                pos += 1 + 4 + addressLength + 4;
+            }
+            records.push({ subtype, view: body.toString('utf8', 6, 6 + viewLength), peers });
+            continue;
+        }
+
+        const prefixLength = body[4];
+        const prefixBytes = (prefixLength + 7) >> 3;
+        const prefix = body.subarray(5, 5 + prefixBytes).toString('hex');
+        let pos = 5 + prefixBytes;
+        const entries = [];
+        const count = body.readUInt16BE(pos);
+        pos += 2;
+        for (let i = 0; i < count; i++) {
+            const entry = { peerIndex: body.readUInt16BE(pos) };
+            pos += 6;
+            if (addPath) {
+                entry.pathId = body.readUInt32BE(pos);
+                pos += 4;
+            }
+            const attrLength = body.readUInt16BE(pos);
+            entry.attributes = body.subarray(pos + 2, pos + 2 + attrLength);
+            pos += 2 + attrLength;
+            entries.push(entry);
+        }
+        assert.strictEqual(pos, body.length, 'RIB 条目长度之和应等于记录长度');
+        records.push({ subtype, sequence: body.readUInt32BE(0), prefix: `${prefix}/${prefixLength}`, entries });
+    }
+    return records;
+}
+
+// RIB 条目属性中指定类型的属性值
+function findAttribute(attributes, type) {
+    let pos = 0;
+    while (pos < attributes.length) {
+        const extended = attributes[pos] & FLAGS.EXTENDED_LENGTH;
+        const length = extended ? attributes.readUInt16BE(pos + 2) : attributes[pos + 2];
+        const start = pos + (extended ? 4 : 3);
+        if (attributes[pos + 1] === type) {
+            return attributes.subarray(start, start + length);
+        }
+        pos = start + length;
+    }
+    return null;
+}
+
+const tempDirs = [];
+
+function tempFile(name) {
+    const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'mrt-test-'));
+    tempDirs.push(dir);
+    return path.join(dir, name);
+}
+
+const tests = {
+    'peers are merged per prefix in prefix order': async () => {
+        const shared = decodedUpdate([65001, 65100]);
+        const other = decodedUpdate([65002]);
+        const peers = [
+            {
+                ip: '192.0.2.1',
+                as: 65001,
+                bgpId: '1.1.1.1',
+                snapshot: table([
+                    ['10.1.0.0', 16, 0, shared],
+                    ['10.0.0.0', 8, 0, shared]
+                ])
+            },
+            {
+                ip: '192.0.2.2',
+                as: 65002,
+                bgpId: '2.2.2.2',
+                snapshot: table([
+                    ['10.1.0.0', 16, 0, other],
+                    ['10.1.0.0', 24, 0, other]
+                ])
+            },
+            // 同一对等体的第二份快照在索引表中只出现一次
+            { ip: '192.0.2.1', as: 65001, bgpId: '1.1.1.1', snapshot: table([['10.2.0.0', 16, 0, shared]]) }
+        ];
+        const file = tempFile('rib.mrt');
+        const stats = await writeRibDump(file, { afi: AFI.AFI_IPV4, peers, collectorId: '9.9.9.9', viewName: 'test' });
+        const records = parseMrt(fs.readFileSync(file), false);
+
+        assert.strictEqual(records[0].subtype, MRT_SUBTYPE.PEER_INDEX_TABLE);
+        assert.strictEqual(records[0].view, 'test');
+        assert.deepStrictEqual(
+            records[0].peers.map(peer => `${peer.address} AS${peer.as}`),
+            ['192.0.2.1 AS65001', '192.0.2.2 AS65002']
+        );
+
+        const ribs = records.slice(1);
+        assert.ok(ribs.every(record => record.subtype === MRT_SUBTYPE.RIB_IPV4_UNICAST));
+        assert.deepStrictEqual(ribs.map(record => record.prefix), ['0a/8', '0a01/16', '0a0100/24', '0a02/16']);
+        assert.deepStrictEqual(ribs.map(record => record.sequence), [0, 1, 2, 3]);
+        assert.deepStrictEqual(ribs[1].entries.map(entry => entry.peerIndex), [0, 1]);
+        assert.strictEqual(ribs[3].entries[0].peerIndex, 0);
+        const size = fs.statSync(file).size;
+        assert.deepStrictEqual(stats, { peers: 2, prefixes: 4, entries: 5, attributes: 2, bytes: size });
+    },
+
+    'AS_PATH is widened and MP_REACH keeps only the next hop': async () => {
+        const nextHop = [0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1];
+        const reach = Buffer.from([0, AFI.AFI_IPV6, 1, 16, ...nextHop, 0, 32, 0x20, 0x01, 0x0d, 0xb8]);
+        const update = decodedUpdate([65001, 65100], [attribute(FLAGS.OPTIONAL, ATTR.MP_REACH_NLRI, reach)]);
+        const peers = [
+            { ip: '2001:db8::1', as: 65001, bgpId: '1.1.1.1', snapshot: table([['2001:db8::', 32, 0, update]]) }
+        ];
+        const file = tempFile('rib6.mrt');
+        await writeRibDump(file, { afi: AFI.AFI_IPV6, peers });
+        const records = parseMrt(fs.readFileSync(file), false);
+
+        assert.strictEqual(records[0].peers[0].type & 0x01, 0x01, 'IPv6 对等体应设置 Peer Type 的 IPv6 位');
+        assert.strictEqual(records[1].subtype, MRT_SUBTYPE.RIB_IPV6_UNICAST);
+        assert.strictEqual(records[1].prefix, '20010db8/32');
+        const attributes = records[1].entries[0].attributes;
+        assert.strictEqual(findAttribute(attributes, ATTR.AS_PATH).toString('hex'), '0202' + '0000fde9' + '0000fe4c');
+        assert.deepStrictEqual([...findAttribute(attributes, ATTR.MP_REACH_NLRI)], [16, ...nextHop]);
+    },
+
+    'ADD-PATH entries carry the path identifier': async () => {
+        const update = decodedUpdate([65001]);
+        const peers = [
+            {
+                ip: '192.0.2.1',
+                as: 65001,
+                bgpId: '1.1.1.1',
+                snapshot: table([
+                    ['10.0.0.0', 8, 7, update],
+                    ['10.0.0.0', 8, 3, update]
+                ])
+            }
+        ];
+        const file = tempFile('addpath.mrt');
+        await writeRibDump(file, { afi: AFI.AFI_IPV4, peers, addPath: true });
+        const records = parseMrt(fs.readFileSync(file), true);
+        assert.strictEqual(records[1].subtype, MRT_SUBTYPE.RIB_IPV4_UNICAST_ADDPATH);
+        assert.deepStrictEqual(records[1].entries.map(entry => entry.pathId), [3, 7]);
+    },
+
+    'gzip output and empty tables': async () => {
+        const file = tempFile('empty.mrt.gz');
+        const stats = await writeRibDump(file, {
+            afi: AFI.AFI_IPV4,
+            peers: [{ ip: '192.0.2.1', as: 65001, bgpId: '1.1.1.1', snapshot: table([]) }]
+        });
+        const records = parseMrt(zlib.gunzipSync(fs.readFileSync(file)), false);
+        assert.strictEqual(records.length, 1, '只有对等体索引表');
+        assert.strictEqual(stats.prefixes, 0);
+    },
+
+    'write errors are reported': async () => {
+        await assert.rejects(
+            writeRibDump(path.join(os.tmpdir(), 'mrt-test-missing-dir', 'rib.mrt'), { afi: AFI.AFI_IPV4, peers: [] }),
+            /ENOENT/
+        );
+    }
+};
+
+async function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            await test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    for (const dir of tempDirs.splice(0)) {
+        fs.rmSync(dir, { recursive: true, force: true });
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };
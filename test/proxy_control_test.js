@@ -0,0 +1,137 @@
+/**
+ * 代理控制行测试
+ * 使用方法: node test/proxy_control_test.js
+ *
+ * 用假的 SSH 连接代替远程守护进程，检查命令按单行发出、含控制字符的参数在发送前被拒绝，
+ * 以及应答按行拆分后与请求按顺序对应
+ */
+
+const assert = require('assert');
+const { EventEmitter } = require('events');
+const SshTunnel = require('../electron/worker/sshTunnel');
+
+// 记录写入内容的假控制通道，应答由测试通过 reply() 写回
+class FakeStream extends EventEmitter {
+    constructor() {
+        super();
+        this.stderr = new EventEmitter();
+        this.written = [];
+    }
+
+    write(data) {
+        this.written.push(data);
+    }
+
+    close() {
+        this.emit('close');
+    }
+
+    reply(data) {
+        this.emit('data', Buffer.from(data));
+    }
+}
+
+function createTunnel() {
+    const tunnel = new SshTunnel();
+    const streams = [];
+    tunnel.conn = {
+        exec: (command, callback) => {
+            const stream = new FakeStream();
+            streams.push(stream);
+            callback(null, stream);
+        }
+    };
+    return { tunnel, streams };
+}
+
+// 等待命令写入通道
+function flush() {
+    return new Promise(resolve => setImmediate(resolve));
+}
+
+const tests = {
+    'command is sent as one line': async () => {
+        const { tunnel, streams } = createTunnel();
+        const promise = tunnel.sendControlCommand(false, 'ADD bmp 11019 127.0.0.1:11020 192.0.2.1 secret');
+        await flush();
+        assert.deepStrictEqual(streams[0].written, ['ADD bmp 11019 127.0.0.1:11020 192.0.2.1 secret\n']);
+        streams[0].reply('OK {"port":11019}\n');
+        assert.deepStrictEqual(await promise, { port: 11019 });
+    },
+
+    'control characters are rejected before sending': async () => {
+        const { tunnel, streams } = createTunnel();
+        for (const secret of ['a\nSTOP bmp', 'a\rb', 'a\0b', 'a\tb', 'a\x7fb']) {
+            await assert.rejects(
+                tunnel.sendControlCommand(false, `KEYS bmp 192.0.2.1 ${secret}`),
+                /control characters/
+            );
+        }
+        assert.strictEqual(streams.length, 0, '不应打开控制通道');
+        // 非 ASCII 字符不是控制字符
+        assert.doesNotThrow(() => SshTunnel.checkControlCommand('KEYS bmp 192.0.2.1 密码'));
+    },
+
+    'replies split across chunks match requests in order': async () => {
+        const { tunnel, streams } = createTunnel();
+        const first = tunnel.sendControlCommand(true, 'PING');
+        const second = tunnel.sendControlCommand(true, 'STATS bmp');
+        await flush();
+        assert.strictEqual(streams.length, 1, '同一种认证方式共用一个通道');
+        streams[0].reply('OK {"pid"');
+        streams[0].reply(':1}\r\nERR no such');
+        streams[0].reply(' listener\n');
+        assert.deepStrictEqual(await first, { pid: 1 });
+        await assert.rejects(second, /^Error: no such listener$/);
+    },
+
+    'non-reply lines are ignored': async () => {
+        const { tunnel, streams } = createTunnel();
+        const promise = tunnel.sendControlCommand(false, 'PING');
+        await flush();
+        streams[0].reply('\nTCP MD5 proxy daemon ready\nOK\n');
+        assert.deepStrictEqual(await promise, {});
+    },
+
+    'invalid JSON reply is rejected': async () => {
+        const { tunnel, streams } = createTunnel();
+        const promise = tunnel.sendControlCommand(false, 'PING');
+        await flush();
+        streams[0].reply('OK {broken\n');
+        await assert.rejects(promise, /Invalid proxy control reply/);
+    },
+
+    'closing the channel rejects pending requests': async () => {
+        const { tunnel, streams } = createTunnel();
+        const promise = tunnel.sendControlCommand(false, 'PING');
+        await flush();
+        streams[0].close();
+        await assert.rejects(promise, /channel closed/);
+        // 下一条命令重新打开通道
+        const next = tunnel.sendControlCommand(false, 'PING');
+        await flush();
+        assert.strictEqual(streams.length, 2);
+        streams[1].reply('OK\n');
+        await next;
+    }
+};
+
+async function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            await test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };
@@ -0,0 +1,169 @@
+/**
+ * RPKI 序列号/增量缓存测试
+ * 使用方法: node test/rpki_cache_test.js
+ *
+ * 检查全量快照、多个序列号合并后的增量、历史不足时返回 null（Cache Reset），
+ * 以及同一批次内的增删抵消
+ */
+
+const assert = require('assert');
+const RpkiCache = require('../electron/worker/rpkiCache');
+const RpkiRoa = require('../electron/worker/rpkiRoa');
+const RpkiConst = require('../electron/const/rpkiConst');
+const BgpConst = require('../electron/const/bgpConst');
+
+const V0 = RpkiConst.RPKI_PROTOCOL_VERSION.V0;
+const V1 = RpkiConst.RPKI_PROTOCOL_VERSION.V1;
+
+function roa(ip, mask, asn, maxLength) {
+    const ipType = ip.includes(':') ? BgpConst.IP_TYPE.IPV6 : BgpConst.IP_TYPE.IPV4;
+    return { key: RpkiRoa.makeKey(ip, mask, asn, maxLength), roa: new RpkiRoa(ip, mask, asn, maxLength, ipType) };
+}
+
+// 把应答拆成 PDU 列表
+function parsePdus(buffer) {
+    const pdus = [];
+    let offset = 0;
+    while (offset < buffer.length) {
+        const version = buffer[offset];
+        const type = buffer[offset + 1];
+        const length = buffer.readUInt32BE(offset + 4);
+        const pdu = { version, type, length };
+        if (type === RpkiConst.RPKI_MSG_TYPE.IPV4_PREFIX || type === RpkiConst.RPKI_MSG_TYPE.IPV6_PREFIX) {
+            pdu.announce = buffer[offset + RpkiConst.RPKI_HEADER_LENGTH] === RpkiConst.RPKI_FLAGS.UPDATE;
+            pdu.mask = buffer[offset + RpkiConst.RPKI_HEADER_LENGTH + 1];
+            pdu.asn = buffer.readUInt32BE(offset + length - 4);
+        } else if (type === RpkiConst.RPKI_MSG_TYPE.END_OF_DATA) {
+            pdu.serial = buffer.readUInt32BE(offset + RpkiConst.RPKI_HEADER_LENGTH);
+        }
+        pdus.push(pdu);
+        offset += length;
+    }
+    assert.strictEqual(offset, buffer.length, 'PDU 长度之和应等于应答长度');
+    return pdus;
+}
+
+function prefixes(pdus) {
+    return pdus
+        .filter(pdu => pdu.announce !== undefined)
+        .map(pdu => `${pdu.announce ? '+' : '-'}${pdu.asn}/${pdu.mask}`);
+}
+
+const tests = {
+    'empty snapshot': () => {
+        const cache = new RpkiCache();
+        const pdus = parsePdus(cache.getSnapshot(V0));
+        assert.deepStrictEqual(
+            pdus.map(pdu => pdu.type),
+            [RpkiConst.RPKI_MSG_TYPE.CACHE_RESPONSE, RpkiConst.RPKI_MSG_TYPE.END_OF_DATA]
+        );
+        assert.strictEqual(pdus[1].serial, 0);
+    },
+
+    'commit bumps serial and snapshot is reused until next commit': () => {
+        const cache = new RpkiCache();
+        const a = roa('10.0.0.0', 8, 65001, 24);
+        const b = roa('2001:db8::', 32, 65002, 48);
+        assert.ok(cache.addRoa(a.key, a.roa));
+        assert.ok(!cache.addRoa(a.key, a.roa), '重复添加应返回 false');
+        cache.addRoa(b.key, b.roa);
+        assert.ok(cache.commit());
+        assert.strictEqual(cache.serial, 1);
+        assert.ok(!cache.commit(), '没有变化时不应生成新序列号');
+
+        const snapshot = cache.getSnapshot(V0);
+        assert.strictEqual(cache.getSnapshot(V0), snapshot, '同一序列号应复用同一个 Buffer');
+        assert.deepStrictEqual(prefixes(parsePdus(snapshot)), ['+65001/8', '+65002/32']);
+
+        cache.deleteRoa(a.key);
+        cache.commit();
+        assert.notStrictEqual(cache.getSnapshot(V0), snapshot, '提交后快照应重新构建');
+    },
+
+    'delta merges serials and orders withdrawals first': () => {
+        const cache = new RpkiCache();
+        const a = roa('10.0.0.0', 8, 65001, 24);
+        const b = roa('10.1.0.0', 16, 65002, 24);
+        const c = roa('10.2.0.0', 16, 65003, 24);
+        cache.addRoa(a.key, a.roa);
+        cache.addRoa(b.key, b.roa);
+        cache.commit(); // serial 1
+        cache.deleteRoa(b.key);
+        cache.addRoa(c.key, c.roa);
+        cache.commit(); // serial 2
+
+        const from1 = parsePdus(cache.getDelta(V0, 1));
+        assert.deepStrictEqual(prefixes(from1), ['-65002/16', '+65003/16']);
+        assert.strictEqual(from1[from1.length - 1].serial, 2);
+
+        // b 在 1 中公告、在 2 中撤销，相对 0 没有净变化
+        assert.deepStrictEqual(prefixes(parsePdus(cache.getDelta(V0, 0))), ['+65001/8', '+65003/16']);
+
+        // 已是最新序列号时只有 Cache Response 和 End of Data
+        assert.deepStrictEqual(prefixes(parsePdus(cache.getDelta(V0, 2))), []);
+    },
+
+    'add and delete within one batch cancel out': () => {
+        const cache = new RpkiCache();
+        const a = roa('10.0.0.0', 8, 65001, 24);
+        cache.addRoa(a.key, a.roa);
+        cache.deleteRoa(a.key);
+        assert.ok(!cache.hasPendingChanges());
+        assert.ok(!cache.commit());
+        assert.strictEqual(cache.serial, 0);
+    },
+
+    'expired history or unknown serial needs cache reset': () => {
+        const cache = new RpkiCache(2);
+        for (let i = 0; i < 3; i++) {
+            const r = roa(`10.${i}.0.0`, 16, 65000 + i, 24);
+            cache.addRoa(r.key, r.roa);
+            cache.commit();
+        }
+        assert.strictEqual(cache.getDelta(V0, 0), null, '序列号 1 已被淘汰');
+        assert.notStrictEqual(cache.getDelta(V0, 1), null);
+        assert.strictEqual(cache.getDelta(V0, 100), null);
+    },
+
+    'version 1 responses carry the version and timing fields': () => {
+        const cache = new RpkiCache();
+        const a = roa('10.0.0.0', 8, 65001, 24);
+        cache.addRoa(a.key, a.roa);
+        cache.commit();
+        const pdus = parsePdus(cache.getSnapshot(V1));
+        assert.ok(pdus.every(pdu => pdu.version === V1));
+        assert.strictEqual(pdus[pdus.length - 1].length, RpkiConst.RPKI_HEADER_LENGTH + 16);
+        // 版本 0 的模板不受影响
+        assert.ok(parsePdus(cache.getSnapshot(V0)).every(pdu => pdu.version === V0));
+    },
+
+    'serial wraps around': () => {
+        const cache = new RpkiCache();
+        cache.serial = 0xffffffff;
+        const a = roa('10.0.0.0', 8, 65001, 24);
+        cache.addRoa(a.key, a.roa);
+        cache.commit();
+        assert.strictEqual(cache.serial, 0);
+        assert.deepStrictEqual(prefixes(parsePdus(cache.getDelta(V0, 0xffffffff))), ['+65001/8']);
+    }
+};
+
+function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };
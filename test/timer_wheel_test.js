@@ -0,0 +1,148 @@
+/**
+ * 分层定时轮测试
+ * 使用方法: node test/timer_wheel_test.js
+ *
+ * 通过拨动定时轮的起点模拟时间流逝，检查各层的到期精度、跨层下放、超出顶层范围的定时器、
+ * 重新调度、取消以及回调出错时其他定时器不受影响
+ */
+
+const assert = require('assert');
+const TimerWheel = require('../electron/utils/timerWheel');
+
+// 让定时轮前进 ms 毫秒
+function elapse(wheel, ms) {
+    wheel.origin -= ms;
+    wheel.advance();
+}
+
+// 逐 tick 推进，返回定时器在第几个 tick 触发
+function fireTick(wheel, delayMs, maxTicks) {
+    let fired = -1;
+    const timer = wheel.createTimer(() => {
+        fired = wheel.tick;
+    });
+    const start = wheel.tick;
+    wheel.schedule(timer, delayMs);
+    for (let i = 0; i < maxTicks && fired < 0; i++) {
+        elapse(wheel, wheel.tickMs);
+    }
+    return fired < 0 ? -1 : fired - start;
+}
+
+const tests = {
+    'timers on every level fire on their tick': () => {
+        // 2 层时顶层之上的定时器也走这条路径
+        for (const levels of [2, 4]) {
+            const wheel = new TimerWheel(10, levels);
+            for (const ticks of [1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 10000]) {
+                assert.strictEqual(fireTick(wheel, ticks * 10, ticks + 2), ticks, `${levels} 层, ${ticks} tick`);
+            }
+            assert.strictEqual(wheel.size, 0);
+        }
+    },
+
+    'delay is rounded up to whole ticks and at least one tick': () => {
+        const wheel = new TimerWheel(100);
+        assert.strictEqual(fireTick(wheel, 0, 5), 1);
+        assert.strictEqual(fireTick(wheel, 101, 5), 2);
+    },
+
+    'a long jump fires all due timers in order': () => {
+        const wheel = new TimerWheel(10);
+        const fired = [];
+        for (const ms of [5000, 50, 700000, 650]) {
+            wheel.schedule(wheel.createTimer(() => fired.push(ms)), ms);
+        }
+        elapse(wheel, 10000);
+        assert.deepStrictEqual(fired, [50, 650, 5000]);
+        assert.strictEqual(wheel.size, 1);
+        elapse(wheel, 700000);
+        assert.deepStrictEqual(fired, [50, 650, 5000, 700000]);
+    },
+
+    'schedule replaces the previous deadline and cancel removes it': () => {
+        const wheel = new TimerWheel(10);
+        let count = 0;
+        const timer = wheel.createTimer(() => count++);
+        wheel.schedule(timer, 100);
+        wheel.schedule(timer, 1000);
+        assert.strictEqual(wheel.size, 1);
+        elapse(wheel, 500);
+        assert.strictEqual(count, 0, '第一次调度应被替换');
+        assert.ok(wheel.isScheduled(timer));
+        wheel.cancel(timer);
+        wheel.cancel(timer);
+        assert.ok(!wheel.isScheduled(timer));
+        assert.strictEqual(wheel.size, 0);
+        elapse(wheel, 1000);
+        assert.strictEqual(count, 0);
+
+        // 取消后可以再次调度，回调中也可以重新调度自己
+        const periodic = wheel.createTimer(() => {
+            count++;
+            wheel.schedule(periodic, 100);
+        });
+        wheel.schedule(periodic, 100);
+        for (let i = 0; i < 5; i++) {
+            elapse(wheel, 100);
+        }
+        assert.strictEqual(count, 5);
+    },
+
+    'a throwing callback does not stop other timers': () => {
+        const wheel = new TimerWheel(10);
+        let fired = false;
+        wheel.schedule(
+            wheel.createTimer(() => {
+                throw new Error('boom');
+            }),
+            50
+        );
+        wheel.schedule(
+            wheel.createTimer(() => {
+                fired = true;
+            }),
+            50
+        );
+        elapse(wheel, 50);
+        assert.ok(fired);
+        assert.strictEqual(wheel.size, 0);
+    },
+
+    'start and stop drive the wheel from setInterval': async () => {
+        const wheel = new TimerWheel(5);
+        let fired = false;
+        wheel.schedule(
+            wheel.createTimer(() => {
+                fired = true;
+            }),
+            20
+        );
+        wheel.start();
+        wheel.start();
+        await new Promise(resolve => setTimeout(resolve, 100));
+        wheel.stop();
+        assert.ok(fired);
+        assert.strictEqual(wheel.interval, null);
+    }
+};
+
+async function runTests() {
+    let failed = 0;
+    for (const [name, test] of Object.entries(tests)) {
+        try {
+            await test();
+            console.log(`✅ ${name}`);
+        } catch (error) {
+            failed++;
+            console.log(`❌ ${name}: ${error.message}`);
+        }
+    }
+    process.exitCode = failed > 0 ? 1 : 0;
+}
+
+if (require.main === module) {
+    runTests();
+}
+
+module.exports = { runTests };